@@ -0,0 +1,259 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pch.h"
+
+#include <d3dcompiler.h>
+
+#include <DeviceResources.h>
+#include <DXUtilities.h>
+
+#include "BilinearRenderer.h"
+#include "ShaderCompiler.h"
+
+namespace
+{
+    using namespace nis_scaler;
+
+    // The texture coordinates follow NIS: the output pixel (x, y) samples the input at ((x + 0.5) * scale) in the input
+    // viewport, so that both shaders line up. The Z index of the dispatch selects the view. The samples are clamped to the
+    // input viewport, so that the views of a texture atlas do not bleed into each other.
+    // A multisampled input cannot be sampled with a filter: the 4 texels around each sample are loaded, each of them
+    // resolved from its samples, and interpolated in the shader.
+    const std::string bilinearShaderSource = R"_(
+struct View
+{
+    float2 scale;
+    float2 inputOrigin;
+    float2 inputMin;
+    float2 inputMax;
+    uint2 outputOrigin;
+    uint2 outputSize;
+    uint2 excludedMin;
+    uint2 excludedMax;
+    uint inputSlice;
+    uint outputSlice;
+    uint isSrgbOutput;
+};
+
+cbuffer cb : register(b0)
+{
+    View kViews[MAX_VIEWS];
+};
+
+#if SAMPLE_COUNT > 1
+cbuffer weights : register(b1)
+{
+    float4 kSampleWeights[(SAMPLE_COUNT + 3) / 4];
+};
+
+Texture2DMSArray<float4, SAMPLE_COUNT> in_texture : register(t0);
+
+float4 LoadResolved(int2 texel, uint slice)
+{
+    float4 color = 0;
+    [unroll]
+    for (uint i = 0; i < SAMPLE_COUNT; i++)
+    {
+        color += kSampleWeights[i / 4][i % 4] * in_texture.Load(int3(texel, slice), i);
+    }
+    return color;
+}
+
+float4 SampleResolved(float2 texcoord, View view)
+{
+    uint width, height, elements, samples;
+    in_texture.GetDimensions(width, height, elements, samples);
+    const float2 size = float2(width, height);
+
+    const float2 position = texcoord * size - 0.5f;
+    const float2 fraction = frac(position);
+    const int2 texel0 = int2(floor(position));
+    const int2 texel1 = min(texel0 + 1, int2(view.inputMax * size));
+
+    const float4 row0 = lerp(LoadResolved(texel0, view.inputSlice), LoadResolved(int2(texel1.x, texel0.y), view.inputSlice), fraction.x);
+    const float4 row1 = lerp(LoadResolved(int2(texel0.x, texel1.y), view.inputSlice), LoadResolved(texel1, view.inputSlice), fraction.x);
+    return lerp(row0, row1, fraction.y);
+}
+#else
+Texture2DArray<float4> in_texture : register(t0);
+SamplerState samplerLinearClamp : register(s0);
+#endif
+RWTexture2DArray<float4> out_texture : register(u0);
+
+// The sRGB textures written through a UNORM alias are encoded here, like an _SRGB view would.
+float4 EncodeOutput(float4 color, View view)
+{
+    if (view.isSrgbOutput)
+    {
+        const float3 linearColor = saturate(color.rgb);
+        color.rgb = linearColor <= 0.0031308f ? linearColor * 12.92f : 1.055f * pow(linearColor, 1.f / 2.4f) - 0.055f;
+    }
+    return color;
+}
+
+[numthreads(8, 8, 1)]
+void main(uint3 id : SV_DispatchThreadID)
+{
+    const View view = kViews[id.z];
+    if (any(id.xy >= view.outputSize) || (all(id.xy >= view.excludedMin) && all(id.xy < view.excludedMax)))
+    {
+        return;
+    }
+
+    const float2 texcoord = clamp(view.inputOrigin + (id.xy + 0.5f) * view.scale, view.inputMin, view.inputMax);
+#if SAMPLE_COUNT > 1
+    const float4 color = SampleResolved(texcoord, view);
+#else
+    const float4 color = in_texture.SampleLevel(samplerLinearClamp, float3(texcoord, view.inputSlice), 0);
+#endif
+    out_texture[uint3(view.outputOrigin + id.xy, view.outputSlice)] = EncodeOutput(color, view);
+}
+    )_";
+
+    constexpr uint32_t ThreadGroupSize = 8;
+
+    bool IsOverlapping(const BilinearView& a, const BilinearView& b)
+    {
+        return a.outputSlice == b.outputSlice && a.outputViewport.x < b.outputViewport.x + b.outputViewport.width &&
+               b.outputViewport.x < a.outputViewport.x + a.outputViewport.width && a.outputViewport.y < b.outputViewport.y + b.outputViewport.height &&
+               b.outputViewport.y < a.outputViewport.y + a.outputViewport.height;
+    }
+}
+
+namespace nis_scaler
+{
+    BilinearRenderer::BilinearRenderer(DeviceResources& deviceResources,
+                                       ShaderCache* const shaderCache,
+                                       const uint32_t sampleCount,
+                                       const float* const sampleWeights)
+        : m_deviceResources(deviceResources), m_sampleCount(sampleCount)
+    {
+        const std::string maxViews = std::to_string(MaxViews);
+        const std::string sampleCountString = std::to_string(sampleCount);
+        const D3D_SHADER_MACRO defines[] = {
+            { "MAX_VIEWS", maxViews.c_str() },
+            { "SAMPLE_COUNT", sampleCountString.c_str() },
+            { nullptr, nullptr }
+        };
+        const std::vector<uint8_t> shaderBytes = CompileShader(shaderCache, bilinearShaderSource, "bilinear", {}, defines, "main", "cs_5_0",
+                                                               D3DCOMPILE_ENABLE_STRICTNESS | D3DCOMPILE_WARNINGS_ARE_ERRORS | D3DCOMPILE_OPTIMIZATION_LEVEL3);
+        DX::ThrowIfFailed(m_deviceResources.device()->CreateComputeShader(shaderBytes.data(), shaderBytes.size(), nullptr, m_computeShader.GetAddressOf()));
+
+        ViewConstants constants[MaxViews]{};
+        m_deviceResources.createConstBuffer(constants, sizeof(constants), m_constantBuffer.GetAddressOf());
+        m_deviceResources.createLinearClampSampler(m_linearClampSampler.GetAddressOf());
+
+        // The weights do not change: they are packed in float4 like the array of the shader.
+        if (sampleCount > 1)
+        {
+            float weights[MaxSampleCount]{};
+            std::copy(sampleWeights, sampleWeights + sampleCount, weights);
+            m_deviceResources.createConstBuffer(weights, sizeof(weights), m_sampleWeightsBuffer.GetAddressOf());
+        }
+    }
+
+    bool BilinearRenderer::update(const BilinearView* const views,
+                                  const uint32_t viewCount,
+                                  const uint32_t inputWidth,
+                                  const uint32_t inputHeight,
+                                  const bool isSrgbOutput)
+    {
+        if (m_isValid && viewCount == m_viewCount && inputWidth == m_inputWidth && inputHeight == m_inputHeight && isSrgbOutput == m_isSrgbOutput &&
+            std::equal(views, views + viewCount, m_views))
+        {
+            return true;
+        }
+
+        m_isValid = viewCount && viewCount <= MaxViews && inputWidth && inputHeight;
+        for (uint32_t i = 0; m_isValid && i < viewCount; i++)
+        {
+            const BilinearView& view = views[i];
+            m_isValid = view.inputViewport.width && view.inputViewport.height && view.outputViewport.width && view.outputViewport.height;
+            for (uint32_t j = 0; m_isValid && j < i; j++)
+            {
+                m_isValid = !IsOverlapping(view, views[j]);
+            }
+        }
+        if (!m_isValid)
+        {
+            return false;
+        }
+
+        std::copy(views, views + viewCount, m_views);
+        m_viewCount = viewCount;
+        m_inputWidth = inputWidth;
+        m_inputHeight = inputHeight;
+        m_isSrgbOutput = isSrgbOutput;
+
+        // The coordinates are normalized to the input texture.
+        ViewConstants constants[MaxViews]{};
+        m_maxOutputWidth = m_maxOutputHeight = 0;
+        for (uint32_t i = 0; i < viewCount; i++)
+        {
+            const BilinearView& view = views[i];
+            ViewConstants& viewConstants = constants[i];
+            viewConstants.scale[0] = (float)view.inputViewport.width / view.outputViewport.width / inputWidth;
+            viewConstants.scale[1] = (float)view.inputViewport.height / view.outputViewport.height / inputHeight;
+            viewConstants.inputOrigin[0] = (float)view.inputViewport.x / inputWidth;
+            viewConstants.inputOrigin[1] = (float)view.inputViewport.y / inputHeight;
+            viewConstants.inputMin[0] = (view.inputViewport.x + 0.5f) / inputWidth;
+            viewConstants.inputMin[1] = (view.inputViewport.y + 0.5f) / inputHeight;
+            viewConstants.inputMax[0] = (view.inputViewport.x + view.inputViewport.width - 0.5f) / inputWidth;
+            viewConstants.inputMax[1] = (view.inputViewport.y + view.inputViewport.height - 0.5f) / inputHeight;
+            viewConstants.outputOrigin[0] = view.outputViewport.x;
+            viewConstants.outputOrigin[1] = view.outputViewport.y;
+            viewConstants.outputSize[0] = view.outputViewport.width;
+            viewConstants.outputSize[1] = view.outputViewport.height;
+            viewConstants.excludedMin[0] = view.excludedViewport.x;
+            viewConstants.excludedMin[1] = view.excludedViewport.y;
+            viewConstants.excludedMax[0] = view.excludedViewport.x + view.excludedViewport.width;
+            viewConstants.excludedMax[1] = view.excludedViewport.y + view.excludedViewport.height;
+            viewConstants.inputSlice = view.inputSlice;
+            viewConstants.outputSlice = view.outputSlice;
+            viewConstants.isSrgbOutput = isSrgbOutput;
+
+            m_maxOutputWidth = (std::max)(m_maxOutputWidth, view.outputViewport.width);
+            m_maxOutputHeight = (std::max)(m_maxOutputHeight, view.outputViewport.height);
+        }
+        m_deviceResources.updateConstBuffer(constants, sizeof(constants), m_constantBuffer.Get());
+
+        return true;
+    }
+
+    void BilinearRenderer::dispatch(ID3D11ShaderResourceView* const* input, ID3D11UnorderedAccessView* const* output)
+    {
+        if (!m_isValid)
+        {
+            return;
+        }
+
+        ID3D11DeviceContext* const context = m_deviceResources.context();
+        context->CSSetShaderResources(0, 1, input);
+        context->CSSetUnorderedAccessViews(0, 1, output, nullptr);
+        context->CSSetSamplers(0, 1, m_linearClampSampler.GetAddressOf());
+        context->CSSetConstantBuffers(0, 1, m_constantBuffer.GetAddressOf());
+        if (m_sampleCount > 1)
+        {
+            context->CSSetConstantBuffers(1, 1, m_sampleWeightsBuffer.GetAddressOf());
+        }
+        context->CSSetShader(m_computeShader.Get(), nullptr, 0);
+
+        // The thread groups cover the largest output viewport, for each view. The groups outside of the viewport of their
+        // view, or within its excluded viewport, end immediately.
+        context->Dispatch((m_maxOutputWidth + ThreadGroupSize - 1) / ThreadGroupSize, (m_maxOutputHeight + ThreadGroupSize - 1) / ThreadGroupSize, m_viewCount);
+    }
+}
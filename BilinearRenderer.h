@@ -0,0 +1,110 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "MsaaResolve.h"
+#include "NISRenderer.h"
+
+class DeviceResources;
+
+namespace nis_scaler
+{
+    // A view processed by BilinearRenderer: a region of a slice of the input, upscaled to a region of a slice of the
+    // output. The samples are clamped to the input viewport. The excluded viewport is relative to the output viewport, and
+    // may be empty.
+    struct BilinearView
+    {
+        uint32_t inputSlice;
+        NISViewport inputViewport;
+        uint32_t outputSlice;
+        NISViewport outputViewport;
+        NISViewport excludedViewport;
+
+        bool operator==(const BilinearView& other) const
+        {
+            return inputSlice == other.inputSlice && inputViewport == other.inputViewport && outputSlice == other.outputSlice &&
+                   outputViewport == other.outputViewport && excludedViewport == other.excludedViewport;
+        }
+    };
+
+    // Upscale regions of the input texture to regions of the output texture with bilinear filtering, sampling the input at
+    // the same positions as NISRenderer. A part of each output region can be skipped, which is how the periphery is filled
+    // around the center region processed with NIS for foveated scaling.
+    // Several views are processed with a single dispatch, one view per Z index: the slices of a texture array (VPRT), or
+    // side-by-side regions of a texture. The textures are bound as arrays, including textures with a single slice.
+    // A multisampled input is resolved while it is read, without a resolved copy of the texture.
+    class BilinearRenderer
+    {
+    public:
+        static constexpr uint32_t MaxViews = 4;
+
+        // Compile the shader for an input with sampleCount samples per pixel, or load it from the cache (if any). With
+        // several samples, the input is resolved with sampleWeights (see GetMsaaResolveWeights()).
+        BilinearRenderer(DeviceResources& deviceResources, ShaderCache* shaderCache, uint32_t sampleCount = 1, const float* sampleWeights = nullptr);
+
+        // Update the constants of the shader. This is a no-op when nothing changed. The output regions of the views must
+        // not overlap. Returns false for invalid views. With isSrgbOutput, the linear values are encoded to sRGB when
+        // they are written, for an sRGB texture written through a UNORM view.
+        bool update(const BilinearView* views, uint32_t viewCount, uint32_t inputWidth, uint32_t inputHeight, bool isSrgbOutput);
+
+        // The input is a Texture2DArray SRV (Texture2DMSArray when multisampled), and the output a Texture2DArray UAV.
+        void dispatch(ID3D11ShaderResourceView* const* input, ID3D11UnorderedAccessView* const* output);
+
+        uint32_t sampleCount() const
+        {
+            return m_sampleCount;
+        }
+
+    private:
+        // The layout of the constant buffer of the shader, for each view.
+        struct ViewConstants
+        {
+            float scale[2];
+            float inputOrigin[2];
+            float inputMin[2];
+            float inputMax[2];
+            uint32_t outputOrigin[2];
+            uint32_t outputSize[2];
+            uint32_t excludedMin[2];
+            uint32_t excludedMax[2];
+            uint32_t inputSlice;
+            uint32_t outputSlice;
+            uint32_t isSrgbOutput;
+            uint32_t padding;
+        };
+
+        DeviceResources& m_deviceResources;
+        const uint32_t m_sampleCount;
+
+        Microsoft::WRL::ComPtr<ID3D11ComputeShader> m_computeShader;
+        Microsoft::WRL::ComPtr<ID3D11Buffer> m_constantBuffer;
+        Microsoft::WRL::ComPtr<ID3D11Buffer> m_sampleWeightsBuffer;
+        Microsoft::WRL::ComPtr<ID3D11SamplerState> m_linearClampSampler;
+
+        // The parameters of the last update().
+        bool m_isValid{ false };
+        BilinearView m_views[MaxViews]{};
+        uint32_t m_viewCount{ 0 };
+        uint32_t m_inputWidth{ 0 };
+        uint32_t m_inputHeight{ 0 };
+        bool m_isSrgbOutput{ false };
+
+        // The size of the dispatch, covering the largest output viewport.
+        uint32_t m_maxOutputWidth{ 0 };
+        uint32_t m_maxOutputHeight{ 0 };
+    };
+}
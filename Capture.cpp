@@ -0,0 +1,393 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// This file does not use the precompiled header, so it can be shared with the tools.
+
+#include "Capture.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+#include "Log.h"
+
+namespace
+{
+    using namespace nis_scaler;
+
+    template <typename T>
+    bool ReadStruct(std::ifstream& file, const uint64_t offset, T& value)
+    {
+        file.clear();
+        file.seekg(offset);
+        file.read(reinterpret_cast<char*>(&value), sizeof(T));
+        return !!file;
+    }
+}
+
+namespace nis_scaler
+{
+    std::string CaptureFileName(const std::string& applicationName, const std::time_t time)
+    {
+        char datetime[1024];
+        std::strftime(datetime, sizeof(datetime), "%Y%m%d_%H%M%S", std::localtime(&time));
+
+        return applicationName + "_" + datetime + ".nisc";
+    }
+
+    CaptureWriter::~CaptureWriter()
+    {
+        // We may be called with the loader lock held, where waiting for the thread could deadlock.
+        finish();
+        if (m_thread.joinable())
+        {
+            m_thread.detach();
+        }
+    }
+
+    bool CaptureWriter::open(const std::string& path, const std::string& applicationName, const size_t maxPendingBytes)
+    {
+        if (isWriting())
+        {
+            return false;
+        }
+        if (m_thread.joinable())
+        {
+            // The previous capture is complete: this does not block.
+            m_thread.join();
+        }
+
+        m_file.clear();
+        m_file.open(path, std::ios_base::binary | std::ios_base::trunc);
+        CaptureFileHeader header{};
+        header.magic = CaptureFileMagic;
+        header.version = CaptureFileVersion;
+        header.indexOffset = 0;
+        strncpy(header.applicationName, applicationName.c_str(), sizeof(header.applicationName) - 1);
+        m_file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        if (!m_file)
+        {
+            m_file.close();
+            return false;
+        }
+
+        m_path = path;
+        m_offset = sizeof(header);
+        m_index.clear();
+        {
+            std::unique_lock lock(m_mutex);
+            m_maxAllocatedBytes = maxPendingBytes;
+            m_droppedFrames = 0;
+            m_bufferSize = 0;
+            m_isFinishing = false;
+            m_isDone = false;
+        }
+        m_thread = std::thread([this]() { writerThread(); });
+
+        return true;
+    }
+
+    void CaptureWriter::reserve(const size_t size)
+    {
+        bool needsBuffer;
+        {
+            std::unique_lock lock(m_mutex);
+            m_bufferSize = (std::max)(m_bufferSize, size);
+            needsBuffer = needsBufferLocked();
+        }
+        if (needsBuffer)
+        {
+            m_wakeUp.notify_one();
+        }
+    }
+
+    bool CaptureWriter::allocate(const size_t size, std::vector<uint8_t>& buffer)
+    {
+        bool needsBuffer;
+        {
+            std::unique_lock lock(m_mutex);
+            if (m_isDone || m_isFinishing)
+            {
+                return false;
+            }
+
+            // Give up the buffers allocated before larger frames came in.
+            m_bufferSize = (std::max)(m_bufferSize, size);
+            while (!m_freeBuffers.empty() && m_freeBuffers.back().capacity() < m_bufferSize)
+            {
+                m_allocatedBytes -= m_freeBuffers.back().capacity();
+                m_freeBuffers.pop_back();
+            }
+
+            if (!m_freeBuffers.empty())
+            {
+                buffer = std::move(m_freeBuffers.back());
+                m_freeBuffers.pop_back();
+            }
+            else
+            {
+                m_droppedFrames++;
+            }
+            needsBuffer = needsBufferLocked();
+        }
+        if (needsBuffer)
+        {
+            m_wakeUp.notify_one();
+        }
+        if (buffer.capacity() < size)
+        {
+            return false;
+        }
+
+        buffer.resize(size);
+        return true;
+    }
+
+    void CaptureWriter::submit(CapturedFrame&& frame)
+    {
+        {
+            std::unique_lock lock(m_mutex);
+            m_queue.push_back(std::move(frame));
+        }
+        m_wakeUp.notify_one();
+    }
+
+    void CaptureWriter::reportDropped(const uint64_t count)
+    {
+        std::unique_lock lock(m_mutex);
+        m_droppedFrames += count;
+    }
+
+    void CaptureWriter::finish()
+    {
+        {
+            std::unique_lock lock(m_mutex);
+            m_isFinishing = true;
+        }
+        m_wakeUp.notify_all();
+    }
+
+    void CaptureWriter::close()
+    {
+        finish();
+        if (m_thread.joinable())
+        {
+            m_thread.join();
+        }
+    }
+
+    bool CaptureWriter::isWriting()
+    {
+        std::unique_lock lock(m_mutex);
+        return !m_isDone;
+    }
+
+    bool CaptureWriter::needsBufferLocked() const
+    {
+        // Always allow one buffer, even above the budget, so that large frames can be captured.
+        return !m_isFinishing && m_bufferSize && m_freeBuffers.size() < MinFreeBuffers &&
+               (!m_allocatedBytes || m_allocatedBytes + m_bufferSize <= m_maxAllocatedBytes);
+    }
+
+    void CaptureWriter::writerThread()
+    {
+        bool writeFailed = false;
+        while (true)
+        {
+            CapturedFrame frame;
+            size_t bufferSize = 0;
+            {
+                std::unique_lock lock(m_mutex);
+                m_wakeUp.wait(lock, [&]() { return m_isFinishing || !m_queue.empty() || needsBufferLocked(); });
+                // Writing a frame also returns a buffer to the pool, so it comes first unless the pool is empty.
+                if (needsBufferLocked() && (m_queue.empty() || m_freeBuffers.empty()))
+                {
+                    bufferSize = m_bufferSize;
+                    m_allocatedBytes += bufferSize;
+                }
+                else if (!m_queue.empty())
+                {
+                    frame = std::move(m_queue.front());
+                    m_queue.pop_front();
+                }
+                else
+                {
+                    // Only stop once all the frames are written.
+                    break;
+                }
+            }
+
+            if (bufferSize)
+            {
+                // Touching new memory can take several milliseconds: this is done here rather than in allocate().
+                std::vector<uint8_t> buffer(bufferSize);
+                std::unique_lock lock(m_mutex);
+                m_freeBuffers.push_back(std::move(buffer));
+                continue;
+            }
+
+            if (!writeFailed)
+            {
+                CaptureChunkHeader chunk{};
+                chunk.type = CaptureChunkFrame;
+                chunk.size = sizeof(CaptureFrameRecord) + frame.pixels.size();
+                m_file.write(reinterpret_cast<const char*>(&chunk), sizeof(chunk));
+                m_file.write(reinterpret_cast<const char*>(&frame.record), sizeof(frame.record));
+                m_file.write(reinterpret_cast<const char*>(frame.pixels.data()), frame.pixels.size());
+                if (m_file)
+                {
+                    m_index.push_back({ m_offset, frame.record });
+                    m_offset += sizeof(chunk) + chunk.size;
+                }
+                else
+                {
+                    Log("Failed to write capture to %s\n", m_path.c_str());
+                    writeFailed = true;
+                }
+            }
+
+            // Buffers smaller than the largest frames are given up, so that any free buffer fits any frame.
+            std::unique_lock lock(m_mutex);
+            if (frame.pixels.capacity() >= m_bufferSize)
+            {
+                m_freeBuffers.push_back(std::move(frame.pixels));
+            }
+            else
+            {
+                m_allocatedBytes -= frame.pixels.capacity();
+            }
+        }
+
+        // Complete the file with the index. Until the header points to it, readers can still recover the frames.
+        if (!writeFailed)
+        {
+            CaptureChunkHeader chunk{};
+            chunk.type = CaptureChunkIndex;
+            chunk.size = m_index.size() * sizeof(CaptureIndexEntry);
+            m_file.write(reinterpret_cast<const char*>(&chunk), sizeof(chunk));
+            m_file.write(reinterpret_cast<const char*>(m_index.data()), chunk.size);
+            m_file.flush();
+            m_file.seekp(offsetof(CaptureFileHeader, indexOffset));
+            m_file.write(reinterpret_cast<const char*>(&m_offset), sizeof(m_offset));
+        }
+        m_file.close();
+
+        uint64_t droppedFrames;
+        {
+            std::unique_lock lock(m_mutex);
+            droppedFrames = m_droppedFrames;
+        }
+        if (!writeFailed && m_file)
+        {
+            Log("Capture saved to %s (%llu frames, %llu dropped)\n", m_path.c_str(), (uint64_t)m_index.size(), droppedFrames);
+        }
+
+        // Release the buffers, which can be large. No more frames can be submitted at this point.
+        std::unique_lock lock(m_mutex);
+        m_freeBuffers.clear();
+        m_allocatedBytes = 0;
+        m_isDone = true;
+    }
+
+    bool CaptureReader::open(const std::string& path)
+    {
+        m_file.close();
+        m_file.clear();
+        m_frames.clear();
+        m_isComplete = false;
+
+        m_file.open(path, std::ios_base::binary);
+        if (!m_file)
+        {
+            return false;
+        }
+        m_file.seekg(0, std::ios_base::end);
+        m_fileSize = (uint64_t)m_file.tellg();
+
+        CaptureFileHeader header;
+        if (!ReadStruct(m_file, 0, header) || header.magic != CaptureFileMagic || header.version != CaptureFileVersion)
+        {
+            return false;
+        }
+        m_applicationName.assign(header.applicationName, strnlen(header.applicationName, sizeof(header.applicationName)));
+
+        m_isComplete = header.indexOffset && readIndex(header.indexOffset);
+        if (!m_isComplete)
+        {
+            scanChunks();
+        }
+
+        return true;
+    }
+
+    bool CaptureReader::read(const CaptureIndexEntry& entry, std::vector<uint8_t>& pixels)
+    {
+        CaptureChunkHeader chunk;
+        if (!ReadStruct(m_file, entry.offset, chunk) || chunk.type != CaptureChunkFrame ||
+            chunk.size < sizeof(CaptureFrameRecord) || chunk.size > m_fileSize - entry.offset - sizeof(chunk))
+        {
+            return false;
+        }
+
+        pixels.resize(chunk.size - sizeof(CaptureFrameRecord));
+        m_file.seekg(entry.offset + sizeof(chunk) + sizeof(CaptureFrameRecord));
+        m_file.read(reinterpret_cast<char*>(pixels.data()), pixels.size());
+        return !!m_file;
+    }
+
+    bool CaptureReader::readIndex(const uint64_t offset)
+    {
+        CaptureChunkHeader chunk;
+        if (!ReadStruct(m_file, offset, chunk) || chunk.type != CaptureChunkIndex || chunk.size % sizeof(CaptureIndexEntry) ||
+            chunk.size > m_fileSize - offset - sizeof(chunk))
+        {
+            return false;
+        }
+
+        m_frames.resize(chunk.size / sizeof(CaptureIndexEntry));
+        m_file.read(reinterpret_cast<char*>(m_frames.data()), chunk.size);
+        if (!m_file)
+        {
+            m_frames.clear();
+            return false;
+        }
+        return true;
+    }
+
+    void CaptureReader::scanChunks()
+    {
+        uint64_t offset = sizeof(CaptureFileHeader);
+        CaptureChunkHeader chunk;
+        while (offset + sizeof(chunk) <= m_fileSize && ReadStruct(m_file, offset, chunk))
+        {
+            // Stop at the first incomplete chunk, which was being written when the capture was interrupted.
+            if (chunk.size > m_fileSize - offset - sizeof(chunk))
+            {
+                break;
+            }
+
+            CaptureIndexEntry entry;
+            entry.offset = offset;
+            if (chunk.type == CaptureChunkFrame && chunk.size >= sizeof(CaptureFrameRecord) &&
+                ReadStruct(m_file, offset + sizeof(chunk), entry.record))
+            {
+                m_frames.push_back(entry);
+            }
+
+            offset += sizeof(chunk) + chunk.size;
+        }
+    }
+}
@@ -0,0 +1,198 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <ctime>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Burst capture: consecutive frames of every view, streamed to a container file.
+//
+// The container is append-only and made of chunks:
+//
+//   CaptureFileHeader
+//   'FRAM' chunk: CaptureFrameRecord, then the pixels with tightly packed rows    (once per captured image)
+//   'INDX' chunk: one CaptureIndexEntry per frame chunk                            (once the capture is complete)
+//
+// The index offset in the header is written last. If the capture was interrupted, it is 0 and readers rebuild the
+// index by walking the chunks.
+
+namespace nis_scaler
+{
+    constexpr uint32_t CaptureFileMagic = 0x4353494e; // 'NISC'
+    constexpr uint32_t CaptureFileVersion = 1;
+    constexpr uint32_t CaptureChunkFrame = 0x4d415246; // 'FRAM'
+    constexpr uint32_t CaptureChunkIndex = 0x58444e49; // 'INDX'
+
+    struct CaptureFileHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t indexOffset; // Offset of the 'INDX' chunk header, or 0.
+        char applicationName[64];
+    };
+
+    struct CaptureChunkHeader
+    {
+        uint32_t type;
+        uint32_t reserved;
+        uint64_t size; // Size of the payload following this header.
+    };
+
+    // Which image of the view was captured.
+    enum class CaptureStage : uint32_t
+    {
+        Input = 0, // The application's image, at the rendering resolution.
+        Output,    // The image submitted to the runtime, at the display resolution.
+        EnumMax
+    };
+
+    struct CaptureFrameRecord
+    {
+        uint64_t frameIndex;  // The frame number within the capture.
+        int64_t displayTime;  // The XrTime of the frame.
+        uint32_t view;
+        CaptureStage stage;
+        uint32_t width;
+        uint32_t height;
+        uint32_t format;      // A DXGI_FORMAT.
+        uint32_t scalingMode; // 0: flat, 1: bilinear, 2: NIS.
+        float scaleFactor;
+        float sharpness;
+    };
+
+    struct CaptureIndexEntry
+    {
+        uint64_t offset; // Offset of the 'FRAM' chunk header.
+        CaptureFrameRecord record;
+    };
+
+    struct CapturedFrame
+    {
+        CaptureFrameRecord record;
+        std::vector<uint8_t> pixels;
+    };
+
+    // The file name for a capture, eg: FS2020_20211105_213000.nisc.
+    std::string CaptureFileName(const std::string& applicationName, std::time_t time);
+
+    // Write frames to a container from a background thread. The memory used by the frames waiting to be written is
+    // bounded: frames are dropped rather than queued when the disk cannot keep up. The pixel buffers come from a pool
+    // within that budget, which is filled by the writer thread so that the frame loop never allocates new memory.
+    class CaptureWriter
+    {
+    public:
+        ~CaptureWriter();
+
+        // Create the file and start the writer thread. Fails if a capture is still being written.
+        bool open(const std::string& path, const std::string& applicationName, size_t maxPendingBytes);
+
+        // Let the writer thread allocate buffers for frames of this size ahead of time.
+        void reserve(size_t size);
+
+        // Get a buffer for the pixels of a frame. Returns false (and counts the frame as dropped) if no buffer is free,
+        // typically because the frames waiting to be written already use the whole budget.
+        bool allocate(size_t size, std::vector<uint8_t>& buffer);
+
+        // Queue a frame, with pixels from allocate().
+        void submit(CapturedFrame&& frame);
+
+        // Count frames dropped before reaching the writer, so that they appear in the summary of the capture.
+        void reportDropped(uint64_t count);
+
+        // Finish the capture without waiting: the writer thread writes the remaining frames and the index.
+        void finish();
+
+        // Finish the capture and wait until it is written.
+        void close();
+
+        // Whether a capture is open or its frames are still being written.
+        bool isWriting();
+
+        // Only valid once the capture is closed.
+        uint64_t droppedFrames() const
+        {
+            return m_droppedFrames;
+        }
+
+    private:
+        // Buffers kept ready for the frame loop: enough for both stages of both views.
+        static constexpr size_t MinFreeBuffers = 4;
+
+        bool needsBufferLocked() const;
+        void writerThread();
+
+        std::ofstream m_file;
+        std::string m_path;
+        uint64_t m_offset{ 0 };
+        std::vector<CaptureIndexEntry> m_index;
+
+        std::mutex m_mutex;
+        std::condition_variable m_wakeUp;
+        std::deque<CapturedFrame> m_queue;
+        std::vector<std::vector<uint8_t>> m_freeBuffers;
+        size_t m_bufferSize{ 0 };
+        size_t m_allocatedBytes{ 0 };
+        size_t m_maxAllocatedBytes{ 0 };
+        uint64_t m_droppedFrames{ 0 };
+        bool m_isFinishing{ false };
+        bool m_isDone{ true };
+
+        std::thread m_thread;
+    };
+
+    // Read the frames of a container.
+    class CaptureReader
+    {
+    public:
+        bool open(const std::string& path);
+
+        // Whether the file has an index. Otherwise, the capture was interrupted and the frames were recovered.
+        bool isComplete() const
+        {
+            return m_isComplete;
+        }
+
+        const std::string& applicationName() const
+        {
+            return m_applicationName;
+        }
+
+        const std::vector<CaptureIndexEntry>& frames() const
+        {
+            return m_frames;
+        }
+
+        bool read(const CaptureIndexEntry& entry, std::vector<uint8_t>& pixels);
+
+    private:
+        bool readIndex(uint64_t offset);
+        void scanChunks();
+
+        std::ifstream m_file;
+        uint64_t m_fileSize{ 0 };
+        std::string m_applicationName;
+        std::vector<CaptureIndexEntry> m_frames;
+        bool m_isComplete{ false };
+    };
+}
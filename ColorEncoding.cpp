@@ -0,0 +1,104 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// This file does not use the precompiled header, so it can be shared with the tools.
+
+#include "ColorEncoding.h"
+
+#include <array>
+#include <cmath>
+
+namespace
+{
+    // The hardware tables are exact to within float precision, so they are computed once in double precision.
+    const std::array<float, 256>& GetSrgbDecodeTable()
+    {
+        static const std::array<float, 256> table = [] {
+            std::array<float, 256> values{};
+            for (uint32_t i = 0; i < 256; i++)
+            {
+                const double value = i / 255.0;
+                values[i] = (float)(value <= 0.04045 ? value / 12.92 : std::pow((value + 0.055) / 1.055, 2.4));
+            }
+            return values;
+        }();
+        return table;
+    }
+}
+
+namespace nis_scaler
+{
+    float SrgbToLinear(const float value)
+    {
+        return value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+    }
+
+    float LinearToSrgb(const float value)
+    {
+        return value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.f / 2.4f) - 0.055f;
+    }
+
+    uint32_t QuantizeUnorm(const float value, const uint32_t maxCode)
+    {
+        // NaN fails both comparisons and becomes 0.
+        if (!(value > 0.f))
+        {
+            return 0;
+        }
+        if (value >= 1.f)
+        {
+            return maxCode;
+        }
+        return (uint32_t)(value * maxCode + 0.5f);
+    }
+
+    uint8_t QuantizeUnorm8(const float value)
+    {
+        return (uint8_t)QuantizeUnorm(value, 255);
+    }
+
+    float DequantizeUnorm8(const uint8_t code)
+    {
+        return code / 255.f;
+    }
+
+    uint16_t QuantizeUnorm16(const float value)
+    {
+        return (uint16_t)QuantizeUnorm(value, 65535);
+    }
+
+    float DequantizeUnorm16(const uint16_t code)
+    {
+        return code / 65535.f;
+    }
+
+    float DecodeSrgb8(const uint8_t code)
+    {
+        return GetSrgbDecodeTable()[code];
+    }
+
+    uint8_t EncodeSrgb8(const float linear)
+    {
+        // Saturate first, the curve is only defined on [0, 1].
+        return QuantizeUnorm8(LinearToSrgb(linear > 0.f ? (linear < 1.f ? linear : 1.f) : 0.f));
+    }
+
+    uint8_t EncodeSrgb8InShader(const float linear)
+    {
+        const float value = linear > 0.f ? (linear < 1.f ? linear : 1.f) : 0.f;
+        return QuantizeUnorm8(value <= 0.0031308f ? value * 12.92f : 1.055f * std::exp2(std::log2(value) * (1.f / 2.4f)) - 0.055f);
+    }
+}
@@ -0,0 +1,44 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+
+namespace nis_scaler
+{
+    // The conversions applied by Direct3D to the UNORM and sRGB formats, used to reason about the color paths of the
+    // layer on the CPU. The sRGB curves are the exact ones from the Direct3D 11 specification.
+
+    // The sRGB transfer functions, for values in [0, 1].
+    float SrgbToLinear(float value);
+    float LinearToSrgb(float value);
+
+    // Convert a float to an n-bit UNORM code (saturating, NaN to 0, rounding to nearest) and back.
+    uint32_t QuantizeUnorm(float value, uint32_t maxCode);
+    uint8_t QuantizeUnorm8(float value);
+    float DequantizeUnorm8(uint8_t code);
+    uint16_t QuantizeUnorm16(float value);
+    float DequantizeUnorm16(uint16_t code);
+
+    // The value read through an _SRGB view of a texel, and the texel written through an _SRGB view for a linear value.
+    float DecodeSrgb8(uint8_t code);
+    uint8_t EncodeSrgb8(float linear);
+
+    // The texel written through a UNORM view of an sRGB texture by the scalers, which encode the linear value themselves
+    // (see EncodeOutput() in NISRenderer.cpp and BilinearRenderer.cpp). pow() is evaluated as exp2(log2()), like the GPU.
+    uint8_t EncodeSrgb8InShader(float linear);
+}
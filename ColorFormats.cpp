@@ -0,0 +1,390 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// This file does not use the precompiled header, so it can be shared with the tools.
+
+#include "ColorFormats.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iterator>
+
+#include "ColorEncoding.h"
+
+namespace
+{
+    using namespace nis_scaler;
+
+    // The DXGI formats in the table.
+    enum : uint32_t
+    {
+        FormatUnknown = 0,
+        FormatR32G32B32A32Float = 2,
+        FormatR16G16B16A16Typeless = 9,
+        FormatR16G16B16A16Float = 10,
+        FormatR16G16B16A16Unorm = 11,
+        FormatR10G10B10A2Typeless = 23,
+        FormatR10G10B10A2Unorm = 24,
+        FormatR11G11B10Float = 26,
+        FormatR8G8B8A8Typeless = 27,
+        FormatR8G8B8A8Unorm = 28,
+        FormatR8G8B8A8UnormSrgb = 29,
+        FormatR8G8B8A8Uint = 30,
+        FormatR8G8B8A8Snorm = 31,
+        FormatR8G8B8A8Sint = 32,
+        FormatB8G8R8A8Unorm = 87,
+        FormatB8G8R8X8Unorm = 88,
+        FormatB8G8R8A8Typeless = 90,
+        FormatB8G8R8A8UnormSrgb = 91,
+        FormatB8G8R8X8Typeless = 92,
+        FormatB8G8R8X8UnormSrgb = 93,
+    };
+
+    // The typeless formats are only used by the captures. They are read like the UNORM format of their family.
+    const ColorFormatInfo ColorFormats[] = {
+        { FormatR32G32B32A32Float, "R32G32B32A32_FLOAT", FormatUnknown, FormatR32G32B32A32Float, TexelLayout::RGBA32Float, 16, ScalerSupport::None, true },
+        { FormatR16G16B16A16Typeless, "R16G16B16A16_TYPELESS", FormatR16G16B16A16Typeless, FormatR16G16B16A16Typeless, TexelLayout::RGBA16Unorm, 8, ScalerSupport::None, false },
+        { FormatR16G16B16A16Float, "R16G16B16A16_FLOAT", FormatR16G16B16A16Typeless, FormatR16G16B16A16Float, TexelLayout::RGBA16Float, 8, ScalerSupport::Direct, true },
+        { FormatR16G16B16A16Unorm, "R16G16B16A16_UNORM", FormatR16G16B16A16Typeless, FormatR16G16B16A16Unorm, TexelLayout::RGBA16Unorm, 8, ScalerSupport::Direct, false },
+        { FormatR10G10B10A2Typeless, "R10G10B10A2_TYPELESS", FormatR10G10B10A2Typeless, FormatR10G10B10A2Typeless, TexelLayout::RGB10A2Unorm, 4, ScalerSupport::None, false },
+        { FormatR10G10B10A2Unorm, "R10G10B10A2_UNORM", FormatR10G10B10A2Typeless, FormatR10G10B10A2Unorm, TexelLayout::RGB10A2Unorm, 4, ScalerSupport::Direct, false },
+        { FormatR11G11B10Float, "R11G11B10_FLOAT", FormatUnknown, FormatR11G11B10Float, TexelLayout::RG11B10Float, 4, ScalerSupport::Direct, true },
+        { FormatR8G8B8A8Typeless, "R8G8B8A8_TYPELESS", FormatR8G8B8A8Typeless, FormatR8G8B8A8Typeless, TexelLayout::RGBA8Unorm, 4, ScalerSupport::None, false },
+        { FormatR8G8B8A8Unorm, "R8G8B8A8_UNORM", FormatR8G8B8A8Typeless, FormatR8G8B8A8Unorm, TexelLayout::RGBA8Unorm, 4, ScalerSupport::Direct, false },
+        { FormatR8G8B8A8UnormSrgb, "R8G8B8A8_UNORM_SRGB", FormatR8G8B8A8Typeless, FormatR8G8B8A8Unorm, TexelLayout::RGBA8Unorm, 4, ScalerSupport::Indirect, false },
+        { FormatR8G8B8A8Uint, "R8G8B8A8_UINT", FormatR8G8B8A8Typeless, FormatR8G8B8A8Uint, TexelLayout::RGBA8Uint, 4, ScalerSupport::Direct, false },
+        { FormatR8G8B8A8Snorm, "R8G8B8A8_SNORM", FormatR8G8B8A8Typeless, FormatR8G8B8A8Snorm, TexelLayout::RGBA8Snorm, 4, ScalerSupport::Direct, false },
+        { FormatR8G8B8A8Sint, "R8G8B8A8_SINT", FormatR8G8B8A8Typeless, FormatR8G8B8A8Sint, TexelLayout::RGBA8Sint, 4, ScalerSupport::Direct, false },
+        { FormatB8G8R8A8Unorm, "B8G8R8A8_UNORM", FormatB8G8R8A8Typeless, FormatB8G8R8A8Unorm, TexelLayout::BGRA8Unorm, 4, ScalerSupport::Direct, false },
+        { FormatB8G8R8X8Unorm, "B8G8R8X8_UNORM", FormatB8G8R8X8Typeless, FormatB8G8R8X8Unorm, TexelLayout::BGRX8Unorm, 4, ScalerSupport::None, false },
+        { FormatB8G8R8A8Typeless, "B8G8R8A8_TYPELESS", FormatB8G8R8A8Typeless, FormatB8G8R8A8Typeless, TexelLayout::BGRA8Unorm, 4, ScalerSupport::None, false },
+        { FormatB8G8R8A8UnormSrgb, "B8G8R8A8_UNORM_SRGB", FormatB8G8R8A8Typeless, FormatB8G8R8A8Unorm, TexelLayout::BGRA8Unorm, 4, ScalerSupport::Indirect, false },
+        { FormatB8G8R8X8Typeless, "B8G8R8X8_TYPELESS", FormatB8G8R8X8Typeless, FormatB8G8R8X8Typeless, TexelLayout::BGRX8Unorm, 4, ScalerSupport::None, false },
+        { FormatB8G8R8X8UnormSrgb, "B8G8R8X8_UNORM_SRGB", FormatB8G8R8X8Typeless, FormatB8G8R8X8Unorm, TexelLayout::BGRX8Unorm, 4, ScalerSupport::None, false },
+    };
+
+    // The small floats of the texture formats have a 5-bit exponent with a bias of 15: half precision, and the 11-bit and
+    // 10-bit floats of R11G11B10_FLOAT, which have no sign bit.
+    float UnpackFloat(const uint32_t bits, const uint32_t mantissaBits, const bool hasSign)
+    {
+        const uint32_t exponent = (bits >> mantissaBits) & 0x1f;
+        const uint32_t mantissa = bits & ((1u << mantissaBits) - 1);
+        float value;
+        if (exponent == 0)
+        {
+            value = std::ldexp((float)mantissa, -14 - (int)mantissaBits);
+        }
+        else if (exponent == 31)
+        {
+            value = mantissa ? NAN : INFINITY;
+        }
+        else
+        {
+            value = std::ldexp((float)(mantissa | 1u << mantissaBits), (int)exponent - 15 - (int)mantissaBits);
+        }
+        return hasSign && ((bits >> (mantissaBits + 5)) & 1) ? -value : value;
+    }
+
+    uint32_t PackFloat(const float value, const uint32_t mantissaBits, const bool hasSign)
+    {
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        const uint32_t sign = hasSign ? (bits >> 31) << (mantissaBits + 5) : 0;
+        const uint32_t infinity = 0x1fu << mantissaBits;
+
+        if (std::isnan(value))
+        {
+            return infinity | 1u << (mantissaBits - 1);
+        }
+        if (!hasSign && (bits >> 31))
+        {
+            // The negative values saturate to 0.
+            return 0;
+        }
+        const int exponent = (int)((bits >> 23) & 0xff) - 127 + 15;
+        if (exponent >= 31)
+        {
+            return sign | infinity;
+        }
+
+        uint32_t mantissa = bits & 0x7fffff;
+        uint32_t shift = 23 - mantissaBits;
+        uint32_t packed;
+        if (exponent <= 0)
+        {
+            // Denormals.
+            shift += 1 - exponent;
+            if (shift >= 32)
+            {
+                return sign;
+            }
+            mantissa |= 0x800000;
+            packed = mantissa >> shift;
+        }
+        else
+        {
+            packed = (uint32_t)exponent << mantissaBits | mantissa >> shift;
+        }
+
+        // Round to nearest even. A carry into the exponent is correct, up to infinity.
+        const uint32_t remainder = mantissa & ((1u << shift) - 1);
+        const uint32_t halfway = 1u << (shift - 1);
+        if (remainder > halfway || (remainder == halfway && (packed & 1)))
+        {
+            packed++;
+        }
+        return sign | packed;
+    }
+
+    float LoadSnorm8(const uint8_t code)
+    {
+        // -128 and -127 both read as -1.
+        return std::max((int8_t)code / 127.f, -1.f);
+    }
+
+    uint8_t StoreSnorm8(const float value)
+    {
+        return std::isnan(value) ? 0 : (uint8_t)(int8_t)std::lround(std::clamp(value, -1.f, 1.f) * 127.f);
+    }
+
+    uint8_t StoreUint8(const float value)
+    {
+        return std::isnan(value) ? 0 : (uint8_t)std::lround(std::clamp(value, 0.f, 255.f));
+    }
+
+    uint8_t StoreSint8(const float value)
+    {
+        return std::isnan(value) ? 0 : (uint8_t)(int8_t)std::lround(std::clamp(value, -128.f, 127.f));
+    }
+
+    uint32_t Load32(const uint8_t* texel)
+    {
+        uint32_t value;
+        std::memcpy(&value, texel, sizeof(value));
+        return value;
+    }
+
+    void Store32(uint8_t* texel, const uint32_t value)
+    {
+        std::memcpy(texel, &value, sizeof(value));
+    }
+
+    uint16_t Load16(const uint8_t* texel)
+    {
+        uint16_t value;
+        std::memcpy(&value, texel, sizeof(value));
+        return value;
+    }
+
+    void Store16(uint8_t* texel, const uint16_t value)
+    {
+        std::memcpy(texel, &value, sizeof(value));
+    }
+}
+
+namespace nis_scaler
+{
+    const ColorFormatInfo* GetColorFormatInfo(const uint32_t format)
+    {
+        for (const ColorFormatInfo& info : ColorFormats)
+        {
+            if (info.format == format)
+            {
+                return &info;
+            }
+        }
+        return nullptr;
+    }
+
+    const ColorFormatInfo* GetColorFormats(size_t& count)
+    {
+        count = std::size(ColorFormats);
+        return ColorFormats;
+    }
+
+    void LoadTexels(const ColorFormatInfo& info, const uint8_t* const texels, const size_t count, float* const rgba)
+    {
+        switch (info.layout)
+        {
+        case TexelLayout::RGBA8Unorm:
+            for (size_t i = 0; i < count * 4; i++)
+            {
+                rgba[i] = DequantizeUnorm8(texels[i]);
+            }
+            break;
+
+        case TexelLayout::RGBA8Snorm:
+            for (size_t i = 0; i < count * 4; i++)
+            {
+                rgba[i] = LoadSnorm8(texels[i]);
+            }
+            break;
+
+        case TexelLayout::RGBA8Uint:
+            for (size_t i = 0; i < count * 4; i++)
+            {
+                rgba[i] = (float)texels[i];
+            }
+            break;
+
+        case TexelLayout::RGBA8Sint:
+            for (size_t i = 0; i < count * 4; i++)
+            {
+                rgba[i] = (float)(int8_t)texels[i];
+            }
+            break;
+
+        case TexelLayout::BGRA8Unorm:
+        case TexelLayout::BGRX8Unorm:
+        {
+            const bool hasAlpha = info.layout == TexelLayout::BGRA8Unorm;
+            for (size_t i = 0; i < count; i++)
+            {
+                rgba[4 * i + 0] = DequantizeUnorm8(texels[4 * i + 2]);
+                rgba[4 * i + 1] = DequantizeUnorm8(texels[4 * i + 1]);
+                rgba[4 * i + 2] = DequantizeUnorm8(texels[4 * i + 0]);
+                rgba[4 * i + 3] = hasAlpha ? DequantizeUnorm8(texels[4 * i + 3]) : 1.f;
+            }
+            break;
+        }
+
+        case TexelLayout::RGB10A2Unorm:
+            for (size_t i = 0; i < count; i++)
+            {
+                const uint32_t texel = Load32(texels + 4 * i);
+                rgba[4 * i + 0] = (texel & 0x3ff) / 1023.f;
+                rgba[4 * i + 1] = ((texel >> 10) & 0x3ff) / 1023.f;
+                rgba[4 * i + 2] = ((texel >> 20) & 0x3ff) / 1023.f;
+                rgba[4 * i + 3] = (texel >> 30) / 3.f;
+            }
+            break;
+
+        case TexelLayout::RG11B10Float:
+            for (size_t i = 0; i < count; i++)
+            {
+                const uint32_t texel = Load32(texels + 4 * i);
+                rgba[4 * i + 0] = UnpackFloat(texel & 0x7ff, 6, false);
+                rgba[4 * i + 1] = UnpackFloat((texel >> 11) & 0x7ff, 6, false);
+                rgba[4 * i + 2] = UnpackFloat(texel >> 22, 5, false);
+                rgba[4 * i + 3] = 1.f;
+            }
+            break;
+
+        case TexelLayout::RGBA16Unorm:
+            for (size_t i = 0; i < count * 4; i++)
+            {
+                rgba[i] = DequantizeUnorm16(Load16(texels + 2 * i));
+            }
+            break;
+
+        case TexelLayout::RGBA16Float:
+            for (size_t i = 0; i < count * 4; i++)
+            {
+                rgba[i] = UnpackFloat(Load16(texels + 2 * i), 10, true);
+            }
+            break;
+
+        case TexelLayout::RGBA32Float:
+            std::memcpy(rgba, texels, count * 16);
+            break;
+        }
+    }
+
+    void StoreTexels(const ColorFormatInfo& info, const float* const rgba, const size_t count, uint8_t* const texels)
+    {
+        switch (info.layout)
+        {
+        case TexelLayout::RGBA8Unorm:
+            for (size_t i = 0; i < count * 4; i++)
+            {
+                texels[i] = QuantizeUnorm8(rgba[i]);
+            }
+            break;
+
+        case TexelLayout::RGBA8Snorm:
+            for (size_t i = 0; i < count * 4; i++)
+            {
+                texels[i] = StoreSnorm8(rgba[i]);
+            }
+            break;
+
+        case TexelLayout::RGBA8Uint:
+            for (size_t i = 0; i < count * 4; i++)
+            {
+                texels[i] = StoreUint8(rgba[i]);
+            }
+            break;
+
+        case TexelLayout::RGBA8Sint:
+            for (size_t i = 0; i < count * 4; i++)
+            {
+                texels[i] = StoreSint8(rgba[i]);
+            }
+            break;
+
+        case TexelLayout::BGRA8Unorm:
+        case TexelLayout::BGRX8Unorm:
+        {
+            const bool hasAlpha = info.layout == TexelLayout::BGRA8Unorm;
+            for (size_t i = 0; i < count; i++)
+            {
+                texels[4 * i + 0] = QuantizeUnorm8(rgba[4 * i + 2]);
+                texels[4 * i + 1] = QuantizeUnorm8(rgba[4 * i + 1]);
+                texels[4 * i + 2] = QuantizeUnorm8(rgba[4 * i + 0]);
+                texels[4 * i + 3] = hasAlpha ? QuantizeUnorm8(rgba[4 * i + 3]) : 255;
+            }
+            break;
+        }
+
+        case TexelLayout::RGB10A2Unorm:
+            for (size_t i = 0; i < count; i++)
+            {
+                Store32(texels + 4 * i,
+                        QuantizeUnorm(rgba[4 * i + 0], 1023) | QuantizeUnorm(rgba[4 * i + 1], 1023) << 10 |
+                            QuantizeUnorm(rgba[4 * i + 2], 1023) << 20 | QuantizeUnorm(rgba[4 * i + 3], 3) << 30);
+            }
+            break;
+
+        case TexelLayout::RG11B10Float:
+            for (size_t i = 0; i < count; i++)
+            {
+                Store32(texels + 4 * i,
+                        PackFloat(rgba[4 * i + 0], 6, false) | PackFloat(rgba[4 * i + 1], 6, false) << 11 |
+                            PackFloat(rgba[4 * i + 2], 5, false) << 22);
+            }
+            break;
+
+        case TexelLayout::RGBA16Unorm:
+            for (size_t i = 0; i < count * 4; i++)
+            {
+                Store16(texels + 2 * i, QuantizeUnorm16(rgba[i]));
+            }
+            break;
+
+        case TexelLayout::RGBA16Float:
+            for (size_t i = 0; i < count * 4; i++)
+            {
+                Store16(texels + 2 * i, (uint16_t)PackFloat(rgba[i], 10, true));
+            }
+            break;
+
+        case TexelLayout::RGBA32Float:
+            std::memcpy(texels, rgba, count * 16);
+            break;
+        }
+    }
+}
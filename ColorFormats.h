@@ -0,0 +1,87 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace nis_scaler
+{
+    // How the texels of a format are stored.
+    enum class TexelLayout
+    {
+        RGBA8Unorm = 0,
+        RGBA8Snorm,
+        RGBA8Uint,
+        RGBA8Sint,
+        BGRA8Unorm,
+        BGRX8Unorm,
+        RGB10A2Unorm,
+        RG11B10Float,
+        RGBA16Unorm,
+        RGBA16Float,
+        RGBA32Float,
+    };
+
+    // How the swapchains of a format are processed by the scalers.
+    enum class ScalerSupport
+    {
+        // The swapchains are not scaled.
+        None = 0,
+
+        // The scalers read and write the textures in the format of the swapchain: the views take care of the swizzle and
+        // of the packing of the texels. A color conversion pass is only needed when the runtime textures do not allow UAVs.
+        Direct,
+
+        // sRGB formats: the runtime textures are created in the intermediate format, or the scalers write them through
+        // views in the aliasFormat and encode the values themselves, or else a color conversion pass is needed.
+        Indirect,
+    };
+
+    // The properties of a DXGI format, for the swapchains and for the captures.
+    struct ColorFormatInfo
+    {
+        uint32_t format; // A DXGI_FORMAT.
+        const char* name;
+
+        // The typeless format of the family (or DXGI_FORMAT_UNKNOWN), and the UNORM format with the same layout for the
+        // sRGB formats (or the format itself).
+        uint32_t typelessFormat;
+        uint32_t aliasFormat;
+
+        TexelLayout layout;
+        uint32_t bytesPerPixel;
+        ScalerSupport scalerSupport;
+
+        // The values are linear and not limited to [0, 1]. NIS runs in its linear HDR mode, and the intermediate texture
+        // uses a float format to preserve the range.
+        bool isHdr;
+    };
+
+    // Returns the properties of a format, or nullptr for the formats that are not in the table.
+    const ColorFormatInfo* GetColorFormatInfo(uint32_t format);
+
+    // Returns the table, to enumerate the formats.
+    const ColorFormatInfo* GetColorFormats(size_t& count);
+
+    // Read and write texels like the views of the format do, as RGBA floats. The formats without alpha read it as 1,
+    // and the X channel is written as 1. sRGB values are not linearized, like when the scalers read them through a UNORM
+    // alias. The stores saturate to the range of the format, round to nearest (to nearest even for floats), and convert
+    // NaN to 0 for the normalized and integer formats.
+    void LoadTexels(const ColorFormatInfo& info, const uint8_t* texels, size_t count, float* rgba);
+    void StoreTexels(const ColorFormatInfo& info, const float* rgba, size_t count, uint8_t* texels);
+}
@@ -0,0 +1,599 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// This file does not use the precompiled header, so it can be shared with the tools.
+
+#include "Config.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+
+#include "Log.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#elif defined(__linux__)
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    using namespace nis_scaler;
+
+    // DXGI_FORMAT_R16G16B16A16_UNORM.
+    constexpr uint32_t DefaultIntermediateFormat = 11;
+
+    // How long the watcher blocks before reclaiming the replaced snapshots. Stopping the watcher wakes it up.
+    constexpr auto WatchTimeout = std::chrono::milliseconds(100);
+
+    // The configuration tool writes the settings one at a time: wait for the changes to settle before reloading.
+    constexpr auto SettleTime = std::chrono::milliseconds(100);
+
+    struct Setting
+    {
+        const char* name;
+        bool isGlobal;
+        void (*apply)(Config& config, int value);
+    };
+
+    const Setting Settings[] = {
+        { "scaling", false, [](Config& config, int value) { config.scaleFactor = std::clamp(value, 0, 100) / 100.f; } },
+        { "sharpness", false, [](Config& config, int value) { config.sharpness = std::clamp(value, 0, 100) / 100.f; } },
+        { "dynamic_resolution", false, [](Config& config, int value) { config.dynamicResolution = value != 0; } },
+        { "min_scaling", false, [](Config& config, int value) { config.minScaleFactor = std::clamp(value, 1, 100) / 100.f; } },
+        { "target_frame_time", false, [](Config& config, int value) { config.targetFrameTime = (uint32_t)(std::max)(value, 1000); } },
+        { "foveated_radius", false, [](Config& config, int value) { config.foveatedRadius = std::clamp(value, 0, 100) / 100.f; } },
+        { "foveated_offset_x", false, [](Config& config, int value) { config.foveatedOffsetX = std::clamp(value, -25, 25) / 100.f; } },
+        { "foveated_offset_y", false, [](Config& config, int value) { config.foveatedOffsetY = std::clamp(value, -25, 25) / 100.f; } },
+        { "disable_bilinear_scaler", false, [](Config& config, int value) { config.disableBilinearScaler = value != 0; } },
+        { "intermediate_format", false, [](Config& config, int value) { config.intermediateFormat = (uint32_t)value; } },
+        { "msaa_resolve_filter", false, [](Config& config, int value) { config.msaaResolveFilter = (uint32_t)std::clamp(value, 0, 1); } },
+        { "fast_context_switch", false, [](Config& config, int value) { config.fastContextSwitch = value != 0; } },
+        { "enable_stats", false, [](Config& config, int value) { config.enableStats = value != 0; } },
+
+        { "enable_screenshots", true, [](Config& config, int value) { config.enableScreenshots = value != 0; } },
+        { "screenshot_format", true, [](Config& config, int value) { config.screenshotFormat = (uint32_t)value; } },
+        { "capture_frames", true, [](Config& config, int value) { config.captureFrames = (uint32_t)(std::max)(value, 1); } },
+        { "capture_input", true, [](Config& config, int value) { config.captureInput = value != 0; } },
+        { "enable_telemetry", true, [](Config& config, int value) { config.enableTelemetry = value != 0; } },
+        { "nis_autotune", true, [](Config& config, int value) { config.nisAutotune = value != 0; } },
+    };
+
+    std::string Trim(const std::string& str)
+    {
+        const size_t first = str.find_first_not_of(" \t\r\n");
+        if (first == std::string::npos)
+        {
+            return "";
+        }
+        const size_t last = str.find_last_not_of(" \t\r\n");
+        return str.substr(first, last - first + 1);
+    }
+
+    int64_t LastWriteTime(const std::string& path)
+    {
+        std::error_code ec;
+        const auto time = std::filesystem::last_write_time(path, ec);
+        return ec ? 0 : (int64_t)time.time_since_epoch().count();
+    }
+}
+
+namespace nis_scaler
+{
+    void Config::Dump() const
+    {
+        if (loaded)
+        {
+            const bool isDebugBuild =
+#ifdef _DEBUG
+                true;
+#else
+                false;
+#endif
+            if (isDebugBuild || enableStats)
+            {
+                Log("!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!\n");
+                Log("!!! USING DEBUG SETTINGS - PERFORMANCE WILL BE DECREASED             !!!\n");
+                Log("!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!\n");
+            }
+
+            Log("Using intermediate format: %u\n", intermediateFormat);
+            if (fastContextSwitch)
+            {
+                Log("Using fast context switch\n");
+            }
+            if (scaleFactor < 1.f)
+            {
+                Log("Use scaling factor: %.3f\n", scaleFactor);
+            }
+            else
+            {
+                Log("No scaling, sharpening only\n");
+            }
+            if (dynamicResolution)
+            {
+                Log("Use dynamic resolution: %.3f to %.3f, target GPU frame time %uus\n", minScaleFactor, scaleFactor, targetFrameTime);
+            }
+            if (foveatedRadius > 0.f && foveatedRadius < 1.f)
+            {
+                Log("Use foveated scaling: radius %.2f, offset %.2f,%.2f\n", foveatedRadius, foveatedOffsetX, foveatedOffsetY);
+            }
+            Log("Sharpness set to %.3f\n", sharpness);
+            if (msaaResolveFilter)
+            {
+                Log("Resolving multisampled swapchains with the tent filter\n");
+            }
+            if (nisAutotune)
+            {
+                Log("Autotuning NIS for new GPUs and drivers\n");
+            }
+            if (enableTelemetry)
+            {
+                Log("Publishing telemetry\n");
+            }
+        }
+    }
+
+    void Config::Reset()
+    {
+        loaded = false;
+        name = "";
+        scaleFactor = 0.7f;
+        sharpness = 0.5f;
+        dynamicResolution = false;
+        minScaleFactor = 0.5f;
+        targetFrameTime = 10000;
+        foveatedRadius = 0.f;
+        foveatedOffsetX = 0.f;
+        foveatedOffsetY = 0.f;
+        nisAutotune = false;
+        disableBilinearScaler = true;
+        intermediateFormat = DefaultIntermediateFormat;
+        msaaResolveFilter = 0;
+        fastContextSwitch = true;
+        enableStats = false;
+        enableTelemetry = false;
+        enableScreenshots = false;
+        screenshotFormat = 0;
+        captureFrames = 90;
+        captureInput = false;
+        revision = 0;
+    }
+
+    bool ApplySetting(Config& config, const std::string& name, const int value)
+    {
+        for (const Setting& setting : Settings)
+        {
+            if (name == setting.name)
+            {
+                setting.apply(config, value);
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    bool ConfigSource::load(const std::string& applicationName, Config& config)
+    {
+        if (applicationName.empty())
+        {
+            return false;
+        }
+
+        refresh();
+
+        int isEnabledForApplication = -1;
+        readValue(applicationName, "enabled", isEnabledForApplication);
+
+        bool isEnabled = isEnabledForApplication == 1;
+        std::string scope = applicationName;
+        if (isEnabledForApplication == -1)
+        {
+            // Try the global settings.
+            int isEnabledGlobally = 0;
+            readValue("", "enabled", isEnabledGlobally);
+            isEnabled = isEnabledGlobally != 0;
+            scope = "";
+        }
+
+        if (!isEnabled)
+        {
+            // We always want to display this message so the log will contain the OpenXR application name.
+            Log("Did not find settings for \"%s\"\n", applicationName.c_str());
+
+            return false;
+        }
+
+        if (isEnabledForApplication == 1)
+        {
+            Log("Loading config for \"%s\"\n", applicationName.c_str());
+        }
+        else
+        {
+            Log("Using global settings\n");
+        }
+
+        for (const Setting& setting : Settings)
+        {
+            int value;
+            if (readValue(setting.isGlobal ? "" : scope, setting.name, value))
+            {
+                setting.apply(config, value);
+            }
+        }
+
+        config.name = applicationName;
+        config.loaded = true;
+
+        return true;
+    }
+
+#ifdef _WIN32
+    RegistryConfigSource::RegistryConfigSource(const std::string& prefix)
+        : m_prefix(prefix)
+    {
+        // Manual reset: a wake up is not lost when it happens before the wait.
+        m_wakeEvent = CreateEventA(nullptr, TRUE, FALSE, nullptr);
+    }
+
+    RegistryConfigSource::~RegistryConfigSource()
+    {
+        if (m_key)
+        {
+            RegCloseKey((HKEY)m_key);
+        }
+        if (m_event)
+        {
+            CloseHandle((HANDLE)m_event);
+        }
+        if (m_wakeEvent)
+        {
+            CloseHandle((HANDLE)m_wakeEvent);
+        }
+    }
+
+    bool RegistryConfigSource::waitForChange(const std::chrono::milliseconds timeout)
+    {
+        if (!m_key)
+        {
+            HKEY key;
+            if (RegOpenKeyExA(HKEY_LOCAL_MACHINE, m_prefix.c_str(), 0, KEY_NOTIFY, &key) != ERROR_SUCCESS)
+            {
+                // The key does not exist (yet).
+                WaitForSingleObject((HANDLE)m_wakeEvent, (DWORD)timeout.count());
+                return false;
+            }
+            m_key = key;
+            m_event = CreateEventA(nullptr, FALSE, FALSE, nullptr);
+        }
+
+        // Notifications are one-shot and must be re-armed after each change.
+        if (!m_isWatching)
+        {
+            if (!m_event || RegNotifyChangeKeyValue((HKEY)m_key, TRUE, REG_NOTIFY_CHANGE_NAME | REG_NOTIFY_CHANGE_LAST_SET, (HANDLE)m_event, TRUE) != ERROR_SUCCESS)
+            {
+                WaitForSingleObject((HANDLE)m_wakeEvent, (DWORD)timeout.count());
+                return false;
+            }
+            m_isWatching = true;
+        }
+
+        // The wake event comes last, so that a change is reported when both are signaled.
+        const HANDLE events[] = { (HANDLE)m_event, (HANDLE)m_wakeEvent };
+        if (WaitForMultipleObjects(m_wakeEvent ? 2 : 1, events, FALSE, (DWORD)timeout.count()) != WAIT_OBJECT_0)
+        {
+            return false;
+        }
+        m_isWatching = false;
+
+        return true;
+    }
+
+    void RegistryConfigSource::wake()
+    {
+        if (m_wakeEvent)
+        {
+            SetEvent((HANDLE)m_wakeEvent);
+        }
+    }
+
+    bool RegistryConfigSource::readValue(const std::string& scope, const std::string& name, int& value)
+    {
+        const std::string subKey = scope.empty() ? m_prefix : m_prefix + "\\" + scope;
+
+        DWORD data{};
+        DWORD dataSize = sizeof(data);
+        if (RegGetValueA(HKEY_LOCAL_MACHINE, subKey.c_str(), name.c_str(), RRF_RT_REG_DWORD, nullptr, &data, &dataSize) != ERROR_SUCCESS)
+        {
+            return false;
+        }
+        value = (int)data;
+
+        return true;
+    }
+#endif
+
+    FileWatcher::FileWatcher(const std::string& path)
+        : m_path(path), m_fileName(std::filesystem::path(path).filename().string())
+    {
+#if defined(__linux__)
+        // Watch the directory rather than the file, since editors typically replace the file when saving.
+        std::string directory = std::filesystem::path(path).parent_path().string();
+        if (directory.empty())
+        {
+            directory = ".";
+        }
+        m_notify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (m_notify >= 0 && inotify_add_watch(m_notify, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE) < 0)
+        {
+            close(m_notify);
+            m_notify = -1;
+        }
+        m_wakeEvent = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+#endif
+        m_lastWriteTime = LastWriteTime(m_path);
+    }
+
+    FileWatcher::~FileWatcher()
+    {
+#if defined(__linux__)
+        if (m_notify >= 0)
+        {
+            close(m_notify);
+        }
+        if (m_wakeEvent >= 0)
+        {
+            close(m_wakeEvent);
+        }
+#endif
+    }
+
+    bool FileWatcher::waitForChange(const std::chrono::milliseconds timeout)
+    {
+#if defined(__linux__)
+        if (m_notify >= 0 && m_wakeEvent >= 0)
+        {
+            pollfd pfds[] = { { m_notify, POLLIN, 0 }, { m_wakeEvent, POLLIN, 0 } };
+            if (poll(pfds, 2, (int)timeout.count()) <= 0)
+            {
+                return false;
+            }
+            if (pfds[1].revents & POLLIN)
+            {
+                uint64_t count;
+                (void)!read(m_wakeEvent, &count, sizeof(count));
+                return false;
+            }
+
+            bool changed = false;
+            alignas(inotify_event) char buffer[4096];
+            ssize_t length;
+            while ((length = read(m_notify, buffer, sizeof(buffer))) > 0)
+            {
+                for (const char* ptr = buffer; ptr < buffer + length;)
+                {
+                    const inotify_event* const event = reinterpret_cast<const inotify_event*>(ptr);
+                    if (event->len && m_fileName == event->name)
+                    {
+                        changed = true;
+                    }
+                    ptr += sizeof(inotify_event) + event->len;
+                }
+            }
+
+            return changed;
+        }
+#endif
+
+        // Without change notifications, poll the modification time.
+        {
+            std::unique_lock lock(m_wakeMutex);
+            if (m_wakeCondition.wait_for(lock, timeout, [this]() { return m_isWoken; }))
+            {
+                m_isWoken = false;
+                return false;
+            }
+        }
+        const int64_t lastWriteTime = LastWriteTime(m_path);
+        if (lastWriteTime == m_lastWriteTime)
+        {
+            return false;
+        }
+        m_lastWriteTime = lastWriteTime;
+
+        return true;
+    }
+
+    void FileWatcher::wake()
+    {
+#if defined(__linux__)
+        if (m_notify >= 0 && m_wakeEvent >= 0)
+        {
+            const uint64_t count = 1;
+            (void)!write(m_wakeEvent, &count, sizeof(count));
+            return;
+        }
+#endif
+        {
+            std::unique_lock lock(m_wakeMutex);
+            m_isWoken = true;
+        }
+        m_wakeCondition.notify_one();
+    }
+
+    FileConfigSource::FileConfigSource(const std::string& path)
+        : m_path(path), m_watcher(path)
+    {
+    }
+
+    bool FileConfigSource::waitForChange(const std::chrono::milliseconds timeout)
+    {
+        return m_watcher.waitForChange(timeout);
+    }
+
+    void FileConfigSource::wake()
+    {
+        m_watcher.wake();
+    }
+
+    void FileConfigSource::refresh()
+    {
+        m_values.clear();
+
+        std::ifstream file(m_path);
+        std::string scope;
+        std::string line;
+        while (std::getline(file, line))
+        {
+            line = Trim(line);
+            if (line.empty() || line[0] == '#')
+            {
+                continue;
+            }
+
+            if (line.front() == '[' && line.back() == ']')
+            {
+                scope = Trim(line.substr(1, line.size() - 2));
+                continue;
+            }
+
+            const size_t separator = line.find('=');
+            if (separator == std::string::npos)
+            {
+                continue;
+            }
+            const std::string value = Trim(line.substr(separator + 1));
+            char* end;
+            const long number = std::strtol(value.c_str(), &end, 0);
+            if (value.empty() || *end)
+            {
+                continue;
+            }
+            m_values[scope][Trim(line.substr(0, separator))] = (int)number;
+        }
+    }
+
+    bool FileConfigSource::readValue(const std::string& scope, const std::string& name, int& value)
+    {
+        const auto scopeIt = m_values.find(scope);
+        if (scopeIt == m_values.cend())
+        {
+            return false;
+        }
+        const auto it = scopeIt->second.find(name);
+        if (it == scopeIt->second.cend())
+        {
+            return false;
+        }
+        value = it->second;
+
+        return true;
+    }
+
+    ConfigWatcher::~ConfigWatcher()
+    {
+        // The layer stops the watcher when the instance is destroyed, before the loader may unload the DLL. Otherwise,
+        // stop it here: the thread must not outlive the source that it waits on, nor the code that it runs.
+        stop();
+    }
+
+    void ConfigWatcher::start(std::unique_ptr<ConfigSource> source, const Config& initialConfig)
+    {
+        stop();
+
+        m_source = std::move(source);
+        auto config = std::make_unique<Config>(initialConfig);
+        config->revision = 1;
+        publish(std::move(config));
+        m_stop = false;
+        m_thread = std::thread([this]() { watchThread(); });
+    }
+
+    void ConfigWatcher::stop()
+    {
+        m_stop = true;
+        if (m_thread.joinable())
+        {
+            m_source->wake();
+            m_thread.join();
+        }
+        m_latest.store(nullptr, std::memory_order_release);
+        m_current.reset();
+        m_retired.clear();
+        m_retiredCount.store(0, std::memory_order_relaxed);
+        m_source.reset();
+    }
+
+    void ConfigWatcher::publish(std::unique_ptr<const Config> config)
+    {
+        m_latest.store(config.get(), std::memory_order_release);
+        if (m_current)
+        {
+            m_retired.push_back({ std::move(m_current), std::chrono::steady_clock::now() });
+            m_retiredCount.store(m_retired.size(), std::memory_order_relaxed);
+        }
+        m_current = std::move(config);
+    }
+
+    void ConfigWatcher::reclaim()
+    {
+        const auto now = std::chrono::steady_clock::now();
+        while (!m_retired.empty() && now - m_retired.front().time >= GracePeriod)
+        {
+            m_retired.pop_front();
+        }
+        m_retiredCount.store(m_retired.size(), std::memory_order_relaxed);
+    }
+
+    void ConfigWatcher::watchThread()
+    {
+        while (!m_stop)
+        {
+            reclaim();
+
+            if (!m_source->waitForChange(WatchTimeout))
+            {
+                continue;
+            }
+            while (!m_stop && m_source->waitForChange(SettleTime))
+            {
+            }
+            if (m_stop)
+            {
+                break;
+            }
+
+            auto config = std::make_unique<Config>();
+            config->Reset();
+            if (!m_source->load(m_current->name, *config))
+            {
+                // The layer is already hooked into the application.
+                Log("Ignoring the configuration change until the application restarts\n");
+                continue;
+            }
+
+            config->revision = m_current->revision + 1;
+            publish(std::move(config));
+        }
+    }
+}
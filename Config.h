@@ -0,0 +1,217 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace nis_scaler
+{
+    // The layer's settings. A published Config is immutable: changes are made to a new copy.
+    struct Config
+    {
+        bool loaded;
+        std::string name;
+        float scaleFactor;
+        float sharpness;
+        bool dynamicResolution;   // When enabled, scaleFactor is the highest render scale.
+        float minScaleFactor;     // The lowest render scale with dynamic resolution.
+        uint32_t targetFrameTime; // The GPU frame time (in microseconds) aimed for by dynamic resolution.
+        float foveatedRadius;     // The half-size of the region processed with NIS (fraction of the image), 0 to disable.
+        float foveatedOffsetX;    // The offset of the region towards the nose (fraction of the image width).
+        float foveatedOffsetY;    // The offset of the region downwards (fraction of the image height).
+        bool disableBilinearScaler;
+        uint32_t intermediateFormat; // A DXGI_FORMAT.
+        uint32_t msaaResolveFilter;  // A MsaaResolveFilter, for the multisampled swapchains.
+        bool fastContextSwitch;
+        bool enableStats;
+        bool enableTelemetry;
+        bool nisAutotune; // Time the variants of the NIS shader for the GPUs and drivers that were not tuned yet.
+        bool enableScreenshots;
+        uint32_t screenshotFormat; // 0: DDS, 1: PNG.
+        uint32_t captureFrames;    // The number of frames recorded by a burst capture.
+        bool captureInput;         // Whether burst captures also record the application's images.
+
+        // The number of the snapshot published by ConfigWatcher (0 when not published).
+        uint32_t revision;
+
+        void Dump() const;
+        void Reset();
+    };
+
+    // Apply a setting from its (registry) name. Returns false for an unknown setting.
+    bool ApplySetting(Config& config, const std::string& name, int value);
+
+    // Detect the changes to a file. Uses inotify on Linux, and polls the modification time elsewhere.
+    class FileWatcher
+    {
+    public:
+        explicit FileWatcher(const std::string& path);
+        ~FileWatcher();
+
+        // Block until the file may have changed. Returns false if the timeout expired first, or if wake() was called.
+        bool waitForChange(std::chrono::milliseconds timeout);
+
+        // Interrupt the current (or the next) waitForChange(), from another thread.
+        void wake();
+
+    private:
+        const std::string m_path;
+        const std::string m_fileName;
+
+        int m_notify{ -1 };
+        int m_wakeEvent{ -1 };
+        int64_t m_lastWriteTime{ 0 };
+
+        // Without change notifications, the polling waits on this condition.
+        std::mutex m_wakeMutex;
+        std::condition_variable m_wakeCondition;
+        bool m_isWoken{ false };
+    };
+
+    // Where the settings are read from. Settings are integer values identified by their (registry) name, stored either
+    // in a per-application scope or in the global scope.
+    class ConfigSource
+    {
+    public:
+        virtual ~ConfigSource() = default;
+
+        // Load the settings for an application, falling back to the global settings when the application has none.
+        // Returns whether the layer is enabled for the application.
+        virtual bool load(const std::string& applicationName, Config& config);
+
+        // Block until the settings may have changed. Returns false if the timeout expired first, or if wake() was called.
+        virtual bool waitForChange(std::chrono::milliseconds timeout) = 0;
+
+        // Interrupt the current (or the next) waitForChange(), from another thread.
+        virtual void wake() = 0;
+
+    protected:
+        // Take a consistent view of the settings before a series of readValue() calls.
+        virtual void refresh()
+        {
+        }
+
+        // Read a value from a scope (an empty scope is the global scope).
+        virtual bool readValue(const std::string& scope, const std::string& name, int& value) = 0;
+    };
+
+#ifdef _WIN32
+    // Read the settings from the registry, under HKEY_LOCAL_MACHINE\<prefix>[\<application name>].
+    class RegistryConfigSource : public ConfigSource
+    {
+    public:
+        explicit RegistryConfigSource(const std::string& prefix);
+        ~RegistryConfigSource() override;
+
+        bool waitForChange(std::chrono::milliseconds timeout) override;
+        void wake() override;
+
+    protected:
+        bool readValue(const std::string& scope, const std::string& name, int& value) override;
+
+    private:
+        const std::string m_prefix;
+        void* m_key{ nullptr };
+        void* m_event{ nullptr };
+        void* m_wakeEvent{ nullptr };
+        bool m_isWatching{ false };
+    };
+#endif
+
+    // Read the settings from a text file. Each line is a "name=value" pair, and "[application name]" lines start the
+    // scope of an application. Lines before the first scope are the global settings. Lines starting with '#' are ignored.
+    class FileConfigSource : public ConfigSource
+    {
+    public:
+        explicit FileConfigSource(const std::string& path);
+
+        bool waitForChange(std::chrono::milliseconds timeout) override;
+        void wake() override;
+
+    protected:
+        void refresh() override;
+        bool readValue(const std::string& scope, const std::string& name, int& value) override;
+
+    private:
+        const std::string m_path;
+        FileWatcher m_watcher;
+        std::map<std::string, std::map<std::string, int>> m_values;
+    };
+
+    // Watch a configuration source from a background thread, and publish a new snapshot of the configuration whenever
+    // it changes. Readers never block: they only load the latest snapshot pointer.
+    class ConfigWatcher
+    {
+    public:
+        // How long a replaced snapshot stays valid. Readers only hold a snapshot for the duration of an OpenXR call.
+        static constexpr auto GracePeriod = std::chrono::seconds(2);
+
+        ~ConfigWatcher();
+
+        void start(std::unique_ptr<ConfigSource> source, const Config& initialConfig);
+
+        // Wake the watcher thread up and wait for it to exit. The snapshots are no longer valid afterwards.
+        void stop();
+
+        // The latest snapshot, or nullptr when not started. The snapshot remains valid for GracePeriod after it is
+        // replaced, and until stop() is called. Its address may be reused afterwards: compare the revisions to detect
+        // changes.
+        const Config* latest() const
+        {
+            return m_latest.load(std::memory_order_acquire);
+        }
+
+        // The number of replaced snapshots not reclaimed yet.
+        size_t retiredCount() const
+        {
+            return m_retiredCount.load(std::memory_order_relaxed);
+        }
+
+    private:
+        struct RetiredSnapshot
+        {
+            std::unique_ptr<const Config> config;
+            std::chrono::steady_clock::time_point time;
+        };
+
+        void watchThread();
+        void publish(std::unique_ptr<const Config> config);
+        void reclaim();
+
+        std::unique_ptr<ConfigSource> m_source;
+
+        // The snapshots are reclaimed by the watcher thread once GracePeriod has elapsed since they were replaced. Each
+        // reload waits for the changes to settle first, which bounds the number of snapshots retired at the same time.
+        std::unique_ptr<const Config> m_current;
+        std::deque<RetiredSnapshot> m_retired;
+        std::atomic<size_t> m_retiredCount{ 0 };
+        std::atomic<const Config*> m_latest{ nullptr };
+
+        std::thread m_thread;
+        std::atomic<bool> m_stop{ false };
+    };
+}
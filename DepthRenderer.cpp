@@ -0,0 +1,191 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pch.h"
+
+#include <d3dcompiler.h>
+
+#include <DeviceResources.h>
+#include <DXUtilities.h>
+
+#include "DepthRenderer.h"
+#include "ShaderCompiler.h"
+
+namespace
+{
+    // A port of UpscaleDepth(). The pixel (x, y) of the output viewport is at (x + 0.5, y + 0.5) in SV_Position, relative
+    // to kOutputOrigin.
+    const std::string depthShaderSource = R"_(
+cbuffer cb : register(b0)
+{
+    float2 kScale;
+    float2 kInputOrigin;
+    int2 kInputMin;
+    int2 kInputMax;
+    float2 kOutputOrigin;
+    float kEdgeThreshold;
+};
+
+#if SAMPLE_COUNT > 1
+Texture2DMSArray<float, SAMPLE_COUNT> in_depth : register(t0);
+
+float LoadDepth(int2 texel)
+{
+    return in_depth.Load(int3(texel, 0), 0);
+}
+#else
+Texture2DArray<float> in_depth : register(t0);
+
+float LoadDepth(int2 texel)
+{
+    return in_depth.Load(int4(texel, 0, 0));
+}
+#endif
+
+void vsMain(in uint id : SV_VertexID, out float4 position : SV_Position)
+{
+    const float2 corner = float2((id == 1) ? 2.0 : 0.0, (id == 2) ? 2.0 : 0.0);
+    position = float4(corner * float2(2.0, -2.0) + float2(-1.0, 1.0), 0.0, 1.0);
+}
+
+float psMain(in float4 position : SV_Position) : SV_Depth
+{
+    const float2 source = kInputOrigin + (position.xy - kOutputOrigin) * kScale - 0.5f;
+    const float2 floorSource = floor(source);
+    const float2 fraction = source - floorSource;
+    const int2 texel0 = clamp((int2)floorSource, kInputMin, kInputMax);
+    const int2 texel1 = clamp((int2)floorSource + 1, kInputMin, kInputMax);
+
+    const float d00 = LoadDepth(int2(texel0.x, texel0.y));
+    const float d10 = LoadDepth(int2(texel1.x, texel0.y));
+    const float d01 = LoadDepth(int2(texel0.x, texel1.y));
+    const float d11 = LoadDepth(int2(texel1.x, texel1.y));
+    const float minDepth = min(min(d00, d10), min(d01, d11));
+    const float maxDepth = max(max(d00, d10), max(d01, d11));
+    if (maxDepth - minDepth <= kEdgeThreshold * maxDepth)
+    {
+        return lerp(lerp(d00, d10, fraction.x), lerp(d01, d11, fraction.x), fraction.y);
+    }
+
+    // Across a discontinuity, take the nearest texel.
+    if (fraction.y < 0.5f)
+    {
+        return fraction.x < 0.5f ? d00 : d10;
+    }
+    return fraction.x < 0.5f ? d01 : d11;
+}
+    )_";
+}
+
+namespace nis_scaler
+{
+    DepthRenderer::DepthRenderer(DeviceResources& deviceResources, ShaderCache* const shaderCache, const uint32_t sampleCount)
+        : m_deviceResources(deviceResources)
+    {
+        ID3D11Device* const device = m_deviceResources.device();
+        const std::string sampleCountString = std::to_string(sampleCount);
+        const D3D_SHADER_MACRO defines[] = {
+            { "SAMPLE_COUNT", sampleCountString.c_str() },
+            { nullptr, nullptr }
+        };
+        const UINT flags = D3DCOMPILE_ENABLE_STRICTNESS | D3DCOMPILE_WARNINGS_ARE_ERRORS | D3DCOMPILE_OPTIMIZATION_LEVEL3;
+        const std::vector<uint8_t> vsBytes = CompileShader(shaderCache, depthShaderSource, "depth", {}, defines, "vsMain", "vs_5_0", flags);
+        DX::ThrowIfFailed(device->CreateVertexShader(vsBytes.data(), vsBytes.size(), nullptr, m_vertexShader.GetAddressOf()));
+        const std::vector<uint8_t> psBytes = CompileShader(shaderCache, depthShaderSource, "depth", {}, defines, "psMain", "ps_5_0", flags);
+        DX::ThrowIfFailed(device->CreatePixelShader(psBytes.data(), psBytes.size(), nullptr, m_pixelShader.GetAddressOf()));
+
+        Constants constants{};
+        m_deviceResources.createConstBuffer(&constants, sizeof(Constants), m_constantBuffer.GetAddressOf());
+
+        // Every pixel of the viewport is written, regardless of the depth already in the texture. The stencil is left
+        // untouched.
+        D3D11_DEPTH_STENCIL_DESC dsDesc;
+        ZeroMemory(&dsDesc, sizeof(D3D11_DEPTH_STENCIL_DESC));
+        dsDesc.DepthEnable = TRUE;
+        dsDesc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ALL;
+        dsDesc.DepthFunc = D3D11_COMPARISON_ALWAYS;
+        dsDesc.StencilEnable = FALSE;
+        DX::ThrowIfFailed(device->CreateDepthStencilState(&dsDesc, m_depthStencilState.GetAddressOf()));
+
+        D3D11_RASTERIZER_DESC rsDesc;
+        ZeroMemory(&rsDesc, sizeof(D3D11_RASTERIZER_DESC));
+        rsDesc.FillMode = D3D11_FILL_SOLID;
+        rsDesc.CullMode = D3D11_CULL_NONE;
+        rsDesc.FrontCounterClockwise = TRUE;
+        DX::ThrowIfFailed(device->CreateRasterizerState(&rsDesc, m_rasterizerState.GetAddressOf()));
+    }
+
+    void DepthRenderer::update(const NISViewport& inputViewport, const NISViewport& outputViewport)
+    {
+        if (m_isValid && inputViewport == m_inputViewport && outputViewport == m_outputViewport)
+        {
+            return;
+        }
+
+        m_inputViewport = inputViewport;
+        m_outputViewport = outputViewport;
+        m_isValid = inputViewport.width && inputViewport.height && outputViewport.width && outputViewport.height;
+        if (!m_isValid)
+        {
+            return;
+        }
+
+        Constants constants{};
+        constants.scale[0] = (float)inputViewport.width / outputViewport.width;
+        constants.scale[1] = (float)inputViewport.height / outputViewport.height;
+        constants.inputOrigin[0] = (float)inputViewport.x;
+        constants.inputOrigin[1] = (float)inputViewport.y;
+        constants.inputMin[0] = (int32_t)inputViewport.x;
+        constants.inputMin[1] = (int32_t)inputViewport.y;
+        constants.inputMax[0] = (int32_t)(inputViewport.x + inputViewport.width) - 1;
+        constants.inputMax[1] = (int32_t)(inputViewport.y + inputViewport.height) - 1;
+        constants.outputOrigin[0] = (float)outputViewport.x;
+        constants.outputOrigin[1] = (float)outputViewport.y;
+        constants.edgeThreshold = DepthEdgeThreshold;
+        m_deviceResources.updateConstBuffer(&constants, sizeof(Constants), m_constantBuffer.Get());
+    }
+
+    void DepthRenderer::draw(ID3D11DeviceContext* const context, ID3D11ShaderResourceView* const input, ID3D11DepthStencilView* const output)
+    {
+        if (!m_isValid)
+        {
+            return;
+        }
+
+        context->OMSetRenderTargets(0, nullptr, output);
+        context->OMSetBlendState(nullptr, nullptr, 0xffffffff);
+        context->OMSetDepthStencilState(m_depthStencilState.Get(), 0);
+        context->VSSetShader(m_vertexShader.Get(), nullptr, 0);
+        context->PSSetShader(m_pixelShader.Get(), nullptr, 0);
+        context->PSSetShaderResources(0, 1, &input);
+        context->PSSetConstantBuffers(0, 1, m_constantBuffer.GetAddressOf());
+        context->IASetIndexBuffer(nullptr, DXGI_FORMAT_UNKNOWN, 0);
+        context->IASetVertexBuffers(0, 0, nullptr, nullptr, nullptr);
+        context->IASetInputLayout(nullptr);
+        context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
+
+        CD3D11_VIEWPORT viewport((float)m_outputViewport.x, (float)m_outputViewport.y, (float)m_outputViewport.width, (float)m_outputViewport.height);
+        context->RSSetViewports(1, &viewport);
+        context->RSSetState(m_rasterizerState.Get());
+
+        context->Draw(3, 0);
+
+        // Unbind the depth texture to avoid D3D debug layer warning.
+        ID3D11ShaderResourceView* const srvs[] = { nullptr };
+        context->PSSetShaderResources(0, 1, srvs);
+        context->OMSetRenderTargets(0, nullptr, nullptr);
+    }
+}
@@ -0,0 +1,70 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "DepthUpscale.h"
+
+class DeviceResources;
+
+namespace nis_scaler
+{
+    class ShaderCache;
+
+    // Upscale a region of a depth texture to a region of a depth-stencil texture, with the edge-preserving filter of
+    // UpscaleDepth(). Depth textures cannot be written by a compute shader, so the depth is output by a pixel shader.
+    // A multisampled input is resolved while it is read, by taking its first sample: depths cannot be averaged without
+    // creating surfaces that do not exist, and the filter already picks the nearest texel across the discontinuities.
+    class DepthRenderer
+    {
+    public:
+        // Compile the shaders for an input with sampleCount samples per pixel, or load them from the cache (if any).
+        DepthRenderer(DeviceResources& deviceResources, ShaderCache* shaderCache, uint32_t sampleCount = 1);
+
+        // Update the constants of the shader. This is a no-op when nothing changed.
+        void update(const NISViewport& inputViewport, const NISViewport& outputViewport);
+
+        // Record the draw into context, which may be a deferred context. The input is a Texture2DArray SRV of a single
+        // slice (Texture2DMSArray when multisampled).
+        void draw(ID3D11DeviceContext* context, ID3D11ShaderResourceView* input, ID3D11DepthStencilView* output);
+
+    private:
+        // The layout of the constant buffer of the shader.
+        struct Constants
+        {
+            float scale[2];
+            float inputOrigin[2];
+            int32_t inputMin[2];
+            int32_t inputMax[2];
+            float outputOrigin[2];
+            float edgeThreshold;
+            float padding;
+        };
+
+        DeviceResources& m_deviceResources;
+
+        Microsoft::WRL::ComPtr<ID3D11VertexShader> m_vertexShader;
+        Microsoft::WRL::ComPtr<ID3D11PixelShader> m_pixelShader;
+        Microsoft::WRL::ComPtr<ID3D11Buffer> m_constantBuffer;
+        Microsoft::WRL::ComPtr<ID3D11DepthStencilState> m_depthStencilState;
+        Microsoft::WRL::ComPtr<ID3D11RasterizerState> m_rasterizerState;
+
+        // The parameters of the last update().
+        bool m_isValid{ false };
+        NISViewport m_inputViewport{};
+        NISViewport m_outputViewport{};
+    };
+}
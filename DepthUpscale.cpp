@@ -0,0 +1,99 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// This file does not use the precompiled header, so it can be shared with the tools.
+
+#include "DepthUpscale.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    using namespace nis_scaler;
+
+    bool IsWithin(const NISViewport& viewport, const DepthImage& image)
+    {
+        return viewport.width && viewport.height && viewport.x + viewport.width <= image.width && viewport.y + viewport.height <= image.height;
+    }
+
+    float lerp(const float a, const float b, const float t)
+    {
+        return a + (b - a) * t;
+    }
+}
+
+namespace nis_scaler
+{
+    // Keep in sync with the shader of DepthRenderer.
+    bool UpscaleDepth(const DepthImage& input,
+                      const NISViewport& inputViewport,
+                      DepthImage& output,
+                      const NISViewport& outputViewport,
+                      const float edgeThreshold)
+    {
+        if (!IsWithin(inputViewport, input) || !IsWithin(outputViewport, output))
+        {
+            return false;
+        }
+
+        const float scaleX = (float)inputViewport.width / outputViewport.width;
+        const float scaleY = (float)inputViewport.height / outputViewport.height;
+        const int minX = (int)inputViewport.x;
+        const int minY = (int)inputViewport.y;
+        const int maxX = (int)(inputViewport.x + inputViewport.width) - 1;
+        const int maxY = (int)(inputViewport.y + inputViewport.height) - 1;
+
+        for (uint32_t y = 0; y < outputViewport.height; y++)
+        {
+            const float sourceY = inputViewport.y + (y + 0.5f) * scaleY - 0.5f;
+            const float floorY = std::floor(sourceY);
+            const float fractionY = sourceY - floorY;
+            const uint32_t y0 = (uint32_t)std::clamp((int)floorY, minY, maxY);
+            const uint32_t y1 = (uint32_t)std::clamp((int)floorY + 1, minY, maxY);
+
+            float* outputDepth = output.depths.data() + (size_t)(outputViewport.y + y) * output.width + outputViewport.x;
+            for (uint32_t x = 0; x < outputViewport.width; x++, outputDepth++)
+            {
+                const float sourceX = inputViewport.x + (x + 0.5f) * scaleX - 0.5f;
+                const float floorX = std::floor(sourceX);
+                const float fractionX = sourceX - floorX;
+                const uint32_t x0 = (uint32_t)std::clamp((int)floorX, minX, maxX);
+                const uint32_t x1 = (uint32_t)std::clamp((int)floorX + 1, minX, maxX);
+
+                const float d00 = input.at(x0, y0);
+                const float d10 = input.at(x1, y0);
+                const float d01 = input.at(x0, y1);
+                const float d11 = input.at(x1, y1);
+                const float minDepth = (std::min)((std::min)(d00, d10), (std::min)(d01, d11));
+                const float maxDepth = (std::max)((std::max)(d00, d10), (std::max)(d01, d11));
+                if (maxDepth - minDepth <= edgeThreshold * maxDepth)
+                {
+                    *outputDepth = lerp(lerp(d00, d10, fractionX), lerp(d01, d11, fractionX), fractionY);
+                }
+                else if (fractionY < 0.5f)
+                {
+                    *outputDepth = fractionX < 0.5f ? d00 : d10;
+                }
+                else
+                {
+                    *outputDepth = fractionX < 0.5f ? d01 : d11;
+                }
+            }
+        }
+        return true;
+    }
+}
@@ -0,0 +1,61 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "ViewMapping.h"
+
+namespace nis_scaler
+{
+    // The largest difference between the depths around a sample, relative to the farthest of them, for the surface to be
+    // considered continuous.
+    constexpr float DepthEdgeThreshold = 0.01f;
+
+    // A depth buffer, one value per pixel.
+    struct DepthImage
+    {
+        uint32_t width{ 0 };
+        uint32_t height{ 0 };
+        std::vector<float> depths;
+
+        void resize(const uint32_t newWidth, const uint32_t newHeight)
+        {
+            width = newWidth;
+            height = newHeight;
+            depths.resize((size_t)width * height);
+        }
+
+        float at(const uint32_t x, const uint32_t y) const
+        {
+            return depths[(size_t)y * width + x];
+        }
+    };
+
+    // The reference for DepthRenderer: upscale a region of the input depth to a region of the output depth, sampling the
+    // input at the same positions as NIS. The 2x2 texels around each sample (clamped to the input region) are interpolated
+    // when they lie on a continuous surface. Across a discontinuity, the nearest texel is taken as is, so that no depth
+    // between the foreground and the background is ever made up. The pixels outside of the output region are left
+    // untouched. Returns false when a region does not fit its image.
+    bool UpscaleDepth(const DepthImage& input,
+                      const NISViewport& inputViewport,
+                      DepthImage& output,
+                      const NISViewport& outputViewport,
+                      float edgeThreshold = DepthEdgeThreshold);
+}
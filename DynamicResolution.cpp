@@ -0,0 +1,80 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "DynamicResolution.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace nis_scaler
+{
+    DynamicResolutionController::DynamicResolutionController(const DynamicResolutionSettings& settings)
+        : m_settings(settings)
+    {
+        reset(settings.maxScale);
+    }
+
+    void DynamicResolutionController::configure(const DynamicResolutionSettings& settings)
+    {
+        m_settings = settings;
+        m_settings.maxScale = (std::max)(m_settings.maxScale, m_settings.minScale);
+        m_settings.quantum = (std::max)(m_settings.quantum, 0.001f);
+
+        const float minPixels = m_settings.minScale * m_settings.minScale;
+        const float maxPixels = m_settings.maxScale * m_settings.maxScale;
+        m_pixels = std::clamp(m_pixels, minPixels, maxPixels);
+        m_scale = std::clamp(m_scale, m_settings.minScale, m_settings.maxScale);
+    }
+
+    void DynamicResolutionController::reset(const float scale)
+    {
+        m_pixels = scale * scale;
+        m_scale = scale;
+        m_lastError = m_lastLastError = 0.f;
+        configure(m_settings);
+    }
+
+    float DynamicResolutionController::update(const uint32_t gpuFrameTime)
+    {
+        if (!gpuFrameTime || !m_settings.targetFrameTime)
+        {
+            return m_scale;
+        }
+
+        // A positive error means that there is headroom. The error is relative, so that the gains do not depend on the
+        // frame rate. Very long frames (eg: loading screens) are capped to avoid dropping straight to the minimum.
+        const float error =
+            (std::max)(-1.f, ((float)m_settings.targetFrameTime - (float)gpuFrameTime) / (float)m_settings.targetFrameTime);
+
+        const float delta = m_settings.kp * (error - m_lastError) + m_settings.ki * error +
+                            m_settings.kd * (error - 2.f * m_lastError + m_lastLastError);
+        m_lastLastError = m_lastError;
+        m_lastError = error;
+
+        const float minPixels = m_settings.minScale * m_settings.minScale;
+        const float maxPixels = m_settings.maxScale * m_settings.maxScale;
+        m_pixels = std::clamp(m_pixels * (1.f + std::clamp(delta, -m_settings.maxStep, m_settings.maxStep)), minPixels, maxPixels);
+
+        // Only move to another step once the target is well past it, so that noise does not flip between two steps.
+        const float target = std::sqrt(m_pixels);
+        if (std::abs(target - m_scale) >= 0.75f * m_settings.quantum)
+        {
+            m_scale = std::clamp(std::round(target / m_settings.quantum) * m_settings.quantum, m_settings.minScale, m_settings.maxScale);
+        }
+
+        return m_scale;
+    }
+}
@@ -0,0 +1,85 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+
+namespace nis_scaler
+{
+    struct DynamicResolutionSettings
+    {
+        // The bounds of the render scale (per dimension, relative to the display resolution).
+        float minScale{ 0.5f };
+        float maxScale{ 1.f };
+
+        // The GPU time to aim for (in microseconds), typically a bit below the frame period.
+        uint32_t targetFrameTime{ 10000 };
+
+        // The gains of the controller, applied to the relative frame time error.
+        float kp{ 0.1f };
+        float ki{ 0.04f };
+        float kd{ 0.f };
+
+        // The largest relative change of the pixel count per update.
+        float maxStep{ 0.05f };
+
+        // The render scale moves by multiples of this step, so that the resolution does not change on every frame.
+        float quantum{ 0.01f };
+    };
+
+    // Pick the render scale from the measured GPU frame times.
+    // The controller works on the pixel count (the square of the scale), which the GPU time is roughly proportional to.
+    // It uses the velocity form of a PID controller: each update adjusts the pixel count relatively to the error between
+    // the target and the measured frame time. This form does not accumulate an integral term, so the output can be
+    // clamped to the bounds without winding up. It does not depend on any graphics API, so that it can be replayed
+    // against recorded traces (see the DynamicResolutionReplay tool).
+    class DynamicResolutionController
+    {
+    public:
+        explicit DynamicResolutionController(const DynamicResolutionSettings& settings = {});
+
+        // Change the settings. The current scale is kept within the new bounds.
+        void configure(const DynamicResolutionSettings& settings);
+
+        // Restart from a given scale, forgetting the previous errors.
+        void reset(float scale);
+
+        // Account for a new GPU frame time (in microseconds). Returns the render scale for the next frames.
+        float update(uint32_t gpuFrameTime);
+
+        // The current render scale (quantized).
+        float scale() const
+        {
+            return m_scale;
+        }
+
+        const DynamicResolutionSettings& settings() const
+        {
+            return m_settings;
+        }
+
+    private:
+        DynamicResolutionSettings m_settings;
+
+        // The unquantized pixel count (relative to the display resolution).
+        float m_pixels;
+        float m_scale;
+
+        float m_lastError{ 0.f };
+        float m_lastLastError{ 0.f };
+    };
+}
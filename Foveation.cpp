@@ -0,0 +1,95 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// This file does not use the precompiled header, so it can be shared with the tools.
+
+#include "Foveation.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+namespace
+{
+    // Snap the region [center - halfSize, center + halfSize) of one dimension to the pixels shared with the input.
+    // Returns false when the region covers the entire dimension.
+    bool SnapRegion(const float center,
+                    const float radius,
+                    const uint32_t inputSize,
+                    const uint32_t outputSize,
+                    uint32_t& inputStart,
+                    uint32_t& inputExtent,
+                    uint32_t& outputStart,
+                    uint32_t& outputExtent)
+    {
+        const uint32_t divisor = std::gcd(inputSize, outputSize);
+        const uint32_t inputStep = inputSize / divisor;
+        const uint32_t outputStep = outputSize / divisor;
+
+        const float halfSize = radius * outputSize / 2;
+        const float start = std::clamp(center * outputSize - halfSize, 0.f, (float)outputSize);
+        const float end = std::clamp(center * outputSize + halfSize, 0.f, (float)outputSize);
+
+        const uint32_t firstStep = (std::min)((uint32_t)std::floor(start / outputStep), divisor - 1);
+        const uint32_t endStep = std::clamp((uint32_t)std::ceil(end / outputStep), firstStep + 1, divisor);
+        if (firstStep == 0 && endStep == divisor)
+        {
+            return false;
+        }
+
+        outputStart = firstStep * outputStep;
+        outputExtent = (endStep - firstStep) * outputStep;
+        inputStart = firstStep * inputStep;
+        inputExtent = (endStep - firstStep) * inputStep;
+        return true;
+    }
+}
+
+namespace nis_scaler
+{
+    bool ComputeFoveatedRegion(const FoveationSettings& settings,
+                               const uint32_t inputWidth,
+                               const uint32_t inputHeight,
+                               const uint32_t outputWidth,
+                               const uint32_t outputHeight,
+                               FoveatedRegion& region)
+    {
+        if (settings.radius <= 0.f || settings.radius >= 1.f || !inputWidth || !inputHeight || !outputWidth || !outputHeight)
+        {
+            return false;
+        }
+
+        // There is a periphery as long as one of the dimensions is not entirely covered.
+        const bool hasHorizontalPeriphery = SnapRegion(settings.centerX, settings.radius, inputWidth, outputWidth,
+                                                       region.inputX, region.inputWidth, region.outputX, region.outputWidth);
+        const bool hasVerticalPeriphery = SnapRegion(settings.centerY, settings.radius, inputHeight, outputHeight,
+                                                     region.inputY, region.inputHeight, region.outputY, region.outputHeight);
+        if (!hasHorizontalPeriphery)
+        {
+            region.inputX = region.outputX = 0;
+            region.inputWidth = inputWidth;
+            region.outputWidth = outputWidth;
+        }
+        if (!hasVerticalPeriphery)
+        {
+            region.inputY = region.outputY = 0;
+            region.inputHeight = inputHeight;
+            region.outputHeight = outputHeight;
+        }
+
+        return hasHorizontalPeriphery || hasVerticalPeriphery;
+    }
+}
@@ -0,0 +1,62 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+
+namespace nis_scaler
+{
+    // The center region of an eye, relative to the output image.
+    struct FoveationSettings
+    {
+        // The center of the lens (fractions of the image size, 0.5 is the middle of the image).
+        float centerX{ 0.5f };
+        float centerY{ 0.5f };
+
+        // The half-size of the region (fraction of the half-size of the image). 0 disables foveation, 1 or more covers
+        // the entire image.
+        float radius{ 0.f };
+    };
+
+    // The center region, in the input and the output images (in pixels). The input region is exactly the part of the
+    // input that the output region is upscaled from.
+    struct FoveatedRegion
+    {
+        uint32_t inputX;
+        uint32_t inputY;
+        uint32_t inputWidth;
+        uint32_t inputHeight;
+        uint32_t outputX;
+        uint32_t outputY;
+        uint32_t outputWidth;
+        uint32_t outputHeight;
+    };
+
+    // Place the center region for an image upscaled (or sharpened) from inputWidth x inputHeight to outputWidth x
+    // outputHeight. Returns false when the image has no periphery: the entire image must then be processed normally.
+    //
+    // The region that NIS processes and the periphery must sample the input at the same positions, otherwise a seam
+    // appears at the boundary. NIS maps the region of the output to the region of the input with the ratio of their sizes,
+    // so the edges of the region are snapped to the pixels that fall on the same position in both images (every
+    // outputWidth / gcd(inputWidth, outputWidth) pixels horizontally). The region grows to the next such pixels.
+    bool ComputeFoveatedRegion(const FoveationSettings& settings,
+                               uint32_t inputWidth,
+                               uint32_t inputHeight,
+                               uint32_t outputWidth,
+                               uint32_t outputHeight,
+                               FoveatedRegion& region);
+}
@@ -0,0 +1,110 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+namespace nis_scaler
+{
+    // A bump allocator for data that only lives until the end of the current frame.
+    // reset() is called at the beginning of each frame and makes all the previous allocations available again. When a
+    // frame needs more memory than the arena holds, the excess is served from temporary blocks and the arena is resized
+    // to the high-water mark on the next reset(), so that steady-state frames never touch the heap.
+    // Only trivially copyable types may be allocated, since no destructor is ever invoked.
+    class FrameArena
+    {
+    public:
+        explicit FrameArena(const size_t initialCapacity = 4096)
+            : m_capacity(initialCapacity)
+        {
+        }
+
+        // Release all allocations from the previous frame.
+        void reset()
+        {
+            if (!m_overflow.empty() || !m_block)
+            {
+                m_capacity = (std::max)(m_capacity, m_highWaterMark);
+                m_block = std::make_unique<uint8_t[]>(m_capacity);
+                m_overflow.clear();
+            }
+            m_offset = 0;
+            m_highWaterMark = 0;
+        }
+
+        // Release all memory held by the arena.
+        void clear()
+        {
+            m_block.reset();
+            m_overflow.clear();
+            m_offset = 0;
+            m_highWaterMark = 0;
+        }
+
+        // Allocate uninitialized storage for count objects.
+        template <typename T>
+        T* allocate(const size_t count = 1)
+        {
+            static_assert(std::is_trivially_copyable_v<T>, "FrameArena only holds trivially copyable types");
+
+            return reinterpret_cast<T*>(allocateBytes(sizeof(T) * count, alignof(T)));
+        }
+
+        // Allocate a shallow copy of count objects.
+        template <typename T>
+        T* copy(const T* const source, const size_t count = 1)
+        {
+            T* const destination = allocate<T>(count);
+            if (count)
+            {
+                std::memcpy(destination, source, sizeof(T) * count);
+            }
+            return destination;
+        }
+
+    private:
+        void* allocateBytes(const size_t size, const size_t alignment)
+        {
+            const size_t offset = (m_offset + alignment - 1) & ~(alignment - 1);
+            m_highWaterMark = offset + size;
+            if (m_block && offset + size <= m_capacity)
+            {
+                m_offset = offset + size;
+                return m_block.get() + offset;
+            }
+
+            // Serve this allocation from a temporary block. We still account for it in the high-water mark so the next
+            // reset() can size the arena accordingly.
+            m_offset = offset + size;
+            m_overflow.push_back(std::make_unique<uint8_t[]>(size + alignment));
+            const uintptr_t address = reinterpret_cast<uintptr_t>(m_overflow.back().get());
+            return reinterpret_cast<void*>((address + alignment - 1) & ~(uintptr_t)(alignment - 1));
+        }
+
+        std::unique_ptr<uint8_t[]> m_block;
+        std::vector<std::unique_ptr<uint8_t[]>> m_overflow;
+        size_t m_capacity;
+        size_t m_offset{ 0 };
+        size_t m_highWaterMark{ 0 };
+    };
+}
@@ -0,0 +1,117 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+// This file does not use the precompiled header, so it can be shared with the tools.
+
+#include <cstring>
+
+#include "FrameSubmission.h"
+
+namespace
+{
+    // The size of the structures that may be chained to a projection view, for the types known to the layer, or 0.
+    size_t GetViewChainEntrySize(const XrStructureType type)
+    {
+        switch (type)
+        {
+        case XR_TYPE_COMPOSITION_LAYER_DEPTH_INFO_KHR:
+            return sizeof(XrCompositionLayerDepthInfoKHR);
+#ifdef XR_FB_space_warp
+        case XR_TYPE_COMPOSITION_LAYER_SPACE_WARP_INFO_FB:
+            return sizeof(XrCompositionLayerSpaceWarpInfoFB);
+#endif
+        default:
+            return 0;
+        }
+    }
+}
+
+namespace nis_scaler
+{
+    const XrCompositionLayerDepthInfoKHR* FindDepthInfo(const void* const next)
+    {
+        for (const XrBaseInStructure* entry = reinterpret_cast<const XrBaseInStructure*>(next); entry; entry = entry->next)
+        {
+            if (entry->type == XR_TYPE_COMPOSITION_LAYER_DEPTH_INFO_KHR)
+            {
+                return reinterpret_cast<const XrCompositionLayerDepthInfoKHR*>(entry);
+            }
+        }
+        return nullptr;
+    }
+
+    FrameSubmission::FrameSubmission(FrameArena& arena, const XrFrameEndInfo& frameEndInfo)
+        : m_arena(arena),
+          m_frameEndInfo(frameEndInfo)
+    {
+        m_layers = m_arena.copy(frameEndInfo.layers, frameEndInfo.layerCount);
+        m_frameEndInfo.layers = m_layers;
+    }
+
+    XrCompositionLayerProjectionView* FrameSubmission::copyProjectionLayer(const uint32_t index)
+    {
+        const XrCompositionLayerProjection* const proj = reinterpret_cast<const XrCompositionLayerProjection*>(m_layers[index]);
+
+        XrCompositionLayerProjection* const chainProj = m_arena.copy(proj);
+        XrCompositionLayerProjectionView* const chainViews = m_arena.copy(proj->views, proj->viewCount);
+        chainProj->views = chainViews;
+        m_layers[index] = reinterpret_cast<const XrCompositionLayerBaseHeader*>(chainProj);
+
+        return chainViews;
+    }
+
+    XrCompositionLayerDepthInfoKHR* FrameSubmission::copyDepthInfo(XrCompositionLayerProjectionView& view)
+    {
+        // Check the whole prefix of the chain before copying anything.
+        const XrCompositionLayerDepthInfoKHR* const depth = FindDepthInfo(view.next);
+        if (!depth)
+        {
+            return nullptr;
+        }
+        const XrBaseInStructure* const depthEntry = reinterpret_cast<const XrBaseInStructure*>(depth);
+        for (const XrBaseInStructure* entry = reinterpret_cast<const XrBaseInStructure*>(view.next); entry != depthEntry; entry = entry->next)
+        {
+            if (!GetViewChainEntrySize(entry->type))
+            {
+                return nullptr;
+            }
+        }
+
+        // The copies are made of 64-bit words to keep the alignment of the structures. Each copy still points to the
+        // next structure of the application, until that one is copied too.
+        XrBaseInStructure* previous = nullptr;
+        for (const XrBaseInStructure* entry = reinterpret_cast<const XrBaseInStructure*>(view.next);; entry = entry->next)
+        {
+            const size_t size = GetViewChainEntrySize(entry->type);
+            XrBaseInStructure* const copy = reinterpret_cast<XrBaseInStructure*>(m_arena.allocate<uint64_t>((size + 7) / 8));
+            std::memcpy(copy, entry, size);
+            if (previous)
+            {
+                previous->next = copy;
+            }
+            else
+            {
+                view.next = copy;
+            }
+            if (entry == depthEntry)
+            {
+                return reinterpret_cast<XrCompositionLayerDepthInfoKHR*>(copy);
+            }
+            previous = copy;
+        }
+    }
+}
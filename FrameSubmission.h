@@ -0,0 +1,60 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#pragma once
+
+#include <cstdint>
+
+#include <openxr/openxr.h>
+
+#include "FrameArena.h"
+
+namespace nis_scaler
+{
+    // The first depth information in the next chain of a projection view, or nullptr.
+    const XrCompositionLayerDepthInfoKHR* FindDepthInfo(const void* next);
+
+    // The frame submission forwarded to the runtime by xrEndFrame().
+    // The application's structures must not be altered, so the layers array is copied into the frame arena, and each
+    // projection layer that the layer modifies is copied along with its views. The next chain of a view is copied up to
+    // its depth information when the depth is replaced. The other layers, and the rest of the chains, are forwarded as
+    // they are. Everything lives until the next reset() of the arena.
+    class FrameSubmission
+    {
+    public:
+        FrameSubmission(FrameArena& arena, const XrFrameEndInfo& frameEndInfo);
+
+        // Replace a projection layer with a copy, and return the copy of its views, to be modified.
+        XrCompositionLayerProjectionView* copyProjectionLayer(uint32_t index);
+
+        // Replace the first depth information in the next chain of a view returned by copyProjectionLayer(), wherever
+        // it appears, and return its copy, to be modified. The structures before it are copied too, which is only
+        // possible for the types known to the layer: returns nullptr when an unknown structure comes first, or when there
+        // is no depth information, and the chain is left as it is.
+        XrCompositionLayerDepthInfoKHR* copyDepthInfo(XrCompositionLayerProjectionView& view);
+
+        const XrFrameEndInfo* get() const
+        {
+            return &m_frameEndInfo;
+        }
+
+    private:
+        FrameArena& m_arena;
+        XrFrameEndInfo m_frameEndInfo;
+        const XrCompositionLayerBaseHeader** m_layers;
+    };
+}
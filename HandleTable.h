@@ -0,0 +1,221 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace nis_scaler
+{
+    // A flat, open-addressed table mapping OpenXR handles to per-handle state.
+    // This is meant for the lookups done on the xrEndFrame() hot path, where we only ever have a handful of live
+    // handles. The keys are stored contiguously so that a probe sequence usually stays within one cache line, and the
+    // values are stored inline (no node allocation). Collisions are resolved with linear probing and deletions use
+    // backward shifting, so there are no tombstones to clean up.
+    // A null handle is used to mark an empty slot and cannot be used as a key.
+    // Pointers returned by find() are invalidated by insert_or_assign() and erase().
+    template <typename Handle, typename Value>
+    class HandleTable
+    {
+    public:
+        HandleTable()
+        {
+            allocate(MinCapacity);
+        }
+
+        Value* find(const Handle handle)
+        {
+            const size_t slot = lookup(handle);
+            return slot != NotFound ? &m_values[slot] : nullptr;
+        }
+
+        const Value* find(const Handle handle) const
+        {
+            const size_t slot = lookup(handle);
+            return slot != NotFound ? &m_values[slot] : nullptr;
+        }
+
+        Value& insert_or_assign(const Handle handle, Value&& value)
+        {
+            size_t slot = lookup(handle);
+            if (slot != NotFound)
+            {
+                m_values[slot] = std::move(value);
+                return m_values[slot];
+            }
+
+            // Keep the load factor at or below 1/2 so that probe sequences stay short.
+            if (2 * (m_size + 1) > m_keys.size())
+            {
+                grow();
+            }
+
+            slot = home(handle);
+            while (m_keys[slot] != Handle{})
+            {
+                slot = (slot + 1) & m_mask;
+            }
+            m_keys[slot] = handle;
+            m_values[slot] = std::move(value);
+            m_size++;
+
+            return m_values[slot];
+        }
+
+        bool erase(const Handle handle)
+        {
+            size_t hole = lookup(handle);
+            if (hole == NotFound)
+            {
+                return false;
+            }
+
+            // Shift back the entries that follow in the same cluster, so that lookups never stop early on the hole.
+            size_t next = (hole + 1) & m_mask;
+            while (m_keys[next] != Handle{})
+            {
+                const size_t nextHome = home(m_keys[next]);
+                if (((next - nextHome) & m_mask) >= ((next - hole) & m_mask))
+                {
+                    m_keys[hole] = m_keys[next];
+                    m_values[hole] = std::move(m_values[next]);
+                    hole = next;
+                }
+                next = (next + 1) & m_mask;
+            }
+            m_keys[hole] = Handle{};
+            m_values[hole] = Value{};
+            m_size--;
+
+            return true;
+        }
+
+        void clear()
+        {
+            m_keys.clear();
+            m_values.clear();
+            m_size = 0;
+            allocate(MinCapacity);
+        }
+
+        size_t size() const
+        {
+            return m_size;
+        }
+
+        bool empty() const
+        {
+            return m_size == 0;
+        }
+
+        // Invoke a function for each live entry (in no particular order).
+        template <typename Function>
+        void forEach(Function function)
+        {
+            for (size_t i = 0; i < m_keys.size(); i++)
+            {
+                if (m_keys[i] != Handle{})
+                {
+                    function(m_keys[i], m_values[i]);
+                }
+            }
+        }
+
+    private:
+        static constexpr size_t MinCapacity = 16;
+        static constexpr size_t NotFound = ~(size_t)0;
+
+        static uint64_t toKey(const Handle handle)
+        {
+            if constexpr (std::is_pointer_v<Handle>)
+            {
+                return (uint64_t)reinterpret_cast<uintptr_t>(handle);
+            }
+            else
+            {
+                return (uint64_t)handle;
+            }
+        }
+
+        size_t home(const Handle handle) const
+        {
+            // Handles are often sequential or aligned pointers: use a finalizer (from MurmurHash3) to spread the bits.
+            uint64_t key = toKey(handle);
+            key ^= key >> 33;
+            key *= 0xff51afd7ed558ccdull;
+            key ^= key >> 33;
+            return (size_t)key & m_mask;
+        }
+
+        size_t lookup(const Handle handle) const
+        {
+            if (handle == Handle{})
+            {
+                return NotFound;
+            }
+
+            size_t slot = home(handle);
+            while (m_keys[slot] != Handle{})
+            {
+                if (m_keys[slot] == handle)
+                {
+                    return slot;
+                }
+                slot = (slot + 1) & m_mask;
+            }
+            return NotFound;
+        }
+
+        void allocate(const size_t capacity)
+        {
+            m_keys.resize(capacity, Handle{});
+            m_values.resize(capacity);
+            m_mask = capacity - 1;
+        }
+
+        void grow()
+        {
+            std::vector<Handle> oldKeys;
+            std::vector<Value> oldValues;
+            std::swap(oldKeys, m_keys);
+            std::swap(oldValues, m_values);
+
+            allocate(oldKeys.size() * 2);
+            for (size_t i = 0; i < oldKeys.size(); i++)
+            {
+                if (oldKeys[i] != Handle{})
+                {
+                    size_t slot = home(oldKeys[i]);
+                    while (m_keys[slot] != Handle{})
+                    {
+                        slot = (slot + 1) & m_mask;
+                    }
+                    m_keys[slot] = oldKeys[i];
+                    m_values[slot] = std::move(oldValues[i]);
+                }
+            }
+        }
+
+        std::vector<Handle> m_keys;
+        std::vector<Value> m_values;
+        size_t m_mask{ 0 };
+        size_t m_size{ 0 };
+    };
+}
@@ -0,0 +1,142 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// This file does not use the precompiled header, so it can be shared with the tools.
+
+#include "Input.h"
+
+#include <chrono>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#endif
+
+namespace
+{
+    // Keys typically change a few times per session: polling at 100Hz is plenty.
+    constexpr auto PollingPeriod = std::chrono::milliseconds(10);
+}
+
+namespace nis_scaler
+{
+    uint32_t KeyboardInputSource::sample()
+    {
+        uint32_t keys = 0;
+#ifdef _WIN32
+        const auto isDown = [](const int key) { return (GetAsyncKeyState(key) & 0x8000) != 0; };
+
+        if (isDown(VK_CONTROL))
+        {
+            if (isDown(VK_LEFT) || isDown(VK_F1))
+            {
+                keys |= HotkeyBit(HotkeyCommand::CycleScalingMode);
+            }
+            if (isDown(VK_DOWN) || isDown(VK_F2))
+            {
+                keys |= HotkeyBit(HotkeyCommand::DecreaseSharpness);
+            }
+            if (isDown(VK_UP) || isDown(VK_F3))
+            {
+                keys |= HotkeyBit(HotkeyCommand::IncreaseSharpness);
+            }
+            if (isDown(VK_F12))
+            {
+                keys |= HotkeyBit(HotkeyCommand::Screenshot);
+            }
+            if (isDown(VK_F11))
+            {
+                keys |= HotkeyBit(HotkeyCommand::BurstCapture);
+            }
+        }
+#endif
+        return keys;
+    }
+
+    InputPoller::~InputPoller()
+    {
+        // The layer stops polling when the session is destroyed. Otherwise, the process is exiting and the thread was
+        // already terminated, so this does not wait under the loader lock.
+        stop();
+    }
+
+    void InputPoller::start(std::unique_ptr<InputSource> source)
+    {
+        stop();
+
+        m_source = std::move(source);
+        m_head = m_tail = 0;
+        m_stop = false;
+        m_thread = std::thread([this]() { pollThread(); });
+    }
+
+    void InputPoller::stop()
+    {
+        m_stop = true;
+        if (m_thread.joinable())
+        {
+            m_thread.join();
+        }
+        m_source.reset();
+    }
+
+    bool InputPoller::pop(HotkeyCommand& command)
+    {
+        const uint32_t head = m_head.load(std::memory_order_relaxed);
+        if (head == m_tail.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+
+        command = m_queue[head & (QueueSize - 1)];
+        m_head.store(head + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    void InputPoller::push(const HotkeyCommand command)
+    {
+        const uint32_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail - m_head.load(std::memory_order_acquire) == QueueSize)
+        {
+            // The frame loop is not draining the queue (no frames are being submitted): drop the command.
+            return;
+        }
+
+        m_queue[tail & (QueueSize - 1)] = command;
+        m_tail.store(tail + 1, std::memory_order_release);
+    }
+
+    void InputPoller::pollThread()
+    {
+        uint32_t wasPressed = 0;
+        while (!m_stop)
+        {
+            const uint32_t isPressed = m_source->sample();
+            const uint32_t newlyPressed = isPressed & ~wasPressed;
+            for (uint32_t i = 0; i < (uint32_t)HotkeyCommand::EnumMax; i++)
+            {
+                if (newlyPressed & HotkeyBit((HotkeyCommand)i))
+                {
+                    push((HotkeyCommand)i);
+                }
+            }
+            wasPressed = isPressed;
+
+            std::this_thread::sleep_for(PollingPeriod);
+        }
+    }
+}
@@ -0,0 +1,118 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace nis_scaler
+{
+    // The commands that can be triggered with hotkeys.
+    enum class HotkeyCommand : uint32_t
+    {
+        CycleScalingMode = 0,
+        DecreaseSharpness,
+        IncreaseSharpness,
+        Screenshot,
+        BurstCapture,
+        EnumMax
+    };
+
+    constexpr uint32_t HotkeyBit(const HotkeyCommand command)
+    {
+        return 1u << (uint32_t)command;
+    }
+
+    // A source of input. sample() returns a bitmask (see HotkeyBit()) of the hotkeys currently held down.
+    class InputSource
+    {
+    public:
+        virtual ~InputSource() = default;
+
+        virtual uint32_t sample() = 0;
+    };
+
+    // Read the hotkeys from the keyboard (Windows only).
+    class KeyboardInputSource : public InputSource
+    {
+    public:
+        uint32_t sample() override;
+    };
+
+    // Replay a fixed sequence of samples, then report no keys held.
+    class ScriptedInputSource : public InputSource
+    {
+    public:
+        explicit ScriptedInputSource(std::vector<uint32_t> samples)
+            : m_samples(std::move(samples))
+        {
+        }
+
+        uint32_t sample() override
+        {
+            const size_t next = m_next.load(std::memory_order_relaxed);
+            if (next >= m_samples.size())
+            {
+                return 0;
+            }
+            m_next.store(next + 1, std::memory_order_release);
+            return m_samples[next];
+        }
+
+        // Whether all the samples were replayed. May be called from any thread.
+        bool isFinished() const
+        {
+            return m_next.load(std::memory_order_acquire) >= m_samples.size();
+        }
+
+    private:
+        const std::vector<uint32_t> m_samples;
+        std::atomic<size_t> m_next{ 0 };
+    };
+
+    // Poll an input source on a dedicated thread, and turn key presses (edges) into commands.
+    // The commands are passed to the frame loop through a single-producer/single-consumer lock-free queue.
+    class InputPoller
+    {
+    public:
+        ~InputPoller();
+
+        void start(std::unique_ptr<InputSource> source);
+        void stop();
+
+        // Retrieve the next pending command. Only one thread may call this.
+        bool pop(HotkeyCommand& command);
+
+    private:
+        static constexpr size_t QueueSize = 64; // Must be a power of two.
+
+        void pollThread();
+        void push(HotkeyCommand command);
+
+        std::unique_ptr<InputSource> m_source;
+        std::thread m_thread;
+        std::atomic<bool> m_stop{ false };
+
+        std::array<HotkeyCommand, QueueSize> m_queue{};
+        alignas(64) std::atomic<uint32_t> m_head{ 0 };
+        alignas(64) std::atomic<uint32_t> m_tail{ 0 };
+    };
+}
@@ -0,0 +1,302 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// This file does not use the precompiled header, so it can be shared with the tools.
+
+#include "Log.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#endif
+
+namespace
+{
+    using namespace nis_scaler::log_detail;
+
+    // Must be a power of two. The largest bursts of the layer (when a session starts) are a few hundred messages at most,
+    // and a burst up to the size of the queue is never dropped (see Tools/LogBenchmark). Beyond that, the callers still
+    // do not wait, and the excess messages are dropped.
+    constexpr size_t QueueSize = 1024;
+
+    // The log file is rotated once it reaches this size.
+    constexpr std::uintmax_t MaxLogFileSize = 16 * 1024 * 1024;
+
+    // How often the writer thread checks for new messages. During a burst, the callers also wake it up each time they
+    // fill another WakeInterval records, so that it frees the slots before the queue is full.
+    constexpr auto WriterPeriod = std::chrono::milliseconds(10);
+    constexpr size_t WakeInterval = QueueSize / 4;
+
+    // A bounded multi-producer queue (from Dmitry Vyukov), with a single consumer: the writer thread.
+    class Logger
+    {
+    public:
+        Logger()
+            : m_records(new Record[QueueSize])
+        {
+            for (size_t i = 0; i < QueueSize; i++)
+            {
+                m_records[i].sequence.store(i, std::memory_order_relaxed);
+            }
+        }
+
+        ~Logger()
+        {
+            // The layer stops the writer thread when the instance is destroyed, before the loader may unload the DLL (see
+            // StopLogging()). Otherwise, stop it here: the thread must not outlive the code that it runs.
+            stop();
+        }
+
+        void start(const std::string& path)
+        {
+            std::unique_lock lock(m_consumerMutex);
+
+            if (m_stream.is_open())
+            {
+                return;
+            }
+
+            // The log is started over by each process, but not when logging starts again (see stop()).
+            m_path = path;
+            m_stream.open(m_path, m_hasStarted ? std::ios_base::app : std::ios_base::trunc);
+            m_hasStarted = true;
+            if (!m_thread.joinable())
+            {
+                m_stop = false;
+                m_thread = std::thread([this]() { writerThread(); });
+            }
+        }
+
+        // Stop the writer thread, and write the messages that are still queued (and the number of dropped messages).
+        void stop()
+        {
+            m_stop = true;
+            wake();
+            if (m_thread.joinable())
+            {
+                m_thread.join();
+            }
+
+            std::unique_lock lock(m_consumerMutex);
+            drain();
+            m_stream.close();
+        }
+
+        Record* beginRecord()
+        {
+            uint64_t position = m_enqueuePosition.load(std::memory_order_relaxed);
+            while (true)
+            {
+                Record& record = m_records[position & (QueueSize - 1)];
+                const uint64_t sequence = record.sequence.load(std::memory_order_acquire);
+                const int64_t difference = (int64_t)sequence - (int64_t)position;
+                if (difference == 0)
+                {
+                    if (m_enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                    {
+                        if ((position + 1) % WakeInterval == 0)
+                        {
+                            wake();
+                        }
+                        return &record;
+                    }
+                }
+                else if (difference < 0)
+                {
+                    // The queue is full.
+                    m_dropped.fetch_add(1, std::memory_order_relaxed);
+                    return nullptr;
+                }
+                else
+                {
+                    position = m_enqueuePosition.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        void commitRecord(Record* record)
+        {
+            // The record was claimed at position sequence.
+            record->sequence.store(record->sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+
+    private:
+        void writerThread()
+        {
+            while (!m_stop)
+            {
+                bool idle;
+                {
+                    std::unique_lock lock(m_consumerMutex);
+                    idle = !drain();
+                }
+                if (idle)
+                {
+                    std::unique_lock lock(m_wakeMutex);
+                    m_wake.wait_for(lock, WriterPeriod, [this]() { return m_stop || m_isWakeRequested; });
+                    m_isWakeRequested = false;
+                }
+            }
+        }
+
+        // The callers do not take the mutex of the writer thread: a wake up may be missed, and the writer thread then
+        // waits for the rest of its period.
+        void wake()
+        {
+            m_isWakeRequested = true;
+            m_wake.notify_one();
+        }
+
+        // Write all the queued messages. Returns whether there were any.
+        bool drain()
+        {
+            m_batch.clear();
+
+            while (true)
+            {
+                Record& record = m_records[m_dequeuePosition & (QueueSize - 1)];
+                if (record.sequence.load(std::memory_order_acquire) != m_dequeuePosition + 1)
+                {
+                    break;
+                }
+
+                formatRecord(record);
+                record.sequence.store(m_dequeuePosition + QueueSize, std::memory_order_release);
+                m_dequeuePosition++;
+            }
+
+            const uint64_t dropped = m_dropped.exchange(0, std::memory_order_relaxed);
+            if (dropped)
+            {
+                m_batch += std::to_string(dropped) + " log messages were dropped\n";
+            }
+
+            if (m_batch.empty())
+            {
+                return false;
+            }
+
+            if (m_stream.is_open())
+            {
+                m_stream << m_batch;
+                m_stream.flush();
+                rotate();
+            }
+
+            return true;
+        }
+
+        void formatRecord(const Record& record)
+        {
+            char buf[1024];
+
+            // The timestamps have a resolution of a second: the prefix is only formatted again when it changes.
+            if (record.time != m_prefixTime || m_prefix.empty())
+            {
+                const std::time_t time = (std::time_t)record.time;
+                char prefix[64];
+                m_prefix.assign(prefix, std::strftime(prefix, sizeof(prefix), "%Y-%m-%d %H:%M:%S %z: ", std::localtime(&time)));
+                m_prefixTime = record.time;
+            }
+            std::memcpy(buf, m_prefix.data(), m_prefix.size());
+            const size_t offset = m_prefix.size();
+            record.formatter(buf + offset, sizeof(buf) - offset, record.format, record.payload);
+#ifdef _WIN32
+            OutputDebugStringA(buf);
+#endif
+            m_batch += buf;
+        }
+
+        void rotate()
+        {
+            if ((std::uintmax_t)m_stream.tellp() < MaxLogFileSize)
+            {
+                return;
+            }
+
+            // Keep one previous log file.
+            m_stream.close();
+            const std::filesystem::path path(m_path);
+            std::filesystem::path previous(path);
+            previous.replace_extension(".1" + path.extension().string());
+            std::error_code ec;
+            std::filesystem::rename(path, previous, ec);
+            m_stream.open(m_path, std::ios_base::trunc);
+        }
+
+        std::unique_ptr<Record[]> m_records;
+        alignas(64) std::atomic<uint64_t> m_enqueuePosition{ 0 };
+        alignas(64) std::atomic<uint64_t> m_dropped{ 0 };
+
+        // Only accessed by the consumer.
+        alignas(64) std::mutex m_consumerMutex;
+        uint64_t m_dequeuePosition{ 0 };
+        std::string m_batch;
+        std::string m_prefix;
+        int64_t m_prefixTime{ 0 };
+        std::string m_path;
+        std::ofstream m_stream;
+        bool m_hasStarted{ false };
+
+        std::atomic<bool> m_stop{ false };
+        std::atomic<bool> m_isWakeRequested{ false };
+        std::mutex m_wakeMutex;
+        std::condition_variable m_wake;
+        std::thread m_thread;
+    };
+
+    Logger logger;
+}
+
+namespace nis_scaler
+{
+    void StartLogging(const std::string& path)
+    {
+        logger.start(path);
+    }
+
+    void StopLogging()
+    {
+        logger.stop();
+    }
+
+    namespace log_detail
+    {
+        Record* BeginRecord()
+        {
+            return logger.beginRecord();
+        }
+
+        void CommitRecord(Record* record)
+        {
+            logger.commitRecord(record);
+        }
+
+        int64_t Now()
+        {
+            return (int64_t)std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+        }
+    }
+}
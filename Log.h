@@ -0,0 +1,189 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+// Asynchronous logging.
+//
+// Callers only capture the format string pointer, a timestamp and their (packed) arguments into a queue. A background
+// thread does the formatting, the timestamp conversion and the file I/O. The format string must be a literal (or
+// otherwise outlive the process), and the arguments must be printf-compatible values. C strings are copied into the
+// record, since they typically point to temporaries.
+
+namespace nis_scaler
+{
+    // Start writing the log to a file. Messages logged before this call are kept and written then.
+    void StartLogging(const std::string& path);
+
+    // Stop the writer thread, once the queued messages are written. Messages logged afterwards are kept until logging
+    // starts again.
+    void StopLogging();
+
+    namespace log_detail
+    {
+        constexpr size_t MaxPayloadSize = 496;
+
+        using FormatFunction = void (*)(char* buffer, size_t size, const char* format, const uint8_t* payload);
+
+        struct alignas(64) Record
+        {
+            std::atomic<uint64_t> sequence;
+            const char* format;
+            FormatFunction formatter;
+            int64_t time;
+            alignas(8) uint8_t payload[MaxPayloadSize];
+        };
+
+        // Claim a record in the queue, or nullptr if the queue is full (the message is then dropped).
+        Record* BeginRecord();
+        void CommitRecord(Record* record);
+
+        // Copy strings into the payload, past the packed arguments.
+        struct PayloadWriter
+        {
+            uint8_t* payload;
+            size_t offset;
+
+            uint32_t writeString(const char* string)
+            {
+                const uint32_t stringOffset = (uint32_t)offset;
+                const size_t available = MaxPayloadSize - offset;
+                if (!available)
+                {
+                    // The caller reserved at least one byte per string: this cannot happen.
+                    return (uint32_t)(MaxPayloadSize - 1);
+                }
+                const size_t length = string ? strnlen(string, available - 1) : 0;
+                if (length)
+                {
+                    std::memcpy(payload + offset, string, length);
+                }
+                payload[offset + length] = 0;
+                offset += length + 1;
+                return stringOffset;
+            }
+        };
+
+        // How an argument is stored in the payload.
+        template <typename T>
+        struct Argument
+        {
+            static_assert(std::is_arithmetic_v<T> || std::is_enum_v<T> || std::is_pointer_v<T>, "Unsupported log argument type");
+
+            using Stored = T;
+
+            static Stored pack(const T value, PayloadWriter&)
+            {
+                return value;
+            }
+
+            static T unpack(const Stored value, const uint8_t*)
+            {
+                return value;
+            }
+        };
+
+        template <>
+        struct Argument<const char*>
+        {
+            using Stored = uint32_t;
+
+            static Stored pack(const char* const value, PayloadWriter& writer)
+            {
+                return writer.writeString(value);
+            }
+
+            static const char* unpack(const Stored offset, const uint8_t* payload)
+            {
+                return reinterpret_cast<const char*>(payload + offset);
+            }
+        };
+
+        template <>
+        struct Argument<char*> : Argument<const char*>
+        {
+        };
+
+        template <typename... Args>
+        using StoredArguments = std::tuple<typename Argument<Args>::Stored...>;
+
+        template <typename... Args, size_t... Indices>
+        void FormatArguments(char* buffer, size_t size, const char* format, const uint8_t* payload, std::index_sequence<Indices...>)
+        {
+            const auto& stored = *std::launder(reinterpret_cast<const StoredArguments<Args...>*>(payload));
+            std::snprintf(buffer, size, format, Argument<Args>::unpack(std::get<Indices>(stored), payload)...);
+            (void)stored;
+        }
+
+        template <typename... Args>
+        void Format(char* buffer, size_t size, const char* format, const uint8_t* payload)
+        {
+            FormatArguments<Args...>(buffer, size, format, payload, std::index_sequence_for<Args...>{});
+        }
+
+        int64_t Now();
+
+        template <typename... Args>
+        void Push(const char* format, const Args&... args)
+        {
+            using Stored = StoredArguments<Args...>;
+            static_assert(sizeof(Stored) + sizeof...(Args) <= MaxPayloadSize, "Too many log arguments");
+
+            Record* const record = BeginRecord();
+            if (!record)
+            {
+                return;
+            }
+
+            record->format = format;
+            record->formatter = &Format<Args...>;
+            record->time = Now();
+
+            PayloadWriter writer{ record->payload, sizeof(Stored) };
+            new (record->payload) Stored(Argument<Args>::pack(args, writer)...);
+            (void)writer;
+
+            CommitRecord(record);
+        }
+    }
+
+    // General logging function.
+    template <typename... Args>
+    void Log(const char* format, const Args&... args)
+    {
+        log_detail::Push<std::decay_t<const Args>...>(format, args...);
+    }
+
+    // Debug logging function. Can make things very slow (only enabled on Debug builds).
+    template <typename... Args>
+    void DebugLog(const char* format, const Args&... args)
+    {
+#ifdef _DEBUG
+        Log(format, args...);
+#endif
+    }
+}
@@ -0,0 +1,83 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+// This file does not use the precompiled header, so it can be shared with the tools.
+
+#include "MsaaResolve.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    // The standard sample positions, in 1/16th of a pixel from its center (see the documentation of
+    // D3D11_STANDARD_MULTISAMPLE_QUALITY_LEVELS).
+    const int8_t StandardPositions2[][2] = { { 4, 4 }, { -4, -4 } };
+    const int8_t StandardPositions4[][2] = { { -2, -6 }, { 6, -2 }, { -6, 2 }, { 2, 6 } };
+    const int8_t StandardPositions8[][2] = { { 1, -3 }, { -1, 3 }, { 5, 1 }, { -3, -5 }, { -5, 5 }, { -7, -1 }, { 3, 7 }, { 7, -7 } };
+    const int8_t StandardPositions16[][2] = { { 1, 1 },   { -1, -3 }, { -3, 2 }, { 4, -1 },  { -5, -2 }, { 2, 5 },  { 5, 3 },  { 3, -5 },
+                                              { -2, 6 },  { 0, -7 },  { -4, -6 }, { -6, 4 }, { -8, 0 },  { 7, -4 }, { 6, 7 },  { -7, -8 } };
+
+    const int8_t (*GetStandardPositions(const uint32_t sampleCount))[2]
+    {
+        switch (sampleCount)
+        {
+        case 2:
+            return StandardPositions2;
+        case 4:
+            return StandardPositions4;
+        case 8:
+            return StandardPositions8;
+        case 16:
+            return StandardPositions16;
+        default:
+            return nullptr;
+        }
+    }
+}
+
+namespace nis_scaler
+{
+    bool HasStandardSamplePositions(const uint32_t sampleCount)
+    {
+        return GetStandardPositions(sampleCount) != nullptr;
+    }
+
+    bool GetMsaaResolveWeights(const uint32_t sampleCount, const MsaaResolveFilter filter, float* const weights)
+    {
+        if (!sampleCount || sampleCount > MaxSampleCount)
+        {
+            return false;
+        }
+
+        const int8_t(*const positions)[2] = GetStandardPositions(sampleCount);
+        float total = 0.f;
+        for (uint32_t i = 0; i < sampleCount; i++)
+        {
+            // A tent of one pixel in each direction: the samples on the edges of the pixel weigh half as much as the
+            // center.
+            weights[i] = 1.f;
+            if (filter == MsaaResolveFilter::Tent && positions)
+            {
+                weights[i] = (1.f - std::abs(positions[i][0]) / 16.f) * (1.f - std::abs(positions[i][1]) / 16.f);
+            }
+            total += weights[i];
+        }
+        std::transform(weights, weights + sampleCount, weights, [&](const float weight) { return weight / total; });
+        return true;
+    }
+}
@@ -0,0 +1,46 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#pragma once
+
+#include <cstdint>
+
+namespace nis_scaler
+{
+    // The largest sample count of a multisampled texture.
+    constexpr uint32_t MaxSampleCount = 16;
+
+    // How the samples of a pixel are combined when resolving a multisampled texture.
+    enum class MsaaResolveFilter
+    {
+        // All the samples have the same weight, like ResolveSubresource().
+        Box = 0,
+
+        // The samples are weighted by their distance to the center of the pixel, with the standard sample positions of
+        // Direct3D (D3D11_STANDARD_MULTISAMPLE_PATTERN).
+        Tent,
+
+        EnumMax
+    };
+
+    // Whether the standard sample positions are defined for a sample count.
+    bool HasStandardSamplePositions(uint32_t sampleCount);
+
+    // The weight of each sample (sampleCount values, adding up to 1). The tent filter falls back to the box filter for
+    // the sample counts without standard sample positions. Returns false for an invalid sample count.
+    bool GetMsaaResolveWeights(uint32_t sampleCount, MsaaResolveFilter filter, float* weights);
+}
@@ -0,0 +1,176 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pch.h"
+
+#include <chrono>
+#include <thread>
+
+#include <DeviceResources.h>
+#include <DXUtilities.h>
+
+#include "Log.h"
+#include "NISAutotune.h"
+#include "NISRenderer.h"
+
+namespace
+{
+    using namespace nis_scaler;
+
+    // The dispatches before the measurements (to warm up the caches and clocks), and the measured dispatches.
+    const uint32_t WarmupDispatches = 4;
+    const uint32_t TimedDispatches = 16;
+
+    // How long to wait for the GPU to complete the dispatches of a variant.
+    const auto CompletionTimeout = std::chrono::seconds(1);
+
+    struct TimerQueries
+    {
+        Microsoft::WRL::ComPtr<ID3D11Query> timeStampDis;
+        Microsoft::WRL::ComPtr<ID3D11Query> timeStampStart;
+        Microsoft::WRL::ComPtr<ID3D11Query> timeStampEnd;
+    };
+
+    // Read a query, waiting for the GPU if needed.
+    template <typename T>
+    bool WaitForQuery(ID3D11DeviceContext* const context, ID3D11Query* const query, T& data, const std::chrono::steady_clock::time_point deadline)
+    {
+        while (true)
+        {
+            const HRESULT hr = context->GetData(query, &data, sizeof(T), 0);
+            if (hr == S_OK)
+            {
+                return true;
+            }
+            if (FAILED(hr) || std::chrono::steady_clock::now() > deadline)
+            {
+                return false;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+}
+
+namespace nis_scaler
+{
+    std::vector<NISVariantTiming> TimeNISVariants(DeviceResources& deviceResources,
+                                                  const std::string& shaderHome,
+                                                  ShaderCache* const shaderCache,
+                                                  const bool isUpscaling,
+                                                  const std::vector<NISVariant>& variants,
+                                                  const uint32_t inputWidth,
+                                                  const uint32_t inputHeight,
+                                                  const uint32_t outputWidth,
+                                                  const uint32_t outputHeight)
+    {
+        ID3D11DeviceContext* const context = deviceResources.context();
+
+        // The contents of the textures do not matter for the timings. The shader reads and writes texture arrays.
+        Microsoft::WRL::ComPtr<ID3D11Texture2D> input;
+        Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> inputSrv;
+        Microsoft::WRL::ComPtr<ID3D11Texture2D> output;
+        Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView> outputUav;
+        deviceResources.createTexture2D(inputWidth, inputHeight, DXGI_FORMAT_R8G8B8A8_UNORM, D3D11_USAGE_DEFAULT, nullptr, 0, 0, input.GetAddressOf());
+        deviceResources.createTexture2D(outputWidth, outputHeight, DXGI_FORMAT_R8G8B8A8_UNORM, D3D11_USAGE_DEFAULT, nullptr, 0, 0, output.GetAddressOf());
+        D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc;
+        ZeroMemory(&srvDesc, sizeof(D3D11_SHADER_RESOURCE_VIEW_DESC));
+        srvDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+        srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
+        srvDesc.Texture2DArray.MipLevels = 1;
+        srvDesc.Texture2DArray.ArraySize = 1;
+        DX::ThrowIfFailed(deviceResources.device()->CreateShaderResourceView(input.Get(), &srvDesc, inputSrv.GetAddressOf()));
+        D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc;
+        ZeroMemory(&uavDesc, sizeof(D3D11_UNORDERED_ACCESS_VIEW_DESC));
+        uavDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+        uavDesc.ViewDimension = D3D11_UAV_DIMENSION_TEXTURE2DARRAY;
+        uavDesc.Texture2DArray.ArraySize = 1;
+        DX::ThrowIfFailed(deviceResources.device()->CreateUnorderedAccessView(output.Get(), &uavDesc, outputUav.GetAddressOf()));
+
+        std::vector<TimerQueries> queries(TimedDispatches);
+        for (TimerQueries& query : queries)
+        {
+            D3D11_QUERY_DESC queryDesc;
+            ZeroMemory(&queryDesc, sizeof(D3D11_QUERY_DESC));
+            queryDesc.Query = D3D11_QUERY_TIMESTAMP_DISJOINT;
+            DX::ThrowIfFailed(deviceResources.device()->CreateQuery(&queryDesc, query.timeStampDis.GetAddressOf()));
+            queryDesc.Query = D3D11_QUERY_TIMESTAMP;
+            DX::ThrowIfFailed(deviceResources.device()->CreateQuery(&queryDesc, query.timeStampStart.GetAddressOf()));
+            DX::ThrowIfFailed(deviceResources.device()->CreateQuery(&queryDesc, query.timeStampEnd.GetAddressOf()));
+        }
+
+        std::vector<NISVariantTiming> timings;
+        for (const NISVariant& variant : variants)
+        {
+            timings.push_back({ variant, {} });
+
+            std::unique_ptr<NISRenderer> renderer;
+            try
+            {
+                renderer = std::make_unique<NISRenderer>(deviceResources, shaderHome, isUpscaling, variant, shaderCache);
+            }
+            catch (std::runtime_error& exc)
+            {
+                Log("Cannot compile NIS variant %s: %s\n", variant.describe().c_str(), exc.what());
+                continue;
+            }
+            const NISView view{ 0, { 0, 0, inputWidth, inputHeight }, 0, { 0, 0, outputWidth, outputHeight } };
+            if (!renderer->update(0, 0.5f, &view, 1, inputWidth, inputHeight, outputWidth, outputHeight, false))
+            {
+                continue;
+            }
+
+            for (uint32_t i = 0; i < WarmupDispatches; i++)
+            {
+                renderer->dispatch(0, inputSrv.GetAddressOf(), outputUav.GetAddressOf());
+            }
+            for (TimerQueries& query : queries)
+            {
+                context->Begin(query.timeStampDis.Get());
+                context->End(query.timeStampStart.Get());
+                renderer->dispatch(0, inputSrv.GetAddressOf(), outputUav.GetAddressOf());
+                context->End(query.timeStampEnd.Get());
+                context->End(query.timeStampDis.Get());
+            }
+            context->Flush();
+
+            const auto deadline = std::chrono::steady_clock::now() + CompletionTimeout;
+            for (TimerQueries& query : queries)
+            {
+                D3D11_QUERY_DATA_TIMESTAMP_DISJOINT disData;
+                UINT64 startime;
+                UINT64 endtime;
+                if (!WaitForQuery(context, query.timeStampDis.Get(), disData, deadline) ||
+                    !WaitForQuery(context, query.timeStampStart.Get(), startime, deadline) ||
+                    !WaitForQuery(context, query.timeStampEnd.Get(), endtime, deadline))
+                {
+                    break;
+                }
+                if (!disData.Disjoint)
+                {
+                    timings.back().samples.push_back((float)((endtime - startime) / double(disData.Frequency) * 1e6));
+                }
+            }
+        }
+
+        // Unbind the textures before they are released.
+        ID3D11ShaderResourceView* const srvs[] = { nullptr };
+        context->CSSetShaderResources(0, 1, srvs);
+        ID3D11UnorderedAccessView* const uavs[] = { nullptr };
+        context->CSSetUnorderedAccessViews(0, 1, uavs, nullptr);
+
+        return timings;
+    }
+}
@@ -0,0 +1,39 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "NISTuning.h"
+
+class DeviceResources;
+
+namespace nis_scaler
+{
+    class ShaderCache;
+
+    // Time each variant of the NIS shader with textures of the given sizes. This compiles every variant and waits for the
+    // GPU (typically a few hundred milliseconds), so it is only done when the tuning database has no result for the GPU
+    // and driver yet. Variants that fail to compile or to complete in time have no samples.
+    std::vector<NISVariantTiming> TimeNISVariants(DeviceResources& deviceResources,
+                                                  const std::string& shaderHome,
+                                                  ShaderCache* shaderCache,
+                                                  bool isUpscaling,
+                                                  const std::vector<NISVariant>& variants,
+                                                  uint32_t inputWidth,
+                                                  uint32_t inputHeight,
+                                                  uint32_t outputWidth,
+                                                  uint32_t outputHeight);
+}
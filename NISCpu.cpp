@@ -0,0 +1,1061 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// This file does not use the precompiled header, so it can be shared with the tools.
+
+#include "NISCpuKernel.h"
+
+#include <atomic>
+#include <thread>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(__x86_64__))
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+
+namespace
+{
+    using namespace nis_scaler;
+    using namespace nis_scaler::nis_cpu;
+
+    // Output rows per band. Each band recomputes the few source rows it shares with its neighbours, in exchange for
+    // bands that are processed independently.
+    constexpr uint32_t BandHeight = 32;
+
+    // The input pixels around the samples of a region that are read to process it: the support of the filters and the
+    // edge map of its pixels.
+    constexpr uint32_t RegionMargin = 4;
+
+    // The scalar kernel below is a port of NIS_Scaler.h, keeping the names and the structure of the shader.
+
+    float saturate(const float x)
+    {
+        return (std::min)((std::max)(x, 0.0f), 1.0f);
+    }
+
+    float lerp(const float a, const float b, const float t)
+    {
+        return a + (b - a) * t;
+    }
+
+    float getY(const float r, const float g, const float b)
+    {
+        return r * 0.2126f + g * 0.7152f + b * 0.0722f;
+    }
+
+    // The 3x3 neighbourhood is given as p[x][y] for the scaler, and p[y][x] for the sharpener.
+    void GetEdgeMap(const NISConfig& config, const float p[3][3], float weights[4])
+    {
+        const float g_0 = std::abs(p[0][0] + p[0][1] + p[0][2] - p[2][0] - p[2][1] - p[2][2]);
+        const float g_45 = std::abs(p[1][0] + p[0][0] + p[0][1] - p[2][1] - p[2][2] - p[1][2]);
+        const float g_90 = std::abs(p[0][0] + p[1][0] + p[2][0] - p[0][2] - p[1][2] - p[2][2]);
+        const float g_135 = std::abs(p[1][0] + p[2][0] + p[2][1] - p[0][1] - p[0][2] - p[1][2]);
+
+        const float g_0_90_max = (std::max)(g_0, g_90);
+        const float g_0_90_min = (std::min)(g_0, g_90);
+        const float g_45_135_max = (std::max)(g_45, g_135);
+        const float g_45_135_min = (std::min)(g_45, g_135);
+
+        if (g_0_90_max + g_45_135_max == 0)
+        {
+            weights[0] = weights[1] = weights[2] = weights[3] = 0.0f;
+            return;
+        }
+
+        const float e_0_90 = (std::min)(g_0_90_max / (g_0_90_max + g_45_135_max), 1.0f);
+        const float e_45_135 = 1.0f - e_0_90;
+
+        const bool c_0_90 = (g_0_90_max > (g_0_90_min * config.kDetectRatio)) && (g_0_90_max > config.kDetectThres) &&
+                            (g_0_90_max > g_45_135_min);
+        const bool c_45_135 = (g_45_135_max > (g_45_135_min * config.kDetectRatio)) &&
+                              (g_45_135_max > config.kDetectThres) && (g_45_135_max > g_0_90_min);
+        const bool c_g_0_90 = g_0_90_max == g_0;
+        const bool c_g_45_135 = g_45_135_max == g_45;
+
+        const float f_e_0_90 = (c_0_90 && c_45_135) ? e_0_90 : 1.0f;
+        const float f_e_45_135 = (c_0_90 && c_45_135) ? e_45_135 : 1.0f;
+
+        weights[0] = (c_0_90 && c_g_0_90) ? f_e_0_90 : 0.0f;
+        weights[1] = (c_0_90 && !c_g_0_90) ? f_e_0_90 : 0.0f;
+        weights[2] = (c_45_135 && c_g_45_135) ? f_e_45_135 : 0.0f;
+        weights[3] = (c_45_135 && !c_g_45_135) ? f_e_45_135 : 0.0f;
+    }
+
+    float CalcLTI(const Job& job, const float pxl[6], const int phase_index)
+    {
+        const NISConfig& config = *job.config;
+
+        const bool selector = (phase_index <= job.phaseCount / 2);
+        float sel = selector ? pxl[0] : pxl[3];
+        const float a_min = (std::min)((std::min)(pxl[1], pxl[2]), sel);
+        const float a_max = (std::max)((std::max)(pxl[1], pxl[2]), sel);
+        sel = selector ? pxl[2] : pxl[5];
+        const float b_min = (std::min)((std::min)(pxl[3], pxl[4]), sel);
+        const float b_max = (std::max)((std::max)(pxl[3], pxl[4]), sel);
+
+        const float a_cont = a_max - a_min;
+        const float b_cont = b_max - b_min;
+
+        const float cont_ratio = (std::max)(a_cont, b_cont) / ((std::min)(a_cont, b_cont) + config.kEps);
+        return (1.0f - saturate((cont_ratio - config.kMinContrastRatio) * config.kRatioNorm)) * config.kContrastBoost;
+    }
+
+    float EvalPoly6(const Job& job, const float pxl[6], const int phase_int)
+    {
+        const NISConfig& config = *job.config;
+        const float* coefScale = job.coefScale + phase_int * job.filterStride;
+        const float* coefUsm = job.coefUsm + phase_int * job.filterStride;
+
+        float y = 0.f;
+        for (int i = 0; i < 6; ++i)
+        {
+            y += coefScale[i] * pxl[i];
+        }
+        float y_usm = 0.f;
+        for (int i = 0; i < 6; ++i)
+        {
+            y_usm += coefUsm[i] * pxl[i];
+        }
+
+        // let's compute a piece-wise ramp based on luma
+        const float y_scale = 1.0f - saturate((y - config.kSharpStartY) * config.kSharpScaleY);
+
+        // scale the ramp to sharpen as a function of luma
+        const float y_sharpness = y_scale * config.kSharpStrengthScale + config.kSharpStrengthMin;
+
+        y_usm *= y_sharpness;
+
+        // scale the ramp to limit USM as a function of luma
+        const float y_sharpness_limit = (y_scale * config.kSharpLimitScale + config.kSharpLimitMin) * y;
+
+        y_usm = (std::min)(y_sharpness_limit, (std::max)(-y_sharpness_limit, y_usm));
+        // reduce ringing
+        y_usm *= CalcLTI(job, pxl, phase_int);
+
+        return y + y_usm;
+    }
+
+    float FilterNormal(const Job& job, const float p[6][6], const int phase_x_frac_int, const int phase_y_frac_int)
+    {
+        const float* coefX = job.coefScale + phase_x_frac_int * job.filterStride;
+        const float* coefY = job.coefScale + phase_y_frac_int * job.filterStride;
+
+        float h_acc = 0.0f;
+        for (int j = 0; j < 6; ++j)
+        {
+            float v_acc = 0.0f;
+            for (int i = 0; i < 6; ++i)
+            {
+                v_acc += p[i][j] * coefY[i];
+            }
+            h_acc += v_acc * coefX[j];
+        }
+
+        return h_acc;
+    }
+
+    float AddDirFilters(const Job& job,
+                        const float p[6][6],
+                        const float phase_x_frac,
+                        const float phase_y_frac,
+                        const int phase_x_frac_int,
+                        const int phase_y_frac_int,
+                        const float w[4])
+    {
+        float f = 0;
+        if (w[0] > 0.0f)
+        {
+            // 0 deg filter
+            float interp0Deg[6];
+            for (int i = 0; i < 6; ++i)
+            {
+                interp0Deg[i] = lerp(p[i][2], p[i][3], phase_x_frac);
+            }
+
+            f += EvalPoly6(job, interp0Deg, phase_y_frac_int) * w[0];
+        }
+
+        if (w[1] > 0.0f)
+        {
+            // 90 deg filter
+            float interp90Deg[6];
+            for (int i = 0; i < 6; ++i)
+            {
+                interp90Deg[i] = lerp(p[2][i], p[3][i], phase_y_frac);
+            }
+
+            f += EvalPoly6(job, interp90Deg, phase_x_frac_int) * w[1];
+        }
+
+        if (w[2] > 0.0f)
+        {
+            // 45 deg filter
+            float pphase_b45 = 0.5f + 0.5f * (phase_x_frac - phase_y_frac);
+
+            float temp_interp45Deg[7];
+            temp_interp45Deg[1] = lerp(p[2][1], p[1][2], pphase_b45);
+            temp_interp45Deg[3] = lerp(p[3][2], p[2][3], pphase_b45);
+            temp_interp45Deg[5] = lerp(p[4][3], p[3][4], pphase_b45);
+            {
+                pphase_b45 = pphase_b45 - 0.5f;
+                const float a = (pphase_b45 >= 0.f) ? p[0][2] : p[2][0];
+                const float b = (pphase_b45 >= 0.f) ? p[1][3] : p[3][1];
+                const float c = (pphase_b45 >= 0.f) ? p[2][4] : p[4][2];
+                const float d = (pphase_b45 >= 0.f) ? p[3][5] : p[5][3];
+                temp_interp45Deg[0] = lerp(p[1][1], a, std::abs(pphase_b45));
+                temp_interp45Deg[2] = lerp(p[2][2], b, std::abs(pphase_b45));
+                temp_interp45Deg[4] = lerp(p[3][3], c, std::abs(pphase_b45));
+                temp_interp45Deg[6] = lerp(p[4][4], d, std::abs(pphase_b45));
+            }
+
+            float interp45Deg[6];
+            float pphase_p45 = phase_x_frac + phase_y_frac;
+            if (pphase_p45 >= 1)
+            {
+                for (int i = 0; i < 6; i++)
+                {
+                    interp45Deg[i] = temp_interp45Deg[i + 1];
+                }
+                pphase_p45 = pphase_p45 - 1;
+            }
+            else
+            {
+                for (int i = 0; i < 6; i++)
+                {
+                    interp45Deg[i] = temp_interp45Deg[i];
+                }
+            }
+
+            f += EvalPoly6(job, interp45Deg, (int)(pphase_p45 * job.phaseCount)) * w[2];
+        }
+
+        if (w[3] > 0.0f)
+        {
+            // 135 deg filter
+            float pphase_b135 = 0.5f * (phase_x_frac + phase_y_frac);
+
+            float temp_interp135Deg[7];
+            temp_interp135Deg[1] = lerp(p[3][1], p[4][2], pphase_b135);
+            temp_interp135Deg[3] = lerp(p[2][2], p[3][3], pphase_b135);
+            temp_interp135Deg[5] = lerp(p[1][3], p[2][4], pphase_b135);
+            {
+                pphase_b135 = pphase_b135 - 0.5f;
+                const float a = (pphase_b135 >= 0.f) ? p[5][2] : p[3][0];
+                const float b = (pphase_b135 >= 0.f) ? p[4][3] : p[2][1];
+                const float c = (pphase_b135 >= 0.f) ? p[3][4] : p[1][2];
+                const float d = (pphase_b135 >= 0.f) ? p[2][5] : p[0][3];
+                temp_interp135Deg[0] = lerp(p[4][1], a, std::abs(pphase_b135));
+                temp_interp135Deg[2] = lerp(p[3][2], b, std::abs(pphase_b135));
+                temp_interp135Deg[4] = lerp(p[2][3], c, std::abs(pphase_b135));
+                temp_interp135Deg[6] = lerp(p[1][4], d, std::abs(pphase_b135));
+            }
+
+            float interp135Deg[6];
+            float pphase_p135 = 1 + (phase_x_frac - phase_y_frac);
+            if (pphase_p135 >= 1)
+            {
+                for (int i = 0; i < 6; ++i)
+                {
+                    interp135Deg[i] = temp_interp135Deg[i + 1];
+                }
+                pphase_p135 = pphase_p135 - 1;
+            }
+            else
+            {
+                for (int i = 0; i < 6; ++i)
+                {
+                    interp135Deg[i] = temp_interp135Deg[i];
+                }
+            }
+
+            f += EvalPoly6(job, interp135Deg, (int)(pphase_p135 * job.phaseCount)) * w[3];
+        }
+
+        return f;
+    }
+
+    float EvalUSM(const NISConfig& config, const float pxl[5], const float sharpnessStrength, const float sharpnessLimit)
+    {
+        // USM profile
+        float y_usm = pxl[1] * -0.6001f + pxl[2] * 1.2002f - pxl[3] * 0.6001f;
+        // boost USM profile
+        y_usm *= sharpnessStrength;
+        // clamp to the limit
+        y_usm = (std::min)(sharpnessLimit, (std::max)(-sharpnessLimit, y_usm));
+
+        // reduce ringing (CalcLTIFast())
+        const float a_min = (std::min)((std::min)(pxl[0], pxl[1]), pxl[2]);
+        const float a_max = (std::max)((std::max)(pxl[0], pxl[1]), pxl[2]);
+        const float b_min = (std::min)((std::min)(pxl[2], pxl[3]), pxl[4]);
+        const float b_max = (std::max)((std::max)(pxl[2], pxl[3]), pxl[4]);
+        const float a_cont = a_max - a_min;
+        const float b_cont = b_max - b_min;
+        const float cont_ratio = (std::max)(a_cont, b_cont) / ((std::min)(a_cont, b_cont) + config.kEps);
+        y_usm *= (1.0f - saturate((cont_ratio - config.kMinContrastRatio) * config.kRatioNorm)) * config.kContrastBoost;
+
+        return y_usm;
+    }
+
+    void GetDirUSM(const NISConfig& config, const float p[5][5], float rval[4])
+    {
+        // sharpness boost & limit are the same for all directions
+        const float scaleY = 1.0f - saturate((p[2][2] - config.kSharpStartY) * config.kSharpScaleY);
+        // scale the ramp to sharpen as a function of luma
+        const float sharpnessStrength = scaleY * config.kSharpStrengthScale + config.kSharpStrengthMin;
+        // scale the ramp to limit USM as a function of luma
+        const float sharpnessLimit = (scaleY * config.kSharpLimitScale + config.kSharpLimitMin) * p[2][2];
+
+        // 0 deg filter
+        float interp0Deg[5];
+        for (int i = 0; i < 5; ++i)
+        {
+            interp0Deg[i] = p[i][2];
+        }
+        rval[0] = EvalUSM(config, interp0Deg, sharpnessStrength, sharpnessLimit);
+
+        // 90 deg filter
+        float interp90Deg[5];
+        for (int i = 0; i < 5; ++i)
+        {
+            interp90Deg[i] = p[2][i];
+        }
+        rval[1] = EvalUSM(config, interp90Deg, sharpnessStrength, sharpnessLimit);
+
+        // 45 deg filter
+        float interp45Deg[5];
+        interp45Deg[0] = p[1][1];
+        interp45Deg[1] = lerp(p[2][1], p[1][2], 0.5f);
+        interp45Deg[2] = p[2][2];
+        interp45Deg[3] = lerp(p[3][2], p[2][3], 0.5f);
+        interp45Deg[4] = p[3][3];
+        rval[2] = EvalUSM(config, interp45Deg, sharpnessStrength, sharpnessLimit);
+
+        // 135 deg filter
+        float interp135Deg[5];
+        interp135Deg[0] = p[3][1];
+        interp135Deg[1] = lerp(p[3][2], p[2][1], 0.5f);
+        interp135Deg[2] = p[2][2];
+        interp135Deg[3] = lerp(p[2][3], p[1][2], 0.5f);
+        interp135Deg[4] = p[1][3];
+        rval[3] = EvalUSM(config, interp135Deg, sharpnessStrength, sharpnessLimit);
+    }
+
+    void ScalarEdgeRow(const Job& job, Band& band, const int y, const bool transposed)
+    {
+        const float* rows[3] = { band.lumaRow(y - 1), band.lumaRow(y), band.lumaRow(y + 1) };
+        float* edges[4] = { band.edgeRow(0, y), band.edgeRow(1, y), band.edgeRow(2, y), band.edgeRow(3, y) };
+
+        for (int x = -1; x <= (int)job.input->width; x++)
+        {
+            float p[3][3];
+            for (int i = 0; i < 3; i++)
+            {
+                for (int j = 0; j < 3; j++)
+                {
+                    p[transposed ? i : j][transposed ? j : i] = rows[i][x - 1 + j];
+                }
+            }
+
+            float weights[4];
+            GetEdgeMap(*job.config, p, weights);
+            for (int d = 0; d < 4; d++)
+            {
+                edges[d][x] = weights[d];
+            }
+        }
+    }
+
+    void ScalarScaleRow(const Job& job, const Band& band, const uint32_t y)
+    {
+        // y coord inside the input image: nearest integer part and fractional part
+        float fy;
+        const int py = SourceRow(job, y, fy);
+        // discretized phase
+        const int fy_int = (int)(fy * job.phaseCount);
+
+        const float* inputRows[2] = { InputRow(job, py), InputRow(job, py + 1) };
+        float* outputPixel = job.output->pixels.data() + (size_t)y * job.output->width * 4;
+
+        for (uint32_t x = 0; x < job.output->width; x++)
+        {
+            const int px = job.sourceX[x];
+            const float fx = job.fractionX[x];
+            const int fx_int = job.phaseX[x];
+
+            // generate weights for directional filters
+            float w[4];
+            for (int d = 0; d < 4; d++)
+            {
+                const float h0 = lerp(band.edgeRow(d, py)[px], band.edgeRow(d, py)[px + 1], fx);
+                const float h1 = lerp(band.edgeRow(d, py + 1)[px], band.edgeRow(d, py + 1)[px + 1], fx);
+                w[d] = lerp(h0, h1, fy);
+            }
+
+            // load 6x6 support to regs
+            float p[6][6];
+            for (int i = 0; i < 6; ++i)
+            {
+                for (int j = 0; j < 6; ++j)
+                {
+                    p[i][j] = band.lumaRow(py - 2 + i)[px - 2 + j];
+                }
+            }
+
+            // weight for luma
+            const float baseWeight = 1.0f - w[0] - w[1] - w[2] - w[3];
+
+            // final luma is a weighted product of directional & normal filters
+            float opY = 0;
+
+            // get traditional scaler filter output
+            opY += FilterNormal(job, p, fx_int, fy_int) * baseWeight;
+
+            // get directional filter bank output
+            opY += AddDirFilters(job, p, fx, fy, fx_int, fy_int, w);
+
+            // do bilinear tap for chroma upscaling
+            float op[4];
+            for (int c = 0; c < 4; c++)
+            {
+                const float h0 = lerp(inputRows[0][job.texelX0[x] + c], inputRows[0][job.texelX1[x] + c], fx);
+                const float h1 = lerp(inputRows[1][job.texelX0[x] + c], inputRows[1][job.texelX1[x] + c], fx);
+                op[c] = lerp(h0, h1, fy);
+            }
+
+            const float corr = opY - getY(op[0], op[1], op[2]);
+            *outputPixel++ = op[0] + corr;
+            *outputPixel++ = op[1] + corr;
+            *outputPixel++ = op[2] + corr;
+            *outputPixel++ = op[3];
+        }
+    }
+
+    void ScalarSharpenRow(const Job& job, const Band& band, const uint32_t y)
+    {
+        const float* inputPixel = InputRow(job, (int)y);
+        float* outputPixel = job.output->pixels.data() + (size_t)y * job.output->width * 4;
+
+        for (uint32_t x = 0; x < job.output->width; x++)
+        {
+            // load 5x5 support to regs
+            float p[5][5];
+            for (int i = 0; i < 5; ++i)
+            {
+                for (int j = 0; j < 5; ++j)
+                {
+                    p[i][j] = band.lumaRow((int)y - 2 + i)[(int)x - 2 + j];
+                }
+            }
+
+            // get directional filter bank output
+            float dirUSM[4];
+            GetDirUSM(*job.config, p, dirUSM);
+
+            // final USM is a weighted sum filter outputs
+            float usmY = dirUSM[0] * band.edgeRow(0, (int)y)[x];
+            usmY += dirUSM[1] * band.edgeRow(1, (int)y)[x];
+            usmY += dirUSM[2] * band.edgeRow(2, (int)y)[x];
+            usmY += dirUSM[3] * band.edgeRow(3, (int)y)[x];
+
+            *outputPixel++ = *inputPixel++ + usmY;
+            *outputPixel++ = *inputPixel++ + usmY;
+            *outputPixel++ = *inputPixel++ + usmY;
+            *outputPixel++ = *inputPixel++;
+        }
+    }
+
+    // The luma of a source row, for all the columns of the padded row.
+    void LumaRow(const Job& job, Band& band, const int y)
+    {
+        const NISCpuImage& input = *job.input;
+        const float* inputRow = InputRow(job, y);
+        float* row = band.lumaRow(y);
+
+        for (int x = -PlanePadding; x < (int)input.width + PlanePadding; x++)
+        {
+            const float* texel = inputRow + (size_t)(std::min)((std::max)(x, 0), (int)input.width - 1) * 4;
+            row[x] = getY(texel[0], texel[1], texel[2]);
+        }
+    }
+
+    void ProcessBand(const Job& job, const Kernel& kernel, Band& band, const uint32_t firstRow, const uint32_t endRow)
+    {
+        // The source rows sampled by the band, then their support.
+        int firstSourceRow = (int)firstRow;
+        int lastSourceRow = (int)endRow - 1;
+        if (job.isScaler)
+        {
+            float fraction;
+            firstSourceRow = SourceRow(job, firstRow, fraction);
+            lastSourceRow = SourceRow(job, endRow - 1, fraction);
+        }
+        const int lastEdgeRow = job.isScaler ? lastSourceRow + 1 : lastSourceRow;
+        const int lastLumaRow = job.isScaler ? lastSourceRow + 3 : lastSourceRow + 2;
+
+        band.pitch = (int)job.input->width + 2 * PlanePadding;
+        band.firstLumaRow = firstSourceRow - 2;
+        band.firstEdgeRow = firstSourceRow;
+        band.luma.resize((size_t)(lastLumaRow - band.firstLumaRow + 1) * band.pitch);
+        for (int d = 0; d < 4; d++)
+        {
+            band.edges[d].resize((size_t)(lastEdgeRow - band.firstEdgeRow + 1) * band.pitch);
+        }
+
+        for (int y = band.firstLumaRow; y <= lastLumaRow; y++)
+        {
+            LumaRow(job, band, y);
+        }
+        for (int y = band.firstEdgeRow; y <= lastEdgeRow; y++)
+        {
+            kernel.edgeRow(job, band, y, !job.isScaler);
+        }
+        for (uint32_t y = firstRow; y < endRow; y++)
+        {
+            (job.isScaler ? kernel.scaleRow : kernel.sharpenRow)(job, band, y);
+        }
+    }
+
+    Kernel GetKernel(const NISCpuKernel kernel)
+    {
+        switch (kernel)
+        {
+#if defined(_M_X64) || defined(__x86_64__)
+        case NISCpuKernel::SSE41:
+            return GetSSE41Kernel();
+        case NISCpuKernel::AVX2:
+            return GetAVX2Kernel();
+#endif
+#if defined(_M_ARM64) || defined(__aarch64__)
+        case NISCpuKernel::NEON:
+            return GetNEONKernel();
+#endif
+        default:
+            return GetScalarKernel();
+        }
+    }
+
+    void Dispatch(Job& job, NISCpuKernel kernelType, uint32_t numThreads)
+    {
+        const NISCpuImage& input = *job.input;
+        const NISCpuImage& output = *job.output;
+
+        if (!IsNISCpuKernelSupported(kernelType))
+        {
+            kernelType = NISCpuKernel::Scalar;
+        }
+        const Kernel kernel = GetKernel(kernelType);
+
+        job.phaseCount = (int)(sizeof(coef_scale) / sizeof(coef_scale[0]));
+        job.filterStride = (int)(sizeof(coef_scale[0]) / sizeof(coef_scale[0][0]));
+        job.coefScale = &coef_scale[0][0];
+        job.coefUsm = &coef_usm[0][0];
+
+        // The column tables are padded with copies of the last column, so that the SIMD kernels can process whole
+        // vectors.
+        const uint32_t paddedWidth = (output.width + MaxLanes - 1) / MaxLanes * MaxLanes;
+        job.sourceX.resize(paddedWidth);
+        job.fractionX.resize(paddedWidth);
+        job.phaseX.resize(paddedWidth);
+        job.texelX0.resize(paddedWidth);
+        job.texelX1.resize(paddedWidth);
+        for (uint32_t x = 0; x < paddedWidth; x++)
+        {
+            const uint32_t dstX = (std::min)(x, output.width - 1);
+            if (job.isScaler)
+            {
+                const float srcX = (0.5f + (dstX + job.outputOriginX)) * job.config->kScaleX - 0.5f;
+                job.sourceX[x] = (int)std::floor(srcX) - (int)job.inputOriginX;
+                job.fractionX[x] = srcX - std::floor(srcX);
+                job.phaseX[x] = (int)(job.fractionX[x] * job.phaseCount);
+            }
+            else
+            {
+                job.sourceX[x] = (int)dstX;
+                job.fractionX[x] = 0.0f;
+                job.phaseX[x] = 0;
+            }
+            job.texelX0[x] = (std::min)((std::max)(job.sourceX[x], 0), (int)input.width - 1) * 4;
+            job.texelX1[x] = (std::min)((std::max)(job.sourceX[x] + 1, 0), (int)input.width - 1) * 4;
+        }
+
+        const uint32_t numBands = (output.height + BandHeight - 1) / BandHeight;
+        if (!numThreads)
+        {
+            numThreads = (std::max)(std::thread::hardware_concurrency(), 1u);
+        }
+        numThreads = (std::min)(numThreads, numBands);
+
+        std::atomic<uint32_t> nextBand{ 0 };
+        const auto worker = [&]() {
+            Band band;
+            uint32_t i;
+            while ((i = nextBand++) < numBands)
+            {
+                ProcessBand(job, kernel, band, i * BandHeight, (std::min)((i + 1) * BandHeight, output.height));
+            }
+        };
+
+        std::vector<std::thread> threads;
+        for (uint32_t i = 1; i < numThreads; i++)
+        {
+            threads.emplace_back(worker);
+        }
+        worker();
+        for (std::thread& thread : threads)
+        {
+            thread.join();
+        }
+    }
+
+    // Find the part of one dimension of the input that is read to process a range of output pixels.
+    void CropInput(const float scale,
+                   const uint32_t outputStart,
+                   const uint32_t outputEnd,
+                   const uint32_t inputSize,
+                   uint32_t& inputStart,
+                   uint32_t& inputEnd)
+    {
+        const int first = (int)std::floor((0.5f + outputStart) * scale - 0.5f) - (int)RegionMargin;
+        const int last = (int)std::floor((0.5f + (outputEnd - 1)) * scale - 0.5f) + 1 + (int)RegionMargin;
+        inputStart = (uint32_t)std::clamp(first, 0, (int)inputSize - 1);
+        inputEnd = (uint32_t)std::clamp(last + 1, (int)inputStart + 1, (int)inputSize);
+    }
+
+    // Process a region of the output from a crop of the input. The crop contains all the pixels that the region reads
+    // (it is only smaller at the edges of the image, where the reads are clamped anyway), so the result is the same as when
+    // processing the entire image.
+    bool DispatchRegion(const NISConfig& config,
+                        const NISCpuImage& input,
+                        NISCpuImage& output,
+                        const NISCpuRect& outputRect,
+                        const bool isScaler,
+                        const NISCpuKernel kernel,
+                        const uint32_t numThreads)
+    {
+        if (!input.width || !input.height || !outputRect.width || !outputRect.height ||
+            outputRect.x + outputRect.width > output.width || outputRect.y + outputRect.height > output.height)
+        {
+            return false;
+        }
+        output.pixels.resize((size_t)output.width * output.height * 4);
+
+        // The scaler computes the sampling positions within the entire images, from the origins of the crops. The
+        // sharpener reads the same pixels in the input as it writes in the output, so both are cropped the same way.
+        uint32_t inputLeft, inputRight, inputTop, inputBottom;
+        uint32_t outputLeft = outputRect.x;
+        uint32_t outputRight = outputRect.x + outputRect.width;
+        uint32_t outputTop = outputRect.y;
+        uint32_t outputBottom = outputRect.y + outputRect.height;
+        if (isScaler)
+        {
+            CropInput(config.kScaleX, outputLeft, outputRight, input.width, inputLeft, inputRight);
+            CropInput(config.kScaleY, outputTop, outputBottom, input.height, inputTop, inputBottom);
+        }
+        else
+        {
+            CropInput(1.0f, outputLeft, outputRight, input.width, inputLeft, inputRight);
+            CropInput(1.0f, outputTop, outputBottom, input.height, inputTop, inputBottom);
+            outputLeft = inputLeft;
+            outputRight = inputRight;
+            outputTop = inputTop;
+            outputBottom = inputBottom;
+        }
+
+        NISCpuImage croppedInput;
+        croppedInput.resize(inputRight - inputLeft, inputBottom - inputTop);
+        for (uint32_t y = 0; y < croppedInput.height; y++)
+        {
+            const float* const source = input.pixels.data() + ((size_t)(inputTop + y) * input.width + inputLeft) * 4;
+            std::copy(source, source + (size_t)croppedInput.width * 4, croppedInput.pixels.data() + (size_t)y * croppedInput.width * 4);
+        }
+
+        NISCpuImage croppedOutput;
+        croppedOutput.resize(outputRight - outputLeft, outputBottom - outputTop);
+
+        Job job{};
+        job.config = &config;
+        job.input = &croppedInput;
+        job.output = &croppedOutput;
+        job.isScaler = isScaler;
+        if (isScaler)
+        {
+            job.inputOriginX = inputLeft;
+            job.inputOriginY = inputTop;
+            job.outputOriginX = outputLeft;
+            job.outputOriginY = outputTop;
+        }
+        Dispatch(job, kernel, numThreads);
+
+        for (uint32_t y = 0; y < outputRect.height; y++)
+        {
+            const float* const source = croppedOutput.pixels.data() +
+                                        ((size_t)(outputRect.y - outputTop + y) * croppedOutput.width + (outputRect.x - outputLeft)) * 4;
+            std::copy(source, source + (size_t)outputRect.width * 4, output.pixels.data() + ((size_t)(outputRect.y + y) * output.width + outputRect.x) * 4);
+        }
+
+        return true;
+    }
+
+    template <typename Image>
+    bool IsWithin(const NISCpuRect& rect, const Image& image)
+    {
+        return rect.width && rect.height && rect.x + rect.width <= image.width && rect.y + rect.height <= image.height;
+    }
+
+    bool IsOverlapping(const NISCpuRect& a, const NISCpuRect& b)
+    {
+        return a.x < b.x + b.width && b.x < a.x + a.width && a.y < b.y + b.height && b.y < a.y + a.height;
+    }
+
+    // Upscale a region of the input to a region of the output with bilinear filtering. Like BilinearRenderer, the samples
+    // are clamped to the input region. The excluded region (if any) is relative to the output region. The input texels are
+    // read with loadTexel(x, y, rgba), so that a multisampled input can be resolved while it is read.
+    template <typename LoadTexel>
+    void BilinearRegion(const NISCpuRect& inputRect,
+                        NISCpuImage& output,
+                        const NISCpuRect& outputRect,
+                        const NISCpuRect* const excludedRect,
+                        const LoadTexel& loadTexel)
+    {
+        // Same as kScaleX and kScaleY from NVScalerUpdateConfig().
+        const float scaleX = (float)inputRect.width / outputRect.width;
+        const float scaleY = (float)inputRect.height / outputRect.height;
+
+        std::vector<int32_t> texelX0(outputRect.width);
+        std::vector<int32_t> texelX1(outputRect.width);
+        std::vector<float> fractionX(outputRect.width);
+        for (uint32_t x = 0; x < outputRect.width; x++)
+        {
+            const float srcX = inputRect.x + (0.5f + x) * scaleX - 0.5f;
+            const int px = (int)std::floor(srcX);
+            fractionX[x] = srcX - std::floor(srcX);
+            texelX0[x] = std::clamp(px, (int)inputRect.x, (int)(inputRect.x + inputRect.width) - 1);
+            texelX1[x] = std::clamp(px + 1, (int)inputRect.x, (int)(inputRect.x + inputRect.width) - 1);
+        }
+
+        const auto clampRow = [&](const int y) { return std::clamp(y, (int)inputRect.y, (int)(inputRect.y + inputRect.height) - 1); };
+        for (uint32_t y = 0; y < outputRect.height; y++)
+        {
+            const float srcY = inputRect.y + (0.5f + y) * scaleY - 0.5f;
+            const int py = (int)std::floor(srcY);
+            const float fy = srcY - std::floor(srcY);
+            const int row0 = clampRow(py);
+            const int row1 = clampRow(py + 1);
+            const bool isExcludedRow = excludedRect && y >= excludedRect->y && y < excludedRect->y + excludedRect->height;
+
+            float* outputPixel = output.pixels.data() + ((size_t)(outputRect.y + y) * output.width + outputRect.x) * 4;
+            for (uint32_t x = 0; x < outputRect.width; x++, outputPixel += 4)
+            {
+                // Skip over the excluded columns.
+                if (isExcludedRow && x == excludedRect->x && excludedRect->width)
+                {
+                    x += excludedRect->width - 1;
+                    outputPixel += (size_t)(excludedRect->width - 1) * 4;
+                    continue;
+                }
+
+                float p00[4], p10[4], p01[4], p11[4];
+                loadTexel(texelX0[x], row0, p00);
+                loadTexel(texelX1[x], row0, p10);
+                loadTexel(texelX0[x], row1, p01);
+                loadTexel(texelX1[x], row1, p11);
+                for (int c = 0; c < 4; c++)
+                {
+                    const float h0 = lerp(p00[c], p10[c], fractionX[x]);
+                    const float h1 = lerp(p01[c], p11[c], fractionX[x]);
+                    outputPixel[c] = lerp(h0, h1, fy);
+                }
+            }
+        }
+    }
+
+    void BilinearRegion(const NISCpuImage& input,
+                        const NISCpuRect& inputRect,
+                        NISCpuImage& output,
+                        const NISCpuRect& outputRect,
+                        const NISCpuRect* const excludedRect)
+    {
+        BilinearRegion(inputRect, output, outputRect, excludedRect, [&](const int x, const int y, float* const rgba) {
+            const float* const texel = input.pixels.data() + ((size_t)y * input.width + x) * 4;
+            std::copy(texel, texel + 4, rgba);
+        });
+    }
+
+    // Resolve a pixel of a multisampled image: the weighted sum of its samples. Like the shader of BilinearRenderer, the
+    // samples are accumulated in order.
+    void ResolvePixel(const NISCpuMultisampledImage& input, const float* const sampleWeights, const int x, const int y, float* const rgba)
+    {
+        const float* sample = input.samples.data() + ((size_t)y * input.width + x) * input.sampleCount * 4;
+        std::fill(rgba, rgba + 4, 0.f);
+        for (uint32_t s = 0; s < input.sampleCount; s++, sample += 4)
+        {
+            for (int c = 0; c < 4; c++)
+            {
+                rgba[c] += sampleWeights[s] * sample[c];
+            }
+        }
+    }
+
+    // Same validation as BilinearRenderer::update().
+    template <typename Image>
+    bool AreViewsValid(const std::vector<Image>& inputSlices,
+                       const std::vector<NISCpuImage>& outputSlices,
+                       const NISCpuView* const views,
+                       const size_t viewCount)
+    {
+        for (size_t i = 0; i < viewCount; i++)
+        {
+            const NISCpuView& view = views[i];
+            if (view.inputSlice >= inputSlices.size() || view.outputSlice >= outputSlices.size() ||
+                !IsWithin(view.inputRect, inputSlices[view.inputSlice]) || !IsWithin(view.outputRect, outputSlices[view.outputSlice]))
+            {
+                return false;
+            }
+            for (size_t j = 0; j < i; j++)
+            {
+                if (view.outputSlice == views[j].outputSlice && IsOverlapping(view.outputRect, views[j].outputRect))
+                {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+#if defined(_M_X64) || defined(__x86_64__)
+    bool HasSSE41()
+    {
+#ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 1);
+        return info[2] & (1 << 19);
+#else
+        return __builtin_cpu_supports("sse4.1");
+#endif
+    }
+
+    bool HasAVX2()
+    {
+#ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7)
+        {
+            return false;
+        }
+        // The OS must also save the AVX registers.
+        __cpuid(info, 1);
+        if (!(info[2] & (1 << 27)) || (_xgetbv(0) & 6) != 6)
+        {
+            return false;
+        }
+        __cpuidex(info, 7, 0);
+        return info[1] & (1 << 5);
+#else
+        return __builtin_cpu_supports("avx2");
+#endif
+    }
+#endif
+}
+
+namespace nis_scaler
+{
+    namespace nis_cpu
+    {
+        Kernel GetScalarKernel()
+        {
+            return { ScalarEdgeRow, ScalarScaleRow, ScalarSharpenRow };
+        }
+    }
+
+    const char* NISCpuKernelName(const NISCpuKernel kernel)
+    {
+        switch (kernel)
+        {
+        case NISCpuKernel::Scalar:
+            return "scalar";
+        case NISCpuKernel::SSE41:
+            return "sse4.1";
+        case NISCpuKernel::AVX2:
+            return "avx2";
+        case NISCpuKernel::NEON:
+            return "neon";
+        default:
+            return "unknown";
+        }
+    }
+
+    bool IsNISCpuKernelSupported(const NISCpuKernel kernel)
+    {
+        switch (kernel)
+        {
+        case NISCpuKernel::Scalar:
+            return true;
+#if defined(_M_X64) || defined(__x86_64__)
+        case NISCpuKernel::SSE41:
+            return HasSSE41();
+        case NISCpuKernel::AVX2:
+            return HasAVX2();
+#endif
+#if defined(_M_ARM64) || defined(__aarch64__)
+        case NISCpuKernel::NEON:
+            return true;
+#endif
+        default:
+            return false;
+        }
+    }
+
+    NISCpuKernel DetectNISCpuKernel()
+    {
+        for (int i = (int)NISCpuKernel::EnumMax - 1; i > 0; i--)
+        {
+            if (IsNISCpuKernelSupported((NISCpuKernel)i))
+            {
+                return (NISCpuKernel)i;
+            }
+        }
+        return NISCpuKernel::Scalar;
+    }
+
+    void NISCpuScale(const NISConfig& config,
+                     const NISCpuImage& input,
+                     NISCpuImage& output,
+                     const NISCpuKernel kernel,
+                     const uint32_t numThreads)
+    {
+        if (!input.width || !input.height || !output.width || !output.height)
+        {
+            return;
+        }
+        output.pixels.resize((size_t)output.width * output.height * 4);
+
+        Job job{};
+        job.config = &config;
+        job.input = &input;
+        job.output = &output;
+        job.isScaler = true;
+        Dispatch(job, kernel, numThreads);
+    }
+
+    void NISCpuSharpen(const NISConfig& config,
+                       const NISCpuImage& input,
+                       NISCpuImage& output,
+                       const NISCpuKernel kernel,
+                       const uint32_t numThreads)
+    {
+        if (!input.width || !input.height)
+        {
+            return;
+        }
+        output.resize(input.width, input.height);
+
+        Job job{};
+        job.config = &config;
+        job.input = &input;
+        job.output = &output;
+        job.isScaler = false;
+        Dispatch(job, kernel, numThreads);
+    }
+
+    bool NISCpuScaleRegion(const NISConfig& config,
+                           const NISCpuImage& input,
+                           NISCpuImage& output,
+                           const NISCpuRect& outputRect,
+                           const NISCpuKernel kernel,
+                           const uint32_t numThreads)
+    {
+        return DispatchRegion(config, input, output, outputRect, true, kernel, numThreads);
+    }
+
+    bool NISCpuSharpenRegion(const NISConfig& config,
+                             const NISCpuImage& input,
+                             NISCpuImage& output,
+                             const NISCpuRect& outputRect,
+                             const NISCpuKernel kernel,
+                             const uint32_t numThreads)
+    {
+        if (output.width != input.width || output.height != input.height)
+        {
+            return false;
+        }
+        return DispatchRegion(config, input, output, outputRect, false, kernel, numThreads);
+    }
+
+    void NISCpuBilinear(const NISCpuImage& input, NISCpuImage& output, const NISCpuRect* const excludedRect)
+    {
+        if (!input.width || !input.height || !output.width || !output.height)
+        {
+            return;
+        }
+        output.pixels.resize((size_t)output.width * output.height * 4);
+
+        BilinearRegion(input, NISCpuRect{ 0, 0, input.width, input.height }, output, NISCpuRect{ 0, 0, output.width, output.height }, excludedRect);
+    }
+
+    bool NISCpuBilinearViews(const std::vector<NISCpuImage>& inputSlices,
+                             std::vector<NISCpuImage>& outputSlices,
+                             const NISCpuView* const views,
+                             const size_t viewCount)
+    {
+        if (!AreViewsValid(inputSlices, outputSlices, views, viewCount))
+        {
+            return false;
+        }
+
+        for (size_t i = 0; i < viewCount; i++)
+        {
+            const NISCpuView& view = views[i];
+            BilinearRegion(inputSlices[view.inputSlice], view.inputRect, outputSlices[view.outputSlice], view.outputRect,
+                           view.excludedRect.width && view.excludedRect.height ? &view.excludedRect : nullptr);
+        }
+        return true;
+    }
+
+    void NISCpuResolve(const NISCpuMultisampledImage& input, const float* const sampleWeights, NISCpuImage& output)
+    {
+        output.resize(input.width, input.height);
+        for (uint32_t y = 0; y < input.height; y++)
+        {
+            for (uint32_t x = 0; x < input.width; x++)
+            {
+                ResolvePixel(input, sampleWeights, x, y, output.pixels.data() + ((size_t)y * output.width + x) * 4);
+            }
+        }
+    }
+
+    bool NISCpuBilinearViewsMultisampled(const std::vector<NISCpuMultisampledImage>& inputSlices,
+                                         const float* const sampleWeights,
+                                         std::vector<NISCpuImage>& outputSlices,
+                                         const NISCpuView* const views,
+                                         const size_t viewCount)
+    {
+        if (!AreViewsValid(inputSlices, outputSlices, views, viewCount))
+        {
+            return false;
+        }
+
+        for (size_t i = 0; i < viewCount; i++)
+        {
+            const NISCpuView& view = views[i];
+            const NISCpuMultisampledImage& input = inputSlices[view.inputSlice];
+            BilinearRegion(view.inputRect, outputSlices[view.outputSlice], view.outputRect,
+                           view.excludedRect.width && view.excludedRect.height ? &view.excludedRect : nullptr,
+                           [&](const int x, const int y, float* const rgba) { ResolvePixel(input, sampleWeights, x, y, rgba); });
+        }
+        return true;
+    }
+}
@@ -0,0 +1,165 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <NIS_Config.h>
+
+// A CPU implementation of the NIS scaler and sharpener.
+//
+// This is a port of NVScaler() and NVSharpen() from NIS_Scaler.h (SDR mode), using the same coefficient tables and the
+// NISConfig constants from NVScalerUpdateConfig() and NVSharpenUpdateConfig(). It is meant for validation and offline
+// processing, not for the frame loop.
+//
+// The scalar kernel follows the shader line by line and is the reference. The SIMD kernels evaluate the same math for
+// several pixels at once, in a different order, and match the scalar kernel within NISCpuTolerance. Compared to the
+// GPU, the results also differ by the precision of the texture filtering hardware (bilinear weights are exact here).
+
+namespace nis_scaler
+{
+    // The maximum difference between the output of a SIMD kernel and the scalar kernel, for inputs in [0, 1]. This is
+    // well below the quantization step of 8-bit formats.
+    constexpr float NISCpuTolerance = 1e-4f;
+
+    // An RGBA image with float components and tightly packed rows.
+    struct NISCpuImage
+    {
+        uint32_t width{ 0 };
+        uint32_t height{ 0 };
+        std::vector<float> pixels;
+
+        void resize(const uint32_t newWidth, const uint32_t newHeight)
+        {
+            width = newWidth;
+            height = newHeight;
+            pixels.resize((size_t)width * height * 4);
+        }
+    };
+
+    // A multisampled RGBA image with float components: the samples of each pixel are consecutive, and the rows are
+    // tightly packed.
+    struct NISCpuMultisampledImage
+    {
+        uint32_t width{ 0 };
+        uint32_t height{ 0 };
+        uint32_t sampleCount{ 1 };
+        std::vector<float> samples;
+
+        void resize(const uint32_t newWidth, const uint32_t newHeight, const uint32_t newSampleCount)
+        {
+            width = newWidth;
+            height = newHeight;
+            sampleCount = newSampleCount;
+            samples.resize((size_t)width * height * sampleCount * 4);
+        }
+    };
+
+    // A region of an image (in pixels).
+    struct NISCpuRect
+    {
+        uint32_t x;
+        uint32_t y;
+        uint32_t width;
+        uint32_t height;
+    };
+
+    enum class NISCpuKernel
+    {
+        Scalar = 0,
+        SSE41,
+        AVX2,
+        NEON,
+        EnumMax
+    };
+
+    const char* NISCpuKernelName(NISCpuKernel kernel);
+
+    // Whether a kernel was compiled in and is supported by this CPU.
+    bool IsNISCpuKernelSupported(NISCpuKernel kernel);
+
+    // The fastest supported kernel.
+    NISCpuKernel DetectNISCpuKernel();
+
+    // Upscale an image with a configuration from NVScalerUpdateConfig(). The output must be sized to the output
+    // resolution. The image is processed in bands of rows, on numThreads threads (0 for one per core).
+    void NISCpuScale(const NISConfig& config,
+                     const NISCpuImage& input,
+                     NISCpuImage& output,
+                     NISCpuKernel kernel,
+                     uint32_t numThreads = 0);
+
+    // Sharpen an image with a configuration from NVSharpenUpdateConfig(). The output is resized to the input resolution.
+    void NISCpuSharpen(const NISConfig& config,
+                       const NISCpuImage& input,
+                       NISCpuImage& output,
+                       NISCpuKernel kernel,
+                       uint32_t numThreads = 0);
+
+    // Process only a region of the output, with the same results as NISCpuScale() and NISCpuSharpen() for the entire
+    // image, and leave the rest of the output untouched. The output must be sized to the output resolution. Returns false
+    // (and does nothing) when the region does not fit the output.
+    bool NISCpuScaleRegion(const NISConfig& config,
+                           const NISCpuImage& input,
+                           NISCpuImage& output,
+                           const NISCpuRect& outputRect,
+                           NISCpuKernel kernel,
+                           uint32_t numThreads = 0);
+    bool NISCpuSharpenRegion(const NISConfig& config,
+                             const NISCpuImage& input,
+                             NISCpuImage& output,
+                             const NISCpuRect& outputRect,
+                             NISCpuKernel kernel,
+                             uint32_t numThreads = 0);
+
+    // Upscale an image with bilinear filtering, sampling the input at the same positions as NISCpuScale(). The output
+    // must be sized to the output resolution. The pixels within excludedRect (if any) are left untouched.
+    void NISCpuBilinear(const NISCpuImage& input, NISCpuImage& output, const NISCpuRect* excludedRect = nullptr);
+
+    // A view processed by NISCpuBilinearViews(), like BilinearView for BilinearRenderer. The excluded rect is relative to
+    // the output rect, and may be empty.
+    struct NISCpuView
+    {
+        uint32_t inputSlice;
+        NISCpuRect inputRect;
+        uint32_t outputSlice;
+        NISCpuRect outputRect;
+        NISCpuRect excludedRect;
+    };
+
+    // The reference for the batched dispatch of BilinearRenderer: upscale each view from a region of a slice of the input
+    // to a region of a slice of the output, with the samples clamped to the input region. The output slices must be sized
+    // already. Returns false when a view does not fit its slices, or when the output regions overlap.
+    bool NISCpuBilinearViews(const std::vector<NISCpuImage>& inputSlices,
+                             std::vector<NISCpuImage>& outputSlices,
+                             const NISCpuView* views,
+                             size_t viewCount);
+
+    // Resolve a multisampled image: each pixel is the sum of its samples, weighted by sampleWeights (one per sample, see
+    // GetMsaaResolveWeights()). The output is resized to the input resolution.
+    void NISCpuResolve(const NISCpuMultisampledImage& input, const float* sampleWeights, NISCpuImage& output);
+
+    // The reference for BilinearRenderer with a multisampled input: like NISCpuBilinearViews(), but the texels are
+    // resolved while they are read, without a resolved copy of the input. This is the same as NISCpuResolve() followed by
+    // NISCpuBilinearViews().
+    bool NISCpuBilinearViewsMultisampled(const std::vector<NISCpuMultisampledImage>& inputSlices,
+                                         const float* sampleWeights,
+                                         std::vector<NISCpuImage>& outputSlices,
+                                         const NISCpuView* views,
+                                         size_t viewCount);
+}
@@ -0,0 +1,141 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// This file does not use the precompiled header, so it can be shared with the tools.
+// It must be compiled with AVX2 enabled (/arch:AVX2).
+
+#include "NISCpuKernel.h"
+
+#if defined(_M_X64) || defined(__x86_64__)
+
+#include <immintrin.h>
+
+namespace
+{
+    struct AVX2
+    {
+        static constexpr int Lanes = 8;
+        using F = __m256;
+        using I = __m256i;
+        using M = __m256;
+
+        static F Set(const float value)
+        {
+            return _mm256_set1_ps(value);
+        }
+        static F Load(const float* p)
+        {
+            return _mm256_loadu_ps(p);
+        }
+        static I LoadInt(const int32_t* p)
+        {
+            return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        }
+        static void Store(float* p, const F value)
+        {
+            _mm256_storeu_ps(p, value);
+        }
+        static F Gather(const float* base, const I index)
+        {
+            return _mm256_i32gather_ps(base, index, 4);
+        }
+
+        static F Add(const F a, const F b)
+        {
+            return _mm256_add_ps(a, b);
+        }
+        static F Sub(const F a, const F b)
+        {
+            return _mm256_sub_ps(a, b);
+        }
+        static F Mul(const F a, const F b)
+        {
+            return _mm256_mul_ps(a, b);
+        }
+        static F Div(const F a, const F b)
+        {
+            return _mm256_div_ps(a, b);
+        }
+        static F Min(const F a, const F b)
+        {
+            return _mm256_min_ps(a, b);
+        }
+        static F Max(const F a, const F b)
+        {
+            return _mm256_max_ps(a, b);
+        }
+        static F Abs(const F a)
+        {
+            return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a);
+        }
+        static I Truncate(const F a)
+        {
+            return _mm256_cvttps_epi32(a);
+        }
+
+        static M Greater(const F a, const F b)
+        {
+            return _mm256_cmp_ps(a, b, _CMP_GT_OQ);
+        }
+        static M GreaterEqual(const F a, const F b)
+        {
+            return _mm256_cmp_ps(a, b, _CMP_GE_OQ);
+        }
+        static M Equal(const F a, const F b)
+        {
+            return _mm256_cmp_ps(a, b, _CMP_EQ_OQ);
+        }
+        static M And(const M a, const M b)
+        {
+            return _mm256_and_ps(a, b);
+        }
+        static M Or(const M a, const M b)
+        {
+            return _mm256_or_ps(a, b);
+        }
+        static M Not(const M a)
+        {
+            return _mm256_xor_ps(a, _mm256_castsi256_ps(_mm256_set1_epi32(-1)));
+        }
+        static F Select(const M m, const F a, const F b)
+        {
+            return _mm256_blendv_ps(b, a, m);
+        }
+
+        static I AddInt(const I a, const int32_t b)
+        {
+            return _mm256_add_epi32(a, _mm256_set1_epi32(b));
+        }
+        static I MulInt(const I a, const int32_t b)
+        {
+            return _mm256_mullo_epi32(a, _mm256_set1_epi32(b));
+        }
+        static M LessEqualInt(const I a, const int32_t b)
+        {
+            return _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(b + 1), a));
+        }
+    };
+}
+
+namespace nis_scaler::nis_cpu
+{
+    Kernel GetAVX2Kernel()
+    {
+        return SimdKernel<AVX2>::get();
+    }
+}
+
+#endif
@@ -0,0 +1,722 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+
+#include "NISCpu.h"
+
+// Internals of the CPU implementation of NIS, shared between NISCpu.cpp and the SIMD kernels. Each SIMD kernel lives in
+// its own file, which is compiled for its instruction set, and instantiates the templates below with a type describing
+// the vector registers (see NISCpuSSE41.cpp).
+
+namespace nis_scaler::nis_cpu
+{
+    // Columns of padding around the rows of the planes, so that the kernels can read past the edges of the image.
+    constexpr int PlanePadding = 16;
+
+    // The widest vector, used to pad the column tables.
+    constexpr int MaxLanes = 8;
+
+    // The state of a dispatch.
+    struct Job
+    {
+        const NISConfig* config;
+        const NISCpuImage* input;
+        NISCpuImage* output;
+        bool isScaler;
+
+        int phaseCount;
+        int filterStride;
+        const float* coefScale;
+        const float* coefUsm;
+
+        // For each output column, padded to a multiple of MaxLanes: the source column to the left of the sample, the
+        // fraction between the 2 columns and its phase, and the offsets of the 2 texels within an input row.
+        std::vector<int32_t> sourceX;
+        std::vector<float> fractionX;
+        std::vector<int32_t> phaseX;
+        std::vector<int32_t> texelX0;
+        std::vector<int32_t> texelX1;
+
+        // When processing a region (see DispatchRegion()): the position of the cropped input and output within the
+        // entire images. The sampling positions are computed within the entire images, so that they are rounded the
+        // same way as when processing the entire images.
+        uint32_t inputOriginX;
+        uint32_t inputOriginY;
+        uint32_t outputOriginX;
+        uint32_t outputOriginY;
+    };
+
+    // The source rows needed by a band of output rows: the luma, and the 4 directional weights of the edge map.
+    struct Band
+    {
+        int pitch{ 0 };
+        int firstLumaRow{ 0 };
+        int firstEdgeRow{ 0 };
+        std::vector<float> luma;
+        std::vector<float> edges[4];
+
+        float* lumaRow(const int y)
+        {
+            return luma.data() + (size_t)(y - firstLumaRow) * pitch + PlanePadding;
+        }
+        const float* lumaRow(const int y) const
+        {
+            return luma.data() + (size_t)(y - firstLumaRow) * pitch + PlanePadding;
+        }
+        float* edgeRow(const int direction, const int y)
+        {
+            return edges[direction].data() + (size_t)(y - firstEdgeRow) * pitch + PlanePadding;
+        }
+        const float* edgeRow(const int direction, const int y) const
+        {
+            return edges[direction].data() + (size_t)(y - firstEdgeRow) * pitch + PlanePadding;
+        }
+    };
+
+    inline int ClampRow(const int y, const uint32_t height)
+    {
+        return (std::min)((std::max)(y, 0), (int)height - 1);
+    }
+
+    // The source row above the sample of an output row, and the fraction between the 2 rows.
+    inline int SourceRow(const Job& job, const uint32_t y, float& fraction)
+    {
+        const float srcY = (0.5f + (y + job.outputOriginY)) * job.config->kScaleY - 0.5f;
+        fraction = srcY - std::floor(srcY);
+        return (int)std::floor(srcY) - (int)job.inputOriginY;
+    }
+
+    inline const float* InputRow(const Job& job, const int y)
+    {
+        return job.input->pixels.data() + (size_t)ClampRow(y, job.input->height) * job.input->width * 4;
+    }
+
+    // Compute the edge map of a source row, for columns -1 to width. The sharpener reads its 3x3 neighbourhoods
+    // transposed compared to the scaler, which only matters when the horizontal and vertical gradients are equal.
+    using EdgeRowFunction = void (*)(const Job& job, Band& band, int y, bool transposed);
+
+    // Produce an output row.
+    using OutputRowFunction = void (*)(const Job& job, const Band& band, uint32_t y);
+
+    struct Kernel
+    {
+        EdgeRowFunction edgeRow;
+        OutputRowFunction scaleRow;
+        OutputRowFunction sharpenRow;
+    };
+
+    Kernel GetScalarKernel();
+#if defined(_M_X64) || defined(__x86_64__)
+    Kernel GetSSE41Kernel();
+    Kernel GetAVX2Kernel();
+#endif
+#if defined(_M_ARM64) || defined(__aarch64__)
+    Kernel GetNEONKernel();
+#endif
+
+    // Arithmetic on the vector registers described by Isa, so that the kernels below read like the shader.
+    template <typename Isa>
+    struct Mask
+    {
+        typename Isa::M v;
+
+        friend Mask operator&(const Mask a, const Mask b)
+        {
+            return { Isa::And(a.v, b.v) };
+        }
+        friend Mask operator|(const Mask a, const Mask b)
+        {
+            return { Isa::Or(a.v, b.v) };
+        }
+        friend Mask operator!(const Mask a)
+        {
+            return { Isa::Not(a.v) };
+        }
+    };
+
+    template <typename Isa>
+    struct Int
+    {
+        typename Isa::I v;
+
+        static Int load(const int32_t* p)
+        {
+            return { Isa::LoadInt(p) };
+        }
+
+        friend Int operator+(const Int a, const int32_t b)
+        {
+            return { Isa::AddInt(a.v, b) };
+        }
+        friend Int operator*(const Int a, const int32_t b)
+        {
+            return { Isa::MulInt(a.v, b) };
+        }
+        friend Mask<Isa> operator<=(const Int a, const int32_t b)
+        {
+            return { Isa::LessEqualInt(a.v, b) };
+        }
+    };
+
+    template <typename Isa>
+    struct Float
+    {
+        typename Isa::F v;
+
+        Float() = default;
+        Float(const typename Isa::F value) : v(value)
+        {
+        }
+        Float(const float value) : v(Isa::Set(value))
+        {
+        }
+
+        static Float load(const float* p)
+        {
+            return Isa::Load(p);
+        }
+        static Float gather(const float* base, const Int<Isa> index)
+        {
+            return Isa::Gather(base, index.v);
+        }
+        void store(float* p) const
+        {
+            Isa::Store(p, v);
+        }
+
+        friend Float operator+(const Float a, const Float b)
+        {
+            return Isa::Add(a.v, b.v);
+        }
+        friend Float operator-(const Float a, const Float b)
+        {
+            return Isa::Sub(a.v, b.v);
+        }
+        friend Float operator*(const Float a, const Float b)
+        {
+            return Isa::Mul(a.v, b.v);
+        }
+        friend Float operator/(const Float a, const Float b)
+        {
+            return Isa::Div(a.v, b.v);
+        }
+        Float& operator+=(const Float b)
+        {
+            return *this = *this + b;
+        }
+        Float& operator*=(const Float b)
+        {
+            return *this = *this * b;
+        }
+
+        friend Mask<Isa> operator>(const Float a, const Float b)
+        {
+            return { Isa::Greater(a.v, b.v) };
+        }
+        friend Mask<Isa> operator>=(const Float a, const Float b)
+        {
+            return { Isa::GreaterEqual(a.v, b.v) };
+        }
+        friend Mask<Isa> operator==(const Float a, const Float b)
+        {
+            return { Isa::Equal(a.v, b.v) };
+        }
+
+        friend Float min(const Float a, const Float b)
+        {
+            return Isa::Min(a.v, b.v);
+        }
+        friend Float max(const Float a, const Float b)
+        {
+            return Isa::Max(a.v, b.v);
+        }
+        friend Float abs(const Float a)
+        {
+            return Isa::Abs(a.v);
+        }
+        friend Float saturate(const Float a)
+        {
+            return min(max(a, 0.0f), 1.0f);
+        }
+        friend Float lerp(const Float a, const Float b, const Float t)
+        {
+            return a + (b - a) * t;
+        }
+        friend Float select(const Mask<Isa> m, const Float a, const Float b)
+        {
+            return Isa::Select(m.v, a.v, b.v);
+        }
+        friend Int<Isa> truncate(const Float a)
+        {
+            return { Isa::Truncate(a.v) };
+        }
+    };
+
+    // The kernels below evaluate the same expressions as the scalar kernel in NISCpu.cpp, in the same order, with one
+    // output pixel per lane. The branches of the shader are replaced by selects and by weights of zero.
+    template <typename Isa>
+    struct SimdKernel
+    {
+        using F = Float<Isa>;
+        using I = Int<Isa>;
+        using M = Mask<Isa>;
+        static constexpr int Lanes = Isa::Lanes;
+
+        static F getY(const F r, const F g, const F b)
+        {
+            return r * 0.2126f + g * 0.7152f + b * 0.0722f;
+        }
+
+        // The 3x3 neighbourhood is given as p[x][y], or p[y][x] when transposed.
+        static void getEdgeMap(const NISConfig& config, const F p[3][3], F weights[4])
+        {
+            const F g_0 = abs(p[0][0] + p[0][1] + p[0][2] - p[2][0] - p[2][1] - p[2][2]);
+            const F g_45 = abs(p[1][0] + p[0][0] + p[0][1] - p[2][1] - p[2][2] - p[1][2]);
+            const F g_90 = abs(p[0][0] + p[1][0] + p[2][0] - p[0][2] - p[1][2] - p[2][2]);
+            const F g_135 = abs(p[1][0] + p[2][0] + p[2][1] - p[0][1] - p[0][2] - p[1][2]);
+
+            const F g_0_90_max = max(g_0, g_90);
+            const F g_0_90_min = min(g_0, g_90);
+            const F g_45_135_max = max(g_45, g_135);
+            const F g_45_135_min = min(g_45, g_135);
+
+            const F sum = g_0_90_max + g_45_135_max;
+            const M isFlat = sum == F(0.0f);
+            const F e_0_90 = min(g_0_90_max / select(isFlat, 1.0f, sum), 1.0f);
+            const F e_45_135 = F(1.0f) - e_0_90;
+
+            const M c_0_90 = (g_0_90_max > g_0_90_min * config.kDetectRatio) & (g_0_90_max > config.kDetectThres) &
+                             (g_0_90_max > g_45_135_min);
+            const M c_45_135 = (g_45_135_max > g_45_135_min * config.kDetectRatio) &
+                               (g_45_135_max > config.kDetectThres) & (g_45_135_max > g_0_90_min);
+            const M c_g_0_90 = g_0_90_max == g_0;
+            const M c_g_45_135 = g_45_135_max == g_45;
+
+            const F f_e_0_90 = select(c_0_90 & c_45_135, e_0_90, 1.0f);
+            const F f_e_45_135 = select(c_0_90 & c_45_135, e_45_135, 1.0f);
+
+            weights[0] = select(isFlat, 0.0f, select(c_0_90 & c_g_0_90, f_e_0_90, 0.0f));
+            weights[1] = select(isFlat, 0.0f, select(c_0_90 & !c_g_0_90, f_e_0_90, 0.0f));
+            weights[2] = select(isFlat, 0.0f, select(c_45_135 & c_g_45_135, f_e_45_135, 0.0f));
+            weights[3] = select(isFlat, 0.0f, select(c_45_135 & !c_g_45_135, f_e_45_135, 0.0f));
+        }
+
+        static void edgeRow(const Job& job, Band& band, const int y, const bool transposed)
+        {
+            const NISConfig& config = *job.config;
+            const float* rows[3] = { band.lumaRow(y - 1), band.lumaRow(y), band.lumaRow(y + 1) };
+            float* edges[4] = { band.edgeRow(0, y), band.edgeRow(1, y), band.edgeRow(2, y), band.edgeRow(3, y) };
+
+            for (int x = -1; x <= (int)job.input->width; x += Lanes)
+            {
+                F p[3][3];
+                for (int i = 0; i < 3; i++)
+                {
+                    for (int j = 0; j < 3; j++)
+                    {
+                        p[transposed ? i : j][transposed ? j : i] = F::load(rows[i] + x - 1 + j);
+                    }
+                }
+
+                F weights[4];
+                getEdgeMap(config, p, weights);
+                for (int d = 0; d < 4; d++)
+                {
+                    weights[d].store(edges[d] + x);
+                }
+            }
+        }
+
+        static F calcLTI(const NISConfig& config, const F pxl[6], const M selector)
+        {
+            F sel = select(selector, pxl[0], pxl[3]);
+            const F a_min = min(min(pxl[1], pxl[2]), sel);
+            const F a_max = max(max(pxl[1], pxl[2]), sel);
+            sel = select(selector, pxl[2], pxl[5]);
+            const F b_min = min(min(pxl[3], pxl[4]), sel);
+            const F b_max = max(max(pxl[3], pxl[4]), sel);
+
+            const F a_cont = a_max - a_min;
+            const F b_cont = b_max - b_min;
+
+            const F cont_ratio = max(a_cont, b_cont) / (min(a_cont, b_cont) + config.kEps);
+            return (F(1.0f) - saturate((cont_ratio - config.kMinContrastRatio) * config.kRatioNorm)) *
+                   config.kContrastBoost;
+        }
+
+        // The coefficients of the phase of each lane.
+        struct Coefficients
+        {
+            F scale[6];
+            F usm[6];
+            M isFirstHalf;
+
+            void gather(const Job& job, const I phase)
+            {
+                const I offset = phase * job.filterStride;
+                for (int i = 0; i < 6; i++)
+                {
+                    scale[i] = F::gather(job.coefScale, offset + i);
+                    usm[i] = F::gather(job.coefUsm, offset + i);
+                }
+                isFirstHalf = phase <= job.phaseCount / 2;
+            }
+
+            void broadcast(const Job& job, const int phase)
+            {
+                for (int i = 0; i < 6; i++)
+                {
+                    scale[i] = job.coefScale[phase * job.filterStride + i];
+                    usm[i] = job.coefUsm[phase * job.filterStride + i];
+                }
+                isFirstHalf = F(phase <= job.phaseCount / 2 ? 1.0f : 0.0f) > F(0.0f);
+            }
+        };
+
+        static F evalPoly6(const NISConfig& config, const F pxl[6], const Coefficients& coef)
+        {
+            F y = 0.0f;
+            for (int i = 0; i < 6; ++i)
+            {
+                y += coef.scale[i] * pxl[i];
+            }
+            F y_usm = 0.0f;
+            for (int i = 0; i < 6; ++i)
+            {
+                y_usm += coef.usm[i] * pxl[i];
+            }
+
+            const F y_scale = F(1.0f) - saturate((y - config.kSharpStartY) * config.kSharpScaleY);
+            const F y_sharpness = y_scale * config.kSharpStrengthScale + config.kSharpStrengthMin;
+            y_usm *= y_sharpness;
+            const F y_sharpness_limit = (y_scale * config.kSharpLimitScale + config.kSharpLimitMin) * y;
+            y_usm = min(y_sharpness_limit, max(F(0.0f) - y_sharpness_limit, y_usm));
+            y_usm *= calcLTI(config, pxl, coef.isFirstHalf);
+
+            return y + y_usm;
+        }
+
+        static void scaleRow(const Job& job, const Band& band, const uint32_t y)
+        {
+            const NISConfig& config = *job.config;
+
+            float fy;
+            const int py = SourceRow(job, y, fy);
+            const int fy_int = (int)(fy * job.phaseCount);
+
+            const float* rows[6];
+            for (int i = 0; i < 6; i++)
+            {
+                rows[i] = band.lumaRow(py - 2 + i);
+            }
+            const float* edgeRows[2][4];
+            for (int i = 0; i < 2; i++)
+            {
+                for (int d = 0; d < 4; d++)
+                {
+                    edgeRows[i][d] = band.edgeRow(d, py + i);
+                }
+            }
+            const float* inputRows[2] = { InputRow(job, py), InputRow(job, py + 1) };
+            float* outputRow = job.output->pixels.data() + (size_t)y * job.output->width * 4;
+
+            Coefficients coefY;
+            coefY.broadcast(job, fy_int);
+
+            for (uint32_t x = 0; x < job.output->width; x += Lanes)
+            {
+                const I px = I::load(&job.sourceX[x]);
+                const F fx = F::load(&job.fractionX[x]);
+                Coefficients coefX;
+                coefX.gather(job, I::load(&job.phaseX[x]));
+
+                // Interpolate the weights of the directional filters.
+                F w[4];
+                for (int d = 0; d < 4; d++)
+                {
+                    const F h0 = lerp(F::gather(edgeRows[0][d], px), F::gather(edgeRows[0][d], px + 1), fx);
+                    const F h1 = lerp(F::gather(edgeRows[1][d], px), F::gather(edgeRows[1][d], px + 1), fx);
+                    w[d] = lerp(h0, h1, fy);
+                }
+
+                // The 6x6 support, as p[y][x].
+                F p[6][6];
+                for (int i = 0; i < 6; ++i)
+                {
+                    for (int j = 0; j < 6; ++j)
+                    {
+                        p[i][j] = F::gather(rows[i], px + (j - 2));
+                    }
+                }
+
+                const F baseWeight = F(1.0f) - w[0] - w[1] - w[2] - w[3];
+
+                // FilterNormal().
+                F h_acc = 0.0f;
+                for (int j = 0; j < 6; ++j)
+                {
+                    F v_acc = 0.0f;
+                    for (int i = 0; i < 6; ++i)
+                    {
+                        v_acc += p[i][j] * coefY.scale[i];
+                    }
+                    h_acc += v_acc * coefX.scale[j];
+                }
+                F opY = 0.0f;
+                opY += h_acc * baseWeight;
+
+                // AddDirFilters().
+                F f = 0.0f;
+                {
+                    F interp0Deg[6];
+                    for (int i = 0; i < 6; ++i)
+                    {
+                        interp0Deg[i] = lerp(p[i][2], p[i][3], fx);
+                    }
+                    f += evalPoly6(config, interp0Deg, coefY) * w[0];
+                }
+                {
+                    F interp90Deg[6];
+                    for (int i = 0; i < 6; ++i)
+                    {
+                        interp90Deg[i] = lerp(p[2][i], p[3][i], fy);
+                    }
+                    f += evalPoly6(config, interp90Deg, coefX) * w[1];
+                }
+                {
+                    F pphase_b45 = F(0.5f) + F(0.5f) * (fx - fy);
+
+                    F temp_interp45Deg[7];
+                    temp_interp45Deg[1] = lerp(p[2][1], p[1][2], pphase_b45);
+                    temp_interp45Deg[3] = lerp(p[3][2], p[2][3], pphase_b45);
+                    temp_interp45Deg[5] = lerp(p[4][3], p[3][4], pphase_b45);
+                    {
+                        pphase_b45 = pphase_b45 - 0.5f;
+                        const M isPositive = pphase_b45 >= 0.0f;
+                        const F a = select(isPositive, p[0][2], p[2][0]);
+                        const F b = select(isPositive, p[1][3], p[3][1]);
+                        const F c = select(isPositive, p[2][4], p[4][2]);
+                        const F d = select(isPositive, p[3][5], p[5][3]);
+                        temp_interp45Deg[0] = lerp(p[1][1], a, abs(pphase_b45));
+                        temp_interp45Deg[2] = lerp(p[2][2], b, abs(pphase_b45));
+                        temp_interp45Deg[4] = lerp(p[3][3], c, abs(pphase_b45));
+                        temp_interp45Deg[6] = lerp(p[4][4], d, abs(pphase_b45));
+                    }
+
+                    F pphase_p45 = fx + fy;
+                    const M isShifted = pphase_p45 >= 1.0f;
+                    F interp45Deg[6];
+                    for (int i = 0; i < 6; i++)
+                    {
+                        interp45Deg[i] = select(isShifted, temp_interp45Deg[i + 1], temp_interp45Deg[i]);
+                    }
+                    pphase_p45 = select(isShifted, pphase_p45 - 1.0f, pphase_p45);
+
+                    Coefficients coef45;
+                    coef45.gather(job, truncate(pphase_p45 * (float)job.phaseCount));
+                    f += evalPoly6(config, interp45Deg, coef45) * w[2];
+                }
+                {
+                    F pphase_b135 = F(0.5f) * (fx + fy);
+
+                    F temp_interp135Deg[7];
+                    temp_interp135Deg[1] = lerp(p[3][1], p[4][2], pphase_b135);
+                    temp_interp135Deg[3] = lerp(p[2][2], p[3][3], pphase_b135);
+                    temp_interp135Deg[5] = lerp(p[1][3], p[2][4], pphase_b135);
+                    {
+                        pphase_b135 = pphase_b135 - 0.5f;
+                        const M isPositive = pphase_b135 >= 0.0f;
+                        const F a = select(isPositive, p[5][2], p[3][0]);
+                        const F b = select(isPositive, p[4][3], p[2][1]);
+                        const F c = select(isPositive, p[3][4], p[1][2]);
+                        const F d = select(isPositive, p[2][5], p[0][3]);
+                        temp_interp135Deg[0] = lerp(p[4][1], a, abs(pphase_b135));
+                        temp_interp135Deg[2] = lerp(p[3][2], b, abs(pphase_b135));
+                        temp_interp135Deg[4] = lerp(p[2][3], c, abs(pphase_b135));
+                        temp_interp135Deg[6] = lerp(p[1][4], d, abs(pphase_b135));
+                    }
+
+                    F pphase_p135 = F(1.0f) + (fx - fy);
+                    const M isShifted = pphase_p135 >= 1.0f;
+                    F interp135Deg[6];
+                    for (int i = 0; i < 6; i++)
+                    {
+                        interp135Deg[i] = select(isShifted, temp_interp135Deg[i + 1], temp_interp135Deg[i]);
+                    }
+                    pphase_p135 = select(isShifted, pphase_p135 - 1.0f, pphase_p135);
+
+                    Coefficients coef135;
+                    coef135.gather(job, truncate(pphase_p135 * (float)job.phaseCount));
+                    f += evalPoly6(config, interp135Deg, coef135) * w[3];
+                }
+                opY += f;
+
+                // Bilinear tap for the chroma, corrected to produce the new luma.
+                const I texel0 = I::load(&job.texelX0[x]);
+                const I texel1 = I::load(&job.texelX1[x]);
+                F op[4];
+                for (int c = 0; c < 4; c++)
+                {
+                    const F h0 = lerp(F::gather(inputRows[0] + c, texel0), F::gather(inputRows[0] + c, texel1), fx);
+                    const F h1 = lerp(F::gather(inputRows[1] + c, texel0), F::gather(inputRows[1] + c, texel1), fx);
+                    op[c] = lerp(h0, h1, fy);
+                }
+                const F corr = opY - getY(op[0], op[1], op[2]);
+                op[0] += corr;
+                op[1] += corr;
+                op[2] += corr;
+
+                storePixels(op, outputRow, x, job.output->width);
+            }
+        }
+
+        static F evalUSM(const NISConfig& config, const F pxl[5], const F sharpnessStrength, const F sharpnessLimit)
+        {
+            F y_usm = pxl[1] * -0.6001f + pxl[2] * 1.2002f - pxl[3] * 0.6001f;
+            y_usm *= sharpnessStrength;
+            y_usm = min(sharpnessLimit, max(F(0.0f) - sharpnessLimit, y_usm));
+
+            // CalcLTIFast().
+            const F a_min = min(min(pxl[0], pxl[1]), pxl[2]);
+            const F a_max = max(max(pxl[0], pxl[1]), pxl[2]);
+            const F b_min = min(min(pxl[2], pxl[3]), pxl[4]);
+            const F b_max = max(max(pxl[2], pxl[3]), pxl[4]);
+            const F a_cont = a_max - a_min;
+            const F b_cont = b_max - b_min;
+            const F cont_ratio = max(a_cont, b_cont) / (min(a_cont, b_cont) + config.kEps);
+            y_usm *= (F(1.0f) - saturate((cont_ratio - config.kMinContrastRatio) * config.kRatioNorm)) *
+                     config.kContrastBoost;
+
+            return y_usm;
+        }
+
+        static void sharpenRow(const Job& job, const Band& band, const uint32_t y)
+        {
+            const NISConfig& config = *job.config;
+
+            const float* rows[5];
+            for (int i = 0; i < 5; i++)
+            {
+                rows[i] = band.lumaRow((int)y - 2 + i);
+            }
+            const float* edgeRows[4];
+            for (int d = 0; d < 4; d++)
+            {
+                edgeRows[d] = band.edgeRow(d, (int)y);
+            }
+            const float* inputRow = InputRow(job, (int)y);
+            float* outputRow = job.output->pixels.data() + (size_t)y * job.output->width * 4;
+
+            for (uint32_t x = 0; x < job.output->width; x += Lanes)
+            {
+                // The 5x5 support, as p[y][x].
+                F p[5][5];
+                for (int i = 0; i < 5; ++i)
+                {
+                    for (int j = 0; j < 5; ++j)
+                    {
+                        p[i][j] = F::load(rows[i] + x - 2 + j);
+                    }
+                }
+
+                // GetDirUSM().
+                const F scaleY = F(1.0f) - saturate((p[2][2] - config.kSharpStartY) * config.kSharpScaleY);
+                const F sharpnessStrength = scaleY * config.kSharpStrengthScale + config.kSharpStrengthMin;
+                const F sharpnessLimit = (scaleY * config.kSharpLimitScale + config.kSharpLimitMin) * p[2][2];
+
+                F dirUSM[4];
+                {
+                    F interp0Deg[5];
+                    for (int i = 0; i < 5; ++i)
+                    {
+                        interp0Deg[i] = p[i][2];
+                    }
+                    dirUSM[0] = evalUSM(config, interp0Deg, sharpnessStrength, sharpnessLimit);
+                }
+                {
+                    F interp90Deg[5];
+                    for (int i = 0; i < 5; ++i)
+                    {
+                        interp90Deg[i] = p[2][i];
+                    }
+                    dirUSM[1] = evalUSM(config, interp90Deg, sharpnessStrength, sharpnessLimit);
+                }
+                {
+                    F interp45Deg[5];
+                    interp45Deg[0] = p[1][1];
+                    interp45Deg[1] = lerp(p[2][1], p[1][2], 0.5f);
+                    interp45Deg[2] = p[2][2];
+                    interp45Deg[3] = lerp(p[3][2], p[2][3], 0.5f);
+                    interp45Deg[4] = p[3][3];
+                    dirUSM[2] = evalUSM(config, interp45Deg, sharpnessStrength, sharpnessLimit);
+                }
+                {
+                    F interp135Deg[5];
+                    interp135Deg[0] = p[3][1];
+                    interp135Deg[1] = lerp(p[3][2], p[2][1], 0.5f);
+                    interp135Deg[2] = p[2][2];
+                    interp135Deg[3] = lerp(p[2][3], p[1][2], 0.5f);
+                    interp135Deg[4] = p[1][3];
+                    dirUSM[3] = evalUSM(config, interp135Deg, sharpnessStrength, sharpnessLimit);
+                }
+
+                F usmY = dirUSM[0] * F::load(edgeRows[0] + x);
+                usmY += dirUSM[1] * F::load(edgeRows[1] + x);
+                usmY += dirUSM[2] * F::load(edgeRows[2] + x);
+                usmY += dirUSM[3] * F::load(edgeRows[3] + x);
+
+                const I texel = I::load(&job.texelX0[x]);
+                F op[4];
+                for (int c = 0; c < 4; c++)
+                {
+                    op[c] = F::gather(inputRow + c, texel);
+                }
+                op[0] += usmY;
+                op[1] += usmY;
+                op[2] += usmY;
+
+                storePixels(op, outputRow, x, job.output->width);
+            }
+        }
+
+        static void storePixels(const F op[4], float* outputRow, const uint32_t x, const uint32_t width)
+        {
+            float channels[4][Lanes];
+            for (int c = 0; c < 4; c++)
+            {
+                op[c].store(channels[c]);
+            }
+            const uint32_t count = (std::min)((uint32_t)Lanes, width - x);
+            float* pixel = outputRow + (size_t)x * 4;
+            for (uint32_t i = 0; i < count; i++)
+            {
+                for (int c = 0; c < 4; c++)
+                {
+                    *pixel++ = channels[c][i];
+                }
+            }
+        }
+
+        static Kernel get()
+        {
+            return { edgeRow, scaleRow, sharpenRow };
+        }
+    };
+}
@@ -0,0 +1,144 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// This file does not use the precompiled header, so it can be shared with the tools.
+
+#include "NISCpuKernel.h"
+
+#if defined(_M_ARM64) || defined(__aarch64__)
+
+#include <arm_neon.h>
+
+namespace
+{
+    struct NEON
+    {
+        static constexpr int Lanes = 4;
+        using F = float32x4_t;
+        using I = int32x4_t;
+        using M = uint32x4_t;
+
+        static F Set(const float value)
+        {
+            return vdupq_n_f32(value);
+        }
+        static F Load(const float* p)
+        {
+            return vld1q_f32(p);
+        }
+        static I LoadInt(const int32_t* p)
+        {
+            return vld1q_s32(p);
+        }
+        static void Store(float* p, const F value)
+        {
+            vst1q_f32(p, value);
+        }
+        static F Gather(const float* base, const I index)
+        {
+            const float values[4] = { base[vgetq_lane_s32(index, 0)],
+                                      base[vgetq_lane_s32(index, 1)],
+                                      base[vgetq_lane_s32(index, 2)],
+                                      base[vgetq_lane_s32(index, 3)] };
+            return vld1q_f32(values);
+        }
+
+        static F Add(const F a, const F b)
+        {
+            return vaddq_f32(a, b);
+        }
+        static F Sub(const F a, const F b)
+        {
+            return vsubq_f32(a, b);
+        }
+        static F Mul(const F a, const F b)
+        {
+            return vmulq_f32(a, b);
+        }
+        static F Div(const F a, const F b)
+        {
+            return vdivq_f32(a, b);
+        }
+        static F Min(const F a, const F b)
+        {
+            return vminq_f32(a, b);
+        }
+        static F Max(const F a, const F b)
+        {
+            return vmaxq_f32(a, b);
+        }
+        static F Abs(const F a)
+        {
+            return vabsq_f32(a);
+        }
+        static I Truncate(const F a)
+        {
+            return vcvtq_s32_f32(a);
+        }
+
+        static M Greater(const F a, const F b)
+        {
+            return vcgtq_f32(a, b);
+        }
+        static M GreaterEqual(const F a, const F b)
+        {
+            return vcgeq_f32(a, b);
+        }
+        static M Equal(const F a, const F b)
+        {
+            return vceqq_f32(a, b);
+        }
+        static M And(const M a, const M b)
+        {
+            return vandq_u32(a, b);
+        }
+        static M Or(const M a, const M b)
+        {
+            return vorrq_u32(a, b);
+        }
+        static M Not(const M a)
+        {
+            return vmvnq_u32(a);
+        }
+        static F Select(const M m, const F a, const F b)
+        {
+            return vbslq_f32(m, a, b);
+        }
+
+        static I AddInt(const I a, const int32_t b)
+        {
+            return vaddq_s32(a, vdupq_n_s32(b));
+        }
+        static I MulInt(const I a, const int32_t b)
+        {
+            return vmulq_n_s32(a, b);
+        }
+        static M LessEqualInt(const I a, const int32_t b)
+        {
+            return vcleq_s32(a, vdupq_n_s32(b));
+        }
+    };
+}
+
+namespace nis_scaler::nis_cpu
+{
+    Kernel GetNEONKernel()
+    {
+        return SimdKernel<NEON>::get();
+    }
+}
+
+#endif
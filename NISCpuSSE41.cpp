@@ -0,0 +1,144 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// This file does not use the precompiled header, so it can be shared with the tools.
+// It must be compiled with SSE4.1 enabled.
+
+#include "NISCpuKernel.h"
+
+#if defined(_M_X64) || defined(__x86_64__)
+
+#include <smmintrin.h>
+
+namespace
+{
+    struct SSE41
+    {
+        static constexpr int Lanes = 4;
+        using F = __m128;
+        using I = __m128i;
+        using M = __m128;
+
+        static F Set(const float value)
+        {
+            return _mm_set1_ps(value);
+        }
+        static F Load(const float* p)
+        {
+            return _mm_loadu_ps(p);
+        }
+        static I LoadInt(const int32_t* p)
+        {
+            return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        }
+        static void Store(float* p, const F value)
+        {
+            _mm_storeu_ps(p, value);
+        }
+        static F Gather(const float* base, const I index)
+        {
+            return _mm_setr_ps(base[_mm_cvtsi128_si32(index)],
+                               base[_mm_extract_epi32(index, 1)],
+                               base[_mm_extract_epi32(index, 2)],
+                               base[_mm_extract_epi32(index, 3)]);
+        }
+
+        static F Add(const F a, const F b)
+        {
+            return _mm_add_ps(a, b);
+        }
+        static F Sub(const F a, const F b)
+        {
+            return _mm_sub_ps(a, b);
+        }
+        static F Mul(const F a, const F b)
+        {
+            return _mm_mul_ps(a, b);
+        }
+        static F Div(const F a, const F b)
+        {
+            return _mm_div_ps(a, b);
+        }
+        static F Min(const F a, const F b)
+        {
+            return _mm_min_ps(a, b);
+        }
+        static F Max(const F a, const F b)
+        {
+            return _mm_max_ps(a, b);
+        }
+        static F Abs(const F a)
+        {
+            return _mm_andnot_ps(_mm_set1_ps(-0.0f), a);
+        }
+        static I Truncate(const F a)
+        {
+            return _mm_cvttps_epi32(a);
+        }
+
+        static M Greater(const F a, const F b)
+        {
+            return _mm_cmpgt_ps(a, b);
+        }
+        static M GreaterEqual(const F a, const F b)
+        {
+            return _mm_cmpge_ps(a, b);
+        }
+        static M Equal(const F a, const F b)
+        {
+            return _mm_cmpeq_ps(a, b);
+        }
+        static M And(const M a, const M b)
+        {
+            return _mm_and_ps(a, b);
+        }
+        static M Or(const M a, const M b)
+        {
+            return _mm_or_ps(a, b);
+        }
+        static M Not(const M a)
+        {
+            return _mm_xor_ps(a, _mm_castsi128_ps(_mm_set1_epi32(-1)));
+        }
+        static F Select(const M m, const F a, const F b)
+        {
+            return _mm_blendv_ps(b, a, m);
+        }
+
+        static I AddInt(const I a, const int32_t b)
+        {
+            return _mm_add_epi32(a, _mm_set1_epi32(b));
+        }
+        static I MulInt(const I a, const int32_t b)
+        {
+            return _mm_mullo_epi32(a, _mm_set1_epi32(b));
+        }
+        static M LessEqualInt(const I a, const int32_t b)
+        {
+            return _mm_castsi128_ps(_mm_cmpgt_epi32(_mm_set1_epi32(b + 1), a));
+        }
+    };
+}
+
+namespace nis_scaler::nis_cpu
+{
+    Kernel GetSSE41Kernel()
+    {
+        return SimdKernel<SSE41>::get();
+    }
+}
+
+#endif
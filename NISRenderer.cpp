@@ -0,0 +1,502 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pch.h"
+
+#include <d3dcompiler.h>
+
+#include <DeviceResources.h>
+#include <DXUtilities.h>
+
+#include "MsaaResolve.h"
+#include "NISRenderer.h"
+#include "ScalerKeys.h"
+#include "ShaderCompiler.h"
+#include "SharedCache.h"
+
+namespace nis_scaler
+{
+    struct NISCoefficients
+    {
+        Microsoft::WRL::ComPtr<ID3D11Texture2D> scaler;
+        Microsoft::WRL::ComPtr<ID3D11Texture2D> usm;
+        Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> scalerSrv;
+        Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> usmSrv;
+    };
+}
+
+namespace
+{
+    using namespace nis_scaler;
+
+    SharedCache<NISCoefficientsKey<ID3D11Device>, NISCoefficients> sharedCoefficients;
+
+    std::shared_ptr<NISCoefficients> CreateCoefficients(DeviceResources& deviceResources)
+    {
+        auto coefficients = std::make_shared<NISCoefficients>();
+        const uint32_t rowPitch = kFilterSize * sizeof(float);
+        const uint32_t imageSize = rowPitch * kPhaseCount;
+        deviceResources.createTexture2D(kFilterSize / 4, kPhaseCount, DXGI_FORMAT_R32G32B32A32_FLOAT, D3D11_USAGE_DEFAULT, coef_scale, rowPitch, imageSize, coefficients->scaler.GetAddressOf());
+        deviceResources.createTexture2D(kFilterSize / 4, kPhaseCount, DXGI_FORMAT_R32G32B32A32_FLOAT, D3D11_USAGE_DEFAULT, coef_usm, rowPitch, imageSize, coefficients->usm.GetAddressOf());
+        deviceResources.createSRV(coefficients->scaler.Get(), DXGI_FORMAT_R32G32B32A32_FLOAT, coefficients->scalerSrv.GetAddressOf());
+        deviceResources.createSRV(coefficients->usm.Get(), DXGI_FORMAT_R32G32B32A32_FLOAT, coefficients->usmSrv.GetAddressOf());
+        return coefficients;
+    }
+
+    // The declarations that NIS_Main.hlsl makes for NIS_Scaler.h, for several views. The constants of NISConfig are read
+    // from the view of the thread group, and the texture accesses of NIS_Scaler.h (the NVTEX_* macros) are redirected to
+    // the slice of the view. NIS_Scaler.h's own definitions of these macros are removed (see StripTextureMacros()).
+    // A multisampled input is resolved while it is read, like with BilinearRenderer, without a resolved copy.
+    const std::string nisShaderPrologue = R"_(
+#ifndef NIS_HLSL
+#define NIS_HLSL 1
+#endif
+
+struct NISViewConfig
+{
+    float detectRatio;
+    float detectThres;
+    float minContrastRatio;
+    float ratioNorm;
+
+    float contrastBoost;
+    float eps;
+    float sharpStartY;
+    float sharpScaleY;
+
+    float sharpStrengthMin;
+    float sharpStrengthScale;
+    float sharpLimitMin;
+    float sharpLimitScale;
+
+    float scaleX;
+    float scaleY;
+
+    float dstNormX;
+    float dstNormY;
+    float srcNormX;
+    float srcNormY;
+
+    uint inputViewportOriginX;
+    uint inputViewportOriginY;
+    uint inputViewportWidth;
+    uint inputViewportHeight;
+
+    uint outputViewportOriginX;
+    uint outputViewportOriginY;
+    uint outputViewportWidth;
+    uint outputViewportHeight;
+
+    float reserved0;
+    float reserved1;
+};
+
+// For each view: the input slice, the output slice, and whether the output is encoded to sRGB.
+cbuffer cb : register(b0)
+{
+    NISViewConfig kViews[MAX_VIEWS];
+    uint4 kViewSlices[MAX_VIEWS];
+};
+
+// The view of the thread group, set by main().
+static uint s_view;
+
+#define kDetectRatio kViews[s_view].detectRatio
+#define kDetectThres kViews[s_view].detectThres
+#define kMinContrastRatio kViews[s_view].minContrastRatio
+#define kRatioNorm kViews[s_view].ratioNorm
+#define kContrastBoost kViews[s_view].contrastBoost
+#define kEps kViews[s_view].eps
+#define kSharpStartY kViews[s_view].sharpStartY
+#define kSharpScaleY kViews[s_view].sharpScaleY
+#define kSharpStrengthMin kViews[s_view].sharpStrengthMin
+#define kSharpStrengthScale kViews[s_view].sharpStrengthScale
+#define kSharpLimitMin kViews[s_view].sharpLimitMin
+#define kSharpLimitScale kViews[s_view].sharpLimitScale
+#define kScaleX kViews[s_view].scaleX
+#define kScaleY kViews[s_view].scaleY
+#define kDstNormX kViews[s_view].dstNormX
+#define kDstNormY kViews[s_view].dstNormY
+#define kSrcNormX kViews[s_view].srcNormX
+#define kSrcNormY kViews[s_view].srcNormY
+#define kInputViewportOriginX kViews[s_view].inputViewportOriginX
+#define kInputViewportOriginY kViews[s_view].inputViewportOriginY
+#define kInputViewportWidth kViews[s_view].inputViewportWidth
+#define kInputViewportHeight kViews[s_view].inputViewportHeight
+#define kOutputViewportOriginX kViews[s_view].outputViewportOriginX
+#define kOutputViewportOriginY kViews[s_view].outputViewportOriginY
+#define kOutputViewportWidth kViews[s_view].outputViewportWidth
+#define kOutputViewportHeight kViews[s_view].outputViewportHeight
+
+SamplerState samplerLinearClamp : register(s0);
+RWTexture2DArray<float4> out_texture : register(u0);
+#if NIS_SCALER
+Texture2D coef_scaler : register(t1);
+Texture2D coef_usm : register(t2);
+#endif
+
+#define NVTEX_LOAD(x, pos) NISLoad_##x(pos)
+#define NISLoad_coef_scaler(pos) coef_scaler[pos]
+#define NISLoad_coef_usm(pos) coef_usm[pos]
+#define NVTEX_STORE(x, pos, v) x[uint3(pos, kViewSlices[s_view].y)] = EncodeOutput(v)
+
+// The sRGB textures written through a UNORM alias are encoded here, like an _SRGB view would.
+float4 EncodeOutput(float4 color)
+{
+    if (kViewSlices[s_view].z)
+    {
+        const float3 linearColor = saturate(color.rgb);
+        color.rgb = linearColor <= 0.0031308f ? linearColor * 12.92f : 1.055f * pow(linearColor, 1.f / 2.4f) - 0.055f;
+    }
+    return color;
+}
+
+#if SAMPLE_COUNT > 1
+cbuffer weights : register(b1)
+{
+    float4 kSampleWeights[(SAMPLE_COUNT + 3) / 4];
+};
+
+Texture2DMSArray<float4, SAMPLE_COUNT> in_texture : register(t0);
+
+// A multisampled input cannot be sampled with a filter: the texels are loaded, each of them resolved from its samples,
+// and filtered in the shader. The texels are clamped to the edges of the texture, like with samplerLinearClamp.
+float4 LoadResolved(int2 texel)
+{
+    uint width, height, elements, samples;
+    in_texture.GetDimensions(width, height, elements, samples);
+    texel = clamp(texel, int2(0, 0), int2(width, height) - 1);
+
+    float4 color = 0;
+    [unroll]
+    for (uint i = 0; i < SAMPLE_COUNT; i++)
+    {
+        color += kSampleWeights[i / 4][i % 4] * in_texture.Load(int3(texel, kViewSlices[s_view].x), i);
+    }
+    return color;
+}
+
+float4 SampleResolved(float2 texcoord)
+{
+    uint width, height, elements, samples;
+    in_texture.GetDimensions(width, height, elements, samples);
+
+    const float2 position = texcoord * float2(width, height) - 0.5f;
+    const float2 fraction = frac(position);
+    const int2 texel = int2(floor(position));
+
+    const float4 row0 = lerp(LoadResolved(texel), LoadResolved(texel + int2(1, 0)), fraction.x);
+    const float4 row1 = lerp(LoadResolved(texel + int2(0, 1)), LoadResolved(texel + int2(1, 1)), fraction.x);
+    return lerp(row0, row1, fraction.y);
+}
+
+// The tile load of NIS_Scaler.h gathers the red, green and blue channels of the same 4 texels in a row: the resolved
+// texels are kept for the next channels, in the order of Gather(): (0, 1), (1, 1), (1, 0), (0, 0).
+static float2 s_gatherTexcoord = -1.f;
+static float4 s_gatherTexels[4];
+
+void GatherResolved(float2 texcoord)
+{
+    if (any(texcoord != s_gatherTexcoord))
+    {
+        uint width, height, elements, samples;
+        in_texture.GetDimensions(width, height, elements, samples);
+
+        const int2 texel = int2(floor(texcoord * float2(width, height) - 0.5f));
+        s_gatherTexels[0] = LoadResolved(texel + int2(0, 1));
+        s_gatherTexels[1] = LoadResolved(texel + int2(1, 1));
+        s_gatherTexels[2] = LoadResolved(texel + int2(1, 0));
+        s_gatherTexels[3] = LoadResolved(texel);
+        s_gatherTexcoord = texcoord;
+    }
+}
+
+float4 GatherResolvedRed(float2 texcoord)
+{
+    GatherResolved(texcoord);
+    return float4(s_gatherTexels[0].r, s_gatherTexels[1].r, s_gatherTexels[2].r, s_gatherTexels[3].r);
+}
+
+float4 GatherResolvedGreen(float2 texcoord)
+{
+    GatherResolved(texcoord);
+    return float4(s_gatherTexels[0].g, s_gatherTexels[1].g, s_gatherTexels[2].g, s_gatherTexels[3].g);
+}
+
+float4 GatherResolvedBlue(float2 texcoord)
+{
+    GatherResolved(texcoord);
+    return float4(s_gatherTexels[0].b, s_gatherTexels[1].b, s_gatherTexels[2].b, s_gatherTexels[3].b);
+}
+
+#define NISLoad_in_texture(pos) LoadResolved(int2(pos))
+#define NVTEX_SAMPLE(x, sampler, pos) SampleResolved(pos)
+#define NVTEX_SAMPLE_RED(x, sampler, pos) GatherResolvedRed(pos)
+#define NVTEX_SAMPLE_GREEN(x, sampler, pos) GatherResolvedGreen(pos)
+#define NVTEX_SAMPLE_BLUE(x, sampler, pos) GatherResolvedBlue(pos)
+#else
+Texture2DArray in_texture : register(t0);
+
+#define NISLoad_in_texture(pos) in_texture.Load(int4(pos, kViewSlices[s_view].x, 0))
+#define NVTEX_SAMPLE(x, sampler, pos) x.SampleLevel(sampler, float3(pos, kViewSlices[s_view].x), 0)
+#define NVTEX_SAMPLE_RED(x, sampler, pos) x.GatherRed(sampler, float3(pos, kViewSlices[s_view].x))
+#define NVTEX_SAMPLE_GREEN(x, sampler, pos) x.GatherGreen(sampler, float3(pos, kViewSlices[s_view].x))
+#define NVTEX_SAMPLE_BLUE(x, sampler, pos) x.GatherBlue(sampler, float3(pos, kViewSlices[s_view].x))
+#endif
+
+#line 1 "NIS_Scaler.h"
+)_";
+
+    // The Z index of the dispatch selects the view. The thread groups cover the largest output viewport: the groups
+    // outside of the viewport of their view end immediately.
+    const std::string nisShaderEpilogue = R"_(
+#line 1 "NISRenderer"
+[numthreads(NIS_THREAD_GROUP_SIZE, 1, 1)]
+void main(uint3 blockIdx : SV_GroupID, uint3 threadIdx : SV_GroupThreadID)
+{
+    s_view = blockIdx.z;
+    if (blockIdx.x * NIS_BLOCK_WIDTH >= kOutputViewportWidth || blockIdx.y * NIS_BLOCK_HEIGHT >= kOutputViewportHeight)
+    {
+        return;
+    }
+
+#if NIS_SCALER
+    NVScaler(blockIdx.xy, threadIdx.x);
+#else
+    NVSharpen(blockIdx.xy, threadIdx.x);
+#endif
+}
+    )_";
+
+    // Remove the definitions of the texture access macros from NIS_Scaler.h, so that the definitions of the prologue
+    // apply. The lines are kept empty, so that the compiler reports the lines of the file.
+    std::string StripTextureMacros(const std::string& header)
+    {
+        static const char* const macros[] = {
+            "NVTEX_LOAD", "NVTEX_SAMPLE", "NVTEX_SAMPLE_RED", "NVTEX_SAMPLE_GREEN", "NVTEX_SAMPLE_BLUE", "NVTEX_STORE",
+        };
+
+        std::string result;
+        result.reserve(header.size());
+        bool isStripped = false;
+        std::istringstream lines(header);
+        std::string line;
+        while (std::getline(lines, line))
+        {
+            // Match "#define NAME(" with any whitespace.
+            size_t position = line.find_first_not_of(" \t");
+            bool isMacro = false;
+            if (position != std::string::npos && line[position] == '#')
+            {
+                position = line.find_first_not_of(" \t", position + 1);
+                if (position != std::string::npos && line.compare(position, 6, "define") == 0)
+                {
+                    const size_t nameBegin = line.find_first_not_of(" \t", position + 6);
+                    const size_t nameEnd = nameBegin != std::string::npos ? line.find_first_of(" \t(", nameBegin) : std::string::npos;
+                    if (nameEnd != std::string::npos)
+                    {
+                        const std::string name = line.substr(nameBegin, nameEnd - nameBegin);
+                        isMacro = std::find(std::begin(macros), std::end(macros), name) != std::end(macros);
+                    }
+                }
+            }
+
+            if (!isMacro)
+            {
+                result += line;
+            }
+            isStripped = isStripped || isMacro;
+            result += '\n';
+        }
+
+        if (!isStripped)
+        {
+            throw std::runtime_error("NIS_Scaler.h does not define the NVTEX_* macros");
+        }
+        return result;
+    }
+
+    bool IsOverlapping(const NISView& a, const NISView& b)
+    {
+        return a.outputSlice == b.outputSlice && a.outputViewport.x < b.outputViewport.x + b.outputViewport.width &&
+               b.outputViewport.x < a.outputViewport.x + a.outputViewport.width && a.outputViewport.y < b.outputViewport.y + b.outputViewport.height &&
+               b.outputViewport.y < a.outputViewport.y + a.outputViewport.height;
+    }
+}
+
+namespace nis_scaler
+{
+    NISRenderer::NISRenderer(DeviceResources& deviceResources,
+                             const std::string& shaderHome,
+                             const bool isUpscaling,
+                             const NISVariant& variant,
+                             ShaderCache* const shaderCache,
+                             const NISHDRMode hdrMode,
+                             const uint32_t sampleCount,
+                             const float* const sampleWeights)
+        : m_deviceResources(deviceResources), m_isUpscaling(isUpscaling), m_variant(variant), m_hdrMode(hdrMode), m_sampleCount(sampleCount)
+    {
+        // The viewport support lets the shader read from and write to a region of the textures. With cs_5_0, half
+        // precision uses min16float.
+        const std::string maxViews = std::to_string(MaxViews);
+        const std::string blockWidth = std::to_string(variant.blockWidth);
+        const std::string blockHeight = std::to_string(variant.blockHeight);
+        const std::string threadGroupSize = std::to_string(variant.threadGroupSize);
+        const std::string hdrModeValue = std::to_string((uint32_t)hdrMode);
+        const std::string sampleCountString = std::to_string(sampleCount);
+        const D3D_SHADER_MACRO defines[] = {
+            { "MAX_VIEWS", maxViews.c_str() },
+            { "SAMPLE_COUNT", sampleCountString.c_str() },
+            { "NIS_SCALER", isUpscaling ? "1" : "0" },
+            { "NIS_HDR_MODE", hdrModeValue.c_str() },
+            { "NIS_BLOCK_WIDTH", blockWidth.c_str() },
+            { "NIS_BLOCK_HEIGHT", blockHeight.c_str() },
+            { "NIS_THREAD_GROUP_SIZE", threadGroupSize.c_str() },
+            { "NIS_USE_HALF_PRECISION", variant.isHalfPrecision ? "1" : "0" },
+            { "NIS_VIEWPORT_SUPPORT", "1" },
+            { nullptr, nullptr }
+        };
+
+        // NIS_Scaler.h is part of the source, so the key of the cache covers it.
+        const std::string headerPath = (std::filesystem::path(shaderHome) / "NIS_Scaler.h").string();
+        const std::string source = nisShaderPrologue + StripTextureMacros(ReadShaderFile(headerPath)) + nisShaderEpilogue;
+        const std::vector<uint8_t> shaderBytes = CompileShader(shaderCache, source, "NISRenderer", {}, defines, "main", "cs_5_0", D3DCOMPILE_OPTIMIZATION_LEVEL3);
+        DX::ThrowIfFailed(m_deviceResources.device()->CreateComputeShader(shaderBytes.data(), shaderBytes.size(), nullptr, m_computeShader.GetAddressOf()));
+
+        for (BatchSlot& slot : m_slots)
+        {
+            Constants constants{};
+            m_deviceResources.createConstBuffer(&constants, sizeof(Constants), slot.constantBuffer.GetAddressOf());
+        }
+        m_deviceResources.createLinearClampSampler(m_linearClampSampler.GetAddressOf());
+
+        // The weights do not change: they are packed in float4 like the array of the shader.
+        if (sampleCount > 1)
+        {
+            float weights[MaxSampleCount]{};
+            std::copy(sampleWeights, sampleWeights + sampleCount, weights);
+            m_deviceResources.createConstBuffer(weights, sizeof(weights), m_sampleWeightsBuffer.GetAddressOf());
+        }
+
+        // The filter coefficients are only used by the scaler.
+        if (isUpscaling)
+        {
+            m_coefficients = sharedCoefficients.getOrCreate(m_deviceResources.device(), [&] { return CreateCoefficients(m_deviceResources); });
+        }
+    }
+
+    bool NISRenderer::update(const uint32_t slotIndex,
+                             const float sharpness,
+                             const NISView* const views,
+                             const uint32_t viewCount,
+                             const uint32_t inputWidth,
+                             const uint32_t inputHeight,
+                             const uint32_t outputWidth,
+                             const uint32_t outputHeight,
+                             const bool isSrgbOutput)
+    {
+        BatchSlot& slot = m_slots[(std::min)(slotIndex, MaxViews - 1)];
+        if (slot.isValid && sharpness == slot.sharpness && viewCount == slot.viewCount && inputWidth == slot.inputWidth &&
+            inputHeight == slot.inputHeight && outputWidth == slot.outputWidth && outputHeight == slot.outputHeight &&
+            isSrgbOutput == slot.isSrgbOutput && std::equal(views, views + viewCount, slot.views))
+        {
+            return true;
+        }
+
+        Constants constants{};
+        slot.isValid = viewCount && viewCount <= MaxViews;
+        for (uint32_t i = 0; slot.isValid && i < viewCount; i++)
+        {
+            const NISView& view = views[i];
+            const NISViewport& inputViewport = view.inputViewport;
+            const NISViewport& outputViewport = view.outputViewport;
+            if (m_isUpscaling)
+            {
+                slot.isValid = NVScalerUpdateConfig(constants.configs[i], sharpness,
+                                                    inputViewport.x, inputViewport.y, inputViewport.width, inputViewport.height, inputWidth, inputHeight,
+                                                    outputViewport.x, outputViewport.y, outputViewport.width, outputViewport.height, outputWidth, outputHeight,
+                                                    m_hdrMode);
+            }
+            else
+            {
+                slot.isValid = outputViewport.width == inputViewport.width && outputViewport.height == inputViewport.height &&
+                               NVSharpenUpdateConfig(constants.configs[i], sharpness,
+                                                     inputViewport.x, inputViewport.y, inputViewport.width, inputViewport.height, inputWidth, inputHeight,
+                                                     outputViewport.x, outputViewport.y,
+                                                     m_hdrMode);
+            }
+            for (uint32_t j = 0; slot.isValid && j < i; j++)
+            {
+                slot.isValid = !IsOverlapping(view, views[j]);
+            }
+            constants.slices[i][0] = view.inputSlice;
+            constants.slices[i][1] = view.outputSlice;
+            constants.slices[i][2] = isSrgbOutput;
+        }
+        if (!slot.isValid)
+        {
+            return false;
+        }
+
+        slot.sharpness = sharpness;
+        std::copy(views, views + viewCount, slot.views);
+        slot.viewCount = viewCount;
+        slot.inputWidth = inputWidth;
+        slot.inputHeight = inputHeight;
+        slot.outputWidth = outputWidth;
+        slot.outputHeight = outputHeight;
+        slot.isSrgbOutput = isSrgbOutput;
+        slot.maxOutputWidth = slot.maxOutputHeight = 0;
+        for (uint32_t i = 0; i < viewCount; i++)
+        {
+            slot.maxOutputWidth = (std::max)(slot.maxOutputWidth, views[i].outputViewport.width);
+            slot.maxOutputHeight = (std::max)(slot.maxOutputHeight, views[i].outputViewport.height);
+        }
+        m_deviceResources.updateConstBuffer(&constants, sizeof(Constants), slot.constantBuffer.Get());
+
+        return true;
+    }
+
+    void NISRenderer::dispatch(const uint32_t slotIndex, ID3D11ShaderResourceView* const* input, ID3D11UnorderedAccessView* const* output)
+    {
+        BatchSlot& slot = m_slots[(std::min)(slotIndex, MaxViews - 1)];
+        if (!slot.isValid)
+        {
+            return;
+        }
+
+        ID3D11DeviceContext* const context = m_deviceResources.context();
+        context->CSSetShaderResources(0, 1, input);
+        if (m_isUpscaling)
+        {
+            context->CSSetShaderResources(1, 1, m_coefficients->scalerSrv.GetAddressOf());
+            context->CSSetShaderResources(2, 1, m_coefficients->usmSrv.GetAddressOf());
+        }
+        context->CSSetUnorderedAccessViews(0, 1, output, nullptr);
+        context->CSSetSamplers(0, 1, m_linearClampSampler.GetAddressOf());
+        context->CSSetConstantBuffers(0, 1, slot.constantBuffer.GetAddressOf());
+        if (m_sampleCount > 1)
+        {
+            context->CSSetConstantBuffers(1, 1, m_sampleWeightsBuffer.GetAddressOf());
+        }
+        context->CSSetShader(m_computeShader.Get(), nullptr, 0);
+
+        // The thread groups cover the largest output viewport, for each view.
+        context->Dispatch((slot.maxOutputWidth + m_variant.blockWidth - 1) / m_variant.blockWidth,
+                          (slot.maxOutputHeight + m_variant.blockHeight - 1) / m_variant.blockHeight,
+                          slot.viewCount);
+    }
+}
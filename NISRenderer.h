@@ -0,0 +1,148 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <NIS_Config.h>
+
+#include "NISTuning.h"
+#include "ViewMapping.h"
+
+class DeviceResources;
+
+namespace nis_scaler
+{
+    class ShaderCache;
+    struct NISCoefficients;
+
+    // A view processed by NISRenderer: a region of a slice of the input, to a region of a slice of the output.
+    struct NISView
+    {
+        uint32_t inputSlice;
+        NISViewport inputViewport;
+        uint32_t outputSlice;
+        NISViewport outputViewport;
+
+        bool operator==(const NISView& other) const
+        {
+            return inputSlice == other.inputSlice && inputViewport == other.inputViewport && outputSlice == other.outputSlice &&
+                   outputViewport == other.outputViewport;
+        }
+    };
+
+    // Run the NIS shader from regions of the input texture to regions of the output texture.
+    // This replaces the NVScaler and NVSharpen classes from the SDK samples, which only process entire textures.
+    // Like BilinearRenderer, several views are processed with a single dispatch, one view per Z index: the shader is built
+    // from NIS_Scaler.h with an entry point of our own (instead of NIS_Main.hlsl), which reads the constants of the view
+    // from an array and the slice of the view from the textures bound as arrays. A multisampled input is resolved while
+    // the tiles of the views are loaded.
+    // The renderer is shared by the swapchains of a frame: each batch slot keeps its own constant buffer, so the constants
+    // are only uploaded when the regions of its views change (for example with dynamic resolution).
+    class NISRenderer
+    {
+    public:
+        // The number of views of a batch, and the number of batch slots. The batches beyond share the last slot.
+        static constexpr uint32_t MaxViews = 4;
+
+        // Compile the scaler (isUpscaling) or the sharpen-only variant of the shader with the given parameters (see
+        // NISTuning.h), or load it from the cache (if any). The linear HDR mode is for the inputs not limited to [0, 1].
+        // With several samples per pixel, the input is resolved with sampleWeights (see GetMsaaResolveWeights()).
+        NISRenderer(DeviceResources& deviceResources,
+                    const std::string& shaderHome,
+                    bool isUpscaling,
+                    const NISVariant& variant,
+                    ShaderCache* shaderCache,
+                    NISHDRMode hdrMode = NISHDRMode::None,
+                    uint32_t sampleCount = 1,
+                    const float* sampleWeights = nullptr);
+
+        // Update the constants of the shader for a batch slot. This is a no-op when nothing changed. The output regions
+        // of the views must not overlap. Returns false for invalid views. When sharpening only, the output viewports must
+        // have the same size as the input viewports. With isSrgbOutput, the linear values are encoded to sRGB when they are
+        // written, for an sRGB texture written through a UNORM view.
+        bool update(uint32_t slot,
+                    float sharpness,
+                    const NISView* views,
+                    uint32_t viewCount,
+                    uint32_t inputWidth,
+                    uint32_t inputHeight,
+                    uint32_t outputWidth,
+                    uint32_t outputHeight,
+                    bool isSrgbOutput);
+
+        // Run the shader for the views of a batch slot. The input is a Texture2DArray SRV (Texture2DMSArray when
+        // multisampled), and the output a Texture2DArray UAV.
+        void dispatch(uint32_t slot, ID3D11ShaderResourceView* const* input, ID3D11UnorderedAccessView* const* output);
+
+        bool isUpscaling() const
+        {
+            return m_isUpscaling;
+        }
+
+        const NISVariant& variant() const
+        {
+            return m_variant;
+        }
+
+        uint32_t sampleCount() const
+        {
+            return m_sampleCount;
+        }
+
+    private:
+        // The layout of the constant buffer of the shader: the constants of each view, then its input and output slices
+        // and whether its output is encoded to sRGB.
+        struct Constants
+        {
+            NISConfig configs[MaxViews];
+            uint32_t slices[MaxViews][4];
+        };
+
+        // The constants of a batch slot, with the parameters of its last update().
+        struct BatchSlot
+        {
+            Microsoft::WRL::ComPtr<ID3D11Buffer> constantBuffer;
+            bool isValid{ false };
+            float sharpness{ 0.f };
+            NISView views[MaxViews]{};
+            uint32_t viewCount{ 0 };
+            uint32_t inputWidth{ 0 };
+            uint32_t inputHeight{ 0 };
+            uint32_t outputWidth{ 0 };
+            uint32_t outputHeight{ 0 };
+            bool isSrgbOutput{ false };
+
+            // The size of the dispatch, covering the largest output viewport.
+            uint32_t maxOutputWidth{ 0 };
+            uint32_t maxOutputHeight{ 0 };
+        };
+
+        DeviceResources& m_deviceResources;
+        const bool m_isUpscaling;
+        const NISVariant m_variant;
+        const NISHDRMode m_hdrMode;
+        const uint32_t m_sampleCount;
+
+        Microsoft::WRL::ComPtr<ID3D11ComputeShader> m_computeShader;
+        Microsoft::WRL::ComPtr<ID3D11Buffer> m_sampleWeightsBuffer;
+        Microsoft::WRL::ComPtr<ID3D11SamplerState> m_linearClampSampler;
+
+        // The filter coefficients, shared by all the scalers on the device.
+        std::shared_ptr<NISCoefficients> m_coefficients;
+
+        BatchSlot m_slots[MaxViews];
+    };
+}
@@ -0,0 +1,327 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// This file does not use the precompiled header, so it can be shared with the tools.
+
+#include "NISTuning.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+namespace
+{
+    using namespace nis_scaler;
+
+    // The GPU families, from the most specific. The parameters follow the NISOptimizer from the SDK. The sharpen-only
+    // variant of the shader always uses 32x32 blocks.
+    struct GpuFamily
+    {
+        uint32_t vendorId;
+        uint32_t minDeviceId;
+        const char* name;
+        uint32_t blockHeight; // When upscaling.
+        uint32_t threadGroupSize;
+        bool isHalfPrecision;
+    };
+
+    const GpuFamily GpuFamilies[] = {
+        // Turing and later have fast FP16 math (NVIDIA_Generic_fp16).
+        { 0x10de, 0x1e00, "NVIDIA Turing or later", 32, 128, true },
+        { 0x10de, 0, "NVIDIA", 24, 128, false },
+        { 0x1002, 0, "AMD", 24, 256, false },
+        { 0x8086, 0, "Intel", 24, 256, false },
+    };
+
+    // The parameters supported by the shader.
+    const uint32_t BlockWidth = 32;
+    const uint32_t ScalerBlockHeights[] = { 24, 32 };
+    const uint32_t SharpenBlockHeight = 32;
+    const uint32_t ThreadGroupSizes[] = { 128, 256 };
+
+    // The minimum number of samples to consider a variant, and how much faster than the default a variant must be.
+    const size_t MinTimingSamples = 8;
+    const float SelectionMargin = 0.03f;
+
+    const GpuFamily* FindGpuFamily(const NISAdapterInfo& adapter)
+    {
+        for (const GpuFamily& family : GpuFamilies)
+        {
+            if (adapter.vendorId == family.vendorId && adapter.deviceId >= family.minDeviceId)
+            {
+                return &family;
+            }
+        }
+        return nullptr;
+    }
+
+    bool IsSupportedVariant(const NISVariant& variant, const bool isUpscaling)
+    {
+        const std::vector<NISVariant> candidates = GetNISCandidateVariants({}, isUpscaling);
+        return std::find(candidates.begin(), candidates.end(), variant) != candidates.end();
+    }
+
+    bool ParseDriverVersion(const std::string& str, uint64_t& driverVersion)
+    {
+        unsigned int parts[4];
+        char end;
+        if (std::sscanf(str.c_str(), "%u.%u.%u.%u%c", &parts[0], &parts[1], &parts[2], &parts[3], &end) != 4)
+        {
+            return false;
+        }
+
+        driverVersion = 0;
+        for (const unsigned int part : parts)
+        {
+            if (part > 0xffff)
+            {
+                return false;
+            }
+            driverVersion = (driverVersion << 16) | part;
+        }
+        return true;
+    }
+
+    bool ParseVariant(const std::string& str, NISVariant& variant)
+    {
+        unsigned int blockWidth, blockHeight, threadGroupSize, precision;
+        char end;
+        if (std::sscanf(str.c_str(), "%ux%u/%u/fp%u%c", &blockWidth, &blockHeight, &threadGroupSize, &precision, &end) != 4 ||
+            (precision != 16 && precision != 32))
+        {
+            return false;
+        }
+
+        variant.blockWidth = blockWidth;
+        variant.blockHeight = blockHeight;
+        variant.threadGroupSize = threadGroupSize;
+        variant.isHalfPrecision = precision == 16;
+        return true;
+    }
+
+    float Median(std::vector<float> samples)
+    {
+        const auto middle = samples.begin() + samples.size() / 2;
+        std::nth_element(samples.begin(), middle, samples.end());
+        return *middle;
+    }
+}
+
+namespace nis_scaler
+{
+    std::string NISVariant::describe() const
+    {
+        return std::to_string(blockWidth) + "x" + std::to_string(blockHeight) + "/" + std::to_string(threadGroupSize) +
+               (isHalfPrecision ? "/fp16" : "/fp32");
+    }
+
+    std::string DescribeDriverVersion(const uint64_t driverVersion)
+    {
+        return std::to_string((driverVersion >> 48) & 0xffff) + "." + std::to_string((driverVersion >> 32) & 0xffff) + "." +
+               std::to_string((driverVersion >> 16) & 0xffff) + "." + std::to_string(driverVersion & 0xffff);
+    }
+
+    const char* GetNISGpuFamily(const NISAdapterInfo& adapter)
+    {
+        const GpuFamily* const family = FindGpuFamily(adapter);
+        return family ? family->name : "unknown";
+    }
+
+    NISVariant GetDefaultNISVariant(const NISAdapterInfo& adapter, const bool isUpscaling)
+    {
+        // Unknown GPUs use the defaults of the SDK (NVIDIA_Generic).
+        NISVariant variant;
+        if (const GpuFamily* const family = FindGpuFamily(adapter))
+        {
+            variant.blockHeight = family->blockHeight;
+            variant.threadGroupSize = family->threadGroupSize;
+            variant.isHalfPrecision = family->isHalfPrecision;
+        }
+        variant.blockWidth = BlockWidth;
+        if (!isUpscaling)
+        {
+            variant.blockHeight = SharpenBlockHeight;
+        }
+        return variant;
+    }
+
+    std::vector<NISVariant> GetNISCandidateVariants(const NISAdapterInfo& adapter, const bool isUpscaling)
+    {
+        std::vector<NISVariant> variants;
+        variants.push_back(GetDefaultNISVariant(adapter, isUpscaling));
+        for (const uint32_t blockHeight : ScalerBlockHeights)
+        {
+            if (!isUpscaling && blockHeight != SharpenBlockHeight)
+            {
+                continue;
+            }
+            for (const uint32_t threadGroupSize : ThreadGroupSizes)
+            {
+                for (const bool isHalfPrecision : { false, true })
+                {
+                    const NISVariant variant{ BlockWidth, blockHeight, threadGroupSize, isHalfPrecision };
+                    if (!(variant == variants[0]))
+                    {
+                        variants.push_back(variant);
+                    }
+                }
+            }
+        }
+        return variants;
+    }
+
+    bool SelectNISVariant(const std::vector<NISVariantTiming>& timings, NISVariant& variant, float& medianTime)
+    {
+        const NISVariantTiming* best = nullptr;
+        float bestTime = 0.f;
+        for (const NISVariantTiming& timing : timings)
+        {
+            if (timing.samples.size() < MinTimingSamples)
+            {
+                continue;
+            }
+
+            const float time = Median(timing.samples);
+            if (!best || time < bestTime)
+            {
+                best = &timing;
+                bestTime = time;
+            }
+        }
+        if (!best)
+        {
+            return false;
+        }
+
+        // Keep the default unless the best variant is clearly faster.
+        if (best != &timings[0] && timings[0].samples.size() >= MinTimingSamples)
+        {
+            const float defaultTime = Median(timings[0].samples);
+            if (bestTime > defaultTime * (1.f - SelectionMargin))
+            {
+                best = &timings[0];
+                bestTime = defaultTime;
+            }
+        }
+
+        variant = best->variant;
+        medianTime = bestTime;
+        return true;
+    }
+
+    bool NISTuningDatabase::load(const std::string& path)
+    {
+        m_path = path;
+        m_entries.clear();
+
+        std::ifstream file(path);
+        if (!file)
+        {
+            return false;
+        }
+
+        std::string line;
+        while (std::getline(file, line))
+        {
+            std::istringstream fields(line);
+            std::string ids, driver, mode, variant;
+            Entry entry;
+            if (!(fields >> ids >> driver >> mode >> variant >> entry.medianTime) || (mode != "scaler" && mode != "sharpen"))
+            {
+                continue;
+            }
+
+            unsigned int vendorId, deviceId;
+            char end;
+            entry.isUpscaling = mode == "scaler";
+            if (std::sscanf(ids.c_str(), "%x:%x%c", &vendorId, &deviceId, &end) != 2 || !ParseDriverVersion(driver, entry.driverVersion) ||
+                !ParseVariant(variant, entry.variant) || !IsSupportedVariant(entry.variant, entry.isUpscaling))
+            {
+                continue;
+            }
+            entry.vendorId = vendorId;
+            entry.deviceId = deviceId;
+
+            m_entries.push_back(entry);
+        }
+
+        return true;
+    }
+
+    bool NISTuningDatabase::save() const
+    {
+        if (m_path.empty())
+        {
+            return false;
+        }
+
+        const std::string temporaryPath = m_path + ".tmp";
+        {
+            std::ofstream file(temporaryPath, std::ios_base::trunc);
+            for (const Entry& entry : m_entries)
+            {
+                char ids[32];
+                std::snprintf(ids, sizeof(ids), "%04x:%04x", entry.vendorId, entry.deviceId);
+                char medianTime[32];
+                std::snprintf(medianTime, sizeof(medianTime), "%.1f", entry.medianTime);
+                file << ids << " " << DescribeDriverVersion(entry.driverVersion) << " " << (entry.isUpscaling ? "scaler" : "sharpen") << " "
+                     << entry.variant.describe() << " " << medianTime << "\n";
+            }
+            file.close();
+            if (file.fail())
+            {
+                return false;
+            }
+        }
+
+        std::error_code ec;
+        std::filesystem::rename(temporaryPath, m_path, ec);
+        if (ec)
+        {
+            std::filesystem::remove(temporaryPath, ec);
+            return false;
+        }
+        return true;
+    }
+
+    bool NISTuningDatabase::find(const NISAdapterInfo& adapter, const bool isUpscaling, NISVariant& variant) const
+    {
+        for (const Entry& entry : m_entries)
+        {
+            if (entry.vendorId == adapter.vendorId && entry.deviceId == adapter.deviceId && entry.driverVersion == adapter.driverVersion &&
+                entry.isUpscaling == isUpscaling)
+            {
+                variant = entry.variant;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void NISTuningDatabase::store(const NISAdapterInfo& adapter, const bool isUpscaling, const NISVariant& variant, const float medianTime)
+    {
+        m_entries.erase(std::remove_if(m_entries.begin(),
+                                       m_entries.end(),
+                                       [&](const Entry& entry) {
+                                           return entry.vendorId == adapter.vendorId && entry.deviceId == adapter.deviceId &&
+                                                  entry.isUpscaling == isUpscaling;
+                                       }),
+                        m_entries.end());
+        m_entries.push_back({ adapter.vendorId, adapter.deviceId, adapter.driverVersion, isUpscaling, variant, medianTime });
+    }
+}
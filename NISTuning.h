@@ -0,0 +1,123 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Tuning of the NIS shader for the GPU.
+//
+// The block size, the thread group size and the precision of the NIS shader are picked from a table of GPU families
+// (by PCI vendor and device IDs), which follows the recommendations of the NISOptimizer from the SDK. Optionally, the
+// layer times all the variants of the shader on the first run with a GPU and driver, and persists the fastest one in a
+// tuning database, which is used by the next runs. None of this depends on the graphics API, so that the selection and
+// the persistence can be checked with fake adapters and synthetic timings (see the NISTuningTool).
+
+namespace nis_scaler
+{
+    // The identity of the GPU, from DXGI_ADAPTER_DESC.
+    struct NISAdapterInfo
+    {
+        uint32_t vendorId{ 0 };
+        uint32_t deviceId{ 0 };
+        uint64_t driverVersion{ 0 }; // As returned by IDXGIAdapter::CheckInterfaceSupport().
+        std::string description;
+    };
+
+    // The compile-time parameters of the NIS shader.
+    struct NISVariant
+    {
+        uint32_t blockWidth{ 32 };
+        uint32_t blockHeight{ 24 };
+        uint32_t threadGroupSize{ 128 };
+        bool isHalfPrecision{ false };
+
+        bool operator==(const NISVariant& other) const
+        {
+            return blockWidth == other.blockWidth && blockHeight == other.blockHeight && threadGroupSize == other.threadGroupSize &&
+                   isHalfPrecision == other.isHalfPrecision;
+        }
+
+        // For example "32x24/128/fp32".
+        std::string describe() const;
+    };
+
+    // The GPU times of a variant (in microseconds), one per dispatch.
+    struct NISVariantTiming
+    {
+        NISVariant variant;
+        std::vector<float> samples;
+    };
+
+    // The driver version as "a.b.c.d".
+    std::string DescribeDriverVersion(uint64_t driverVersion);
+
+    // The name of the GPU family used for the defaults, for logging.
+    const char* GetNISGpuFamily(const NISAdapterInfo& adapter);
+
+    // The variant recommended for the GPU family.
+    NISVariant GetDefaultNISVariant(const NISAdapterInfo& adapter, bool isUpscaling);
+
+    // All the variants supported by the shader, starting with the default for the GPU.
+    std::vector<NISVariant> GetNISCandidateVariants(const NISAdapterInfo& adapter, bool isUpscaling);
+
+    // Pick the variant with the lowest median time. The first variant (the default) is the reference: another variant
+    // must be faster by a margin to be picked, so that the noise of the measurements does not make the choice flip
+    // between runs. Variants with too few samples are ignored. Returns false when no variant has enough samples.
+    bool SelectNISVariant(const std::vector<NISVariantTiming>& timings, NISVariant& variant, float& medianTime);
+
+    // The tuning results, stored as text with one line per GPU, driver and mode:
+    //
+    //   10de:2204 30.0.15.1179 scaler 32x32/128/fp16 452.5
+    //
+    // The fields are the PCI vendor and device IDs, the driver version, the mode (scaler or sharpen), the variant and
+    // its median time (in microseconds, for information). The results for a GPU are replaced when the driver changes.
+    class NISTuningDatabase
+    {
+    public:
+        struct Entry
+        {
+            uint32_t vendorId;
+            uint32_t deviceId;
+            uint64_t driverVersion;
+            bool isUpscaling;
+            NISVariant variant;
+            float medianTime;
+        };
+
+        // Read the results from a file. Invalid lines are ignored. Returns false when the file cannot be read.
+        bool load(const std::string& path);
+
+        // Write the results to the file they were loaded from. The file is replaced atomically.
+        bool save() const;
+
+        bool find(const NISAdapterInfo& adapter, bool isUpscaling, NISVariant& variant) const;
+
+        // Record the result for a GPU, driver and mode, replacing the previous results for the GPU and mode.
+        void store(const NISAdapterInfo& adapter, bool isUpscaling, const NISVariant& variant, float medianTime);
+
+        const std::vector<Entry>& entries() const
+        {
+            return m_entries;
+        }
+
+    private:
+        std::string m_path;
+        std::vector<Entry> m_entries;
+    };
+}
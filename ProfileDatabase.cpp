@@ -0,0 +1,778 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// This file does not use the precompiled header, so it can be shared with the tools.
+
+#include "ProfileDatabase.h"
+
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <sstream>
+
+#include "Log.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    using namespace nis_scaler;
+
+    char ToLower(const char c)
+    {
+        return (char)std::tolower((unsigned char)c);
+    }
+
+    // FNV-1a of the lowercase string.
+    uint32_t HashName(const char* str)
+    {
+        uint32_t hash = 2166136261u;
+        for (; *str; str++)
+        {
+            hash ^= (uint8_t)ToLower(*str);
+            hash *= 16777619u;
+        }
+        return hash;
+    }
+
+    bool EqualsIgnoreCase(const char* a, const char* b)
+    {
+        for (; *a && *b; a++, b++)
+        {
+            if (ToLower(*a) != ToLower(*b))
+            {
+                return false;
+            }
+        }
+        return *a == *b;
+    }
+
+    bool HasWildcards(const std::string& pattern)
+    {
+        return pattern.find_first_of("*?") != std::string::npos;
+    }
+
+    std::string Trim(const std::string& str)
+    {
+        const size_t first = str.find_first_not_of(" \t\r\n");
+        if (first == std::string::npos)
+        {
+            return "";
+        }
+        const size_t last = str.find_last_not_of(" \t\r\n");
+        return str.substr(first, last - first + 1);
+    }
+
+    bool ParseInteger(const std::string& str, long long& value)
+    {
+        if (str.empty())
+        {
+            return false;
+        }
+        char* end;
+        value = std::strtoll(str.c_str(), &end, 0);
+        return !*end;
+    }
+
+    struct SourceProfile
+    {
+        int line;
+        std::string application;
+        std::string gpu;
+        uint32_t vendorId{ 0 };
+        uint32_t minWidth{ 0 };
+        uint32_t minHeight{ 0 };
+        std::vector<std::pair<std::string, int>> settings;
+
+        bool isQualified() const
+        {
+            return !gpu.empty() || vendorId || minWidth || minHeight;
+        }
+
+        std::string key() const
+        {
+            std::string lowercase = application + "|" + gpu + "|" + std::to_string(vendorId) + "|" +
+                std::to_string(minWidth) + "x" + std::to_string(minHeight);
+            for (char& c : lowercase)
+            {
+                c = ToLower(c);
+            }
+            return lowercase;
+        }
+    };
+
+    class StringTable
+    {
+    public:
+        uint32_t add(const std::string& str)
+        {
+            const auto it = m_offsets.find(str);
+            if (it != m_offsets.cend())
+            {
+                return it->second;
+            }
+            const uint32_t offset = (uint32_t)m_data.size();
+            m_data.insert(m_data.end(), str.cbegin(), str.cend());
+            m_data.push_back(0);
+            m_offsets.insert_or_assign(str, offset);
+            return offset;
+        }
+
+        const std::vector<char>& data() const
+        {
+            return m_data;
+        }
+
+    private:
+        std::vector<char> m_data;
+        std::map<std::string, uint32_t> m_offsets;
+    };
+
+    template <typename T>
+    uint32_t Append(std::vector<uint8_t>& database, const T* data, size_t count)
+    {
+        const uint32_t offset = (uint32_t)database.size();
+        const size_t size = sizeof(T) * count;
+        database.resize(database.size() + size);
+        if (size)
+        {
+            std::memcpy(database.data() + offset, data, size);
+        }
+        return offset;
+    }
+}
+
+namespace nis_scaler
+{
+    bool MatchPattern(const char* pattern, const char* str)
+    {
+        // Greedy matching, backtracking to the last star on a mismatch.
+        const char* starPattern = nullptr;
+        const char* starStr = nullptr;
+        while (*str)
+        {
+            if (*pattern == '*')
+            {
+                starPattern = ++pattern;
+                starStr = str;
+            }
+            else if (*pattern == '?' || (*pattern && ToLower(*pattern) == ToLower(*str)))
+            {
+                pattern++;
+                str++;
+            }
+            else if (starPattern)
+            {
+                pattern = starPattern;
+                str = ++starStr;
+            }
+            else
+            {
+                return false;
+            }
+        }
+        while (*pattern == '*')
+        {
+            pattern++;
+        }
+        return !*pattern;
+    }
+
+    bool CompileProfiles(const std::string& source, std::vector<uint8_t>& database, std::string& errors)
+    {
+        std::ostringstream errorStream;
+
+        // Parse the source. The global profile is implicit.
+        std::vector<SourceProfile> profiles(1);
+        profiles[0].line = 0;
+        profiles[0].application = "*";
+
+        std::map<std::string, int> profileKeys;
+        std::istringstream stream(source);
+        std::string line;
+        int lineNumber = 0;
+        while (std::getline(stream, line))
+        {
+            lineNumber++;
+
+            const size_t comment = line.find('#');
+            if (comment != std::string::npos)
+            {
+                line.resize(comment);
+            }
+            line = Trim(line);
+            if (line.empty())
+            {
+                continue;
+            }
+
+            if (line.front() == '[')
+            {
+                if (line.back() != ']')
+                {
+                    errorStream << "line " << lineNumber << ": unterminated profile header\n";
+                    continue;
+                }
+
+                SourceProfile profile;
+                profile.line = lineNumber;
+
+                std::istringstream fields(line.substr(1, line.size() - 2));
+                std::string field;
+                bool isFirst = true;
+                while (std::getline(fields, field, '|'))
+                {
+                    field = Trim(field);
+                    if (isFirst)
+                    {
+                        profile.application = field;
+                        isFirst = false;
+                        continue;
+                    }
+
+                    const size_t separator = field.find('=');
+                    const std::string name = Trim(field.substr(0, separator));
+                    const std::string value = separator != std::string::npos ? Trim(field.substr(separator + 1)) : "";
+                    long long number;
+                    unsigned int width, height;
+                    char trailing;
+                    if (name == "gpu" && !value.empty())
+                    {
+                        profile.gpu = value;
+                    }
+                    else if (name == "vendor" && ParseInteger(value, number) && number > 0 && number <= 0xffff)
+                    {
+                        profile.vendorId = (uint32_t)number;
+                    }
+                    else if (name == "resolution" && std::sscanf(value.c_str(), "%ux%u%c", &width, &height, &trailing) == 2 && width && height)
+                    {
+                        profile.minWidth = width;
+                        profile.minHeight = height;
+                    }
+                    else
+                    {
+                        errorStream << "line " << lineNumber << ": invalid qualifier \"" << field << "\"\n";
+                    }
+                }
+
+                if (profile.application.empty())
+                {
+                    errorStream << "line " << lineNumber << ": missing application name\n";
+                    continue;
+                }
+
+                const auto previous = profileKeys.find(profile.key());
+                if (previous != profileKeys.cend())
+                {
+                    errorStream << "line " << lineNumber << ": duplicate profile (first defined at line " << previous->second << ")\n";
+                    continue;
+                }
+                profileKeys.insert_or_assign(profile.key(), lineNumber);
+
+                profiles.push_back(std::move(profile));
+                continue;
+            }
+
+            const size_t separator = line.find('=');
+            if (separator == std::string::npos)
+            {
+                errorStream << "line " << lineNumber << ": expected \"name=value\"\n";
+                continue;
+            }
+            const std::string name = Trim(line.substr(0, separator));
+            long long value = 0;
+            if (!ParseInteger(Trim(line.substr(separator + 1)), value) || value < INT32_MIN || value > INT32_MAX)
+            {
+                errorStream << "line " << lineNumber << ": invalid value for \"" << name << "\"\n";
+                continue;
+            }
+
+            SourceProfile& profile = profiles.back();
+            if (name == "enabled")
+            {
+                // The layer is enabled when the instance is created, before the GPU and the display are known.
+                if (profile.isQualified())
+                {
+                    errorStream << "line " << lineNumber << ": \"enabled\" cannot be set in a qualified profile\n";
+                    continue;
+                }
+            }
+            else
+            {
+                Config probe;
+                probe.Reset();
+                if (!ApplySetting(probe, name, (int)value))
+                {
+                    errorStream << "line " << lineNumber << ": unknown setting \"" << name << "\"\n";
+                    continue;
+                }
+            }
+
+            bool isDuplicate = false;
+            for (const auto& setting : profile.settings)
+            {
+                isDuplicate = isDuplicate || setting.first == name;
+            }
+            if (isDuplicate)
+            {
+                errorStream << "line " << lineNumber << ": duplicate setting \"" << name << "\"\n";
+                continue;
+            }
+
+            profile.settings.push_back(std::make_pair(name, (int)value));
+        }
+
+        errors = errorStream.str();
+        if (!errors.empty())
+        {
+            return false;
+        }
+
+        // Build the records.
+        StringTable strings;
+        std::vector<ProfileRecord> profileRecords;
+        std::vector<ProfileSettingRecord> settingRecords;
+        std::vector<uint32_t> wildcards;
+        std::map<std::string, uint32_t> lastProfileForApplication;
+        std::map<std::string, uint32_t> firstProfileForApplication;
+        for (const SourceProfile& profile : profiles)
+        {
+            const uint32_t index = (uint32_t)profileRecords.size();
+
+            ProfileRecord record{};
+            record.application = strings.add(profile.application);
+            record.gpu = profile.gpu.empty() ? ProfileNone : strings.add(profile.gpu);
+            record.vendorId = profile.vendorId;
+            record.minWidth = profile.minWidth;
+            record.minHeight = profile.minHeight;
+            record.firstSetting = (uint32_t)settingRecords.size();
+            record.settingCount = (uint32_t)profile.settings.size();
+            record.nextSameApplication = ProfileNone;
+            for (const auto& setting : profile.settings)
+            {
+                settingRecords.push_back({ strings.add(setting.first), setting.second });
+            }
+            profileRecords.push_back(record);
+
+            if (HasWildcards(profile.application))
+            {
+                wildcards.push_back(index);
+                continue;
+            }
+
+            // Chain the profiles for the same application, in the order of the source.
+            std::string lowercase = profile.application;
+            for (char& c : lowercase)
+            {
+                c = ToLower(c);
+            }
+            const auto last = lastProfileForApplication.find(lowercase);
+            if (last != lastProfileForApplication.cend())
+            {
+                profileRecords[last->second].nextSameApplication = index;
+            }
+            else
+            {
+                firstProfileForApplication.insert_or_assign(lowercase, index);
+            }
+            lastProfileForApplication.insert_or_assign(lowercase, index);
+        }
+
+        // Keep the load factor at or below 1/2.
+        uint32_t indexCapacity = 2;
+        while (indexCapacity < 2 * firstProfileForApplication.size())
+        {
+            indexCapacity *= 2;
+        }
+        std::vector<ProfileIndexEntry> index(indexCapacity, ProfileIndexEntry{ 0, ProfileNone });
+        for (const auto& application : firstProfileForApplication)
+        {
+            const uint32_t hash = HashName(application.first.c_str());
+            uint32_t slot = hash & (indexCapacity - 1);
+            while (index[slot].profile != ProfileNone)
+            {
+                slot = (slot + 1) & (indexCapacity - 1);
+            }
+            index[slot] = { hash, application.second };
+        }
+
+        // Serialize.
+        database.clear();
+        ProfileDatabaseHeader header{};
+        Append(database, &header, 1);
+        header.magic = ProfileDatabaseMagic;
+        header.version = ProfileDatabaseVersion;
+        header.profileCount = (uint32_t)profileRecords.size();
+        header.profilesOffset = Append(database, profileRecords.data(), profileRecords.size());
+        header.settingCount = (uint32_t)settingRecords.size();
+        header.settingsOffset = Append(database, settingRecords.data(), settingRecords.size());
+        header.wildcardCount = (uint32_t)wildcards.size();
+        header.wildcardsOffset = Append(database, wildcards.data(), wildcards.size());
+        header.indexCapacity = indexCapacity;
+        header.indexOffset = Append(database, index.data(), index.size());
+        header.stringsSize = (uint32_t)strings.data().size();
+        header.stringsOffset = Append(database, strings.data().data(), strings.data().size());
+        header.size = (uint32_t)database.size();
+        std::memcpy(database.data(), &header, sizeof(header));
+
+        return true;
+    }
+
+    ProfileDatabase::~ProfileDatabase()
+    {
+        close();
+    }
+
+#ifdef _WIN32
+    bool ProfileDatabase::open(const std::string& path)
+    {
+        close();
+
+        const HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+        {
+            return false;
+        }
+        m_file = file;
+
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file, &size) || size.QuadPart < (LONGLONG)sizeof(ProfileDatabaseHeader))
+        {
+            close();
+            return false;
+        }
+
+        m_mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        const void* const data = m_mapping ? MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+        if (!data)
+        {
+            close();
+            return false;
+        }
+        m_data = static_cast<const uint8_t*>(data);
+        m_size = (size_t)size.QuadPart;
+
+        if (!validate(m_size))
+        {
+            close();
+            return false;
+        }
+
+        return true;
+    }
+
+    void ProfileDatabase::close()
+    {
+        if (m_mapping)
+        {
+            if (m_data)
+            {
+                UnmapViewOfFile(m_data);
+            }
+            CloseHandle(m_mapping);
+        }
+        if (m_file)
+        {
+            CloseHandle(m_file);
+        }
+        m_file = m_mapping = nullptr;
+        m_data = nullptr;
+        m_size = 0;
+        m_header = nullptr;
+    }
+#else
+    bool ProfileDatabase::open(const std::string& path)
+    {
+        close();
+
+        const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            return false;
+        }
+
+        struct stat st;
+        void* data = MAP_FAILED;
+        if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(ProfileDatabaseHeader))
+        {
+            data = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        }
+        ::close(fd);
+        if (data == MAP_FAILED)
+        {
+            return false;
+        }
+        m_mapping = data;
+        m_data = static_cast<const uint8_t*>(data);
+        m_size = (size_t)st.st_size;
+
+        if (!validate(m_size))
+        {
+            close();
+            return false;
+        }
+
+        return true;
+    }
+
+    void ProfileDatabase::close()
+    {
+        if (m_mapping)
+        {
+            munmap(m_mapping, m_size);
+        }
+        m_file = m_mapping = nullptr;
+        m_data = nullptr;
+        m_size = 0;
+        m_header = nullptr;
+    }
+#endif
+
+    bool ProfileDatabase::open(const uint8_t* data, const size_t size)
+    {
+        close();
+
+        m_data = data;
+        if (!validate(size))
+        {
+            m_data = nullptr;
+            return false;
+        }
+
+        return true;
+    }
+
+    bool ProfileDatabase::validate(const size_t size)
+    {
+        if (size < sizeof(ProfileDatabaseHeader) || (uintptr_t)m_data % alignof(ProfileDatabaseHeader))
+        {
+            return false;
+        }
+
+        const ProfileDatabaseHeader* const header = reinterpret_cast<const ProfileDatabaseHeader*>(m_data);
+        const auto isInBounds = [&](const uint32_t offset, const uint32_t count, const size_t elementSize) {
+            return offset % 4 == 0 && (uint64_t)offset + (uint64_t)count * elementSize <= size;
+        };
+        if (header->magic != ProfileDatabaseMagic || header->version != ProfileDatabaseVersion || header->size != size ||
+            !isInBounds(header->profilesOffset, header->profileCount, sizeof(ProfileRecord)) ||
+            !isInBounds(header->settingsOffset, header->settingCount, sizeof(ProfileSettingRecord)) ||
+            !isInBounds(header->wildcardsOffset, header->wildcardCount, sizeof(uint32_t)) ||
+            !isInBounds(header->indexOffset, header->indexCapacity, sizeof(ProfileIndexEntry)) ||
+            header->indexCapacity == 0 || (header->indexCapacity & (header->indexCapacity - 1)) ||
+            header->stringsSize == 0 || (uint64_t)header->stringsOffset + header->stringsSize > size ||
+            m_data[header->stringsOffset + header->stringsSize - 1] != 0)
+        {
+            return false;
+        }
+
+        m_header = header;
+        m_profiles = reinterpret_cast<const ProfileRecord*>(m_data + header->profilesOffset);
+        m_settings = reinterpret_cast<const ProfileSettingRecord*>(m_data + header->settingsOffset);
+        m_wildcards = reinterpret_cast<const uint32_t*>(m_data + header->wildcardsOffset);
+        m_index = reinterpret_cast<const ProfileIndexEntry*>(m_data + header->indexOffset);
+        m_strings = reinterpret_cast<const char*>(m_data + header->stringsOffset);
+        m_size = size;
+
+        // Check the references once, so that lookups do not need to.
+        bool isValid = true;
+        for (uint32_t i = 0; i < header->profileCount; i++)
+        {
+            const ProfileRecord& profile = m_profiles[i];
+            isValid = isValid && profile.application < header->stringsSize &&
+                (profile.gpu == ProfileNone || profile.gpu < header->stringsSize) &&
+                (uint64_t)profile.firstSetting + profile.settingCount <= header->settingCount &&
+                (profile.nextSameApplication == ProfileNone || (profile.nextSameApplication > i && profile.nextSameApplication < header->profileCount));
+        }
+        for (uint32_t i = 0; i < header->settingCount; i++)
+        {
+            isValid = isValid && m_settings[i].name < header->stringsSize;
+        }
+        for (uint32_t i = 0; i < header->wildcardCount; i++)
+        {
+            isValid = isValid && m_wildcards[i] < header->profileCount;
+        }
+        for (uint32_t i = 0; i < header->indexCapacity; i++)
+        {
+            isValid = isValid && (m_index[i].profile == ProfileNone || m_index[i].profile < header->profileCount);
+        }
+        if (!isValid)
+        {
+            m_header = nullptr;
+        }
+
+        return isValid;
+    }
+
+    const char* ProfileDatabase::string(const uint32_t offset) const
+    {
+        return m_strings + offset;
+    }
+
+    bool ProfileDatabase::matches(const ProfileRecord& profile, const ProfileQuery& query) const
+    {
+        if (profile.gpu != ProfileNone && (query.gpu.empty() || !MatchPattern(string(profile.gpu), query.gpu.c_str())))
+        {
+            return false;
+        }
+        if (profile.vendorId && profile.vendorId != query.vendorId)
+        {
+            return false;
+        }
+        if ((profile.minWidth || profile.minHeight) &&
+            (!query.width || query.width < profile.minWidth || query.height < profile.minHeight))
+        {
+            return false;
+        }
+        return true;
+    }
+
+    void ProfileDatabase::apply(const ProfileRecord& profile, Config& config, int& enabled) const
+    {
+        for (uint32_t i = 0; i < profile.settingCount; i++)
+        {
+            const ProfileSettingRecord& setting = m_settings[profile.firstSetting + i];
+            const char* const name = string(setting.name);
+            if (!std::strcmp(name, "enabled"))
+            {
+                enabled = setting.value;
+            }
+            else
+            {
+                ApplySetting(config, name, setting.value);
+            }
+        }
+    }
+
+    bool ProfileDatabase::resolve(const ProfileQuery& query, Config& config) const
+    {
+        if (!m_header || query.application.empty())
+        {
+            return false;
+        }
+
+        const auto isQualified = [](const ProfileRecord& profile) {
+            return profile.gpu != ProfileNone || profile.vendorId || profile.minWidth || profile.minHeight;
+        };
+
+        int enabled = 0;
+
+        // The global and wildcard profiles.
+        for (const bool qualified : { false, true })
+        {
+            for (uint32_t i = 0; i < m_header->wildcardCount; i++)
+            {
+                const ProfileRecord& profile = m_profiles[m_wildcards[i]];
+                if (isQualified(profile) == qualified && MatchPattern(string(profile.application), query.application.c_str()) &&
+                    matches(profile, query))
+                {
+                    apply(profile, config, enabled);
+                }
+            }
+        }
+
+        // The profiles for the exact application name.
+        const uint32_t hash = HashName(query.application.c_str());
+        const uint32_t mask = m_header->indexCapacity - 1;
+        uint32_t first = ProfileNone;
+        for (uint32_t slot = hash & mask, probes = 0; probes <= mask; slot = (slot + 1) & mask, probes++)
+        {
+            const ProfileIndexEntry& entry = m_index[slot];
+            if (entry.profile == ProfileNone)
+            {
+                break;
+            }
+            if (entry.hash == hash && EqualsIgnoreCase(string(m_profiles[entry.profile].application), query.application.c_str()))
+            {
+                first = entry.profile;
+                break;
+            }
+        }
+        for (const bool qualified : { false, true })
+        {
+            for (uint32_t i = first; i != ProfileNone; i = m_profiles[i].nextSameApplication)
+            {
+                const ProfileRecord& profile = m_profiles[i];
+                if (isQualified(profile) == qualified && matches(profile, query))
+                {
+                    apply(profile, config, enabled);
+                }
+            }
+        }
+
+        if (enabled != 1)
+        {
+            return false;
+        }
+
+        config.name = query.application;
+        config.loaded = true;
+
+        return true;
+    }
+
+    ProfileConfigSource::ProfileConfigSource(const std::string& path, const ProfileQuery& query)
+        : m_path(path), m_query(query), m_watcher(path)
+    {
+    }
+
+    bool ProfileConfigSource::load(const std::string& applicationName, Config& config)
+    {
+        ProfileDatabase database;
+        if (!database.open(m_path))
+        {
+            Log("Failed to open the profile database \"%s\"\n", m_path.c_str());
+            return false;
+        }
+
+        m_query.application = applicationName;
+        if (!database.resolve(m_query, config))
+        {
+            // We always want to display this message so the log will contain the OpenXR application name.
+            Log("Did not find a profile for \"%s\"\n", applicationName.c_str());
+            return false;
+        }
+
+        Log("Loading profile for \"%s\"\n", applicationName.c_str());
+
+        return true;
+    }
+
+    bool ProfileConfigSource::waitForChange(const std::chrono::milliseconds timeout)
+    {
+        return m_watcher.waitForChange(timeout);
+    }
+
+    void ProfileConfigSource::wake()
+    {
+        m_watcher.wake();
+    }
+
+    bool ProfileConfigSource::readValue(const std::string& /* scope */, const std::string& /* name */, int& /* value */)
+    {
+        // Profiles are resolved as a whole in load().
+        return false;
+    }
+}
@@ -0,0 +1,183 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Config.h"
+
+// Per-application profiles.
+//
+// Profiles are written as text, then compiled into a compact binary database that the layer maps in memory. The text
+// format is:
+//
+//   # The global profile (lines before the first header).
+//   enabled=1
+//   scaling=70
+//
+//   [Flight*]                          # Applications matching a pattern ('*' and '?' wildcards).
+//   sharpness=40
+//
+//   [FS2020 | gpu=*RTX 30* | resolution=2000x2000]
+//   scaling=80
+//
+// Headers take an application name pattern, optionally followed by qualifiers: "gpu" (a pattern on the adapter
+// description), "vendor" (the PCI vendor ID) and "resolution" (the minimum display resolution per eye). Patterns are
+// case-insensitive.
+//
+// Every profile inherits from the less specific ones: the settings are applied from the global profile, then the
+// matching wildcard profiles, then the profile for the exact application name. At each level, profiles without
+// qualifiers are applied before the qualified ones, and otherwise in the order of the source.
+
+namespace nis_scaler
+{
+    constexpr uint32_t ProfileDatabaseMagic = 0x5053494e; // 'NISP'
+    constexpr uint32_t ProfileDatabaseVersion = 1;
+    constexpr uint32_t ProfileNone = ~0u;
+
+    // All offsets are in bytes from the beginning of the database, except string offsets which are from the beginning
+    // of the string table.
+    struct ProfileDatabaseHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t size;
+        uint32_t profilesOffset;
+        uint32_t profileCount;
+        uint32_t settingsOffset;
+        uint32_t settingCount;
+        uint32_t wildcardsOffset;
+        uint32_t wildcardCount;
+        uint32_t indexOffset;
+        uint32_t indexCapacity; // A power of two.
+        uint32_t stringsOffset;
+        uint32_t stringsSize;
+    };
+
+    struct ProfileRecord
+    {
+        uint32_t application; // String offset.
+        uint32_t gpu;         // String offset, or ProfileNone.
+        uint32_t vendorId;    // 0 for any.
+        uint32_t minWidth;
+        uint32_t minHeight;
+        uint32_t firstSetting;
+        uint32_t settingCount;
+        uint32_t nextSameApplication; // Profile index, or ProfileNone.
+    };
+
+    struct ProfileSettingRecord
+    {
+        uint32_t name; // String offset.
+        int32_t value;
+    };
+
+    // Index of the profiles for exact application names, hashed by their lowercase name with open addressing.
+    struct ProfileIndexEntry
+    {
+        uint32_t hash;
+        uint32_t profile; // First profile for the application, or ProfileNone for an empty entry.
+    };
+
+    // What the profiles are matched against. Unknown properties (empty GPU, 0 vendor or resolution) never satisfy a
+    // qualifier.
+    struct ProfileQuery
+    {
+        std::string application;
+        std::string gpu;
+        uint32_t vendorId{ 0 };
+        uint32_t width{ 0 };
+        uint32_t height{ 0 };
+    };
+
+    // Compile profiles from their text form. Returns false and fills the errors (one per line) if the source is invalid.
+    bool CompileProfiles(const std::string& source, std::vector<uint8_t>& database, std::string& errors);
+
+    // Case-insensitive matching with '*' and '?' wildcards.
+    bool MatchPattern(const char* pattern, const char* str);
+
+    // A compiled database, mapped in memory.
+    class ProfileDatabase
+    {
+    public:
+        ProfileDatabase() = default;
+        ProfileDatabase(const ProfileDatabase&) = delete;
+        ProfileDatabase& operator=(const ProfileDatabase&) = delete;
+        ~ProfileDatabase();
+
+        bool open(const std::string& path);
+
+        // Use a database already in memory. The memory must outlive the object.
+        bool open(const uint8_t* data, size_t size);
+
+        void close();
+
+        bool isOpen() const
+        {
+            return m_header != nullptr;
+        }
+
+        // Apply the settings of all the profiles matching the query. Returns whether the layer is enabled.
+        bool resolve(const ProfileQuery& query, Config& config) const;
+
+        uint32_t profileCount() const
+        {
+            return m_header ? m_header->profileCount : 0;
+        }
+
+    private:
+        bool validate(size_t size);
+        const char* string(uint32_t offset) const;
+        bool matches(const ProfileRecord& profile, const ProfileQuery& query) const;
+        void apply(const ProfileRecord& profile, Config& config, int& enabled) const;
+
+        void* m_file{ nullptr };
+        void* m_mapping{ nullptr };
+        const uint8_t* m_data{ nullptr };
+        size_t m_size{ 0 };
+
+        const ProfileDatabaseHeader* m_header{ nullptr };
+        const ProfileRecord* m_profiles{ nullptr };
+        const ProfileSettingRecord* m_settings{ nullptr };
+        const uint32_t* m_wildcards{ nullptr };
+        const ProfileIndexEntry* m_index{ nullptr };
+        const char* m_strings{ nullptr };
+    };
+
+    // Load the settings from a compiled profile database. The database is only mapped while loading, so that it can
+    // be replaced while the application is running.
+    class ProfileConfigSource : public ConfigSource
+    {
+    public:
+        ProfileConfigSource(const std::string& path, const ProfileQuery& query);
+
+        bool load(const std::string& applicationName, Config& config) override;
+        bool waitForChange(std::chrono::milliseconds timeout) override;
+        void wake() override;
+
+    protected:
+        bool readValue(const std::string& scope, const std::string& name, int& value) override;
+
+    private:
+        const std::string m_path;
+        ProfileQuery m_query;
+        FileWatcher m_watcher;
+    };
+}
@@ -0,0 +1,66 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+#include <tuple>
+
+#include "MsaaResolve.h"
+#include "NISTuning.h"
+
+namespace nis_scaler
+{
+    // The keys of the scalers shared by the swapchains with the same settings (see SharedCache.h). The device is a
+    // template parameter, so that the ScalerSharing tool checks the same keys without Direct3D.
+
+    // The NIS scaler is keyed on the mode (upscaling or sharpening only), on the variant of the shader (block size,
+    // thread group size, precision), on the HDR mode (a NISHDRMode) for the float formats, and like the bilinear scalers
+    // on the sample count and the resolve filter of a multisampled input. The viewports are set with each dispatch, so
+    // the sizes are not part of the key.
+    template <typename Device>
+    using NISScalerKey = std::tuple<Device*, bool, uint32_t, uint32_t, uint32_t, bool, uint32_t, uint32_t, MsaaResolveFilter>;
+
+    template <typename Device>
+    NISScalerKey<Device> MakeNISScalerKey(Device* const device,
+                                          const bool isUpscaling,
+                                          const NISVariant& variant,
+                                          const uint32_t hdrMode,
+                                          const uint32_t sampleCount,
+                                          const MsaaResolveFilter resolveFilter)
+    {
+        return { device, isUpscaling, variant.blockWidth, variant.blockHeight, variant.threadGroupSize, variant.isHalfPrecision, hdrMode,
+                 sampleCount, resolveFilter };
+    }
+
+    // The filter coefficients of the NIS scaler do not depend on the variant of the shader nor on the viewports.
+    template <typename Device>
+    using NISCoefficientsKey = Device*;
+
+    // The periphery scalers are keyed on the sample count and the resolve filter.
+    template <typename Device>
+    using BilinearScalerKey = std::tuple<Device*, uint32_t, MsaaResolveFilter>;
+
+    template <typename Device>
+    BilinearScalerKey<Device> MakeBilinearScalerKey(Device* const device, const uint32_t sampleCount, const MsaaResolveFilter resolveFilter)
+    {
+        return { device, sampleCount, resolveFilter };
+    }
+
+    // The depth scaler is keyed on the sample count.
+    template <typename Device>
+    using DepthScalerKey = std::tuple<Device*, uint32_t>;
+}
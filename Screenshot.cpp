@@ -0,0 +1,1431 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// This file does not use the precompiled header, so it can be shared with the tools.
+
+#include "Screenshot.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#include "ColorFormats.h"
+#include "Log.h"
+
+namespace
+{
+    using namespace nis_scaler;
+
+    // The DXGI formats we know how to save.
+    enum : uint32_t
+    {
+        FormatR32G32B32A32Float = 2,
+        FormatR16G16B16A16Typeless = 9,
+        FormatR16G16B16A16Float = 10,
+        FormatR16G16B16A16Unorm = 11,
+        FormatR10G10B10A2Typeless = 23,
+        FormatR10G10B10A2Unorm = 24,
+        FormatR11G11B10Float = 26,
+        FormatR8G8B8A8Typeless = 27,
+        FormatR8G8B8A8Unorm = 28,
+        FormatR8G8B8A8UnormSrgb = 29,
+        FormatB8G8R8A8Unorm = 87,
+        FormatB8G8R8X8Unorm = 88,
+        FormatB8G8R8A8Typeless = 90,
+        FormatB8G8R8A8UnormSrgb = 91,
+        FormatB8G8R8X8Typeless = 92,
+        FormatB8G8R8X8UnormSrgb = 93,
+    };
+
+    void Put32BE(std::vector<uint8_t>& output, const uint32_t value)
+    {
+        output.push_back((uint8_t)(value >> 24));
+        output.push_back((uint8_t)(value >> 16));
+        output.push_back((uint8_t)(value >> 8));
+        output.push_back((uint8_t)value);
+    }
+
+    uint32_t Get32BE(const uint8_t* data)
+    {
+        return (uint32_t)data[0] << 24 | (uint32_t)data[1] << 16 | (uint32_t)data[2] << 8 | data[3];
+    }
+
+    template <typename T>
+    void PutStruct(std::vector<uint8_t>& output, const T& value)
+    {
+        const uint8_t* const bytes = reinterpret_cast<const uint8_t*>(&value);
+        output.insert(output.end(), bytes, bytes + sizeof(T));
+    }
+
+    uint32_t Crc32(const uint8_t* data, const size_t size, uint32_t crc = 0)
+    {
+        static const auto table = []() {
+            std::vector<uint32_t> table(256);
+            for (uint32_t i = 0; i < 256; i++)
+            {
+                uint32_t c = i;
+                for (int k = 0; k < 8; k++)
+                {
+                    c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+                }
+                table[i] = c;
+            }
+            return table;
+        }();
+
+        crc = ~crc;
+        for (size_t i = 0; i < size; i++)
+        {
+            crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+        }
+        return ~crc;
+    }
+
+    uint32_t Adler32(const uint8_t* data, const size_t size)
+    {
+        uint32_t a = 1, b = 0;
+        for (size_t i = 0; i < size; i++)
+        {
+            a = (a + data[i]) % 65521;
+            b = (b + a) % 65521;
+        }
+        return (b << 16) | a;
+    }
+
+    // A deflate encoder with LZ77 matching and the fixed Huffman codes. It compresses rendered images reasonably well,
+    // without the complexity of dynamic Huffman trees.
+    class Deflater
+    {
+    public:
+        explicit Deflater(std::vector<uint8_t>& output)
+            : m_output(output)
+        {
+        }
+
+        void compress(const uint8_t* data, const size_t size)
+        {
+            // One final block with fixed codes.
+            putBits(1, 1);
+            putBits(1, 2);
+
+            std::vector<int32_t> head(HashSize, -1);
+            std::vector<int32_t> previous(WindowSize, -1);
+            const auto insert = [&](const size_t position) {
+                if (position + MinMatch <= size)
+                {
+                    const uint32_t hash = this->hash(data + position);
+                    previous[position & (WindowSize - 1)] = head[hash];
+                    head[hash] = (int32_t)position;
+                }
+            };
+
+            size_t position = 0;
+            while (position < size)
+            {
+                size_t bestLength = 0;
+                size_t bestDistance = 0;
+                if (position + MinMatch <= size)
+                {
+                    const size_t maxLength = (std::min)(MaxMatch, size - position);
+                    int32_t candidate = head[hash(data + position)];
+                    for (int chain = 0; chain < MaxChain && candidate >= 0 && position - candidate <= WindowSize; chain++)
+                    {
+                        size_t length = 0;
+                        while (length < maxLength && data[candidate + length] == data[position + length])
+                        {
+                            length++;
+                        }
+                        if (length > bestLength)
+                        {
+                            bestLength = length;
+                            bestDistance = position - candidate;
+                            if (length == maxLength)
+                            {
+                                break;
+                            }
+                        }
+                        candidate = previous[candidate & (WindowSize - 1)];
+                    }
+                }
+
+                if (bestLength >= MinMatch)
+                {
+                    putLength(bestLength);
+                    putDistance(bestDistance);
+                    for (size_t i = 0; i < bestLength; i++)
+                    {
+                        insert(position + i);
+                    }
+                    position += bestLength;
+                }
+                else
+                {
+                    putSymbol(data[position]);
+                    insert(position);
+                    position++;
+                }
+            }
+
+            // End of block.
+            putSymbol(256);
+            if (m_bitCount)
+            {
+                m_output.push_back((uint8_t)m_bitBuffer);
+            }
+        }
+
+    private:
+        static constexpr size_t WindowSize = 32768;
+        static constexpr size_t HashSize = 1 << 15;
+        static constexpr size_t MinMatch = 3;
+        static constexpr size_t MaxMatch = 258;
+        static constexpr int MaxChain = 32;
+
+        uint32_t hash(const uint8_t* data) const
+        {
+            return ((data[0] << 16 | data[1] << 8 | data[2]) * 2654435761u) >> (32 - 15);
+        }
+
+        void putBits(const uint32_t bits, const int count)
+        {
+            m_bitBuffer |= bits << m_bitCount;
+            m_bitCount += count;
+            while (m_bitCount >= 8)
+            {
+                m_output.push_back((uint8_t)m_bitBuffer);
+                m_bitBuffer >>= 8;
+                m_bitCount -= 8;
+            }
+        }
+
+        // Huffman codes are stored starting from their most significant bit.
+        void putCode(const uint32_t code, const int length)
+        {
+            uint32_t reversed = 0;
+            for (int i = 0; i < length; i++)
+            {
+                reversed |= ((code >> i) & 1) << (length - 1 - i);
+            }
+            putBits(reversed, length);
+        }
+
+        void putSymbol(const uint32_t symbol)
+        {
+            if (symbol < 144)
+            {
+                putCode(0x30 + symbol, 8);
+            }
+            else if (symbol < 256)
+            {
+                putCode(0x190 + symbol - 144, 9);
+            }
+            else if (symbol < 280)
+            {
+                putCode(symbol - 256, 7);
+            }
+            else
+            {
+                putCode(0xc0 + symbol - 280, 8);
+            }
+        }
+
+        void putLength(const size_t length)
+        {
+            static const uint16_t Base[] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+            static const uint8_t Extra[] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+            int code = 28;
+            while (Base[code] > length)
+            {
+                code--;
+            }
+            putSymbol(257 + code);
+            putBits((uint32_t)(length - Base[code]), Extra[code]);
+        }
+
+        void putDistance(const size_t distance)
+        {
+            static const uint16_t Base[] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+            static const uint8_t Extra[] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+            int code = 29;
+            while (Base[code] > distance)
+            {
+                code--;
+            }
+            putCode(code, 5);
+            putBits((uint32_t)(distance - Base[code]), Extra[code]);
+        }
+
+        std::vector<uint8_t>& m_output;
+        uint32_t m_bitBuffer{ 0 };
+        int m_bitCount{ 0 };
+    };
+
+    // A decoder for zlib streams, with a lookup table for the short Huffman codes.
+    class Inflater
+    {
+    public:
+        Inflater(const uint8_t* data, const size_t size)
+            : m_data(data)
+            , m_size(size)
+        {
+        }
+
+        // Fails rather than produce more than maxSize bytes.
+        bool decompress(std::vector<uint8_t>& output, const size_t maxSize)
+        {
+            m_maxSize = maxSize;
+            // Deflate with a window of at most 32KB, and no preset dictionary.
+            if (m_size < 2 || (m_data[0] & 0x0f) != 8 || (m_data[0] >> 4) > 7 || ((m_data[0] << 8) | m_data[1]) % 31 ||
+                (m_data[1] & 0x20))
+            {
+                return false;
+            }
+            m_position = 2;
+
+            bool isLast;
+            do
+            {
+                isLast = getBits(1);
+                const uint32_t type = getBits(2);
+                bool success = false;
+                if (type == 0)
+                {
+                    success = stored(output);
+                }
+                else if (type == 1)
+                {
+                    success = codes(output, fixedLengthCode(), fixedDistanceCode());
+                }
+                else if (type == 2)
+                {
+                    success = dynamic(output);
+                }
+                if (!success || m_overrun)
+                {
+                    return false;
+                }
+            } while (!isLast);
+
+            return true;
+        }
+
+    private:
+        struct Huffman
+        {
+            static constexpr int FastBits = 10;
+
+            // For the codes of up to FastBits bits, indexed by the next bits of the stream: the symbol and the length.
+            uint16_t fast[1 << FastBits];
+            uint16_t counts[16];
+            uint16_t symbols[288];
+        };
+
+        static bool build(Huffman& huffman, const uint8_t* lengths, const int count)
+        {
+            std::memset(huffman.counts, 0, sizeof(huffman.counts));
+            for (int symbol = 0; symbol < count; symbol++)
+            {
+                huffman.counts[lengths[symbol]]++;
+            }
+            huffman.counts[0] = 0;
+
+            // Reject over-subscribed codes. Incomplete codes are allowed, eg: for a single distance code.
+            int left = 1;
+            for (int length = 1; length < 16; length++)
+            {
+                left = (left << 1) - huffman.counts[length];
+                if (left < 0)
+                {
+                    return false;
+                }
+            }
+
+            uint16_t offsets[16] = {};
+            for (int length = 1; length < 15; length++)
+            {
+                offsets[length + 1] = offsets[length] + huffman.counts[length];
+            }
+            for (int symbol = 0; symbol < count; symbol++)
+            {
+                if (lengths[symbol])
+                {
+                    huffman.symbols[offsets[lengths[symbol]]++] = (uint16_t)symbol;
+                }
+            }
+
+            // Canonical codes, stored starting from their most significant bit.
+            std::memset(huffman.fast, 0, sizeof(huffman.fast));
+            uint32_t code = 0;
+            int index = 0;
+            for (int length = 1; length < 16; length++)
+            {
+                for (int i = 0; i < huffman.counts[length]; i++, code++)
+                {
+                    const uint16_t symbol = huffman.symbols[index++];
+                    if (length <= Huffman::FastBits)
+                    {
+                        uint32_t reversed = 0;
+                        for (int bit = 0; bit < length; bit++)
+                        {
+                            reversed |= ((code >> bit) & 1) << (length - 1 - bit);
+                        }
+                        for (uint32_t entry = reversed; entry < (1u << Huffman::FastBits); entry += 1u << length)
+                        {
+                            huffman.fast[entry] = (uint16_t)(symbol << 4 | length);
+                        }
+                    }
+                }
+                code <<= 1;
+            }
+
+            return true;
+        }
+
+        static const Huffman& fixedLengthCode()
+        {
+            static const Huffman huffman = []() {
+                uint8_t lengths[288];
+                std::fill(lengths, lengths + 144, (uint8_t)8);
+                std::fill(lengths + 144, lengths + 256, (uint8_t)9);
+                std::fill(lengths + 256, lengths + 280, (uint8_t)7);
+                std::fill(lengths + 280, lengths + 288, (uint8_t)8);
+                Huffman huffman;
+                build(huffman, lengths, 288);
+                return huffman;
+            }();
+            return huffman;
+        }
+
+        static const Huffman& fixedDistanceCode()
+        {
+            static const Huffman huffman = []() {
+                uint8_t lengths[30];
+                std::fill(lengths, lengths + 30, (uint8_t)5);
+                Huffman huffman;
+                build(huffman, lengths, 30);
+                return huffman;
+            }();
+            return huffman;
+        }
+
+        void refill()
+        {
+            while (m_bitCount <= 56 && m_position < m_size)
+            {
+                m_bitBuffer |= (uint64_t)m_data[m_position++] << m_bitCount;
+                m_bitCount += 8;
+            }
+        }
+
+        uint32_t getBits(const int count)
+        {
+            if (m_bitCount < count)
+            {
+                refill();
+                if (m_bitCount < count)
+                {
+                    m_overrun = true;
+                    return 0;
+                }
+            }
+            const uint32_t bits = (uint32_t)(m_bitBuffer & ((1ull << count) - 1));
+            m_bitBuffer >>= count;
+            m_bitCount -= count;
+            return bits;
+        }
+
+        int decode(const Huffman& huffman)
+        {
+            if (m_bitCount < 15)
+            {
+                refill();
+            }
+            const uint16_t entry = huffman.fast[m_bitBuffer & ((1u << Huffman::FastBits) - 1)];
+            if (entry && (entry & 15) <= m_bitCount)
+            {
+                m_bitBuffer >>= entry & 15;
+                m_bitCount -= entry & 15;
+                return entry >> 4;
+            }
+
+            // Longer codes, one bit at a time.
+            int code = 0;
+            int first = 0;
+            int index = 0;
+            for (int length = 1; length < 16; length++)
+            {
+                code |= getBits(1);
+                const int count = huffman.counts[length];
+                if (code - count < first)
+                {
+                    return huffman.symbols[index + (code - first)];
+                }
+                index += count;
+                first = (first + count) << 1;
+                code <<= 1;
+            }
+            return -1;
+        }
+
+        bool stored(std::vector<uint8_t>& output)
+        {
+            // Go back to the first byte boundary that was not consumed.
+            m_bitBuffer >>= m_bitCount % 8;
+            m_bitCount -= m_bitCount % 8;
+            m_position -= m_bitCount / 8;
+            m_bitBuffer = 0;
+            m_bitCount = 0;
+
+            if (m_size - m_position < 4)
+            {
+                return false;
+            }
+            const uint32_t length = m_data[m_position] | m_data[m_position + 1] << 8;
+            const uint32_t complement = m_data[m_position + 2] | m_data[m_position + 3] << 8;
+            m_position += 4;
+            if (length != (~complement & 0xffff) || m_size - m_position < length || length > m_maxSize - output.size())
+            {
+                return false;
+            }
+            output.insert(output.end(), m_data + m_position, m_data + m_position + length);
+            m_position += length;
+            return true;
+        }
+
+        bool codes(std::vector<uint8_t>& output, const Huffman& lengthCode, const Huffman& distanceCode)
+        {
+            static const uint16_t LengthBase[] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+            static const uint8_t LengthExtra[] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+            static const uint16_t DistanceBase[] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+            static const uint8_t DistanceExtra[] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+            while (!m_overrun)
+            {
+                int symbol = decode(lengthCode);
+                if (symbol < 0)
+                {
+                    return false;
+                }
+                else if (symbol < 256)
+                {
+                    if (output.size() >= m_maxSize)
+                    {
+                        return false;
+                    }
+                    output.push_back((uint8_t)symbol);
+                }
+                else if (symbol == 256)
+                {
+                    return true;
+                }
+                else
+                {
+                    symbol -= 257;
+                    if (symbol >= 29)
+                    {
+                        return false;
+                    }
+                    const size_t length = LengthBase[symbol] + getBits(LengthExtra[symbol]);
+
+                    symbol = decode(distanceCode);
+                    if (symbol < 0 || symbol >= 30)
+                    {
+                        return false;
+                    }
+                    const size_t distance = DistanceBase[symbol] + getBits(DistanceExtra[symbol]);
+                    if (distance > output.size() || length > m_maxSize - output.size())
+                    {
+                        return false;
+                    }
+
+                    // The source and the destination can overlap.
+                    const size_t from = output.size() - distance;
+                    for (size_t i = 0; i < length; i++)
+                    {
+                        output.push_back(output[from + i]);
+                    }
+                }
+            }
+            return false;
+        }
+
+        bool dynamic(std::vector<uint8_t>& output)
+        {
+            static const uint8_t Order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+            const int numLengths = getBits(5) + 257;
+            const int numDistances = getBits(5) + 1;
+            const int numCodeLengths = getBits(4) + 4;
+            if (numLengths > 286 || numDistances > 30)
+            {
+                return false;
+            }
+
+            uint8_t lengths[286 + 30] = {};
+            for (int i = 0; i < numCodeLengths; i++)
+            {
+                lengths[Order[i]] = (uint8_t)getBits(3);
+            }
+            Huffman lengthCode;
+            if (!build(lengthCode, lengths, 19))
+            {
+                return false;
+            }
+
+            int index = 0;
+            while (index < numLengths + numDistances)
+            {
+                const int symbol = decode(lengthCode);
+                if (symbol < 0 || m_overrun)
+                {
+                    return false;
+                }
+                if (symbol < 16)
+                {
+                    lengths[index++] = (uint8_t)symbol;
+                    continue;
+                }
+
+                uint8_t length = 0;
+                int repeat;
+                if (symbol == 16)
+                {
+                    if (!index)
+                    {
+                        return false;
+                    }
+                    length = lengths[index - 1];
+                    repeat = 3 + getBits(2);
+                }
+                else if (symbol == 17)
+                {
+                    repeat = 3 + getBits(3);
+                }
+                else
+                {
+                    repeat = 11 + getBits(7);
+                }
+                if (index + repeat > numLengths + numDistances)
+                {
+                    return false;
+                }
+                std::fill(lengths + index, lengths + index + repeat, length);
+                index += repeat;
+            }
+
+            // The end of block code is required.
+            Huffman distanceCode;
+            if (!lengths[256] || !build(lengthCode, lengths, numLengths) ||
+                !build(distanceCode, lengths + numLengths, numDistances))
+            {
+                return false;
+            }
+            return codes(output, lengthCode, distanceCode);
+        }
+
+        const uint8_t* m_data;
+        size_t m_size;
+        size_t m_maxSize{ 0 };
+        size_t m_position{ 0 };
+        uint64_t m_bitBuffer{ 0 };
+        int m_bitCount{ 0 };
+        bool m_overrun{ false };
+    };
+
+    float HalfToFloat(const uint16_t half)
+    {
+        const int exponent = (half >> 10) & 0x1f;
+        const int mantissa = half & 0x3ff;
+        float value;
+        if (exponent == 0)
+        {
+            value = std::ldexp((float)mantissa, -24);
+        }
+        else if (exponent == 31)
+        {
+            value = mantissa ? 0.f : INFINITY;
+        }
+        else
+        {
+            value = std::ldexp((float)(mantissa | 0x400), exponent - 25);
+        }
+        return half & 0x8000 ? -value : value;
+    }
+
+    uint8_t LinearToSrgb(float value)
+    {
+        value = std::clamp(value, 0.f, 1.f);
+        value = value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.f / 2.4f) - 0.055f;
+        return (uint8_t)(value * 255.f + 0.5f);
+    }
+
+    // Convert to opaque 8-bit RGB(A) for PNG. The alpha channel of a rendered image is meaningless in a screenshot.
+    bool ConvertToRgba8(const CapturedImage& image, std::vector<uint8_t>& rgba)
+    {
+        const size_t numPixels = (size_t)image.width * image.height;
+        rgba.resize(numPixels * 4);
+        const uint8_t* const src = image.pixels.data();
+        uint8_t* const dst = rgba.data();
+
+        switch (image.format)
+        {
+        case FormatR8G8B8A8Typeless:
+        case FormatR8G8B8A8Unorm:
+        case FormatR8G8B8A8UnormSrgb:
+            for (size_t i = 0; i < numPixels; i++)
+            {
+                dst[4 * i + 0] = src[4 * i + 0];
+                dst[4 * i + 1] = src[4 * i + 1];
+                dst[4 * i + 2] = src[4 * i + 2];
+                dst[4 * i + 3] = 255;
+            }
+            return true;
+
+        case FormatB8G8R8A8Unorm:
+        case FormatB8G8R8X8Unorm:
+        case FormatB8G8R8A8Typeless:
+        case FormatB8G8R8A8UnormSrgb:
+        case FormatB8G8R8X8Typeless:
+        case FormatB8G8R8X8UnormSrgb:
+            for (size_t i = 0; i < numPixels; i++)
+            {
+                dst[4 * i + 0] = src[4 * i + 2];
+                dst[4 * i + 1] = src[4 * i + 1];
+                dst[4 * i + 2] = src[4 * i + 0];
+                dst[4 * i + 3] = 255;
+            }
+            return true;
+
+        case FormatR10G10B10A2Typeless:
+        case FormatR10G10B10A2Unorm:
+            for (size_t i = 0; i < numPixels; i++)
+            {
+                uint32_t pixel;
+                std::memcpy(&pixel, src + 4 * i, sizeof(pixel));
+                dst[4 * i + 0] = (uint8_t)((pixel >> 2) & 0xff);
+                dst[4 * i + 1] = (uint8_t)((pixel >> 12) & 0xff);
+                dst[4 * i + 2] = (uint8_t)((pixel >> 22) & 0xff);
+                dst[4 * i + 3] = 255;
+            }
+            return true;
+
+        case FormatR16G16B16A16Unorm:
+            for (size_t i = 0; i < numPixels; i++)
+            {
+                uint16_t pixel[4];
+                std::memcpy(pixel, src + 8 * i, sizeof(pixel));
+                dst[4 * i + 0] = (uint8_t)(pixel[0] >> 8);
+                dst[4 * i + 1] = (uint8_t)(pixel[1] >> 8);
+                dst[4 * i + 2] = (uint8_t)(pixel[2] >> 8);
+                dst[4 * i + 3] = 255;
+            }
+            return true;
+
+        case FormatR16G16B16A16Float:
+            // Floating point render targets hold linear values.
+            for (size_t i = 0; i < numPixels; i++)
+            {
+                uint16_t pixel[4];
+                std::memcpy(pixel, src + 8 * i, sizeof(pixel));
+                dst[4 * i + 0] = LinearToSrgb(HalfToFloat(pixel[0]));
+                dst[4 * i + 1] = LinearToSrgb(HalfToFloat(pixel[1]));
+                dst[4 * i + 2] = LinearToSrgb(HalfToFloat(pixel[2]));
+                dst[4 * i + 3] = 255;
+            }
+            return true;
+
+        default:
+            return false;
+        }
+    }
+
+    uint8_t Paeth(const int a, const int b, const int c)
+    {
+        const int p = a + b - c;
+        const int pa = std::abs(p - a);
+        const int pb = std::abs(p - b);
+        const int pc = std::abs(p - c);
+        return (uint8_t)(pa <= pb && pa <= pc ? a : pb <= pc ? b : c);
+    }
+
+    // Filter each row with the filter that minimizes the sum of absolute differences (the heuristic from the PNG
+    // specification).
+    void FilterScanlines(const std::vector<uint8_t>& rgba, const uint32_t width, const uint32_t height, std::vector<uint8_t>& filtered)
+    {
+        const size_t stride = (size_t)width * 4;
+        filtered.resize((stride + 1) * height);
+
+        std::vector<uint8_t> candidates[5];
+        for (auto& candidate : candidates)
+        {
+            candidate.resize(stride);
+        }
+        const std::vector<uint8_t> zeroes(stride, 0);
+
+        for (uint32_t y = 0; y < height; y++)
+        {
+            const uint8_t* const row = rgba.data() + y * stride;
+            const uint8_t* const above = y ? row - stride : zeroes.data();
+
+            uint64_t bestScore = UINT64_MAX;
+            int bestFilter = 0;
+            for (int filter = 0; filter < 5; filter++)
+            {
+                uint8_t* const out = candidates[filter].data();
+                uint64_t score = 0;
+                for (size_t x = 0; x < stride; x++)
+                {
+                    const int left = x >= 4 ? row[x - 4] : 0;
+                    const int up = above[x];
+                    const int upLeft = x >= 4 ? above[x - 4] : 0;
+                    uint8_t predictor = 0;
+                    switch (filter)
+                    {
+                    case 1:
+                        predictor = (uint8_t)left;
+                        break;
+                    case 2:
+                        predictor = (uint8_t)up;
+                        break;
+                    case 3:
+                        predictor = (uint8_t)((left + up) / 2);
+                        break;
+                    case 4:
+                        predictor = Paeth(left, up, upLeft);
+                        break;
+                    }
+                    out[x] = (uint8_t)(row[x] - predictor);
+                    score += std::abs((int8_t)out[x]);
+                }
+                if (score < bestScore)
+                {
+                    bestScore = score;
+                    bestFilter = filter;
+                }
+            }
+
+            uint8_t* const dst = filtered.data() + y * (stride + 1);
+            dst[0] = (uint8_t)bestFilter;
+            std::memcpy(dst + 1, candidates[bestFilter].data(), stride);
+        }
+    }
+
+    const uint8_t PngSignature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+
+    void PutPngChunk(std::vector<uint8_t>& output, const char* type, const std::vector<uint8_t>& data)
+    {
+        Put32BE(output, (uint32_t)data.size());
+        const size_t start = output.size();
+        output.insert(output.end(), type, type + 4);
+        output.insert(output.end(), data.cbegin(), data.cend());
+        Put32BE(output, Crc32(output.data() + start, output.size() - start));
+    }
+
+    struct DdsPixelFormat
+    {
+        uint32_t size;
+        uint32_t flags;
+        uint32_t fourCC;
+        uint32_t rgbBitCount;
+        uint32_t rBitMask;
+        uint32_t gBitMask;
+        uint32_t bBitMask;
+        uint32_t aBitMask;
+    };
+
+    struct DdsHeader
+    {
+        uint32_t size;
+        uint32_t flags;
+        uint32_t height;
+        uint32_t width;
+        uint32_t pitchOrLinearSize;
+        uint32_t depth;
+        uint32_t mipMapCount;
+        uint32_t reserved1[11];
+        DdsPixelFormat pixelFormat;
+        uint32_t caps;
+        uint32_t caps2;
+        uint32_t caps3;
+        uint32_t caps4;
+        uint32_t reserved2;
+    };
+
+    struct DdsHeaderDx10
+    {
+        uint32_t dxgiFormat;
+        uint32_t resourceDimension;
+        uint32_t miscFlag;
+        uint32_t arraySize;
+        uint32_t miscFlags2;
+    };
+
+    // The DXGI format of a DDS file without the DX10 header, for the uncompressed formats we know.
+    uint32_t LegacyDdsFormat(const DdsPixelFormat& pixelFormat)
+    {
+        if (pixelFormat.flags & 0x4) // FOURCC
+        {
+            switch (pixelFormat.fourCC)
+            {
+            case 36: // D3DFMT_A16B16G16R16
+                return FormatR16G16B16A16Unorm;
+            case 113: // D3DFMT_A16B16G16R16F
+                return FormatR16G16B16A16Float;
+            case 116: // D3DFMT_A32B32G32R32F
+                return FormatR32G32B32A32Float;
+            default:
+                return 0;
+            }
+        }
+
+        if ((pixelFormat.flags & 0x40) && pixelFormat.rgbBitCount == 32) // RGB
+        {
+            const bool hasAlpha = pixelFormat.flags & 0x1;
+            if (pixelFormat.rBitMask == 0xff && pixelFormat.gBitMask == 0xff00 && pixelFormat.bBitMask == 0xff0000)
+            {
+                return FormatR8G8B8A8Unorm;
+            }
+            if (pixelFormat.rBitMask == 0xff0000 && pixelFormat.gBitMask == 0xff00 && pixelFormat.bBitMask == 0xff)
+            {
+                return hasAlpha ? FormatB8G8R8A8Unorm : FormatB8G8R8X8Unorm;
+            }
+            if (pixelFormat.rBitMask == 0x3ff && pixelFormat.gBitMask == 0xffc00 && pixelFormat.bBitMask == 0x3ff00000)
+            {
+                return FormatR10G10B10A2Unorm;
+            }
+        }
+
+        return 0;
+    }
+}
+
+namespace nis_scaler
+{
+    uint32_t BytesPerPixel(const uint32_t format)
+    {
+        switch (format)
+        {
+        case FormatR32G32B32A32Float:
+            return 16;
+
+        case FormatR16G16B16A16Typeless:
+        case FormatR16G16B16A16Float:
+        case FormatR16G16B16A16Unorm:
+            return 8;
+
+        case FormatR10G10B10A2Typeless:
+        case FormatR10G10B10A2Unorm:
+        case FormatR11G11B10Float:
+        case FormatR8G8B8A8Typeless:
+        case FormatR8G8B8A8Unorm:
+        case FormatR8G8B8A8UnormSrgb:
+        case FormatB8G8R8A8Unorm:
+        case FormatB8G8R8X8Unorm:
+        case FormatB8G8R8A8Typeless:
+        case FormatB8G8R8A8UnormSrgb:
+        case FormatB8G8R8X8Typeless:
+        case FormatB8G8R8X8UnormSrgb:
+            return 4;
+
+        default:
+            return 0;
+        }
+    }
+
+    bool IsPngCompatible(const uint32_t format)
+    {
+        return BytesPerPixel(format) && format != FormatR32G32B32A32Float && format != FormatR16G16B16A16Typeless &&
+            format != FormatR11G11B10Float;
+    }
+
+    std::string ScreenshotFileName(const std::string& applicationName,
+                                   const bool isNIS,
+                                   const float scaleFactor,
+                                   const float sharpness,
+                                   const std::time_t time,
+                                   const ImageFileFormat fileFormat)
+    {
+        std::stringstream parameters;
+        if (isNIS)
+        {
+            parameters << "NIS_" << std::fixed << std::setprecision(3) << scaleFactor << "_" << sharpness;
+        }
+        else
+        {
+            parameters << "upscaled_" << std::fixed << std::setprecision(3) << scaleFactor;
+        }
+        // std::localtime() is not reentrant, and the names are also built from worker threads.
+        std::tm localTime;
+#ifdef _WIN32
+        localtime_s(&localTime, &time);
+#else
+        localtime_r(&time, &localTime);
+#endif
+        char datetime[1024];
+        std::strftime(datetime, sizeof(datetime), "%Y%m%d_%H%M%S_", &localTime);
+
+        return applicationName + "_" + datetime + parameters.str() + (fileFormat == ImageFileFormat::PNG ? ".png" : ".dds");
+    }
+
+    bool EncodeDDS(const CapturedImage& image, std::vector<uint8_t>& output)
+    {
+        const uint32_t bytesPerPixel = BytesPerPixel(image.format);
+        if (!bytesPerPixel || image.pixels.size() != (size_t)image.width * image.height * bytesPerPixel)
+        {
+            return false;
+        }
+
+        DdsHeader header{};
+        header.size = sizeof(DdsHeader);
+        header.flags = 0x1 | 0x2 | 0x4 | 0x8 | 0x1000; // CAPS | HEIGHT | WIDTH | PITCH | PIXELFORMAT
+        header.height = image.height;
+        header.width = image.width;
+        header.pitchOrLinearSize = image.width * bytesPerPixel;
+        header.mipMapCount = 1;
+        header.pixelFormat.size = sizeof(DdsPixelFormat);
+        header.pixelFormat.flags = 0x4; // FOURCC
+        header.pixelFormat.fourCC = 0x30315844; // 'DX10'
+        header.caps = 0x1000; // TEXTURE
+
+        DdsHeaderDx10 headerDx10{};
+        headerDx10.dxgiFormat = image.format;
+        headerDx10.resourceDimension = 3; // TEXTURE2D
+        headerDx10.arraySize = 1;
+
+        output.clear();
+        output.reserve(4 + sizeof(header) + sizeof(headerDx10) + image.pixels.size());
+        PutStruct(output, (uint32_t)0x20534444); // 'DDS '
+        PutStruct(output, header);
+        PutStruct(output, headerDx10);
+        output.insert(output.end(), image.pixels.cbegin(), image.pixels.cend());
+
+        return true;
+    }
+
+    bool EncodePNG(const CapturedImage& image, std::vector<uint8_t>& output)
+    {
+        const uint32_t bytesPerPixel = BytesPerPixel(image.format);
+        if (!IsPngCompatible(image.format) || image.pixels.size() != (size_t)image.width * image.height * bytesPerPixel)
+        {
+            return false;
+        }
+
+        std::vector<uint8_t> rgba;
+        ConvertToRgba8(image, rgba);
+        std::vector<uint8_t> filtered;
+        FilterScanlines(rgba, image.width, image.height, filtered);
+        rgba.clear();
+
+        // The zlib stream: header, deflate data, checksum.
+        std::vector<uint8_t> compressed = { 0x78, 0x01 };
+        Deflater(compressed).compress(filtered.data(), filtered.size());
+        Put32BE(compressed, Adler32(filtered.data(), filtered.size()));
+
+        std::vector<uint8_t> headerChunk;
+        Put32BE(headerChunk, image.width);
+        Put32BE(headerChunk, image.height);
+        headerChunk.push_back(8); // Bit depth.
+        headerChunk.push_back(6); // RGBA.
+        headerChunk.push_back(0); // Compression.
+        headerChunk.push_back(0); // Filtering.
+        headerChunk.push_back(0); // No interlacing.
+
+        output.assign(PngSignature, PngSignature + sizeof(PngSignature));
+        PutPngChunk(output, "IHDR", headerChunk);
+        PutPngChunk(output, "IDAT", compressed);
+        PutPngChunk(output, "IEND", {});
+
+        return true;
+    }
+
+    bool DecodeDDS(const uint8_t* data, const size_t size, CapturedImage& image)
+    {
+        uint32_t magic;
+        DdsHeader header;
+        if (size < sizeof(magic) + sizeof(header))
+        {
+            return false;
+        }
+        std::memcpy(&magic, data, sizeof(magic));
+        std::memcpy(&header, data + sizeof(magic), sizeof(header));
+        size_t offset = sizeof(magic) + sizeof(header);
+        if (magic != 0x20534444 || header.size != sizeof(DdsHeader))
+        {
+            return false;
+        }
+
+        uint32_t format;
+        if ((header.pixelFormat.flags & 0x4) && header.pixelFormat.fourCC == 0x30315844) // 'DX10'
+        {
+            DdsHeaderDx10 headerDx10;
+            if (size - offset < sizeof(headerDx10))
+            {
+                return false;
+            }
+            std::memcpy(&headerDx10, data + offset, sizeof(headerDx10));
+            offset += sizeof(headerDx10);
+            if (headerDx10.resourceDimension != 3) // TEXTURE2D
+            {
+                return false;
+            }
+            format = headerDx10.dxgiFormat;
+        }
+        else
+        {
+            format = LegacyDdsFormat(header.pixelFormat);
+        }
+
+        // Only the first mip level of the first slice is read.
+        const uint32_t bytesPerPixel = BytesPerPixel(format);
+        const uint64_t imageSize = (uint64_t)header.width * header.height * bytesPerPixel;
+        if (!imageSize || imageSize > size - offset)
+        {
+            return false;
+        }
+
+        image.width = header.width;
+        image.height = header.height;
+        image.format = format;
+        image.pixels.assign(data + offset, data + offset + imageSize);
+        return true;
+    }
+
+    bool DecodePNG(const uint8_t* data, const size_t size, CapturedImage& image)
+    {
+        if (size < sizeof(PngSignature) || std::memcmp(data, PngSignature, sizeof(PngSignature)))
+        {
+            return false;
+        }
+
+        uint32_t width = 0, height = 0;
+        uint8_t bitDepth = 0, colorType = 0;
+        bool hasHeader = false, hasEnd = false;
+        std::vector<uint8_t> palette;
+        std::vector<uint8_t> compressed;
+        size_t offset = sizeof(PngSignature);
+        while (!hasEnd && size - offset >= 12)
+        {
+            const uint32_t length = Get32BE(data + offset);
+            if (length > size - offset - 12)
+            {
+                return false;
+            }
+            const uint8_t* const type = data + offset + 4;
+            const uint8_t* const chunk = type + 4;
+            if (Get32BE(chunk + length) != Crc32(type, length + 4))
+            {
+                return false;
+            }
+
+            if (!std::memcmp(type, "IHDR", 4) && length >= 13)
+            {
+                width = Get32BE(chunk);
+                height = Get32BE(chunk + 4);
+                bitDepth = chunk[8];
+                colorType = chunk[9];
+                // Default compression and filtering, no interlacing.
+                hasHeader = !chunk[10] && !chunk[11] && !chunk[12];
+            }
+            else if (!std::memcmp(type, "PLTE", 4))
+            {
+                palette.assign(chunk, chunk + length);
+            }
+            else if (!std::memcmp(type, "IDAT", 4))
+            {
+                compressed.insert(compressed.end(), chunk, chunk + length);
+            }
+            else if (!std::memcmp(type, "IEND", 4))
+            {
+                hasEnd = true;
+            }
+            offset += 12 + (size_t)length;
+        }
+
+        int channels;
+        switch (colorType)
+        {
+        case 0: // Grayscale.
+        case 3: // Palette.
+            channels = 1;
+            break;
+        case 2: // RGB.
+            channels = 3;
+            break;
+        case 4: // Grayscale and alpha.
+            channels = 2;
+            break;
+        case 6: // RGBA.
+            channels = 4;
+            break;
+        default:
+            return false;
+        }
+        if (!hasHeader || !hasEnd || !width || !height || (bitDepth != 8 && (bitDepth != 16 || colorType == 3)) ||
+            (colorType == 3 && palette.size() < 3) || (uint64_t)width * height > (1ull << 28))
+        {
+            return false;
+        }
+
+        const size_t bytesPerPixel = (size_t)channels * bitDepth / 8;
+        const size_t stride = width * bytesPerPixel;
+        const size_t filteredSize = (stride + 1) * height;
+        std::vector<uint8_t> filtered;
+        filtered.reserve(filteredSize);
+        if (!Inflater(compressed.data(), compressed.size()).decompress(filtered, filteredSize) ||
+            filtered.size() != filteredSize)
+        {
+            return false;
+        }
+        compressed.clear();
+
+        // Reverse the filters in place: the previous row is already decoded.
+        for (uint32_t y = 0; y < height; y++)
+        {
+            uint8_t* const row = filtered.data() + y * (stride + 1);
+            uint8_t* const current = row + 1;
+            const uint8_t* const above = y ? current - (stride + 1) : nullptr;
+            for (size_t x = 0; x < stride; x++)
+            {
+                const int left = x >= bytesPerPixel ? current[x - bytesPerPixel] : 0;
+                const int up = above ? above[x] : 0;
+                const int upLeft = above && x >= bytesPerPixel ? above[x - bytesPerPixel] : 0;
+                switch (row[0])
+                {
+                case 0:
+                    break;
+                case 1:
+                    current[x] += (uint8_t)left;
+                    break;
+                case 2:
+                    current[x] += (uint8_t)up;
+                    break;
+                case 3:
+                    current[x] += (uint8_t)((left + up) / 2);
+                    break;
+                case 4:
+                    current[x] += Paeth(left, up, upLeft);
+                    break;
+                default:
+                    return false;
+                }
+            }
+        }
+
+        // 8-bit images become R8G8B8A8_UNORM, and 16-bit images R16G16B16A16_UNORM.
+        const size_t numPixels = (size_t)width * height;
+        image.width = width;
+        image.height = height;
+        image.format = bitDepth == 16 ? FormatR16G16B16A16Unorm : FormatR8G8B8A8Unorm;
+        image.pixels.resize(numPixels * BytesPerPixel(image.format));
+        for (uint32_t y = 0; y < height; y++)
+        {
+            const uint8_t* src = filtered.data() + y * (stride + 1) + 1;
+            for (uint32_t x = 0; x < width; x++, src += bytesPerPixel)
+            {
+                uint32_t values[4];
+                for (int c = 0; c < channels; c++)
+                {
+                    values[c] = bitDepth == 16 ? (uint32_t)(src[2 * c] << 8 | src[2 * c + 1]) : src[c];
+                }
+                const uint32_t opaque = bitDepth == 16 ? 0xffff : 0xff;
+                uint32_t rgba[4];
+                switch (colorType)
+                {
+                case 0:
+                    rgba[0] = rgba[1] = rgba[2] = values[0];
+                    rgba[3] = opaque;
+                    break;
+                case 2:
+                    rgba[0] = values[0];
+                    rgba[1] = values[1];
+                    rgba[2] = values[2];
+                    rgba[3] = opaque;
+                    break;
+                case 3:
+                    if (values[0] * 3 + 2 >= palette.size())
+                    {
+                        return false;
+                    }
+                    rgba[0] = palette[values[0] * 3];
+                    rgba[1] = palette[values[0] * 3 + 1];
+                    rgba[2] = palette[values[0] * 3 + 2];
+                    rgba[3] = opaque;
+                    break;
+                case 4:
+                    rgba[0] = rgba[1] = rgba[2] = values[0];
+                    rgba[3] = values[1];
+                    break;
+                default:
+                    std::copy(values, values + 4, rgba);
+                    break;
+                }
+
+                const size_t pixel = (size_t)y * width + x;
+                for (int c = 0; c < 4; c++)
+                {
+                    if (bitDepth == 16)
+                    {
+                        const uint16_t value = (uint16_t)rgba[c];
+                        std::memcpy(image.pixels.data() + 8 * pixel + 2 * c, &value, sizeof(value));
+                    }
+                    else
+                    {
+                        image.pixels[4 * pixel + c] = (uint8_t)rgba[c];
+                    }
+                }
+            }
+        }
+
+        return true;
+    }
+
+    bool ConvertToFloat(const CapturedImage& image, std::vector<float>& rgba)
+    {
+        const size_t numPixels = (size_t)image.width * image.height;
+        const ColorFormatInfo* const info = GetColorFormatInfo(image.format);
+        if (!info || !BytesPerPixel(image.format) || image.pixels.size() != numPixels * info->bytesPerPixel)
+        {
+            return false;
+        }
+        rgba.resize(numPixels * 4);
+        LoadTexels(*info, image.pixels.data(), numPixels, rgba.data());
+        return true;
+    }
+
+    bool ConvertFromFloat(const float* rgba, CapturedImage& image)
+    {
+        const size_t numPixels = (size_t)image.width * image.height;
+        const ColorFormatInfo* const info = GetColorFormatInfo(image.format);
+        if (!info || !BytesPerPixel(image.format))
+        {
+            return false;
+        }
+        image.pixels.resize(numPixels * info->bytesPerPixel);
+        StoreTexels(*info, rgba, numPixels, image.pixels.data());
+        return true;
+    }
+
+    ScreenshotWriter::~ScreenshotWriter()
+    {
+        // We may be called with the loader lock held, where waiting for the thread could deadlock.
+        {
+            std::unique_lock lock(m_mutex);
+            m_stop = true;
+        }
+        m_wakeUp.notify_all();
+        if (m_thread.joinable())
+        {
+            m_thread.detach();
+        }
+    }
+
+    void ScreenshotWriter::start()
+    {
+        if (m_thread.joinable())
+        {
+            return;
+        }
+
+        m_stop = false;
+        m_thread = std::thread([this]() { writerThread(); });
+    }
+
+    void ScreenshotWriter::stop()
+    {
+        {
+            std::unique_lock lock(m_mutex);
+            m_stop = true;
+        }
+        m_wakeUp.notify_all();
+        if (m_thread.joinable())
+        {
+            m_thread.join();
+        }
+    }
+
+    bool ScreenshotWriter::submit(CapturedImage&& image)
+    {
+        {
+            std::unique_lock lock(m_mutex);
+            if (m_queue.size() >= MaxPendingImages)
+            {
+                return false;
+            }
+            m_queue.push_back(std::move(image));
+        }
+        m_wakeUp.notify_one();
+
+        return true;
+    }
+
+    void ScreenshotWriter::flush()
+    {
+        std::unique_lock lock(m_mutex);
+        m_idle.wait(lock, [&]() { return (m_queue.empty() && !m_isBusy) || !m_thread.joinable(); });
+    }
+
+    void ScreenshotWriter::writerThread()
+    {
+        std::vector<uint8_t> encoded;
+        while (true)
+        {
+            CapturedImage image;
+            {
+                std::unique_lock lock(m_mutex);
+                m_isBusy = false;
+                m_idle.notify_all();
+                m_wakeUp.wait(lock, [&]() { return m_stop || !m_queue.empty(); });
+                if (m_queue.empty())
+                {
+                    // Only stop once all the images are written.
+                    break;
+                }
+                image = std::move(m_queue.front());
+                m_queue.pop_front();
+                m_isBusy = true;
+            }
+
+            const bool encodeSuccess =
+                image.fileFormat == ImageFileFormat::PNG ? EncodePNG(image, encoded) : EncodeDDS(image, encoded);
+            if (!encodeSuccess)
+            {
+                Log("Failed to encode screenshot for format %u\n", image.format);
+                continue;
+            }
+
+            std::ofstream file(image.path, std::ios_base::binary | std::ios_base::trunc);
+            file.write(reinterpret_cast<const char*>(encoded.data()), encoded.size());
+            file.close();
+            if (file)
+            {
+                Log("Screenshot saved to %s\n", image.path.c_str());
+            }
+            else
+            {
+                Log("Failed to write screenshot to %s\n", image.path.c_str());
+            }
+        }
+
+        std::unique_lock lock(m_mutex);
+        m_isBusy = false;
+        m_idle.notify_all();
+    }
+}
@@ -0,0 +1,107 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <ctime>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// The CPU side of the screenshots: the layer reads back the pixels, and a worker thread encodes and writes the files.
+
+namespace nis_scaler
+{
+    enum class ImageFileFormat
+    {
+        DDS = 0,
+        PNG,
+    };
+
+    // An image read back from the GPU, with tightly packed rows.
+    struct CapturedImage
+    {
+        std::string path;
+        ImageFileFormat fileFormat;
+        uint32_t width;
+        uint32_t height;
+        uint32_t format; // A DXGI_FORMAT.
+        std::vector<uint8_t> pixels;
+    };
+
+    // The size of a pixel for the formats that can be captured, or 0 if the format is not supported.
+    uint32_t BytesPerPixel(uint32_t format);
+
+    // Whether a format can be converted for PNG. Other formats can only be saved as DDS.
+    bool IsPngCompatible(uint32_t format);
+
+    // The file name for a screenshot, eg: FS2020_20211105_213000_NIS_0.700_0.500.png.
+    std::string ScreenshotFileName(const std::string& applicationName,
+                                   bool isNIS,
+                                   float scaleFactor,
+                                   float sharpness,
+                                   std::time_t time,
+                                   ImageFileFormat fileFormat);
+
+    bool EncodeDDS(const CapturedImage& image, std::vector<uint8_t>& output);
+    bool EncodePNG(const CapturedImage& image, std::vector<uint8_t>& output);
+
+    // Decode uncompressed DDS files, in one of the formats above, and non-interlaced PNG files. 8-bit PNG files decode
+    // to R8G8B8A8_UNORM and 16-bit ones to R16G16B16A16_UNORM.
+    bool DecodeDDS(const uint8_t* data, size_t size, CapturedImage& image);
+    bool DecodePNG(const uint8_t* data, size_t size, CapturedImage& image);
+
+    // Convert between the pixels of an image and RGBA floats (see LoadTexels()). The values are the stored ones: sRGB
+    // images are not linearized, like when the layer scales them. ConvertFromFloat() uses the size and the format of the
+    // image.
+    bool ConvertToFloat(const CapturedImage& image, std::vector<float>& rgba);
+    bool ConvertFromFloat(const float* rgba, CapturedImage& image);
+
+    // Encode and write images from a background thread.
+    class ScreenshotWriter
+    {
+    public:
+        ~ScreenshotWriter();
+
+        void start();
+        void stop();
+
+        // Queue an image. Returns false (and drops the image) if too many images are already waiting.
+        bool submit(CapturedImage&& image);
+
+        // Wait until all the queued images are written.
+        void flush();
+
+    private:
+        static constexpr size_t MaxPendingImages = 4;
+
+        void writerThread();
+
+        std::mutex m_mutex;
+        std::condition_variable m_wakeUp;
+        std::condition_variable m_idle;
+        std::deque<CapturedImage> m_queue;
+        bool m_isBusy{ false };
+        bool m_stop{ false };
+
+        std::thread m_thread;
+    };
+}
@@ -0,0 +1,272 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// This file does not use the precompiled header, so it can be shared with the tools.
+
+#include "ShaderCache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+
+namespace
+{
+    using namespace nis_scaler;
+
+    // Temporary files older than this are left over from an interrupted store(), and are deleted by trim().
+    constexpr auto StaleTemporaryFileAge = std::chrono::minutes(10);
+
+    constexpr const char* TemporaryExtension = ".tmp";
+
+    std::string ToHex(const uint64_t value)
+    {
+        char buffer[17];
+        std::snprintf(buffer, sizeof(buffer), "%016llx", (unsigned long long)value);
+        return buffer;
+    }
+
+    uint64_t Checksum(const std::string& key, const std::vector<uint8_t>& bytecode)
+    {
+        return HashShaderData(bytecode.data(), bytecode.size(), HashShaderData(key.data(), key.size()));
+    }
+}
+
+namespace nis_scaler
+{
+    std::string ShaderKey::describe() const
+    {
+        std::string description;
+        description += "source=" + ToHex(HashShaderData(source.data(), source.size())) + ":" + std::to_string(source.size()) + "\n";
+        for (const auto& define : defines)
+        {
+            description += "define=" + define.first + "=" + define.second + "\n";
+        }
+        description += "entry=" + entryPoint + "\n";
+        description += "target=" + target + "\n";
+        description += "flags=" + std::to_string(flags) + "\n";
+        description += "compiler=" + compilerVersion + "\n";
+        return description;
+    }
+
+    uint64_t HashShaderData(const void* const data, const size_t size, uint64_t hash)
+    {
+        const uint8_t* const bytes = static_cast<const uint8_t*>(data);
+        for (size_t i = 0; i < size; i++)
+        {
+            hash ^= bytes[i];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    ShaderCache::ShaderCache(const std::string& directory, const uint64_t maxSize)
+        : m_directory(directory), m_maxSize(maxSize)
+    {
+    }
+
+    std::string ShaderCache::entryPath(const ShaderKey& key) const
+    {
+        const std::string description = key.describe();
+        return (std::filesystem::path(m_directory) / (ToHex(HashShaderData(description.data(), description.size())) + ShaderCacheExtension)).string();
+    }
+
+    bool ShaderCache::load(const ShaderKey& key, std::vector<uint8_t>& bytecode)
+    {
+        const std::string path = entryPath(key);
+        const std::string description = key.describe();
+
+        bool isValid = false;
+        {
+            std::ifstream file(path, std::ios_base::binary);
+            if (!file)
+            {
+                m_statistics.misses++;
+                return false;
+            }
+
+            std::error_code ec;
+            const uint64_t fileSize = std::filesystem::file_size(path, ec);
+
+            ShaderCacheEntryHeader header{};
+            std::string entryKey;
+            if (!ec && file.read(reinterpret_cast<char*>(&header), sizeof(header)) && header.magic == ShaderCacheMagic &&
+                header.version == ShaderCacheVersion && sizeof(header) + (uint64_t)header.keySize + header.bytecodeSize == fileSize &&
+                header.keySize == description.size())
+            {
+                entryKey.resize(header.keySize);
+                bytecode.resize(header.bytecodeSize);
+                isValid = file.read(entryKey.data(), entryKey.size()) &&
+                          file.read(reinterpret_cast<char*>(bytecode.data()), bytecode.size()) &&
+                          Checksum(entryKey, bytecode) == header.checksum && entryKey == description;
+            }
+        }
+
+        if (!isValid)
+        {
+            // Corrupted, from another version, or for another key with the same hash: the entry is replaced by the
+            // next store().
+            std::error_code ec;
+            std::filesystem::remove(path, ec);
+            bytecode.clear();
+            m_statistics.invalidEntries++;
+            m_statistics.misses++;
+            return false;
+        }
+
+        // Mark the entry as recently used.
+        std::error_code ec;
+        std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), ec);
+        m_statistics.hits++;
+        return true;
+    }
+
+    bool ShaderCache::store(const ShaderKey& key, const std::vector<uint8_t>& bytecode)
+    {
+        const std::string path = entryPath(key);
+        const std::string description = key.describe();
+
+        std::error_code ec;
+        std::filesystem::create_directories(m_directory, ec);
+
+        // Another process may be storing the same entry: the temporary file must be unique.
+        const uint64_t unique = (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count() ^
+                                (uint64_t)std::hash<std::thread::id>()(std::this_thread::get_id());
+        const std::string temporaryPath = path + "." + ToHex(unique) + TemporaryExtension;
+
+        ShaderCacheEntryHeader header{};
+        header.magic = ShaderCacheMagic;
+        header.version = ShaderCacheVersion;
+        header.keySize = (uint32_t)description.size();
+        header.bytecodeSize = (uint32_t)bytecode.size();
+        header.checksum = Checksum(description, bytecode);
+
+        bool isWritten;
+        {
+            std::ofstream file(temporaryPath, std::ios_base::binary | std::ios_base::trunc);
+            isWritten = file.write(reinterpret_cast<const char*>(&header), sizeof(header)) &&
+                        file.write(description.data(), description.size()) &&
+                        file.write(reinterpret_cast<const char*>(bytecode.data()), bytecode.size());
+            file.close();
+            isWritten = isWritten && !file.fail();
+        }
+        if (isWritten)
+        {
+            std::filesystem::rename(temporaryPath, path, ec);
+            isWritten = !ec;
+        }
+        if (!isWritten)
+        {
+            std::filesystem::remove(temporaryPath, ec);
+            return false;
+        }
+
+        trim();
+        return true;
+    }
+
+    bool ShaderCache::getOrCompile(const ShaderKey& key, std::vector<uint8_t>& bytecode, const CompileFunction& compile)
+    {
+        if (load(key, bytecode))
+        {
+            return true;
+        }
+        if (!compile(bytecode))
+        {
+            return false;
+        }
+
+        // A failure to store the entry only costs a compilation next time.
+        store(key, bytecode);
+        return true;
+    }
+
+    void ShaderCache::trim()
+    {
+        struct Entry
+        {
+            std::filesystem::path path;
+            uint64_t size;
+            std::filesystem::file_time_type lastUsed;
+        };
+        std::vector<Entry> entries;
+        uint64_t totalSize = 0;
+
+        const auto now = std::filesystem::file_time_type::clock::now();
+        std::error_code ec;
+        for (const auto& file : std::filesystem::directory_iterator(m_directory, ec))
+        {
+            std::error_code fileEc;
+            if (!file.is_regular_file(fileEc))
+            {
+                continue;
+            }
+
+            const std::filesystem::path& path = file.path();
+            const auto lastWriteTime = file.last_write_time(fileEc);
+            if (fileEc)
+            {
+                continue;
+            }
+            if (path.extension() == TemporaryExtension)
+            {
+                if (now - lastWriteTime > StaleTemporaryFileAge)
+                {
+                    std::filesystem::remove(path, fileEc);
+                }
+            }
+            else if (path.extension() == ShaderCacheExtension)
+            {
+                entries.push_back({ path, file.file_size(fileEc), lastWriteTime });
+                totalSize += entries.back().size;
+            }
+        }
+        if (totalSize <= m_maxSize)
+        {
+            return;
+        }
+
+        std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.lastUsed < b.lastUsed; });
+        for (const Entry& entry : entries)
+        {
+            if (totalSize <= m_maxSize)
+            {
+                break;
+            }
+            if (std::filesystem::remove(entry.path, ec))
+            {
+                totalSize -= entry.size;
+                m_statistics.evictedEntries++;
+            }
+        }
+    }
+
+    void ShaderCache::clear()
+    {
+        std::error_code ec;
+        for (const auto& file : std::filesystem::directory_iterator(m_directory, ec))
+        {
+            const std::filesystem::path& path = file.path();
+            if (path.extension() == ShaderCacheExtension || path.extension() == TemporaryExtension)
+            {
+                std::error_code fileEc;
+                std::filesystem::remove(path, fileEc);
+            }
+        }
+    }
+}
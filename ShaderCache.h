@@ -0,0 +1,121 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+// A persistent cache of compiled shaders.
+//
+// Each entry is a file named after the hash of its key, holding a header, the description of the key and the bytecode.
+// The key covers everything the bytecode depends on: the source and the files it includes, the macro definitions, the
+// entry point, the target profile, the compile flags and the version of the compiler. Entries are verified when loaded
+// (sizes, checksum, and the description of the key in case of a hash collision), and invalid entries are deleted. Loading an entry
+// marks it as used, and the least recently used entries are evicted when the cache grows beyond its size limit.
+//
+// The cache does not depend on the compiler, so that it can be tested with a stub compiler (see the ShaderCacheTool).
+
+namespace nis_scaler
+{
+    constexpr uint32_t ShaderCacheMagic = 0x4353494e; // 'NISC'
+    constexpr uint32_t ShaderCacheVersion = 1;
+    constexpr uint64_t ShaderCacheDefaultMaxSize = 32 * 1024 * 1024;
+
+    // The extension of the entry files.
+    constexpr const char* ShaderCacheExtension = ".shader";
+
+    struct ShaderCacheEntryHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t keySize;
+        uint32_t bytecodeSize;
+        uint64_t checksum; // Of the key and the bytecode.
+    };
+
+    struct ShaderKey
+    {
+        // The source, followed by the contents of the files it includes.
+        std::string source;
+        std::vector<std::pair<std::string, std::string>> defines;
+        std::string entryPoint;
+        std::string target;
+        uint32_t flags{ 0 };
+        std::string compilerVersion;
+
+        // A canonical description of the key. The source is only described by its hash and size.
+        std::string describe() const;
+    };
+
+    // FNV-1a (64-bit).
+    uint64_t HashShaderData(const void* data, size_t size, uint64_t hash = 14695981039346656037ull);
+
+    class ShaderCache
+    {
+    public:
+        // The compiler, for getOrCompile(). Returns false when the shader does not compile.
+        using CompileFunction = std::function<bool(std::vector<uint8_t>& bytecode)>;
+
+        struct Statistics
+        {
+            uint32_t hits;
+            uint32_t misses;
+            uint32_t invalidEntries;
+            uint32_t evictedEntries;
+        };
+
+        explicit ShaderCache(const std::string& directory, uint64_t maxSize = ShaderCacheDefaultMaxSize);
+
+        // Load the bytecode for a key. Returns false when the entry is missing or invalid.
+        bool load(const ShaderKey& key, std::vector<uint8_t>& bytecode);
+
+        // Store the bytecode for a key, then evict entries if needed. The entry is written to a temporary file first, so
+        // that other processes never see a partial entry.
+        bool store(const ShaderKey& key, const std::vector<uint8_t>& bytecode);
+
+        // Load the bytecode for a key, or compile and store it. Returns false when the shader does not compile.
+        bool getOrCompile(const ShaderKey& key, std::vector<uint8_t>& bytecode, const CompileFunction& compile);
+
+        // Evict the least recently used entries until the cache fits its size limit.
+        void trim();
+
+        // Delete all the entries.
+        void clear();
+
+        // The path of the entry for a key.
+        std::string entryPath(const ShaderKey& key) const;
+
+        const std::string& directory() const
+        {
+            return m_directory;
+        }
+
+        const Statistics& statistics() const
+        {
+            return m_statistics;
+        }
+
+    private:
+        const std::string m_directory;
+        const uint64_t m_maxSize;
+
+        Statistics m_statistics{};
+    };
+}
@@ -0,0 +1,92 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pch.h"
+
+#include <d3dcompiler.h>
+
+#include <DXUtilities.h>
+
+#include "Log.h"
+#include "ShaderCompiler.h"
+
+namespace nis_scaler
+{
+    std::vector<uint8_t> CompileShader(ShaderCache* const cache,
+                                       const std::string& source,
+                                       const std::string& sourceName,
+                                       const std::vector<std::string>& includes,
+                                       const D3D_SHADER_MACRO* const defines,
+                                       const char* const entryPoint,
+                                       const char* const target,
+                                       const UINT flags)
+    {
+        ShaderKey key;
+        key.source = source;
+        for (const std::string& include : includes)
+        {
+            key.source += ReadShaderFile(include);
+        }
+        for (const D3D_SHADER_MACRO* define = defines; define && define->Name; define++)
+        {
+            key.defines.emplace_back(define->Name, define->Definition ? define->Definition : "");
+        }
+        key.entryPoint = entryPoint;
+        key.target = target;
+        key.flags = flags;
+        key.compilerVersion = "d3dcompiler_" + std::to_string(D3D_COMPILER_VERSION);
+
+        HRESULT result = S_OK;
+        const auto compile = [&](std::vector<uint8_t>& bytecode) {
+            Log("Compiling %s:%s (%s)\n", sourceName.c_str(), entryPoint, target);
+
+            Microsoft::WRL::ComPtr<ID3DBlob> shaderBytes;
+            Microsoft::WRL::ComPtr<ID3DBlob> errors;
+            result = D3DCompile(source.c_str(), source.length(), sourceName.c_str(), defines, includes.empty() ? nullptr : D3D_COMPILE_STANDARD_FILE_INCLUDE,
+                                entryPoint, target, flags, 0, shaderBytes.GetAddressOf(), errors.GetAddressOf());
+            if (FAILED(result))
+            {
+                if (errors)
+                {
+                    Log("%s compile failed: %.*s\n", sourceName.c_str(), (int)errors->GetBufferSize(), (const char*)errors->GetBufferPointer());
+                }
+                return false;
+            }
+
+            const uint8_t* const bytes = static_cast<const uint8_t*>(shaderBytes->GetBufferPointer());
+            bytecode.assign(bytes, bytes + shaderBytes->GetBufferSize());
+            return true;
+        };
+
+        std::vector<uint8_t> bytecode;
+        if (!(cache ? cache->getOrCompile(key, bytecode, compile) : compile(bytecode)))
+        {
+            DX::ThrowIfFailed(result);
+        }
+        return bytecode;
+    }
+
+    std::string ReadShaderFile(const std::string& path)
+    {
+        std::ifstream file(path, std::ios_base::binary);
+        if (!file)
+        {
+            Log("Cannot read %s\n", path.c_str());
+            DX::ThrowIfFailed(HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND));
+        }
+        return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+}
@@ -0,0 +1,37 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "ShaderCache.h"
+
+namespace nis_scaler
+{
+    // Compile a shader with D3DCompile(), or load its bytecode from the cache (when not null). The includes are resolved
+    // relatively to sourceName, and their paths must be listed in includes so that the key of the cache covers them.
+    // Throws when the shader does not compile (the errors are logged).
+    std::vector<uint8_t> CompileShader(ShaderCache* cache,
+                                       const std::string& source,
+                                       const std::string& sourceName,
+                                       const std::vector<std::string>& includes,
+                                       const D3D_SHADER_MACRO* defines,
+                                       const char* entryPoint,
+                                       const char* target,
+                                       UINT flags);
+
+    // Read a shader source file. Throws when the file cannot be read.
+    std::string ReadShaderFile(const std::string& path);
+}
@@ -0,0 +1,93 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <map>
+#include <memory>
+
+namespace nis_scaler
+{
+    // A cache of objects shared by their users, like the scalers of the swapchains with the same geometry and settings.
+    // The cache only holds weak references: an object is destroyed with its last user, and created again by the next
+    // request for its key. Keys must be ordered (operator<). Keys of GPU objects should include the device, so that
+    // objects are never shared across devices.
+    template <typename Key, typename T>
+    class SharedCache
+    {
+    public:
+        struct Statistics
+        {
+            uint32_t created;
+            uint32_t reused;
+        };
+
+        // Return the live object for a key, or create it with create(), which returns a std::shared_ptr<T>. Nothing is
+        // cached when create() throws.
+        template <typename Factory>
+        std::shared_ptr<T> getOrCreate(const Key& key, const Factory& create)
+        {
+            prune();
+
+            const auto it = m_entries.find(key);
+            if (it != m_entries.end())
+            {
+                if (std::shared_ptr<T> object = it->second.lock())
+                {
+                    m_statistics.reused++;
+                    return object;
+                }
+            }
+
+            std::shared_ptr<T> object = create();
+            m_entries.insert_or_assign(key, object);
+            m_statistics.created++;
+            return object;
+        }
+
+        // The number of live objects.
+        size_t size() const
+        {
+            size_t count = 0;
+            for (const auto& entry : m_entries)
+            {
+                count += entry.second.expired() ? 0 : 1;
+            }
+            return count;
+        }
+
+        const Statistics& statistics() const
+        {
+            return m_statistics;
+        }
+
+    private:
+        // Forget the objects that were destroyed.
+        void prune()
+        {
+            for (auto it = m_entries.begin(); it != m_entries.end();)
+            {
+                it = it->second.expired() ? m_entries.erase(it) : std::next(it);
+            }
+        }
+
+        std::map<Key, std::weak_ptr<T>> m_entries;
+        Statistics m_statistics{};
+    };
+}
@@ -0,0 +1,190 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace nis_scaler
+{
+    // A histogram with fixed log-linear buckets, suitable for recording durations (in microseconds).
+    // Each power of two is split in SubBuckets linear buckets, which bounds the relative error of a percentile to
+    // 1/SubBuckets. Values below SubBuckets are recorded exactly. Recording is constant time and never allocates.
+    class LatencyHistogram
+    {
+    public:
+        static constexpr uint32_t SubBucketsLog2 = 3;
+        static constexpr uint32_t SubBuckets = 1 << SubBucketsLog2;
+        static constexpr size_t NumBuckets = SubBuckets + (64 - SubBucketsLog2) * SubBuckets;
+
+        void record(const uint64_t value)
+        {
+            m_buckets[bucketIndex(value)]++;
+            m_count++;
+            m_max = (std::max)(m_max, value);
+        }
+
+        void reset()
+        {
+            m_buckets.fill(0);
+            m_count = 0;
+            m_max = 0;
+        }
+
+        uint64_t count() const
+        {
+            return m_count;
+        }
+
+        uint64_t maximum() const
+        {
+            return m_max;
+        }
+
+        // Return the value below which the given fraction (0 to 1) of the samples fall. The result is the upper bound of
+        // the bucket containing that sample, capped to the largest recorded value.
+        uint64_t percentile(const double fraction) const
+        {
+            if (!m_count)
+            {
+                return 0;
+            }
+
+            const uint64_t rank = (std::max)((uint64_t)1, (uint64_t)(fraction * m_count + 0.5));
+            uint64_t seen = 0;
+            for (size_t i = 0; i < NumBuckets; i++)
+            {
+                seen += m_buckets[i];
+                if (seen >= rank)
+                {
+                    return (std::min)(bucketUpperBound(i), m_max);
+                }
+            }
+            return m_max;
+        }
+
+        static size_t bucketIndex(const uint64_t value)
+        {
+            if (value < SubBuckets)
+            {
+                return (size_t)value;
+            }
+
+            const uint32_t exponent = log2(value);
+            const uint32_t subBucket = (uint32_t)(value >> (exponent - SubBucketsLog2)) & (SubBuckets - 1);
+            return SubBuckets + (exponent - SubBucketsLog2) * SubBuckets + subBucket;
+        }
+
+        static uint64_t bucketUpperBound(const size_t index)
+        {
+            if (index < SubBuckets)
+            {
+                return index;
+            }
+
+            const uint32_t exponent = (uint32_t)((index - SubBuckets) / SubBuckets) + SubBucketsLog2;
+            const uint64_t subBucket = (index - SubBuckets) % SubBuckets;
+            const uint64_t width = 1ull << (exponent - SubBucketsLog2);
+            return (1ull << exponent) + (subBucket + 1) * width - 1;
+        }
+
+    private:
+        static uint32_t log2(uint64_t value)
+        {
+            uint32_t exponent = 0;
+            while (value >>= 1)
+            {
+                exponent++;
+            }
+            return exponent;
+        }
+
+        std::array<uint32_t, NumBuckets> m_buckets{};
+        uint64_t m_count{ 0 };
+        uint64_t m_max{ 0 };
+    };
+
+    // A ring of in-flight samples (typically GPU queries) that are read back several frames after being issued, so
+    // that reading them never stalls. When all the slots are in flight, the oldest sample is dropped to make room.
+    template <typename Slot, size_t Depth>
+    class PendingRing
+    {
+    public:
+        // The slot to record the next sample into. Must be followed by commit().
+        Slot& acquire()
+        {
+            if (m_count == Depth)
+            {
+                release();
+                m_dropped++;
+            }
+            return m_slots[(m_head + m_count) % Depth];
+        }
+
+        void commit()
+        {
+            m_count++;
+        }
+
+        // The slot returned by the last acquire().
+        Slot& current()
+        {
+            return m_slots[(m_head + m_count) % Depth];
+        }
+
+        // The oldest sample that was not read back yet, or nullptr if none.
+        Slot* oldest()
+        {
+            return m_count ? &m_slots[m_head] : nullptr;
+        }
+
+        // Retire the oldest sample.
+        void release()
+        {
+            m_head = (m_head + 1) % Depth;
+            m_count--;
+        }
+
+        // Count a sample that was read back but could not be used.
+        void discard()
+        {
+            release();
+            m_dropped++;
+        }
+
+        // Return the number of samples dropped since the last call.
+        uint64_t takeDropped()
+        {
+            const uint64_t dropped = m_dropped;
+            m_dropped = 0;
+            return dropped;
+        }
+
+        std::array<Slot, Depth>& slots()
+        {
+            return m_slots;
+        }
+
+    private:
+        std::array<Slot, Depth> m_slots{};
+        size_t m_head{ 0 };
+        size_t m_count{ 0 };
+        uint64_t m_dropped{ 0 };
+    };
+}
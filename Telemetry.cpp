@@ -0,0 +1,270 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// This file does not use the precompiled header, so it can be shared with the tools.
+
+#include "Telemetry.h"
+
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace nis_scaler
+{
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "Telemetry requires lock-free 64-bit atomics");
+    static_assert((TelemetryCapacity & (TelemetryCapacity - 1)) == 0, "TelemetryCapacity must be a power of two");
+
+#ifdef _WIN32
+    const std::string TelemetrySegmentName = "Local\\XR_APILAYER_NOVENDOR_nis_scaler_telemetry";
+#else
+    const std::string TelemetrySegmentName = "/XR_APILAYER_NOVENDOR_nis_scaler_telemetry";
+#endif
+
+    SharedMemory::~SharedMemory()
+    {
+        close();
+    }
+
+    bool SharedMemory::create(const std::string& name, const size_t size)
+    {
+        return map(name, size, true);
+    }
+
+    bool SharedMemory::open(const std::string& name, const size_t size)
+    {
+        return map(name, size, false);
+    }
+
+#ifdef _WIN32
+    bool SharedMemory::map(const std::string& name, const size_t size, const bool create)
+    {
+        close();
+
+        if (create)
+        {
+            m_mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, (DWORD)((uint64_t)size >> 32), (DWORD)size, name.c_str());
+        }
+        else
+        {
+            m_mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, name.c_str());
+        }
+        if (!m_mapping)
+        {
+            return false;
+        }
+
+        m_data = MapViewOfFile(m_mapping, create ? FILE_MAP_ALL_ACCESS : FILE_MAP_READ, 0, 0, size);
+        if (!m_data)
+        {
+            close();
+            return false;
+        }
+        m_size = size;
+
+        return true;
+    }
+
+    void SharedMemory::close()
+    {
+        if (m_data)
+        {
+            UnmapViewOfFile(m_data);
+            m_data = nullptr;
+        }
+        if (m_mapping)
+        {
+            CloseHandle(m_mapping);
+            m_mapping = nullptr;
+        }
+        m_size = 0;
+    }
+#else
+    bool SharedMemory::map(const std::string& name, const size_t size, const bool create)
+    {
+        close();
+
+        const int fd = shm_open(name.c_str(), create ? (O_CREAT | O_RDWR) : O_RDONLY, 0600);
+        if (fd < 0)
+        {
+            return false;
+        }
+        if (create && ftruncate(fd, (off_t)size) != 0)
+        {
+            ::close(fd);
+            return false;
+        }
+
+        void* const data = mmap(nullptr, size, create ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (data == MAP_FAILED)
+        {
+            return false;
+        }
+        m_data = data;
+        m_size = size;
+        m_name = name;
+        m_owner = create;
+
+        return true;
+    }
+
+    void SharedMemory::close()
+    {
+        if (m_data)
+        {
+            munmap(m_data, m_size);
+            m_data = nullptr;
+        }
+        if (m_owner)
+        {
+            shm_unlink(m_name.c_str());
+            m_owner = false;
+        }
+        m_size = 0;
+    }
+#endif
+
+    bool TelemetryWriter::open()
+    {
+        if (!m_memory.create(TelemetrySegmentName, sizeof(TelemetrySegment)))
+        {
+            return false;
+        }
+
+        // The segment might be left over from a previous session: start over.
+        m_segment = reinterpret_cast<TelemetrySegment*>(m_memory.data());
+        for (TelemetrySlot& slot : m_segment->slots)
+        {
+            slot.sequence.store(0, std::memory_order_relaxed);
+        }
+        m_segment->header.writeIndex.store(0, std::memory_order_relaxed);
+        m_segment->header.capacity = TelemetryCapacity;
+        m_segment->header.recordSize = sizeof(TelemetryRecord);
+        m_segment->header.version = TelemetryVersion;
+        std::atomic_thread_fence(std::memory_order_release);
+        m_segment->header.magic = TelemetryMagic;
+
+        return true;
+    }
+
+    void TelemetryWriter::close()
+    {
+        m_segment = nullptr;
+        m_memory.close();
+    }
+
+    void TelemetryWriter::publish(const TelemetryRecord& record)
+    {
+        if (!m_segment)
+        {
+            return;
+        }
+
+        const uint64_t index = m_segment->header.writeIndex.load(std::memory_order_relaxed);
+        TelemetrySlot& slot = m_segment->slots[index & (TelemetryCapacity - 1)];
+
+        // Mark the slot as being written, then publish the record.
+        slot.sequence.store(2 * index + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        std::memcpy(&slot.record, &record, sizeof(TelemetryRecord));
+        slot.sequence.store(2 * (index + 1), std::memory_order_release);
+
+        m_segment->header.writeIndex.store(index + 1, std::memory_order_release);
+    }
+
+    bool TelemetryReader::open()
+    {
+        if (!m_memory.open(TelemetrySegmentName, sizeof(TelemetrySegment)))
+        {
+            return false;
+        }
+
+        m_segment = reinterpret_cast<const TelemetrySegment*>(m_memory.data());
+        if (m_segment->header.magic != TelemetryMagic ||
+            m_segment->header.version != TelemetryVersion ||
+            m_segment->header.recordSize != sizeof(TelemetryRecord) ||
+            m_segment->header.capacity != TelemetryCapacity)
+        {
+            close();
+            return false;
+        }
+
+        // Only report the records published from now on.
+        m_readIndex = m_segment->header.writeIndex.load(std::memory_order_acquire);
+        m_overruns = m_tornReads = 0;
+
+        return true;
+    }
+
+    void TelemetryReader::close()
+    {
+        m_segment = nullptr;
+        m_memory.close();
+    }
+
+    bool TelemetryReader::read(TelemetryRecord& record)
+    {
+        if (!m_segment)
+        {
+            return false;
+        }
+
+        while (true)
+        {
+            const uint64_t writeIndex = m_segment->header.writeIndex.load(std::memory_order_acquire);
+            if (writeIndex < m_readIndex)
+            {
+                // The producer restarted.
+                m_readIndex = writeIndex;
+            }
+            if (m_readIndex == writeIndex)
+            {
+                return false;
+            }
+
+            // Skip the records that were already overwritten.
+            if (writeIndex - m_readIndex > TelemetryCapacity)
+            {
+                m_overruns += writeIndex - m_readIndex - TelemetryCapacity;
+                m_readIndex = writeIndex - TelemetryCapacity;
+            }
+
+            const TelemetrySlot& slot = m_segment->slots[m_readIndex & (TelemetryCapacity - 1)];
+            const uint64_t expected = 2 * (m_readIndex + 1);
+            const uint64_t sequenceBefore = slot.sequence.load(std::memory_order_acquire);
+            std::memcpy(&record, &slot.record, sizeof(TelemetryRecord));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            const uint64_t sequenceAfter = slot.sequence.load(std::memory_order_relaxed);
+
+            m_readIndex++;
+            if (sequenceBefore == expected && sequenceAfter == expected)
+            {
+                return true;
+            }
+
+            // The producer lapped us while we were copying the record.
+            m_tornReads++;
+            m_overruns++;
+        }
+    }
+}
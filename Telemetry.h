@@ -0,0 +1,166 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace nis_scaler
+{
+    // The per-frame record published by the layer.
+    struct TelemetryRecord
+    {
+        uint64_t frameIndex;
+
+        // CPU time spent inside xrEndFrame() (in microseconds).
+        uint32_t cpuTime;
+
+        // Most recent GPU times read back (in microseconds). These lag a few frames behind frameIndex.
+        uint32_t scalerTime;
+        uint32_t colorConversionTime;
+        uint32_t appGpuTime; // From xrBeginFrame() to xrEndFrame().
+
+        uint32_t scalingMode;
+        float sharpness;
+
+        // The render scale picked by dynamic resolution (or the configured scale when it is disabled).
+        float renderScale;
+
+        // The resolution rendered by the application and the resolution submitted to the runtime.
+        uint32_t renderWidth;
+        uint32_t renderHeight;
+        uint32_t displayWidth;
+        uint32_t displayHeight;
+    };
+
+    // Layout of the shared memory segment. The ring is written by a single producer (the layer) and can be read by any
+    // number of consumers. Each slot is protected by a sequence number (seqlock): the producer never waits, and readers
+    // detect records that were overwritten while they were being copied.
+    constexpr uint32_t TelemetryMagic = 0x4e495354; // 'NIST'
+    constexpr uint32_t TelemetryVersion = 2;
+    constexpr uint32_t TelemetryCapacity = 1024; // Must be a power of two.
+
+    struct TelemetrySlot
+    {
+        // 2 * (index + 1) once record #index is published, odd while it is being written.
+        std::atomic<uint64_t> sequence;
+        TelemetryRecord record;
+    };
+
+    struct TelemetryHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t recordSize;
+        uint32_t capacity;
+
+        // The number of records published so far.
+        std::atomic<uint64_t> writeIndex;
+    };
+
+    struct TelemetrySegment
+    {
+        TelemetryHeader header;
+        TelemetrySlot slots[TelemetryCapacity];
+    };
+
+    // The name of the shared memory segment.
+    extern const std::string TelemetrySegmentName;
+
+    // A named shared memory mapping.
+    class SharedMemory
+    {
+    public:
+        ~SharedMemory();
+
+        // Create the segment (producer) or open an existing one (consumer).
+        bool create(const std::string& name, size_t size);
+        bool open(const std::string& name, size_t size);
+        void close();
+
+        void* data() const
+        {
+            return m_data;
+        }
+
+    private:
+        bool map(const std::string& name, size_t size, bool create);
+
+        void* m_data{ nullptr };
+        size_t m_size{ 0 };
+#ifdef _WIN32
+        void* m_mapping{ nullptr };
+#else
+        std::string m_name;
+        bool m_owner{ false };
+#endif
+    };
+
+    class TelemetryWriter
+    {
+    public:
+        bool open();
+        void close();
+
+        bool isOpen() const
+        {
+            return m_segment != nullptr;
+        }
+
+        // Publish a record. This never blocks, and older records are overwritten when readers fall behind.
+        void publish(const TelemetryRecord& record);
+
+    private:
+        SharedMemory m_memory;
+        TelemetrySegment* m_segment{ nullptr };
+    };
+
+    class TelemetryReader
+    {
+    public:
+        bool open();
+        void close();
+
+        bool isOpen() const
+        {
+            return m_segment != nullptr;
+        }
+
+        // Read the next record, if any. Returns false when the reader has caught up with the producer.
+        // Records that were overwritten before they could be read are skipped and counted as overruns.
+        bool read(TelemetryRecord& record);
+
+        uint64_t overruns() const
+        {
+            return m_overruns;
+        }
+
+        uint64_t tornReads() const
+        {
+            return m_tornReads;
+        }
+
+    private:
+        SharedMemory m_memory;
+        const TelemetrySegment* m_segment{ nullptr };
+        uint64_t m_readIndex{ 0 };
+        uint64_t m_overruns{ 0 };
+        uint64_t m_tornReads{ 0 };
+    };
+}
@@ -0,0 +1,498 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Upscale images offline with the CPU implementation of NIS (see NISCpu.h).
+//
+// Usage: BatchScaler [options] <output directory> <input>...
+//
+// Options: --scaling <percent>[,<percent>...]     Default: 70, like the configuration file.
+//          --sharpness <percent>[,<percent>...]   Default: 50.
+//          --threads <count>                      Default: one per core.
+//          --png                                  Write PNG files when the format allows it.
+//
+// The inputs are DDS or PNG files, burst captures (the application's images are used), or directories of those. Each
+// image is treated as rendered at the scaling factor, and upscaled to the display resolution like the layer would: a
+// scaling of 100% only sharpens. Every image is processed for every combination of scaling and sharpness, and the
+// output files are named like the screenshots of the layer.
+//
+// The images stream through three stages (decode, scale, encode) running on a work-stealing pool. The number of
+// inputs in flight is bounded, which bounds the queues between the stages and the memory used.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "Capture.h"
+#include "NISCpu.h"
+#include "Screenshot.h"
+#include "WorkStealingPool.h"
+
+using namespace nis_scaler;
+
+namespace
+{
+    enum class Stage
+    {
+        Decode = 0,
+        Scale,
+        Encode,
+        EnumMax
+    };
+
+    const char* const StageNames[] = { "decode", "scale", "encode" };
+
+    // A burst capture, shared by the frames read from it.
+    struct CaptureSource
+    {
+        std::mutex mutex;
+        CaptureReader reader;
+    };
+
+    struct Input
+    {
+        std::string path;
+        std::string name; // The prefix of the output file names.
+        ImageFileFormat fileFormat;
+        std::shared_ptr<CaptureSource> capture;
+        CaptureIndexEntry entry{};
+    };
+
+    struct Settings
+    {
+        float scaleFactor;
+        float sharpness;
+    };
+
+    bool ParsePercentages(const char* list, std::vector<float>& values)
+    {
+        values.clear();
+        std::string value;
+        std::stringstream stream(list);
+        while (std::getline(stream, value, ','))
+        {
+            char* end;
+            const long percent = std::strtol(value.c_str(), &end, 10);
+            if (value.empty() || *end || percent < 0 || percent > 100)
+            {
+                return false;
+            }
+            values.push_back(percent / 100.f);
+        }
+        return !values.empty();
+    }
+
+    bool ReadFile(const std::string& path, std::vector<uint8_t>& data)
+    {
+        std::ifstream file(path, std::ios_base::binary);
+        if (!file)
+        {
+            return false;
+        }
+        data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        return !file.bad();
+    }
+
+    std::string Extension(const std::filesystem::path& path)
+    {
+        std::string extension = path.extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return (char)std::tolower(c); });
+        return extension;
+    }
+
+    bool AddInputs(const std::filesystem::path& path, std::vector<Input>& inputs)
+    {
+        std::error_code ec;
+        if (std::filesystem::is_directory(path, ec))
+        {
+            std::vector<std::filesystem::path> files;
+            for (const auto& entry : std::filesystem::directory_iterator(path, ec))
+            {
+                const std::string extension = Extension(entry.path());
+                if (entry.is_regular_file(ec) && (extension == ".dds" || extension == ".png" || extension == ".nisc"))
+                {
+                    files.push_back(entry.path());
+                }
+            }
+            std::sort(files.begin(), files.end());
+            for (const auto& file : files)
+            {
+                if (!AddInputs(file, inputs))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        const std::string extension = Extension(path);
+        if (extension == ".nisc")
+        {
+            auto capture = std::make_shared<CaptureSource>();
+            if (!capture->reader.open(path.string()))
+            {
+                std::fprintf(stderr, "Cannot read %s\n", path.string().c_str());
+                return false;
+            }
+            for (const CaptureIndexEntry& entry : capture->reader.frames())
+            {
+                if (entry.record.stage != CaptureStage::Input)
+                {
+                    continue;
+                }
+                char suffix[64];
+                std::snprintf(suffix, sizeof(suffix), "_frame%06llu_view%u", (unsigned long long)entry.record.frameIndex, entry.record.view);
+                inputs.push_back({ path.string(), path.stem().string() + suffix, ImageFileFormat::DDS, capture, entry });
+            }
+            return true;
+        }
+        else if (extension == ".dds" || extension == ".png")
+        {
+            inputs.push_back({ path.string(), path.stem().string(), extension == ".png" ? ImageFileFormat::PNG : ImageFileFormat::DDS, nullptr, {} });
+            return true;
+        }
+
+        std::fprintf(stderr, "Unsupported input %s\n", path.string().c_str());
+        return false;
+    }
+
+    class BatchScaler
+    {
+    public:
+        BatchScaler(const std::vector<Input>& inputs,
+                    const std::vector<Settings>& settings,
+                    const std::filesystem::path& outputDirectory,
+                    const bool usePng,
+                    const uint32_t numThreads)
+            : m_inputs(inputs), m_settings(settings), m_outputDirectory(outputDirectory), m_usePng(usePng),
+              m_kernel(DetectNISCpuKernel()), m_startTime(std::time(nullptr)), m_pool(numThreads)
+        {
+        }
+
+        int run()
+        {
+            const auto start = std::chrono::steady_clock::now();
+
+            // Enough inputs in flight to keep every worker busy while some of them wait on the disk.
+            const size_t maxInFlight = 2 * (size_t)m_pool.size();
+            for (size_t i = 0; i < maxInFlight; i++)
+            {
+                startNext();
+            }
+            m_pool.wait();
+
+            const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            const uint64_t numWritten = m_numWritten;
+            std::printf("%llu images written, %llu failed, in %.2f s: %.2f images/s, %.1f Mpixels/s (%s kernel, %u threads)\n",
+                (unsigned long long)numWritten, (unsigned long long)m_numFailed.load(), elapsed, numWritten / elapsed,
+                m_numPixelsWritten / (elapsed * 1e6), NISCpuKernelName(m_kernel), m_pool.size());
+
+            // The share of the worker time spent in each stage. The rest is the time spent idle or scheduling.
+            const double totalTime = elapsed * m_pool.size();
+            double busyTime = 0;
+            std::printf("stage,busy s,utilization\n");
+            for (int i = 0; i < (int)Stage::EnumMax; i++)
+            {
+                const double stageTime = m_busyTime[i] / 1e9;
+                busyTime += stageTime;
+                std::printf("%s,%.2f,%.1f%%\n", StageNames[i], stageTime, 100 * stageTime / totalTime);
+            }
+            std::printf("idle,%.2f,%.1f%%\n", totalTime - busyTime, 100 * (1 - busyTime / totalTime));
+
+            return m_numFailed ? 1 : 0;
+        }
+
+    private:
+        // The outputs of one input that are not written yet.
+        struct Pending
+        {
+            explicit Pending(size_t count) : remaining(count)
+            {
+            }
+
+            std::atomic<size_t> remaining;
+        };
+
+        class StageTimer
+        {
+        public:
+            StageTimer(BatchScaler& scaler, const Stage stage)
+                : m_scaler(scaler), m_stage(stage), m_start(std::chrono::steady_clock::now())
+            {
+            }
+
+            ~StageTimer()
+            {
+                m_scaler.m_busyTime[(int)m_stage] +=
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_start).count();
+            }
+
+        private:
+            BatchScaler& m_scaler;
+            const Stage m_stage;
+            const std::chrono::steady_clock::time_point m_start;
+        };
+
+        void startNext()
+        {
+            const size_t index = m_nextInput++;
+            if (index < m_inputs.size())
+            {
+                m_pool.submit([this, index] { decode(index); });
+            }
+        }
+
+        // Retire one output of an input, and start the next input after the last one.
+        void complete(const std::shared_ptr<Pending>& pending, const bool success)
+        {
+            (success ? m_numWritten : m_numFailed)++;
+            if (--pending->remaining == 0)
+            {
+                startNext();
+            }
+        }
+
+        void decode(const size_t index)
+        {
+            const Input& input = m_inputs[index];
+            auto pending = std::make_shared<Pending>(m_settings.size());
+            auto image = std::make_shared<CapturedImage>();
+
+            bool success;
+            {
+                StageTimer timer(*this, Stage::Decode);
+                if (input.capture)
+                {
+                    const CaptureFrameRecord& record = input.entry.record;
+                    image->width = record.width;
+                    image->height = record.height;
+                    image->format = record.format;
+                    std::unique_lock lock(input.capture->mutex);
+                    success = input.capture->reader.read(input.entry, image->pixels);
+                }
+                else
+                {
+                    std::vector<uint8_t> data;
+                    success = ReadFile(input.path, data) &&
+                              (input.fileFormat == ImageFileFormat::PNG ? DecodePNG(data.data(), data.size(), *image)
+                                                                        : DecodeDDS(data.data(), data.size(), *image));
+                }
+            }
+
+            if (!success)
+            {
+                std::fprintf(stderr, "Cannot read %s\n", input.name.c_str());
+                for (size_t i = 0; i < m_settings.size(); i++)
+                {
+                    complete(pending, false);
+                }
+                return;
+            }
+
+            for (const Settings& settings : m_settings)
+            {
+                m_pool.submit([this, index, image, pending, settings] { scale(index, image, pending, settings); });
+            }
+        }
+
+        void scale(const size_t index,
+                   const std::shared_ptr<const CapturedImage>& image,
+                   const std::shared_ptr<Pending>& pending,
+                   const Settings& settings)
+        {
+            const Input& input = m_inputs[index];
+            auto output = std::make_shared<CapturedImage>();
+
+            bool success;
+            {
+                StageTimer timer(*this, Stage::Scale);
+
+                // The buffers are reused by the tasks running on the same worker.
+                thread_local NISCpuImage source;
+                thread_local NISCpuImage destination;
+                success = ConvertToFloat(*image, source.pixels);
+                if (success)
+                {
+                    source.width = image->width;
+                    source.height = image->height;
+
+                    // The images are processed in parallel, rather than the bands of one image.
+                    NISConfig config{};
+                    if (settings.scaleFactor < 1.f)
+                    {
+                        const uint32_t width = (std::max)((uint32_t)std::lround(source.width / settings.scaleFactor), 1u);
+                        const uint32_t height = (std::max)((uint32_t)std::lround(source.height / settings.scaleFactor), 1u);
+                        NVScalerUpdateConfig(config, settings.sharpness, 0, 0, source.width, source.height, source.width,
+                            source.height, 0, 0, width, height, width, height);
+                        destination.resize(width, height);
+                        NISCpuScale(config, source, destination, m_kernel, 1);
+                    }
+                    else
+                    {
+                        NVSharpenUpdateConfig(config, settings.sharpness, 0, 0, source.width, source.height, source.width,
+                            source.height, 0, 0);
+                        NISCpuSharpen(config, source, destination, m_kernel, 1);
+                    }
+
+                    output->width = destination.width;
+                    output->height = destination.height;
+                    output->format = image->format;
+                    output->fileFormat =
+                        (m_usePng || input.fileFormat == ImageFileFormat::PNG) && IsPngCompatible(image->format)
+                            ? ImageFileFormat::PNG
+                            : ImageFileFormat::DDS;
+                    output->path = (m_outputDirectory / ScreenshotFileName(input.name, true, settings.scaleFactor,
+                        settings.sharpness, m_startTime, output->fileFormat)).string();
+                    success = ConvertFromFloat(destination.pixels.data(), *output);
+                }
+            }
+
+            if (!success)
+            {
+                std::fprintf(stderr, "Cannot scale %s (format %u)\n", input.name.c_str(), image->format);
+                complete(pending, false);
+                return;
+            }
+
+            m_pool.submit([this, output, pending] { encode(output, pending); });
+        }
+
+        void encode(const std::shared_ptr<const CapturedImage>& image, const std::shared_ptr<Pending>& pending)
+        {
+            bool success;
+            {
+                StageTimer timer(*this, Stage::Encode);
+
+                std::vector<uint8_t> encoded;
+                success = image->fileFormat == ImageFileFormat::PNG ? EncodePNG(*image, encoded) : EncodeDDS(*image, encoded);
+                if (success)
+                {
+                    std::ofstream file(image->path, std::ios_base::binary | std::ios_base::trunc);
+                    file.write(reinterpret_cast<const char*>(encoded.data()), encoded.size());
+                    success = !!file;
+                }
+            }
+
+            if (success)
+            {
+                m_numPixelsWritten += (uint64_t)image->width * image->height;
+            }
+            else
+            {
+                std::fprintf(stderr, "Cannot write %s\n", image->path.c_str());
+            }
+            complete(pending, success);
+        }
+
+        const std::vector<Input>& m_inputs;
+        const std::vector<Settings>& m_settings;
+        const std::filesystem::path m_outputDirectory;
+        const bool m_usePng;
+        const NISCpuKernel m_kernel;
+        const std::time_t m_startTime;
+
+        std::atomic<size_t> m_nextInput{ 0 };
+        std::atomic<uint64_t> m_numWritten{ 0 };
+        std::atomic<uint64_t> m_numFailed{ 0 };
+        std::atomic<uint64_t> m_numPixelsWritten{ 0 };
+        std::atomic<uint64_t> m_busyTime[(int)Stage::EnumMax]{};
+
+        // Last, so that the workers are stopped before the rest is destroyed.
+        WorkStealingPool m_pool;
+    };
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<float> scaleFactors = { 0.7f };
+    std::vector<float> sharpnesses = { 0.5f };
+    uint32_t numThreads = (std::max)(std::thread::hardware_concurrency(), 1u);
+    bool usePng = false;
+    std::vector<std::string> arguments;
+
+    bool isValid = true;
+    for (int i = 1; i < argc && isValid; i++)
+    {
+        const std::string argument = argv[i];
+        if (argument == "--scaling" && i + 1 < argc)
+        {
+            isValid = ParsePercentages(argv[++i], scaleFactors) &&
+                      std::none_of(scaleFactors.begin(), scaleFactors.end(), [](float value) { return value <= 0.f; });
+        }
+        else if (argument == "--sharpness" && i + 1 < argc)
+        {
+            isValid = ParsePercentages(argv[++i], sharpnesses);
+        }
+        else if (argument == "--threads" && i + 1 < argc)
+        {
+            numThreads = (uint32_t)std::strtoul(argv[++i], nullptr, 10);
+            isValid = numThreads > 0;
+        }
+        else if (argument == "--png")
+        {
+            usePng = true;
+        }
+        else
+        {
+            isValid = argument.rfind("--", 0) != 0;
+            arguments.push_back(argument);
+        }
+    }
+
+    if (!isValid || arguments.size() < 2)
+    {
+        std::fprintf(stderr,
+            "Usage: BatchScaler [--scaling <percent>[,...]] [--sharpness <percent>[,...]] [--threads <count>] [--png]\n"
+            "                   <output directory> <input>...\n");
+        return 1;
+    }
+
+    std::vector<Input> inputs;
+    for (size_t i = 1; i < arguments.size(); i++)
+    {
+        if (!AddInputs(arguments[i], inputs))
+        {
+            return 1;
+        }
+    }
+
+    std::vector<Settings> settings;
+    for (const float scaleFactor : scaleFactors)
+    {
+        for (const float sharpness : sharpnesses)
+        {
+            settings.push_back({ scaleFactor, sharpness });
+        }
+    }
+
+    const std::filesystem::path outputDirectory = arguments[0];
+    std::error_code ec;
+    std::filesystem::create_directories(outputDirectory, ec);
+
+    std::printf("%zu images x %zu settings\n", inputs.size(), settings.size());
+    return BatchScaler(inputs, settings, outputDirectory, usePng, numThreads).run();
+}
@@ -0,0 +1,172 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A thread pool with one task deque per worker.
+//
+// A task submitted from a worker goes to the back of that worker's deque, and the worker takes its own tasks from the
+// back: the task that a stage produces runs next, on the same core, while its input is still in the cache. Idle workers
+// steal from the front of the other deques, where the oldest tasks are.
+
+class WorkStealingPool
+{
+public:
+    explicit WorkStealingPool(uint32_t numWorkers)
+    {
+        for (uint32_t i = 0; i < numWorkers; i++)
+        {
+            m_workers.push_back(std::make_unique<Worker>());
+        }
+        for (uint32_t i = 0; i < numWorkers; i++)
+        {
+            m_threads.emplace_back([this, i] { run(i); });
+        }
+    }
+
+    ~WorkStealingPool()
+    {
+        wait();
+        {
+            std::unique_lock lock(m_mutex);
+            m_stop = true;
+        }
+        m_wakeUp.notify_all();
+        for (std::thread& thread : m_threads)
+        {
+            thread.join();
+        }
+    }
+
+    uint32_t size() const
+    {
+        return (uint32_t)m_workers.size();
+    }
+
+    void submit(std::function<void()> task)
+    {
+        uint32_t index = CurrentWorker;
+        if (CurrentPool != this)
+        {
+            std::unique_lock lock(m_mutex);
+            index = m_nextWorker++ % size();
+        }
+        {
+            std::unique_lock lock(m_workers[index]->mutex);
+            m_workers[index]->tasks.push_back(std::move(task));
+        }
+        {
+            std::unique_lock lock(m_mutex);
+            m_numQueued++;
+            m_numPending++;
+        }
+        m_wakeUp.notify_one();
+    }
+
+    // Wait until all the tasks, including the ones they submit, are done.
+    void wait()
+    {
+        std::unique_lock lock(m_mutex);
+        m_idle.wait(lock, [&] { return m_numPending == 0; });
+    }
+
+private:
+    struct Worker
+    {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    bool tryPop(const uint32_t index, std::function<void()>& task)
+    {
+        for (uint32_t i = 0; i < size(); i++)
+        {
+            Worker& worker = *m_workers[(index + i) % size()];
+            std::unique_lock lock(worker.mutex);
+            if (!worker.tasks.empty())
+            {
+                if (i == 0)
+                {
+                    task = std::move(worker.tasks.back());
+                    worker.tasks.pop_back();
+                }
+                else
+                {
+                    task = std::move(worker.tasks.front());
+                    worker.tasks.pop_front();
+                }
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void run(const uint32_t index)
+    {
+        CurrentPool = this;
+        CurrentWorker = index;
+
+        while (true)
+        {
+            // Reserve one of the queued tasks before looking for it, so that a worker never spins on an empty pool.
+            {
+                std::unique_lock lock(m_mutex);
+                m_wakeUp.wait(lock, [&] { return m_numQueued > 0 || m_stop; });
+                if (m_numQueued == 0)
+                {
+                    return;
+                }
+                m_numQueued--;
+            }
+
+            std::function<void()> task;
+            while (!tryPop(index, task))
+            {
+                std::this_thread::yield();
+            }
+            task();
+
+            std::unique_lock lock(m_mutex);
+            if (--m_numPending == 0)
+            {
+                m_idle.notify_all();
+            }
+        }
+    }
+
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    std::vector<std::thread> m_threads;
+
+    std::mutex m_mutex;
+    std::condition_variable m_wakeUp;
+    std::condition_variable m_idle;
+    size_t m_numQueued{ 0 };
+    size_t m_numPending{ 0 };
+    uint32_t m_nextWorker{ 0 };
+    bool m_stop{ false };
+
+    static inline thread_local const WorkStealingPool* CurrentPool{ nullptr };
+    static inline thread_local uint32_t CurrentWorker{ 0 };
+};
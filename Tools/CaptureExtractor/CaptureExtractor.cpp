@@ -0,0 +1,248 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// List and extract the frames of a burst capture (see Capture.h).
+//
+// Usage: CaptureExtractor <capture.nisc>
+//        CaptureExtractor <capture.nisc> <directory> [--png]
+//        CaptureExtractor --benchmark <capture.nisc> [frames [WIDTHxHEIGHT [fps [budgetMB]]]]
+//
+// The benchmark streams synthetic frames of two views through the capture writer at the given frame rate, like the
+// layer does, then reports the throughput, the frames dropped, and verifies the file.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+
+#include "Capture.h"
+#include "Screenshot.h"
+
+using namespace nis_scaler;
+
+namespace
+{
+    const char* StageName(const CaptureStage stage)
+    {
+        return stage == CaptureStage::Input ? "input" : "output";
+    }
+
+    int List(const char* path)
+    {
+        CaptureReader reader;
+        if (!reader.open(path))
+        {
+            std::fprintf(stderr, "Cannot read %s\n", path);
+            return 1;
+        }
+        if (!reader.isComplete())
+        {
+            std::fprintf(stderr, "The capture is incomplete, %zu frames were recovered\n", reader.frames().size());
+        }
+
+        std::printf("application=%s\n", reader.applicationName().c_str());
+        std::printf("frameIndex,displayTime,view,stage,width,height,format,scalingMode,scaleFactor,sharpness\n");
+        for (const CaptureIndexEntry& entry : reader.frames())
+        {
+            const CaptureFrameRecord& record = entry.record;
+            std::printf("%llu,%lld,%u,%s,%u,%u,%u,%u,%.3f,%.3f\n",
+                (unsigned long long)record.frameIndex, (long long)record.displayTime, record.view, StageName(record.stage),
+                record.width, record.height, record.format, record.scalingMode, record.scaleFactor, record.sharpness);
+        }
+
+        return 0;
+    }
+
+    int Extract(const char* path, const char* directory, const bool usePng)
+    {
+        CaptureReader reader;
+        if (!reader.open(path))
+        {
+            std::fprintf(stderr, "Cannot read %s\n", path);
+            return 1;
+        }
+        if (!reader.isComplete())
+        {
+            std::fprintf(stderr, "The capture is incomplete, %zu frames were recovered\n", reader.frames().size());
+        }
+
+        std::error_code ec;
+        std::filesystem::create_directories(directory, ec);
+
+        std::vector<uint8_t> encoded;
+        uint32_t numExtracted = 0;
+        for (const CaptureIndexEntry& entry : reader.frames())
+        {
+            const CaptureFrameRecord& record = entry.record;
+
+            CapturedImage image;
+            image.width = record.width;
+            image.height = record.height;
+            image.format = record.format;
+            image.fileFormat = usePng && IsPngCompatible(record.format) ? ImageFileFormat::PNG : ImageFileFormat::DDS;
+            if (!reader.read(entry, image.pixels))
+            {
+                std::fprintf(stderr, "Cannot read frame %llu\n", (unsigned long long)record.frameIndex);
+                continue;
+            }
+
+            const bool encodeSuccess =
+                image.fileFormat == ImageFileFormat::PNG ? EncodePNG(image, encoded) : EncodeDDS(image, encoded);
+            if (!encodeSuccess)
+            {
+                std::fprintf(stderr, "Cannot encode frame %llu (format %u)\n", (unsigned long long)record.frameIndex, record.format);
+                continue;
+            }
+
+            char fileName[256];
+            std::snprintf(fileName, sizeof(fileName), "frame_%06llu_view%u_%s.%s", (unsigned long long)record.frameIndex,
+                record.view, StageName(record.stage), image.fileFormat == ImageFileFormat::PNG ? "png" : "dds");
+            const std::string filePath = (std::filesystem::path(directory) / fileName).string();
+            std::ofstream file(filePath, std::ios_base::binary | std::ios_base::trunc);
+            file.write(reinterpret_cast<const char*>(encoded.data()), encoded.size());
+            if (!file)
+            {
+                std::fprintf(stderr, "Cannot write %s\n", filePath.c_str());
+                return 1;
+            }
+            numExtracted++;
+        }
+
+        std::printf("Extracted %u frames to %s\n", numExtracted, directory);
+        return 0;
+    }
+
+    int Benchmark(int argc, char** argv)
+    {
+        const uint32_t numFrames = argc > 3 ? (uint32_t)std::strtoul(argv[3], nullptr, 10) : 270;
+        uint32_t width = 2048, height = 2048;
+        if (argc > 4 && std::sscanf(argv[4], "%ux%u", &width, &height) != 2)
+        {
+            std::fprintf(stderr, "Invalid resolution %s\n", argv[4]);
+            return 1;
+        }
+        const double fps = argc > 5 ? std::strtod(argv[5], nullptr) : 90.0;
+        const size_t budget = (argc > 6 ? std::strtoull(argv[6], nullptr, 10) : 512) * 1024 * 1024;
+        const uint32_t numViews = 2;
+        const uint32_t format = 28; // DXGI_FORMAT_R8G8B8A8_UNORM
+        const size_t frameSize = (size_t)width * height * 4;
+
+        CaptureWriter writer;
+        if (!writer.open(argv[2], "CaptureExtractor", budget))
+        {
+            std::fprintf(stderr, "Cannot write %s\n", argv[2]);
+            return 1;
+        }
+
+        // Synthetic frames: a different byte value per image, so that the contents can be verified.
+        const auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / fps));
+        double maxSubmitTime = 0;
+        uint32_t numSubmitted = 0;
+        // Like the layer, announce the frames when they are copied on the GPU, a frame before they are read back.
+        writer.reserve(frameSize);
+        std::this_thread::sleep_for(period);
+        const auto start = std::chrono::steady_clock::now();
+        auto nextFrame = start;
+
+        for (uint32_t i = 0; i < numFrames; i++)
+        {
+            for (uint32_t view = 0; view < numViews; view++)
+            {
+                const auto submitStart = std::chrono::steady_clock::now();
+
+                CapturedFrame frame{};
+                frame.record.frameIndex = i;
+                frame.record.displayTime = std::chrono::duration_cast<std::chrono::nanoseconds>(nextFrame - start).count();
+                frame.record.view = view;
+                frame.record.stage = CaptureStage::Output;
+                frame.record.width = width;
+                frame.record.height = height;
+                frame.record.format = format;
+                if (writer.allocate(frameSize, frame.pixels))
+                {
+                    std::memset(frame.pixels.data(), (uint8_t)(i * numViews + view), frameSize);
+                    writer.submit(std::move(frame));
+                    numSubmitted++;
+                }
+
+                maxSubmitTime = (std::max)(maxSubmitTime, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - submitStart).count());
+            }
+
+            nextFrame += period;
+            std::this_thread::sleep_until(nextFrame);
+        }
+        const auto captureEnd = std::chrono::steady_clock::now();
+        writer.close();
+        const auto end = std::chrono::steady_clock::now();
+
+        const double captureTime = std::chrono::duration<double>(captureEnd - start).count();
+        const double totalTime = std::chrono::duration<double>(end - start).count();
+        std::printf("%u frames of %ux%u x%u views at %.1f fps (%.1f MB/s requested)\n",
+            numFrames, width, height, numViews, fps, numViews * frameSize * fps / (1024 * 1024));
+        std::printf("written: %u, dropped: %llu, max submit time: %.3f ms\n", numSubmitted, (unsigned long long)writer.droppedFrames(), maxSubmitTime);
+        std::printf("throughput: %.1f MB/s, drain time after the last frame: %.3f s\n",
+            numSubmitted * frameSize / totalTime / (1024 * 1024), totalTime - captureTime);
+
+        // Verify the file.
+        CaptureReader reader;
+        if (!reader.open(argv[2]) || !reader.isComplete() || reader.frames().size() != numSubmitted)
+        {
+            std::fprintf(stderr, "Verification failed: the index is missing or incomplete\n");
+            return 1;
+        }
+        std::vector<uint8_t> pixels;
+        for (const CaptureIndexEntry& entry : reader.frames())
+        {
+            const uint8_t expected = (uint8_t)(entry.record.frameIndex * numViews + entry.record.view);
+            if (!reader.read(entry, pixels) || pixels.size() != frameSize ||
+                std::any_of(pixels.begin(), pixels.end(), [&](uint8_t value) { return value != expected; }))
+            {
+                std::fprintf(stderr, "Verification failed for frame %llu view %u\n", (unsigned long long)entry.record.frameIndex, entry.record.view);
+                return 1;
+            }
+        }
+        std::printf("%s verified\n", argv[2]);
+
+        return 0;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const std::string command = argc > 1 ? argv[1] : "";
+    if (command == "--benchmark" && argc >= 3)
+    {
+        return Benchmark(argc, argv);
+    }
+    else if (argc == 2 && command.rfind("--", 0) != 0)
+    {
+        return List(argv[1]);
+    }
+    else if ((argc == 3 || (argc == 4 && std::string(argv[3]) == "--png")) && command.rfind("--", 0) != 0)
+    {
+        return Extract(argv[1], argv[2], argc == 4);
+    }
+
+    std::fprintf(stderr,
+        "Usage: CaptureExtractor <capture.nisc>\n"
+        "       CaptureExtractor <capture.nisc> <directory> [--png]\n"
+        "       CaptureExtractor --benchmark <capture.nisc> [frames [WIDTHxHEIGHT [fps [budgetMB]]]]\n");
+    return 1;
+}
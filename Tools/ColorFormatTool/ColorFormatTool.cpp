@@ -0,0 +1,289 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+// Check the color conversions of the layer (see ColorEncoding.h) against the Direct3D rules for the sRGB formats, and the
+// texel adapters of each format (see ColorFormats.h).
+//
+// Usage: ColorFormatTool --check
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "ColorEncoding.h"
+#include "ColorFormats.h"
+
+using namespace nis_scaler;
+
+namespace
+{
+    // The sRGB encoding in double precision, as the reference for the tolerance of the hardware.
+    double ReferenceLinearToSrgb(const double value)
+    {
+        return value <= 0.0031308 ? value * 12.92 : 1.055 * std::pow(value, 1.0 / 2.4) - 0.055;
+    }
+
+    bool IsSameValue(const float a, const float b)
+    {
+        return (std::isnan(a) && std::isnan(b)) || std::memcmp(&a, &b, sizeof(float)) == 0;
+    }
+
+    // Whether a texel is the one written back for its value: NaN payloads, the X channel and the -128 of SNORM have
+    // several encodings.
+    bool IsCanonical(const ColorFormatInfo& info, const uint8_t* texel, const float* rgba)
+    {
+        for (uint32_t c = 0; c < 4; c++)
+        {
+            if (std::isnan(rgba[c]) || (info.layout == TexelLayout::RGBA8Snorm && texel[c] == 0x80))
+            {
+                return false;
+            }
+        }
+        return info.layout != TexelLayout::BGRX8Unorm || texel[3] == 0xff;
+    }
+
+    // The texels to round trip: every code of every channel, and random texels. The windows of 11 consecutive bits at each
+    // position (32-bit texels) and the texels with the same 16-bit code in each channel (64-bit texels) cover all the codes
+    // of each channel.
+    std::vector<uint8_t> MakeTexels(const ColorFormatInfo& info)
+    {
+        std::vector<uint8_t> texels;
+        const auto append = [&](const void* texel) {
+            const uint8_t* const bytes = reinterpret_cast<const uint8_t*>(texel);
+            texels.insert(texels.end(), bytes, bytes + info.bytesPerPixel);
+        };
+        if (info.bytesPerPixel == 4)
+        {
+            for (uint32_t shift = 0; shift < 32; shift++)
+            {
+                for (uint32_t i = 0; i < 1u << 11; i++)
+                {
+                    const uint32_t texel = i << shift;
+                    append(&texel);
+                }
+            }
+        }
+        else if (info.bytesPerPixel == 8)
+        {
+            for (uint32_t i = 0; i < 1u << 16; i++)
+            {
+                const uint64_t texel = i * 0x0001000100010001ull;
+                append(&texel);
+            }
+        }
+        uint64_t seed = 0x9e3779b97f4a7c15ull;
+        for (uint32_t i = 0; i < (1u << 20) * info.bytesPerPixel; i++)
+        {
+            seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+            texels.push_back((uint8_t)(seed >> 56));
+        }
+        return texels;
+    }
+
+    int Check()
+    {
+        int result = 0;
+        const auto expect = [&](const char* name, const uint32_t errors) {
+            std::printf("%s: %s", name, !errors ? "ok\n" : "FAILED");
+            if (errors)
+            {
+                std::printf(" (%u errors)\n", errors);
+                result = 1;
+            }
+        };
+
+        // The decode table covers [0, 1] and is strictly increasing.
+        {
+            uint32_t errors = DecodeSrgb8(0) != 0.f || DecodeSrgb8(255) != 1.f;
+            for (uint32_t i = 1; i < 256; i++)
+            {
+                errors += DecodeSrgb8((uint8_t)i) <= DecodeSrgb8((uint8_t)(i - 1));
+            }
+            expect("sRGB decode", errors);
+        }
+
+        // Writing a decoded texel through an _SRGB view gives back the texel.
+        {
+            uint32_t errors = 0;
+            for (uint32_t i = 0; i < 256; i++)
+            {
+                errors += EncodeSrgb8(DecodeSrgb8((uint8_t)i)) != i;
+            }
+            expect("sRGB round trip", errors);
+        }
+
+        // The encode is within the 0.6 ULP allowed by Direct3D for float to sRGB conversions, and saturates.
+        {
+            uint32_t errors = EncodeSrgb8(-1.f) != 0 || EncodeSrgb8(2.f) != 255 || EncodeSrgb8(NAN) != 0;
+            constexpr uint32_t Steps = 1 << 20;
+            for (uint32_t i = 0; i <= Steps; i++)
+            {
+                const float linear = (float)i / Steps;
+                const double exact = ReferenceLinearToSrgb(linear) * 255.0;
+                errors += std::abs(EncodeSrgb8(linear) - exact) > 0.6;
+            }
+            expect("sRGB encode", errors);
+        }
+
+        // The encode of the scalers matches the hardware encode for every texel written back, and is within the same 0.6
+        // ULP elsewhere.
+        {
+            uint32_t errors = EncodeSrgb8InShader(-1.f) != 0 || EncodeSrgb8InShader(2.f) != 255 || EncodeSrgb8InShader(NAN) != 0;
+            for (uint32_t i = 0; i < 256; i++)
+            {
+                errors += EncodeSrgb8InShader(DecodeSrgb8((uint8_t)i)) != EncodeSrgb8(DecodeSrgb8((uint8_t)i));
+            }
+            constexpr uint32_t Steps = 1 << 20;
+            for (uint32_t i = 0; i <= Steps; i++)
+            {
+                const float linear = (float)i / Steps;
+                const double exact = ReferenceLinearToSrgb(linear) * 255.0;
+                errors += std::abs(EncodeSrgb8InShader(linear) - exact) > 0.6;
+            }
+            expect("sRGB shader encode", errors);
+        }
+
+        // With an sRGB swapchain, the scaler reads linear values through an _SRGB view of the application's texture, and
+        // either writes them to an intermediate texture (16-bit UNORM) that is copied to the runtime texture through an
+        // _SRGB view, or encodes them itself through a UNORM view of the runtime texture. Where the scaler leaves a value
+        // unchanged, both paths give back the texel of the application.
+        {
+            uint32_t errors = 0;
+            for (uint32_t i = 0; i < 256; i++)
+            {
+                const uint8_t converted = EncodeSrgb8(DequantizeUnorm16(QuantizeUnorm16(DecodeSrgb8((uint8_t)i))));
+                const uint8_t aliased = EncodeSrgb8InShader(DecodeSrgb8((uint8_t)i));
+                errors += converted != i || aliased != i;
+            }
+            expect("sRGB aliased output", errors);
+        }
+
+        size_t formatCount;
+        const ColorFormatInfo* const formats = GetColorFormats(formatCount);
+
+        // The formats of a family have the same layout.
+        {
+            uint32_t errors = 0;
+            for (size_t i = 0; i < formatCount; i++)
+            {
+                const ColorFormatInfo* const alias = GetColorFormatInfo(formats[i].aliasFormat);
+                const ColorFormatInfo* const typeless = formats[i].typelessFormat ? GetColorFormatInfo(formats[i].typelessFormat) : &formats[i];
+                errors += !alias || alias->layout != formats[i].layout || alias->bytesPerPixel != formats[i].bytesPerPixel ||
+                          (formats[i].scalerSupport == ScalerSupport::Indirect && alias == &formats[i]) || !typeless ||
+                          typeless->bytesPerPixel != formats[i].bytesPerPixel;
+            }
+            expect("format table", errors);
+        }
+
+        // Reading a texel, writing it back and reading it again gives the same value, and the same texel unless the value
+        // has several encodings.
+        for (size_t i = 0; i < formatCount; i++)
+        {
+            const ColorFormatInfo& info = formats[i];
+            const std::vector<uint8_t> texels = MakeTexels(info);
+            const size_t count = texels.size() / info.bytesPerPixel;
+            std::vector<float> values(count * 4), roundTripValues(count * 4);
+            std::vector<uint8_t> roundTripTexels(texels.size());
+            LoadTexels(info, texels.data(), count, values.data());
+            StoreTexels(info, values.data(), count, roundTripTexels.data());
+            LoadTexels(info, roundTripTexels.data(), count, roundTripValues.data());
+
+            uint32_t errors = 0;
+            for (size_t j = 0; j < count; j++)
+            {
+                const size_t offset = j * info.bytesPerPixel;
+                bool isSame = !IsCanonical(info, texels.data() + offset, values.data() + 4 * j) ||
+                              std::memcmp(texels.data() + offset, roundTripTexels.data() + offset, info.bytesPerPixel) == 0;
+                for (uint32_t c = 0; c < 4; c++)
+                {
+                    isSame = isSame && IsSameValue(values[4 * j + c], roundTripValues[4 * j + c]);
+                }
+                errors += !isSame;
+            }
+            expect((std::string("round trip ") + info.name).c_str(), errors);
+        }
+
+        // Known texels, for the swizzle and the packing: (1, 0.5, 0.25, 1).
+        {
+            const struct
+            {
+                TexelLayout layout;
+                uint64_t texel;
+            } expected[] = {
+                { TexelLayout::RGBA8Unorm, 0xff4080ff },
+                { TexelLayout::RGBA8Snorm, 0x7f20407f },
+                { TexelLayout::RGBA8Uint, 0x01000101 },
+                { TexelLayout::RGBA8Sint, 0x01000101 },
+                { TexelLayout::BGRA8Unorm, 0xffff8040 },
+                { TexelLayout::BGRX8Unorm, 0xffff8040 },
+                { TexelLayout::RGB10A2Unorm, 0xd00803ff },
+                { TexelLayout::RG11B10Float, 0x681c03c0 },
+                { TexelLayout::RGBA16Unorm, 0xffff40008000ffffull },
+                { TexelLayout::RGBA16Float, 0x3c00340038003c00ull },
+            };
+            const float value[] = { 1.f, 0.5f, 0.25f, 1.f };
+            uint32_t errors = 0;
+            for (size_t i = 0; i < formatCount; i++)
+            {
+                for (const auto& entry : expected)
+                {
+                    if (entry.layout == formats[i].layout)
+                    {
+                        uint64_t texel = 0;
+                        StoreTexels(formats[i], value, 1, reinterpret_cast<uint8_t*>(&texel));
+                        errors += texel != entry.texel;
+                    }
+                }
+            }
+            expect("known texels", errors);
+        }
+
+        // The HDR formats keep the values above 1, the other ones saturate them.
+        {
+            const float value[] = { 4.f, 4.f, 4.f, 4.f };
+            uint32_t errors = 0;
+            for (size_t i = 0; i < formatCount; i++)
+            {
+                if (formats[i].layout == TexelLayout::RGBA8Uint || formats[i].layout == TexelLayout::RGBA8Sint)
+                {
+                    continue;
+                }
+                uint8_t texel[16];
+                float roundTrip[4];
+                StoreTexels(formats[i], value, 1, texel);
+                LoadTexels(formats[i], texel, 1, roundTrip);
+                errors += roundTrip[0] != (formats[i].isHdr ? 4.f : 1.f);
+            }
+            expect("HDR range", errors);
+        }
+
+        return result;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (argc == 2 && std::string(argv[1]) == "--check")
+    {
+        return Check();
+    }
+
+    std::fprintf(stderr, "Usage: %s --check\n", argv[0]);
+    return 1;
+}
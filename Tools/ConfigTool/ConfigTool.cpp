@@ -0,0 +1,212 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+// Check the configuration file source and the reloading of the configuration (see Config.h).
+//
+// Usage: ConfigTool --check
+//
+// The check writes configuration files to the temporary directory and loads them with FileConfigSource: per-application
+// and global scopes, comments and invalid lines. Then it watches a file with ConfigWatcher (inotify on Linux) while the
+// file is rewritten in place and replaced like editors do, and verifies that each change publishes a new snapshot, that
+// other files in the directory do not, and that the replaced snapshots are reclaimed after the grace period.
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+
+#include "Config.h"
+
+using namespace nis_scaler;
+
+namespace
+{
+    const std::string ApplicationName = "ConfigTool";
+
+    void WriteFile(const std::filesystem::path& path, const std::string& content)
+    {
+        std::ofstream file(path, std::ios_base::trunc);
+        file << content;
+    }
+
+    // Write a new file and move it over the old one.
+    void ReplaceFile(const std::filesystem::path& path, const std::string& content)
+    {
+        std::filesystem::path temporary(path);
+        temporary += ".tmp";
+        WriteFile(temporary, content);
+        std::filesystem::rename(temporary, path);
+    }
+
+    std::string MakeSettings(const int sharpness)
+    {
+        return "enabled=0\n[" + ApplicationName + "]\nenabled=1\nsharpness=" + std::to_string(sharpness) + "\n";
+    }
+
+    bool IsEqual(const float a, const float b)
+    {
+        return std::fabs(a - b) < 1e-6f;
+    }
+
+    // Wait until the watcher publishes the given revision.
+    const Config* WaitForRevision(const ConfigWatcher& watcher, const uint32_t revision, const std::chrono::milliseconds timeout)
+    {
+        const auto deadline = std::chrono::steady_clock::now() + timeout;
+        while (std::chrono::steady_clock::now() < deadline)
+        {
+            const Config* const latest = watcher.latest();
+            if (latest && latest->revision >= revision)
+            {
+                return latest;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        return nullptr;
+    }
+
+    int Check()
+    {
+        int result = 0;
+        const auto expect = [&](const char* name, const bool isPass) {
+            std::printf("%s: %s\n", name, isPass ? "ok" : "FAILED");
+            if (!isPass)
+            {
+                result = 1;
+            }
+        };
+
+        const std::filesystem::path directory = std::filesystem::temp_directory_path() / "ConfigTool";
+        std::error_code ec;
+        std::filesystem::remove_all(directory, ec);
+        std::filesystem::create_directories(directory);
+        const std::filesystem::path path = directory / "settings.cfg";
+
+        // The application settings take precedence, and the global-only settings are always read from the global scope.
+        {
+            WriteFile(path,
+                "# Global settings\n"
+                "enabled=1\n"
+                "sharpness=20\n"
+                "enable_telemetry=1\n"
+                "capture_frames=30\n"
+                "\n"
+                "[" + ApplicationName + "]\n"
+                "  enabled = 1\n"
+                "scaling=80\n"
+                "sharpness=not a number\n"
+                "capture_frames=10\n"
+                "this line is ignored\n"
+                "[Other]\n"
+                "enabled=1\n"
+                "scaling=50\n");
+            FileConfigSource source(path.string());
+            Config config;
+            config.Reset();
+            const bool isLoaded = source.load(ApplicationName, config);
+            expect("application scope", isLoaded && config.loaded && config.name == ApplicationName && IsEqual(config.scaleFactor, 0.8f) &&
+                                            IsEqual(config.sharpness, 0.5f) && config.enableTelemetry && config.captureFrames == 30);
+
+            config.Reset();
+            expect("global scope", source.load("Unknown", config) && IsEqual(config.scaleFactor, 0.7f) && IsEqual(config.sharpness, 0.2f));
+        }
+
+        // The layer is disabled when neither scope enables it.
+        {
+            WriteFile(path, "enabled=0\n[Other]\nenabled=1\n");
+            FileConfigSource source(path.string());
+            Config config;
+            config.Reset();
+            expect("disabled", !source.load(ApplicationName, config) && !config.loaded);
+        }
+
+        // Reload when the file changes.
+        {
+            WriteFile(path, MakeSettings(10));
+            auto source = std::make_unique<FileConfigSource>(path.string());
+            Config initialConfig;
+            initialConfig.Reset();
+            source->load(ApplicationName, initialConfig);
+
+            ConfigWatcher watcher;
+            watcher.start(std::move(source), initialConfig);
+            const Config* const first = watcher.latest();
+            expect("initial snapshot", first && first->revision == 1 && IsEqual(first->sharpness, 0.1f));
+
+            WriteFile(path, MakeSettings(20));
+            const Config* const rewritten = WaitForRevision(watcher, 2, std::chrono::seconds(5));
+            expect("file rewritten", rewritten && rewritten->revision == 2 && IsEqual(rewritten->sharpness, 0.2f));
+
+            ReplaceFile(path, MakeSettings(30));
+            const Config* const replaced = WaitForRevision(watcher, 3, std::chrono::seconds(5));
+            expect("file replaced", replaced && replaced->revision == 3 && IsEqual(replaced->sharpness, 0.3f));
+
+            WriteFile(directory / "other.cfg", MakeSettings(40));
+            expect("other file", !WaitForRevision(watcher, 4, std::chrono::milliseconds(500)) && IsEqual(watcher.latest()->sharpness, 0.3f));
+
+            // A series of changes, each one settled.
+            for (int i = 0; i < 5; i++)
+            {
+                WriteFile(path, MakeSettings(50 + i));
+                WaitForRevision(watcher, 4 + i, std::chrono::seconds(5));
+            }
+            const Config* const last = watcher.latest();
+            expect("series of changes", last->revision == 8 && IsEqual(last->sharpness, 0.54f) && watcher.retiredCount() > 0);
+
+            // Reclaim the replaced snapshots. The latest one remains.
+            const auto deadline = std::chrono::steady_clock::now() + ConfigWatcher::GracePeriod + std::chrono::seconds(2);
+            while (watcher.retiredCount() && std::chrono::steady_clock::now() < deadline)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            }
+            expect("reclamation", !watcher.retiredCount() && watcher.latest() == last && IsEqual(last->sharpness, 0.54f));
+
+            watcher.stop();
+            expect("stop", !watcher.latest() && !watcher.retiredCount());
+        }
+
+        // A wait is interrupted by wake(), so that stopping the watcher does not wait for the timeout.
+        {
+            FileWatcher fileWatcher(path.string());
+            const auto start = std::chrono::steady_clock::now();
+            std::thread waker([&]() {
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+                fileWatcher.wake();
+            });
+            const bool isChanged = fileWatcher.waitForChange(std::chrono::seconds(10));
+            waker.join();
+            expect("wake", !isChanged && std::chrono::steady_clock::now() - start < std::chrono::seconds(5));
+        }
+
+        std::filesystem::remove_all(directory, ec);
+
+        return result;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (argc == 2 && std::string(argv[1]) == "--check")
+    {
+        return Check();
+    }
+
+    std::fprintf(stderr, "Usage: %s --check\n", argv[0]);
+    return 1;
+}
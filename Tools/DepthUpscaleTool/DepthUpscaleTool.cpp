@@ -0,0 +1,189 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+// Check the depth upscaling of the layer (see DepthUpscale.h) on synthetic depth buffers.
+//
+// Usage: DepthUpscaleTool --check
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <string>
+
+#include "DepthUpscale.h"
+
+using namespace nis_scaler;
+
+namespace
+{
+    constexpr float Sentinel = -1.f;
+
+    DepthImage MakeImage(const uint32_t width, const uint32_t height, const float depth)
+    {
+        DepthImage image;
+        image.resize(width, height);
+        std::fill(image.depths.begin(), image.depths.end(), depth);
+        return image;
+    }
+
+    template <typename Function>
+    void Fill(DepthImage& image, const NISViewport& viewport, const Function& depth)
+    {
+        for (uint32_t y = 0; y < viewport.height; y++)
+        {
+            for (uint32_t x = 0; x < viewport.width; x++)
+            {
+                image.depths[(size_t)(viewport.y + y) * image.width + viewport.x + x] = depth(x, y);
+            }
+        }
+    }
+
+    // Count the pixels of the output region that fail the predicate, and the pixels outside of the region that were
+    // written.
+    template <typename Predicate>
+    uint32_t CountErrors(const DepthImage& image, const NISViewport& viewport, const Predicate& isValid)
+    {
+        uint32_t errors = 0;
+        for (uint32_t y = 0; y < image.height; y++)
+        {
+            for (uint32_t x = 0; x < image.width; x++)
+            {
+                const bool isInside = x >= viewport.x && x < viewport.x + viewport.width && y >= viewport.y && y < viewport.y + viewport.height;
+                const float depth = image.at(x, y);
+                if (isInside ? !isValid(x - viewport.x, y - viewport.y, depth) : depth != Sentinel)
+                {
+                    errors++;
+                }
+            }
+        }
+        return errors;
+    }
+
+    int Check()
+    {
+        int result = 0;
+        const auto expect = [&](const char* name, const bool isPass, const uint32_t errors) {
+            std::printf("%s: %s", name, isPass && !errors ? "ok\n" : "FAILED");
+            if (!isPass || errors)
+            {
+                std::printf(" (%u bad pixels)\n", errors);
+                result = 1;
+            }
+        };
+
+        // A vertical edge between the foreground and the background: no depth in between may appear.
+        {
+            DepthImage input = MakeImage(64, 48, 0.f);
+            Fill(input, { 0, 0, 64, 48 }, [](uint32_t x, uint32_t) { return x < 29 ? 0.2f : 0.9f; });
+            DepthImage output = MakeImage(100, 75, Sentinel);
+            const bool isPass = UpscaleDepth(input, { 0, 0, 64, 48 }, output, { 0, 0, 100, 75 });
+            expect("step edge", isPass, CountErrors(output, { 0, 0, 100, 75 }, [](uint32_t, uint32_t, float depth) {
+                       return depth == 0.2f || depth == 0.9f;
+                   }));
+        }
+
+        // A slanted plane is continuous: the output matches the plane at the sampled positions.
+        {
+            const auto plane = [](float x, float y) { return 0.4f + 0.0005f * x + 0.0002f * y; };
+            DepthImage input = MakeImage(64, 48, 0.f);
+            Fill(input, { 0, 0, 64, 48 }, [&](uint32_t x, uint32_t y) { return plane((float)x, (float)y); });
+            DepthImage output = MakeImage(100, 75, Sentinel);
+            const bool isPass = UpscaleDepth(input, { 0, 0, 64, 48 }, output, { 0, 0, 100, 75 });
+            expect("slanted plane", isPass, CountErrors(output, { 0, 0, 100, 75 }, [&](uint32_t x, uint32_t y, float depth) {
+                       const float sourceX = std::fmin(std::fmax((x + 0.5f) * 64 / 100 - 0.5f, 0.f), 63.f);
+                       const float sourceY = std::fmin(std::fmax((y + 0.5f) * 48 / 75 - 0.5f, 0.f), 47.f);
+                       return std::fabs(depth - plane(sourceX, sourceY)) < 1e-5f;
+                   }));
+        }
+
+        // A disc in front of a slanted background: each pixel is either on the disc or on the background plane.
+        {
+            const auto background = [](float x, float y) { return 0.8f + 0.001f * x + 0.0005f * y; };
+            const auto isOnDisc = [](float x, float y) { return (x - 30) * (x - 30) + (y - 20) * (y - 20) < 12 * 12; };
+            DepthImage input = MakeImage(64, 48, 0.f);
+            Fill(input, { 0, 0, 64, 48 }, [&](uint32_t x, uint32_t y) {
+                return isOnDisc((float)x, (float)y) ? 0.3f : background((float)x, (float)y);
+            });
+            DepthImage output = MakeImage(100, 75, Sentinel);
+            const bool isPass = UpscaleDepth(input, { 0, 0, 64, 48 }, output, { 0, 0, 100, 75 });
+            expect("disc occluder", isPass, CountErrors(output, { 0, 0, 100, 75 }, [&](uint32_t x, uint32_t y, float depth) {
+                       const float sourceX = (x + 0.5f) * 64 / 100 - 0.5f;
+                       const float sourceY = (y + 0.5f) * 48 / 75 - 0.5f;
+                       return depth == 0.3f || (depth >= background(std::floor(sourceX), std::floor(sourceY)) - 1e-5f &&
+                                                depth <= background(std::ceil(sourceX), std::ceil(sourceY)) + 1e-5f);
+                   }));
+        }
+
+        // Reversed Z, with the background at 0 (infinitely far).
+        {
+            DepthImage input = MakeImage(64, 48, 0.f);
+            Fill(input, { 0, 0, 64, 48 }, [](uint32_t x, uint32_t y) { return x + y < 50 ? 0.05f : 0.f; });
+            DepthImage output = MakeImage(100, 75, Sentinel);
+            const bool isPass = UpscaleDepth(input, { 0, 0, 64, 48 }, output, { 0, 0, 100, 75 });
+            expect("reversed Z", isPass, CountErrors(output, { 0, 0, 100, 75 }, [](uint32_t, uint32_t, float depth) {
+                       return depth == 0.05f || depth == 0.f;
+                   }));
+        }
+
+        // Two views side by side in a texture atlas: the depth of one view never bleeds into the other one.
+        {
+            DepthImage input = MakeImage(128, 48, 0.f);
+            Fill(input, { 0, 0, 64, 48 }, [](uint32_t, uint32_t) { return 0.2f; });
+            Fill(input, { 64, 0, 64, 48 }, [](uint32_t, uint32_t) { return 0.9f; });
+            DepthImage output = MakeImage(200, 75, Sentinel);
+            const bool isPass = UpscaleDepth(input, { 0, 0, 64, 48 }, output, { 0, 0, 100, 75 }) &&
+                                UpscaleDepth(input, { 64, 0, 64, 48 }, output, { 100, 0, 100, 75 });
+            expect("atlas", isPass, CountErrors(output, { 0, 0, 200, 75 }, [](uint32_t x, uint32_t, float depth) {
+                       return depth == (x < 100 ? 0.2f : 0.9f);
+                   }));
+        }
+
+        // Without scaling, the depth is copied exactly, to a different region.
+        {
+            DepthImage input = MakeImage(64, 48, 0.f);
+            Fill(input, { 0, 0, 64, 48 }, [](uint32_t x, uint32_t y) { return (x * 7 + y * 13) % 17 / 17.f; });
+            DepthImage output = MakeImage(80, 60, Sentinel);
+            const bool isPass = UpscaleDepth(input, { 8, 4, 40, 30 }, output, { 20, 10, 40, 30 });
+            expect("identity", isPass, CountErrors(output, { 20, 10, 40, 30 }, [&](uint32_t x, uint32_t y, float depth) {
+                       return depth == input.at(x + 8, y + 4);
+                   }));
+        }
+
+        // The regions that do not fit their image are rejected, and nothing is written.
+        {
+            const DepthImage input = MakeImage(64, 48, 0.5f);
+            DepthImage output = MakeImage(100, 75, Sentinel);
+            const bool isPass = !UpscaleDepth(input, { 1, 0, 64, 48 }, output, { 0, 0, 100, 75 }) &&
+                                !UpscaleDepth(input, { 0, 0, 64, 48 }, output, { 0, 1, 100, 75 }) &&
+                                !UpscaleDepth(input, { 0, 0, 0, 48 }, output, { 0, 0, 100, 75 });
+            expect("invalid regions", isPass, CountErrors(output, { 0, 0, 0, 0 }, [](uint32_t, uint32_t, float) { return false; }));
+        }
+
+        return result;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (argc == 2 && std::string(argv[1]) == "--check")
+    {
+        return Check();
+    }
+
+    std::fprintf(stderr, "Usage: %s --check\n", argv[0]);
+    return 1;
+}
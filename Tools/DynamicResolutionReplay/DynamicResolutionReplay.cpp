@@ -0,0 +1,465 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Replay a telemetry trace through the dynamic resolution controller (see DynamicResolution.h).
+//
+// Usage: DynamicResolutionReplay [options] <trace.csv>
+//        DynamicResolutionReplay --check <Tools/DynamicResolutionReplay/Traces>
+//
+// Options: --target <us>     The GPU frame time to aim for. Default: 10000.
+//          --budget <us>     The frame period, used to count the frames that miss it. Default: 11111 (90Hz).
+//          --min <percent>   The lowest render scale. Default: 50.
+//          --max <percent>   The highest render scale. Default: the highest scale in the trace.
+//          --kp/--ki/--kd <gain>, --step <fraction>, --quantum <percent>
+//                            The controller tuning. Defaults: see DynamicResolutionSettings.
+//          --fixed <fraction>  The part of the application's GPU time that does not depend on the resolution. Default: 0.2.
+//          --latency <frames>  How many frames old the GPU times are when they reach the controller. Default: 8.
+//          --csv             Print the replayed frames as CSV.
+//
+// The trace is the CSV output of TelemetryReader. For each frame, the GPU time at another render scale is modeled from
+// the recorded one, the application's part scaling with the pixel count. The report compares the recorded frames with
+// the replayed ones.
+//
+// The check replays the synthetic traces of the Traces directory, recorded at the display resolution, with the default
+// settings: a steady load above the target (steady.csv), a short spike (spike.csv), and a sustained overload that
+// the lowest scale cannot absorb, followed by a light load (overload.csv). It verifies the settling time, the overshoot,
+// the clamping to the bounds, and the recovery from the bounds.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "DynamicResolution.h"
+#include "Statistics.h"
+
+using namespace nis_scaler;
+
+namespace
+{
+    struct TraceFrame
+    {
+        uint64_t frameIndex;
+        uint32_t appGpuTime;
+        uint32_t scalerTime;
+
+        // The render scale the frame was recorded at.
+        float scale;
+    };
+
+    std::vector<std::string> Split(const std::string& line)
+    {
+        std::vector<std::string> fields;
+        std::istringstream stream(line);
+        std::string field;
+        while (std::getline(stream, field, ','))
+        {
+            fields.push_back(field);
+        }
+        return fields;
+    }
+
+    bool LoadTrace(const char* path, std::vector<TraceFrame>& frames)
+    {
+        std::ifstream file(path);
+        std::string line;
+        if (!file || !std::getline(file, line))
+        {
+            std::fprintf(stderr, "Cannot read %s\n", path);
+            return false;
+        }
+
+        // Locate the columns by name, so that traces with extra columns can be replayed.
+        const std::vector<std::string> header = Split(line);
+        const char* const names[] = { "frameIndex", "appGpuTime", "scalerTime", "renderWidth", "displayWidth" };
+        size_t columns[std::size(names)];
+        for (size_t i = 0; i < std::size(names); i++)
+        {
+            columns[i] = header.size();
+            for (size_t j = 0; j < header.size(); j++)
+            {
+                if (header[j] == names[i])
+                {
+                    columns[i] = j;
+                }
+            }
+            if (columns[i] == header.size())
+            {
+                std::fprintf(stderr, "%s has no %s column\n", path, names[i]);
+                return false;
+            }
+        }
+
+        while (std::getline(file, line))
+        {
+            const std::vector<std::string> fields = Split(line);
+            if (fields.size() < header.size())
+            {
+                continue;
+            }
+
+            TraceFrame frame;
+            frame.frameIndex = std::strtoull(fields[columns[0]].c_str(), nullptr, 10);
+            frame.appGpuTime = (uint32_t)std::strtoul(fields[columns[1]].c_str(), nullptr, 10);
+            frame.scalerTime = (uint32_t)std::strtoul(fields[columns[2]].c_str(), nullptr, 10);
+            const uint32_t renderWidth = (uint32_t)std::strtoul(fields[columns[3]].c_str(), nullptr, 10);
+            const uint32_t displayWidth = (uint32_t)std::strtoul(fields[columns[4]].c_str(), nullptr, 10);
+
+            // The first frames have no GPU times yet.
+            if (!frame.appGpuTime || !renderWidth || !displayWidth)
+            {
+                continue;
+            }
+            frame.scale = (float)renderWidth / displayWidth;
+            frames.push_back(frame);
+        }
+
+        return true;
+    }
+
+    struct ReplayedFrame
+    {
+        float scale;
+        uint32_t time;
+    };
+
+    // Replay the trace through the controller. For each frame, the GPU time is modeled at the scale picked by the
+    // controller, and reaches the controller a few frames late, like the timer queries read back by the layer.
+    std::vector<ReplayedFrame> Replay(const std::vector<TraceFrame>& frames,
+                                      const DynamicResolutionSettings& settings,
+                                      const float fixedFraction,
+                                      const size_t latency)
+    {
+        DynamicResolutionController controller(settings);
+        std::vector<uint32_t> pendingTimes(latency + 1, 0);
+        std::vector<ReplayedFrame> replayed;
+        replayed.reserve(frames.size());
+        for (size_t i = 0; i < frames.size(); i++)
+        {
+            const TraceFrame& frame = frames[i];
+            const float scale = controller.scale();
+            const float pixelRatio = (scale * scale) / (frame.scale * frame.scale);
+            const uint32_t time =
+                (uint32_t)(frame.appGpuTime * (fixedFraction + (1.f - fixedFraction) * pixelRatio) + 0.5f) + frame.scalerTime;
+            replayed.push_back({ scale, time });
+
+            pendingTimes[i % pendingTimes.size()] = time;
+            if (i >= latency)
+            {
+                controller.update(pendingTimes[(i - latency) % pendingTimes.size()]);
+            }
+        }
+        return replayed;
+    }
+
+    struct Summary
+    {
+        LatencyHistogram frameTime;
+        LatencyHistogram scale; // In percent.
+        uint64_t missedFrames{ 0 };
+        uint64_t scaleChanges{ 0 };
+        double scaleSum{ 0 };
+
+        void record(const uint32_t time, const float frameScale, const bool isChange, const uint32_t budget)
+        {
+            frameTime.record(time);
+            scale.record((uint64_t)(frameScale * 100 + 0.5f));
+            missedFrames += time > budget;
+            scaleChanges += isChange;
+            scaleSum += frameScale;
+        }
+
+        void print(const char* name) const
+        {
+            const uint64_t count = (std::max)(frameTime.count(), (uint64_t)1);
+            std::printf("%-8s missed=%.2f%% frameTime(p50/p90/p99/max)=%llu/%llu/%llu/%llu scale(mean/p10/p50)=%.3f/%.2f/%.2f scaleChanges=%llu\n",
+                name, 100.0 * missedFrames / count,
+                (unsigned long long)frameTime.percentile(0.5), (unsigned long long)frameTime.percentile(0.9),
+                (unsigned long long)frameTime.percentile(0.99), (unsigned long long)frameTime.maximum(),
+                scaleSum / count, scale.percentile(0.1) / 100.0, scale.percentile(0.5) / 100.0,
+                (unsigned long long)scaleChanges);
+        }
+    };
+
+    int Check(const std::string& directory)
+    {
+        const DynamicResolutionSettings settings;
+        const float fixedFraction = 0.2f;
+        const size_t latency = 8;
+        const float quantum = settings.quantum + 0.001f;
+
+        int result = 0;
+        const auto expect = [&](const std::string& name, const bool isPass, const char* format, const double value, const double other = 0.) {
+            std::printf("%s: ", name.c_str());
+            std::printf(format, value, other);
+            std::printf("%s\n", isPass ? " ok" : " FAILED");
+            if (!isPass)
+            {
+                result = 1;
+            }
+        };
+
+        const auto replay = [&](const char* name, std::vector<ReplayedFrame>& replayed) {
+            std::vector<TraceFrame> frames;
+            if (!LoadTrace((directory + "/" + name + ".csv").c_str(), frames) || frames.size() != 600)
+            {
+                std::printf("%s: cannot load the trace FAILED\n", name);
+                result = 1;
+                return false;
+            }
+            replayed = Replay(frames, settings, fixedFraction, latency);
+
+            float lowest = settings.maxScale;
+            float highest = settings.minScale;
+            for (const ReplayedFrame& frame : replayed)
+            {
+                lowest = (std::min)(lowest, frame.scale);
+                highest = (std::max)(highest, frame.scale);
+            }
+            expect(std::string(name) + ": within the bounds", lowest >= settings.minScale && highest <= settings.maxScale,
+                "scale in [%.2f, %.2f]", lowest, highest);
+            return true;
+        };
+
+        // The first frame from which the scale stays within a quantum of the given scale.
+        const auto settlingFrame = [&](const std::vector<ReplayedFrame>& replayed, const size_t begin, const size_t end, const float scale) {
+            size_t settled = begin;
+            for (size_t i = begin; i < end; i++)
+            {
+                if (std::abs(replayed[i].scale - scale) > quantum)
+                {
+                    settled = i + 1;
+                }
+            }
+            return settled;
+        };
+
+        // A steady load of 12.4ms at the display resolution: the scale settles at about 0.87, without dropping much
+        // below it, and the frames stay within the budget.
+        std::vector<ReplayedFrame> replayed;
+        if (replay("steady", replayed))
+        {
+            float settledScale = 0.f;
+            for (size_t i = 500; i < 600; i++)
+            {
+                settledScale += replayed[i].scale / 100;
+            }
+            const size_t settled = settlingFrame(replayed, 0, 600, settledScale);
+            expect("steady: settling time", settled <= 120, "%.0f frames", (double)settled);
+
+            float lowest = settings.maxScale;
+            uint32_t longest = 0;
+            for (size_t i = 0; i < 600; i++)
+            {
+                lowest = (std::min)(lowest, replayed[i].scale);
+                if (i >= settled)
+                {
+                    longest = (std::max)(longest, replayed[i].time);
+                }
+            }
+            expect("steady: overshoot", settledScale - lowest <= 2 * quantum, "%.3f", settledScale - lowest);
+            expect("steady: settled frame time", longest <= 11111, "%.0fus", (double)longest);
+        }
+
+        // A light load of 7.4ms, with a spike to 20.4ms over frames 200 to 229: the scale stays clamped at the highest
+        // scale outside of the spike, dips during the spike, and is back at the highest scale soon after it.
+        if (replay("spike", replayed))
+        {
+            const size_t clamped = settlingFrame(replayed, 0, 200, settings.maxScale);
+            expect("spike: clamped before the spike", clamped == 0, "%.0f frames", (double)clamped);
+
+            float lowest = settings.maxScale;
+            for (size_t i = 200; i < 600; i++)
+            {
+                lowest = (std::min)(lowest, replayed[i].scale);
+            }
+            expect("spike: dip", lowest < settings.maxScale && lowest >= 0.6f, "%.2f", lowest);
+
+            const size_t recovered = settlingFrame(replayed, 230, 600, settings.maxScale);
+            expect("spike: recovery", recovered - 230 <= 90, "%.0f frames", (double)(recovered - 230));
+        }
+
+        // An overload of 30.6ms until frame 400, which needs a scale below the lowest one, then a light load of 7.4ms:
+        // the scale stays clamped at the lowest scale, and rises as soon as the light load is measured (the controller
+        // does not wind up while clamped).
+        if (replay("overload", replayed))
+        {
+            const size_t clamped = settlingFrame(replayed, 0, 400, settings.minScale);
+            expect("overload: clamped", clamped <= 90, "%.0f frames", (double)clamped);
+
+            size_t rising = 400;
+            while (rising < 600 && replayed[rising].scale <= settings.minScale)
+            {
+                rising++;
+            }
+            expect("overload: release", rising - 400 <= latency + 5, "%.0f frames", (double)(rising - 400));
+
+            const size_t recovered = settlingFrame(replayed, 400, 600, settings.maxScale);
+            expect("overload: recovery", recovered - 400 <= 120, "%.0f frames", (double)(recovered - 400));
+        }
+
+        return result;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    DynamicResolutionSettings settings;
+    settings.maxScale = 0.f;
+    uint32_t budget = 11111;
+    float fixedFraction = 0.2f;
+    size_t latency = 8;
+    bool printCsv = false;
+    const char* path = nullptr;
+
+    if (argc == 3 && std::string(argv[1]) == "--check")
+    {
+        return Check(argv[2]);
+    }
+
+    bool isValid = true;
+    for (int i = 1; i < argc && isValid; i++)
+    {
+        const std::string argument = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (argument == "--target" && hasValue)
+        {
+            settings.targetFrameTime = (uint32_t)std::strtoul(argv[++i], nullptr, 10);
+        }
+        else if (argument == "--budget" && hasValue)
+        {
+            budget = (uint32_t)std::strtoul(argv[++i], nullptr, 10);
+        }
+        else if (argument == "--min" && hasValue)
+        {
+            settings.minScale = std::strtof(argv[++i], nullptr) / 100.f;
+        }
+        else if (argument == "--max" && hasValue)
+        {
+            settings.maxScale = std::strtof(argv[++i], nullptr) / 100.f;
+        }
+        else if (argument == "--kp" && hasValue)
+        {
+            settings.kp = std::strtof(argv[++i], nullptr);
+        }
+        else if (argument == "--ki" && hasValue)
+        {
+            settings.ki = std::strtof(argv[++i], nullptr);
+        }
+        else if (argument == "--kd" && hasValue)
+        {
+            settings.kd = std::strtof(argv[++i], nullptr);
+        }
+        else if (argument == "--step" && hasValue)
+        {
+            settings.maxStep = std::strtof(argv[++i], nullptr);
+        }
+        else if (argument == "--quantum" && hasValue)
+        {
+            settings.quantum = std::strtof(argv[++i], nullptr) / 100.f;
+        }
+        else if (argument == "--fixed" && hasValue)
+        {
+            fixedFraction = std::strtof(argv[++i], nullptr);
+        }
+        else if (argument == "--latency" && hasValue)
+        {
+            latency = std::strtoul(argv[++i], nullptr, 10);
+        }
+        else if (argument == "--csv")
+        {
+            printCsv = true;
+        }
+        else
+        {
+            isValid = argument.rfind("--", 0) != 0 && !path;
+            path = argv[i];
+        }
+    }
+
+    if (!isValid || !path || !settings.targetFrameTime || settings.minScale <= 0.f)
+    {
+        std::fprintf(stderr,
+            "Usage: DynamicResolutionReplay [--target <us>] [--budget <us>] [--min <percent>] [--max <percent>]\n"
+            "                               [--kp <gain>] [--ki <gain>] [--kd <gain>] [--step <fraction>] [--quantum <percent>]\n"
+            "                               [--fixed <fraction>] [--latency <frames>] [--csv] <trace.csv>\n"
+            "       DynamicResolutionReplay --check <Tools/DynamicResolutionReplay/Traces>\n");
+        return 1;
+    }
+
+    std::vector<TraceFrame> frames;
+    if (!LoadTrace(path, frames))
+    {
+        return 1;
+    }
+    if (frames.empty())
+    {
+        std::fprintf(stderr, "%s has no GPU times\n", path);
+        return 1;
+    }
+
+    if (settings.maxScale <= 0.f)
+    {
+        for (const TraceFrame& frame : frames)
+        {
+            settings.maxScale = (std::max)(settings.maxScale, frame.scale);
+        }
+    }
+    DynamicResolutionController controller(settings);
+    const std::vector<ReplayedFrame> replayedFrames = Replay(frames, settings, fixedFraction, latency);
+
+    if (printCsv)
+    {
+        std::printf("frameIndex,recordedScale,recordedTime,scale,time\n");
+    }
+
+    Summary recorded;
+    Summary replayed;
+    float lastRecordedScale = frames[0].scale;
+    float lastScale = replayedFrames[0].scale;
+    for (size_t i = 0; i < frames.size(); i++)
+    {
+        const TraceFrame& frame = frames[i];
+        const uint32_t recordedTime = frame.appGpuTime + frame.scalerTime;
+        const float scale = replayedFrames[i].scale;
+        const uint32_t time = replayedFrames[i].time;
+
+        recorded.record(recordedTime, frame.scale, frame.scale != lastRecordedScale, budget);
+        replayed.record(time, scale, scale != lastScale, budget);
+        lastRecordedScale = frame.scale;
+        lastScale = scale;
+
+        if (printCsv)
+        {
+            std::printf("%llu,%.3f,%u,%.3f,%u\n", (unsigned long long)frame.frameIndex, frame.scale, recordedTime, scale, time);
+        }
+    }
+
+    std::fprintf(printCsv ? stderr : stdout, "%zu frames, target=%u budget=%u scale=[%.2f, %.2f]\n",
+        frames.size(), settings.targetFrameTime, budget, controller.settings().minScale, controller.settings().maxScale);
+    if (!printCsv)
+    {
+        recorded.print("recorded");
+        replayed.print("replayed");
+    }
+
+    return 0;
+}
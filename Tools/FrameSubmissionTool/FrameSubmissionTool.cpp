@@ -0,0 +1,361 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+// Check the copy of the frame submissions made by xrEndFrame() (see FrameSubmission.h).
+//
+// Usage: FrameSubmissionTool --check
+//
+// Frames are submitted like the layer does: the projection layers are copied and their image rectangles rewritten, the
+// depth chained to the views is replaced, then the copy is passed to a stub of the runtime's xrEndFrame(), which checks
+// what it receives. The structures of the
+// application must be left untouched, and once the frame arena has grown to the size of the frames, the submissions
+// must not allocate. The heap allocations are counted by replacing the global allocation functions.
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "FrameSubmission.h"
+
+using namespace nis_scaler;
+
+namespace
+{
+    std::atomic<uint64_t> g_allocations{ 0 };
+}
+
+void* operator new(const size_t size)
+{
+    g_allocations++;
+    if (void* const memory = std::malloc(size ? size : 1))
+    {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](const size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* const memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete[](void* const memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void* const memory, size_t) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete[](void* const memory, size_t) noexcept
+{
+    std::free(memory);
+}
+
+namespace
+{
+    // A structure of an extension unknown to the layer.
+    const XrStructureType UnknownStructureType = (XrStructureType)1000999000;
+
+    // A frame of the application: projection layers with their views (some of them with depth chained), and quad layers.
+    // The depth is chained either first, followed by an unknown structure, or after an unknown structure (so that it
+    // cannot be replaced), or not at all.
+    struct AppFrame
+    {
+        std::vector<XrCompositionLayerDepthInfoKHR> depth;
+        std::vector<XrBaseInStructure> unknown;
+        std::vector<std::vector<XrCompositionLayerProjectionView>> views;
+        std::vector<XrCompositionLayerProjection> projections;
+        std::vector<XrCompositionLayerBaseHeader> quads;
+        std::vector<const XrCompositionLayerBaseHeader*> layers;
+        XrFrameEndInfo frameEndInfo{};
+    };
+
+    XrSwapchain MakeSwapchain(const uint32_t index)
+    {
+        return reinterpret_cast<XrSwapchain>((uintptr_t)(0x1000 + index * 0x40));
+    }
+
+    // Every other layer is a quad layer.
+    void MakeFrame(AppFrame& frame, const uint32_t projectionCount, const uint32_t viewCount)
+    {
+        frame.depth.resize(projectionCount * viewCount);
+        frame.unknown.resize(projectionCount * viewCount);
+        frame.views.resize(projectionCount);
+        frame.projections.resize(projectionCount);
+        frame.quads.resize(projectionCount);
+        for (uint32_t i = 0; i < projectionCount; i++)
+        {
+            frame.views[i].resize(viewCount);
+            for (uint32_t j = 0; j < viewCount; j++)
+            {
+                XrCompositionLayerDepthInfoKHR& depth = frame.depth[i * viewCount + j];
+                depth = { XR_TYPE_COMPOSITION_LAYER_DEPTH_INFO_KHR };
+                depth.subImage.swapchain = MakeSwapchain(1000 + i);
+                depth.subImage.imageRect = { { (int32_t)(j * 320), 0 }, { 320, 240 } };
+                depth.subImage.imageArrayIndex = j;
+                depth.maxDepth = 1.f;
+                XrBaseInStructure& unknown = frame.unknown[i * viewCount + j];
+                unknown = { UnknownStructureType };
+
+                XrCompositionLayerProjectionView& view = frame.views[i][j];
+                view = { XR_TYPE_COMPOSITION_LAYER_PROJECTION_VIEW };
+                if (j % 3 == 0)
+                {
+                    view.next = &depth;
+                    depth.next = &unknown;
+                }
+                else if (j % 3 == 1)
+                {
+                    view.next = &unknown;
+                    unknown.next = reinterpret_cast<const XrBaseInStructure*>(&depth);
+                }
+                view.pose.orientation.w = 1.f;
+                view.pose.position.x = j * 0.06f;
+                view.fov = { -0.9f, 0.8f, 0.85f, -0.95f };
+                view.subImage.swapchain = MakeSwapchain(i);
+                view.subImage.imageRect = { { (int32_t)(j * 640), 0 }, { 640, 480 } };
+                view.subImage.imageArrayIndex = j;
+            }
+
+            XrCompositionLayerProjection& proj = frame.projections[i];
+            proj = { XR_TYPE_COMPOSITION_LAYER_PROJECTION };
+            proj.space = reinterpret_cast<XrSpace>((uintptr_t)0x100);
+            proj.viewCount = viewCount;
+            proj.views = frame.views[i].data();
+
+            frame.quads[i] = { XR_TYPE_COMPOSITION_LAYER_QUAD };
+            frame.quads[i].space = proj.space;
+        }
+
+        frame.layers.clear();
+        for (uint32_t i = 0; i < projectionCount; i++)
+        {
+            frame.layers.push_back(reinterpret_cast<const XrCompositionLayerBaseHeader*>(&frame.projections[i]));
+            frame.layers.push_back(&frame.quads[i]);
+        }
+
+        frame.frameEndInfo = { XR_TYPE_FRAME_END_INFO };
+        frame.frameEndInfo.displayTime = 123456789;
+        frame.frameEndInfo.environmentBlendMode = XR_ENVIRONMENT_BLEND_MODE_OPAQUE;
+        frame.frameEndInfo.layerCount = (uint32_t)frame.layers.size();
+        frame.frameEndInfo.layers = frame.layers.data();
+    }
+
+    // The bytes of all the structures of a frame, to detect any modification.
+    std::vector<uint8_t> Snapshot(const AppFrame& frame)
+    {
+        std::vector<uint8_t> bytes;
+        const auto append = [&](const void* data, const size_t size) {
+            const uint8_t* const begin = reinterpret_cast<const uint8_t*>(data);
+            bytes.insert(bytes.end(), begin, begin + size);
+        };
+        append(&frame.frameEndInfo, sizeof(frame.frameEndInfo));
+        append(frame.layers.data(), frame.layers.size() * sizeof(frame.layers[0]));
+        append(frame.projections.data(), frame.projections.size() * sizeof(frame.projections[0]));
+        append(frame.quads.data(), frame.quads.size() * sizeof(frame.quads[0]));
+        append(frame.depth.data(), frame.depth.size() * sizeof(frame.depth[0]));
+        append(frame.unknown.data(), frame.unknown.size() * sizeof(frame.unknown[0]));
+        for (const auto& views : frame.views)
+        {
+            append(views.data(), views.size() * sizeof(views[0]));
+        }
+        return bytes;
+    }
+
+    // The frame submitted by the application, and the errors found by the stub of the runtime.
+    const AppFrame* g_appFrame = nullptr;
+    uint32_t g_submitErrors = 0;
+
+    // The image rectangle forwarded for a view: the layer forwards the region written by the scaler.
+    XrRect2Di ScaleRect(const XrRect2Di& rect)
+    {
+        return { { rect.offset.x * 2, rect.offset.y * 2 }, { rect.extent.width * 2, rect.extent.height * 2 } };
+    }
+
+    bool IsSameRect(const XrRect2Di& a, const XrRect2Di& b)
+    {
+        return a.offset.x == b.offset.x && a.offset.y == b.offset.y && a.extent.width == b.extent.width && a.extent.height == b.extent.height;
+    }
+
+    // The depth must be replaced when it comes first in the chain, and the chain must be left as it is otherwise.
+    bool IsSameChain(const XrCompositionLayerProjectionView& view, const XrCompositionLayerProjectionView& appView)
+    {
+        const XrCompositionLayerDepthInfoKHR* const appDepth = FindDepthInfo(appView.next);
+        if (!appDepth || appView.next != appDepth)
+        {
+            return view.next == appView.next;
+        }
+
+        const XrCompositionLayerDepthInfoKHR* const depth = FindDepthInfo(view.next);
+        return depth && depth != appDepth && view.next == depth && depth->next == appDepth->next && depth->subImage.swapchain == appDepth->subImage.swapchain &&
+               depth->subImage.imageArrayIndex == appDepth->subImage.imageArrayIndex && depth->minDepth == appDepth->minDepth &&
+               depth->maxDepth == appDepth->maxDepth && IsSameRect(depth->subImage.imageRect, ScaleRect(appDepth->subImage.imageRect));
+    }
+
+    XrResult StubEndFrame(const XrSession, const XrFrameEndInfo* const frameEndInfo)
+    {
+        const XrFrameEndInfo& appInfo = g_appFrame->frameEndInfo;
+        if (frameEndInfo == &appInfo || frameEndInfo->layers == appInfo.layers || frameEndInfo->layerCount != appInfo.layerCount ||
+            frameEndInfo->displayTime != appInfo.displayTime || frameEndInfo->environmentBlendMode != appInfo.environmentBlendMode ||
+            frameEndInfo->next != appInfo.next)
+        {
+            g_submitErrors++;
+            return XR_ERROR_VALIDATION_FAILURE;
+        }
+
+        for (uint32_t i = 0; i < frameEndInfo->layerCount; i++)
+        {
+            const XrCompositionLayerBaseHeader* const layer = frameEndInfo->layers[i];
+            if (layer->type != XR_TYPE_COMPOSITION_LAYER_PROJECTION)
+            {
+                // Forwarded as is.
+                g_submitErrors += layer != appInfo.layers[i];
+                continue;
+            }
+
+            const XrCompositionLayerProjection* const proj = reinterpret_cast<const XrCompositionLayerProjection*>(layer);
+            const XrCompositionLayerProjection* const appProj = reinterpret_cast<const XrCompositionLayerProjection*>(appInfo.layers[i]);
+            if (proj == appProj || proj->views == appProj->views || proj->viewCount != appProj->viewCount || proj->space != appProj->space ||
+                proj->layerFlags != appProj->layerFlags || proj->next != appProj->next)
+            {
+                g_submitErrors++;
+                continue;
+            }
+            for (uint32_t j = 0; j < proj->viewCount; j++)
+            {
+                const XrCompositionLayerProjectionView& view = proj->views[j];
+                const XrCompositionLayerProjectionView& appView = appProj->views[j];
+                if (std::memcmp(&view.pose, &appView.pose, sizeof(view.pose)) || std::memcmp(&view.fov, &appView.fov, sizeof(view.fov)) ||
+                    !IsSameChain(view, appView) || view.subImage.swapchain != appView.subImage.swapchain ||
+                    view.subImage.imageArrayIndex != appView.subImage.imageArrayIndex || !IsSameRect(view.subImage.imageRect, ScaleRect(appView.subImage.imageRect)))
+                {
+                    g_submitErrors++;
+                }
+            }
+        }
+
+        return XR_SUCCESS;
+    }
+
+    // Like xrEndFrame() in the layer.
+    XrResult SubmitFrame(FrameArena& arena, const XrFrameEndInfo* const frameEndInfo, const PFN_xrEndFrame next_xrEndFrame)
+    {
+        arena.reset();
+        FrameSubmission submission(arena, *frameEndInfo);
+        for (uint32_t i = 0; i < frameEndInfo->layerCount; i++)
+        {
+            if (frameEndInfo->layers[i]->type == XR_TYPE_COMPOSITION_LAYER_PROJECTION)
+            {
+                const XrCompositionLayerProjection* const proj = reinterpret_cast<const XrCompositionLayerProjection*>(frameEndInfo->layers[i]);
+                XrCompositionLayerProjectionView* const chainViews = submission.copyProjectionLayer(i);
+                for (uint32_t j = 0; j < proj->viewCount; j++)
+                {
+                    chainViews[j].subImage.imageRect = ScaleRect(proj->views[j].subImage.imageRect);
+                    if (XrCompositionLayerDepthInfoKHR* const depth = submission.copyDepthInfo(chainViews[j]))
+                    {
+                        depth->subImage.imageRect = ScaleRect(depth->subImage.imageRect);
+                    }
+                }
+            }
+        }
+
+        return next_xrEndFrame(XR_NULL_HANDLE, submission.get());
+    }
+
+    int Check()
+    {
+        int result = 0;
+        const auto expect = [&](const char* name, const uint32_t errors) {
+            std::printf("%s: %s", name, !errors ? "ok\n" : "FAILED");
+            if (errors)
+            {
+                std::printf(" (%u errors)\n", errors);
+                result = 1;
+            }
+        };
+
+        struct Scenario
+        {
+            const char* name;
+            uint32_t projectionCount;
+            uint32_t viewCount;
+        };
+        const Scenario scenarios[] = {
+            { "stereo", 1, 2 },
+            { "quad views", 1, 4 },
+            { "several projection layers", 3, 2 },
+            // Larger than the initial arena: the first frames allocate temporary blocks.
+            { "beyond the initial arena", 16, 4 },
+        };
+
+        FrameArena arena;
+        for (const Scenario& scenario : scenarios)
+        {
+            AppFrame frame;
+            MakeFrame(frame, scenario.projectionCount, scenario.viewCount);
+            const std::vector<uint8_t> before = Snapshot(frame);
+            g_appFrame = &frame;
+            g_submitErrors = 0;
+
+            // The first frames may grow the arena, then no frame may allocate.
+            uint32_t errors = 0;
+            uint64_t steadyAllocations = 0;
+            for (uint32_t i = 0; i < 1000; i++)
+            {
+                const uint64_t allocations = g_allocations;
+                errors += SubmitFrame(arena, &frame.frameEndInfo, StubEndFrame) != XR_SUCCESS;
+                if (i >= 2)
+                {
+                    steadyAllocations += g_allocations - allocations;
+                }
+            }
+            errors += g_submitErrors;
+
+            const std::string name = std::string(scenario.name) + ": submission";
+            expect(name.c_str(), errors);
+            const std::string unchangedName = std::string(scenario.name) + ": application structures unchanged";
+            expect(unchangedName.c_str(), Snapshot(frame) != before);
+            const std::string allocationsName = std::string(scenario.name) + ": no allocation in steady state";
+            expect(allocationsName.c_str(), (uint32_t)steadyAllocations);
+        }
+
+        return result;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (argc == 2 && std::string(argv[1]) == "--check")
+    {
+        return Check();
+    }
+
+    std::fprintf(stderr, "Usage: %s --check\n", argv[0]);
+    return 1;
+}
@@ -0,0 +1,345 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+// Validate and benchmark the table keeping the per-swapchain state of the layer (see HandleTable.h), against the
+// std::map it replaced.
+//
+// Usage: HandleTableBenchmark --check
+//        HandleTableBenchmark --benchmark [iterations]
+//
+// The check runs random insertions, lookups and erasures against a std::map model, then builds clusters of handles with
+// the same home slot (including clusters wrapping around the end of the table) and erases them in every order, so that
+// the backward shifting is exercised on every layout. The benchmark times the lookups done per frame, and the
+// insertion/erasure of a swapchain, for 2, 8 and 64 live swapchains.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "HandleTable.h"
+
+using namespace nis_scaler;
+
+namespace
+{
+    // Like the OpenXR handles on 64-bit platforms.
+    typedef struct Swapchain_T* Swapchain;
+
+    // About the size of the per-swapchain state of the layer.
+    struct Value
+    {
+        uint64_t id{ 0 };
+        uint64_t payload[31]{};
+    };
+
+    Swapchain MakeHandle(const uint64_t value)
+    {
+        return reinterpret_cast<Swapchain>((uintptr_t)value);
+    }
+
+    // The home slot of a handle in a table with the given capacity, with the same finalizer as HandleTable.
+    size_t Home(const Swapchain handle, const size_t capacity)
+    {
+        uint64_t key = (uint64_t)reinterpret_cast<uintptr_t>(handle);
+        key ^= key >> 33;
+        key *= 0xff51afd7ed558ccdull;
+        key ^= key >> 33;
+        return (size_t)key & (capacity - 1);
+    }
+
+    // Find handles with the same home slot in the initial table (16 slots).
+    std::vector<Swapchain> MakeCollidingHandles(const size_t slot, const size_t count)
+    {
+        std::vector<Swapchain> handles;
+        for (uint64_t value = 1; handles.size() < count; value++)
+        {
+            const Swapchain handle = MakeHandle(value << 4);
+            if (Home(handle, 16) == slot)
+            {
+                handles.push_back(handle);
+            }
+        }
+        return handles;
+    }
+
+    // Compare the content of the table with the model.
+    uint32_t CountMismatches(HandleTable<Swapchain, Value>& table, const std::map<Swapchain, Value>& model)
+    {
+        uint32_t errors = table.size() != model.size() ? 1 : 0;
+        for (const auto& entry : model)
+        {
+            const Value* const value = table.find(entry.first);
+            if (!value || value->id != entry.second.id)
+            {
+                errors++;
+            }
+        }
+
+        size_t count = 0;
+        table.forEach([&](Swapchain handle, Value& value) {
+            const auto it = model.find(handle);
+            if (it == model.cend() || it->second.id != value.id)
+            {
+                errors++;
+            }
+            count++;
+        });
+        return errors + (count != model.size() ? 1 : 0);
+    }
+
+    int Check()
+    {
+        int result = 0;
+        const auto expect = [&](const char* name, const uint32_t errors) {
+            std::printf("%s: %s", name, !errors ? "ok\n" : "FAILED");
+            if (errors)
+            {
+                std::printf(" (%u errors)\n", errors);
+                result = 1;
+            }
+        };
+
+        // Random operations over a small handle space, so that erasures and reinsertions are frequent, and up to a few
+        // hundred live entries, so that the table grows several times.
+        {
+            std::mt19937_64 random(42);
+            HandleTable<Swapchain, Value> table;
+            std::map<Swapchain, Value> model;
+            uint32_t errors = 0;
+            for (uint32_t i = 0; i < 200000; i++)
+            {
+                const uint32_t range = i < 100000 ? 64 : 512;
+                const Swapchain handle = MakeHandle((random() % range + 1) * 0x40);
+                switch (random() % 3)
+                {
+                case 0:
+                {
+                    Value value;
+                    value.id = i;
+                    model[handle] = value;
+                    if (table.insert_or_assign(handle, std::move(value)).id != i)
+                    {
+                        errors++;
+                    }
+                    break;
+                }
+
+                case 1:
+                {
+                    const Value* const value = table.find(handle);
+                    const auto it = model.find(handle);
+                    if ((value != nullptr) != (it != model.end()) || (value && value->id != it->second.id))
+                    {
+                        errors++;
+                    }
+                    break;
+                }
+
+                case 2:
+                    if (table.erase(handle) != (model.erase(handle) != 0))
+                    {
+                        errors++;
+                    }
+                    break;
+                }
+
+                if (i % 997 == 0)
+                {
+                    errors += CountMismatches(table, model);
+                }
+            }
+            errors += CountMismatches(table, model);
+            expect("random operations", errors);
+        }
+
+        // Clusters of colliding handles, erased in every order. With 7 entries, the table stays at 16 slots. The cluster
+        // homed at slot 12 wraps around, and the other handles homed right after the cluster get displaced by it.
+        for (const size_t slot : { (size_t)0, (size_t)12, (size_t)15 })
+        {
+            std::vector<Swapchain> handles = MakeCollidingHandles(slot, 5);
+            const std::vector<Swapchain> neighbors = MakeCollidingHandles((slot + 2) % 16, 2);
+            handles.insert(handles.end(), neighbors.cbegin(), neighbors.cend());
+
+            std::vector<size_t> order(handles.size());
+            for (size_t i = 0; i < order.size(); i++)
+            {
+                order[i] = i;
+            }
+
+            uint32_t errors = 0;
+            do
+            {
+                HandleTable<Swapchain, Value> table;
+                std::map<Swapchain, Value> model;
+                for (size_t i = 0; i < handles.size(); i++)
+                {
+                    Value value;
+                    value.id = i + 1;
+                    model[handles[i]] = value;
+                    table.insert_or_assign(handles[i], std::move(value));
+                }
+
+                for (const size_t i : order)
+                {
+                    if (!table.erase(handles[i]) || table.erase(handles[i]))
+                    {
+                        errors++;
+                    }
+                    model.erase(handles[i]);
+                    errors += CountMismatches(table, model);
+                }
+            } while (std::next_permutation(order.begin(), order.end()));
+
+            const std::string name = "colliding erasures at slot " + std::to_string(slot);
+            expect(name.c_str(), errors);
+        }
+
+        // Null handles are never stored.
+        {
+            HandleTable<Swapchain, Value> table;
+            uint32_t errors = table.find(nullptr) || table.erase(nullptr) ? 1 : 0;
+            table.insert_or_assign(MakeHandle(0x40), Value{});
+            table.clear();
+            errors += !table.empty() || table.find(MakeHandle(0x40)) ? 1 : 0;
+            expect("null handle and clear", errors);
+        }
+
+        return result;
+    }
+
+    // The time of an operation in nanoseconds, as the best of several runs.
+    template <typename Function>
+    double Measure(const uint32_t iterations, const uint32_t operations, const Function& function)
+    {
+        double bestTime = INFINITY;
+        for (uint32_t j = 0; j <= iterations; j++)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            function();
+            const auto end = std::chrono::steady_clock::now();
+            if (j > 0)
+            {
+                bestTime = (std::min)(bestTime, std::chrono::duration<double, std::nano>(end - start).count() / operations);
+            }
+        }
+        return bestTime;
+    }
+
+    int Benchmark(int argc, char** argv)
+    {
+        const uint32_t iterations = argc > 2 ? (std::max)((uint32_t)std::strtoul(argv[2], nullptr, 10), 1u) : 10;
+        const uint32_t rounds = 10000;
+
+        std::printf("swapchains,container,lookup ns,insert+erase ns\n");
+        for (const uint32_t count : { 2u, 8u, 64u })
+        {
+            // Runtime handles, as heap addresses.
+            std::mt19937_64 random(count);
+            std::vector<Swapchain> handles;
+            for (uint32_t i = 0; i < count; i++)
+            {
+                handles.push_back(MakeHandle(0x1f0000000ull + (random() % 0x100000) * 0x40));
+            }
+            std::sort(handles.begin(), handles.end());
+            handles.erase(std::unique(handles.begin(), handles.end()), handles.end());
+            const Swapchain extra = MakeHandle(0x2f0000000ull);
+
+            uint64_t sink = 0;
+            {
+                HandleTable<Swapchain, Value> table;
+                for (const Swapchain handle : handles)
+                {
+                    table.insert_or_assign(handle, Value{});
+                }
+                const double lookup = Measure(iterations, rounds * (uint32_t)handles.size(), [&]() {
+                    for (uint32_t r = 0; r < rounds; r++)
+                    {
+                        for (const Swapchain handle : handles)
+                        {
+                            sink += table.find(handle)->id++;
+                        }
+                    }
+                });
+                const double churn = Measure(iterations, rounds, [&]() {
+                    for (uint32_t r = 0; r < rounds; r++)
+                    {
+                        table.insert_or_assign(extra, Value{});
+                        sink += table.erase(extra);
+                    }
+                });
+                std::printf("%zu,HandleTable,%.2f,%.2f\n", handles.size(), lookup, churn);
+            }
+            {
+                std::map<Swapchain, Value> map;
+                for (const Swapchain handle : handles)
+                {
+                    map.insert_or_assign(handle, Value{});
+                }
+                const double lookup = Measure(iterations, rounds * (uint32_t)handles.size(), [&]() {
+                    for (uint32_t r = 0; r < rounds; r++)
+                    {
+                        for (const Swapchain handle : handles)
+                        {
+                            sink += map.find(handle)->second.id++;
+                        }
+                    }
+                });
+                const double churn = Measure(iterations, rounds, [&]() {
+                    for (uint32_t r = 0; r < rounds; r++)
+                    {
+                        map.insert_or_assign(extra, Value{});
+                        sink += map.erase(extra);
+                    }
+                });
+                std::printf("%zu,std::map,%.2f,%.2f\n", handles.size(), lookup, churn);
+            }
+
+            // Keep the results alive.
+            if (sink == 1)
+            {
+                std::printf("\n");
+            }
+        }
+
+        return 0;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const std::string command = argc > 1 ? argv[1] : "";
+    if (command == "--check" && argc == 2)
+    {
+        return Check();
+    }
+    else if (command == "--benchmark" && argc <= 3)
+    {
+        return Benchmark(argc, argv);
+    }
+
+    std::fprintf(stderr,
+        "Usage: HandleTableBenchmark --check\n"
+        "       HandleTableBenchmark --benchmark [iterations]\n");
+    return 1;
+}
@@ -0,0 +1,178 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+// Check the hotkey polling (see Input.h).
+//
+// Usage: InputTool --check
+//
+// Scripted samples are fed to the input thread, one per polling period, and the commands received by the frame loop must
+// be exactly one per key press: a key held for several samples triggers its command once, and releasing it triggers
+// nothing. The check also verifies that the poller no longer samples its source once it is destroyed.
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Input.h"
+
+using namespace nis_scaler;
+
+namespace
+{
+    constexpr uint32_t Cycle = HotkeyBit(HotkeyCommand::CycleScalingMode);
+    constexpr uint32_t Decrease = HotkeyBit(HotkeyCommand::DecreaseSharpness);
+    constexpr uint32_t Increase = HotkeyBit(HotkeyCommand::IncreaseSharpness);
+    constexpr uint32_t Screenshot = HotkeyBit(HotkeyCommand::Screenshot);
+    constexpr uint32_t Burst = HotkeyBit(HotkeyCommand::BurstCapture);
+
+    // Replay the samples through a poller, and return the commands it produced.
+    std::vector<HotkeyCommand> Replay(const std::vector<uint32_t>& samples)
+    {
+        InputPoller poller;
+        auto source = std::make_unique<ScriptedInputSource>(samples);
+        const ScriptedInputSource* const script = source.get();
+        poller.start(std::move(source));
+        while (!script->isFinished())
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        poller.stop();
+
+        std::vector<HotkeyCommand> commands;
+        HotkeyCommand command;
+        while (poller.pop(command))
+        {
+            commands.push_back(command);
+        }
+        return commands;
+    }
+
+    std::string Describe(const std::vector<HotkeyCommand>& commands)
+    {
+        std::string description;
+        for (const HotkeyCommand command : commands)
+        {
+            description += (description.empty() ? "" : " ") + std::to_string((uint32_t)command);
+        }
+        return "[" + description + "]";
+    }
+
+    // Count the calls to sample().
+    class CountingInputSource : public InputSource
+    {
+    public:
+        explicit CountingInputSource(std::atomic<uint32_t>& calls)
+            : m_calls(calls)
+        {
+        }
+
+        uint32_t sample() override
+        {
+            m_calls++;
+            return 0;
+        }
+
+    private:
+        std::atomic<uint32_t>& m_calls;
+    };
+
+    int Check()
+    {
+        int result = 0;
+        const auto expect = [&](const char* name, const bool isPass, const std::string& details) {
+            std::printf("%s: %s", name, isPass ? "ok\n" : "FAILED");
+            if (!isPass)
+            {
+                std::printf(" (%s)\n", details.c_str());
+                result = 1;
+            }
+        };
+
+        struct Scenario
+        {
+            const char* name;
+            std::vector<uint32_t> samples;
+            std::vector<HotkeyCommand> commands;
+        };
+        const Scenario scenarios[] = {
+            { "no keys", { 0, 0, 0 }, {} },
+            { "held key", { Cycle, Cycle, Cycle, Cycle, Cycle }, { HotkeyCommand::CycleScalingMode } },
+            { "release", { Screenshot, 0, 0 }, { HotkeyCommand::Screenshot } },
+            { "repeated presses",
+              { Increase, 0, Increase, Increase, 0, Increase },
+              { HotkeyCommand::IncreaseSharpness, HotkeyCommand::IncreaseSharpness, HotkeyCommand::IncreaseSharpness } },
+            { "simultaneous presses",
+              { Decrease | Burst, Decrease | Burst, 0 },
+              { HotkeyCommand::DecreaseSharpness, HotkeyCommand::BurstCapture } },
+            { "press while holding",
+              { Cycle, Cycle | Increase, Cycle, Cycle | Increase, Increase, 0 },
+              { HotkeyCommand::CycleScalingMode, HotkeyCommand::IncreaseSharpness, HotkeyCommand::IncreaseSharpness } },
+            { "held until the end", { 0, Screenshot }, { HotkeyCommand::Screenshot } },
+        };
+
+        for (const Scenario& scenario : scenarios)
+        {
+            const std::vector<HotkeyCommand> commands = Replay(scenario.samples);
+            expect(scenario.name, commands == scenario.commands, "got " + Describe(commands) + ", expected " + Describe(scenario.commands));
+        }
+
+        // The frame loop is not draining the commands: the queue keeps the first ones.
+        {
+            std::vector<uint32_t> samples;
+            for (uint32_t i = 0; i < 100; i++)
+            {
+                samples.push_back(Screenshot);
+                samples.push_back(0);
+            }
+            const std::vector<HotkeyCommand> commands = Replay(samples);
+            expect("full queue", commands.size() == 64, std::to_string(commands.size()) + " commands");
+        }
+
+        // Once the poller is destroyed, its thread is gone.
+        {
+            std::atomic<uint32_t> calls{ 0 };
+            {
+                InputPoller poller;
+                poller.start(std::make_unique<CountingInputSource>(calls));
+                while (!calls)
+                {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                }
+            }
+            const uint32_t callsAfterDestruction = calls;
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            expect("destruction", calls == callsAfterDestruction, std::to_string(calls - callsAfterDestruction) + " samples after destruction");
+        }
+
+        return result;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (argc == 2 && std::string(argv[1]) == "--check")
+    {
+        return Check();
+    }
+
+    std::fprintf(stderr, "Usage: %s --check\n", argv[0]);
+    return 1;
+}
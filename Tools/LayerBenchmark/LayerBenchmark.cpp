@@ -0,0 +1,456 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Measure the CPU overhead of the layer for each OpenXR call it intercepts.
+//
+// Usage: LayerBenchmark [--layer <XR_APILAYER_NOVENDOR_nis_scaler.dll>] [--frames <count>] [--warp]
+//
+// The layer DLL is loaded and chained like the OpenXR loader would, in front of the mock runtime (see MockRuntime.h),
+// with a profile database enabling it for this application. The graphics device is the D3D11 null device (or WARP
+// when the null device is not installed), so that the GPU work costs close to nothing. Each call is timed through the
+// layer and directly on the mock runtime, and the difference is the overhead of the layer. The heap allocations made
+// by the layer on the calling thread are counted too.
+//
+// The layer library is required: where it cannot be built (eg: on Linux), the benchmark refuses to run rather than
+// report the cost of the mock runtime as the overhead of the layer.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "../MockRuntime/FrameLoop.h"
+#include "../MockRuntime/LayerChain.h"
+
+using namespace mock_runtime;
+
+namespace
+{
+    const char* const ApplicationName = "LayerBenchmark";
+
+    // The heap allocations made by the layer, on the calling thread only: the layer's worker threads allocate too.
+    thread_local uint64_t numAllocations = 0;
+
+#ifdef _WIN32
+    // The layer's imports of the CRT heap functions are patched to count the calls.
+
+    void* (__cdecl* real_malloc)(size_t) = nullptr;
+    void* (__cdecl* real_calloc)(size_t, size_t) = nullptr;
+    void* (__cdecl* real_realloc)(void*, size_t) = nullptr;
+
+    void* __cdecl counting_malloc(size_t size)
+    {
+        numAllocations++;
+        return real_malloc(size);
+    }
+
+    void* __cdecl counting_calloc(size_t count, size_t size)
+    {
+        numAllocations++;
+        return real_calloc(count, size);
+    }
+
+    void* __cdecl counting_realloc(void* block, size_t size)
+    {
+        numAllocations++;
+        return real_realloc(block, size);
+    }
+
+    bool PatchImport(const HMODULE module, const char* const functionName, void* const replacement, void** const original)
+    {
+        uint8_t* const base = reinterpret_cast<uint8_t*>(module);
+        const IMAGE_DOS_HEADER* const dosHeader = reinterpret_cast<const IMAGE_DOS_HEADER*>(base);
+        const IMAGE_NT_HEADERS* const ntHeaders = reinterpret_cast<const IMAGE_NT_HEADERS*>(base + dosHeader->e_lfanew);
+        const IMAGE_DATA_DIRECTORY& imports = ntHeaders->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_IMPORT];
+        if (!imports.VirtualAddress)
+        {
+            return false;
+        }
+
+        bool isPatched = false;
+        for (const IMAGE_IMPORT_DESCRIPTOR* descriptor = reinterpret_cast<const IMAGE_IMPORT_DESCRIPTOR*>(base + imports.VirtualAddress);
+             descriptor->Name; descriptor++)
+        {
+            if (!descriptor->OriginalFirstThunk)
+            {
+                continue;
+            }
+
+            const IMAGE_THUNK_DATA* name = reinterpret_cast<const IMAGE_THUNK_DATA*>(base + descriptor->OriginalFirstThunk);
+            IMAGE_THUNK_DATA* function = reinterpret_cast<IMAGE_THUNK_DATA*>(base + descriptor->FirstThunk);
+            for (; name->u1.AddressOfData; name++, function++)
+            {
+                if (IMAGE_SNAP_BY_ORDINAL(name->u1.Ordinal) ||
+                    std::strcmp(reinterpret_cast<const IMAGE_IMPORT_BY_NAME*>(base + name->u1.AddressOfData)->Name, functionName))
+                {
+                    continue;
+                }
+
+                DWORD oldProtection;
+                VirtualProtect(&function->u1.Function, sizeof(function->u1.Function), PAGE_READWRITE, &oldProtection);
+                *original = reinterpret_cast<void*>(function->u1.Function);
+                function->u1.Function = reinterpret_cast<ULONG_PTR>(replacement);
+                VirtualProtect(&function->u1.Function, sizeof(function->u1.Function), oldProtection, &oldProtection);
+                isPatched = true;
+            }
+        }
+
+        return isPatched;
+    }
+
+    bool CountAllocations(const LayerChain& chain)
+    {
+        const HMODULE module = static_cast<HMODULE>(chain.module());
+        return PatchImport(module, "malloc", reinterpret_cast<void*>(counting_malloc), reinterpret_cast<void**>(&real_malloc)) &&
+               PatchImport(module, "calloc", reinterpret_cast<void*>(counting_calloc), reinterpret_cast<void**>(&real_calloc)) &&
+               PatchImport(module, "realloc", reinterpret_cast<void*>(counting_realloc), reinterpret_cast<void**>(&real_realloc));
+    }
+#else
+    // The layer library is not patched: the allocations of the whole process are counted through operator new.
+    bool CountAllocations(const LayerChain& /* chain */)
+    {
+        return true;
+    }
+#endif
+
+    struct Measurement
+    {
+        double nsPerCall{ 0 };
+        double allocationsPerCall{ 0 };
+    };
+
+    // Time a batch of calls: a single call to the cheapest functions is below the resolution of the clock.
+    Measurement Measure(const uint32_t numCalls, const std::function<void(uint32_t)>& call)
+    {
+        const uint64_t allocationsBefore = numAllocations;
+        const auto start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < numCalls; i++)
+        {
+            call(i);
+        }
+        const auto end = std::chrono::steady_clock::now();
+
+        Measurement measurement;
+        measurement.nsPerCall = std::chrono::duration<double, std::nano>(end - start).count() / numCalls;
+        measurement.allocationsPerCall = (double)(numAllocations - allocationsBefore) / numCalls;
+        return measurement;
+    }
+
+    void Report(const char* function, const uint32_t numLayers, const uint32_t numViews, const uint32_t numCalls,
+                const Measurement& layer, const Measurement& runtime)
+    {
+        std::printf("%s,%u,%u,%u,%.1f,%.1f,%.1f,%.2f\n", function, numLayers, numViews, numCalls, layer.nsPerCall,
+            runtime.nsPerCall, layer.nsPerCall - runtime.nsPerCall, layer.allocationsPerCall);
+    }
+
+    class LayerBenchmark
+    {
+    public:
+        LayerBenchmark(const uint32_t numFrames) : m_numFrames(numFrames)
+        {
+        }
+
+        bool createGraphics(const bool useWarp)
+        {
+            m_graphics = CreateGraphics(useWarp);
+            return m_graphics != nullptr;
+        }
+
+        bool createInstance(const std::string& layerPath)
+        {
+            if (!m_chain.load(layerPath))
+            {
+                return false;
+            }
+            if (!CountAllocations(m_chain))
+            {
+                std::fprintf(stderr, "Cannot count the allocations of the layer\n");
+                return false;
+            }
+
+            // The mock runtime only measures itself: skip the validation.
+            Options options;
+            options.validate = false;
+            Configure(options);
+            if (!m_chain.createInstance(ApplicationName, m_instance) ||
+                !m_layer.resolve(m_chain.getInstanceProcAddr(), m_instance) ||
+                !m_runtime.resolve(mock_runtime::xrGetInstanceProcAddr, m_instance))
+            {
+                std::fprintf(stderr, "Cannot resolve the functions\n");
+                return false;
+            }
+
+            return true;
+        }
+
+        bool run()
+        {
+            std::printf("function,layers,views,calls,layer ns/call,runtime ns/call,overhead ns/call,allocations/call\n");
+
+            // Resolving a function that the layer intercepts, and one that it does not.
+            const uint32_t numLookups = 100000;
+            PFN_xrVoidFunction function;
+            for (const char* name : { "xrEndFrame", "xrPollEvent" })
+            {
+                const auto lookup = [&](const Dispatch& dispatch) {
+                    return Measure(numLookups, [&](uint32_t) { dispatch.xrGetInstanceProcAddr(m_instance, name, &function); });
+                };
+                const std::string label = std::string("xrGetInstanceProcAddr(") + name + ")";
+                Report(label.c_str(), 0, 0, numLookups, lookup(m_layer), lookup(m_runtime));
+            }
+
+            for (const uint32_t numViews : { 1u, 2u, 4u })
+            {
+                if (!runSession(numViews))
+                {
+                    return false;
+                }
+            }
+
+            return true;
+        }
+
+    private:
+        bool runSession(const uint32_t numViews)
+        {
+            Options options;
+            options.viewCount = numViews;
+            options.validate = false;
+            Configure(options);
+
+            // The recommended resolution, which the layer scales down.
+            std::vector<XrViewConfigurationView> views(numViews, { XR_TYPE_VIEW_CONFIGURATION_VIEW });
+            uint32_t viewCount;
+            const auto enumerateViews = [&](const Dispatch& dispatch) {
+                return Measure(100, [&](uint32_t) {
+                    dispatch.xrEnumerateViewConfigurationViews(m_instance, 1, XR_VIEW_CONFIGURATION_TYPE_PRIMARY_STEREO,
+                        numViews, &viewCount, views.data());
+                });
+            };
+            const Measurement runtimeEnumerateViews = enumerateViews(m_runtime);
+            Report("xrEnumerateViewConfigurationViews", 0, numViews, 100, enumerateViews(m_layer), runtimeEnumerateViews);
+            if (views[0].recommendedImageRectWidth == options.width)
+            {
+                std::fprintf(stderr, "The layer is not active, see its log file\n");
+                return false;
+            }
+
+            XrSessionCreateInfo sessionInfo = { XR_TYPE_SESSION_CREATE_INFO };
+            sessionInfo.next = m_graphics->sessionBinding();
+            sessionInfo.systemId = 1;
+            XrSession session;
+            const Measurement createSession = Measure(1, [&](uint32_t) { m_layer.xrCreateSession(m_instance, &sessionInfo, &session); });
+
+            XrSwapchainCreateInfo swapchainInfo = { XR_TYPE_SWAPCHAIN_CREATE_INFO };
+            swapchainInfo.usageFlags = XR_SWAPCHAIN_USAGE_COLOR_ATTACHMENT_BIT | XR_SWAPCHAIN_USAGE_SAMPLED_BIT;
+            swapchainInfo.format = FormatR8G8B8A8Unorm;
+            swapchainInfo.sampleCount = 1;
+            swapchainInfo.width = views[0].recommendedImageRectWidth;
+            swapchainInfo.height = views[0].recommendedImageRectHeight;
+            swapchainInfo.faceCount = 1;
+            swapchainInfo.arraySize = 1;
+            swapchainInfo.mipCount = 1;
+
+            // Swapchain creation, including the textures, and destruction.
+            {
+                const uint32_t numSwapchains = 20;
+                std::vector<XrSwapchain> swapchains(numSwapchains);
+                std::vector<void*> images;
+                Measurement results[2][3];
+                for (int i = 0; i < 2; i++)
+                {
+                    const Dispatch& dispatch = i == 0 ? m_layer : m_runtime;
+                    results[i][0] = Measure(numSwapchains, [&](uint32_t j) { dispatch.xrCreateSwapchain(session, &swapchainInfo, &swapchains[j]); });
+                    results[i][1] = Measure(numSwapchains, [&](uint32_t j) {
+                        m_graphics->enumerateImages(dispatch.xrEnumerateSwapchainImages, swapchains[j], 8, images);
+                    });
+                    results[i][2] = Measure(numSwapchains, [&](uint32_t j) { dispatch.xrDestroySwapchain(swapchains[j]); });
+                }
+                Report("xrCreateSwapchain", 0, numViews, numSwapchains, results[0][0], results[1][0]);
+                Report("xrEnumerateSwapchainImages", 0, numViews, numSwapchains, results[0][1], results[1][1]);
+                Report("xrDestroySwapchain", 0, numViews, numSwapchains, results[0][2], results[1][2]);
+            }
+
+            // One swapchain per view, like most applications.
+            std::vector<XrSwapchain> swapchains(numViews);
+            for (XrSwapchain& swapchain : swapchains)
+            {
+                std::vector<void*> images;
+                if (m_layer.xrCreateSwapchain(session, &swapchainInfo, &swapchain) != XR_SUCCESS ||
+                    m_graphics->enumerateImages(m_layer.xrEnumerateSwapchainImages, swapchain, 8, images) != XR_SUCCESS)
+                {
+                    std::fprintf(stderr, "Cannot create the swapchains\n");
+                    return false;
+                }
+            }
+
+            const uint32_t numAcquires = 100000;
+            const auto acquire = [&](const Dispatch& dispatch) {
+                uint32_t index;
+                return Measure(numAcquires, [&](uint32_t i) { dispatch.xrAcquireSwapchainImage(swapchains[i % numViews], nullptr, &index); });
+            };
+            Report("xrAcquireSwapchainImage", 0, numViews, numAcquires, acquire(m_layer), acquire(m_runtime));
+
+            for (const uint32_t numLayers : { 1u, 2u, 4u })
+            {
+                std::vector<XrCompositionLayerProjectionView> projectionViews(numViews, { XR_TYPE_COMPOSITION_LAYER_PROJECTION_VIEW });
+                for (uint32_t i = 0; i < numViews; i++)
+                {
+                    projectionViews[i].pose.orientation.w = 1.f;
+                    projectionViews[i].subImage.swapchain = swapchains[i];
+                    projectionViews[i].subImage.imageRect.extent.width = swapchainInfo.width;
+                    projectionViews[i].subImage.imageRect.extent.height = swapchainInfo.height;
+                }
+                std::vector<XrCompositionLayerProjection> projections(numLayers, { XR_TYPE_COMPOSITION_LAYER_PROJECTION });
+                std::vector<const XrCompositionLayerBaseHeader*> layers;
+                for (XrCompositionLayerProjection& projection : projections)
+                {
+                    projection.viewCount = numViews;
+                    projection.views = projectionViews.data();
+                    layers.push_back(reinterpret_cast<const XrCompositionLayerBaseHeader*>(&projection));
+                }
+                XrFrameEndInfo frameEndInfo = { XR_TYPE_FRAME_END_INFO };
+                frameEndInfo.environmentBlendMode = XR_ENVIRONMENT_BLEND_MODE_OPAQUE;
+                frameEndInfo.layerCount = numLayers;
+                frameEndInfo.layers = layers.data();
+
+                const auto endFrame = [&](const Dispatch& dispatch) {
+                    return Measure(m_numFrames, [&](uint32_t i) {
+                        frameEndInfo.displayTime = i + 1;
+                        dispatch.xrEndFrame(session, &frameEndInfo);
+                    });
+                };
+                // The first frames allocate the frame arena and the GPU resources: warm up first.
+                endFrame(m_layer);
+                Report("xrEndFrame", numLayers, numViews, m_numFrames, endFrame(m_layer), endFrame(m_runtime));
+                if (LastSubmittedViews().size() != numLayers * numViews)
+                {
+                    std::fprintf(stderr, "The mock runtime did not receive the frames\n");
+                    return false;
+                }
+            }
+
+            for (const XrSwapchain swapchain : swapchains)
+            {
+                m_layer.xrDestroySwapchain(swapchain);
+            }
+            const Measurement destroySession = Measure(1, [&](uint32_t) { m_layer.xrDestroySession(session); });
+
+            // The mock runtime forgets all the swapchains with the session, so it is measured last.
+            const Measurement runtimeCreateSession = Measure(1, [&](uint32_t) { m_runtime.xrCreateSession(m_instance, &sessionInfo, &session); });
+            const Measurement runtimeDestroySession = Measure(1, [&](uint32_t) { m_runtime.xrDestroySession(session); });
+            Report("xrCreateSession", 0, numViews, 1, createSession, runtimeCreateSession);
+            Report("xrDestroySession", 0, numViews, 1, destroySession, runtimeDestroySession);
+
+            return true;
+        }
+
+        const uint32_t m_numFrames;
+        LayerChain m_chain;
+        std::unique_ptr<Graphics> m_graphics;
+        XrInstance m_instance{ XR_NULL_HANDLE };
+        Dispatch m_layer{};
+        Dispatch m_runtime{};
+    };
+}
+
+#ifndef _WIN32
+// Count the allocations of the whole process (see CountAllocations()).
+void* operator new(const size_t size)
+{
+    numAllocations++;
+    if (void* const memory = std::malloc(size ? size : 1))
+    {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](const size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* const memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete[](void* const memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void* const memory, size_t) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete[](void* const memory, size_t) noexcept
+{
+    std::free(memory);
+}
+#endif
+
+int main(int argc, char** argv)
+{
+    std::string layerPath = DefaultLayerPath();
+    uint32_t numFrames = 10000;
+    bool useWarp = false;
+
+    bool isValid = true;
+    for (int i = 1; i < argc && isValid; i++)
+    {
+        const std::string argument = argv[i];
+        if (argument == "--layer" && i + 1 < argc)
+        {
+            layerPath = argv[++i];
+        }
+        else if (argument == "--frames" && i + 1 < argc)
+        {
+            numFrames = (uint32_t)std::strtoul(argv[++i], nullptr, 10);
+            isValid = numFrames > 0;
+        }
+        else if (argument == "--warp")
+        {
+            useWarp = true;
+        }
+        else
+        {
+            isValid = false;
+        }
+    }
+
+    if (!isValid)
+    {
+        std::fprintf(stderr, "Usage: LayerBenchmark [--layer <%s.dll>] [--frames <count>] [--warp]\n", LayerName.c_str());
+        return 1;
+    }
+
+    LayerBenchmark benchmark(numFrames);
+    if (!SetupProfile(std::filesystem::temp_directory_path() / ApplicationName, ApplicationName, "scaling=70\nsharpness=50\n") || !benchmark.createGraphics(useWarp) ||
+        !benchmark.createInstance(layerPath) || !benchmark.run())
+    {
+        return 1;
+    }
+
+    return 0;
+}
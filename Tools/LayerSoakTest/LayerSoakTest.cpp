@@ -0,0 +1,417 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Run the layer through complete sessions against the mock runtime, and check what the runtime receives.
+//
+// Usage: LayerSoakTest [--layer <XR_APILAYER_NOVENDOR_nis_scaler.dll>] [--frames <count>] [--sessions <count>] [--warp]
+//
+// Each scenario configures the mock runtime (view count, swapchain formats, quirks), then creates an instance and a
+// session through the layer and runs the frame loop like an application would, as fast as the layer allows. The test
+// checks that:
+//  - the recommended resolution is scaled down, and the runtime swapchains are created at the display resolution;
+//  - the runtime swapchains have the format and the usage expected from the format negotiation;
+//  - the application renders to the layer's textures, never to the runtime's;
+//  - every submitted view uses the runtime swapchain, with an image rectangle covering the display resolution;
+//  - the mock runtime found no violation of the specification.
+//
+// The layer library is required: where it cannot be built (eg: on Linux), the test fails rather than pass on the mock
+// runtime alone.
+
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "../MockRuntime/FrameLoop.h"
+#include "../MockRuntime/LayerChain.h"
+
+using namespace mock_runtime;
+
+namespace
+{
+    const char* const ApplicationName = "LayerSoakTest";
+
+    struct Scenario
+    {
+        const char* name;
+        Options options;
+        int64_t applicationFormat;
+
+        // Whether the application uses a single texture array for all the views, or one swapchain per view.
+        bool useTextureArray;
+
+        int64_t expectedRuntimeFormat;
+        bool expectUnorderedAccess;
+    };
+
+    std::vector<Scenario> MakeScenarios()
+    {
+        const Options defaults;
+        std::vector<Scenario> scenarios;
+
+        scenarios.push_back({ "RGBA", defaults, FormatR8G8B8A8Unorm, false, FormatR8G8B8A8Unorm, true });
+        scenarios.push_back({ "BGRA", defaults, FormatB8G8R8A8Unorm, false, FormatB8G8R8A8Unorm, true });
+        scenarios.push_back({ "RGBA texture array", defaults, FormatR8G8B8A8Unorm, true, FormatR8G8B8A8Unorm, true });
+
+        Options quadViews = defaults;
+        quadViews.viewCount = 4;
+        scenarios.push_back({ "RGBA quad views", quadViews, FormatR8G8B8A8Unorm, false, FormatR8G8B8A8Unorm, true });
+
+        // sRGB cannot be written through a UAV: the runtime swapchain uses the intermediate format when the runtime
+        // supports it, and the application's format with a color conversion pass otherwise.
+        scenarios.push_back({ "sRGB", defaults, FormatR8G8B8A8UnormSrgb, false, FormatR16G16B16A16Unorm, true });
+
+        Options noIntermediateFormat = defaults;
+        noIntermediateFormat.formats = { FormatR8G8B8A8UnormSrgb, FormatR8G8B8A8Unorm, FormatD32Float };
+        scenarios.push_back({ "sRGB without intermediate format", noIntermediateFormat, FormatR8G8B8A8UnormSrgb, false,
+            FormatR8G8B8A8UnormSrgb, false });
+
+        Options steamVR = defaults;
+        steamVR.runtimeName = "SteamVR/OpenXR";
+        steamVR.formatsWithoutUnorderedAccess = { FormatR16G16B16A16Unorm };
+        scenarios.push_back({ "sRGB on SteamVR", steamVR, FormatR8G8B8A8UnormSrgb, false, FormatR8G8B8A8UnormSrgb, false });
+        scenarios.push_back({ "RGBA on SteamVR", steamVR, FormatR8G8B8A8Unorm, false, FormatR8G8B8A8Unorm, true });
+
+        return scenarios;
+    }
+
+    // The first failure of a scenario, if any.
+    class Checker
+    {
+    public:
+        bool check(const bool condition, const char* fmt, ...)
+        {
+            if (!condition && m_failure.empty())
+            {
+                char buf[1024];
+                va_list va;
+                va_start(va, fmt);
+                vsnprintf(buf, sizeof(buf), fmt, va);
+                va_end(va);
+                m_failure = buf;
+            }
+            return condition;
+        }
+
+        bool succeeded(const XrResult result, const char* what)
+        {
+            return check(XR_SUCCEEDED(result), "%s failed with %d", what, result);
+        }
+
+        // Fold the validation errors of the mock runtime.
+        void checkRuntime()
+        {
+            for (const std::string& error : TakeErrors())
+            {
+                check(false, "Runtime validation: %s", error.c_str());
+            }
+        }
+
+        bool ok() const
+        {
+            return m_failure.empty();
+        }
+
+        const std::string& failure() const
+        {
+            return m_failure;
+        }
+
+    private:
+        std::string m_failure;
+    };
+
+    class LayerSoakTest
+    {
+    public:
+        LayerSoakTest(const uint32_t numFrames, const uint32_t numSessions) : m_numFrames(numFrames), m_numSessions(numSessions)
+        {
+        }
+
+        bool createGraphics(const bool useWarp)
+        {
+            m_graphics = CreateGraphics(useWarp);
+            return m_graphics != nullptr;
+        }
+
+        bool load(const std::string& layerPath)
+        {
+            return m_chain.load(layerPath);
+        }
+
+        bool run()
+        {
+            bool isSuccess = true;
+            for (const Scenario& scenario : MakeScenarios())
+            {
+                Checker checker;
+                double framesPerSecond = 0;
+
+                // The layer reads the runtime properties when the instance is created.
+                Configure(scenario.options);
+                XrInstance instance = XR_NULL_HANDLE;
+                Dispatch xr{};
+                if (checker.check(m_chain.createInstance(ApplicationName, instance), "Cannot create the instance") &&
+                    checker.check(xr.resolve(m_chain.getInstanceProcAddr(), instance), "Cannot resolve the functions"))
+                {
+                    for (uint32_t i = 0; i < m_numSessions && checker.ok(); i++)
+                    {
+                        runSession(scenario, xr, instance, checker, framesPerSecond);
+                    }
+                    xr.xrDestroyInstance(instance);
+                }
+                checker.checkRuntime();
+
+                if (checker.ok())
+                {
+                    std::printf("PASS %s: %u sessions, %.0f frames/s\n", scenario.name, m_numSessions, framesPerSecond);
+                }
+                else
+                {
+                    std::printf("FAIL %s: %s\n", scenario.name, checker.failure().c_str());
+                    isSuccess = false;
+                }
+            }
+
+            return isSuccess;
+        }
+
+    private:
+        void runSession(const Scenario& scenario, const Dispatch& xr, const XrInstance instance, Checker& checker, double& framesPerSecond)
+        {
+            const Options& options = scenario.options;
+            const uint32_t viewCount = options.viewCount;
+
+            XrSystemGetInfo systemInfo = { XR_TYPE_SYSTEM_GET_INFO };
+            systemInfo.formFactor = XR_FORM_FACTOR_HEAD_MOUNTED_DISPLAY;
+            XrSystemId systemId;
+            std::vector<XrViewConfigurationView> views(viewCount, { XR_TYPE_VIEW_CONFIGURATION_VIEW });
+            uint32_t count;
+            if (!checker.succeeded(xr.xrGetSystem(instance, &systemInfo, &systemId), "xrGetSystem") ||
+                !checker.succeeded(xr.xrEnumerateViewConfigurationViews(instance, systemId, XR_VIEW_CONFIGURATION_TYPE_PRIMARY_STEREO,
+                    viewCount, &count, views.data()), "xrEnumerateViewConfigurationViews"))
+            {
+                return;
+            }
+            const uint32_t width = views[0].recommendedImageRectWidth;
+            const uint32_t height = views[0].recommendedImageRectHeight;
+            if (!checker.check(width < options.width && height < options.height,
+                    "The recommended resolution %ux%u is not scaled, the layer is not active (see its log file)", width, height))
+            {
+                return;
+            }
+
+            FrameLoop loop(xr, instance, *m_graphics);
+            if (!checker.succeeded(loop.createSession(systemId), loop.failedFunction()))
+            {
+                return;
+            }
+            if (checker.check(loop.state() == XR_SESSION_STATE_READY, "The session is not ready") &&
+                checker.succeeded(loop.beginSession(), loop.failedFunction()))
+            {
+                std::vector<XrSwapchain> swapchains;
+                if (createSwapchains(scenario, xr, loop.session(), width, height, checker, swapchains))
+                {
+                    framesPerSecond = runFrames(scenario, loop, width, height, checker, swapchains);
+                }
+                for (const XrSwapchain swapchain : swapchains)
+                {
+                    xr.xrDestroySwapchain(swapchain);
+                }
+
+                if (checker.succeeded(loop.requestExitSession(), loop.failedFunction()))
+                {
+                    checker.check(loop.state() == XR_SESSION_STATE_STOPPING, "The session is not stopping");
+                    checker.succeeded(loop.endSession(), loop.failedFunction());
+                    checker.check(loop.state() == XR_SESSION_STATE_EXITING, "The session is not exiting");
+                }
+            }
+            checker.succeeded(loop.destroySession(), loop.failedFunction());
+            checker.checkRuntime();
+        }
+
+        bool createSwapchains(const Scenario& scenario, const Dispatch& xr, const XrSession session, const uint32_t width,
+                              const uint32_t height, Checker& checker, std::vector<XrSwapchain>& swapchains)
+        {
+            const Options& options = scenario.options;
+
+            XrSwapchainCreateInfo swapchainInfo = { XR_TYPE_SWAPCHAIN_CREATE_INFO };
+            swapchainInfo.usageFlags = XR_SWAPCHAIN_USAGE_COLOR_ATTACHMENT_BIT | XR_SWAPCHAIN_USAGE_SAMPLED_BIT;
+            swapchainInfo.format = scenario.applicationFormat;
+            swapchainInfo.sampleCount = 1;
+            swapchainInfo.width = width;
+            swapchainInfo.height = height;
+            swapchainInfo.faceCount = 1;
+            swapchainInfo.arraySize = scenario.useTextureArray ? options.viewCount : 1;
+            swapchainInfo.mipCount = 1;
+
+            const uint32_t numSwapchains = scenario.useTextureArray ? 1 : options.viewCount;
+            for (uint32_t i = 0; i < numSwapchains; i++)
+            {
+                XrSwapchain swapchain;
+                if (!checker.succeeded(xr.xrCreateSwapchain(session, &swapchainInfo, &swapchain), "xrCreateSwapchain"))
+                {
+                    return false;
+                }
+                swapchains.push_back(swapchain);
+
+                // The layer passes the runtime's handle through, but changes what the runtime creates.
+                XrSwapchainCreateInfo runtimeInfo;
+                if (!checker.check(GetSwapchainInfo(swapchain, runtimeInfo), "The runtime does not know the swapchain") ||
+                    !checker.check(runtimeInfo.width == options.width && runtimeInfo.height == options.height,
+                        "The runtime swapchain is %ux%u instead of %ux%u", runtimeInfo.width, runtimeInfo.height, options.width, options.height) ||
+                    !checker.check(runtimeInfo.format == scenario.expectedRuntimeFormat,
+                        "The runtime swapchain has format %lld instead of %lld", runtimeInfo.format, scenario.expectedRuntimeFormat) ||
+                    !checker.check(!!(runtimeInfo.usageFlags & XR_SWAPCHAIN_USAGE_UNORDERED_ACCESS_BIT) == scenario.expectUnorderedAccess,
+                        "The runtime swapchain usage is 0x%llx", runtimeInfo.usageFlags))
+                {
+                    return false;
+                }
+
+                std::vector<void*> images;
+                if (!checker.succeeded(m_graphics->enumerateImages(xr.xrEnumerateSwapchainImages, swapchain, options.imageCount, images),
+                        "xrEnumerateSwapchainImages"))
+                {
+                    return false;
+                }
+                for (void* const image : images)
+                {
+                    const ImageDescription desc = m_graphics->describeImage(image);
+                    if (!checker.check(!IsRuntimeImage(image), "The application received a runtime texture") ||
+                        !checker.check(desc.width == width && desc.height == height && desc.format == scenario.applicationFormat &&
+                            desc.arraySize == swapchainInfo.arraySize,
+                            "The application texture is %ux%ux%u with format %lld", desc.width, desc.height, desc.arraySize, desc.format))
+                    {
+                        return false;
+                    }
+                }
+            }
+
+            return true;
+        }
+
+        double runFrames(const Scenario& scenario, FrameLoop& loop, const uint32_t width, const uint32_t height, Checker& checker,
+                         const std::vector<XrSwapchain>& swapchains)
+        {
+            const uint32_t viewCount = scenario.options.viewCount;
+
+            std::vector<XrCompositionLayerProjectionView> projectionViews(viewCount, { XR_TYPE_COMPOSITION_LAYER_PROJECTION_VIEW });
+            for (uint32_t i = 0; i < viewCount; i++)
+            {
+                projectionViews[i].pose.orientation.w = 1.f;
+                projectionViews[i].subImage.swapchain = swapchains[scenario.useTextureArray ? 0 : i];
+                projectionViews[i].subImage.imageRect.extent.width = width;
+                projectionViews[i].subImage.imageRect.extent.height = height;
+                projectionViews[i].subImage.imageArrayIndex = scenario.useTextureArray ? i : 0;
+            }
+            XrCompositionLayerProjection projection = { XR_TYPE_COMPOSITION_LAYER_PROJECTION };
+            projection.viewCount = viewCount;
+            projection.views = projectionViews.data();
+            const XrCompositionLayerBaseHeader* const layers[] = { reinterpret_cast<const XrCompositionLayerBaseHeader*>(&projection) };
+
+            const auto start = std::chrono::steady_clock::now();
+            for (uint32_t frame = 0; frame < m_numFrames && checker.ok(); frame++)
+            {
+                // Like a loading screen, submit no layer from time to time.
+                const bool isEmptyFrame = frame % 97 == 96;
+                const uint32_t layerCount = isEmptyFrame ? 0 : 1;
+                if (!checker.succeeded(loop.runFrame(swapchains, layerCount, layers), loop.failedFunction()))
+                {
+                    break;
+                }
+
+                // The runtime must see its own swapchains at the display resolution, whatever the application submitted.
+                const std::vector<SubmittedView>& submitted = LastSubmittedViews();
+                if (!checker.check(submitted.size() == layerCount * viewCount, "Frame %u has %zu views", frame, submitted.size()))
+                {
+                    break;
+                }
+                for (uint32_t i = 0; i < submitted.size(); i++)
+                {
+                    const XrRect2Di& rect = submitted[i].imageRect;
+                    checker.check(submitted[i].swapchain == projectionViews[i].subImage.swapchain &&
+                        submitted[i].imageArrayIndex == projectionViews[i].subImage.imageArrayIndex,
+                        "Frame %u view %u uses the wrong image", frame, i);
+                    checker.check(rect.offset.x == 0 && rect.offset.y == 0 &&
+                        rect.extent.width == (int32_t)scenario.options.width && rect.extent.height == (int32_t)scenario.options.height,
+                        "Frame %u view %u has rectangle %d,%d %dx%d", frame, i, rect.offset.x, rect.offset.y, rect.extent.width, rect.extent.height);
+                }
+            }
+            const auto end = std::chrono::steady_clock::now();
+
+            return m_numFrames / std::chrono::duration<double>(end - start).count();
+        }
+
+        const uint32_t m_numFrames;
+        const uint32_t m_numSessions;
+        LayerChain m_chain;
+        std::unique_ptr<Graphics> m_graphics;
+    };
+}
+
+int main(int argc, char** argv)
+{
+    std::string layerPath = DefaultLayerPath();
+    uint32_t numFrames = 10000;
+    uint32_t numSessions = 3;
+    bool useWarp = false;
+
+    bool isValid = true;
+    for (int i = 1; i < argc && isValid; i++)
+    {
+        const std::string argument = argv[i];
+        if (argument == "--layer" && i + 1 < argc)
+        {
+            layerPath = argv[++i];
+        }
+        else if (argument == "--frames" && i + 1 < argc)
+        {
+            numFrames = (uint32_t)std::strtoul(argv[++i], nullptr, 10);
+            isValid = numFrames > 0;
+        }
+        else if (argument == "--sessions" && i + 1 < argc)
+        {
+            numSessions = (uint32_t)std::strtoul(argv[++i], nullptr, 10);
+            isValid = numSessions > 0;
+        }
+        else if (argument == "--warp")
+        {
+            useWarp = true;
+        }
+        else
+        {
+            isValid = false;
+        }
+    }
+
+    if (!isValid)
+    {
+        std::fprintf(stderr, "Usage: LayerSoakTest [--layer <%s.dll>] [--frames <count>] [--sessions <count>] [--warp]\n", LayerName.c_str());
+        return 1;
+    }
+
+    LayerSoakTest test(numFrames, numSessions);
+    if (!SetupProfile(std::filesystem::temp_directory_path() / ApplicationName, ApplicationName, "scaling=70\nsharpness=50\n") ||
+        !test.createGraphics(useWarp) || !test.load(layerPath) || !test.run())
+    {
+        return 1;
+    }
+
+    return 0;
+}
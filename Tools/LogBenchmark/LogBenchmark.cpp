@@ -0,0 +1,247 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+// Validate and benchmark the asynchronous logging (see Log.h).
+//
+// Usage: LogBenchmark --check
+//        LogBenchmark --benchmark [messages [threads]]
+//
+// Both modes log to LogBenchmark.log in the temporary directory. The check logs bursts of messages with strings and numbers
+// of various sizes, and verifies that each message was written intact or counted as dropped. The benchmark times each
+// call of the callers during a burst (100k messages by default) like the statistics line of the layer, and reports the
+// percentiles of the caller latency and the number of dropped messages. A burst larger than the queue is expected to
+// drop messages: the callers must still never wait.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Log.h"
+
+using namespace nis_scaler;
+
+namespace
+{
+    std::filesystem::path g_logPath;
+    std::streamoff g_logOffset = 0;
+
+    // Wait until the writer thread has written or dropped the given number of messages, and return the new lines of the
+    // log and the number of dropped messages.
+    bool WaitForMessages(const size_t count, std::vector<std::string>& lines, uint64_t& dropped)
+    {
+        const std::string droppedSuffix = " log messages were dropped";
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+        std::streamoff offset = g_logOffset;
+        std::string partial;
+        lines.clear();
+        dropped = 0;
+        while (lines.size() + dropped < count)
+        {
+            if (std::chrono::steady_clock::now() > deadline)
+            {
+                return false;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+            std::ifstream stream(g_logPath, std::ios_base::binary);
+            stream.seekg(offset);
+            std::string line;
+            while (std::getline(stream, line))
+            {
+                if (stream.eof())
+                {
+                    // Not terminated yet.
+                    partial = line;
+                    break;
+                }
+                offset += (std::streamoff)line.size() + 1;
+
+                // Skip the timestamp.
+                const size_t separator = line.find(": ");
+                line = separator != std::string::npos ? line.substr(separator + 2) : line;
+                if (line.size() > droppedSuffix.size() && line.compare(line.size() - droppedSuffix.size(), droppedSuffix.size(), droppedSuffix) == 0)
+                {
+                    dropped += std::strtoull(line.c_str(), nullptr, 10);
+                }
+                else
+                {
+                    lines.push_back(line);
+                }
+            }
+        }
+        g_logOffset = offset;
+        return true;
+    }
+
+    int Check()
+    {
+        int result = 0;
+        const auto expect = [&](const char* name, const uint64_t errors) {
+            std::printf("%s: %s", name, !errors ? "ok\n" : "FAILED");
+            if (errors)
+            {
+                std::printf(" (%llu errors)\n", (unsigned long long)errors);
+                result = 1;
+            }
+        };
+
+        for (const uint32_t count : { 10u, 1000u, 20000u })
+        {
+            // The strings are longer than the payload every 16 messages, and are then truncated.
+            std::vector<std::string> expected;
+            for (uint32_t i = 0; i < count; i++)
+            {
+                const std::string text(i % 16 == 15 ? 1000 : i % 200, (char)('a' + i % 26));
+                const double value = i * 0.25;
+                const int64_t big = -(int64_t)i * 1000000007ll;
+                Log("check %u of %u: %s %.2f %lld %c\n", i, count, text.c_str(), value, (long long)big, (char)('A' + i % 26));
+
+                char buffer[2048];
+                const std::string stored = text.substr(0, log_detail::MaxPayloadSize - 1 - 40);
+                std::snprintf(buffer, sizeof(buffer), "check %u of %u: %s %.2f %lld %c", i, count, stored.c_str(), value, (long long)big, (char)('A' + i % 26));
+                expected.push_back(buffer);
+            }
+
+            std::vector<std::string> lines;
+            uint64_t dropped;
+            uint64_t errors = 0;
+            if (!WaitForMessages(count, lines, dropped))
+            {
+                errors++;
+            }
+
+            // The messages are written in order. The writer frees slots during the burst, so the dropped messages can be
+            // anywhere in it.
+            uint32_t nextIndex = 0;
+            for (const std::string& line : lines)
+            {
+                const uint32_t index = (uint32_t)std::strtoul(line.c_str() + std::strlen("check "), nullptr, 10);
+                if (line.compare(0, 6, "check ") != 0 || index < nextIndex || index >= count)
+                {
+                    errors++;
+                    continue;
+                }
+                nextIndex = index + 1;
+
+                // The length of the truncated strings depends on the size of the packed arguments: only check the prefix.
+                const std::string& reference = expected[index];
+                if (line.compare(0, 20, reference, 0, 20) != 0 || (reference.size() < 300 && line != reference))
+                {
+                    errors++;
+                }
+            }
+            const std::string name = "burst of " + std::to_string(count) + " (" + std::to_string(dropped) + " dropped)";
+            expect(name.c_str(), errors + (lines.size() + dropped != count));
+        }
+
+        // Stopping writes the queued messages before the writer thread exits, and logging can start again.
+        {
+            for (uint32_t i = 0; i < 100; i++)
+            {
+                Log("stop %u\n", i);
+            }
+            StopLogging();
+            std::vector<std::string> lines;
+            uint64_t dropped;
+            uint64_t errors = !WaitForMessages(100, lines, dropped) || dropped;
+            for (uint32_t i = 0; i < lines.size(); i++)
+            {
+                errors += lines[i] != "stop " + std::to_string(i);
+            }
+            expect("stop", errors);
+
+            StartLogging(g_logPath.string());
+            Log("restart\n");
+            expect("restart", !WaitForMessages(1, lines, dropped) || lines.size() != 1 || lines[0] != "restart");
+        }
+
+        return result;
+    }
+
+    int Benchmark(int argc, char** argv)
+    {
+        const uint32_t count = argc > 2 ? (std::max)((uint32_t)std::strtoul(argv[2], nullptr, 10), 1u) : 100000;
+        const uint32_t numThreads = argc > 3 ? (std::max)((uint32_t)std::strtoul(argv[3], nullptr, 10), 1u) : 1;
+
+        // Each thread times its own calls.
+        std::vector<std::vector<uint32_t>> latencies(numThreads);
+        std::vector<std::thread> threads;
+        for (uint32_t t = 0; t < numThreads; t++)
+        {
+            threads.emplace_back([&, t]() {
+                std::vector<uint32_t>& times = latencies[t];
+                times.reserve(count / numThreads);
+                for (uint32_t i = t; i < count; i += numThreads)
+                {
+                    const auto start = std::chrono::steady_clock::now();
+                    Log("numFrames=%u (%u fps), scalerTime(p50/p90/p99/max)=%llu/%llu/%llu/%llu, appGpuTime(p50/p90/p99/max)=%llu/%llu/%llu/%llu, renderScale=%.3f, mode=%s\n",
+                        i, 90u, 1200ull, 1300ull, 1400ull, 2000ull, 8000ull, 9000ull, 9500ull, 11000ull, 0.75f, "NIS");
+                    const auto end = std::chrono::steady_clock::now();
+                    times.push_back((uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+                }
+            });
+        }
+        for (std::thread& thread : threads)
+        {
+            thread.join();
+        }
+
+        std::vector<uint32_t> all;
+        for (const auto& times : latencies)
+        {
+            all.insert(all.end(), times.cbegin(), times.cend());
+        }
+        std::sort(all.begin(), all.end());
+        const auto percentile = [&](const double fraction) { return all[(std::min)((size_t)(fraction * all.size()), all.size() - 1)]; };
+
+        std::vector<std::string> lines;
+        uint64_t dropped = 0;
+        const bool isComplete = WaitForMessages(count, lines, dropped);
+
+        std::printf("messages,threads,p50 ns,p90 ns,p99 ns,p99.9 ns,max ns,written,dropped\n");
+        std::printf("%u,%u,%u,%u,%u,%u,%u,%zu,%llu\n", count, numThreads, percentile(0.5), percentile(0.9), percentile(0.99), percentile(0.999),
+            all.back(), lines.size(), (unsigned long long)dropped);
+
+        return isComplete ? 0 : 1;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const std::string command = argc > 1 ? argv[1] : "";
+    if ((command == "--check" && argc == 2) || (command == "--benchmark" && argc <= 4))
+    {
+        g_logPath = std::filesystem::temp_directory_path() / "LogBenchmark.log";
+        std::error_code ec;
+        std::filesystem::remove(g_logPath, ec);
+        StartLogging(g_logPath.string());
+
+        return command == "--check" ? Check() : Benchmark(argc, argv);
+    }
+
+    std::fprintf(stderr,
+        "Usage: LogBenchmark --check\n"
+        "       LogBenchmark --benchmark [messages [threads]]\n");
+    return 1;
+}
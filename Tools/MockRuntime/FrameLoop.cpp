@@ -0,0 +1,161 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "FrameLoop.h"
+
+namespace mock_runtime
+{
+    bool Dispatch::resolve(const PFN_xrGetInstanceProcAddr getInstanceProcAddr, const XrInstance instance)
+    {
+        xrGetInstanceProcAddr = getInstanceProcAddr;
+
+#define RESOLVE(xrCall)                                                                                           \
+        if (getInstanceProcAddr(instance, #xrCall, reinterpret_cast<PFN_xrVoidFunction*>(&xrCall)) != XR_SUCCESS) \
+        {                                                                                                         \
+            return false;                                                                                         \
+        }
+
+        RESOLVE(xrDestroyInstance);
+        RESOLVE(xrPollEvent);
+        RESOLVE(xrGetSystem);
+        RESOLVE(xrEnumerateViewConfigurationViews);
+        RESOLVE(xrCreateSession);
+        RESOLVE(xrDestroySession);
+        RESOLVE(xrBeginSession);
+        RESOLVE(xrRequestExitSession);
+        RESOLVE(xrEndSession);
+        RESOLVE(xrCreateSwapchain);
+        RESOLVE(xrDestroySwapchain);
+        RESOLVE(xrEnumerateSwapchainImages);
+        RESOLVE(xrAcquireSwapchainImage);
+        RESOLVE(xrWaitSwapchainImage);
+        RESOLVE(xrReleaseSwapchainImage);
+        RESOLVE(xrWaitFrame);
+        RESOLVE(xrBeginFrame);
+        RESOLVE(xrEndFrame);
+
+#undef RESOLVE
+
+        return true;
+    }
+
+    FrameLoop::FrameLoop(const Dispatch& xr, const XrInstance instance, const Graphics& graphics)
+        : m_xr(xr), m_instance(instance), m_graphics(graphics)
+    {
+    }
+
+    XrResult FrameLoop::createSession(const XrSystemId systemId)
+    {
+        XrSessionCreateInfo sessionInfo = { XR_TYPE_SESSION_CREATE_INFO };
+        sessionInfo.next = m_graphics.sessionBinding();
+        sessionInfo.systemId = systemId;
+        m_state = XR_SESSION_STATE_UNKNOWN;
+        const XrResult result = check(m_xr.xrCreateSession(m_instance, &sessionInfo, &m_session), "xrCreateSession");
+        pollEvents();
+        return result;
+    }
+
+    XrResult FrameLoop::beginSession()
+    {
+        XrSessionBeginInfo beginInfo = { XR_TYPE_SESSION_BEGIN_INFO };
+        beginInfo.primaryViewConfigurationType = XR_VIEW_CONFIGURATION_TYPE_PRIMARY_STEREO;
+        const XrResult result = check(m_xr.xrBeginSession(m_session, &beginInfo), "xrBeginSession");
+        pollEvents();
+        return result;
+    }
+
+    XrResult FrameLoop::requestExitSession()
+    {
+        const XrResult result = check(m_xr.xrRequestExitSession(m_session), "xrRequestExitSession");
+        pollEvents();
+        return result;
+    }
+
+    XrResult FrameLoop::endSession()
+    {
+        const XrResult result = check(m_xr.xrEndSession(m_session), "xrEndSession");
+        pollEvents();
+        return result;
+    }
+
+    XrResult FrameLoop::destroySession()
+    {
+        const XrResult result = check(m_xr.xrDestroySession(m_session), "xrDestroySession");
+        m_session = XR_NULL_HANDLE;
+        return result;
+    }
+
+    XrResult FrameLoop::runFrame(const std::vector<XrSwapchain>& swapchains,
+                                 const uint32_t layerCount,
+                                 const XrCompositionLayerBaseHeader* const* const layers)
+    {
+        XrFrameWaitInfo waitInfo = { XR_TYPE_FRAME_WAIT_INFO };
+        XrFrameState frameState = { XR_TYPE_FRAME_STATE };
+        XrResult result = check(m_xr.xrWaitFrame(m_session, &waitInfo, &frameState), "xrWaitFrame");
+        if (XR_FAILED(result))
+        {
+            return result;
+        }
+        XrFrameBeginInfo frameBeginInfo = { XR_TYPE_FRAME_BEGIN_INFO };
+        result = check(m_xr.xrBeginFrame(m_session, &frameBeginInfo), "xrBeginFrame");
+        if (XR_FAILED(result))
+        {
+            return result;
+        }
+
+        for (const XrSwapchain swapchain : swapchains)
+        {
+            uint32_t index;
+            XrSwapchainImageWaitInfo imageWaitInfo = { XR_TYPE_SWAPCHAIN_IMAGE_WAIT_INFO };
+            imageWaitInfo.timeout = 100000000;
+            if (XR_FAILED(result = check(m_xr.xrAcquireSwapchainImage(swapchain, nullptr, &index), "xrAcquireSwapchainImage")) ||
+                XR_FAILED(result = check(m_xr.xrWaitSwapchainImage(swapchain, &imageWaitInfo), "xrWaitSwapchainImage")) ||
+                XR_FAILED(result = check(m_xr.xrReleaseSwapchainImage(swapchain, nullptr), "xrReleaseSwapchainImage")))
+            {
+                return result;
+            }
+        }
+
+        XrFrameEndInfo frameEndInfo = { XR_TYPE_FRAME_END_INFO };
+        frameEndInfo.displayTime = frameState.predictedDisplayTime;
+        frameEndInfo.environmentBlendMode = XR_ENVIRONMENT_BLEND_MODE_OPAQUE;
+        frameEndInfo.layerCount = layerCount;
+        frameEndInfo.layers = layers;
+        return check(m_xr.xrEndFrame(m_session, &frameEndInfo), "xrEndFrame");
+    }
+
+    XrResult FrameLoop::check(const XrResult result, const char* const function)
+    {
+        if (XR_FAILED(result))
+        {
+            m_failedFunction = function;
+        }
+        return result;
+    }
+
+    void FrameLoop::pollEvents()
+    {
+        XrEventDataBuffer event = { XR_TYPE_EVENT_DATA_BUFFER };
+        while (m_xr.xrPollEvent(m_instance, &event) == XR_SUCCESS)
+        {
+            if (event.type == XR_TYPE_EVENT_DATA_SESSION_STATE_CHANGED)
+            {
+                m_state = reinterpret_cast<const XrEventDataSessionStateChanged*>(&event)->state;
+            }
+            event = { XR_TYPE_EVENT_DATA_BUFFER };
+        }
+    }
+}
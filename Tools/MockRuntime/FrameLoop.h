@@ -0,0 +1,99 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <vector>
+
+#include "Graphics.h"
+
+// Drive a session like an application would: the session lifecycle and its events, and the frame loop. The driver only
+// goes through the OpenXR functions it is given (through the layer, or directly on the mock runtime) and through the
+// Graphics interface, so it runs on any platform.
+
+namespace mock_runtime
+{
+    // The functions used by an application, resolved through xrGetInstanceProcAddr().
+    struct Dispatch
+    {
+        PFN_xrGetInstanceProcAddr xrGetInstanceProcAddr;
+        PFN_xrDestroyInstance xrDestroyInstance;
+        PFN_xrPollEvent xrPollEvent;
+        PFN_xrGetSystem xrGetSystem;
+        PFN_xrEnumerateViewConfigurationViews xrEnumerateViewConfigurationViews;
+        PFN_xrCreateSession xrCreateSession;
+        PFN_xrDestroySession xrDestroySession;
+        PFN_xrBeginSession xrBeginSession;
+        PFN_xrRequestExitSession xrRequestExitSession;
+        PFN_xrEndSession xrEndSession;
+        PFN_xrCreateSwapchain xrCreateSwapchain;
+        PFN_xrDestroySwapchain xrDestroySwapchain;
+        PFN_xrEnumerateSwapchainImages xrEnumerateSwapchainImages;
+        PFN_xrAcquireSwapchainImage xrAcquireSwapchainImage;
+        PFN_xrWaitSwapchainImage xrWaitSwapchainImage;
+        PFN_xrReleaseSwapchainImage xrReleaseSwapchainImage;
+        PFN_xrWaitFrame xrWaitFrame;
+        PFN_xrBeginFrame xrBeginFrame;
+        PFN_xrEndFrame xrEndFrame;
+
+        bool resolve(PFN_xrGetInstanceProcAddr getInstanceProcAddr, XrInstance instance);
+    };
+
+    class FrameLoop
+    {
+    public:
+        FrameLoop(const Dispatch& xr, XrInstance instance, const Graphics& graphics);
+
+        // Each call returns the result of the first OpenXR call that failed, see failedFunction().
+        XrResult createSession(XrSystemId systemId);
+        XrResult beginSession();
+        XrResult requestExitSession();
+        XrResult endSession();
+        XrResult destroySession();
+
+        // Wait for a frame, begin it, acquire, wait and release an image of each swapchain, then end the frame with the
+        // layers (which may be empty).
+        XrResult runFrame(const std::vector<XrSwapchain>& swapchains, uint32_t layerCount, const XrCompositionLayerBaseHeader* const* layers);
+
+        XrSession session() const
+        {
+            return m_session;
+        }
+
+        // The last state reached by the session, from the events received so far.
+        XrSessionState state() const
+        {
+            return m_state;
+        }
+
+        const char* failedFunction() const
+        {
+            return m_failedFunction;
+        }
+
+    private:
+        XrResult check(XrResult result, const char* function);
+        void pollEvents();
+
+        const Dispatch& m_xr;
+        const XrInstance m_instance;
+        const Graphics& m_graphics;
+
+        XrSession m_session{ XR_NULL_HANDLE };
+        XrSessionState m_state{ XR_SESSION_STATE_UNKNOWN };
+        const char* m_failedFunction{ "" };
+    };
+}
@@ -0,0 +1,153 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "Graphics.h"
+
+#include <cstdio>
+
+#ifdef _WIN32
+#include <wrl.h>
+#endif
+
+namespace
+{
+    using namespace mock_runtime;
+
+#ifdef _WIN32
+    using Microsoft::WRL::ComPtr;
+
+    class D3D11Graphics : public Graphics
+    {
+    public:
+        bool create(const bool useWarp)
+        {
+            const D3D_FEATURE_LEVEL featureLevel = D3D_FEATURE_LEVEL_11_0;
+            for (const D3D_DRIVER_TYPE driverType : { D3D_DRIVER_TYPE_NULL, D3D_DRIVER_TYPE_WARP })
+            {
+                if (useWarp && driverType == D3D_DRIVER_TYPE_NULL)
+                {
+                    continue;
+                }
+                if (SUCCEEDED(D3D11CreateDevice(nullptr, driverType, nullptr, 0, &featureLevel, 1, D3D11_SDK_VERSION,
+                        m_device.ReleaseAndGetAddressOf(), nullptr, nullptr)))
+                {
+                    m_name = driverType == D3D_DRIVER_TYPE_NULL ? "D3D11 null device" : "D3D11 WARP device";
+                    m_binding.device = m_device.Get();
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        const char* name() const override
+        {
+            return m_name;
+        }
+
+        const void* sessionBinding() const override
+        {
+            return &m_binding;
+        }
+
+        XrResult enumerateImages(const PFN_xrEnumerateSwapchainImages xrEnumerateSwapchainImages,
+                                 const XrSwapchain swapchain,
+                                 const uint32_t capacity,
+                                 std::vector<void*>& images) override
+        {
+            m_images.assign(capacity, { XR_TYPE_SWAPCHAIN_IMAGE_D3D11_KHR });
+            uint32_t count = 0;
+            const XrResult result = xrEnumerateSwapchainImages(swapchain, capacity, &count, reinterpret_cast<XrSwapchainImageBaseHeader*>(m_images.data()));
+            images.clear();
+            for (uint32_t i = 0; XR_SUCCEEDED(result) && i < count; i++)
+            {
+                images.push_back(m_images[i].texture);
+            }
+            return result;
+        }
+
+        ImageDescription describeImage(void* const image) const override
+        {
+            D3D11_TEXTURE2D_DESC desc;
+            static_cast<ID3D11Texture2D*>(image)->GetDesc(&desc);
+            return { desc.Width, desc.Height, desc.ArraySize, (int64_t)desc.Format };
+        }
+
+    private:
+        const char* m_name{ "" };
+        ComPtr<ID3D11Device> m_device;
+        XrGraphicsBindingD3D11KHR m_binding{ XR_TYPE_GRAPHICS_BINDING_D3D11_KHR };
+        std::vector<XrSwapchainImageD3D11KHR> m_images;
+    };
+#else
+    class HeadlessGraphics : public Graphics
+    {
+    public:
+        const char* name() const override
+        {
+            return "headless session";
+        }
+
+        const void* sessionBinding() const override
+        {
+            return nullptr;
+        }
+
+        XrResult enumerateImages(const PFN_xrEnumerateSwapchainImages xrEnumerateSwapchainImages,
+                                 const XrSwapchain swapchain,
+                                 const uint32_t capacity,
+                                 std::vector<void*>& images) override
+        {
+            m_images.assign(capacity, { TypeSwapchainImageHeadless });
+            uint32_t count = 0;
+            const XrResult result = xrEnumerateSwapchainImages(swapchain, capacity, &count, reinterpret_cast<XrSwapchainImageBaseHeader*>(m_images.data()));
+            images.clear();
+            for (uint32_t i = 0; XR_SUCCEEDED(result) && i < count; i++)
+            {
+                images.push_back(m_images[i].image);
+            }
+            return result;
+        }
+
+        ImageDescription describeImage(void* const image) const override
+        {
+            return *static_cast<const ImageDescription*>(image);
+        }
+
+    private:
+        std::vector<SwapchainImageHeadless> m_images;
+    };
+#endif
+}
+
+namespace mock_runtime
+{
+    std::unique_ptr<Graphics> CreateGraphics(const bool useWarp)
+    {
+#ifdef _WIN32
+        auto graphics = std::make_unique<D3D11Graphics>();
+        if (!graphics->create(useWarp))
+        {
+            std::fprintf(stderr, "Cannot create a D3D11 device\n");
+            return nullptr;
+        }
+#else
+        (void)useWarp;
+        auto graphics = std::make_unique<HeadlessGraphics>();
+#endif
+        std::fprintf(stderr, "Using the %s\n", graphics->name());
+        return graphics;
+    }
+}
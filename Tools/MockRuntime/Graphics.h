@@ -0,0 +1,52 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "MockRuntime.h"
+
+// The graphics API of the application, for the tools driving a session: the device bound to the session and the
+// swapchain images. This is D3D11 on Windows, and a headless session elsewhere (see MockRuntime.h).
+
+namespace mock_runtime
+{
+    class Graphics
+    {
+    public:
+        virtual ~Graphics() = default;
+
+        virtual const char* name() const = 0;
+
+        // The structure to chain to XrSessionCreateInfo, or nullptr for a headless session.
+        virtual const void* sessionBinding() const = 0;
+
+        // Enumerate the images of a swapchain with a single call, like an application that knows the image count. The
+        // images are the D3D11 textures, or the headless images.
+        virtual XrResult enumerateImages(PFN_xrEnumerateSwapchainImages xrEnumerateSwapchainImages,
+                                         XrSwapchain swapchain,
+                                         uint32_t capacity,
+                                         std::vector<void*>& images) = 0;
+
+        virtual ImageDescription describeImage(void* image) const = 0;
+    };
+
+    // Create the D3D11 null device, or WARP when requested or when the null device is not installed. Returns nullptr on
+    // failure. Without D3D11, the graphics are headless and useWarp is ignored.
+    std::unique_ptr<Graphics> CreateGraphics(bool useWarp);
+}
@@ -0,0 +1,167 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "LayerChain.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <vector>
+
+#ifndef _WIN32
+#include <dlfcn.h>
+#endif
+
+#include "ProfileDatabase.h"
+
+namespace mock_runtime
+{
+    const std::string LayerName = "XR_APILAYER_NOVENDOR_nis_scaler";
+
+    bool SetupProfile(const std::filesystem::path& directory, const std::string& applicationName, const std::string& settings)
+    {
+        std::error_code ec;
+        std::filesystem::create_directories(directory, ec);
+
+        std::vector<uint8_t> database;
+        std::string errors;
+        const std::string source = "[" + applicationName + "]\nenabled=1\n" + settings;
+        if (!nis_scaler::CompileProfiles(source, database, errors))
+        {
+            std::fprintf(stderr, "%s", errors.c_str());
+            return false;
+        }
+        std::ofstream file(directory / (LayerName + ".profiles"), std::ios_base::binary | std::ios_base::trunc);
+        file.write(reinterpret_cast<const char*>(database.data()), database.size());
+        if (!file)
+        {
+            return false;
+        }
+
+        const std::string localAppData = directory.string();
+#ifdef _WIN32
+        SetEnvironmentVariableA("LOCALAPPDATA", localAppData.c_str());
+        _putenv_s("LOCALAPPDATA", localAppData.c_str());
+#else
+        setenv("LOCALAPPDATA", localAppData.c_str(), 1);
+#endif
+        std::fprintf(stderr, "Writing the layer's log to %s\n", (directory / (LayerName + ".log")).string().c_str());
+        return true;
+    }
+
+    std::string DefaultLayerPath()
+    {
+#ifdef _WIN32
+        char modulePath[MAX_PATH];
+        GetModuleFileNameA(nullptr, modulePath, sizeof(modulePath));
+        return (std::filesystem::path(modulePath).parent_path() / (LayerName + ".dll")).string();
+#else
+        return "";
+#endif
+    }
+
+    LayerChain::~LayerChain()
+    {
+        if (m_module)
+        {
+#ifdef _WIN32
+            FreeLibrary(static_cast<HMODULE>(m_module));
+#else
+            dlclose(m_module);
+#endif
+        }
+    }
+
+    bool LayerChain::load(const std::string& layerPath)
+    {
+        // There is no stand-in for the layer: the tools would only measure and check the mock runtime.
+        if (layerPath.empty())
+        {
+            std::fprintf(stderr, "No layer library (the layer only builds on Windows), see --layer\n");
+            return false;
+        }
+
+        const char* const negotiateName = "NISScaler_xrNegotiateLoaderApiLayerInterface";
+#ifdef _WIN32
+        m_module = LoadLibraryA(layerPath.c_str());
+        const PFN_xrNegotiateLoaderApiLayerInterface negotiate =
+            m_module ? reinterpret_cast<PFN_xrNegotiateLoaderApiLayerInterface>(GetProcAddress(static_cast<HMODULE>(m_module), negotiateName)) : nullptr;
+#else
+        m_module = dlopen(layerPath.c_str(), RTLD_NOW | RTLD_LOCAL);
+        const PFN_xrNegotiateLoaderApiLayerInterface negotiate =
+            m_module ? reinterpret_cast<PFN_xrNegotiateLoaderApiLayerInterface>(dlsym(m_module, negotiateName)) : nullptr;
+#endif
+        if (!m_module)
+        {
+            std::fprintf(stderr, "Cannot load %s\n", layerPath.c_str());
+            return false;
+        }
+
+        // Negotiate like the loader.
+        XrNegotiateLoaderInfo loaderInfo{};
+        loaderInfo.structType = XR_LOADER_INTERFACE_STRUCT_LOADER_INFO;
+        loaderInfo.structVersion = XR_LOADER_INFO_STRUCT_VERSION;
+        loaderInfo.structSize = sizeof(XrNegotiateLoaderInfo);
+        loaderInfo.minInterfaceVersion = loaderInfo.maxInterfaceVersion = XR_CURRENT_LOADER_API_LAYER_VERSION;
+        loaderInfo.minApiVersion = loaderInfo.maxApiVersion = XR_CURRENT_API_VERSION;
+        XrNegotiateApiLayerRequest layerRequest{};
+        layerRequest.structType = XR_LOADER_INTERFACE_STRUCT_API_LAYER_REQUEST;
+        layerRequest.structVersion = XR_API_LAYER_INFO_STRUCT_VERSION;
+        layerRequest.structSize = sizeof(XrNegotiateApiLayerRequest);
+        if (!negotiate || negotiate(&loaderInfo, LayerName.c_str(), &layerRequest) != XR_SUCCESS)
+        {
+            std::fprintf(stderr, "Cannot negotiate with the layer\n");
+            return false;
+        }
+
+        m_getInstanceProcAddr = layerRequest.getInstanceProcAddr;
+        m_createApiLayerInstance = layerRequest.createApiLayerInstance;
+        return true;
+    }
+
+    bool LayerChain::createInstance(const std::string& applicationName, XrInstance& instance)
+    {
+        // Chain the layer in front of the mock runtime.
+        XrApiLayerNextInfo nextInfo{};
+        nextInfo.structType = XR_LOADER_INTERFACE_STRUCT_API_LAYER_NEXT_INFO;
+        nextInfo.structVersion = XR_API_LAYER_NEXT_INFO_STRUCT_VERSION;
+        nextInfo.structSize = sizeof(XrApiLayerNextInfo);
+        CopyString(nextInfo.layerName, LayerName);
+        nextInfo.nextGetInstanceProcAddr = mock_runtime::xrGetInstanceProcAddr;
+        nextInfo.nextCreateApiLayerInstance = mock_runtime::xrCreateApiLayerInstance;
+        XrApiLayerCreateInfo apiLayerInfo{};
+        apiLayerInfo.structType = XR_LOADER_INTERFACE_STRUCT_API_LAYER_CREATE_INFO;
+        apiLayerInfo.structVersion = XR_API_LAYER_CREATE_INFO_STRUCT_VERSION;
+        apiLayerInfo.structSize = sizeof(XrApiLayerCreateInfo);
+        apiLayerInfo.nextInfo = &nextInfo;
+
+        XrInstanceCreateInfo createInfo = { XR_TYPE_INSTANCE_CREATE_INFO };
+        CopyString(createInfo.applicationInfo.applicationName, applicationName);
+        createInfo.applicationInfo.apiVersion = XR_CURRENT_API_VERSION;
+#ifdef _WIN32
+        const char* const extensions[] = { XR_KHR_D3D11_ENABLE_EXTENSION_NAME };
+        createInfo.enabledExtensionCount = 1;
+        createInfo.enabledExtensionNames = extensions;
+#endif
+        if (!m_createApiLayerInstance || m_createApiLayerInstance(&createInfo, &apiLayerInfo, &instance) != XR_SUCCESS)
+        {
+            std::fprintf(stderr, "Cannot create the instance\n");
+            return false;
+        }
+
+        return true;
+    }
+}
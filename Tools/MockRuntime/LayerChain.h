@@ -0,0 +1,65 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <filesystem>
+#include <string>
+
+#include "MockRuntime.h"
+
+// Load the layer and create instances through it, in front of the mock runtime, like the OpenXR loader would. The
+// layer library is required: where it cannot be built, the tools fail rather than exercise the mock runtime alone.
+
+namespace mock_runtime
+{
+    extern const std::string LayerName;
+
+    // Enable the layer for an application, with a profile database in a private LOCALAPPDATA. The layer also writes its
+    // log file there. The settings use the syntax of the profile database, eg: "scaling=70\nsharpness=50\n".
+    bool SetupProfile(const std::filesystem::path& directory, const std::string& applicationName, const std::string& settings);
+
+    // The layer library next to the executable on Windows, or an empty path (no layer library) elsewhere.
+    std::string DefaultLayerPath();
+
+    class LayerChain
+    {
+    public:
+        ~LayerChain();
+
+        // Load the layer library. This fails when the path is empty.
+        bool load(const std::string& layerPath);
+
+        // The mock runtime options are read by the layer when the instance is created.
+        bool createInstance(const std::string& applicationName, XrInstance& instance);
+
+        // The native handle of the layer library (HMODULE on Windows).
+        void* module() const
+        {
+            return m_module;
+        }
+
+        PFN_xrGetInstanceProcAddr getInstanceProcAddr() const
+        {
+            return m_getInstanceProcAddr;
+        }
+
+    private:
+        void* m_module{ nullptr };
+        PFN_xrGetInstanceProcAddr m_getInstanceProcAddr{ nullptr };
+        PFN_xrCreateApiLayerInstance m_createApiLayerInstance{ nullptr };
+    };
+}
@@ -0,0 +1,736 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "MockRuntime.h"
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <memory>
+
+#ifdef _WIN32
+#include <wrl.h>
+#endif
+
+namespace
+{
+#ifdef _WIN32
+    using Microsoft::WRL::ComPtr;
+#endif
+
+    // A frame every 90th of a second, for the predicted display times. The frame loop does not actually wait.
+    constexpr XrDuration DisplayPeriod = 11111111;
+
+    // The limit that the specification guarantees.
+    constexpr uint32_t MaxLayerCount = 16;
+
+    // Keep the log of a long run bounded: the first errors are the interesting ones.
+    constexpr size_t MaxErrors = 100;
+
+    struct Swapchain
+    {
+        XrSwapchainCreateInfo createInfo;
+
+        // The images as handed to the application: the D3D11 textures, or the headless images.
+        std::vector<const void*> images;
+#ifdef _WIN32
+        std::vector<ComPtr<ID3D11Texture2D>> textures;
+#endif
+        std::vector<std::unique_ptr<mock_runtime::ImageDescription>> headlessImages;
+        uint32_t nextImage{ 0 };
+
+        // The images acquired and not released yet, in order, and whether the oldest one was waited on.
+        std::deque<uint32_t> acquiredImages;
+        bool isWaited{ false };
+        bool wasReleased{ false };
+    };
+
+    struct Session
+    {
+        XrSession handle{ XR_NULL_HANDLE };
+        bool isHeadless{ false };
+        XrSessionState state{ XR_SESSION_STATE_UNKNOWN };
+        bool isRunning{ false };
+        bool isExitRequested{ false };
+        uint64_t waitedFrames{ 0 };
+        uint64_t begunFrames{ 0 };
+        bool isFrameBegun{ false };
+    };
+
+    mock_runtime::Options options;
+#ifdef _WIN32
+    ComPtr<ID3D11Device> device;
+#endif
+    Session session;
+    std::map<uint64_t, Swapchain> swapchains;
+    std::deque<XrSessionState> pendingStates;
+    uint64_t nextHandle = 1;
+    uint64_t submittedFrames = 0;
+    std::vector<mock_runtime::SubmittedView> lastSubmittedViews;
+    std::vector<std::string> errors;
+
+    // Handles are opaque to the layer and to the application: any unique value will do.
+    template <typename Handle>
+    Handle NewHandle()
+    {
+        return reinterpret_cast<Handle>(nextHandle++);
+    }
+
+    template <typename Handle>
+    uint64_t HandleValue(const Handle handle)
+    {
+        return reinterpret_cast<uint64_t>(handle);
+    }
+
+    // Record a violation of the specification and return the error code to report.
+    XrResult Fail(const XrResult result, const char* fmt, ...)
+    {
+        if (errors.size() < MaxErrors)
+        {
+            char buf[1024];
+            va_list va;
+            va_start(va, fmt);
+            vsnprintf(buf, sizeof(buf), fmt, va);
+            va_end(va);
+            errors.push_back(buf);
+        }
+        return result;
+    }
+
+    bool IsSupportedFormat(const int64_t format)
+    {
+        return std::find(options.formats.cbegin(), options.formats.cend(), format) != options.formats.cend();
+    }
+
+    void ChangeState(const XrSessionState state)
+    {
+        session.state = state;
+        pendingStates.push_back(state);
+    }
+
+    Swapchain* FindSwapchain(const XrSwapchain swapchain)
+    {
+        const auto it = swapchains.find(HandleValue(swapchain));
+        return it != swapchains.end() ? &it->second : nullptr;
+    }
+
+    XrResult XRAPI_CALL Mock_xrDestroyInstance(XrInstance /* instance */)
+    {
+        return XR_SUCCESS;
+    }
+
+    XrResult XRAPI_CALL Mock_xrGetInstanceProperties(XrInstance /* instance */, XrInstanceProperties* properties)
+    {
+        properties->runtimeVersion = XR_MAKE_VERSION(1, 0, 0);
+        mock_runtime::CopyString(properties->runtimeName, options.runtimeName);
+        return XR_SUCCESS;
+    }
+
+    XrResult XRAPI_CALL Mock_xrPollEvent(XrInstance /* instance */, XrEventDataBuffer* eventData)
+    {
+        if (pendingStates.empty())
+        {
+            return XR_EVENT_UNAVAILABLE;
+        }
+
+        XrEventDataSessionStateChanged* const event = reinterpret_cast<XrEventDataSessionStateChanged*>(eventData);
+        event->type = XR_TYPE_EVENT_DATA_SESSION_STATE_CHANGED;
+        event->next = nullptr;
+        event->session = session.handle;
+        event->state = pendingStates.front();
+        event->time = (XrTime)session.waitedFrames * DisplayPeriod;
+        pendingStates.pop_front();
+        return XR_SUCCESS;
+    }
+
+    XrResult XRAPI_CALL Mock_xrGetSystem(XrInstance /* instance */, const XrSystemGetInfo* getInfo, XrSystemId* systemId)
+    {
+        if (getInfo->formFactor != XR_FORM_FACTOR_HEAD_MOUNTED_DISPLAY)
+        {
+            return XR_ERROR_FORM_FACTOR_UNSUPPORTED;
+        }
+
+        *systemId = 1;
+        return XR_SUCCESS;
+    }
+
+#ifdef _WIN32
+    XrResult XRAPI_CALL Mock_xrGetD3D11GraphicsRequirementsKHR(XrInstance /* instance */,
+                                                               XrSystemId /* systemId */,
+                                                               XrGraphicsRequirementsD3D11KHR* requirements)
+    {
+        requirements->adapterLuid = {};
+        requirements->minFeatureLevel = D3D_FEATURE_LEVEL_11_0;
+        return XR_SUCCESS;
+    }
+#endif
+
+    XrResult XRAPI_CALL Mock_xrEnumerateViewConfigurationViews(XrInstance /* instance */,
+                                                               XrSystemId /* systemId */,
+                                                               XrViewConfigurationType /* viewConfigurationType */,
+                                                               uint32_t viewCapacityInput,
+                                                               uint32_t* viewCountOutput,
+                                                               XrViewConfigurationView* views)
+    {
+        *viewCountOutput = options.viewCount;
+        if (viewCapacityInput == 0)
+        {
+            return XR_SUCCESS;
+        }
+        if (viewCapacityInput < options.viewCount)
+        {
+            return XR_ERROR_SIZE_INSUFFICIENT;
+        }
+        for (uint32_t i = 0; i < options.viewCount; i++)
+        {
+            views[i].recommendedImageRectWidth = views[i].maxImageRectWidth = options.width;
+            views[i].recommendedImageRectHeight = views[i].maxImageRectHeight = options.height;
+            views[i].recommendedSwapchainSampleCount = views[i].maxSwapchainSampleCount = 1;
+        }
+        return XR_SUCCESS;
+    }
+
+    XrResult XRAPI_CALL Mock_xrEnumerateSwapchainFormats(XrSession /* session */,
+                                                         uint32_t formatCapacityInput,
+                                                         uint32_t* formatCountOutput,
+                                                         int64_t* formats)
+    {
+        const uint32_t count = (uint32_t)options.formats.size();
+
+        *formatCountOutput = count;
+        if (formatCapacityInput == 0)
+        {
+            return XR_SUCCESS;
+        }
+        if (formatCapacityInput < count)
+        {
+            return XR_ERROR_SIZE_INSUFFICIENT;
+        }
+        std::copy(options.formats.cbegin(), options.formats.cend(), formats);
+        return XR_SUCCESS;
+    }
+
+    XrResult XRAPI_CALL Mock_xrCreateSession(XrInstance /* instance */, const XrSessionCreateInfo* createInfo, XrSession* newSession)
+    {
+        if (options.validate && session.handle != XR_NULL_HANDLE)
+        {
+            return Fail(XR_ERROR_LIMIT_REACHED, "xrCreateSession: a session already exists");
+        }
+
+        // Without a graphics binding, the session is headless.
+        const XrBaseInStructure* entry = reinterpret_cast<const XrBaseInStructure*>(createInfo->next);
+        while (entry && entry->type != XR_TYPE_GRAPHICS_BINDING_D3D11_KHR)
+        {
+            entry = entry->next;
+        }
+#ifdef _WIN32
+        device = entry ? reinterpret_cast<const XrGraphicsBindingD3D11KHR*>(entry)->device : nullptr;
+        if (entry && !device)
+        {
+            return XR_ERROR_GRAPHICS_DEVICE_INVALID;
+        }
+#else
+        if (entry)
+        {
+            return Fail(XR_ERROR_GRAPHICS_DEVICE_INVALID, "xrCreateSession: D3D11 is not available on this platform");
+        }
+#endif
+
+        session = {};
+        session.isHeadless = !entry;
+        session.handle = *newSession = NewHandle<XrSession>();
+        pendingStates.clear();
+        ChangeState(XR_SESSION_STATE_IDLE);
+        ChangeState(XR_SESSION_STATE_READY);
+        return XR_SUCCESS;
+    }
+
+    XrResult XRAPI_CALL Mock_xrDestroySession(XrSession /* session */)
+    {
+        if (options.validate && !swapchains.empty())
+        {
+            Fail(XR_SUCCESS, "xrDestroySession: %zu swapchains were not destroyed", swapchains.size());
+        }
+
+        swapchains.clear();
+        pendingStates.clear();
+        session = {};
+#ifdef _WIN32
+        device = nullptr;
+#endif
+        return XR_SUCCESS;
+    }
+
+    XrResult XRAPI_CALL Mock_xrBeginSession(XrSession /* session */, const XrSessionBeginInfo* /* beginInfo */)
+    {
+        if (session.isRunning)
+        {
+            return XR_ERROR_SESSION_RUNNING;
+        }
+        if (session.state != XR_SESSION_STATE_READY)
+        {
+            return XR_ERROR_SESSION_NOT_READY;
+        }
+
+        session.isRunning = true;
+        ChangeState(XR_SESSION_STATE_SYNCHRONIZED);
+        ChangeState(XR_SESSION_STATE_VISIBLE);
+        ChangeState(XR_SESSION_STATE_FOCUSED);
+        return XR_SUCCESS;
+    }
+
+    XrResult XRAPI_CALL Mock_xrRequestExitSession(XrSession /* session */)
+    {
+        if (!session.isRunning)
+        {
+            return XR_ERROR_SESSION_NOT_RUNNING;
+        }
+
+        session.isExitRequested = true;
+        ChangeState(XR_SESSION_STATE_VISIBLE);
+        ChangeState(XR_SESSION_STATE_SYNCHRONIZED);
+        ChangeState(XR_SESSION_STATE_STOPPING);
+        return XR_SUCCESS;
+    }
+
+    XrResult XRAPI_CALL Mock_xrEndSession(XrSession /* session */)
+    {
+        if (!session.isRunning)
+        {
+            return XR_ERROR_SESSION_NOT_RUNNING;
+        }
+        if (session.state != XR_SESSION_STATE_STOPPING)
+        {
+            return XR_ERROR_SESSION_NOT_STOPPING;
+        }
+
+        session.isRunning = false;
+        ChangeState(XR_SESSION_STATE_IDLE);
+        if (session.isExitRequested)
+        {
+            ChangeState(XR_SESSION_STATE_EXITING);
+        }
+        return XR_SUCCESS;
+    }
+
+    XrResult XRAPI_CALL Mock_xrCreateSwapchain(XrSession /* session */, const XrSwapchainCreateInfo* createInfo, XrSwapchain* swapchain)
+    {
+        if (!IsSupportedFormat(createInfo->format))
+        {
+            return Fail(XR_ERROR_SWAPCHAIN_FORMAT_UNSUPPORTED, "xrCreateSwapchain: format %lld is not supported", createInfo->format);
+        }
+        if ((createInfo->usageFlags & XR_SWAPCHAIN_USAGE_UNORDERED_ACCESS_BIT) &&
+            std::find(options.formatsWithoutUnorderedAccess.cbegin(), options.formatsWithoutUnorderedAccess.cend(), createInfo->format) !=
+                options.formatsWithoutUnorderedAccess.cend())
+        {
+            return Fail(XR_ERROR_FEATURE_UNSUPPORTED, "xrCreateSwapchain: format %lld cannot be used for unordered access", createInfo->format);
+        }
+
+        Swapchain newSwapchain;
+        newSwapchain.createInfo = *createInfo;
+        newSwapchain.createInfo.next = nullptr;
+        if (session.isHeadless)
+        {
+            for (uint32_t i = 0; i < options.imageCount; i++)
+            {
+                newSwapchain.headlessImages.push_back(std::make_unique<mock_runtime::ImageDescription>(
+                    mock_runtime::ImageDescription{ createInfo->width, createInfo->height, createInfo->arraySize, createInfo->format }));
+                newSwapchain.images.push_back(newSwapchain.headlessImages.back().get());
+            }
+
+            *swapchain = NewHandle<XrSwapchain>();
+            swapchains.emplace(HandleValue(*swapchain), std::move(newSwapchain));
+            return XR_SUCCESS;
+        }
+
+#ifdef _WIN32
+        D3D11_TEXTURE2D_DESC desc{};
+        desc.Width = createInfo->width;
+        desc.Height = createInfo->height;
+        desc.MipLevels = createInfo->mipCount;
+        desc.ArraySize = createInfo->arraySize;
+        desc.Format = (DXGI_FORMAT)createInfo->format;
+        desc.SampleDesc.Count = createInfo->sampleCount;
+        desc.Usage = D3D11_USAGE_DEFAULT;
+        if (createInfo->usageFlags & XR_SWAPCHAIN_USAGE_COLOR_ATTACHMENT_BIT)
+        {
+            desc.BindFlags |= D3D11_BIND_RENDER_TARGET;
+        }
+        if (createInfo->usageFlags & XR_SWAPCHAIN_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT)
+        {
+            desc.BindFlags |= D3D11_BIND_DEPTH_STENCIL;
+        }
+        if (createInfo->usageFlags & XR_SWAPCHAIN_USAGE_UNORDERED_ACCESS_BIT)
+        {
+            desc.BindFlags |= D3D11_BIND_UNORDERED_ACCESS;
+        }
+        if (createInfo->usageFlags & XR_SWAPCHAIN_USAGE_SAMPLED_BIT)
+        {
+            desc.BindFlags |= D3D11_BIND_SHADER_RESOURCE;
+        }
+
+        newSwapchain.textures.resize(options.imageCount);
+        for (auto& texture : newSwapchain.textures)
+        {
+            if (!device || FAILED(device->CreateTexture2D(&desc, nullptr, texture.GetAddressOf())))
+            {
+                return Fail(XR_ERROR_RUNTIME_FAILURE, "xrCreateSwapchain: cannot create a %ux%u texture with format %lld and usage 0x%llx",
+                    createInfo->width, createInfo->height, createInfo->format, createInfo->usageFlags);
+            }
+            newSwapchain.images.push_back(texture.Get());
+        }
+
+        *swapchain = NewHandle<XrSwapchain>();
+        swapchains.emplace(HandleValue(*swapchain), std::move(newSwapchain));
+        return XR_SUCCESS;
+#else
+        return Fail(XR_ERROR_RUNTIME_FAILURE, "xrCreateSwapchain: D3D11 is not available on this platform");
+#endif
+    }
+
+    XrResult XRAPI_CALL Mock_xrDestroySwapchain(XrSwapchain swapchain)
+    {
+        return swapchains.erase(HandleValue(swapchain)) ? XR_SUCCESS : Fail(XR_ERROR_HANDLE_INVALID, "xrDestroySwapchain: invalid handle");
+    }
+
+    XrResult XRAPI_CALL Mock_xrEnumerateSwapchainImages(XrSwapchain swapchain,
+                                                        uint32_t imageCapacityInput,
+                                                        uint32_t* imageCountOutput,
+                                                        XrSwapchainImageBaseHeader* images)
+    {
+        const Swapchain* const entry = FindSwapchain(swapchain);
+        if (!entry)
+        {
+            return Fail(XR_ERROR_HANDLE_INVALID, "xrEnumerateSwapchainImages: invalid handle");
+        }
+
+        const uint32_t count = (uint32_t)entry->images.size();
+        *imageCountOutput = count;
+        if (imageCapacityInput == 0)
+        {
+            return XR_SUCCESS;
+        }
+        if (imageCapacityInput < count)
+        {
+            return XR_ERROR_SIZE_INSUFFICIENT;
+        }
+        const XrStructureType imageType = session.isHeadless ? mock_runtime::TypeSwapchainImageHeadless : XR_TYPE_SWAPCHAIN_IMAGE_D3D11_KHR;
+        if (options.validate && images->type != imageType)
+        {
+            return Fail(XR_ERROR_VALIDATION_FAILURE, "xrEnumerateSwapchainImages: invalid image structure type %d", images->type);
+        }
+        if (session.isHeadless)
+        {
+            mock_runtime::SwapchainImageHeadless* const headlessImages = reinterpret_cast<mock_runtime::SwapchainImageHeadless*>(images);
+            for (uint32_t i = 0; i < count; i++)
+            {
+                headlessImages[i].image = entry->headlessImages[i].get();
+            }
+        }
+#ifdef _WIN32
+        else
+        {
+            XrSwapchainImageD3D11KHR* const d3dImages = reinterpret_cast<XrSwapchainImageD3D11KHR*>(images);
+            for (uint32_t i = 0; i < count; i++)
+            {
+                d3dImages[i].texture = entry->textures[i].Get();
+            }
+        }
+#endif
+        return XR_SUCCESS;
+    }
+
+    XrResult XRAPI_CALL Mock_xrAcquireSwapchainImage(XrSwapchain swapchain, const XrSwapchainImageAcquireInfo* /* acquireInfo */, uint32_t* index)
+    {
+        Swapchain* const entry = FindSwapchain(swapchain);
+        if (!entry)
+        {
+            return Fail(XR_ERROR_HANDLE_INVALID, "xrAcquireSwapchainImage: invalid handle");
+        }
+
+        if (options.validate)
+        {
+            if (entry->acquiredImages.size() == entry->images.size())
+            {
+                return Fail(XR_ERROR_CALL_ORDER_INVALID, "xrAcquireSwapchainImage: all the images are already acquired");
+            }
+            entry->acquiredImages.push_back(entry->nextImage);
+        }
+
+        *index = entry->nextImage;
+        entry->nextImage = (entry->nextImage + 1) % (uint32_t)entry->images.size();
+        return XR_SUCCESS;
+    }
+
+    XrResult XRAPI_CALL Mock_xrWaitSwapchainImage(XrSwapchain swapchain, const XrSwapchainImageWaitInfo* /* waitInfo */)
+    {
+        Swapchain* const entry = FindSwapchain(swapchain);
+        if (!entry)
+        {
+            return Fail(XR_ERROR_HANDLE_INVALID, "xrWaitSwapchainImage: invalid handle");
+        }
+
+        if (options.validate)
+        {
+            if (entry->acquiredImages.empty() || entry->isWaited)
+            {
+                return Fail(XR_ERROR_CALL_ORDER_INVALID, "xrWaitSwapchainImage: no image to wait on");
+            }
+            entry->isWaited = true;
+        }
+        return XR_SUCCESS;
+    }
+
+    XrResult XRAPI_CALL Mock_xrReleaseSwapchainImage(XrSwapchain swapchain, const XrSwapchainImageReleaseInfo* /* releaseInfo */)
+    {
+        Swapchain* const entry = FindSwapchain(swapchain);
+        if (!entry)
+        {
+            return Fail(XR_ERROR_HANDLE_INVALID, "xrReleaseSwapchainImage: invalid handle");
+        }
+
+        if (options.validate)
+        {
+            if (!entry->isWaited)
+            {
+                return Fail(XR_ERROR_CALL_ORDER_INVALID, "xrReleaseSwapchainImage: the image was not waited on");
+            }
+            entry->acquiredImages.pop_front();
+            entry->isWaited = false;
+        }
+        entry->wasReleased = true;
+        return XR_SUCCESS;
+    }
+
+    XrResult XRAPI_CALL Mock_xrWaitFrame(XrSession /* session */, const XrFrameWaitInfo* /* frameWaitInfo */, XrFrameState* frameState)
+    {
+        if (options.validate && !session.isRunning)
+        {
+            return Fail(XR_ERROR_SESSION_NOT_RUNNING, "xrWaitFrame: the session is not running");
+        }
+
+        session.waitedFrames++;
+        frameState->predictedDisplayTime = (XrTime)session.waitedFrames * DisplayPeriod;
+        frameState->predictedDisplayPeriod = DisplayPeriod;
+        frameState->shouldRender = session.state == XR_SESSION_STATE_VISIBLE || session.state == XR_SESSION_STATE_FOCUSED;
+        return XR_SUCCESS;
+    }
+
+    XrResult XRAPI_CALL Mock_xrBeginFrame(XrSession /* session */, const XrFrameBeginInfo* /* frameBeginInfo */)
+    {
+        if (options.validate && session.begunFrames >= session.waitedFrames)
+        {
+            return Fail(XR_ERROR_CALL_ORDER_INVALID, "xrBeginFrame: xrWaitFrame was not called");
+        }
+
+        // Beginning a frame again discards the previous one.
+        const bool isDiscarded = session.isFrameBegun;
+        session.isFrameBegun = true;
+        session.begunFrames++;
+        return isDiscarded ? XR_FRAME_DISCARDED : XR_SUCCESS;
+    }
+
+    XrResult XRAPI_CALL Mock_xrEndFrame(XrSession /* session */, const XrFrameEndInfo* frameEndInfo)
+    {
+        if (options.validate)
+        {
+            if (!session.isFrameBegun)
+            {
+                return Fail(XR_ERROR_CALL_ORDER_INVALID, "xrEndFrame: xrBeginFrame was not called");
+            }
+            if (frameEndInfo->displayTime <= 0)
+            {
+                return Fail(XR_ERROR_TIME_INVALID, "xrEndFrame: invalid display time %lld", frameEndInfo->displayTime);
+            }
+            if (frameEndInfo->layerCount > MaxLayerCount)
+            {
+                return Fail(XR_ERROR_LAYER_LIMIT_EXCEEDED, "xrEndFrame: %u layers", frameEndInfo->layerCount);
+            }
+        }
+
+        lastSubmittedViews.clear();
+        for (uint32_t i = 0; i < frameEndInfo->layerCount; i++)
+        {
+            if (!frameEndInfo->layers[i])
+            {
+                return Fail(XR_ERROR_LAYER_INVALID, "xrEndFrame: layer %u is null", i);
+            }
+            if (frameEndInfo->layers[i]->type != XR_TYPE_COMPOSITION_LAYER_PROJECTION)
+            {
+                continue;
+            }
+
+            const XrCompositionLayerProjection* const projection = reinterpret_cast<const XrCompositionLayerProjection*>(frameEndInfo->layers[i]);
+            if (options.validate && projection->viewCount != options.viewCount)
+            {
+                return Fail(XR_ERROR_VALIDATION_FAILURE, "xrEndFrame: layer %u has %u views", i, projection->viewCount);
+            }
+            for (uint32_t j = 0; j < projection->viewCount; j++)
+            {
+                const XrSwapchainSubImage& subImage = projection->views[j].subImage;
+                lastSubmittedViews.push_back({ subImage.swapchain, subImage.imageRect, subImage.imageArrayIndex });
+                if (!options.validate)
+                {
+                    continue;
+                }
+
+                // The layer must hand over its own swapchains, sized for the display, and never the application's.
+                const Swapchain* const entry = FindSwapchain(subImage.swapchain);
+                if (!entry)
+                {
+                    return Fail(XR_ERROR_HANDLE_INVALID, "xrEndFrame: layer %u view %u uses an invalid swapchain", i, j);
+                }
+                if (!entry->wasReleased)
+                {
+                    return Fail(XR_ERROR_LAYER_INVALID, "xrEndFrame: layer %u view %u uses a swapchain that was never released", i, j);
+                }
+                const XrRect2Di& rect = subImage.imageRect;
+                if (rect.offset.x < 0 || rect.offset.y < 0 || rect.extent.width <= 0 || rect.extent.height <= 0 ||
+                    (uint32_t)(rect.offset.x + rect.extent.width) > entry->createInfo.width ||
+                    (uint32_t)(rect.offset.y + rect.extent.height) > entry->createInfo.height)
+                {
+                    return Fail(XR_ERROR_SWAPCHAIN_RECT_INVALID, "xrEndFrame: layer %u view %u has rectangle %d,%d %dx%d in a %ux%u swapchain",
+                        i, j, rect.offset.x, rect.offset.y, rect.extent.width, rect.extent.height, entry->createInfo.width, entry->createInfo.height);
+                }
+                if (subImage.imageArrayIndex >= entry->createInfo.arraySize)
+                {
+                    return Fail(XR_ERROR_VALIDATION_FAILURE, "xrEndFrame: layer %u view %u uses array slice %u of %u",
+                        i, j, subImage.imageArrayIndex, entry->createInfo.arraySize);
+                }
+            }
+        }
+
+        submittedFrames++;
+        session.isFrameBegun = false;
+        return XR_SUCCESS;
+    }
+}
+
+namespace mock_runtime
+{
+    void Configure(const Options& newOptions)
+    {
+        options = newOptions;
+#ifdef _WIN32
+        device = nullptr;
+#endif
+        session = {};
+        swapchains.clear();
+        pendingStates.clear();
+        submittedFrames = 0;
+        lastSubmittedViews.clear();
+        errors.clear();
+    }
+
+    XrResult XRAPI_CALL xrGetInstanceProcAddr(XrInstance /* instance */, const char* name, PFN_xrVoidFunction* function)
+    {
+#define MOCK_FUNCTION(xrCall)                                              \
+        if (!std::strcmp(name, #xrCall))                                   \
+        {                                                                  \
+            *function = reinterpret_cast<PFN_xrVoidFunction>(Mock_##xrCall); \
+            return XR_SUCCESS;                                             \
+        }
+
+        if (!std::strcmp(name, "xrGetInstanceProcAddr"))
+        {
+            *function = reinterpret_cast<PFN_xrVoidFunction>(xrGetInstanceProcAddr);
+            return XR_SUCCESS;
+        }
+        MOCK_FUNCTION(xrDestroyInstance);
+        MOCK_FUNCTION(xrGetInstanceProperties);
+        MOCK_FUNCTION(xrPollEvent);
+        MOCK_FUNCTION(xrGetSystem);
+#ifdef _WIN32
+        MOCK_FUNCTION(xrGetD3D11GraphicsRequirementsKHR);
+#endif
+        MOCK_FUNCTION(xrEnumerateViewConfigurationViews);
+        MOCK_FUNCTION(xrEnumerateSwapchainFormats);
+        MOCK_FUNCTION(xrCreateSession);
+        MOCK_FUNCTION(xrDestroySession);
+        MOCK_FUNCTION(xrBeginSession);
+        MOCK_FUNCTION(xrRequestExitSession);
+        MOCK_FUNCTION(xrEndSession);
+        MOCK_FUNCTION(xrCreateSwapchain);
+        MOCK_FUNCTION(xrDestroySwapchain);
+        MOCK_FUNCTION(xrEnumerateSwapchainImages);
+        MOCK_FUNCTION(xrAcquireSwapchainImage);
+        MOCK_FUNCTION(xrWaitSwapchainImage);
+        MOCK_FUNCTION(xrReleaseSwapchainImage);
+        MOCK_FUNCTION(xrWaitFrame);
+        MOCK_FUNCTION(xrBeginFrame);
+        MOCK_FUNCTION(xrEndFrame);
+
+#undef MOCK_FUNCTION
+
+        *function = nullptr;
+        return XR_ERROR_FUNCTION_UNSUPPORTED;
+    }
+
+    XrResult XRAPI_CALL xrCreateApiLayerInstance(const XrInstanceCreateInfo* /* createInfo */,
+                                                 const XrApiLayerCreateInfo* /* apiLayerInfo */,
+                                                 XrInstance* instance)
+    {
+        *instance = NewHandle<XrInstance>();
+        return XR_SUCCESS;
+    }
+
+    uint64_t SubmittedFrames()
+    {
+        return submittedFrames;
+    }
+
+    const std::vector<SubmittedView>& LastSubmittedViews()
+    {
+        return lastSubmittedViews;
+    }
+
+    bool GetSwapchainInfo(const XrSwapchain swapchain, XrSwapchainCreateInfo& createInfo)
+    {
+        const Swapchain* const entry = FindSwapchain(swapchain);
+        if (!entry)
+        {
+            return false;
+        }
+
+        createInfo = entry->createInfo;
+        return true;
+    }
+
+    bool IsRuntimeImage(const void* const image)
+    {
+        for (const auto& swapchain : swapchains)
+        {
+            for (const void* const runtimeImage : swapchain.second.images)
+            {
+                if (runtimeImage == image)
+                {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    std::vector<std::string> TakeErrors()
+    {
+        std::vector<std::string> result;
+        result.swap(errors);
+        return result;
+    }
+}
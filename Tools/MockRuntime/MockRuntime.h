@@ -0,0 +1,148 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <d3d11.h>
+#define XR_USE_GRAPHICS_API_D3D11
+#endif
+
+// The OpenXR functions are only called through pointers.
+#define XR_NO_PROTOTYPES
+#include <openxr/openxr.h>
+#include <openxr/openxr_platform.h>
+
+#include "loader_interfaces.h"
+
+// A mock OpenXR runtime, to stand after the layer in the chain.
+//
+// It implements the subset of OpenXR that the layer and a simple application use: the system and view enumeration,
+// the session lifecycle and its events, the swapchains and the frame loop. With the D3D11 graphics binding, the
+// swapchain images are plain textures created on the application's device, which may be the D3D11 null device. A
+// session created without a graphics binding is headless: its swapchain images are only described (see
+// SwapchainImageHeadless), so that the frame loop also runs where D3D11 is not available. The frame submissions are
+// checked and dropped. There is no frame pacing: xrWaitFrame() returns immediately, so the frame loop runs as fast as the layer.
+//
+// With validation enabled, the calls are checked against the rules of the specification that matter to the layer (the
+// swapchain image and frame loop ordering, the formats, the image rectangles), and each violation is recorded.
+
+namespace mock_runtime
+{
+    // The DXGI formats used by the tools. The runtime does not interpret them.
+    enum : int64_t
+    {
+        FormatR16G16B16A16Float = 10,
+        FormatR16G16B16A16Unorm = 11,
+        FormatR10G10B10A2Unorm = 24,
+        FormatR8G8B8A8Unorm = 28,
+        FormatR8G8B8A8UnormSrgb = 29,
+        FormatD32Float = 40,
+        FormatB8G8R8A8Unorm = 87,
+        FormatB8G8R8A8UnormSrgb = 91,
+    };
+
+    // The swapchain images of a headless session, as returned by xrEnumerateSwapchainImages().
+    constexpr XrStructureType TypeSwapchainImageHeadless = (XrStructureType)0x7fff0001;
+
+    struct ImageDescription
+    {
+        uint32_t width;
+        uint32_t height;
+        uint32_t arraySize;
+        int64_t format;
+    };
+
+    struct SwapchainImageHeadless
+    {
+        XrStructureType type;
+        void* next;
+        ImageDescription* image;
+    };
+
+    // Copy a string to a fixed-size OpenXR field, truncating it if needed.
+    template <size_t Size>
+    void CopyString(char (&destination)[Size], const std::string& source)
+    {
+        const size_t length = source.size() < Size - 1 ? source.size() : Size - 1;
+        std::memcpy(destination, source.c_str(), length);
+        destination[length] = 0;
+    }
+
+    struct Options
+    {
+        // The layer applies workarounds based on the runtime name, eg: "SteamVR/OpenXR".
+        std::string runtimeName{ "Mock runtime" };
+        uint32_t viewCount{ 2 };
+        uint32_t width{ 2160 };
+        uint32_t height{ 2160 };
+        uint32_t imageCount{ 3 };
+
+        // The swapchain formats, in order of preference.
+        std::vector<int64_t> formats{
+            FormatR8G8B8A8UnormSrgb,
+            FormatR8G8B8A8Unorm,
+            FormatB8G8R8A8UnormSrgb,
+            FormatB8G8R8A8Unorm,
+            FormatR10G10B10A2Unorm,
+            FormatR16G16B16A16Float,
+            FormatR16G16B16A16Unorm,
+            FormatD32Float,
+        };
+
+        // The formats that the runtime advertises but cannot create with the unordered access usage, like SteamVR.
+        std::vector<int64_t> formatsWithoutUnorderedAccess;
+
+        bool validate{ true };
+    };
+
+    // A projection view, as received by xrEndFrame().
+    struct SubmittedView
+    {
+        XrSwapchain swapchain;
+        XrRect2Di imageRect;
+        uint32_t imageArrayIndex;
+    };
+
+    // Reset the runtime with new options. The instance must be created again.
+    void Configure(const Options& options);
+
+    // The entry points to give to the layer through XrApiLayerNextInfo.
+    XrResult XRAPI_CALL xrGetInstanceProcAddr(XrInstance instance, const char* name, PFN_xrVoidFunction* function);
+    XrResult XRAPI_CALL xrCreateApiLayerInstance(const XrInstanceCreateInfo* createInfo,
+                                                 const XrApiLayerCreateInfo* apiLayerInfo,
+                                                 XrInstance* instance);
+
+    // The frames submitted to xrEndFrame(), and the projection views of the last one.
+    uint64_t SubmittedFrames();
+    const std::vector<SubmittedView>& LastSubmittedViews();
+
+    // Inspect the swapchains as the runtime sees them, ie: as requested by the layer. The images are the D3D11 textures
+    // or the headless images.
+    bool GetSwapchainInfo(XrSwapchain swapchain, XrSwapchainCreateInfo& createInfo);
+    bool IsRuntimeImage(const void* image);
+
+    // The validation errors since the last call.
+    std::vector<std::string> TakeErrors();
+}
@@ -0,0 +1,876 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Validate and benchmark the CPU implementation of NIS (see NISCpu.h).
+//
+// Usage: NISCpuBenchmark --check
+//        NISCpuBenchmark --benchmark [iterations [threads [scaling]]]
+//        NISCpuBenchmark --foveation [iterations [threads [scaling]]]
+//
+// The check compares every kernel supported by this CPU to the scalar kernel, on synthetic images, for several scale
+// factors and sharpness values. It also checks that foveated images (NIS in the center region, bilinear in the periphery)
+// have no seam, and that resolving multisampled images while upscaling them matches resolving them first. The benchmark
+// upscales to the per-eye resolutions of common headsets, from the given scale factor (in percent, like the
+// configuration file). The foveation benchmark compares the cost of foveated scaling to the cost of full NIS, for
+// several sizes of the center region.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+
+#include "Foveation.h"
+#include "MsaaResolve.h"
+#include "NISCpu.h"
+
+using namespace nis_scaler;
+
+namespace
+{
+    // Gradients, hard edges at several angles, thin lines and noise: every path of the edge detection is exercised.
+    void MakeTestImage(NISCpuImage& image, const uint32_t width, const uint32_t height)
+    {
+        image.resize(width, height);
+        uint32_t seed = 12345;
+        float* pixel = image.pixels.data();
+        for (uint32_t y = 0; y < height; y++)
+        {
+            for (uint32_t x = 0; x < width; x++)
+            {
+                seed = seed * 1664525 + 1013904223;
+                const float noise = (seed >> 8) / 16777216.0f;
+                const float u = (float)x / width;
+                const float v = (float)y / height;
+
+                const bool checker = ((x / 17) + (y / 23)) % 2;
+                const bool diagonal = ((x + 2 * y) / 11) % 2;
+                const bool line = (x % 31) == 0 || (y % 29) == 0;
+                const float ring = 0.5f + 0.5f * std::sin(0.002f * ((float)x * x + (float)y * y));
+
+                *pixel++ = std::fmod(u + (checker ? 0.4f : 0.0f) + 0.1f * noise, 1.0f);
+                *pixel++ = line ? 1.0f : (diagonal ? 0.8f : 0.2f) * ring;
+                *pixel++ = v * (1.0f - 0.2f * noise);
+                *pixel++ = 1.0f;
+            }
+        }
+    }
+
+    float MaxDifference(const NISCpuImage& a, const NISCpuImage& b)
+    {
+        float maxDifference = a.pixels.size() == b.pixels.size() ? 0.0f : INFINITY;
+        for (size_t i = 0; i < a.pixels.size() && i < b.pixels.size(); i++)
+        {
+            // NaN must fail the check too.
+            const float difference = std::abs(a.pixels[i] - b.pixels[i]);
+            maxDifference = difference <= maxDifference ? maxDifference : difference;
+        }
+        return maxDifference;
+    }
+
+    // Smooth gradients, where any misregistration between the center region and the periphery is visible.
+    void MakeSmoothImage(NISCpuImage& image, const uint32_t width, const uint32_t height)
+    {
+        image.resize(width, height);
+        float* pixel = image.pixels.data();
+        for (uint32_t y = 0; y < height; y++)
+        {
+            for (uint32_t x = 0; x < width; x++)
+            {
+                *pixel++ = 0.5f + 0.4f * std::sin(0.11f * x + 0.03f * y);
+                *pixel++ = 0.5f + 0.4f * std::sin(0.07f * y - 0.05f * x);
+                *pixel++ = (float)(x + y) / (width + height);
+                *pixel++ = 1.0f;
+            }
+        }
+    }
+
+    NISConfig MakeConfig(const float sharpness, const NISCpuImage& input, const uint32_t outputWidth, const uint32_t outputHeight)
+    {
+        NISConfig config{};
+        if (input.width != outputWidth || input.height != outputHeight)
+        {
+            NVScalerUpdateConfig(config, sharpness, 0, 0, input.width, input.height, input.width, input.height, 0, 0,
+                outputWidth, outputHeight, outputWidth, outputHeight);
+        }
+        else
+        {
+            NVSharpenUpdateConfig(config, sharpness, 0, 0, input.width, input.height, input.width, input.height, 0, 0);
+        }
+        return config;
+    }
+
+    // Process an entire image with NIS.
+    void Process(const NISConfig& config, const NISCpuImage& input, NISCpuImage& output, const NISCpuKernel kernel, const uint32_t numThreads)
+    {
+        if (input.width != output.width || input.height != output.height)
+        {
+            NISCpuScale(config, input, output, kernel, numThreads);
+        }
+        else
+        {
+            NISCpuSharpen(config, input, output, kernel, numThreads);
+        }
+    }
+
+    // Process an image like the layer does with foveation: bilinear in the periphery, NIS in the center region.
+    bool ProcessFoveated(const NISConfig& config,
+                         const NISCpuImage& input,
+                         NISCpuImage& output,
+                         const FoveatedRegion& region,
+                         const NISCpuKernel kernel,
+                         const uint32_t numThreads)
+    {
+        const NISCpuRect rect{ region.outputX, region.outputY, region.outputWidth, region.outputHeight };
+        NISCpuBilinear(input, output, &rect);
+        if (input.width != output.width || input.height != output.height)
+        {
+            return NISCpuScaleRegion(config, input, output, rect, kernel, numThreads);
+        }
+        return NISCpuSharpenRegion(config, input, output, rect, kernel, numThreads);
+    }
+
+    bool IsInside(const NISCpuRect& rect, const uint32_t x, const uint32_t y)
+    {
+        return x >= rect.x && x < rect.x + rect.width && y >= rect.y && y < rect.y + rect.height;
+    }
+
+    // The largest difference between the pixels of a region of a and b (or outside of the region).
+    float MaxDifference(const NISCpuImage& a, const NISCpuImage& b, const NISCpuRect& rect, const bool inside)
+    {
+        float maxDifference = 0.0f;
+        for (uint32_t y = 0; y < a.height; y++)
+        {
+            for (uint32_t x = 0; x < a.width; x++)
+            {
+                if (IsInside(rect, x, y) != inside)
+                {
+                    continue;
+                }
+                for (uint32_t c = 0; c < 4; c++)
+                {
+                    const size_t i = ((size_t)y * a.width + x) * 4 + c;
+                    const float difference = std::abs(a.pixels[i] - b.pixels[i]);
+                    maxDifference = difference <= maxDifference ? maxDifference : difference;
+                }
+            }
+        }
+        return maxDifference;
+    }
+
+    // How much larger the steps between neighbouring pixels across the boundary of the region are, compared to the same
+    // steps in the images produced entirely with NIS and entirely with bilinear filtering.
+    float SeamExcess(const NISCpuImage& foveated, const NISCpuImage& nis, const NISCpuImage& bilinear, const NISCpuRect& rect)
+    {
+        float maxExcess = 0.0f;
+        const auto step = [](const NISCpuImage& image, const uint32_t x0, const uint32_t y0, const uint32_t x1, const uint32_t y1, const uint32_t c) {
+            return std::abs(image.pixels[((size_t)y0 * image.width + x0) * 4 + c] - image.pixels[((size_t)y1 * image.width + x1) * 4 + c]);
+        };
+        const auto compare = [&](const uint32_t x0, const uint32_t y0, const uint32_t x1, const uint32_t y1) {
+            for (uint32_t c = 0; c < 3; c++)
+            {
+                const float excess = step(foveated, x0, y0, x1, y1, c) - (std::max)(step(nis, x0, y0, x1, y1, c), step(bilinear, x0, y0, x1, y1, c));
+                maxExcess = (std::max)(maxExcess, excess);
+            }
+        };
+
+        for (uint32_t y = rect.y; y < rect.y + rect.height; y++)
+        {
+            if (rect.x > 0)
+            {
+                compare(rect.x - 1, y, rect.x, y);
+            }
+            if (rect.x + rect.width < foveated.width)
+            {
+                compare(rect.x + rect.width - 1, y, rect.x + rect.width, y);
+            }
+        }
+        for (uint32_t x = rect.x; x < rect.x + rect.width; x++)
+        {
+            if (rect.y > 0)
+            {
+                compare(x, rect.y - 1, x, rect.y);
+            }
+            if (rect.y + rect.height < foveated.height)
+            {
+                compare(x, rect.y + rect.height - 1, x, rect.y + rect.height);
+            }
+        }
+        return maxExcess;
+    }
+
+    // Check that the center region is exactly what NIS produces for the entire image, that the periphery is exactly the
+    // bilinear upscale, and that there is no seam between them. A center region misregistered by one pixel must be
+    // detected as a seam.
+    int CheckFoveation()
+    {
+        struct TestCase
+        {
+            uint32_t inputWidth;
+            uint32_t inputHeight;
+            uint32_t outputWidth;
+            uint32_t outputHeight;
+            FoveationSettings settings;
+        };
+        const TestCase testCases[] = {
+            { 700, 630, 1000, 900, { 0.5f, 0.5f, 0.5f } },   // 70%
+            { 700, 630, 1000, 900, { 0.55f, 0.52f, 0.3f } }, // With the offset of a left eye.
+            { 500, 450, 1000, 900, { 0.45f, 0.5f, 0.8f } },  // 50%, with the offset of a right eye.
+            { 317, 251, 317, 251, { 0.45f, 0.5f, 0.5f } },   // Sharpen only.
+            { 159, 126, 317, 251, { 0.5f, 0.5f, 0.5f } },    // Coprime sizes: no foveation.
+        };
+
+        // Below the quantization step of 8-bit formats.
+        constexpr float SeamTolerance = 1.0f / 255;
+
+        const NISCpuKernel kernel = DetectNISCpuKernel();
+        int result = 0;
+        for (const TestCase& testCase : testCases)
+        {
+            std::printf("foveation %ux%u -> %ux%u center %.2f,%.2f radius %.2f: ", testCase.inputWidth, testCase.inputHeight,
+                testCase.outputWidth, testCase.outputHeight, testCase.settings.centerX, testCase.settings.centerY, testCase.settings.radius);
+
+            FoveatedRegion region;
+            if (!ComputeFoveatedRegion(testCase.settings, testCase.inputWidth, testCase.inputHeight, testCase.outputWidth,
+                    testCase.outputHeight, region))
+            {
+                std::printf("no periphery\n");
+                continue;
+            }
+            const NISCpuRect rect{ region.outputX, region.outputY, region.outputWidth, region.outputHeight };
+
+            float maxRegionDifference = 0.0f;
+            float maxPeripheryDifference = 0.0f;
+            float maxExcess = 0.0f;
+            float misregisteredExcess = 0.0f;
+            bool isProcessed = true;
+            for (const bool isSmooth : { false, true })
+            {
+                NISCpuImage input;
+                (isSmooth ? MakeSmoothImage : MakeTestImage)(input, testCase.inputWidth, testCase.inputHeight);
+                const NISConfig config = MakeConfig(0.5f, input, testCase.outputWidth, testCase.outputHeight);
+
+                NISCpuImage nis;
+                NISCpuImage bilinear;
+                NISCpuImage foveated;
+                nis.resize(testCase.outputWidth, testCase.outputHeight);
+                bilinear.resize(testCase.outputWidth, testCase.outputHeight);
+                foveated.resize(testCase.outputWidth, testCase.outputHeight);
+                Process(config, input, nis, kernel, 0);
+                NISCpuBilinear(input, bilinear);
+                isProcessed = ProcessFoveated(config, input, foveated, region, kernel, 0) && isProcessed;
+
+                maxRegionDifference = (std::max)(maxRegionDifference, MaxDifference(foveated, nis, rect, true));
+                maxPeripheryDifference = (std::max)(maxPeripheryDifference, MaxDifference(foveated, bilinear, rect, false));
+
+                // The seams are only measured on the smooth image: on the other one, the hard edges that NIS sharpens
+                // differ from the bilinear upscale regardless of the registration.
+                if (isSmooth)
+                {
+                    maxExcess = SeamExcess(foveated, nis, bilinear, rect);
+
+                    NISCpuImage misregistered = foveated;
+                    for (uint32_t y = rect.y; y < rect.y + rect.height; y++)
+                    {
+                        for (uint32_t x = (std::max)(rect.x, 1u); x < rect.x + rect.width; x++)
+                        {
+                            const size_t i = ((size_t)y * nis.width + x) * 4;
+                            std::copy(&nis.pixels[i - 4], &nis.pixels[i], &misregistered.pixels[i]);
+                        }
+                    }
+                    misregisteredExcess = SeamExcess(misregistered, nis, bilinear, rect);
+                }
+            }
+
+            const bool isPass = isProcessed && maxRegionDifference <= NISCpuTolerance && maxPeripheryDifference == 0.0f &&
+                                maxExcess <= SeamTolerance && misregisteredExcess > SeamTolerance;
+            std::printf("region %ux%u+%u+%u, center difference %g, periphery difference %g, seam %g (misregistered %g) %s\n",
+                rect.width, rect.height, rect.x, rect.y, maxRegionDifference, maxPeripheryDifference, maxExcess,
+                misregisteredExcess, isPass ? "ok" : "FAILED");
+            if (!isPass)
+            {
+                result = 1;
+            }
+        }
+
+        return result;
+    }
+
+    void Fill(NISCpuImage& image, const uint32_t width, const uint32_t height, const float value)
+    {
+        image.resize(width, height);
+        std::fill(image.pixels.begin(), image.pixels.end(), value);
+    }
+
+    // Copy a region of an image.
+    void Crop(const NISCpuImage& image, const NISCpuRect& rect, NISCpuImage& cropped)
+    {
+        cropped.resize(rect.width, rect.height);
+        for (uint32_t y = 0; y < rect.height; y++)
+        {
+            const float* const source = image.pixels.data() + ((size_t)(rect.y + y) * image.width + rect.x) * 4;
+            std::copy(source, source + (size_t)rect.width * 4, cropped.pixels.data() + (size_t)y * rect.width * 4);
+        }
+    }
+
+    // The upscale of each view must be what the upscale of the view cropped from the input produces (the samples are
+    // clamped to the view), and the pixels outside of the output regions must be left untouched.
+    bool IsMatchingCroppedViews(const NISCpuImage& input, const NISCpuImage& output, const NISCpuView* const views, const size_t viewCount, float& maxDifference)
+    {
+        bool isUntouched = true;
+        for (uint32_t y = 0; y < output.height; y++)
+        {
+            for (uint32_t x = 0; x < output.width; x++)
+            {
+                const bool isInside = std::any_of(views, views + viewCount, [&](const NISCpuView& view) { return IsInside(view.outputRect, x, y); });
+                isUntouched = isUntouched && (isInside || output.pixels[((size_t)y * output.width + x) * 4] == -1.0f);
+            }
+        }
+
+        for (size_t i = 0; i < viewCount; i++)
+        {
+            NISCpuImage croppedInput;
+            NISCpuImage reference;
+            NISCpuImage croppedOutput;
+            Crop(input, views[i].inputRect, croppedInput);
+            Fill(reference, views[i].outputRect.width, views[i].outputRect.height, -1.0f);
+            NISCpuBilinear(croppedInput, reference, views[i].excludedRect.width ? &views[i].excludedRect : nullptr);
+            Crop(output, views[i].outputRect, croppedOutput);
+            maxDifference = (std::max)(maxDifference, MaxDifference(reference, croppedOutput));
+        }
+        return isUntouched;
+    }
+
+    // Check the batched views of BilinearRenderer. With a texture array, each slice must be exactly what a single view
+    // produces. Side by side (texture atlas) and for regions of the texture, each view must be exactly what it produces on
+    // its own, and what the upscale of the view cropped from the input produces.
+    int CheckBatchedViews()
+    {
+        const uint32_t inputWidth = 222;
+        const uint32_t inputHeight = 181;
+        const uint32_t outputWidth = 317;
+        const uint32_t outputHeight = 251;
+        const NISCpuRect excludedRect{ 53, 41, 211, 169 };
+        int result = 0;
+
+        // Texture arrays, with each view on its slice, then with the slices swapped.
+        {
+            std::vector<NISCpuImage> inputs(2);
+            MakeTestImage(inputs[0], inputWidth, inputHeight);
+            MakeSmoothImage(inputs[1], inputWidth, inputHeight);
+
+            for (const bool isSwapped : { false, true })
+            {
+                std::vector<NISCpuImage> outputs(2);
+                Fill(outputs[0], outputWidth, outputHeight, -1.0f);
+                Fill(outputs[1], outputWidth, outputHeight, -1.0f);
+                const NISCpuRect inputRect{ 0, 0, inputWidth, inputHeight };
+                const NISCpuRect outputRect{ 0, 0, outputWidth, outputHeight };
+                const NISCpuView views[] = {
+                    { 0, inputRect, isSwapped ? 1u : 0u, outputRect, excludedRect },
+                    { 1, inputRect, isSwapped ? 0u : 1u, outputRect, {} },
+                };
+                const bool isProcessed = NISCpuBilinearViews(inputs, outputs, views, 2);
+
+                float maxDifference = 0.0f;
+                for (uint32_t i = 0; i < 2; i++)
+                {
+                    NISCpuImage reference;
+                    Fill(reference, outputWidth, outputHeight, -1.0f);
+                    NISCpuBilinear(inputs[i], reference, i == 0 ? &excludedRect : nullptr);
+                    maxDifference = (std::max)(maxDifference, MaxDifference(reference, outputs[isSwapped ? 1 - i : i]));
+                }
+
+                const bool isPass = isProcessed && maxDifference == 0.0f;
+                std::printf("batched views array%s %ux%u -> %ux%u: max difference %g %s\n", isSwapped ? " (swapped)" : "",
+                    inputWidth, inputHeight, outputWidth, outputHeight, maxDifference, isPass ? "ok" : "FAILED");
+                if (!isPass)
+                {
+                    result = 1;
+                }
+            }
+        }
+
+        // Side by side.
+        {
+            std::vector<NISCpuImage> inputs(1);
+            MakeTestImage(inputs[0], 2 * inputWidth, inputHeight);
+
+            const NISCpuView views[] = {
+                { 0, { 0, 0, inputWidth, inputHeight }, 0, { 0, 0, outputWidth, outputHeight }, excludedRect },
+                { 0, { inputWidth, 0, inputWidth, inputHeight }, 0, { outputWidth, 0, outputWidth, outputHeight }, {} },
+            };
+            std::vector<NISCpuImage> outputs(1);
+            Fill(outputs[0], 2 * outputWidth, outputHeight, -1.0f);
+            bool isProcessed = NISCpuBilinearViews(inputs, outputs, views, 2);
+
+            std::vector<NISCpuImage> singleOutputs(1);
+            Fill(singleOutputs[0], 2 * outputWidth, outputHeight, -1.0f);
+            isProcessed = NISCpuBilinearViews(inputs, singleOutputs, &views[0], 1) && isProcessed;
+            isProcessed = NISCpuBilinearViews(inputs, singleOutputs, &views[1], 1) && isProcessed;
+            const float singleDifference = MaxDifference(outputs[0], singleOutputs[0]);
+
+            float maxDifference = 0.0f;
+            const bool isUntouched = IsMatchingCroppedViews(inputs[0], outputs[0], views, 2, maxDifference);
+
+            // Overlapping views are rejected.
+            const NISCpuView overlapping[] = { views[0], { 0, views[1].inputRect, 0, { outputWidth - 1, 0, outputWidth, outputHeight }, {} } };
+            const bool isRejected = !NISCpuBilinearViews(inputs, outputs, overlapping, 2);
+
+            const bool isPass = isProcessed && singleDifference == 0.0f && maxDifference <= NISCpuTolerance && isUntouched && isRejected;
+            std::printf("batched views side by side %ux%u -> %ux%u: single view difference %g, cropped difference %g%s %s\n",
+                2 * inputWidth, inputHeight, 2 * outputWidth, outputHeight, singleDifference, maxDifference,
+                isRejected ? "" : ", overlap not rejected", isPass ? "ok" : "FAILED");
+            if (!isPass)
+            {
+                result = 1;
+            }
+        }
+
+        // Regions at the edges of the texture, down to a single pixel, upscaled to regions at the edges of the output.
+        {
+            struct TestCase
+            {
+                const char* name;
+                NISCpuRect inputRect;
+                NISCpuRect outputRect;
+            };
+            const TestCase testCases[] = {
+                { "bottom right corner", { 150, 120, 72, 61 }, { 213, 163, 104, 88 } },
+                { "last column", { 221, 0, 1, 181 }, { 315, 0, 2, 251 } },
+                { "last row", { 0, 180, 222, 1 }, { 0, 249, 317, 2 } },
+                { "single pixel", { 0, 0, 1, 1 }, { 0, 0, 3, 3 } },
+                { "partial region", { 13, 7, 200, 170 }, { 0, 0, 317, 251 } },
+            };
+
+            std::vector<NISCpuImage> inputs(1);
+            MakeTestImage(inputs[0], inputWidth, inputHeight);
+            for (const TestCase& testCase : testCases)
+            {
+                std::vector<NISCpuImage> outputs(1);
+                Fill(outputs[0], outputWidth, outputHeight, -1.0f);
+                const NISCpuView view{ 0, testCase.inputRect, 0, testCase.outputRect, {} };
+                const bool isProcessed = NISCpuBilinearViews(inputs, outputs, &view, 1);
+
+                float maxDifference = 0.0f;
+                const bool isUntouched = IsMatchingCroppedViews(inputs[0], outputs[0], &view, 1, maxDifference);
+
+                // The regions that do not fit are rejected.
+                NISCpuView outside = view;
+                outside.outputRect.x = outputWidth - outside.outputRect.width + 1;
+                const bool isRejected = !NISCpuBilinearViews(inputs, outputs, &outside, 1);
+
+                const bool isPass = isProcessed && maxDifference <= NISCpuTolerance && isUntouched && isRejected;
+                std::printf("batched views %s %ux%u+%u+%u -> %ux%u+%u+%u: cropped difference %g%s%s %s\n", testCase.name,
+                    testCase.inputRect.width, testCase.inputRect.height, testCase.inputRect.x, testCase.inputRect.y,
+                    testCase.outputRect.width, testCase.outputRect.height, testCase.outputRect.x, testCase.outputRect.y,
+                    maxDifference, isUntouched ? "" : ", pixels outside written", isRejected ? "" : ", overflow not rejected",
+                    isPass ? "ok" : "FAILED");
+                if (!isPass)
+                {
+                    result = 1;
+                }
+            }
+        }
+
+        return result;
+    }
+
+    // Each sample of a pixel comes from a different pixel of a test image, so that the samples differ around the edges.
+    void MakeMultisampledTestImage(NISCpuMultisampledImage& image, const uint32_t width, const uint32_t height, const uint32_t sampleCount)
+    {
+        NISCpuImage samples;
+        MakeTestImage(samples, width * sampleCount, height);
+        image.resize(width, height, sampleCount);
+        image.samples = samples.pixels;
+    }
+
+    int CheckMultisampledViews()
+    {
+        const uint32_t inputWidth = 222;
+        const uint32_t inputHeight = 181;
+        const uint32_t outputWidth = 317;
+        const uint32_t outputHeight = 251;
+        const NISCpuRect excludedRect{ 53, 41, 211, 169 };
+        int result = 0;
+
+        // The weights of the resolve.
+        {
+            float weights[MaxSampleCount];
+            bool isPass = !GetMsaaResolveWeights(0, MsaaResolveFilter::Box, weights) && !GetMsaaResolveWeights(MaxSampleCount + 1, MsaaResolveFilter::Box, weights);
+            for (const uint32_t sampleCount : { 1u, 2u, 4u, 6u, 8u, 16u })
+            {
+                for (const MsaaResolveFilter filter : { MsaaResolveFilter::Box, MsaaResolveFilter::Tent })
+                {
+                    float total = 0.0f;
+                    float minWeight = INFINITY;
+                    float maxWeight = 0.0f;
+                    isPass = GetMsaaResolveWeights(sampleCount, filter, weights) && isPass;
+                    for (uint32_t i = 0; i < sampleCount; i++)
+                    {
+                        total += weights[i];
+                        minWeight = (std::min)(minWeight, weights[i]);
+                        maxWeight = (std::max)(maxWeight, weights[i]);
+                    }
+
+                    // The standard positions at 2x and 4x are all at the same distance from the center.
+                    const bool isUniform = filter == MsaaResolveFilter::Box || sampleCount <= 4 || !HasStandardSamplePositions(sampleCount);
+                    isPass = std::abs(total - 1.0f) < 1e-6f && (isUniform ? maxWeight - minWeight < 1e-6f : maxWeight > minWeight) && isPass;
+                }
+            }
+            std::printf("resolve weights: %s\n", isPass ? "ok" : "FAILED");
+            if (!isPass)
+            {
+                result = 1;
+            }
+        }
+
+        // Resolving while upscaling is the same as resolving, then upscaling. The custom weights favor the first samples.
+        for (const uint32_t sampleCount : { 2u, 4u })
+        {
+            float boxWeights[MaxSampleCount];
+            GetMsaaResolveWeights(sampleCount, MsaaResolveFilter::Box, boxWeights);
+            float customWeights[MaxSampleCount];
+            for (uint32_t i = 0; i < sampleCount; i++)
+            {
+                customWeights[i] = 2.0f * (sampleCount - i) / (sampleCount * (sampleCount + 1));
+            }
+
+            for (const float* weights : { boxWeights, customWeights })
+            {
+                std::vector<NISCpuMultisampledImage> inputs(2);
+                MakeMultisampledTestImage(inputs[0], 2 * inputWidth, inputHeight, sampleCount);
+                MakeMultisampledTestImage(inputs[1], inputWidth, inputHeight, sampleCount);
+
+                // Two views side by side in the first slice (one of them foveated), and one view in the second slice.
+                const NISCpuView views[] = {
+                    { 0, { 0, 0, inputWidth, inputHeight }, 0, { 0, 0, outputWidth, outputHeight }, excludedRect },
+                    { 0, { inputWidth, 0, inputWidth, inputHeight }, 0, { outputWidth, 0, outputWidth, outputHeight }, {} },
+                    { 1, { 13, 7, 200, 170 }, 1, { 0, 0, outputWidth, outputHeight }, {} },
+                };
+                std::vector<NISCpuImage> outputs(2);
+                Fill(outputs[0], 2 * outputWidth, outputHeight, -1.0f);
+                Fill(outputs[1], outputWidth, outputHeight, -1.0f);
+                bool isProcessed = NISCpuBilinearViewsMultisampled(inputs, weights, outputs, views, 3);
+
+                std::vector<NISCpuImage> resolved(2);
+                NISCpuResolve(inputs[0], weights, resolved[0]);
+                NISCpuResolve(inputs[1], weights, resolved[1]);
+                std::vector<NISCpuImage> references(2);
+                Fill(references[0], 2 * outputWidth, outputHeight, -1.0f);
+                Fill(references[1], outputWidth, outputHeight, -1.0f);
+                isProcessed = NISCpuBilinearViews(resolved, references, views, 3) && isProcessed;
+                const float maxDifference = (std::max)(MaxDifference(references[0], outputs[0]), MaxDifference(references[1], outputs[1]));
+
+                // The samples of each pixel are weighted.
+                const NISCpuImage& pixels = resolved[1];
+                float resolveDifference = 0.0f;
+                for (size_t i = 0; i < pixels.pixels.size(); i++)
+                {
+                    float expected = 0.0f;
+                    for (uint32_t s = 0; s < sampleCount; s++)
+                    {
+                        expected += weights[s] * inputs[1].samples[(i / 4 * sampleCount + s) * 4 + i % 4];
+                    }
+                    resolveDifference = (std::max)(resolveDifference, std::abs(expected - pixels.pixels[i]));
+                }
+
+                const bool isPass = isProcessed && maxDifference == 0.0f && resolveDifference <= 1e-6f;
+                std::printf("multisampled views %ux %s weights %ux%u -> %ux%u: max difference %g, resolve difference %g %s\n", sampleCount,
+                    weights == boxWeights ? "box" : "custom", inputWidth, inputHeight, outputWidth, outputHeight, maxDifference,
+                    resolveDifference, isPass ? "ok" : "FAILED");
+                if (!isPass)
+                {
+                    result = 1;
+                }
+            }
+        }
+
+        return result;
+    }
+
+    int Check()
+    {
+        struct TestCase
+        {
+            uint32_t inputWidth;
+            uint32_t inputHeight;
+            uint32_t outputWidth;
+            uint32_t outputHeight;
+            float sharpness;
+        };
+        const TestCase testCases[] = {
+            { 317, 251, 317, 251, 0.5f },  // Sharpen only.
+            { 317, 251, 317, 251, 1.0f },  //
+            { 222, 181, 317, 251, 0.0f },  // 70%
+            { 222, 181, 317, 251, 0.5f },  //
+            { 159, 126, 317, 251, 1.0f },  // 50%, with odd sizes.
+            { 300, 240, 301, 239, 0.35f }, // Almost 1:1.
+            { 7, 5, 13, 11, 0.5f },        // Smaller than a vector and a band.
+        };
+
+        int result = 0;
+        for (const TestCase& testCase : testCases)
+        {
+            const bool isScaler = testCase.inputWidth != testCase.outputWidth || testCase.inputHeight != testCase.outputHeight;
+
+            NISConfig config{};
+            if (isScaler)
+            {
+                NVScalerUpdateConfig(config, testCase.sharpness, 0, 0, testCase.inputWidth, testCase.inputHeight,
+                    testCase.inputWidth, testCase.inputHeight, 0, 0, testCase.outputWidth, testCase.outputHeight,
+                    testCase.outputWidth, testCase.outputHeight);
+            }
+            else
+            {
+                NVSharpenUpdateConfig(config, testCase.sharpness, 0, 0, testCase.inputWidth, testCase.inputHeight,
+                    testCase.inputWidth, testCase.inputHeight, 0, 0);
+            }
+
+            NISCpuImage input;
+            MakeTestImage(input, testCase.inputWidth, testCase.inputHeight);
+
+            const auto run = [&](const NISCpuKernel kernel, const uint32_t numThreads, NISCpuImage& output) {
+                output.resize(testCase.outputWidth, testCase.outputHeight);
+                if (isScaler)
+                {
+                    NISCpuScale(config, input, output, kernel, numThreads);
+                }
+                else
+                {
+                    NISCpuSharpen(config, input, output, kernel, numThreads);
+                }
+            };
+
+            NISCpuImage reference;
+            run(NISCpuKernel::Scalar, 1, reference);
+
+            for (int i = 0; i < (int)NISCpuKernel::EnumMax; i++)
+            {
+                const NISCpuKernel kernel = (NISCpuKernel)i;
+                if (!IsNISCpuKernelSupported(kernel))
+                {
+                    continue;
+                }
+
+                // Also check that the bands produce the same results regardless of the threads processing them.
+                NISCpuImage output;
+                run(kernel, 3, output);
+                const float difference = MaxDifference(reference, output);
+                const bool isPass = difference <= NISCpuTolerance;
+                std::printf("%s %ux%u -> %ux%u sharpness %.2f %s: max difference %g %s\n",
+                    isScaler ? "scale" : "sharpen", testCase.inputWidth, testCase.inputHeight, testCase.outputWidth,
+                    testCase.outputHeight, testCase.sharpness, NISCpuKernelName(kernel), difference, isPass ? "ok" : "FAILED");
+                if (!isPass)
+                {
+                    result = 1;
+                }
+            }
+        }
+
+        if (CheckFoveation())
+        {
+            result = 1;
+        }
+        if (CheckBatchedViews())
+        {
+            result = 1;
+        }
+        if (CheckMultisampledViews())
+        {
+            result = 1;
+        }
+
+        std::printf("tolerance: %g\n", NISCpuTolerance);
+        return result;
+    }
+
+    int Benchmark(int argc, char** argv)
+    {
+        const uint32_t iterations = argc > 2 ? (std::max)((uint32_t)std::strtoul(argv[2], nullptr, 10), 1u) : 5;
+        const uint32_t maxThreads = argc > 3 ? (uint32_t)std::strtoul(argv[3], nullptr, 10) : 0;
+        const float scaleFactor = (argc > 4 ? std::strtoul(argv[4], nullptr, 10) : 70) / 100.0f;
+
+        struct Resolution
+        {
+            const char* name;
+            uint32_t width;
+            uint32_t height;
+        };
+        const Resolution resolutions[] = {
+            { "Reverb G2", 2160, 2160 },
+            { "Quest 2", 1832, 1920 },
+        };
+
+        const uint32_t numCores = (std::max)(std::thread::hardware_concurrency(), 1u);
+        const uint32_t threadCounts[] = { 1, maxThreads ? maxThreads : numCores };
+
+        std::printf("resolution,mode,kernel,threads,ms,Mpixels/s\n");
+        for (const Resolution& resolution : resolutions)
+        {
+            const uint32_t inputWidth = (uint32_t)(resolution.width * scaleFactor);
+            const uint32_t inputHeight = (uint32_t)(resolution.height * scaleFactor);
+
+            for (const bool isScaler : { true, false })
+            {
+                NISConfig config{};
+                NISCpuImage input;
+                NISCpuImage output;
+                if (isScaler)
+                {
+                    NVScalerUpdateConfig(config, 0.5f, 0, 0, inputWidth, inputHeight, inputWidth, inputHeight, 0, 0,
+                        resolution.width, resolution.height, resolution.width, resolution.height);
+                    MakeTestImage(input, inputWidth, inputHeight);
+                }
+                else
+                {
+                    NVSharpenUpdateConfig(config, 0.5f, 0, 0, resolution.width, resolution.height, resolution.width,
+                        resolution.height, 0, 0);
+                    MakeTestImage(input, resolution.width, resolution.height);
+                }
+
+                for (int i = 0; i < (int)NISCpuKernel::EnumMax; i++)
+                {
+                    const NISCpuKernel kernel = (NISCpuKernel)i;
+                    if (!IsNISCpuKernelSupported(kernel))
+                    {
+                        continue;
+                    }
+
+                    for (size_t t = 0; t < std::size(threadCounts); t++)
+                    {
+                        const uint32_t numThreads = threadCounts[t];
+                        if (t > 0 && numThreads == threadCounts[0])
+                        {
+                            continue;
+                        }
+
+                        // The first run warms up the allocations.
+                        double bestTime = INFINITY;
+                        for (uint32_t j = 0; j <= iterations; j++)
+                        {
+                            output.resize(resolution.width, resolution.height);
+                            const auto start = std::chrono::steady_clock::now();
+                            if (isScaler)
+                            {
+                                NISCpuScale(config, input, output, kernel, numThreads);
+                            }
+                            else
+                            {
+                                NISCpuSharpen(config, input, output, kernel, numThreads);
+                            }
+                            const auto end = std::chrono::steady_clock::now();
+                            if (j > 0)
+                            {
+                                bestTime = (std::min)(bestTime, std::chrono::duration<double, std::milli>(end - start).count());
+                            }
+                        }
+
+                        std::printf("%s %ux%u,%s,%s,%u,%.2f,%.1f\n", resolution.name, resolution.width, resolution.height,
+                            isScaler ? "scale" : "sharpen", NISCpuKernelName(kernel), numThreads, bestTime,
+                            (double)resolution.width * resolution.height / (bestTime * 1000.0));
+                    }
+                }
+            }
+        }
+
+        return 0;
+    }
+
+    int BenchmarkFoveation(int argc, char** argv)
+    {
+        const uint32_t iterations = argc > 2 ? (std::max)((uint32_t)std::strtoul(argv[2], nullptr, 10), 1u) : 5;
+        const uint32_t numThreads = argc > 3 ? (uint32_t)std::strtoul(argv[3], nullptr, 10) : 1;
+        const float scaleFactor = (argc > 4 ? std::strtoul(argv[4], nullptr, 10) : 70) / 100.0f;
+
+        const float radii[] = { 0.8f, 0.6f, 0.5f, 0.4f, 0.3f };
+        const uint32_t width = 2160;
+        const uint32_t height = 2160;
+        const uint32_t inputWidth = (uint32_t)(width * scaleFactor);
+        const uint32_t inputHeight = (uint32_t)(height * scaleFactor);
+        const NISCpuKernel kernel = DetectNISCpuKernel();
+
+        NISCpuImage input;
+        MakeTestImage(input, inputWidth, inputHeight);
+        const NISConfig config = MakeConfig(0.5f, input, width, height);
+        NISCpuImage output;
+        output.resize(width, height);
+
+        // The first run warms up the allocations.
+        const auto measure = [&](const auto& process) {
+            double bestTime = INFINITY;
+            for (uint32_t j = 0; j <= iterations; j++)
+            {
+                const auto start = std::chrono::steady_clock::now();
+                process();
+                const auto end = std::chrono::steady_clock::now();
+                if (j > 0)
+                {
+                    bestTime = (std::min)(bestTime, std::chrono::duration<double, std::milli>(end - start).count());
+                }
+            }
+            return bestTime;
+        };
+
+        const double fullTime = measure([&]() { Process(config, input, output, kernel, numThreads); });
+
+        std::printf("%ux%u -> %ux%u per eye, kernel %s, %u thread(s)\n", inputWidth, inputHeight, width, height,
+            NISCpuKernelName(kernel), numThreads ? numThreads : (std::max)(std::thread::hardware_concurrency(), 1u));
+        std::printf("radius,region,area%%,ms,reduction%%\n");
+        std::printf("full,%ux%u,100.0,%.2f,0.0\n", width, height, fullTime);
+        for (const float radius : radii)
+        {
+            // The center of the left eye is a bit towards the nose (see the foveated_offset_x setting).
+            FoveatedRegion region;
+            if (!ComputeFoveatedRegion({ 0.55f, 0.5f, radius }, inputWidth, inputHeight, width, height, region))
+            {
+                std::printf("%.2f,none,100.0,%.2f,0.0\n", radius, fullTime);
+                continue;
+            }
+
+            const double time = measure([&]() { ProcessFoveated(config, input, output, region, kernel, numThreads); });
+            std::printf("%.2f,%ux%u,%.1f,%.2f,%.1f\n", radius, region.outputWidth, region.outputHeight,
+                100.0 * region.outputWidth * region.outputHeight / ((double)width * height), time, 100.0 * (1.0 - time / fullTime));
+        }
+
+        return 0;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const std::string command = argc > 1 ? argv[1] : "";
+    if (command == "--check" && argc == 2)
+    {
+        return Check();
+    }
+    else if (command == "--benchmark" && argc <= 5)
+    {
+        return Benchmark(argc, argv);
+    }
+    else if (command == "--foveation" && argc <= 5)
+    {
+        return BenchmarkFoveation(argc, argv);
+    }
+
+    std::fprintf(stderr,
+        "Usage: NISCpuBenchmark --check\n"
+        "       NISCpuBenchmark --benchmark [iterations [threads [scaling]]]\n"
+        "       NISCpuBenchmark --foveation [iterations [threads [scaling]]]\n");
+    return 1;
+}
@@ -0,0 +1,250 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Inspect the NIS tuning of the layer, and check the selection and persistence logic (see NISTuning.h).
+//
+// Usage: NISTuningTool --list <database>
+//        NISTuningTool --defaults <vendor ID> <device ID>
+//        NISTuningTool --check
+//
+// The layer keeps its database in %LOCALAPPDATA%\XR_APILAYER_NOVENDOR_nis_scaler.tuning. The IDs are hexadecimal. The
+// check uses fake adapters and synthetic timings.
+
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+
+#include "NISTuning.h"
+
+using namespace nis_scaler;
+
+namespace
+{
+    int List(const std::string& path)
+    {
+        NISTuningDatabase database;
+        if (!database.load(path))
+        {
+            std::fprintf(stderr, "Cannot read %s\n", path.c_str());
+            return 1;
+        }
+
+        for (const NISTuningDatabase::Entry& entry : database.entries())
+        {
+            std::printf("%04x:%04x driver %s, %s: %s (%.1fus)\n", entry.vendorId, entry.deviceId, DescribeDriverVersion(entry.driverVersion).c_str(),
+                entry.isUpscaling ? "scaler" : "sharpen", entry.variant.describe().c_str(), entry.medianTime);
+        }
+        return 0;
+    }
+
+    int Defaults(const char* vendorId, const char* deviceId)
+    {
+        NISAdapterInfo adapter;
+        adapter.vendorId = (uint32_t)std::strtoul(vendorId, nullptr, 16);
+        adapter.deviceId = (uint32_t)std::strtoul(deviceId, nullptr, 16);
+        std::printf("Family: %s\n", GetNISGpuFamily(adapter));
+        std::printf("Scaler: %s\n", GetDefaultNISVariant(adapter, true).describe().c_str());
+        std::printf("Sharpen: %s\n", GetDefaultNISVariant(adapter, false).describe().c_str());
+        return 0;
+    }
+
+    NISAdapterInfo MakeAdapter(const uint32_t vendorId, const uint32_t deviceId, const uint64_t driverVersion = 0x1e000f0000049bull)
+    {
+        NISAdapterInfo adapter;
+        adapter.vendorId = vendorId;
+        adapter.deviceId = deviceId;
+        adapter.driverVersion = driverVersion;
+        return adapter;
+    }
+
+    // Samples around a median time, with a few outliers (like a dispatch delayed by another process).
+    NISVariantTiming MakeTiming(const NISVariant& variant, const float time, const size_t count, std::mt19937& random)
+    {
+        std::normal_distribution<float> noise(0.f, time * 0.01f);
+        NISVariantTiming timing{ variant, {} };
+        for (size_t i = 0; i < count; i++)
+        {
+            timing.samples.push_back(i % 8 == 7 ? time * 3 : time + noise(random));
+        }
+        return timing;
+    }
+
+    int Check()
+    {
+        int result = 0;
+        const auto expect = [&](const char* name, const bool isPass) {
+            std::printf("%s: %s\n", name, isPass ? "ok" : "FAILED");
+            if (!isPass)
+            {
+                result = 1;
+            }
+        };
+
+        // The defaults for the GPU families.
+        {
+            const auto isDefault = [](const NISAdapterInfo& adapter, const char* scaler, const char* sharpen) {
+                return GetDefaultNISVariant(adapter, true).describe() == scaler && GetDefaultNISVariant(adapter, false).describe() == sharpen;
+            };
+            expect("defaults: NVIDIA Ampere", isDefault(MakeAdapter(0x10de, 0x2204), "32x32/128/fp16", "32x32/128/fp16"));
+            expect("defaults: NVIDIA Turing", isDefault(MakeAdapter(0x10de, 0x1e87), "32x32/128/fp16", "32x32/128/fp16"));
+            expect("defaults: NVIDIA Pascal", isDefault(MakeAdapter(0x10de, 0x1b80), "32x24/128/fp32", "32x32/128/fp32"));
+            expect("defaults: AMD", isDefault(MakeAdapter(0x1002, 0x73bf), "32x24/256/fp32", "32x32/256/fp32"));
+            expect("defaults: Intel", isDefault(MakeAdapter(0x8086, 0x56a0), "32x24/256/fp32", "32x32/256/fp32"));
+            expect("defaults: unknown", isDefault(MakeAdapter(0x1414, 0x8c), "32x24/128/fp32", "32x32/128/fp32"));
+        }
+
+        // The candidates are unique, and start with the default.
+        {
+            const auto isValid = [](const NISAdapterInfo& adapter, const bool isUpscaling, const size_t count) {
+                const std::vector<NISVariant> candidates = GetNISCandidateVariants(adapter, isUpscaling);
+                bool isUnique = true;
+                for (size_t i = 0; i < candidates.size(); i++)
+                {
+                    for (size_t j = i + 1; j < candidates.size(); j++)
+                    {
+                        isUnique = isUnique && !(candidates[i] == candidates[j]);
+                    }
+                }
+                return candidates.size() == count && isUnique && candidates[0] == GetDefaultNISVariant(adapter, isUpscaling);
+            };
+            expect("candidates: scaler", isValid(MakeAdapter(0x10de, 0x2204), true, 8) && isValid(MakeAdapter(0x1002, 0x73bf), true, 8));
+            expect("candidates: sharpen", isValid(MakeAdapter(0x10de, 0x2204), false, 4) && isValid(MakeAdapter(0x8086, 0x56a0), false, 4));
+        }
+
+        // The selection from synthetic timings.
+        {
+            std::mt19937 random(42);
+            const std::vector<NISVariant> candidates = GetNISCandidateVariants(MakeAdapter(0x1002, 0x73bf), true);
+            NISVariant variant;
+            float medianTime;
+
+            std::vector<NISVariantTiming> timings;
+            for (size_t i = 0; i < candidates.size(); i++)
+            {
+                timings.push_back(MakeTiming(candidates[i], i == 5 ? 80.f : 100.f + i, 16, random));
+            }
+            bool isPicked = SelectNISVariant(timings, variant, medianTime) && variant == candidates[5];
+            expect("selection: fastest", isPicked && medianTime > 78.f && medianTime < 82.f);
+
+            timings[5] = MakeTiming(candidates[5], 99.f, 16, random);
+            isPicked = SelectNISVariant(timings, variant, medianTime) && variant == candidates[0];
+            expect("selection: default within the margin", isPicked);
+
+            // The default is only the reference when it has enough samples.
+            timings[5] = MakeTiming(candidates[5], 60.f, 16, random);
+            for (float& sample : timings[0].samples)
+            {
+                sample = 1000.f;
+            }
+            timings[0].samples.resize(4);
+            isPicked = SelectNISVariant(timings, variant, medianTime) && variant == candidates[5];
+            expect("selection: default without enough samples", isPicked);
+
+            timings[5].samples.resize(4);
+            isPicked = SelectNISVariant(timings, variant, medianTime) && variant == candidates[1];
+            expect("selection: variant without enough samples", isPicked);
+
+            for (NISVariantTiming& timing : timings)
+            {
+                timing.samples.clear();
+            }
+            expect("selection: no samples", !SelectNISVariant(timings, variant, medianTime));
+        }
+
+        // The persistence of the results.
+        {
+            const std::filesystem::path path = std::filesystem::temp_directory_path() / "NISTuningTool-check.tuning";
+            std::error_code ec;
+            std::filesystem::remove(path, ec);
+
+            const NISAdapterInfo nvidia = MakeAdapter(0x10de, 0x2204);
+            const NISAdapterInfo amd = MakeAdapter(0x1002, 0x73bf);
+            const NISVariant tunedScaler{ 32, 24, 256, true };
+            const NISVariant tunedSharpen{ 32, 32, 128, false };
+
+            NISTuningDatabase database;
+            NISVariant variant;
+            expect("persistence: missing file", !database.load(path.string()) && !database.find(nvidia, true, variant));
+
+            database.store(nvidia, true, tunedScaler, 450.f);
+            database.store(nvidia, false, tunedSharpen, 210.f);
+            database.store(amd, true, tunedSharpen, 500.f);
+            expect("persistence: save", database.save());
+
+            NISTuningDatabase reloaded;
+            bool isFound = reloaded.load(path.string()) && reloaded.entries().size() == 3;
+            isFound = isFound && reloaded.find(nvidia, true, variant) && variant == tunedScaler;
+            isFound = isFound && reloaded.find(nvidia, false, variant) && variant == tunedSharpen;
+            isFound = isFound && reloaded.find(amd, true, variant) && variant == tunedSharpen && !reloaded.find(amd, false, variant);
+            expect("persistence: reload", isFound);
+
+            // Another driver or another GPU of the same family must be tuned again.
+            const NISAdapterInfo newDriver = MakeAdapter(0x10de, 0x2204, nvidia.driverVersion + 1);
+            expect("persistence: other driver", !reloaded.find(newDriver, true, variant));
+            expect("persistence: other GPU", !reloaded.find(MakeAdapter(0x10de, 0x2206), true, variant));
+
+            reloaded.store(newDriver, true, tunedSharpen, 440.f);
+            isFound = reloaded.find(newDriver, true, variant) && variant == tunedSharpen && !reloaded.find(nvidia, true, variant);
+            expect("persistence: driver update", isFound && reloaded.entries().size() == 3);
+
+            // Invalid lines are ignored: bad IDs, bad driver version, unknown mode, unsupported variants.
+            {
+                std::ofstream file(path, std::ios_base::app);
+                file << "garbage\n"
+                     << "10de:zz 30.0.15.1179 scaler 32x24/128/fp32 1.0\n"
+                     << "10de:2208 30.0.15 scaler 32x24/128/fp32 1.0\n"
+                     << "10de:2208 30.0.15.1179 upscale 32x24/128/fp32 1.0\n"
+                     << "10de:2208 30.0.15.1179 sharpen 32x24/128/fp32 1.0\n"
+                     << "10de:2208 30.0.15.1179 scaler 64x64/128/fp32 1.0\n"
+                     << "10de:2208 30.0.15.1179 scaler 32x24/128/fp8 1.0\n"
+                     << "\n"
+                     << "10de:2208 30.0.15.1179 scaler 32x24/128/fp32\n";
+            }
+            NISTuningDatabase damaged;
+            expect("persistence: invalid lines", damaged.load(path.string()) && damaged.entries().size() == 3);
+
+            std::filesystem::remove(path, ec);
+        }
+
+        return result;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const std::string command = argc > 1 ? argv[1] : "";
+    if (command == "--list" && argc == 3)
+    {
+        return List(argv[2]);
+    }
+    else if (command == "--defaults" && argc == 4)
+    {
+        return Defaults(argv[2], argv[3]);
+    }
+    else if (command == "--check" && argc == 2)
+    {
+        return Check();
+    }
+
+    std::fprintf(stderr,
+        "Usage: NISTuningTool --list <database>\n"
+        "       NISTuningTool --defaults <vendor ID> <device ID>\n"
+        "       NISTuningTool --check\n");
+    return 1;
+}
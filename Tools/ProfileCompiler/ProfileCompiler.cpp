@@ -0,0 +1,214 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Compile, validate and query profile databases (see ProfileDatabase.h).
+//
+// Usage: ProfileCompiler <profiles.txt> <profiles.bin>
+//        ProfileCompiler --check <profiles.txt>
+//        ProfileCompiler --lookup <profiles.bin> <application> [gpu [vendor [WIDTHxHEIGHT]]]
+//        ProfileCompiler --benchmark <profiles.bin> <application> [iterations]
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+#include "ProfileDatabase.h"
+
+using namespace nis_scaler;
+
+namespace
+{
+    bool ReadSource(const char* path, std::string& source)
+    {
+        std::ifstream file(path);
+        if (!file)
+        {
+            std::fprintf(stderr, "Cannot read %s\n", path);
+            return false;
+        }
+        std::ostringstream contents;
+        contents << file.rdbuf();
+        source = contents.str();
+        return true;
+    }
+
+    bool Compile(const char* path, std::vector<uint8_t>& database)
+    {
+        std::string source;
+        if (!ReadSource(path, source))
+        {
+            return false;
+        }
+
+        std::string errors;
+        if (!CompileProfiles(source, database, errors))
+        {
+            std::fprintf(stderr, "%s", errors.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    void PrintConfig(const Config& config)
+    {
+        std::printf("scaling=%d\nsharpness=%d\ndynamic_resolution=%d\nmin_scaling=%d\ntarget_frame_time=%u\n"
+                    "foveated_radius=%d\nfoveated_offset_x=%d\nfoveated_offset_y=%d\ndisable_bilinear_scaler=%d\nintermediate_format=%u\n"
+                    "msaa_resolve_filter=%u\nfast_context_switch=%d\n"
+                    "enable_stats=%d\nenable_screenshots=%d\nscreenshot_format=%u\ncapture_frames=%u\ncapture_input=%d\n"
+                    "enable_telemetry=%d\nnis_autotune=%d\n",
+            (int)(config.scaleFactor * 100 + 0.5f), (int)(config.sharpness * 100 + 0.5f), config.dynamicResolution,
+            (int)(config.minScaleFactor * 100 + 0.5f), config.targetFrameTime, (int)std::lround(config.foveatedRadius * 100),
+            (int)std::lround(config.foveatedOffsetX * 100), (int)std::lround(config.foveatedOffsetY * 100), config.disableBilinearScaler,
+            config.intermediateFormat, config.msaaResolveFilter, config.fastContextSwitch, config.enableStats, config.enableScreenshots, config.screenshotFormat,
+            config.captureFrames, config.captureInput, config.enableTelemetry, config.nisAutotune);
+    }
+
+    int Lookup(int argc, char** argv)
+    {
+        ProfileDatabase database;
+        if (!database.open(argv[2]))
+        {
+            std::fprintf(stderr, "Cannot open %s\n", argv[2]);
+            return 1;
+        }
+
+        ProfileQuery query;
+        query.application = argv[3];
+        query.gpu = argc > 4 ? argv[4] : "";
+        query.vendorId = argc > 5 ? (uint32_t)std::strtoul(argv[5], nullptr, 0) : 0;
+        if (argc > 6 && std::sscanf(argv[6], "%ux%u", &query.width, &query.height) != 2)
+        {
+            std::fprintf(stderr, "Invalid resolution %s\n", argv[6]);
+            return 1;
+        }
+
+        Config config;
+        config.Reset();
+        const bool isEnabled = database.resolve(query, config);
+        std::printf("enabled=%d\n", isEnabled);
+        PrintConfig(config);
+
+        return 0;
+    }
+
+    int Benchmark(int argc, char** argv)
+    {
+        const uint64_t iterations = argc > 4 ? std::strtoull(argv[4], nullptr, 10) : 100000;
+
+        ProfileQuery query;
+        query.application = argv[3];
+        query.gpu = "NVIDIA GeForce RTX 3080";
+        query.vendorId = 0x10de;
+        query.width = 2160;
+        query.height = 2160;
+
+        // What the layer does at instance creation: map the database and resolve the profile.
+        auto start = std::chrono::steady_clock::now();
+        uint64_t numEnabled = 0;
+        for (uint64_t i = 0; i < iterations / 100 + 1; i++)
+        {
+            ProfileDatabase database;
+            Config config;
+            config.Reset();
+            numEnabled += database.open(argv[2]) && database.resolve(query, config);
+        }
+        auto end = std::chrono::steady_clock::now();
+        std::printf("open+resolve: %.3f us\n",
+            std::chrono::duration<double, std::micro>(end - start).count() / (iterations / 100 + 1));
+
+        ProfileDatabase database;
+        if (!database.open(argv[2]))
+        {
+            std::fprintf(stderr, "Cannot open %s\n", argv[2]);
+            return 1;
+        }
+
+        start = std::chrono::steady_clock::now();
+        for (uint64_t i = 0; i < iterations; i++)
+        {
+            Config config;
+            config.Reset();
+            numEnabled += database.resolve(query, config);
+        }
+        end = std::chrono::steady_clock::now();
+        std::printf("resolve: %.3f us (%u profiles)\n",
+            std::chrono::duration<double, std::micro>(end - start).count() / iterations, database.profileCount());
+
+        // Prevent the loops from being optimized out.
+        return numEnabled ? 0 : 2;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const std::string command = argc > 1 ? argv[1] : "";
+    if (command == "--check" && argc == 3)
+    {
+        std::vector<uint8_t> database;
+        if (!Compile(argv[2], database))
+        {
+            return 1;
+        }
+        std::printf("%s is valid\n", argv[2]);
+        return 0;
+    }
+    else if (command == "--lookup" && argc >= 4)
+    {
+        return Lookup(argc, argv);
+    }
+    else if (command == "--benchmark" && argc >= 4)
+    {
+        return Benchmark(argc, argv);
+    }
+    else if (argc == 3 && command.rfind("--", 0) != 0)
+    {
+        std::vector<uint8_t> database;
+        if (!Compile(argv[1], database))
+        {
+            return 1;
+        }
+
+        // Write to a temporary file first, so that a running application never sees a partial database.
+        const std::string temporaryPath = std::string(argv[2]) + ".tmp";
+        {
+            std::ofstream file(temporaryPath, std::ios_base::binary | std::ios_base::trunc);
+            file.write(reinterpret_cast<const char*>(database.data()), database.size());
+            if (!file)
+            {
+                std::fprintf(stderr, "Cannot write %s\n", temporaryPath.c_str());
+                return 1;
+            }
+        }
+        std::remove(argv[2]);
+        if (std::rename(temporaryPath.c_str(), argv[2]))
+        {
+            std::fprintf(stderr, "Cannot write %s\n", argv[2]);
+            return 1;
+        }
+        std::printf("Wrote %s (%zu bytes)\n", argv[2], database.size());
+        return 0;
+    }
+
+    std::fprintf(stderr,
+        "Usage: ProfileCompiler <profiles.txt> <profiles.bin>\n"
+        "       ProfileCompiler --check <profiles.txt>\n"
+        "       ProfileCompiler --lookup <profiles.bin> <application> [gpu [vendor [WIDTHxHEIGHT]]]\n"
+        "       ProfileCompiler --benchmark <profiles.bin> <application> [iterations]\n");
+    return 1;
+}
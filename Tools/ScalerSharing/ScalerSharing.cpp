@@ -0,0 +1,308 @@
+// Report what sharing the scalers between swapchains saves, and check the keying and the lifetime of the shared
+// scalers (see SharedCache.h).
+//
+// Usage: ScalerSharing --report
+//        ScalerSharing --check
+//
+// The report replays the swapchain creations of typical applications against caches with the same keys as the layer
+// (see ScalerKeys.h), with scalers that only count the GPU objects and memory they would create. The sizes of the NIS
+// resources are those of NIS_Config.h from the SDK, so that the tool does not need the SDK to build.
+
+#include <cstdio>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "ScalerKeys.h"
+#include "SharedCache.h"
+
+using namespace nis_scaler;
+
+namespace
+{
+    // Stand-ins for the D3D11 device and the scalers of the layer.
+    struct Device
+    {
+    };
+
+    struct Resources
+    {
+        uint32_t objects;
+        uint64_t bytes;
+    };
+
+    struct Counted
+    {
+        Counted(Resources& live, const Resources& size) : m_live(live), m_size(size)
+        {
+            m_live.objects += m_size.objects;
+            m_live.bytes += m_size.bytes;
+        }
+
+        ~Counted()
+        {
+            m_live.objects -= m_size.objects;
+            m_live.bytes -= m_size.bytes;
+        }
+
+        Resources& m_live;
+        const Resources m_size;
+    };
+
+    // sizeof(NISConfig), kPhaseCount and kFilterSize in NIS_Config.h.
+    constexpr uint64_t NISConfigSize = 28 * 4;
+    constexpr uint64_t NISPhaseCount = 64;
+    constexpr uint64_t NISFilterSize = 8;
+
+    // NISRenderer::MaxViews and BilinearRenderer::MaxViews.
+    constexpr uint64_t ViewSlots = 4;
+
+    // Shader, sampler and one constant buffer per batch slot (a NISConfig and the slices for each view), and the sample
+    // weights (16 floats) when multisampled. The coefficients (2 textures and their views) are shared separately.
+    const Resources NISScalerSize{ 2 + ViewSlots, ViewSlots * ViewSlots * (NISConfigSize + 16) };
+    const Resources MultisampledNISScalerSize{ 3 + ViewSlots, ViewSlots * ViewSlots * (NISConfigSize + 16) + 16 * sizeof(float) };
+    const Resources NISCoefficientsSize{ 4, 2 * NISPhaseCount * NISFilterSize * sizeof(float) };
+    // Shader, sampler and constant buffer (80 bytes per view), and the sample weights (16 floats) when multisampled.
+    const Resources BilinearScalerSize{ 3, ViewSlots * 80 };
+    const Resources MultisampledBilinearScalerSize{ 4, ViewSlots * 80 + 16 * sizeof(float) };
+
+    struct NISCoefficients : Counted
+    {
+        explicit NISCoefficients(Resources& live) : Counted(live, NISCoefficientsSize)
+        {
+        }
+    };
+
+    struct NISScalerModel : Counted
+    {
+        NISScalerModel(Resources& live, const uint32_t sampleCount, std::shared_ptr<NISCoefficients> coefficients)
+            : Counted(live, sampleCount > 1 ? MultisampledNISScalerSize : NISScalerSize), coefficients(coefficients)
+        {
+        }
+
+        std::shared_ptr<NISCoefficients> coefficients;
+    };
+
+    struct BilinearScaler : Counted
+    {
+        BilinearScaler(Resources& live, const uint32_t sampleCount)
+            : Counted(live, sampleCount > 1 ? MultisampledBilinearScalerSize : BilinearScalerSize)
+        {
+        }
+    };
+
+    struct SwapchainInfo
+    {
+        uint32_t width;
+        uint32_t height;
+        uint32_t sampleCount;
+        bool isHdr;
+    };
+
+    struct SwapchainScalers
+    {
+        std::shared_ptr<NISScalerModel> NISScaler;
+        std::shared_ptr<BilinearScaler> peripheryScaler;
+    };
+
+    // The caches, keyed like in the layer (dllmain.cpp and NISRenderer.cpp).
+    struct Layer
+    {
+        explicit Layer(const bool isSharing) : isSharing(isSharing)
+        {
+        }
+
+        SwapchainScalers createSwapchain(Device* const device,
+                                         const SwapchainInfo& info,
+                                         const bool isUpscaling,
+                                         const NISVariant& variant = {},
+                                         const MsaaResolveFilter resolveFilter = MsaaResolveFilter::Box)
+        {
+            // The HDR mode is NISHDRMode::Linear for the float formats, and NISHDRMode::None otherwise.
+            SwapchainScalers scalers;
+            scalers.NISScaler = share(NISScalers, MakeNISScalerKey(device, isUpscaling, variant, info.isHdr ? 1u : 0u, info.sampleCount, resolveFilter), [&] {
+                auto coefficients = isUpscaling ? share(coefficientSets, device, [&] { return std::make_shared<NISCoefficients>(live); }) : nullptr;
+                return std::make_shared<NISScalerModel>(live, info.sampleCount, coefficients);
+            });
+            scalers.peripheryScaler = share(peripheryScalers, MakeBilinearScalerKey(device, info.sampleCount, resolveFilter), [&] {
+                return std::make_shared<BilinearScaler>(live, info.sampleCount);
+            });
+            return scalers;
+        }
+
+        template <typename Key, typename T, typename Factory>
+        std::shared_ptr<T> share(SharedCache<Key, T>& cache, const Key& key, const Factory& create)
+        {
+            return isSharing ? cache.getOrCreate(key, create) : create();
+        }
+
+        const bool isSharing;
+        Resources live{};
+
+        SharedCache<NISScalerKey<Device>, NISScalerModel> NISScalers;
+        SharedCache<BilinearScalerKey<Device>, BilinearScaler> peripheryScalers;
+        SharedCache<NISCoefficientsKey<Device>, NISCoefficients> coefficientSets;
+    };
+
+    struct Scenario
+    {
+        const char* name;
+        std::vector<SwapchainInfo> swapchains;
+        bool isUpscaling;
+    };
+
+    Resources Replay(const Scenario& scenario, const bool isSharing)
+    {
+        Device device;
+        Layer layer(isSharing);
+        std::vector<SwapchainScalers> swapchains;
+        for (const SwapchainInfo& info : scenario.swapchains)
+        {
+            swapchains.push_back(layer.createSwapchain(&device, info, scenario.isUpscaling));
+        }
+        return layer.live;
+    }
+
+    int Report()
+    {
+        const SwapchainInfo eye{ 1600, 1600, 1, false };
+        const SwapchainInfo inset{ 1200, 1200, 1, false };
+        const SwapchainInfo multisampledEye{ 1600, 1600, 4, false };
+        const SwapchainInfo hdrEye{ 1600, 1600, 1, true };
+        const Scenario scenarios[] = {
+            { "Stereo, one swapchain per eye", { eye, eye }, true },
+            { "Stereo, texture array", { eye }, true },
+            { "Stereo, sharpen only", { eye, eye }, false },
+            { "Stereo, 4x MSAA", { multisampledEye, multisampledEye }, true },
+            { "Stereo, HDR", { hdrEye, hdrEye }, true },
+            { "Quad views, one swapchain per view", { eye, eye, inset, inset }, true },
+        };
+
+        std::printf("%-40s %18s %18s\n", "Scenario", "Without sharing", "With sharing");
+        for (const Scenario& scenario : scenarios)
+        {
+            const Resources unshared = Replay(scenario, false);
+            const Resources shared = Replay(scenario, true);
+            std::printf("%-40s %4u obj, %6llu B %4u obj, %6llu B\n", scenario.name, unshared.objects, (unsigned long long)unshared.bytes, shared.objects,
+                        (unsigned long long)shared.bytes);
+        }
+        return 0;
+    }
+
+    int Check()
+    {
+        int result = 0;
+        const auto expect = [&](const char* name, const bool isPass) {
+            std::printf("%s: %s\n", name, isPass ? "ok" : "FAILED");
+            if (!isPass)
+            {
+                result = 1;
+            }
+        };
+
+        const SwapchainInfo eye{ 1600, 1600, 1, false };
+        const SwapchainInfo other{ 1200, 1200, 1, false };
+
+        // Swapchains with the same settings share their scalers.
+        {
+            Device device;
+            Layer layer(true);
+            const SwapchainScalers left = layer.createSwapchain(&device, eye, true);
+            const SwapchainScalers right = layer.createSwapchain(&device, eye, true);
+            expect("sharing: same settings",
+                   left.NISScaler == right.NISScaler && left.peripheryScaler == right.peripheryScaler &&
+                       layer.NISScalers.statistics().created == 1 && layer.NISScalers.statistics().reused == 1);
+        }
+
+        // Each part of the keys selects another scaler, and the sizes are not part of the keys.
+        {
+            Device device;
+            Device otherDevice;
+            Layer layer(true);
+            const SwapchainScalers reference = layer.createSwapchain(&device, eye, true);
+
+            const SwapchainScalers otherSize = layer.createSwapchain(&device, other, true);
+            expect("keys: input size", otherSize.NISScaler == reference.NISScaler && otherSize.peripheryScaler == reference.peripheryScaler);
+
+            const SwapchainScalers sharpen = layer.createSwapchain(&device, eye, false);
+            expect("keys: mode", sharpen.NISScaler != reference.NISScaler && !sharpen.NISScaler->coefficients);
+
+            NISVariant variant;
+            variant.blockHeight = 32;
+            const SwapchainScalers otherVariant = layer.createSwapchain(&device, eye, true, variant);
+            expect("keys: variant", otherVariant.NISScaler != reference.NISScaler && otherVariant.NISScaler->coefficients == reference.NISScaler->coefficients);
+
+            const SwapchainScalers hdr = layer.createSwapchain(&device, SwapchainInfo{ 1600, 1600, 1, true }, true);
+            expect("keys: HDR mode", hdr.NISScaler != reference.NISScaler && hdr.NISScaler->coefficients == reference.NISScaler->coefficients &&
+                                         hdr.peripheryScaler == reference.peripheryScaler);
+
+            const SwapchainInfo multisampledEye{ 1600, 1600, 4, false };
+            const SwapchainScalers multisampled = layer.createSwapchain(&device, multisampledEye, true);
+            expect("keys: sample count", multisampled.NISScaler != reference.NISScaler && multisampled.peripheryScaler != reference.peripheryScaler &&
+                                             multisampled.NISScaler->coefficients == reference.NISScaler->coefficients);
+
+            const SwapchainScalers tent = layer.createSwapchain(&device, multisampledEye, true, {}, MsaaResolveFilter::Tent);
+            expect("keys: resolve filter", tent.NISScaler != multisampled.NISScaler && tent.peripheryScaler != multisampled.peripheryScaler);
+
+            const SwapchainScalers otherDeviceScalers = layer.createSwapchain(&otherDevice, eye, true);
+            expect("keys: device", otherDeviceScalers.NISScaler != reference.NISScaler && otherDeviceScalers.peripheryScaler != reference.peripheryScaler &&
+                                       otherDeviceScalers.NISScaler->coefficients != reference.NISScaler->coefficients);
+        }
+
+        // The scalers live as long as their last swapchain.
+        {
+            Device device;
+            Layer layer(true);
+            auto left = std::make_unique<SwapchainScalers>(layer.createSwapchain(&device, eye, true));
+            auto right = std::make_unique<SwapchainScalers>(layer.createSwapchain(&device, eye, true));
+            const Resources stereo = layer.live;
+
+            left.reset();
+            const bool isKept = layer.live.objects == stereo.objects && layer.NISScalers.size() == 1;
+            right.reset();
+            const bool isReleased = layer.live.objects == 0 && layer.live.bytes == 0 && layer.NISScalers.size() == 0 && layer.coefficientSets.size() == 0;
+            expect("lifetime: release on last use", isKept && isReleased);
+
+            const SwapchainScalers recreated = layer.createSwapchain(&device, eye, true);
+            expect("lifetime: recreation", layer.live.objects == stereo.objects && layer.NISScalers.statistics().created == 2);
+        }
+
+        // A failed creation is not cached.
+        {
+            SharedCache<int, int> cache;
+            bool isThrown = false;
+            try
+            {
+                cache.getOrCreate(1, []() -> std::shared_ptr<int> { throw std::runtime_error("failed"); });
+            }
+            catch (std::runtime_error&)
+            {
+                isThrown = true;
+            }
+            const std::shared_ptr<int> value = cache.getOrCreate(1, [] { return std::make_shared<int>(42); });
+            expect("failed creation", isThrown && *value == 42 && cache.statistics().created == 1 && cache.size() == 1);
+        }
+
+        return result;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const std::string command = argc > 1 ? argv[1] : "";
+    if (command == "--report" && argc == 2)
+    {
+        return Report();
+    }
+    else if (command == "--check" && argc == 2)
+    {
+        return Check();
+    }
+
+    std::fprintf(stderr,
+        "Usage: ScalerSharing --report\n"
+        "       ScalerSharing --check\n");
+    return 1;
+}
@@ -0,0 +1,285 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Inspect the shader cache of the layer, and check its behavior (see ShaderCache.h).
+//
+// Usage: ShaderCacheTool --list <directory>
+//        ShaderCacheTool --clear <directory>
+//        ShaderCacheTool --check
+//
+// The layer keeps its cache in %LOCALAPPDATA%\XR_APILAYER_NOVENDOR_nis_scaler.shaders. The check runs the cache in a
+// temporary directory with a stub compiler, and verifies the keying, the integrity checks and the eviction.
+
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+#include "ShaderCache.h"
+
+using namespace nis_scaler;
+
+namespace
+{
+    int List(const std::string& directory)
+    {
+        std::error_code ec;
+        uint64_t totalSize = 0;
+        uint32_t count = 0;
+        for (const auto& file : std::filesystem::directory_iterator(directory, ec))
+        {
+            if (file.path().extension() != ShaderCacheExtension)
+            {
+                continue;
+            }
+
+            std::ifstream stream(file.path(), std::ios_base::binary);
+            ShaderCacheEntryHeader header{};
+            std::string key;
+            if (stream.read(reinterpret_cast<char*>(&header), sizeof(header)) && header.magic == ShaderCacheMagic &&
+                header.version == ShaderCacheVersion && header.keySize < 64 * 1024)
+            {
+                key.resize(header.keySize);
+                stream.read(key.data(), key.size());
+            }
+
+            std::error_code fileEc;
+            const uint64_t size = file.file_size(fileEc);
+            std::printf("%s: %llu bytes%s\n", file.path().filename().string().c_str(), (unsigned long long)size,
+                key.empty() ? " (invalid)" : "");
+            std::printf("%s", key.c_str());
+            totalSize += size;
+            count++;
+        }
+        if (ec)
+        {
+            std::fprintf(stderr, "Cannot read %s\n", directory.c_str());
+            return 1;
+        }
+
+        std::printf("%u entries, %llu bytes\n", count, (unsigned long long)totalSize);
+        return 0;
+    }
+
+    int Clear(const std::string& directory)
+    {
+        ShaderCache(directory).clear();
+        return 0;
+    }
+
+    // A compiler that produces bytecode derived from the key, and counts its invocations.
+    struct StubCompiler
+    {
+        uint32_t invocations{ 0 };
+
+        ShaderCache::CompileFunction compile(const ShaderKey& key, const bool succeeds = true)
+        {
+            return [this, key, succeeds](std::vector<uint8_t>& bytecode) {
+                invocations++;
+                const std::string description = "DXBC" + key.describe();
+                bytecode.assign(description.begin(), description.end());
+                return succeeds;
+            };
+        }
+    };
+
+    ShaderKey MakeKey()
+    {
+        ShaderKey key;
+        key.source = "[numthreads(8, 8, 1)] void main() {}\n";
+        key.defines = { { "NIS_SCALER", "1" }, { "NIS_HDR_MODE", "0" }, { "NIS_BLOCK_WIDTH", "32" } };
+        key.entryPoint = "main";
+        key.target = "cs_5_0";
+        key.flags = 1 << 15;
+        key.compilerVersion = "d3dcompiler_47";
+        return key;
+    }
+
+    void PatchFile(const std::string& path, const uint64_t offset, const char value)
+    {
+        std::fstream file(path, std::ios_base::binary | std::ios_base::in | std::ios_base::out);
+        file.seekp(offset);
+        file.write(&value, 1);
+    }
+
+    int Check()
+    {
+        const std::filesystem::path directory = std::filesystem::temp_directory_path() / "ShaderCacheTool-check";
+        std::error_code ec;
+        std::filesystem::remove_all(directory, ec);
+
+        int result = 0;
+        const auto expect = [&](const char* name, const bool isPass) {
+            std::printf("%s: %s\n", name, isPass ? "ok" : "FAILED");
+            if (!isPass)
+            {
+                result = 1;
+            }
+        };
+
+        StubCompiler compiler;
+        const ShaderKey key = MakeKey();
+        std::vector<uint8_t> expected;
+        compiler.compile(key)(expected);
+        compiler.invocations = 0;
+
+        // A miss compiles and stores, the next lookups hit, including from another instance (another process).
+        {
+            ShaderCache cache(directory.string());
+            std::vector<uint8_t> bytecode;
+            const bool isMissCompiled = cache.getOrCompile(key, bytecode, compiler.compile(key)) && bytecode == expected;
+            const bool isHit = cache.getOrCompile(key, bytecode, compiler.compile(key)) && bytecode == expected;
+            expect("miss then hit", isMissCompiled && isHit && compiler.invocations == 1 && cache.statistics().hits == 1);
+
+            ShaderCache otherCache(directory.string());
+            expect("persistence", otherCache.load(key, bytecode) && bytecode == expected);
+        }
+
+        // Every part of the key must select another entry.
+        {
+            ShaderCache cache(directory.string());
+            const auto isNewEntry = [&](const ShaderKey& otherKey) {
+                std::vector<uint8_t> bytecode;
+                return cache.entryPath(otherKey) != cache.entryPath(key) && !cache.load(otherKey, bytecode);
+            };
+            ShaderKey otherKey = key;
+            otherKey.source += " ";
+            expect("key: source", isNewEntry(otherKey));
+            otherKey = key;
+            otherKey.defines[2].second = "64";
+            expect("key: define value", isNewEntry(otherKey));
+            otherKey = key;
+            otherKey.defines.push_back({ "NIS_USE_HALF_PRECISION", "1" });
+            expect("key: additional define", isNewEntry(otherKey));
+            otherKey = key;
+            otherKey.entryPoint = "main2";
+            expect("key: entry point", isNewEntry(otherKey));
+            otherKey = key;
+            otherKey.target = "cs_5_1";
+            expect("key: target", isNewEntry(otherKey));
+            otherKey = key;
+            otherKey.flags = 0;
+            expect("key: flags", isNewEntry(otherKey));
+            otherKey = key;
+            otherKey.compilerVersion = "d3dcompiler_48";
+            expect("key: compiler version", isNewEntry(otherKey));
+        }
+
+        // Damaged entries are rejected, deleted, and replaced by the next compilation.
+        {
+            ShaderCache cache(directory.string());
+            const std::string path = cache.entryPath(key);
+            const uint64_t size = std::filesystem::file_size(path, ec);
+            std::vector<uint8_t> bytecode;
+
+            PatchFile(path, size - 1, 'X');
+            const bool isRejected = !cache.load(key, bytecode) && !std::filesystem::exists(path);
+            expect("integrity: corrupted bytecode", isRejected && cache.statistics().invalidEntries == 1);
+
+            cache.store(key, expected);
+            std::filesystem::resize_file(path, size - 4, ec);
+            expect("integrity: truncated entry", !cache.load(key, bytecode) && !std::filesystem::exists(path));
+
+            cache.store(key, expected);
+            PatchFile(path, offsetof(ShaderCacheEntryHeader, version), (char)(ShaderCacheVersion + 1));
+            expect("integrity: other version", !cache.load(key, bytecode) && !std::filesystem::exists(path));
+
+            // An entry for another key at the same path, like with a hash collision.
+            ShaderKey otherKey = key;
+            otherKey.entryPoint = "other";
+            cache.store(otherKey, expected);
+            std::filesystem::rename(cache.entryPath(otherKey), path, ec);
+            expect("integrity: other key", !cache.load(key, bytecode));
+
+            compiler.invocations = 0;
+            const bool isRecompiled = cache.getOrCompile(key, bytecode, compiler.compile(key)) && bytecode == expected;
+            expect("integrity: recompiled", isRecompiled && compiler.invocations == 1 && cache.load(key, bytecode));
+        }
+
+        // Failed compilations are not stored.
+        {
+            ShaderCache cache(directory.string());
+            ShaderKey badKey = key;
+            badKey.source = "syntax error";
+            std::vector<uint8_t> bytecode;
+            const bool isFailed = !cache.getOrCompile(badKey, bytecode, compiler.compile(badKey, false));
+            expect("failed compilation", isFailed && !std::filesystem::exists(cache.entryPath(badKey)));
+        }
+
+        // The least recently used entries are evicted first.
+        {
+            ShaderCache(directory.string()).clear();
+
+            // Room for 3 entries.
+            const uint64_t entrySize = sizeof(ShaderCacheEntryHeader) + key.describe().size() + expected.size();
+            ShaderCache cache(directory.string(), entrySize * 3);
+
+            // Entry i is used i minutes ago.
+            std::vector<ShaderKey> keys;
+            const auto now = std::filesystem::file_time_type::clock::now();
+            for (int i = 0; i < 3; i++)
+            {
+                keys.push_back(key);
+                keys.back().defines[2].second = std::to_string(i);
+                std::vector<uint8_t> bytecode;
+                compiler.compile(keys.back())(bytecode);
+                cache.store(keys.back(), bytecode);
+                std::filesystem::last_write_time(cache.entryPath(keys.back()), now - std::chrono::minutes(i), ec);
+            }
+
+            // Using the oldest entry makes the second oldest the least recently used.
+            std::vector<uint8_t> bytecode;
+            cache.load(keys[2], bytecode);
+            ShaderKey newKey = key;
+            newKey.defines[2].second = "new";
+            compiler.compile(newKey)(bytecode);
+            cache.store(newKey, bytecode);
+
+            const bool isEvicted = !std::filesystem::exists(cache.entryPath(keys[1]));
+            const bool areKept = std::filesystem::exists(cache.entryPath(keys[0])) && std::filesystem::exists(cache.entryPath(keys[2])) &&
+                                 std::filesystem::exists(cache.entryPath(newKey));
+            expect("eviction", isEvicted && areKept && cache.statistics().evictedEntries == 1);
+        }
+
+        std::filesystem::remove_all(directory, ec);
+        return result;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const std::string command = argc > 1 ? argv[1] : "";
+    if (command == "--list" && argc == 3)
+    {
+        return List(argv[2]);
+    }
+    else if (command == "--clear" && argc == 3)
+    {
+        return Clear(argv[2]);
+    }
+    else if (command == "--check" && argc == 2)
+    {
+        return Check();
+    }
+
+    std::fprintf(stderr,
+        "Usage: ShaderCacheTool --list <directory>\n"
+        "       ShaderCacheTool --clear <directory>\n"
+        "       ShaderCacheTool --check\n");
+    return 1;
+}
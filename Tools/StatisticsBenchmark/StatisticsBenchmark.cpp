@@ -0,0 +1,337 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+// Validate and benchmark the statistics of the GPU timers (see Statistics.h).
+//
+// Usage: StatisticsBenchmark --check
+//        StatisticsBenchmark --benchmark [iterations]
+//
+// The check compares the percentiles of the histogram to the exact percentiles of the sorted samples, for several
+// distributions, and runs random sequences of operations on the ring of pending samples against a std::deque model, to
+// verify the order of the samples and the accounting of the dropped ones. The benchmark measures the cost of recording a
+// sample and of computing the percentiles reported by the layer.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "Statistics.h"
+
+using namespace nis_scaler;
+
+namespace
+{
+    const double Fractions[] = { 0.01, 0.1, 0.5, 0.9, 0.99, 0.999, 1.0 };
+
+    // The sample of the given rank, with the same rank as LatencyHistogram::percentile().
+    uint64_t ReferencePercentile(const std::vector<uint64_t>& sorted, const double fraction)
+    {
+        const uint64_t rank = (std::max)((uint64_t)1, (uint64_t)(fraction * sorted.size() + 0.5));
+        return sorted[(size_t)(rank - 1)];
+    }
+
+    // The percentiles are the upper bound of the bucket of the reference sample, capped to the maximum: never below the
+    // reference, and above it by less than 1/SubBuckets of it.
+    uint32_t CountPercentileErrors(const std::vector<uint64_t>& samples)
+    {
+        LatencyHistogram histogram;
+        for (const uint64_t sample : samples)
+        {
+            histogram.record(sample);
+        }
+        std::vector<uint64_t> sorted(samples);
+        std::sort(sorted.begin(), sorted.end());
+
+        uint32_t errors = 0;
+        if (histogram.count() != sorted.size() || histogram.maximum() != sorted.back())
+        {
+            errors++;
+        }
+        for (const double fraction : Fractions)
+        {
+            const uint64_t reference = ReferencePercentile(sorted, fraction);
+            const uint64_t value = histogram.percentile(fraction);
+            const uint64_t tolerance = reference < LatencyHistogram::SubBuckets ? 0 : reference / LatencyHistogram::SubBuckets;
+            if (value < reference || value - reference > tolerance || value > sorted.back())
+            {
+                std::printf("  percentile %g: %llu, expected %llu (+%llu)\n", fraction, (unsigned long long)value,
+                    (unsigned long long)reference, (unsigned long long)tolerance);
+                errors++;
+            }
+        }
+        return errors;
+    }
+
+    int Check()
+    {
+        int result = 0;
+        const auto expect = [&](const char* name, const uint32_t errors) {
+            std::printf("%s: %s", name, !errors ? "ok\n" : "FAILED");
+            if (errors)
+            {
+                std::printf(" (%u errors)\n", errors);
+                result = 1;
+            }
+        };
+
+        // Each value falls in the bucket ending at or after it, and the buckets are contiguous.
+        {
+            uint32_t errors = 0;
+            for (size_t i = 0; i + 1 < LatencyHistogram::NumBuckets; i++)
+            {
+                const uint64_t upperBound = LatencyHistogram::bucketUpperBound(i);
+                if (LatencyHistogram::bucketIndex(upperBound) != i || LatencyHistogram::bucketIndex(upperBound + 1) != i + 1)
+                {
+                    errors++;
+                }
+            }
+            if (LatencyHistogram::bucketUpperBound(LatencyHistogram::NumBuckets - 1) != ~0ull ||
+                LatencyHistogram::bucketIndex(~0ull) != LatencyHistogram::NumBuckets - 1)
+            {
+                errors++;
+            }
+            expect("contiguous buckets", errors);
+        }
+
+        // GPU timings in microseconds: a narrow distribution with a long tail, two modes (like alternating eyes or
+        // reprojected frames), and small values that are recorded exactly.
+        {
+            std::mt19937_64 random(42);
+            struct Distribution
+            {
+                const char* name;
+                std::function<uint64_t()> generate;
+            };
+            std::lognormal_distribution<double> lognormal(std::log(1500.0), 0.25);
+            std::uniform_int_distribution<uint64_t> uniform(0, 20000);
+            std::normal_distribution<double> lowMode(800.0, 50.0);
+            std::normal_distribution<double> highMode(4000.0, 300.0);
+            std::uniform_int_distribution<uint64_t> small(0, LatencyHistogram::SubBuckets - 1);
+            std::uniform_int_distribution<uint64_t> wide(0, ~0ull);
+            const Distribution distributions[] = {
+                { "lognormal", [&]() { return (uint64_t)lognormal(random); } },
+                { "uniform", [&]() { return uniform(random); } },
+                { "bimodal", [&]() { return (uint64_t)(std::max)(random() % 4 ? lowMode(random) : highMode(random), 0.0); } },
+                { "small values", [&]() { return small(random); } },
+                { "full range", [&]() { return wide(random) >> (random() % 64); } },
+            };
+
+            for (const Distribution& distribution : distributions)
+            {
+                uint32_t errors = 0;
+                for (const size_t count : { (size_t)1, (size_t)7, (size_t)100, (size_t)10000, (size_t)100000 })
+                {
+                    std::vector<uint64_t> samples(count);
+                    for (uint64_t& sample : samples)
+                    {
+                        sample = distribution.generate();
+                    }
+                    errors += CountPercentileErrors(samples);
+                }
+                const std::string name = std::string("percentiles of ") + distribution.name;
+                expect(name.c_str(), errors);
+            }
+        }
+
+        // The histogram is empty after a reset.
+        {
+            LatencyHistogram histogram;
+            histogram.record(1234);
+            histogram.reset();
+            expect("reset", histogram.count() || histogram.maximum() || histogram.percentile(0.5) ? 1 : 0);
+        }
+
+        // Random operations like the GPU timers: issue a sample each frame, read back the ready ones, and discard those
+        // that cannot be used. The samples are numbered to check their order.
+        {
+            constexpr size_t Depth = 5;
+            std::mt19937_64 random(7);
+            PendingRing<uint64_t, Depth> ring;
+            std::deque<uint64_t> model;
+            uint64_t modelDropped = 0;
+            uint64_t nextSample = 1;
+            uint32_t errors = 0;
+            for (uint32_t i = 0; i < 100000; i++)
+            {
+                switch (random() % 4)
+                {
+                case 0:
+                case 1:
+                    // A full ring drops its oldest sample to make room.
+                    ring.acquire() = nextSample;
+                    if (ring.current() != nextSample)
+                    {
+                        errors++;
+                    }
+                    ring.commit();
+                    if (model.size() == Depth)
+                    {
+                        model.pop_front();
+                        modelDropped++;
+                    }
+                    model.push_back(nextSample++);
+                    break;
+
+                case 2:
+                    if (!model.empty())
+                    {
+                        ring.release();
+                        model.pop_front();
+                    }
+                    break;
+
+                case 3:
+                    if (!model.empty())
+                    {
+                        ring.discard();
+                        model.pop_front();
+                        modelDropped++;
+                    }
+                    break;
+                }
+
+                const uint64_t* const oldest = ring.oldest();
+                if ((oldest != nullptr) != !model.empty() || (oldest && *oldest != model.front()))
+                {
+                    errors++;
+                }
+                if (i % 101 == 0)
+                {
+                    errors += ring.takeDropped() != modelDropped;
+                    modelDropped = 0;
+                }
+            }
+            errors += ring.takeDropped() != modelDropped;
+            errors += ring.takeDropped() != 0;
+            expect("pending ring order and drops", errors);
+        }
+
+        // A reader that never catches up: every sample beyond the depth of the ring is dropped.
+        {
+            PendingRing<uint64_t, 3> ring;
+            for (uint64_t i = 0; i < 10; i++)
+            {
+                ring.acquire() = i;
+                ring.commit();
+            }
+            expect("pending ring overrun", ring.takeDropped() != 7 || !ring.oldest() || *ring.oldest() != 7 ? 1 : 0);
+        }
+
+        return result;
+    }
+
+    // The time of an operation in nanoseconds, as the best of several runs.
+    template <typename Function>
+    double Measure(const uint32_t iterations, const uint32_t operations, const Function& function)
+    {
+        double bestTime = INFINITY;
+        for (uint32_t j = 0; j <= iterations; j++)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            function();
+            const auto end = std::chrono::steady_clock::now();
+            if (j > 0)
+            {
+                bestTime = (std::min)(bestTime, std::chrono::duration<double, std::nano>(end - start).count() / operations);
+            }
+        }
+        return bestTime;
+    }
+
+    int Benchmark(int argc, char** argv)
+    {
+        const uint32_t iterations = argc > 2 ? (std::max)((uint32_t)std::strtoul(argv[2], nullptr, 10), 1u) : 10;
+        const uint32_t count = 100000;
+
+        std::mt19937_64 random(42);
+        std::lognormal_distribution<double> lognormal(std::log(1500.0), 0.25);
+        std::vector<uint64_t> samples(count);
+        for (uint64_t& sample : samples)
+        {
+            sample = (uint64_t)lognormal(random);
+        }
+
+        uint64_t sink = 0;
+        LatencyHistogram histogram;
+        const double record = Measure(iterations, count, [&]() {
+            histogram.reset();
+            for (const uint64_t sample : samples)
+            {
+                histogram.record(sample);
+            }
+        });
+        // The layer logs the p50, p90 and p99 of each timer.
+        const double percentiles = Measure(iterations, 1000, [&]() {
+            for (uint32_t i = 0; i < 1000; i++)
+            {
+                sink += histogram.percentile(0.5) + histogram.percentile(0.9) + histogram.percentile(0.99);
+            }
+        });
+        PendingRing<uint64_t, 5> ring;
+        const double cycle = Measure(iterations, count, [&]() {
+            for (uint32_t i = 0; i < count; i++)
+            {
+                ring.acquire() = i;
+                ring.commit();
+                if (i % 4 == 0)
+                {
+                    sink += *ring.oldest();
+                    ring.release();
+                }
+            }
+        });
+        sink += ring.takeDropped();
+
+        std::printf("operation,ns\n");
+        std::printf("record,%.2f\n", record);
+        std::printf("p50+p90+p99,%.2f\n", percentiles);
+        std::printf("ring acquire+commit(+release),%.2f\n", cycle);
+
+        // Keep the results alive.
+        if (sink == 1)
+        {
+            std::printf("\n");
+        }
+
+        return 0;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const std::string command = argc > 1 ? argv[1] : "";
+    if (command == "--check" && argc == 2)
+    {
+        return Check();
+    }
+    else if (command == "--benchmark" && argc <= 3)
+    {
+        return Benchmark(argc, argv);
+    }
+
+    std::fprintf(stderr,
+        "Usage: StatisticsBenchmark --check\n"
+        "       StatisticsBenchmark --benchmark [iterations]\n");
+    return 1;
+}
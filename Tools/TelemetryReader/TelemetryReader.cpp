@@ -0,0 +1,224 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Print the telemetry published by the layer as CSV.
+//
+// Usage: TelemetryReader [frames]
+//        TelemetryReader --stress [records]
+//
+// Without a frame count, records are printed until the process is interrupted.
+//
+// The stress test publishes records as fast as possible from a thread, through the same shared memory segment as the
+// layer (so it must not run at the same time as the layer), while a reader that regularly falls behind consumes them.
+// Each record carries a checksum of its payload: a record returned by the reader with a bad checksum, or out of order,
+// is a torn read that was not detected. Every record must be either returned or counted as an overrun, and once the
+// writer is done, each slot must hold the sequence number of its last record, which is even.
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#include "Telemetry.h"
+
+using namespace nis_scaler;
+
+namespace
+{
+    uint32_t Checksum(const TelemetryRecord& record)
+    {
+        // FNV-1a over the record, without the checksum itself (the last field).
+        const uint8_t* const bytes = reinterpret_cast<const uint8_t*>(&record);
+        uint32_t hash = 2166136261u;
+        for (size_t i = 0; i < offsetof(TelemetryRecord, displayHeight); i++)
+        {
+            hash = (hash ^ bytes[i]) * 16777619u;
+        }
+        return hash;
+    }
+
+    // A record with a payload that changes with each index.
+    TelemetryRecord MakeRecord(const uint64_t index)
+    {
+        uint64_t state = index * 0x9e3779b97f4a7c15ull;
+        const auto next = [&]() {
+            state ^= state >> 29;
+            state *= 0xbf58476d1ce4e5b9ull;
+            return (uint32_t)(state >> 32);
+        };
+
+        TelemetryRecord record{};
+        record.frameIndex = index;
+        record.cpuTime = next();
+        record.scalerTime = next();
+        record.colorConversionTime = next();
+        record.appGpuTime = next();
+        record.scalingMode = next() % 3;
+        record.sharpness = (next() % 1001) / 1000.f;
+        record.renderScale = (next() % 1001) / 1000.f;
+        record.renderWidth = next();
+        record.renderHeight = next();
+        record.displayWidth = next();
+        record.displayHeight = Checksum(record);
+        return record;
+    }
+
+    int Stress(const uint64_t numRecords)
+    {
+        TelemetryWriter writer;
+        if (!writer.open())
+        {
+            std::fprintf(stderr, "Cannot create the shared memory segment\n");
+            return 1;
+        }
+        TelemetryReader reader;
+        if (!reader.open())
+        {
+            std::fprintf(stderr, "Cannot open the shared memory segment\n");
+            return 1;
+        }
+
+        std::atomic<bool> isWriterDone{ false };
+        std::thread writerThread([&]() {
+            for (uint64_t i = 0; i < numRecords; i++)
+            {
+                writer.publish(MakeRecord(i));
+            }
+            isWriterDone.store(true, std::memory_order_release);
+        });
+
+        // Fall behind every now and then, by more than the capacity of the ring.
+        uint64_t numRead = 0;
+        uint64_t badChecksums = 0;
+        uint64_t outOfOrder = 0;
+        uint64_t nextIndex = 0;
+        uint64_t skipped = 0;
+        while (true)
+        {
+            const bool isLastPass = isWriterDone.load(std::memory_order_acquire);
+            TelemetryRecord record;
+            while (reader.read(record))
+            {
+                if (Checksum(record) != record.displayHeight)
+                {
+                    badChecksums++;
+                }
+                if (record.frameIndex < nextIndex)
+                {
+                    outOfOrder++;
+                }
+                else
+                {
+                    skipped += record.frameIndex - nextIndex;
+                    nextIndex = record.frameIndex + 1;
+                }
+                if (++numRead % 50000 == 0)
+                {
+                    std::this_thread::sleep_for(std::chrono::microseconds(200));
+                }
+            }
+            if (isLastPass)
+            {
+                break;
+            }
+        }
+        writerThread.join();
+        skipped += numRecords - nextIndex;
+
+        // Each slot holds the last record written to it.
+        uint64_t badSequences = 0;
+        {
+            SharedMemory memory;
+            if (!memory.open(TelemetrySegmentName, sizeof(TelemetrySegment)))
+            {
+                std::fprintf(stderr, "Cannot open the shared memory segment\n");
+                return 1;
+            }
+            const TelemetrySegment* const segment = reinterpret_cast<const TelemetrySegment*>(memory.data());
+            for (uint64_t i = numRecords > TelemetryCapacity ? numRecords - TelemetryCapacity : 0; i < numRecords; i++)
+            {
+                const uint64_t sequence = segment->slots[i & (TelemetryCapacity - 1)].sequence.load(std::memory_order_acquire);
+                if (sequence % 2 || sequence != 2 * (i + 1))
+                {
+                    badSequences++;
+                }
+            }
+        }
+        reader.close();
+        writer.close();
+
+        std::printf("%llu records published, %llu read, %llu overruns, %llu torn reads\n", (unsigned long long)numRecords,
+            (unsigned long long)numRead, (unsigned long long)reader.overruns(), (unsigned long long)reader.tornReads());
+        const bool isPass = !badChecksums && !outOfOrder && !badSequences && skipped == reader.overruns() && numRead + skipped == numRecords;
+        std::printf("stress: %s", isPass ? "ok\n" : "FAILED");
+        if (!isPass)
+        {
+            std::printf(" (%llu bad checksums, %llu out of order, %llu bad sequences, %llu skipped records)\n", (unsigned long long)badChecksums,
+                (unsigned long long)outOfOrder, (unsigned long long)badSequences, (unsigned long long)skipped);
+        }
+
+        return isPass ? 0 : 1;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (argc > 1 && std::string(argv[1]) == "--stress")
+    {
+        return Stress(argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 10000000);
+    }
+
+    const uint64_t maxRecords = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 0;
+
+    TelemetryReader reader;
+    while (!reader.open())
+    {
+        std::fprintf(stderr, "Waiting for the layer to publish telemetry...\n");
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+    }
+
+    std::printf("frameIndex,cpuTime,scalerTime,colorConversionTime,appGpuTime,scalingMode,sharpness,renderScale,renderWidth,renderHeight,displayWidth,displayHeight\n");
+
+    uint64_t numRecords = 0;
+    while (!maxRecords || numRecords < maxRecords)
+    {
+        TelemetryRecord record;
+        bool idle = true;
+        while (reader.read(record) && (!maxRecords || numRecords < maxRecords))
+        {
+            std::printf("%llu,%u,%u,%u,%u,%u,%.3f,%.3f,%u,%u,%u,%u\n",
+                (unsigned long long)record.frameIndex, record.cpuTime, record.scalerTime, record.colorConversionTime, record.appGpuTime,
+                record.scalingMode, record.sharpness, record.renderScale,
+                record.renderWidth, record.renderHeight, record.displayWidth, record.displayHeight);
+            numRecords++;
+            idle = false;
+        }
+
+        if (idle)
+        {
+            // Poll a few times per frame at 90Hz.
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+    }
+
+    std::fprintf(stderr, "%llu records, %llu overruns, %llu torn reads\n",
+        (unsigned long long)numRecords, (unsigned long long)reader.overruns(), (unsigned long long)reader.tornReads());
+
+    return 0;
+}
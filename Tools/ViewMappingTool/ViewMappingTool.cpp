@@ -0,0 +1,145 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Show how the layer maps the regions submitted by the application to the runtime textures, and check the mapping
+// (see ViewMapping.h).
+//
+// Usage: ViewMappingTool --map <texture width>x<texture height> <render width>x<render height> <display width>x<display height> <x> <y> <width> <height>
+//        ViewMappingTool --check
+//
+// The render resolution is the one recommended to the application, and the region is its imageRect.
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "ViewMapping.h"
+
+using namespace nis_scaler;
+
+namespace
+{
+    bool ParseSize(const char* text, uint32_t& width, uint32_t& height)
+    {
+        return std::sscanf(text, "%ux%u", &width, &height) == 2 && width && height;
+    }
+
+    std::string Describe(const NISViewport& viewport)
+    {
+        return std::to_string(viewport.width) + "x" + std::to_string(viewport.height) + "+" + std::to_string(viewport.x) + "+" + std::to_string(viewport.y);
+    }
+
+    int Map(char** argv)
+    {
+        uint32_t textureWidth, textureHeight, renderWidth, renderHeight, displayWidth, displayHeight;
+        if (!ParseSize(argv[0], textureWidth, textureHeight) || !ParseSize(argv[1], renderWidth, renderHeight) ||
+            !ParseSize(argv[2], displayWidth, displayHeight))
+        {
+            std::fprintf(stderr, "Invalid size\n");
+            return 1;
+        }
+
+        const uint32_t outputWidth = GetOutputTextureSize(textureWidth, renderWidth, displayWidth);
+        const uint32_t outputHeight = GetOutputTextureSize(textureHeight, renderHeight, displayHeight);
+        const NISViewport inputViewport = ClampViewport(std::atoi(argv[3]), std::atoi(argv[4]), std::atoi(argv[5]), std::atoi(argv[6]), textureWidth, textureHeight);
+        const bool isUpscaling = renderWidth != displayWidth || renderHeight != displayHeight;
+        const NISViewport outputViewport =
+            MapOutputViewport(inputViewport, textureWidth, textureHeight, outputWidth, outputHeight, isUpscaling);
+
+        std::printf("Runtime texture: %ux%u\n", outputWidth, outputHeight);
+        std::printf("Input region: %s\n", Describe(inputViewport).c_str());
+        std::printf("Output region: %s (%s)\n", Describe(outputViewport).c_str(), isUpscaling ? "upscaled" : "sharpened in place");
+        return 0;
+    }
+
+    int Check()
+    {
+        int result = 0;
+        const auto expect = [&](const char* name, const NISViewport& viewport, const NISViewport& expected) {
+            const bool isPass = viewport == expected;
+            std::printf("%s: %s%s\n", name, Describe(viewport).c_str(), isPass ? " ok" : (" FAILED, expected " + Describe(expected)).c_str());
+            if (!isPass)
+            {
+                result = 1;
+            }
+        };
+
+        // The runtime textures.
+        {
+            const auto size = [](const uint32_t appSize, const uint32_t renderSize, const uint32_t displaySize) {
+                return NISViewport{ 0, 0, GetOutputTextureSize(appSize, renderSize, displaySize), 1 };
+            };
+            expect("texture: view", size(1400, 1400, 2000), { 0, 0, 2000, 1 });
+            expect("texture: atlas", size(2800, 1400, 2000), { 0, 0, 4000, 1 });
+            expect("texture: atlas, odd size", size(2798, 1399, 2000), { 0, 0, 4000, 1 });
+            expect("texture: no upscaling", size(2048, 2000, 2000), { 0, 0, 2048, 1 });
+            expect("texture: smaller", size(700, 1400, 2000), { 0, 0, 1000, 1 });
+        }
+
+        // The regions submitted by the application.
+        {
+            expect("clamp: entire texture", ClampViewport(0, 0, 1400, 1260, 1400, 1260), { 0, 0, 1400, 1260 });
+            expect("clamp: negative offset", ClampViewport(-5, -1, 1400, 1260, 1400, 1260), { 0, 0, 1400, 1260 });
+            expect("clamp: past the edges", ClampViewport(100, 60, 1400, 1260, 1400, 1260), { 100, 60, 1300, 1200 });
+            expect("clamp: last pixel", ClampViewport(1399, 1259, 1, 1, 1400, 1260), { 1399, 1259, 1, 1 });
+            expect("clamp: outside", ClampViewport(1400, 1260, 10, 10, 1400, 1260), { 1399, 1259, 1, 1 });
+            expect("clamp: empty", ClampViewport(10, 20, 0, -3, 1400, 1260), { 10, 20, 1, 1 });
+        }
+
+        // The regions of the runtime textures.
+        {
+            const auto map = [](const NISViewport& input, const uint32_t inputWidth, const uint32_t inputHeight, const uint32_t renderWidth,
+                                 const uint32_t renderHeight, const bool isUpscaling = true) {
+                const uint32_t displayWidth = isUpscaling ? 2000 : renderWidth;
+                const uint32_t displayHeight = isUpscaling ? 1800 : renderHeight;
+                return MapOutputViewport(input, inputWidth, inputHeight, GetOutputTextureSize(inputWidth, renderWidth, displayWidth),
+                                         GetOutputTextureSize(inputHeight, renderHeight, displayHeight), isUpscaling);
+            };
+            expect("map: view", map({ 0, 0, 1400, 1260 }, 1400, 1260, 1400, 1260), { 0, 0, 2000, 1800 });
+            expect("map: atlas left", map({ 0, 0, 1400, 1260 }, 2800, 1260, 1400, 1260), { 0, 0, 2000, 1800 });
+            expect("map: atlas right", map({ 1400, 0, 1400, 1260 }, 2800, 1260, 1400, 1260), { 2000, 0, 2000, 1800 });
+            expect("map: atlas right, odd size", map({ 1399, 0, 1399, 1259 }, 2798, 1259, 1399, 1259), { 2000, 0, 2000, 1800 });
+            expect("map: atlas bottom", map({ 0, 1260, 1400, 1260 }, 1400, 2520, 1400, 1260), { 0, 1800, 2000, 1800 });
+            expect("map: dynamic resolution", map({ 0, 0, 1050, 945 }, 1400, 1260, 1400, 1260), { 0, 0, 1500, 1350 });
+            expect("map: dynamic resolution, atlas right", map({ 1400, 0, 1050, 945 }, 2800, 1260, 1400, 1260), { 2000, 0, 1500, 1350 });
+            // The views of an atlas packed side by side at the current scale do not overlap.
+            expect("map: dynamic resolution, packed atlas left", map({ 0, 0, 1050, 945 }, 2800, 1260, 1400, 1260), { 0, 0, 1500, 1350 });
+            expect("map: dynamic resolution, packed atlas right", map({ 1050, 0, 1050, 945 }, 2800, 1260, 1400, 1260), { 1500, 0, 1500, 1350 });
+            expect("map: clamped to the texture", map({ 700, 630, 700, 630 }, 1400, 1260, 1400, 1260), { 1000, 900, 1000, 900 });
+            expect("map: last pixel", map({ 1399, 1259, 1, 1 }, 1400, 1260, 1400, 1260), { 1999, 1799, 1, 1 });
+            expect("map: supersampled", map({ 0, 0, 2100, 1890 }, 2100, 1890, 1400, 1260), { 0, 0, 3000, 2700 });
+            expect("map: sharpen", map({ 1400, 10, 1000, 900 }, 2800, 1260, 1400, 1260, false), { 1400, 10, 1000, 900 });
+        }
+
+        return result;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (argc == 9 && std::string(argv[1]) == "--map")
+    {
+        return Map(argv + 2);
+    }
+    if (argc == 2 && std::string(argv[1]) == "--check")
+    {
+        return Check();
+    }
+
+    std::fprintf(stderr, "Usage: %s --map <texture width>x<texture height> <render width>x<render height> <display width>x<display height> <x> <y> <width> <height>\n", argv[0]);
+    std::fprintf(stderr, "       %s --check\n", argv[0]);
+    return 1;
+}
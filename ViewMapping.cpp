@@ -0,0 +1,86 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// This file does not use the precompiled header, so it can be shared with the tools.
+
+#include "ViewMapping.h"
+
+#include <algorithm>
+
+namespace
+{
+    // value * numerator / denominator, rounded to the nearest integer.
+    uint32_t Scale(const uint32_t value, const uint32_t numerator, const uint32_t denominator)
+    {
+        return (uint32_t)(((uint64_t)value * numerator + denominator / 2) / denominator);
+    }
+
+    void MapRange(const uint32_t inputStart,
+                  const uint32_t inputExtent,
+                  const uint32_t inputSize,
+                  const uint32_t outputSize,
+                  uint32_t& outputStart,
+                  uint32_t& outputExtent)
+    {
+        outputStart = (std::min)(Scale(inputStart, outputSize, inputSize), outputSize - 1);
+        outputExtent = std::clamp(Scale(inputExtent, outputSize, inputSize), 1u, outputSize - outputStart);
+    }
+}
+
+namespace nis_scaler
+{
+    uint32_t GetOutputTextureSize(const uint32_t appSize, const uint32_t renderSize, const uint32_t displaySize)
+    {
+        if (appSize == renderSize || !renderSize)
+        {
+            return displaySize;
+        }
+        return (std::max)(Scale(appSize, displaySize, renderSize), 1u);
+    }
+
+    NISViewport ClampViewport(const int32_t x,
+                              const int32_t y,
+                              const int32_t width,
+                              const int32_t height,
+                              const uint32_t textureWidth,
+                              const uint32_t textureHeight)
+    {
+        NISViewport viewport;
+        viewport.x = (uint32_t)std::clamp(x, 0, (int32_t)textureWidth - 1);
+        viewport.y = (uint32_t)std::clamp(y, 0, (int32_t)textureHeight - 1);
+        viewport.width = (uint32_t)std::clamp(width, 1, (int32_t)(textureWidth - viewport.x));
+        viewport.height = (uint32_t)std::clamp(height, 1, (int32_t)(textureHeight - viewport.y));
+        return viewport;
+    }
+
+    NISViewport MapOutputViewport(const NISViewport& inputViewport,
+                                  const uint32_t inputWidth,
+                                  const uint32_t inputHeight,
+                                  const uint32_t outputWidth,
+                                  const uint32_t outputHeight,
+                                  const bool isUpscaling)
+    {
+        if (!isUpscaling)
+        {
+            return inputViewport;
+        }
+
+        NISViewport outputViewport;
+        MapRange(inputViewport.x, inputViewport.width, inputWidth, outputWidth, outputViewport.x, outputViewport.width);
+        MapRange(inputViewport.y, inputViewport.height, inputHeight, outputHeight, outputViewport.y, outputViewport.height);
+        return outputViewport;
+    }
+}
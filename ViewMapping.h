@@ -0,0 +1,55 @@
+// Copyright (c) 2021, Matthieu Bucchianeri
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+
+namespace nis_scaler
+{
+    // A region of a texture (in pixels).
+    struct NISViewport
+    {
+        uint32_t x;
+        uint32_t y;
+        uint32_t width;
+        uint32_t height;
+
+        bool operator==(const NISViewport& other) const
+        {
+            return x == other.x && y == other.y && width == other.width && height == other.height;
+        }
+    };
+
+    // The size of the runtime texture for a texture of the application, in one dimension. The application renders its
+    // views at renderSize instead of displaySize, and its texture may hold several views (texture atlas) or be sized
+    // differently: the runtime texture keeps the same proportion. A texture of exactly renderSize maps to displaySize.
+    uint32_t GetOutputTextureSize(uint32_t appSize, uint32_t renderSize, uint32_t displaySize);
+
+    // Clamp the region submitted by the application (imageRect) to its texture. The region keeps at least one pixel.
+    NISViewport ClampViewport(int32_t x, int32_t y, int32_t width, int32_t height, uint32_t textureWidth, uint32_t textureHeight);
+
+    // The region of the output texture for a region of the input texture. When sharpening, the region is processed in
+    // place. When upscaling, the origin and the size are both mapped with the proportion of the textures, so that the
+    // views of an atlas never overlap, even when they are rendered to a part of their cells or packed at a lower
+    // resolution (dynamic resolution). The region is clamped to the output texture.
+    NISViewport MapOutputViewport(const NISViewport& inputViewport,
+                                  uint32_t inputWidth,
+                                  uint32_t inputHeight,
+                                  uint32_t outputWidth,
+                                  uint32_t outputHeight,
+                                  bool isUpscaling);
+}
@@ -17,15 +17,36 @@
 #include "pch.h"
 
 #include <DeviceResources.h>
-#include <BilinearUpscale.h>
-#include <NVScaler.h>
-#include <NVSharpen.h>
+
+#include "BilinearRenderer.h"
+#include "Capture.h"
+#include "ColorFormats.h"
+#include "Config.h"
+#include "DepthRenderer.h"
+#include "DynamicResolution.h"
+#include "Foveation.h"
+#include "FrameArena.h"
+#include "FrameSubmission.h"
+#include "HandleTable.h"
+#include "Input.h"
+#include "Log.h"
+#include "MsaaResolve.h"
+#include "NISAutotune.h"
+#include "NISRenderer.h"
+#include "ProfileDatabase.h"
+#include "ScalerKeys.h"
+#include "Screenshot.h"
+#include "ShaderCompiler.h"
+#include "SharedCache.h"
+#include "Statistics.h"
+#include "Telemetry.h"
 
 #define STRINGIFY(s) XSTRINGIFY(s)
 #define XSTRINGIFY(s) #s
 
 namespace {
     using Microsoft::WRL::ComPtr;
+    using namespace nis_scaler;
 
     // Update in Form1.cs if needed.
     const std::string RegPrefix = "SOFTWARE\\OpenXR_NIS_Scaler";
@@ -33,46 +54,93 @@ namespace {
     const std::string LayerName = "XR_APILAYER_NOVENDOR_nis_scaler";
     const std::string VersionString = "Beta-1";
 
+    // The viewport covers the region to write, and kSourceRect is the region to read (origin and size, normalized to the
+    // source texture). Flat upscaling of a multisampled swapchain reads the nearest texel of the slice kSlice, resolved
+    // from its samples.
     const std::string colorConversionShadersSource = R"_(
-Texture2D srcTex;
+cbuffer cb : register(b0)
+{
+    float4 kSourceRect;
+    uint kSlice;
+    uint kSampleCount;
+    float4 kSampleWeights[4];
+};
+
+Texture2D srcTex : register(t0);
+Texture2DMSArray<float4> srcTexMS : register(t1);
 SamplerState srcSampler;
 
 void vsMain(in uint id : SV_VertexID, out float4 position : SV_Position, out float2 texcoord : TEXCOORD0)
 {
-    texcoord = float2((id == 1) ? 2.0 : 0.0, (id == 2) ? 2.0 : 0.0);
-    position = float4(texcoord * float2(2.0, -2.0) + float2(-1.0, 1.0), 0.0, 1.0);
+    const float2 corner = float2((id == 1) ? 2.0 : 0.0, (id == 2) ? 2.0 : 0.0);
+    texcoord = kSourceRect.xy + corner * kSourceRect.zw;
+    position = float4(corner * float2(2.0, -2.0) + float2(-1.0, 1.0), 0.0, 1.0);
 }
 
 float4 psMain(in float4 position : SV_POSITION, in float2 texcoord : TEXCOORD0) : SV_TARGET {
 	return srcTex.Sample(srcSampler, texcoord);
 }
+
+float4 psMainMS(in float4 position : SV_POSITION, in float2 texcoord : TEXCOORD0) : SV_TARGET {
+    uint width, height, elements, samples;
+    srcTexMS.GetDimensions(width, height, elements, samples);
+    const int2 texel = clamp(int2(texcoord * float2(width, height)), int2(0, 0), int2(width - 1, height - 1));
+
+    float4 color = 0;
+    for (uint i = 0; i < kSampleCount; i++)
+    {
+        color += kSampleWeights[i / 4][i % 4] * srcTexMS.Load(int3(texel, kSlice), i);
+    }
+    return color;
+}
     )_";
 
+    // The constants of the color conversion shaders, with the layout of their cbuffer.
+    struct ColorConversionConstants
+    {
+        float sourceRect[4];
+        uint32_t slice;
+        uint32_t sampleCount;
+        uint32_t padding[2];
+        float sampleWeights[MaxSampleCount];
+    };
+
 
     // The path where the DLL loads config files and stores logs.
     std::string dllHome;
+    bool isLogging = false;
 
     // The path to find the NIS shader source.
     std::string nisShaderHome;
 
-    // The file logger.
-    std::ofstream logStream;
+    // The compiled shaders, persisted across sessions and applications.
+    std::unique_ptr<ShaderCache> shaderCache;
+
+    // The GPU of the current session, and the parameters of the NIS shader measured for each GPU.
+    NISAdapterInfo adapterInfo;
+    NISTuningDatabase tuningDatabase;
 
     // Function pointers to chain calls with the next layers and/or the OpenXR runtime.
     PFN_xrGetInstanceProcAddr next_xrGetInstanceProcAddr = nullptr;
+    PFN_xrGetSystem next_xrGetSystem = nullptr;
     PFN_xrEnumerateViewConfigurationViews next_xrEnumerateViewConfigurationViews = nullptr;
     PFN_xrEnumerateSwapchainFormats next_xrEnumerateSwapchainFormats = nullptr;
+    PFN_xrDestroyInstance next_xrDestroyInstance = nullptr;
     PFN_xrCreateSession next_xrCreateSession = nullptr;
     PFN_xrDestroySession next_xrDestroySession = nullptr;
     PFN_xrCreateSwapchain next_xrCreateSwapchain = nullptr;
     PFN_xrDestroySwapchain next_xrDestroySwapchain = nullptr;
     PFN_xrEnumerateSwapchainImages next_xrEnumerateSwapchainImages = nullptr;
     PFN_xrAcquireSwapchainImage next_xrAcquireSwapchainImage = nullptr;
+    PFN_xrBeginFrame next_xrBeginFrame = nullptr;
     PFN_xrEndFrame next_xrEndFrame = nullptr;
 
-    // Device state.
+    // Device state. The application renders its views at the recommended resolution, picked before the swapchains are
+    // created.
     uint32_t actualDisplayWidth;
     uint32_t actualDisplayHeight;
+    uint32_t recommendedRenderWidth;
+    uint32_t recommendedRenderHeight;
     ID3D11Device* d3d11Device = nullptr;
     DeviceResources deviceResources;
 
@@ -81,14 +149,19 @@ float4 psMain(in float4 position : SV_POSITION, in float2 texcoord : TEXCOORD0)
     bool needBindUnorderedAccessWorkaround = false;
     struct SwapchainImageResources
     {
-        // Resources needed by the scaler.
-        ComPtr<ID3D11UnorderedAccessView> upscaledTextureUav[2];
+        // Resources needed by the scaler. The array views cover all the slices, for the scalers processing several views
+        // with a single dispatch.
+        ComPtr<ID3D11UnorderedAccessView> upscaledTextureArrayUav;
         ComPtr<ID3D11Texture2D> appTexture;
         ComPtr<ID3D11ShaderResourceView> appTextureSrv[2];
+        ComPtr<ID3D11ShaderResourceView> appTextureArraySrv;
 
         // Resources needed for flat upscaling and color conversion.
         ComPtr<ID3D11RenderTargetView> runtimeTextureRtv[2];
 
+        // Resources needed for depth upscaling. The depth is read through appTextureSrv.
+        ComPtr<ID3D11DepthStencilView> runtimeTextureDsv[2];
+
         // The original texture returned by OpenXR.
         ID3D11Texture2D* runtimeTexture;
     };
@@ -97,17 +170,65 @@ float4 psMain(in float4 position : SV_POSITION, in float2 texcoord : TEXCOORD0)
         ComPtr<ID3D11Query> timeStampDis;
         ComPtr<ID3D11Query> timeStampStart;
         ComPtr<ID3D11Query> timeStampEnd;
-        bool valid;
     };
+    // The number of timer samples in flight. Samples are read back when they reach the end of the ring, several frames
+    // after being issued, so that we never wait on the GPU.
+    const size_t GpuTimerLatency = 8;
+    struct GpuTimerRing
+    {
+        PendingRing<GpuTimer, GpuTimerLatency> ring;
+        bool valid{ false };
+    };
+    // Screenshots are copied to a staging texture, then read back several frames later (so that we never wait on the
+    // GPU) and written by a worker thread.
+    struct ScreenshotCapture
+    {
+        ComPtr<ID3D11Texture2D> stagingTexture;
+        CapturedImage image;
+    };
+    const size_t ScreenshotLatency = 3;
+    PendingRing<ScreenshotCapture, ScreenshotLatency> screenshots;
+    ScreenshotWriter screenshotWriter;
+    // Burst captures go through the same staging readback, with one ring per stage (so that the staging textures keep
+    // the same size) holding both views of each frame in flight. The container file is written by a worker thread.
+    struct FrameCapture
+    {
+        ComPtr<ID3D11Texture2D> stagingTexture;
+        CaptureFrameRecord record;
+    };
+    const size_t CaptureLatency = 3;
+    const size_t CaptureMaxPendingBytes = 512 * 1024 * 1024;
+    PendingRing<FrameCapture, 2 * CaptureLatency> frameCaptures[(size_t)CaptureStage::EnumMax];
+    CaptureWriter captureWriter;
+
     struct ScalerResources
     {
         // The swapchain info as requested by the application.
         XrSwapchainCreateInfo swapchainInfo;
 
-        // Scaler processors. Either NISScaler or NISSharpen will be used based on the requested scaling (not both).
-        std::shared_ptr<BilinearUpscale> bilinearScaler;
-        std::shared_ptr<NVScaler> NISScaler;
-        std::shared_ptr<NVSharpen> NISSharpen;
+        // The size of the runtime textures (see GetOutputTextureSize()).
+        uint32_t outputWidth;
+        uint32_t outputHeight;
+        bool isUpscaling;
+
+        // Scaler processors. NISScaler either upscales or only sharpens based on the requested scaling. With foveated
+        // scaling, peripheryScaler fills the output around the region processed by NISScaler. peripheryScaler is also
+        // the bilinear scaler, so that both honor the region rendered by the application. Depth swapchains only have a
+        // depthScaler.
+        std::shared_ptr<NISRenderer> NISScaler;
+        std::shared_ptr<BilinearRenderer> peripheryScaler;
+        std::shared_ptr<DepthRenderer> depthScaler;
+
+        // Multisampled swapchains are resolved while they are read by NISScaler, peripheryScaler and flat upscaling (with
+        // sampleWeights), without a resolved copy of the application's texture.
+        bool useStandardSamplePattern{ false };
+        float sampleWeights[MaxSampleCount]{};
+
+        // When the runtime textures can be written by the scalers (in the format of the swapchain, in the intermediate
+        // format, or through a UNORM alias of their sRGB format), there is no color conversion pass. The scalers always
+        // read linear values from the application's texture: with the alias, they encode them to sRGB when they write.
+        bool needColorConversion{ false };
+        bool isSrgbAliased{ false };
 
         // Common resources for color conversion mode.
         ComPtr<ID3D11Texture2D> intermediateTexture;
@@ -116,19 +237,54 @@ float4 psMain(in float4 position : SV_POSITION, in float2 texcoord : TEXCOORD0)
         // The resources for each swapchain image.
         std::vector<SwapchainImageResources> imageResources;
 
+        // The index of the image last acquired by the application.
+        uint32_t acquiredImageIndex{ 0 };
+
         // GPU timers.
-        mutable GpuTimer scalerTimer;
-        mutable GpuTimer colorConversionTimer;
+        mutable GpuTimerRing scalerTimer;
+        mutable GpuTimerRing colorConversionTimer;
     };
-    std::map<XrSwapchain, ScalerResources> scalerResources;
-    std::map<XrSwapchain, uint32_t> swapchainIndices;
+    HandleTable<XrSwapchain, ScalerResources> scalerResources;
+
+    // A view of a projection layer being processed in xrEndFrame().
+    struct ScaledView
+    {
+        const ScalerResources* resources;
+        const SwapchainImageResources* imageResources;
+        uint32_t slice;
+        NISViewport inputViewport;
+        NISViewport outputViewport;
+        bool isFoveated;
+        FoveatedRegion region;
+    };
+
+    // The scalers are shared by the swapchains with the same settings, typically one swapchain per eye (see ScalerKeys.h
+    // for the keys).
+    SharedCache<NISScalerKey<ID3D11Device>, NISRenderer> sharedNISScalers;
+    SharedCache<BilinearScalerKey<ID3D11Device>, BilinearRenderer> sharedPeripheryScalers;
+    SharedCache<DepthScalerKey<ID3D11Device>, DepthRenderer> sharedDepthScalers;
+
+    // The GPU time of the application's rendering, measured from xrBeginFrame() to xrEndFrame().
+    GpuTimerRing appTimer;
+    bool isAppTimerStarted = false;
+
+    // Dynamic resolution state. The scale is applied to the views submitted after it is picked. The scaler and color
+    // conversion timers are sampled once per batch of views, and the samples issued by the last frame are counted.
+    DynamicResolutionController dynamicResolution;
+    float renderScale = 1.f;
+    uint32_t lastFrameScalerSamples = 0;
+    uint32_t lastFrameColorConversionSamples = 0;
 
     // Common resources for indirect color conversion mode.
     ComPtr<ID3D11VertexShader> colorConversionVertexShader;
     ComPtr<ID3D11PixelShader> colorConversionPixelShader;
+    ComPtr<ID3D11PixelShader> colorConversionPixelShaderMS;
+    ComPtr<ID3D11Buffer> colorConversionConstantBuffer;
     ComPtr<ID3D11SamplerState> colorConversionSampler;
     ComPtr<ID3D11RasterizerState> colorConversionRasterizer;
-    ComPtr<ID3D11RasterizerState> colorConversionRasterizerMSAA;
+
+    // Storage for the copy of the frame submission that we forward to the runtime.
+    FrameArena frameArena;
 
     // Statistics.
     const uint64_t StatsPeriodMs = 60000;
@@ -137,20 +293,36 @@ float4 psMain(in float4 position : SV_POSITION, in float2 texcoord : TEXCOORD0)
         uint64_t windowBeginning;
         uint64_t nextWindow;
 
-        uint64_t totalScalerTime;
-        uint64_t totalColorConversionTime;
+        // GPU times (in microseconds).
+        LatencyHistogram scalerTime;
+        LatencyHistogram colorConversionTime;
+        LatencyHistogram appGpuTime;
+        uint64_t droppedSamples;
+
+        // Most recent GPU times (in microseconds), for telemetry and dynamic resolution.
+        uint64_t lastScalerTime;
+        uint64_t lastColorConversionTime;
+        uint64_t lastAppGpuTime;
 
         uint32_t numFrames;
 
         void Reset()
         {
-            totalScalerTime = totalColorConversionTime = 0;
+            scalerTime.reset();
+            colorConversionTime.reset();
+            appGpuTime.reset();
+            droppedSamples = 0;
             numFrames = 0;
         }
     };
     Statistics stats;
 
+    // Per-frame telemetry for external tools.
+    TelemetryWriter telemetry;
+    uint64_t frameIndex = 0;
+
     // Interactive state (for use with hotkeys).
+    InputPoller inputPoller;
     enum ScalingMode
     {
         Flat = 0,
@@ -160,325 +332,712 @@ float4 psMain(in float4 position : SV_POSITION, in float2 texcoord : TEXCOORD0)
     } scalingMode;
     float newSharpness;
     bool takeScreenshot = false;
+    uint32_t captureFramesRemaining = 0;
+    uint64_t captureFrameIndex = 0;
+    bool isCapturing = false;
+
+    Config config;
 
-    void Log(const char* fmt, ...);
+    // Configuration changes made while the application is running.
+    ConfigWatcher configWatcher;
+    uint32_t appliedRevision = 0;
 
-    struct {
-        bool loaded;
-        std::string name;
-        float scaleFactor;
-        float sharpness;
-        bool disableBilinearScaler;
-        DXGI_FORMAT intermediateFormat;
-        bool fastContextSwitch;
-        bool enableStats;
-        bool enableScreenshots;
+    // The profiles may depend on the system, which is only known once the application calls xrGetSystem(). Until then,
+    // our calls are intercepted but the layer stays inactive (config.loaded is false).
+    bool isProfileMatchPending = false;
+    std::string profileDatabasePath;
+    std::string applicationName;
+    bool isD3D11Enabled = false;
 
-        void Dump()
+    // Load configuration for our layer.
+    bool LoadConfiguration(
+        ConfigSource& source,
+        const std::string configName)
+    {
+        config.Reset();
+
+        return source.load(configName, config);
+    }
+
+    // Identify the GPU and the display resolution of the system picked by the application, for the profiles that depend
+    // on them. This is a best effort: the properties that cannot be queried are left unknown.
+    ProfileQuery DescribeSystem(
+        const XrInstance instance,
+        const XrSystemId systemId)
+    {
+        ProfileQuery query;
+        query.application = applicationName;
+
+        PFN_xrEnumerateViewConfigurationViews xrEnumerateViewConfigurationViews;
+        XrViewConfigurationView views[2] = { { XR_TYPE_VIEW_CONFIGURATION_VIEW }, { XR_TYPE_VIEW_CONFIGURATION_VIEW } };
+        uint32_t viewCount;
+        if (next_xrGetInstanceProcAddr(instance, "xrEnumerateViewConfigurationViews", reinterpret_cast<PFN_xrVoidFunction*>(&xrEnumerateViewConfigurationViews)) == XR_SUCCESS &&
+            xrEnumerateViewConfigurationViews(instance, systemId, XR_VIEW_CONFIGURATION_TYPE_PRIMARY_STEREO, 2, &viewCount, views) == XR_SUCCESS)
+        {
+            query.width = views[0].recommendedImageRectWidth;
+            query.height = views[0].recommendedImageRectHeight;
+        }
+
+        // The adapter can only be queried when the application enabled D3D11 support.
+        PFN_xrGetD3D11GraphicsRequirementsKHR xrGetD3D11GraphicsRequirementsKHR;
+        XrGraphicsRequirementsD3D11KHR requirements = { XR_TYPE_GRAPHICS_REQUIREMENTS_D3D11_KHR };
+        ComPtr<IDXGIFactory1> dxgiFactory;
+        if (isD3D11Enabled &&
+            next_xrGetInstanceProcAddr(instance, "xrGetD3D11GraphicsRequirementsKHR", reinterpret_cast<PFN_xrVoidFunction*>(&xrGetD3D11GraphicsRequirementsKHR)) == XR_SUCCESS &&
+            xrGetD3D11GraphicsRequirementsKHR(instance, systemId, &requirements) == XR_SUCCESS &&
+            SUCCEEDED(CreateDXGIFactory1(__uuidof(IDXGIFactory1), reinterpret_cast<void**>(dxgiFactory.GetAddressOf()))))
         {
-            if (loaded)
+            ComPtr<IDXGIAdapter1> adapter;
+            for (UINT i = 0; dxgiFactory->EnumAdapters1(i, adapter.ReleaseAndGetAddressOf()) == S_OK; i++)
             {
-                const bool isDebugBuild =
-#ifdef _DEBUG
-                    true;
-#else
-                    false;
-#endif
-                if (isDebugBuild || config.enableStats)
+                DXGI_ADAPTER_DESC1 desc;
+                if (SUCCEEDED(adapter->GetDesc1(&desc)) && !memcmp(&desc.AdapterLuid, &requirements.adapterLuid, sizeof(LUID)))
                 {
-                    Log("!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!\n");
-                    Log("!!! USING DEBUG SETTINGS - PERFORMANCE WILL BE DECREASED             !!!\n");
-                    Log("!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!\n");
+                    const std::wstring wadapterDescription(desc.Description);
+                    std::transform(wadapterDescription.begin(), wadapterDescription.end(), std::back_inserter(query.gpu), [](wchar_t c) { return (char)c; });
+                    query.vendorId = desc.VendorId;
+                    break;
                 }
+            }
+        }
 
-                Log("Using intermediate format: %d\n", intermediateFormat);
-                if (config.fastContextSwitch)
-                {
-                    Log("Using fast context switch\n");
-                }
-                if (scaleFactor < 1.f)
-                {
-                    Log("Use scaling factor: %.3f\n", scaleFactor);
-                }
-                else
+        Log("Matching profiles for adapter \"%s\" (vendor 0x%x) and resolution %ux%u\n", query.gpu.c_str(), query.vendorId, query.width, query.height);
+
+        return query;
+    }
+
+    // Match the profiles against the system picked by the application, and load our configuration. This happens once,
+    // before the application creates its session.
+    void ResolveProfiles(
+        const XrInstance instance,
+        const XrSystemId systemId)
+    {
+        if (!isProfileMatchPending)
+        {
+            return;
+        }
+        isProfileMatchPending = false;
+
+        auto configSource = std::make_unique<ProfileConfigSource>(profileDatabasePath, DescribeSystem(instance, systemId));
+        LoadConfiguration(*configSource, applicationName);
+        config.Dump();
+
+        // Watch for changes made to the database.
+        if (config.loaded)
+        {
+            configWatcher.start(std::move(configSource), config);
+            appliedRevision = configWatcher.latest()->revision;
+        }
+    }
+
+    // The dynamic resolution settings from the configuration. The highest scale is the scale the swapchains are sized for.
+    DynamicResolutionSettings DescribeDynamicResolution()
+    {
+        DynamicResolutionSettings settings;
+        settings.minScale = (std::min)(config.minScaleFactor, config.scaleFactor);
+        settings.maxScale = config.scaleFactor;
+        settings.targetFrameTime = config.targetFrameTime;
+        return settings;
+    }
+
+    // The center region of a view for foveated scaling. The offset is towards the nose, so it is mirrored for the right
+    // eye (the odd views).
+    FoveationSettings DescribeFoveation(const uint32_t viewIndex)
+    {
+        FoveationSettings settings;
+        settings.centerX = 0.5f + (viewIndex % 2 ? -config.foveatedOffsetX : config.foveatedOffsetX);
+        settings.centerY = 0.5f + config.foveatedOffsetY;
+        settings.radius = config.foveatedRadius;
+        return settings;
+    }
+
+    // Pick the parameters of the NIS shader for the GPU: the result of a previous autotuning, or a new autotuning when
+    // enabled, or the defaults for the GPU family.
+    NISVariant PickNISVariant(const bool isUpscaling, const uint32_t inputWidth, const uint32_t inputHeight, const uint32_t outputWidth, const uint32_t outputHeight)
+    {
+        NISVariant variant;
+        if (tuningDatabase.find(adapterInfo, isUpscaling, variant))
+        {
+            Log("Using tuned NIS variant %s\n", variant.describe().c_str());
+            return variant;
+        }
+
+        if (config.nisAutotune)
+        {
+            Log("Timing the NIS variants for driver %s at %ux%u -> %ux%u\n", DescribeDriverVersion(adapterInfo.driverVersion).c_str(), inputWidth, inputHeight, outputWidth, outputHeight);
+            std::vector<NISVariantTiming> timings;
+            try
+            {
+                timings = TimeNISVariants(deviceResources, nisShaderHome, shaderCache.get(), isUpscaling, GetNISCandidateVariants(adapterInfo, isUpscaling), inputWidth, inputHeight, outputWidth, outputHeight);
+            }
+            catch (std::runtime_error exc)
+            {
+                Log("Error: %s\n", exc.what());
+            }
+            for (const NISVariantTiming& timing : timings)
+            {
+                const float minTime = timing.samples.empty() ? 0.f : *std::min_element(timing.samples.begin(), timing.samples.end());
+                Log("  %s: %zu samples, best %.1fus\n", timing.variant.describe().c_str(), timing.samples.size(), minTime);
+            }
+
+            float medianTime;
+            if (SelectNISVariant(timings, variant, medianTime))
+            {
+                tuningDatabase.store(adapterInfo, isUpscaling, variant, medianTime);
+                if (!tuningDatabase.save())
                 {
-                    Log("No scaling, sharpening only\n");
+                    Log("Failed to save the NIS tuning results\n");
                 }
-                Log("Sharpness set to %.3f\n", sharpness);
+                Log("Using tuned NIS variant %s (%.1fus)\n", variant.describe().c_str(), medianTime);
+                return variant;
             }
+            Log("Failed to time the NIS variants\n");
         }
 
-        void Reset()
+        variant = GetDefaultNISVariant(adapterInfo, isUpscaling);
+        Log("Using default NIS variant %s for %s GPU\n", variant.describe().c_str(), GetNISGpuFamily(adapterInfo));
+        return variant;
+    }
+
+    // Pick up the settings that can change while frames are being submitted. Called at the beginning of xrEndFrame().
+    void ApplyConfigurationChanges()
+    {
+        const Config* const latest = configWatcher.latest();
+        if (!latest || latest->revision == appliedRevision)
+        {
+            return;
+        }
+        appliedRevision = latest->revision;
+
+        Log("Configuration changed\n");
+
+        // The new sharpness is applied to the scalers like with the hotkeys.
+        newSharpness = latest->sharpness;
+        config.disableBilinearScaler = latest->disableBilinearScaler;
+        if (config.disableBilinearScaler && scalingMode == ScalingMode::Bilinear)
+        {
+            scalingMode = ScalingMode::NIS;
+        }
+        config.fastContextSwitch = latest->fastContextSwitch;
+        config.foveatedRadius = latest->foveatedRadius;
+        config.foveatedOffsetX = latest->foveatedOffsetX;
+        config.foveatedOffsetY = latest->foveatedOffsetY;
+        config.enableScreenshots = latest->enableScreenshots;
+        config.screenshotFormat = latest->screenshotFormat;
+
+        // The bounds of dynamic resolution can be tuned while it is running (but the highest scale is the size of the
+        // swapchains).
+        config.minScaleFactor = latest->minScaleFactor;
+        config.targetFrameTime = latest->targetFrameTime;
+        dynamicResolution.configure(DescribeDynamicResolution());
+
+        // The other settings require new resources: they are applied at the next safe point (see
+        // xrEnumerateViewConfigurationViews() and xrCreateSession()).
+        if (latest->scaleFactor != config.scaleFactor || latest->dynamicResolution != config.dynamicResolution ||
+            latest->intermediateFormat != config.intermediateFormat || latest->enableStats != config.enableStats ||
+            latest->enableTelemetry != config.enableTelemetry || latest->msaaResolveFilter != config.msaaResolveFilter)
         {
-            loaded = false;
-            name = "";
-            scaleFactor = 0.7f;
-            sharpness = 0.5f;
-            disableBilinearScaler = true;
-            intermediateFormat = DXGI_FORMAT_R16G16B16A16_UNORM;
-            fastContextSwitch = true;
-            enableStats = false;
-            enableScreenshots = false;
-        }
-    } config;
-
-    // Utility logging function.
-    void InternalLog(
-        const char* fmt,
-        va_list va)
+            Log("Some settings will only apply to the next session\n");
+        }
+    }
+
+    // Start recording the next frames. The capture ends by itself after the configured number of frames.
+    void StartCapture()
     {
-        const std::time_t now = std::time(nullptr);
+        if (isCapturing)
+        {
+            return;
+        }
 
-        char buf[1024];
-        size_t offset = std::strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S %z: ", std::localtime(&now));
-        _vsnprintf_s(buf + offset, sizeof(buf) - offset, sizeof(buf) - offset, fmt, va);
-        OutputDebugStringA(buf);
-        if (logStream.is_open())
+        const std::string captureFilename = CaptureFileName(config.name, std::time(nullptr));
+        const std::string capturePath = (std::filesystem::path(getenv("LOCALAPPDATA")) / captureFilename).string();
+        if (!captureWriter.open(capturePath, config.name, CaptureMaxPendingBytes))
         {
-            logStream << buf;
-            logStream.flush();
+            Log("Cannot start a capture while the previous one is still being written\n");
+            return;
         }
+
+        Log("Capturing %u frames to %s\n", config.captureFrames, capturePath.c_str());
+        captureFramesRemaining = config.captureFrames;
+        captureFrameIndex = 0;
+        isCapturing = true;
     }
 
-    // General logging function.
-    void Log(
-        const char* fmt,
-        ...)
+    // Apply the commands from the keyboard shortcuts. The keyboard is polled on the input thread.
+    void HandleHotkeys()
     {
-        va_list va;
-        va_start(va, fmt);
-        InternalLog(fmt, va);
-        va_end(va);
+        HotkeyCommand command;
+        while (inputPoller.pop(command))
+        {
+            switch (command)
+            {
+            case HotkeyCommand::CycleScalingMode:
+                do
+                {
+                    scalingMode = (ScalingMode)((scalingMode + 1) % ScalingMode::EnumMax);
+                } while (config.disableBilinearScaler && scalingMode == ScalingMode::Bilinear);
+                break;
+
+            case HotkeyCommand::DecreaseSharpness:
+                newSharpness = max(0.f, newSharpness - 0.05f);
+                Log("sharpness=%.3f\n", newSharpness);
+                break;
+
+            case HotkeyCommand::IncreaseSharpness:
+                newSharpness = min(1.f, newSharpness + 0.05f);
+                Log("sharpness=%.3f\n", newSharpness);
+                break;
+
+            case HotkeyCommand::Screenshot:
+                takeScreenshot = config.enableScreenshots;
+                break;
+
+            case HotkeyCommand::BurstCapture:
+                if (config.enableScreenshots)
+                {
+                    StartCapture();
+                }
+                break;
+
+            default:
+                break;
+            }
+        }
     }
 
-    // Debug logging function. Can make things very slow (only enabled on Debug builds).
-    void DebugLog(
-        const char* fmt,
-        ...)
+    // Returns whether a texture format is directly supported by the scalers (see ColorFormats.h).
+    bool IsSupportedColorFormat(
+        const DXGI_FORMAT format)
     {
-#ifdef _DEBUG
-        va_list va;
-        va_start(va, fmt);
-        InternalLog(fmt, va);
-        va_end(va);
-#endif
+        const ColorFormatInfo* const info = GetColorFormatInfo(format);
+        return info && info->scalerSupport == ScalerSupport::Direct;
     }
 
-    // https://docs.microsoft.com/en-us/archive/msdn-magazine/2017/may/c-use-modern-c-to-access-the-windows-registry
-    int RegGetDword(
-        HKEY hKey,
-        const std::wstring& subKey,
-        const std::wstring& value,
-        DWORD defaultValue)
+    // Returns whether a texture format is indirectly supported by the scalers.
+    // Indirectly means that we implement a conversion path from this format to a supported format.
+    bool IsIndirectlySupportedColorFormat(
+        const DXGI_FORMAT format)
     {
-        DWORD data{};
-        DWORD dataSize = sizeof(data);
-        LONG retCode = ::RegGetValue(
-            hKey,
-            subKey.c_str(),
-            value.c_str(),
-            RRF_RT_REG_DWORD,
-            nullptr,
-            &data,
-            &dataSize);
-        if (retCode != ERROR_SUCCESS)
-        {
-            return defaultValue;
-        }
-        return data;
+        const ColorFormatInfo* const info = GetColorFormatInfo(format);
+        return info && info->scalerSupport == ScalerSupport::Indirect;
     }
 
-    // Load configuration for our layer.
-    bool LoadConfiguration(
-        const std::string configName)
+    // Returns whether the scalers can write to a texture through a UAV of this format.
+    bool IsTypedUnorderedAccessSupported(
+        ID3D11Device* const device,
+        const DXGI_FORMAT format)
     {
-        config.Reset();
+        UINT support = 0;
+        return SUCCEEDED(device->CheckFormatSupport(format, &support)) && (support & D3D11_FORMAT_SUPPORT_TYPED_UNORDERED_ACCESS_VIEW);
+    }
 
-        if (configName.empty())
+    // Returns whether a depth format is supported by our layer, with the typeless format of the texture that the
+    // application renders to (so that it can also be read by the depth scaler) and the format to read it with.
+    bool GetDepthTextureFormats(
+        const DXGI_FORMAT format,
+        DXGI_FORMAT& typelessFormat,
+        DXGI_FORMAT& shaderResourceFormat)
+    {
+        switch (format)
         {
+        case DXGI_FORMAT_D32_FLOAT:
+            typelessFormat = DXGI_FORMAT_R32_TYPELESS;
+            shaderResourceFormat = DXGI_FORMAT_R32_FLOAT;
+            return true;
+        case DXGI_FORMAT_D24_UNORM_S8_UINT:
+            typelessFormat = DXGI_FORMAT_R24G8_TYPELESS;
+            shaderResourceFormat = DXGI_FORMAT_R24_UNORM_X8_TYPELESS;
+            return true;
+        case DXGI_FORMAT_D16_UNORM:
+            typelessFormat = DXGI_FORMAT_R16_TYPELESS;
+            shaderResourceFormat = DXGI_FORMAT_R16_UNORM;
+            return true;
+        case DXGI_FORMAT_D32_FLOAT_S8X24_UINT:
+            typelessFormat = DXGI_FORMAT_R32G8X24_TYPELESS;
+            shaderResourceFormat = DXGI_FORMAT_R32_FLOAT_X8X24_TYPELESS;
+            return true;
+        default:
             return false;
         }
+    }
 
-        // Global settings.
-        const std::wstring wglobalKey = std::wstring(RegPrefix.begin(), RegPrefix.end());
+    // Returns whether a depth format is supported by our layer.
+    bool IsSupportedDepthFormat(
+        const DXGI_FORMAT format)
+    {
+        DXGI_FORMAT typelessFormat, shaderResourceFormat;
+        return GetDepthTextureFormats(format, typelessFormat, shaderResourceFormat);
+    }
 
-        // Base key for the application.
-        std::string baseKey = RegPrefix + "\\" + configName;
-        std::wstring wbaseKey = std::wstring(baseKey.begin(), baseKey.end());
-        const int isEnabledForApplication = RegGetDword(HKEY_LOCAL_MACHINE, wbaseKey, L"enabled", -1);
+    // Returns whether this swapchain is currently set up for scaling.
+    bool IsSwapchainHandled(
+        const XrSwapchain swapchain)
+    {
+        return scalerResources.find(swapchain) != nullptr;
+    }
+
+    // Returns whether the GPU timers are needed: for the statistics, for the telemetry, or to drive dynamic resolution.
+    bool IsGpuTimingEnabled()
+    {
+        return config.enableStats || config.enableTelemetry || config.dynamicResolution;
+    }
 
-        int isEnabled = isEnabledForApplication == 1;
-        if (isEnabledForApplication == -1)
+    void InitTimer(GpuTimerRing& timer)
+    {
+        D3D11_QUERY_DESC queryDesc;
+        ZeroMemory(&queryDesc, sizeof(D3D11_QUERY_DESC));
+        for (GpuTimer& slot : timer.ring.slots())
         {
-            // Try the global settings.
-            isEnabled = RegGetDword(HKEY_LOCAL_MACHINE, wglobalKey, L"enabled", 0);
-            baseKey = RegPrefix;
-            wbaseKey = wglobalKey;
+            queryDesc.Query = D3D11_QUERY_TIMESTAMP_DISJOINT;
+            DX::ThrowIfFailed(deviceResources.device()->CreateQuery(&queryDesc, slot.timeStampDis.ReleaseAndGetAddressOf()));
+            queryDesc.Query = D3D11_QUERY_TIMESTAMP;
+            DX::ThrowIfFailed(deviceResources.device()->CreateQuery(&queryDesc, slot.timeStampStart.ReleaseAndGetAddressOf()));
+            DX::ThrowIfFailed(deviceResources.device()->CreateQuery(&queryDesc, slot.timeStampEnd.ReleaseAndGetAddressOf()));
         }
+        timer.valid = true;
+    }
 
-        if (!isEnabled)
+    void StartTimer(GpuTimerRing& timer)
+    {
+        if (timer.valid)
         {
-            // We always want to display this message so the log will contain the OpenXR application name.
-            Log("Did not find settings for \"%s\"\n", configName.c_str());
+            GpuTimer& slot = timer.ring.acquire();
+            deviceResources.context()->Begin(slot.timeStampDis.Get());
+            deviceResources.context()->End(slot.timeStampStart.Get());
+        }
+    }
 
-            return false;
+    void StopTimer(GpuTimerRing& timer)
+    {
+        if (timer.valid)
+        {
+            GpuTimer& slot = timer.ring.current();
+            deviceResources.context()->End(slot.timeStampEnd.Get());
+            deviceResources.context()->End(slot.timeStampDis.Get());
+            timer.ring.commit();
         }
+    }
 
-        if (isEnabledForApplication == 1)
+    // Copy a slice of a texture into a staging texture, (re)creating the staging texture if needed.
+    bool CopyToStagingTexture(ComPtr<ID3D11Texture2D>& stagingTexture, ID3D11Texture2D* const texture, const UINT arraySlice, D3D11_TEXTURE2D_DESC& desc)
+    {
+        texture->GetDesc(&desc);
+
+        try
         {
-            Log("Loading config for \"%s\"\n", configName.c_str());
+            D3D11_TEXTURE2D_DESC stagingDesc;
+            if (stagingTexture)
+            {
+                stagingTexture->GetDesc(&stagingDesc);
+            }
+            if (!stagingTexture || stagingDesc.Width != desc.Width || stagingDesc.Height != desc.Height || stagingDesc.Format != desc.Format)
+            {
+                ZeroMemory(&stagingDesc, sizeof(D3D11_TEXTURE2D_DESC));
+                stagingDesc.Width = desc.Width;
+                stagingDesc.Height = desc.Height;
+                stagingDesc.MipLevels = 1;
+                stagingDesc.ArraySize = 1;
+                stagingDesc.Format = desc.Format;
+                stagingDesc.SampleDesc.Count = 1;
+                stagingDesc.Usage = D3D11_USAGE_STAGING;
+                stagingDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+                DX::ThrowIfFailed(deviceResources.device()->CreateTexture2D(&stagingDesc, nullptr, stagingTexture.ReleaseAndGetAddressOf()));
+            }
         }
-        else
+        catch (std::runtime_error exc)
         {
-            Log("Using global settings\n");
+            Log("Error: %s\n", exc.what());
+            return false;
         }
 
-#define LOAD_DWORD_SETTING(setting, base, key, transform)                   \
-        do {                                                                \
-            int _value = RegGetDword(HKEY_LOCAL_MACHINE, base, (key), -1);  \
-            if (_value != -1)                                               \
-            {                                                               \
-                (setting) = transform(_value);                              \
-            }                                                               \
-        } while (false)
+        deviceResources.context()->CopySubresourceRegion(stagingTexture.Get(), 0, 0, 0, 0, texture, D3D11CalcSubresource(0, arraySlice, desc.MipLevels), nullptr);
+        return true;
+    }
 
-        LOAD_DWORD_SETTING(config.scaleFactor, wbaseKey, L"scaling", [](int value) { return std::clamp(value, 0, 100) / 100.f; });
-        LOAD_DWORD_SETTING(config.sharpness, wbaseKey, L"sharpness", [](int value) { return std::clamp(value, 0, 100) / 100.f; });
-        LOAD_DWORD_SETTING(config.disableBilinearScaler, wbaseKey, L"disable_bilinear_scaler", [](int value) { return value != 0; });
-        LOAD_DWORD_SETTING(config.intermediateFormat, wbaseKey, L"intermediate_format", [](int value) { return (DXGI_FORMAT)value; });
-        LOAD_DWORD_SETTING(config.fastContextSwitch, wbaseKey, L"fast_context_switch", [](int value) { return value != 0; });
-        LOAD_DWORD_SETTING(config.enableStats, wbaseKey, L"enable_stats", [](int value) { return value != 0; });
+    // Copy the rows of a mapped staging texture (tightly packed), then unmap it.
+    void ReadBackStagingTexture(ID3D11Texture2D* const stagingTexture, const D3D11_MAPPED_SUBRESOURCE& mappedResource, const size_t rowSize, const uint32_t height, uint8_t* const pixels)
+    {
+        for (uint32_t y = 0; y < height; y++)
+        {
+            memcpy(pixels + y * rowSize, static_cast<const uint8_t*>(mappedResource.pData) + y * mappedResource.RowPitch, rowSize);
+        }
+        deviceResources.context()->Unmap(stagingTexture, 0);
+    }
 
-        LOAD_DWORD_SETTING(config.enableScreenshots, wglobalKey, L"enable_screenshots", [](int value) { return value != 0; });
+    // Queue a copy of a texture for a screenshot. The copy is read back by PollScreenshots().
+    void CaptureScreenshot(ID3D11Texture2D* const texture, const UINT arraySlice, const DXGI_FORMAT format)
+    {
+        if (!BytesPerPixel(format))
+        {
+            Log("Screenshots are not supported for format %d\n", format);
+            return;
+        }
 
-        config.name = configName;
-        config.loaded = true;
+        D3D11_TEXTURE2D_DESC desc;
+        ScreenshotCapture& capture = screenshots.acquire();
+        if (!CopyToStagingTexture(capture.stagingTexture, texture, arraySlice, desc))
+        {
+            return;
+        }
 
-        return true;
+        const ImageFileFormat fileFormat =
+            config.screenshotFormat == (uint32_t)ImageFileFormat::PNG && IsPngCompatible(format) ? ImageFileFormat::PNG : ImageFileFormat::DDS;
+        const std::string screenshotFilename =
+            ScreenshotFileName(config.name, scalingMode == ScalingMode::NIS, config.scaleFactor, config.sharpness, std::time(nullptr), fileFormat);
+        capture.image.path = (std::filesystem::path(getenv("LOCALAPPDATA")) / screenshotFilename).string();
+        capture.image.fileFormat = fileFormat;
+        capture.image.width = desc.Width;
+        capture.image.height = desc.Height;
+        capture.image.format = format;
+        screenshots.commit();
+
+        screenshotWriter.start();
     }
 
-    // Implement keyboard shortcut detection and handling.
-    void HandleHotkeys()
+    // Read back the screenshots that the GPU has finished copying, and hand them over to the writer thread.
+    void PollScreenshots()
     {
-        static bool wasF1Pressed = false;
-        const bool isF1Pressed = GetAsyncKeyState(VK_CONTROL) && (GetAsyncKeyState(VK_LEFT) || GetAsyncKeyState(VK_F1));
-        if (!wasF1Pressed && isF1Pressed)
+        while (ScreenshotCapture* const capture = screenshots.oldest())
         {
-            do
+            // Do not wait for the GPU: the copy will be retried on the next frame if it is not done yet.
+            D3D11_MAPPED_SUBRESOURCE mappedResource;
+            const HRESULT hr = deviceResources.context()->Map(capture->stagingTexture.Get(), 0, D3D11_MAP_READ, D3D11_MAP_FLAG_DO_NOT_WAIT, &mappedResource);
+            if (hr == DXGI_ERROR_WAS_STILL_DRAWING)
+            {
+                break;
+            }
+            if (FAILED(hr))
             {
-                scalingMode = (ScalingMode)((scalingMode + 1) % ScalingMode::EnumMax);
-            } while (config.disableBilinearScaler && scalingMode == ScalingMode::Bilinear);
+                Log("Failed to take screenshot: %d\n", hr);
+                screenshots.discard();
+                continue;
+            }
+
+            CapturedImage image = capture->image;
+            const size_t rowSize = (size_t)image.width * BytesPerPixel(image.format);
+            image.pixels.resize(rowSize * image.height);
+            ReadBackStagingTexture(capture->stagingTexture.Get(), mappedResource, rowSize, image.height, image.pixels.data());
+            screenshots.release();
+
+            if (!screenshotWriter.submit(std::move(image)))
+            {
+                Log("Too many screenshots pending, dropping %s\n", capture->image.path.c_str());
+            }
         }
-        wasF1Pressed = isF1Pressed;
 
-        static bool wasF2Pressed = false;
-        const bool isF2Pressed = GetAsyncKeyState(VK_CONTROL) && (GetAsyncKeyState(VK_DOWN) || GetAsyncKeyState(VK_F2));
-        if (!wasF2Pressed && isF2Pressed)
+        const uint64_t dropped = screenshots.takeDropped();
+        if (dropped)
         {
-            newSharpness = max(0.f, newSharpness - 0.05f);
-            Log("sharpness=%.3f\n", newSharpness);
+            Log("Dropped %llu screenshots\n", dropped);
         }
-        wasF2Pressed = isF2Pressed;
+    }
 
-        static bool wasF3Pressed = false;
-        const bool isF3Pressed = GetAsyncKeyState(VK_CONTROL) && (GetAsyncKeyState(VK_UP) || GetAsyncKeyState(VK_F3));
-        if (!wasF3Pressed && isF3Pressed)
+    // Queue a copy of a view for the burst capture. The copy is read back by PollCaptures().
+    void CaptureFrame(const CaptureStage stage, ID3D11Texture2D* const texture, const UINT arraySlice, const DXGI_FORMAT format, const uint32_t view, const XrTime displayTime)
+    {
+        // Multisampled textures cannot be copied to a staging texture.
+        D3D11_TEXTURE2D_DESC desc;
+        texture->GetDesc(&desc);
+        if (!BytesPerPixel(format) || desc.SampleDesc.Count > 1)
         {
-            newSharpness = min(1.f, newSharpness + 0.05f);
-            Log("sharpness=%.3f\n", newSharpness);
+            return;
         }
-        wasF3Pressed = isF3Pressed;
 
-        static bool wasF12Pressed = false;
-        const bool isF12Pressed = GetAsyncKeyState(VK_CONTROL) && GetAsyncKeyState(VK_F12);
-        if (!wasF12Pressed && isF12Pressed)
+        // The frame is read back a few frames from now: this gives the writer thread time to allocate its buffer.
+        captureWriter.reserve((size_t)desc.Width * desc.Height * BytesPerPixel(format));
+
+        // When the GPU is too far behind, this drops the oldest frame in flight instead of waiting.
+        FrameCapture& capture = frameCaptures[(size_t)stage].acquire();
+        if (!CopyToStagingTexture(capture.stagingTexture, texture, arraySlice, desc))
         {
-            takeScreenshot = config.enableScreenshots;
+            return;
         }
-        wasF12Pressed = isF12Pressed;
-    }
 
-    // Returns whether a texture format is directly supported by the NIS shader.
-    bool IsSupportedColorFormat(
-        const DXGI_FORMAT format)
-    {
-        // Want to use ID3D11Device::CheckFormatSupport() but there might not be a device. Use a list instead.
-        return format == DXGI_FORMAT_R8G8B8A8_UNORM
-            || format == DXGI_FORMAT_R8G8B8A8_UINT
-            || format == DXGI_FORMAT_R8G8B8A8_SNORM
-            || format == DXGI_FORMAT_R8G8B8A8_SINT;
+        capture.record.frameIndex = captureFrameIndex;
+        capture.record.displayTime = displayTime;
+        capture.record.view = view;
+        capture.record.stage = stage;
+        capture.record.width = desc.Width;
+        capture.record.height = desc.Height;
+        capture.record.format = format;
+        capture.record.scalingMode = scalingMode;
+        capture.record.scaleFactor = config.scaleFactor;
+        capture.record.sharpness = config.sharpness;
+        frameCaptures[(size_t)stage].commit();
     }
 
-    // Returns whether a texture format is indirectly supported by the NIS shader.
-    // Indirectly means that we implement a conversion path from this format to a supported format.
-    bool IsIndirectlySupportedColorFormat(
-        const DXGI_FORMAT format)
+    // Read back the captured frames that the GPU has finished copying, and hand them over to the writer thread.
+    void PollCaptures()
     {
-        return format == DXGI_FORMAT_R8G8B8A8_UNORM_SRGB;
-    }
+        if (!isCapturing)
+        {
+            return;
+        }
 
-    // Returns whether a depth format is supported by our layer.
-    bool IsSupportedDepthFormat(
-        const DXGI_FORMAT format)
-    {
-        // TODO: Support depth.
-        return false;
+        bool isEmpty = true;
+        for (auto& ring : frameCaptures)
+        {
+            while (FrameCapture* const capture = ring.oldest())
+            {
+                D3D11_MAPPED_SUBRESOURCE mappedResource;
+                const HRESULT hr = deviceResources.context()->Map(capture->stagingTexture.Get(), 0, D3D11_MAP_READ, D3D11_MAP_FLAG_DO_NOT_WAIT, &mappedResource);
+                if (hr == DXGI_ERROR_WAS_STILL_DRAWING)
+                {
+                    isEmpty = false;
+                    break;
+                }
+                if (FAILED(hr))
+                {
+                    ring.discard();
+                    continue;
+                }
+
+                // When the disk is not keeping up, the writer has no memory left and the frame is dropped (and counted).
+                CapturedFrame frame;
+                frame.record = capture->record;
+                const size_t rowSize = (size_t)frame.record.width * BytesPerPixel(frame.record.format);
+                if (captureWriter.allocate(rowSize * frame.record.height, frame.pixels))
+                {
+                    ReadBackStagingTexture(capture->stagingTexture.Get(), mappedResource, rowSize, frame.record.height, frame.pixels.data());
+                    captureWriter.submit(std::move(frame));
+                }
+                else
+                {
+                    deviceResources.context()->Unmap(capture->stagingTexture.Get(), 0);
+                }
+                ring.release();
+            }
+            captureWriter.reportDropped(ring.takeDropped());
+        }
+
+        // Let the writer thread complete the file once all the frames are read back.
+        if (!captureFramesRemaining && isEmpty)
+        {
+            captureWriter.finish();
+            isCapturing = false;
+        }
     }
 
-    // Returns whether this swapchain is currently set up for scaling.
-    bool IsSwapchainHandled(
-        const XrSwapchain swapchain)
+    // Read back all the completed samples (in microseconds) into the histogram. Returns the number of new samples.
+    uint32_t PollTimer(GpuTimerRing& timer, LatencyHistogram& histogram, uint64_t& lastSample)
     {
-        return scalerResources.find(swapchain) != scalerResources.cend();
+        uint32_t numSamples = 0;
+        while (GpuTimer* const slot = timer.ring.oldest())
+        {
+            D3D11_QUERY_DATA_TIMESTAMP_DISJOINT disData;
+            UINT64 startime;
+            UINT64 endtime;
+
+            // Do not flush the context: the sample will be retried on the next frame if it is not ready yet.
+            if (deviceResources.context()->GetData(slot->timeStampDis.Get(), &disData, sizeof(D3D11_QUERY_DATA_TIMESTAMP_DISJOINT), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK)
+            {
+                break;
+            }
+
+            if (deviceResources.context()->GetData(slot->timeStampStart.Get(), &startime, sizeof(UINT64), D3D11_ASYNC_GETDATA_DONOTFLUSH) == S_OK &&
+                deviceResources.context()->GetData(slot->timeStampEnd.Get(), &endtime, sizeof(UINT64), D3D11_ASYNC_GETDATA_DONOTFLUSH) == S_OK &&
+                !disData.Disjoint)
+            {
+                lastSample = (uint64_t)((endtime - startime) / double(disData.Frequency) * 1e6);
+                histogram.record(lastSample);
+                timer.ring.release();
+                numSamples++;
+            }
+            else
+            {
+                timer.ring.discard();
+            }
+        }
+
+        return numSamples;
     }
 
-    void InitTimer(GpuTimer& timer)
+    bool IsOverlapping(const NISViewport& a, const NISViewport& b)
     {
-        D3D11_QUERY_DESC queryDesc;
-        ZeroMemory(&queryDesc, sizeof(D3D11_QUERY_DESC));
-        queryDesc.Query = D3D11_QUERY_TIMESTAMP_DISJOINT;
-        DX::ThrowIfFailed(deviceResources.device()->CreateQuery(&queryDesc, timer.timeStampDis.GetAddressOf()));
-        queryDesc.Query = D3D11_QUERY_TIMESTAMP;
-        DX::ThrowIfFailed(deviceResources.device()->CreateQuery(&queryDesc, timer.timeStampStart.GetAddressOf()));
-        DX::ThrowIfFailed(deviceResources.device()->CreateQuery(&queryDesc, timer.timeStampEnd.GetAddressOf()));
-        timer.valid = false;
+        return a.x < b.x + b.width && b.x < a.x + a.width && a.y < b.y + b.height && b.y < a.y + a.height;
     }
 
-    void StartTimer(GpuTimer& timer)
+    // Find the end of the batch of views starting at first: the consecutive views of the same swapchain image, as many as
+    // the periphery scaler takes with a single dispatch, and as long as they write to different regions of each slice.
+    uint32_t FindViewBatchEnd(const ScaledView* const views, const uint32_t viewCount, const uint32_t first)
     {
-        if (timer.timeStampDis)
+        uint32_t end = first + 1;
+        for (; end < viewCount && end - first < BilinearRenderer::MaxViews && views[end].resources == views[first].resources; end++)
         {
-            deviceResources.context()->Begin(timer.timeStampDis.Get());
-            deviceResources.context()->End(timer.timeStampStart.Get());
+            for (uint32_t i = first; i < end; i++)
+            {
+                if (views[i].slice == views[end].slice && IsOverlapping(views[i].outputViewport, views[end].outputViewport))
+                {
+                    return end;
+                }
+            }
         }
+        return end;
     }
 
-    void StopTimer(GpuTimer& timer)
+    // Upscale the depth submitted by the application to the runtime texture. Returns the region written.
+    XrRect2Di UpscaleDepth(const ScalerResources& resources, const XrSwapchainSubImage& subImage)
     {
-        if (timer.timeStampDis)
+        const XrSwapchainCreateInfo& imageInfo = resources.swapchainInfo;
+        const SwapchainImageResources& imageResources = resources.imageResources[resources.acquiredImageIndex];
+        const XrRect2Di& imageRect = subImage.imageRect;
+        const NISViewport inputViewport = ClampViewport(imageRect.offset.x, imageRect.offset.y, imageRect.extent.width, imageRect.extent.height, imageInfo.width, imageInfo.height);
+        const NISViewport outputViewport =
+            MapOutputViewport(inputViewport, imageInfo.width, imageInfo.height, resources.outputWidth, resources.outputHeight, resources.isUpscaling);
+        resources.depthScaler->update(inputViewport, outputViewport);
+
+        // Like color conversion, use a deferred context so we can use the context saving feature.
+        ComPtr<ID3D11DeviceContext> executionContext;
+        if (!config.fastContextSwitch)
+        {
+            DX::ThrowIfFailed(deviceResources.device()->CreateDeferredContext(0, executionContext.GetAddressOf()));
+            executionContext->ClearState();
+        }
+        else
+        {
+            executionContext.Attach(deviceResources.context());
+        }
+
+        resources.depthScaler->draw(executionContext.Get(), imageResources.appTextureSrv[subImage.imageArrayIndex].Get(),
+                                    imageResources.runtimeTextureDsv[subImage.imageArrayIndex].Get());
+
+        if (!config.fastContextSwitch)
+        {
+            ComPtr<ID3D11CommandList> commandList;
+            DX::ThrowIfFailed(executionContext->FinishCommandList(FALSE, commandList.GetAddressOf()));
+            deviceResources.context()->ExecuteCommandList(commandList.Get(), TRUE);
+        }
+        else
         {
-            deviceResources.context()->End(timer.timeStampEnd.Get());
-            deviceResources.context()->End(timer.timeStampDis.Get());
-            timer.valid = true;
+            executionContext.Detach();
         }
+
+        XrRect2Di outputRect;
+        outputRect.offset.x = (int32_t)outputViewport.x;
+        outputRect.offset.y = (int32_t)outputViewport.y;
+        outputRect.extent.width = (int32_t)outputViewport.width;
+        outputRect.extent.height = (int32_t)outputViewport.height;
+        return outputRect;
     }
 
-    uint64_t QueryTimer(GpuTimer& timer)
+    // We override this OpenXR API in order to match the profiles against the system picked by the application.
+    XrResult NISScaler_xrGetSystem(
+        const XrInstance instance,
+        const XrSystemGetInfo* const getInfo,
+        XrSystemId* const systemId)
     {
-        D3D11_QUERY_DATA_TIMESTAMP_DISJOINT disData;
-        UINT64 startime;
-        UINT64 endtime;
+        DebugLog("--> NISScaler_xrGetSystem\n");
 
-        if (timer.valid && timer.timeStampDis &&
-            deviceResources.context()->GetData(timer.timeStampDis.Get(), &disData, sizeof(D3D11_QUERY_DATA_TIMESTAMP_DISJOINT), 0) == S_OK &&
-            deviceResources.context()->GetData(timer.timeStampStart.Get(), &startime, sizeof(UINT64), 0) == S_OK &&
-            deviceResources.context()->GetData(timer.timeStampEnd.Get(), &endtime, sizeof(UINT64), 0) == S_OK &&
-            !disData.Disjoint)
+        // Call the chain to perform the actual operation.
+        const XrResult result = next_xrGetSystem(instance, getInfo, systemId);
+        if (result == XR_SUCCESS && getInfo->formFactor == XR_FORM_FACTOR_HEAD_MOUNTED_DISPLAY)
         {
-            timer.valid = false;
-            return (uint64_t)((endtime - startime) / double(disData.Frequency) * 1e6);
+            ResolveProfiles(instance, *systemId);
         }
-        return 0;
+
+        DebugLog("<-- NISScaler_xrGetSystem %d\n", result);
+
+        return result;
     }
 
     // We override this OpenXR API in order to return the desired rendering resolution to the application.
@@ -493,30 +1052,53 @@ float4 psMain(in float4 position : SV_POSITION, in float2 texcoord : TEXCOORD0)
     {
         DebugLog("--> NISScaler_xrEnumerateViewConfigurationViews\n");
 
+        if (!config.loaded)
+        {
+            return next_xrEnumerateViewConfigurationViews(instance, systemId, viewConfigurationType, viewCapacityInput, viewCountOutput, views);
+        }
+
         // Call the chain to perform the actual operation.
         const XrResult result = next_xrEnumerateViewConfigurationViews(instance, systemId, viewConfigurationType, viewCapacityInput, viewCountOutput, views);
         if (result == XR_SUCCESS && viewConfigurationType == XR_VIEW_CONFIGURATION_TYPE_PRIMARY_STEREO && viewCapacityInput > 0)
         {
+            // The swapchains are sized after the scaling factor: only pick up a new value before they are created.
+            const Config* const latestConfig = configWatcher.latest();
+            if (latestConfig && scalerResources.empty())
+            {
+                config.scaleFactor = latestConfig->scaleFactor;
+            }
+
             actualDisplayWidth = views[0].recommendedImageRectWidth;
             actualDisplayHeight = views[0].recommendedImageRectHeight;
+            if (scalerResources.empty())
+            {
+                recommendedRenderWidth = actualDisplayWidth;
+                recommendedRenderHeight = actualDisplayHeight;
+            }
 
-            if (config.scaleFactor < 1.f)
+            // With dynamic resolution, the swapchains are sized for the highest scale. Once they are created, the
+            // application can query the current scale and render to a region of its textures.
+            const bool isDynamic = config.dynamicResolution && !scalerResources.empty();
+            const float scaleFactor = isDynamic ? renderScale : config.scaleFactor;
+            if (scaleFactor < 1.f)
             {
                 // Store the actual image size and override the recommended image size to account for scaling.
                 for (uint32_t i = 0; i < *viewCountOutput; i++)
                 {
-                    views[i].recommendedImageRectWidth = (uint32_t)(views[i].recommendedImageRectWidth * config.scaleFactor);
-                    views[i].recommendedImageRectHeight = (uint32_t)(views[i].recommendedImageRectHeight * config.scaleFactor);
+                    views[i].recommendedImageRectWidth = (uint32_t)(views[i].recommendedImageRectWidth * scaleFactor);
+                    views[i].recommendedImageRectHeight = (uint32_t)(views[i].recommendedImageRectHeight * scaleFactor);
 
-                    if (i == 0)
+                    if (i == 0 && !isDynamic)
                     {
+                        recommendedRenderWidth = views[i].recommendedImageRectWidth;
+                        recommendedRenderHeight = views[i].recommendedImageRectHeight;
                         Log("Scaled resolution is: %ux%u (%u%% of %ux%u)\n",
                             views[i].recommendedImageRectWidth, views[i].recommendedImageRectHeight,
                             (unsigned int)((config.scaleFactor + 0.001f) * 100), actualDisplayWidth, actualDisplayHeight);
                     }
                 }
             }
-            else
+            else if (!isDynamic)
             {
                 Log("Using OpenXR resolution (no scaling): %ux%u\n", actualDisplayWidth, actualDisplayHeight);
             }
@@ -536,10 +1118,27 @@ float4 psMain(in float4 position : SV_POSITION, in float2 texcoord : TEXCOORD0)
     {
         DebugLog("--> NISScaler_xrCreateSession\n");
 
+        // In case the application did not look up its system through our layer.
+        ResolveProfiles(instance, createInfo->systemId);
+        if (!config.loaded)
+        {
+            return next_xrCreateSession(instance, createInfo, session);
+        }
+
         // Call the chain to perform the actual operation.
         const XrResult result = next_xrCreateSession(instance, createInfo, session);
         if (result == XR_SUCCESS)
         {
+            // Pick up the settings that the session's resources depend on.
+            if (const Config* const latestConfig = configWatcher.latest())
+            {
+                config.intermediateFormat = latestConfig->intermediateFormat;
+                config.enableStats = latestConfig->enableStats;
+                config.enableTelemetry = latestConfig->enableTelemetry;
+                config.dynamicResolution = latestConfig->dynamicResolution;
+                config.msaaResolveFilter = latestConfig->msaaResolveFilter;
+            }
+
             try
             {
                 const XrBaseInStructure* entry = reinterpret_cast<const XrBaseInStructure*>(createInfo->next);
@@ -551,27 +1150,43 @@ float4 psMain(in float4 position : SV_POSITION, in float2 texcoord : TEXCOORD0)
                         const XrGraphicsBindingD3D11KHR* d3dBindings = reinterpret_cast<const XrGraphicsBindingD3D11KHR*>(entry);
                         d3d11Device = d3dBindings->device;
 
-                        // Try to log the GPU name.
+                        // Identify the GPU, to tune the NIS shader.
                         {
                             ComPtr<IDXGIDevice> dxgiDevice;
                             ComPtr<IDXGIAdapter> adapter;
                             DXGI_ADAPTER_DESC desc;
 
+                            adapterInfo = {};
                             if (SUCCEEDED(d3d11Device->QueryInterface(__uuidof(IDXGIDevice), reinterpret_cast<void**>(dxgiDevice.GetAddressOf()))) &&
                                 SUCCEEDED(dxgiDevice->GetAdapter(&adapter)) &&
                                 SUCCEEDED(adapter->GetDesc(&desc)))
                             {
                                 const std::wstring wadapterDescription(desc.Description);
-                                std::string adapterDescription;
-                                std::transform(wadapterDescription.begin(), wadapterDescription.end(), std::back_inserter(adapterDescription), [](wchar_t c) { return (char)c; });
-                                Log("Using adapter: %s\n", adapterDescription.c_str());
+                                std::transform(wadapterDescription.begin(), wadapterDescription.end(), std::back_inserter(adapterInfo.description), [](wchar_t c) { return (char)c; });
+                                adapterInfo.vendorId = desc.VendorId;
+                                adapterInfo.deviceId = desc.DeviceId;
+
+                                // This returns the version of the user-mode driver.
+                                LARGE_INTEGER driverVersion;
+                                if (SUCCEEDED(adapter->CheckInterfaceSupport(__uuidof(IDXGIDevice), &driverVersion)))
+                                {
+                                    adapterInfo.driverVersion = (uint64_t)driverVersion.QuadPart;
+                                }
+                                Log("Using adapter: %s (%04x:%04x, driver %s)\n", adapterInfo.description.c_str(), adapterInfo.vendorId, adapterInfo.deviceId,
+                                    DescribeDriverVersion(adapterInfo.driverVersion).c_str());
                             }
                         }
 
                         // HACK: See our DeviceResources implementation. We use the existing interface using an HWND pointer as an opaque pointer.
                         deviceResources.create(reinterpret_cast<HWND>(d3d11Device));
 
-                        // Check whether we need color conversion.
+                        if (IsGpuTimingEnabled())
+                        {
+                            InitTimer(appTimer);
+                        }
+
+                        // Check whether we need color conversion. The runtime or the intermediate format may have changed since the previous session.
+                        isIntermediateFormatCompatible = false;
                         uint32_t formatsCount = 0;
                         next_xrEnumerateSwapchainFormats(*session, 0, &formatsCount, nullptr);
                         std::vector<int64_t> formats(formatsCount, {});
@@ -579,7 +1194,7 @@ float4 psMain(in float4 position : SV_POSITION, in float2 texcoord : TEXCOORD0)
                         {
                             for (auto format : formats)
                             {
-                                if (format == config.intermediateFormat)
+                                if (format == (int64_t)config.intermediateFormat)
                                 {
                                     isIntermediateFormatCompatible = true;
                                     break;
@@ -597,23 +1212,17 @@ float4 psMain(in float4 position : SV_POSITION, in float2 texcoord : TEXCOORD0)
                         }
 
                         // Initialize resources for color conversion (in case we actually need it). We also use this for the unfiltered (flat) scaling mode.
-                        ComPtr<ID3DBlob> errors;
+                        const std::vector<uint8_t> vsBytes = CompileShader(shaderCache.get(), colorConversionShadersSource, "colorConversion", {}, nullptr, "vsMain", "vs_5_0", D3DCOMPILE_ENABLE_STRICTNESS | D3DCOMPILE_WARNINGS_ARE_ERRORS);
+                        DX::ThrowIfFailed(d3d11Device->CreateVertexShader(vsBytes.data(), vsBytes.size(), nullptr, colorConversionVertexShader.GetAddressOf()));
 
-                        ComPtr<ID3DBlob> vsBytes;
-                        HRESULT hr = D3DCompile(colorConversionShadersSource.c_str(), colorConversionShadersSource.length(), nullptr, nullptr, nullptr, "vsMain", "vs_5_0", D3DCOMPILE_ENABLE_STRICTNESS | D3DCOMPILE_WARNINGS_ARE_ERRORS, 0, vsBytes.GetAddressOf(), errors.GetAddressOf());
-                        if (FAILED(hr)) {
-                            Log("VS compile failed: %*s\n", errors->GetBufferSize(), errors->GetBufferPointer());
-                            DX::ThrowIfFailed(hr);
-                        }
-                        DX::ThrowIfFailed(d3d11Device->CreateVertexShader(vsBytes->GetBufferPointer(), vsBytes->GetBufferSize(), nullptr, colorConversionVertexShader.GetAddressOf()));
+                        const std::vector<uint8_t> psBytes = CompileShader(shaderCache.get(), colorConversionShadersSource, "colorConversion", {}, nullptr, "psMain", "ps_5_0", D3DCOMPILE_ENABLE_STRICTNESS | D3DCOMPILE_WARNINGS_ARE_ERRORS);
+                        DX::ThrowIfFailed(d3d11Device->CreatePixelShader(psBytes.data(), psBytes.size(), nullptr, colorConversionPixelShader.GetAddressOf()));
 
-                        ComPtr<ID3DBlob> psBytes;
-                        hr = D3DCompile(colorConversionShadersSource.c_str(), colorConversionShadersSource.length(), nullptr, nullptr, nullptr, "psMain", "ps_5_0", D3DCOMPILE_ENABLE_STRICTNESS | D3DCOMPILE_WARNINGS_ARE_ERRORS, 0, psBytes.GetAddressOf(), errors.ReleaseAndGetAddressOf());
-                        if (FAILED(hr)) {
-                            Log("PS compile failed: %*s\n", errors->GetBufferSize(), errors->GetBufferPointer());
-                            DX::ThrowIfFailed(hr);
-                        }
-                        DX::ThrowIfFailed(d3d11Device->CreatePixelShader(psBytes->GetBufferPointer(), psBytes->GetBufferSize(), nullptr, colorConversionPixelShader.GetAddressOf()));
+                        const std::vector<uint8_t> psMSBytes = CompileShader(shaderCache.get(), colorConversionShadersSource, "colorConversion", {}, nullptr, "psMainMS", "ps_5_0", D3DCOMPILE_ENABLE_STRICTNESS | D3DCOMPILE_WARNINGS_ARE_ERRORS);
+                        DX::ThrowIfFailed(d3d11Device->CreatePixelShader(psMSBytes.data(), psMSBytes.size(), nullptr, colorConversionPixelShaderMS.GetAddressOf()));
+
+                        ColorConversionConstants constants{ { 0.f, 0.f, 1.f, 1.f } };
+                        deviceResources.createConstBuffer(&constants, sizeof(constants), colorConversionConstantBuffer.GetAddressOf());
 
                         D3D11_SAMPLER_DESC sampDesc;
                         ZeroMemory(&sampDesc, sizeof(D3D11_SAMPLER_DESC));
@@ -631,8 +1240,6 @@ float4 psMain(in float4 position : SV_POSITION, in float2 texcoord : TEXCOORD0)
                         rsDesc.CullMode = D3D11_CULL_NONE;
                         rsDesc.FrontCounterClockwise = TRUE;
                         DX::ThrowIfFailed(d3d11Device->CreateRasterizerState(&rsDesc, colorConversionRasterizer.GetAddressOf()));
-                        rsDesc.MultisampleEnable = TRUE;
-                        DX::ThrowIfFailed(d3d11Device->CreateRasterizerState(&rsDesc, colorConversionRasterizerMSAA.GetAddressOf()));
                     }
                     else if (entry->type == XR_TYPE_GRAPHICS_BINDING_D3D12_KHR)
                     {
@@ -656,6 +1263,21 @@ float4 psMain(in float4 position : SV_POSITION, in float2 texcoord : TEXCOORD0)
             scalingMode = ScalingMode::NIS;
             newSharpness = config.sharpness;
 
+            // Start from the highest scale: the swapchains are sized for it.
+            dynamicResolution.configure(DescribeDynamicResolution());
+            dynamicResolution.reset(config.scaleFactor);
+            renderScale = config.scaleFactor;
+            lastFrameScalerSamples = 0;
+            lastFrameColorConversionSamples = 0;
+
+            if (config.enableTelemetry && !telemetry.isOpen() && !telemetry.open())
+            {
+                Log("Failed to create the telemetry segment\n");
+            }
+            frameIndex = 0;
+
+            inputPoller.start(std::make_unique<KeyboardInputSource>());
+
             // Make the first update quicker.
             stats.windowBeginning = GetTickCount64();
             stats.nextWindow = stats.windowBeginning + StatsPeriodMs / 10;
@@ -679,11 +1301,25 @@ float4 psMain(in float4 position : SV_POSITION, in float2 texcoord : TEXCOORD0)
         {
             // Cleanup all the scaler's resources.
             scalerResources.clear();
-            swapchainIndices.clear();
+            appTimer = {};
+            isAppTimerStarted = false;
+            frameArena.clear();
+            telemetry.close();
+            inputPoller.stop();
+            screenshots = {};
+            screenshotWriter.stop();
+            for (auto& ring : frameCaptures)
+            {
+                ring = {};
+            }
+            captureFramesRemaining = 0;
+            isCapturing = false;
+            captureWriter.close();
             colorConversionRasterizer = nullptr;
-            colorConversionRasterizerMSAA = nullptr;
             colorConversionSampler = nullptr;
             colorConversionPixelShader = nullptr;
+            colorConversionPixelShaderMS = nullptr;
+            colorConversionConstantBuffer = nullptr;
             colorConversionVertexShader = nullptr;
             deviceResources.create(nullptr);
             d3d11Device = nullptr;
@@ -703,21 +1339,32 @@ float4 psMain(in float4 position : SV_POSITION, in float2 texcoord : TEXCOORD0)
     {
         DebugLog("--> NISScaler_xrCreateSwapchain\n");
 
+        if (!config.loaded)
+        {
+            return next_xrCreateSwapchain(session, createInfo, swapchain);
+        }
+
         // This function is the most likely to fail due to OpenXR runtime variations, GPU variations etc...
         // Add extra logging in here.
 
         XrSwapchainCreateInfo chainCreateInfo = *createInfo;
 
+        const ColorFormatInfo* const colorFormatInfo = GetColorFormatInfo((uint32_t)createInfo->format);
         const bool isIndirectlySupportedColorFormat = IsIndirectlySupportedColorFormat((DXGI_FORMAT)createInfo->format);
         const bool isSupportedColorFormat = IsSupportedColorFormat((DXGI_FORMAT)createInfo->format) || isIndirectlySupportedColorFormat;
         const bool isSupportedDepthFormat = IsSupportedDepthFormat((DXGI_FORMAT)createInfo->format);
         const bool isHandled = d3d11Device && createInfo->arraySize <= 2 && createInfo->faceCount == 1 && (isSupportedColorFormat || isSupportedDepthFormat);
 
+        const uint32_t outputWidth = GetOutputTextureSize(createInfo->width, recommendedRenderWidth, actualDisplayWidth);
+        const uint32_t outputHeight = GetOutputTextureSize(createInfo->height, recommendedRenderHeight, actualDisplayHeight);
         if (isHandled)
         {
             // Request the full device resolution. The app will not see this texture, only the runtime.
-            chainCreateInfo.width = actualDisplayWidth;
-            chainCreateInfo.height = actualDisplayHeight;
+            chainCreateInfo.width = outputWidth;
+            chainCreateInfo.height = outputHeight;
+
+            // The application's samples are resolved by the scalers, which cannot write to a multisampled texture.
+            chainCreateInfo.sampleCount = 1;
 
             // Make sure this format is supported for a UAV.
             if (isIndirectlySupportedColorFormat)
@@ -734,20 +1381,44 @@ float4 psMain(in float4 position : SV_POSITION, in float2 texcoord : TEXCOORD0)
                 }
                 else
                 {
-                    Log("Using indirect texture format with color conversion\n");
-
-                    // Otherwise we keep the requested format, and we will have to do an extra pass for color mapping.
+                    // Otherwise we keep the requested format. If the runtime creates its textures typeless, the scalers can
+                    // write them through a UNORM alias (see xrEnumerateSwapchainImages()), otherwise we will have to do an
+                    // extra pass for color mapping.
+                    if (IsTypedUnorderedAccessSupported(d3d11Device, (DXGI_FORMAT)colorFormatInfo->aliasFormat))
+                    {
+                        chainCreateInfo.usageFlags |= XR_SWAPCHAIN_USAGE_UNORDERED_ACCESS_BIT;
+                    }
                 }
             }
-            else
+            else if (isSupportedDepthFormat)
+            {
+                // Add the flag to allow the textures to be the output of the depth scaler.
+                chainCreateInfo.usageFlags |= XR_SWAPCHAIN_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+            }
+            else if (IsTypedUnorderedAccessSupported(d3d11Device, (DXGI_FORMAT)createInfo->format))
             {
                 // Add the flag to allow the textures to be the output of the scaler.
                 chainCreateInfo.usageFlags |= XR_SWAPCHAIN_USAGE_UNORDERED_ACCESS_BIT;
             }
+            else
+            {
+                Log("Using texture format %d with color conversion\n", (int)createInfo->format);
+
+                // The scalers write to the intermediate texture, and the color conversion pass writes the runtime texture
+                // through a render target view.
+            }
         }
 
         // Call the chain to perform the actual operation.
-        const XrResult result = next_xrCreateSwapchain(session, &chainCreateInfo, swapchain);
+        XrResult result = next_xrCreateSwapchain(session, &chainCreateInfo, swapchain);
+        const bool isUnorderedAccessAdded = (chainCreateInfo.usageFlags & ~createInfo->usageFlags) & XR_SWAPCHAIN_USAGE_UNORDERED_ACCESS_BIT;
+        if (result != XR_SUCCESS && isHandled && isUnorderedAccessAdded && chainCreateInfo.format == createInfo->format)
+        {
+            // The runtime may not allow UAVs with this format. Fallback to the color conversion pass.
+            Log("Retrying without unordered access\n");
+            chainCreateInfo.usageFlags = createInfo->usageFlags;
+            result = next_xrCreateSwapchain(session, &chainCreateInfo, swapchain);
+        }
         if (result == XR_SUCCESS)
         {
             if (isHandled)
@@ -756,29 +1427,59 @@ float4 psMain(in float4 position : SV_POSITION, in float2 texcoord : TEXCOORD0)
                 {
                     ScalerResources resources;
 
-                    // Create the scalers.
-                    if (!config.disableBilinearScaler)
+                    // Create the scalers, or share them with another swapchain.
+                    ID3D11Device* const device = deviceResources.device();
+                    const bool isUpscaling = config.scaleFactor < 1.f || config.dynamicResolution;
+                    if (isSupportedDepthFormat)
                     {
-                        resources.bilinearScaler = std::make_shared<BilinearUpscale>(deviceResources);
-                        resources.bilinearScaler->update(createInfo->width, createInfo->height, actualDisplayWidth, actualDisplayHeight);
-                    }
-                    std::vector<std::string> shaderHome;
-                    if (config.scaleFactor < 1.f)
-                    {
-                        resources.NISScaler = std::make_shared<NVScaler>(deviceResources, nisShaderHome);
-                        resources.NISScaler->update(config.sharpness, createInfo->width, createInfo->height, actualDisplayWidth, actualDisplayHeight);
+                        resources.depthScaler = sharedDepthScalers.getOrCreate({ device, createInfo->sampleCount }, [&] {
+                            return std::make_shared<DepthRenderer>(deviceResources, shaderCache.get(), createInfo->sampleCount);
+                        });
                     }
                     else
                     {
-                        resources.NISSharpen = std::make_shared<NVSharpen>(deviceResources, nisShaderHome);
-                        resources.NISSharpen->update(config.sharpness, createInfo->width, createInfo->height);
+                        // The tent filter needs to know where the samples are, so it is only used with the standard sample
+                        // positions, which Direct3D supports up to 8 samples.
+                        const uint32_t sampleCount = createInfo->sampleCount;
+                        const MsaaResolveFilter resolveFilter = sampleCount > 1 && sampleCount <= 8 && HasStandardSamplePositions(sampleCount)
+                                                                    ? (MsaaResolveFilter)config.msaaResolveFilter
+                                                                    : MsaaResolveFilter::Box;
+                        float sampleWeights[MaxSampleCount];
+                        if (!GetMsaaResolveWeights(sampleCount, resolveFilter, sampleWeights))
+                        {
+                            throw std::runtime_error("Unsupported sample count");
+                        }
+                        resources.useStandardSamplePattern = resolveFilter != MsaaResolveFilter::Box;
+                        memcpy(resources.sampleWeights, sampleWeights, sizeof(sampleWeights));
+
+                        // The viewports are set for each view in xrEndFrame(), since the application may render to a region of its texture.
+                        const NISVariant variant = PickNISVariant(isUpscaling, createInfo->width, createInfo->height, outputWidth, outputHeight);
+                        const NISHDRMode hdrMode = colorFormatInfo->isHdr ? NISHDRMode::Linear : NISHDRMode::None;
+                        resources.NISScaler = sharedNISScalers.getOrCreate(MakeNISScalerKey(device, isUpscaling, variant, (uint32_t)hdrMode, sampleCount, resolveFilter), [&] {
+                            return std::make_shared<NISRenderer>(deviceResources, nisShaderHome, isUpscaling, variant, shaderCache.get(), hdrMode, sampleCount,
+                                                                 sampleWeights);
+                        });
+                        resources.peripheryScaler = sharedPeripheryScalers.getOrCreate(MakeBilinearScalerKey(device, sampleCount, resolveFilter), [&] {
+                            return std::make_shared<BilinearRenderer>(deviceResources, shaderCache.get(), sampleCount, sampleWeights);
+                        });
+                        if (sampleCount > 1)
+                        {
+                            Log("Resolving %u samples with the %s filter\n", sampleCount, resolveFilter == MsaaResolveFilter::Tent ? "tent" : "box");
+                        }
                     }
 
                     // We keep track of the (real) swapchain info for when we intercept the textures in xrEnumerateSwapchainImages().
                     resources.swapchainInfo = *createInfo;
+                    resources.outputWidth = outputWidth;
+                    resources.outputHeight = outputHeight;
+                    resources.isUpscaling = isUpscaling;
 
                     // We will keep track of the textures we distribute to the app.
                     scalerResources.insert_or_assign(*swapchain, std::move(resources));
+
+                    Log("Sharing %zu NIS and %zu bilinear scalers between %zu swapchains (%u scalers reused so far)\n",
+                        sharedNISScalers.size(), sharedPeripheryScalers.size(), scalerResources.size(),
+                        sharedNISScalers.statistics().reused + sharedPeripheryScalers.statistics().reused);
                 }
                 catch (std::runtime_error exc)
                 {
@@ -812,7 +1513,6 @@ float4 psMain(in float4 position : SV_POSITION, in float2 texcoord : TEXCOORD0)
         {
             // Cleanup the resources.
             scalerResources.erase(swapchain);
-            swapchainIndices.erase(swapchain);
         }
 
         DebugLog("<-- NISScaler_xrDestroySwapchain %d\n", result);
@@ -840,12 +1540,47 @@ float4 psMain(in float4 position : SV_POSITION, in float2 texcoord : TEXCOORD0)
             try
             {
                 XrSwapchainImageD3D11KHR* d3dImages = reinterpret_cast<XrSwapchainImageD3D11KHR*>(images);
-                ScalerResources& commonResources = scalerResources[swapchain];
+                ScalerResources& commonResources = *scalerResources.find(swapchain);
 
                 // Detect some properties for our resources.
                 const XrSwapchainCreateInfo& imageInfo = commonResources.swapchainInfo;
                 const bool indirectMode = IsIndirectlySupportedColorFormat((DXGI_FORMAT)imageInfo.format);
-                const bool needColorConversion = !isIntermediateFormatCompatible;
+                const ColorFormatInfo* const colorFormatInfo = GetColorFormatInfo((uint32_t)imageInfo.format);
+
+                // The scalers write the runtime textures when they allow UAVs, otherwise the color conversion pass does. The
+                // direct formats are written in the format of the swapchain. The sRGB textures of the runtime are written in
+                // the intermediate format when the runtime created them in it, or else through a UNORM alias when they are
+                // typeless, with the sRGB encoding done by the scalers.
+                if (colorFormatInfo && *imageCountOutput > 0)
+                {
+                    D3D11_TEXTURE2D_DESC runtimeDesc;
+                    d3dImages[0].texture->GetDesc(&runtimeDesc);
+                    const bool isUnorderedAccess = runtimeDesc.BindFlags & D3D11_BIND_UNORDERED_ACCESS;
+                    if (indirectMode && !isIntermediateFormatCompatible)
+                    {
+                        commonResources.isSrgbAliased = isUnorderedAccess && runtimeDesc.Format == (DXGI_FORMAT)colorFormatInfo->typelessFormat;
+                        Log(commonResources.isSrgbAliased ? "Using sRGB texture format through a UNORM alias\n"
+                                                          : "Using indirect texture format with color conversion\n");
+                    }
+                    commonResources.needColorConversion =
+                        !isUnorderedAccess || (indirectMode && !isIntermediateFormatCompatible && !commonResources.isSrgbAliased);
+                }
+                const bool needColorConversion = commonResources.needColorConversion;
+                const bool isSrgbAliased = commonResources.isSrgbAliased;
+
+                // The intermediate texture preserves the range of the HDR formats.
+                const DXGI_FORMAT intermediateFormat =
+                    colorFormatInfo && colorFormatInfo->isHdr ? DXGI_FORMAT_R16G16B16A16_FLOAT : (DXGI_FORMAT)config.intermediateFormat;
+
+                // The format of the views of the texture written by the scalers.
+                const DXGI_FORMAT aliasUnormFormat = colorFormatInfo ? (DXGI_FORMAT)colorFormatInfo->aliasFormat : DXGI_FORMAT_UNKNOWN;
+                const DXGI_FORMAT outputViewFormat = needColorConversion ? intermediateFormat
+                                                     : isSrgbAliased     ? aliasUnormFormat
+                                                     : !indirectMode     ? (DXGI_FORMAT)imageInfo.format
+                                                                         : (DXGI_FORMAT)config.intermediateFormat;
+                DXGI_FORMAT depthTypelessFormat, depthShaderResourceFormat;
+                const bool isDepth = GetDepthTextureFormats((DXGI_FORMAT)imageInfo.format, depthTypelessFormat, depthShaderResourceFormat);
+                const bool isMultisampled = imageInfo.sampleCount > 1;
                 for (uint32_t i = 0; i < *imageCountOutput; i++)
                 {
                     SwapchainImageResources resources;
@@ -860,8 +1595,9 @@ float4 psMain(in float4 position : SV_POSITION, in float2 texcoord : TEXCOORD0)
                     textureDesc.Height = imageInfo.height;
                     textureDesc.MipLevels = imageInfo.mipCount;
                     textureDesc.ArraySize = imageInfo.arraySize;
-                    textureDesc.Format = (DXGI_FORMAT)imageInfo.format;
+                    textureDesc.Format = isDepth ? depthTypelessFormat : (DXGI_FORMAT)imageInfo.format;
                     textureDesc.SampleDesc.Count = imageInfo.sampleCount;
+                    textureDesc.SampleDesc.Quality = commonResources.useStandardSamplePattern ? D3D11_STANDARD_MULTISAMPLE_PATTERN : 0;
                     textureDesc.Usage = D3D11_USAGE_DEFAULT;
                     if (imageInfo.usageFlags & XR_SWAPCHAIN_USAGE_COLOR_ATTACHMENT_BIT)
                     {
@@ -879,18 +1615,59 @@ float4 psMain(in float4 position : SV_POSITION, in float2 texcoord : TEXCOORD0)
                     textureDesc.BindFlags |= D3D11_BIND_SHADER_RESOURCE;
                     DX::ThrowIfFailed(deviceResources.device()->CreateTexture2D(&textureDesc, nullptr, resources.appTexture.GetAddressOf()));
 
+                    // Create the views needed by the depth scaler, for each slice.
+                    if (isDepth)
+                    {
+                        for (uint32_t j = 0; j < imageInfo.arraySize; j++)
+                        {
+                            // The samples of a multisampled depth are resolved by the depth scaler.
+                            D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc;
+                            ZeroMemory(&srvDesc, sizeof(D3D11_SHADER_RESOURCE_VIEW_DESC));
+                            srvDesc.Format = depthShaderResourceFormat;
+                            if (isMultisampled)
+                            {
+                                srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DMSARRAY;
+                                srvDesc.Texture2DMSArray.ArraySize = 1;
+                                srvDesc.Texture2DMSArray.FirstArraySlice = j;
+                            }
+                            else
+                            {
+                                srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
+                                srvDesc.Texture2DArray.MostDetailedMip = 0;
+                                srvDesc.Texture2DArray.MipLevels = 1;
+                                srvDesc.Texture2DArray.ArraySize = 1;
+                                srvDesc.Texture2DArray.FirstArraySlice = j;
+                            }
+                            DX::ThrowIfFailed(deviceResources.device()->CreateShaderResourceView(resources.appTexture.Get(), &srvDesc, resources.appTextureSrv[j].GetAddressOf()));
+
+                            D3D11_DEPTH_STENCIL_VIEW_DESC dsvDesc;
+                            ZeroMemory(&dsvDesc, sizeof(D3D11_DEPTH_STENCIL_VIEW_DESC));
+                            dsvDesc.Format = (DXGI_FORMAT)imageInfo.format;
+                            dsvDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2DARRAY;
+                            dsvDesc.Texture2DArray.MipSlice = 0;
+                            dsvDesc.Texture2DArray.ArraySize = 1;
+                            dsvDesc.Texture2DArray.FirstArraySlice = j;
+                            DX::ThrowIfFailed(deviceResources.device()->CreateDepthStencilView(resources.runtimeTexture, &dsvDesc, resources.runtimeTextureDsv[j].GetAddressOf()));
+                        }
+
+                        commonResources.imageResources.push_back(resources);
+                        d3dImages[i].texture = resources.appTexture.Get();
+                        continue;
+                    }
+
                     // Create an intermediate texture for color conversion. This texture is compatible with the scaler's output.
                     if (needColorConversion && i == 0)
                     {
-                        textureDesc.Width = actualDisplayWidth;
-                        textureDesc.Height = actualDisplayHeight;
-                        textureDesc.Format = config.intermediateFormat;
+                        textureDesc.Width = commonResources.outputWidth;
+                        textureDesc.Height = commonResources.outputHeight;
+                        textureDesc.Format = intermediateFormat;
+                        textureDesc.SampleDesc.Count = 1;
+                        textureDesc.SampleDesc.Quality = 0;
                         textureDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_UNORDERED_ACCESS;
                         DX::ThrowIfFailed(deviceResources.device()->CreateTexture2D(&textureDesc, nullptr, commonResources.intermediateTexture.GetAddressOf()));
                     }
 
-                    // Create the views needed by the scalers and color conversion.
-                    // TODO: Update the shaders to support VPRT.
+                    // Create the views needed by the scalers and color conversion, for each slice (VPRT).
                     for (uint32_t j = 0; j < imageInfo.arraySize; j++)
                     {
                         D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc;
@@ -900,34 +1677,67 @@ float4 psMain(in float4 position : SV_POSITION, in float2 texcoord : TEXCOORD0)
                         srvDesc.Texture2DArray.MostDetailedMip = 0;
                         srvDesc.Texture2DArray.MipLevels = imageInfo.mipCount;
                         srvDesc.Texture2DArray.ArraySize = 1;
-                        srvDesc.Texture2DArray.FirstArraySlice = D3D11CalcSubresource(0, j, imageInfo.mipCount);
-                        DX::ThrowIfFailed(deviceResources.device()->CreateShaderResourceView(resources.appTexture.Get(), &srvDesc, resources.appTextureSrv[j].GetAddressOf()));
+                        srvDesc.Texture2DArray.FirstArraySlice = j;
+                        if (isMultisampled)
+                        {
+                            D3D11_SHADER_RESOURCE_VIEW_DESC multisampledSrvDesc;
+                            ZeroMemory(&multisampledSrvDesc, sizeof(D3D11_SHADER_RESOURCE_VIEW_DESC));
+                            multisampledSrvDesc.Format = (DXGI_FORMAT)imageInfo.format;
+                            multisampledSrvDesc.ViewDimension = imageInfo.arraySize == 1 ? D3D11_SRV_DIMENSION_TEXTURE2DMS : D3D11_SRV_DIMENSION_TEXTURE2DMSARRAY;
+                            multisampledSrvDesc.Texture2DMSArray.ArraySize = 1;
+                            multisampledSrvDesc.Texture2DMSArray.FirstArraySlice = j;
+                            DX::ThrowIfFailed(deviceResources.device()->CreateShaderResourceView(resources.appTexture.Get(), &multisampledSrvDesc, resources.appTextureSrv[j].GetAddressOf()));
+                        }
+                        else
+                        {
+                            DX::ThrowIfFailed(deviceResources.device()->CreateShaderResourceView(resources.appTexture.Get(), &srvDesc, resources.appTextureSrv[j].GetAddressOf()));
+                        }
 
                         if (needColorConversion && i == 0)
                         {
-                            srvDesc.Format = config.intermediateFormat;
+                            srvDesc.Format = intermediateFormat;
                             DX::ThrowIfFailed(deviceResources.device()->CreateShaderResourceView(commonResources.intermediateTexture.Get(), &srvDesc, commonResources.intermediateTextureSrv[j].GetAddressOf()));
                         }
 
-                        D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc;
-                        ZeroMemory(&uavDesc, sizeof(D3D11_UNORDERED_ACCESS_VIEW_DESC));
-                        uavDesc.Format = !indirectMode ? (DXGI_FORMAT)imageInfo.format : config.intermediateFormat;
-                        uavDesc.ViewDimension = imageInfo.arraySize == 1 ? D3D11_UAV_DIMENSION_TEXTURE2D : D3D11_UAV_DIMENSION_TEXTURE2DARRAY;
-                        uavDesc.Texture2DArray.MipSlice = 0;
-                        uavDesc.Texture2DArray.ArraySize = 1;
-                        uavDesc.Texture2DArray.FirstArraySlice = D3D11CalcSubresource(0, j, imageInfo.mipCount);
-                        ID3D11Resource* const targetTexture = needColorConversion ? commonResources.intermediateTexture.Get() : resources.runtimeTexture;
-                        DX::ThrowIfFailed(deviceResources.device()->CreateUnorderedAccessView(targetTexture, &uavDesc, resources.upscaledTextureUav[j].GetAddressOf()));
-
                         D3D11_RENDER_TARGET_VIEW_DESC rtvDesc;
                         ZeroMemory(&rtvDesc, sizeof(D3D11_RENDER_TARGET_VIEW_DESC));
-                        rtvDesc.Format = !indirectMode || !isIntermediateFormatCompatible ? (DXGI_FORMAT)imageInfo.format : config.intermediateFormat;
+                        rtvDesc.Format = !indirectMode || !isIntermediateFormatCompatible ? (DXGI_FORMAT)imageInfo.format : (DXGI_FORMAT)config.intermediateFormat;
                         rtvDesc.ViewDimension = imageInfo.arraySize == 1 ? D3D11_RTV_DIMENSION_TEXTURE2D : D3D11_RTV_DIMENSION_TEXTURE2DARRAY;
                         rtvDesc.Texture2DArray.MipSlice = 0;
-                        rtvDesc.Texture2DArray.ArraySize = imageInfo.arraySize;
-                        rtvDesc.Texture2DArray.FirstArraySlice = D3D11CalcSubresource(0, j, imageInfo.mipCount);
+                        rtvDesc.Texture2DArray.ArraySize = 1;
+                        rtvDesc.Texture2DArray.FirstArraySlice = j;
                         DX::ThrowIfFailed(deviceResources.device()->CreateRenderTargetView(resources.runtimeTexture, &rtvDesc, resources.runtimeTextureRtv[j].GetAddressOf()));
                     }
+                    {
+                        D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc;
+                        ZeroMemory(&srvDesc, sizeof(D3D11_SHADER_RESOURCE_VIEW_DESC));
+                        srvDesc.Format = (DXGI_FORMAT)imageInfo.format;
+                        if (isMultisampled)
+                        {
+                            srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DMSARRAY;
+                            srvDesc.Texture2DMSArray.ArraySize = imageInfo.arraySize;
+                            srvDesc.Texture2DMSArray.FirstArraySlice = 0;
+                        }
+                        else
+                        {
+                            srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
+                            srvDesc.Texture2DArray.MostDetailedMip = 0;
+                            srvDesc.Texture2DArray.MipLevels = imageInfo.mipCount;
+                            srvDesc.Texture2DArray.ArraySize = imageInfo.arraySize;
+                            srvDesc.Texture2DArray.FirstArraySlice = 0;
+                        }
+                        DX::ThrowIfFailed(deviceResources.device()->CreateShaderResourceView(resources.appTexture.Get(), &srvDesc, resources.appTextureArraySrv.GetAddressOf()));
+
+                        D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc;
+                        ZeroMemory(&uavDesc, sizeof(D3D11_UNORDERED_ACCESS_VIEW_DESC));
+                        uavDesc.Format = outputViewFormat;
+                        uavDesc.ViewDimension = D3D11_UAV_DIMENSION_TEXTURE2DARRAY;
+                        uavDesc.Texture2DArray.MipSlice = 0;
+                        uavDesc.Texture2DArray.ArraySize = imageInfo.arraySize;
+                        uavDesc.Texture2DArray.FirstArraySlice = 0;
+                        ID3D11Resource* const targetTexture = needColorConversion ? commonResources.intermediateTexture.Get() : resources.runtimeTexture;
+                        DX::ThrowIfFailed(deviceResources.device()->CreateUnorderedAccessView(targetTexture, &uavDesc, resources.upscaledTextureArrayUav.GetAddressOf()));
+                    }
 
                     commonResources.imageResources.push_back(resources);
 
@@ -936,7 +1746,7 @@ float4 psMain(in float4 position : SV_POSITION, in float2 texcoord : TEXCOORD0)
                 }
 
                 // Create the GPU timers.
-                if (config.enableStats)
+                if (IsGpuTimingEnabled())
                 {
                     InitTimer(commonResources.scalerTimer);
                     InitTimer(commonResources.colorConversionTimer);
@@ -965,11 +1775,11 @@ float4 psMain(in float4 position : SV_POSITION, in float2 texcoord : TEXCOORD0)
         const XrResult result = next_xrAcquireSwapchainImage(swapchain, acquireInfo, index);
         if (result == XR_SUCCESS)
         {
-            auto swapchainIndex = swapchainIndices.find(swapchain);
-            if (swapchainIndex != swapchainIndices.end())
+            ScalerResources* const resources = scalerResources.find(swapchain);
+            if (resources)
             {
                 // Keep track of the current texture index.
-                swapchainIndex->second = *index;
+                resources->acquiredImageIndex = *index;
             }
         }
 
@@ -978,6 +1788,27 @@ float4 psMain(in float4 position : SV_POSITION, in float2 texcoord : TEXCOORD0)
         return result;
     }
 
+    // We override this OpenXR API in order to measure the GPU time of the application's rendering, which ends with xrEndFrame().
+    XrResult NISScaler_xrBeginFrame(
+        const XrSession session,
+        const XrFrameBeginInfo* const frameBeginInfo)
+    {
+        DebugLog("--> NISScaler_xrBeginFrame\n");
+
+        // Call the chain to perform the actual operation.
+        const XrResult result = next_xrBeginFrame(session, frameBeginInfo);
+        if (XR_SUCCEEDED(result) && appTimer.valid && !isAppTimerStarted)
+        {
+            // When a frame is discarded, the measurement continues until the next xrEndFrame().
+            StartTimer(appTimer);
+            isAppTimerStarted = true;
+        }
+
+        DebugLog("<-- NISScaler_xrBeginFrame %d\n", result);
+
+        return result;
+    }
+
     // We override this OpenXR API in order to apply the NIS scaling and submit its output to the OpenXR runtime.
     XrResult NISScaler_xrEndFrame(
         const XrSession session,
@@ -987,10 +1818,34 @@ float4 psMain(in float4 position : SV_POSITION, in float2 texcoord : TEXCOORD0)
 
         DebugLog("--> NISScaler_xrEndFrame\n");
 
+        if (!config.loaded)
+        {
+            return next_xrEndFrame(session, frameEndInfo);
+        }
+
+        const auto frameStart = std::chrono::steady_clock::now();
+
         stats.numFrames++;
 
-        // Check keyboard input.
+        // Check for configuration changes and keyboard input.
+        ApplyConfigurationChanges();
         HandleHotkeys();
+        PollScreenshots();
+        PollCaptures();
+
+        // Measure the application's GPU time, and pick the render scale for the next frames. The GPU times are from a
+        // few frames ago, and the scaler's time is accounted for each timer sample of the last frame.
+        if (isAppTimerStarted)
+        {
+            StopTimer(appTimer);
+            isAppTimerStarted = false;
+        }
+        if (PollTimer(appTimer, stats.appGpuTime, stats.lastAppGpuTime) && config.dynamicResolution)
+        {
+            const uint64_t scalerTime = lastFrameScalerSamples * stats.lastScalerTime + lastFrameColorConversionSamples * stats.lastColorConversionTime;
+            renderScale = dynamicResolution.update((uint32_t)(stats.lastAppGpuTime + scalerTime));
+        }
+        stats.droppedSamples += appTimer.ring.takeDropped();
 
         // Unbind any RTV to avoid D3D debug layer warning.
         {
@@ -998,43 +1853,71 @@ float4 psMain(in float4 position : SV_POSITION, in float2 texcoord : TEXCOORD0)
             deviceResources.context()->OMSetRenderTargets(1, rtvs, nullptr);
         }
 
+        // Make a copy of the frame submission that we can modify. The application's structures must not be altered.
+        frameArena.reset();
+        FrameSubmission submission(frameArena, *frameEndInfo);
+
         // Go through each projection layer.
-        std::vector<const XrCompositionLayerBaseHeader*> layers(frameEndInfo->layerCount);
+        uint32_t renderWidth = 0;
+        uint32_t renderHeight = 0;
+        uint32_t scalerSamples = 0;
+        uint32_t colorConversionSamples = 0;
         for (uint32_t i = 0; i < frameEndInfo->layerCount; i++)
         {
             if (frameEndInfo->layers[i]->type == XR_TYPE_COMPOSITION_LAYER_PROJECTION)
             {
                 const XrCompositionLayerProjection* proj = reinterpret_cast<const XrCompositionLayerProjection*>(frameEndInfo->layers[i]);
+
+                XrCompositionLayerProjectionView* const chainViews = submission.copyProjectionLayer(i);
+
+                // Prepare the views that can be upscaled.
+                ScaledView* const scaledViews = frameArena.allocate<ScaledView>(proj->viewCount);
                 for (uint32_t j = 0; j < proj->viewCount; j++)
                 {
                     // Check whether this layer can be upscaled.
                     const XrCompositionLayerProjectionView& view = proj->views[j];
-                    auto scalerResourceIt = scalerResources.find(view.subImage.swapchain);
-                    if (scalerResourceIt == scalerResources.end())
+                    ScaledView& scaledView = scaledViews[j];
+                    scaledView.resources = scalerResources.find(view.subImage.swapchain);
+                    if (!scaledView.resources || scaledView.resources->depthScaler)
                     {
+                        scaledView.resources = nullptr;
                         continue;
                     }
 
                     // Collect the resources and properties of the swapchain.
-                    const ScalerResources& commonResources = scalerResourceIt->second;
+                    const ScalerResources& commonResources = *scaledView.resources;
                     const XrSwapchainCreateInfo& imageInfo = commonResources.swapchainInfo;
-                    const SwapchainImageResources& swapchainResources = commonResources.imageResources[swapchainIndices[view.subImage.swapchain]];
-                    const bool indirectMode = IsIndirectlySupportedColorFormat((DXGI_FORMAT)imageInfo.format);
-                    const bool needColorConversion = !isIntermediateFormatCompatible;
-
-                    // Update the statistics.
+                    scaledView.imageResources = &commonResources.imageResources[commonResources.acquiredImageIndex];
+                    scaledView.slice = view.subImage.imageArrayIndex;
+
+                    // The application may render to a region of its texture, for example with dynamic resolution or with
+                    // several views in the same texture (atlas). Only this region is upscaled to its cell of the runtime
+                    // texture, or sharpened in place.
+                    const XrRect2Di& imageRect = view.subImage.imageRect;
+                    scaledView.inputViewport = ClampViewport(imageRect.offset.x, imageRect.offset.y, imageRect.extent.width, imageRect.extent.height, imageInfo.width, imageInfo.height);
+                    scaledView.outputViewport = MapOutputViewport(scaledView.inputViewport, imageInfo.width, imageInfo.height, commonResources.outputWidth, commonResources.outputHeight,
+                                                                  commonResources.isUpscaling);
+                    renderWidth = scaledView.inputViewport.width;
+                    renderHeight = scaledView.inputViewport.height;
+
+                    // Update the statistics. Dynamic resolution also accounts for the scaler's time.
+                    if (IsGpuTimingEnabled())
+                    {
+                        PollTimer(commonResources.scalerTimer, stats.scalerTime, stats.lastScalerTime);
+                        PollTimer(commonResources.colorConversionTimer, stats.colorConversionTime, stats.lastColorConversionTime);
+                        stats.droppedSamples += commonResources.scalerTimer.ring.takeDropped() + commonResources.colorConversionTimer.ring.takeDropped();
+                    }
                     if (config.enableStats)
                     {
-                        stats.totalScalerTime += QueryTimer(commonResources.scalerTimer);
-                        stats.totalColorConversionTime += QueryTimer(commonResources.colorConversionTimer);
-
                         const uint64_t now = GetTickCount64();
                         if (now >= stats.nextWindow || (scalingMode != lastFrameScalingMode && stats.numFrames))
                         {
-                            Log("numFrames=%u (%u fps), scalerTime=%lu, colorConversionTime=%lu\n",
-                                stats.numFrames, (1000 * stats.numFrames) / (now - stats.windowBeginning),
-                                stats.totalScalerTime / stats.numFrames,
-                                stats.totalColorConversionTime / stats.numFrames);
+                            Log("numFrames=%u (%u fps), scalerTime(p50/p90/p99/max)=%llu/%llu/%llu/%llu, colorConversionTime(p50/p90/p99/max)=%llu/%llu/%llu/%llu, appGpuTime(p50/p90/p99/max)=%llu/%llu/%llu/%llu, renderScale=%.3f, droppedSamples=%llu\n",
+                                stats.numFrames, (uint32_t)((1000 * stats.numFrames) / (now - stats.windowBeginning)),
+                                stats.scalerTime.percentile(0.5), stats.scalerTime.percentile(0.9), stats.scalerTime.percentile(0.99), stats.scalerTime.maximum(),
+                                stats.colorConversionTime.percentile(0.5), stats.colorConversionTime.percentile(0.9), stats.colorConversionTime.percentile(0.99), stats.colorConversionTime.maximum(),
+                                stats.appGpuTime.percentile(0.5), stats.appGpuTime.percentile(0.9), stats.appGpuTime.percentile(0.99), stats.appGpuTime.maximum(),
+                                config.dynamicResolution ? renderScale : config.scaleFactor, stats.droppedSamples);
 
                             stats.Reset();
 
@@ -1046,35 +1929,81 @@ float4 psMain(in float4 position : SV_POSITION, in float2 texcoord : TEXCOORD0)
                     // Adjust the scaler's settings if needed.
                     if (abs(config.sharpness - newSharpness) > FLT_EPSILON)
                     {
-                        if (commonResources.bilinearScaler)
-                        {
-                            commonResources.bilinearScaler->update(imageInfo.width, imageInfo.height, actualDisplayWidth, actualDisplayHeight);
-                        }
-                        if (commonResources.NISScaler)
-                        {
-                            commonResources.NISScaler->update(newSharpness, imageInfo.width, imageInfo.height, actualDisplayWidth, actualDisplayHeight);
-                        }
-                        else
-                        {
-                            commonResources.NISSharpen->update(newSharpness, imageInfo.width, imageInfo.height);
-                        }
                         config.sharpness = newSharpness;
                     }
 
-                    // Invoke the scaler.
-                    // TODO: Need to handle imageRect properly.
-                    ID3D11ShaderResourceView* const srv = swapchainResources.appTextureSrv[view.subImage.imageArrayIndex].Get();
-                    ID3D11UnorderedAccessView* const uav = swapchainResources.upscaledTextureUav[view.subImage.imageArrayIndex].Get();
+                    // With foveated scaling, NIS only processes the center region, and the periphery is upscaled with
+                    // bilinear filtering. The region is placed so that both sample the input at the same positions.
+                    scaledView.isFoveated = scalingMode == ScalingMode::NIS &&
+                                            ComputeFoveatedRegion(DescribeFoveation(j), scaledView.inputViewport.width, scaledView.inputViewport.height,
+                                                                  scaledView.outputViewport.width, scaledView.outputViewport.height, scaledView.region);
+                }
+
+                // Invoke the scaler. The consecutive views of a swapchain image (the slices of a texture array, or views side
+                // by side in a texture) are processed as a batch, with a single timer sample, a single dispatch for each
+                // scaler (NIS, bilinear, and the periphery of all the foveated views), and a single unbind of the output.
+                for (uint32_t first = 0, last; first < proj->viewCount; first = last)
+                {
+                    if (!scaledViews[first].resources)
+                    {
+                        last = first + 1;
+                        continue;
+                    }
+                    last = FindViewBatchEnd(scaledViews, proj->viewCount, first);
+
+                    const ScalerResources& commonResources = *scaledViews[first].resources;
+                    const XrSwapchainCreateInfo& imageInfo = commonResources.swapchainInfo;
+                    const SwapchainImageResources& swapchainResources = *scaledViews[first].imageResources;
                     if (scalingMode == ScalingMode::NIS)
                     {
                         StartTimer(commonResources.scalerTimer);
-                        if (commonResources.NISScaler)
+                        scalerSamples++;
+
+                        // A multisampled swapchain is resolved while it is read, by both the periphery scaler and NIS.
+                        BilinearView peripheryViews[BilinearRenderer::MaxViews];
+                        uint32_t peripheryViewCount = 0;
+                        for (uint32_t j = first; j < last; j++)
                         {
-                            commonResources.NISScaler->dispatch(&srv, &uav);
+                            const ScaledView& scaledView = scaledViews[j];
+                            if (scaledView.isFoveated)
+                            {
+                                const FoveatedRegion& region = scaledView.region;
+                                peripheryViews[peripheryViewCount++] = BilinearView{ scaledView.slice, scaledView.inputViewport, scaledView.slice, scaledView.outputViewport,
+                                                                                     NISViewport{ region.outputX, region.outputY, region.outputWidth, region.outputHeight } };
+                            }
                         }
-                        else
+                        if (peripheryViewCount && commonResources.peripheryScaler->update(peripheryViews, peripheryViewCount, imageInfo.width, imageInfo.height,
+                                                                                           commonResources.isSrgbAliased))
+                        {
+                            ID3D11ShaderResourceView* const srv = swapchainResources.appTextureArraySrv.Get();
+                            ID3D11UnorderedAccessView* const uav = swapchainResources.upscaledTextureArrayUav.Get();
+                            commonResources.peripheryScaler->dispatch(&srv, &uav);
+                        }
+
+                        NISView views[NISRenderer::MaxViews];
+                        for (uint32_t j = first; j < last; j++)
                         {
-                            commonResources.NISSharpen->dispatch(&srv, &uav);
+                            const ScaledView& scaledView = scaledViews[j];
+                            NISView& view = views[j - first];
+                            view.inputSlice = view.outputSlice = scaledView.slice;
+                            if (scaledView.isFoveated)
+                            {
+                                const FoveatedRegion& region = scaledView.region;
+                                view.inputViewport = NISViewport{ scaledView.inputViewport.x + region.inputX, scaledView.inputViewport.y + region.inputY, region.inputWidth, region.inputHeight };
+                                view.outputViewport = NISViewport{ scaledView.outputViewport.x + region.outputX, scaledView.outputViewport.y + region.outputY, region.outputWidth, region.outputHeight };
+                            }
+                            else
+                            {
+                                view.inputViewport = scaledView.inputViewport;
+                                view.outputViewport = scaledView.outputViewport;
+                            }
+                        }
+                        if (commonResources.NISScaler->update(first, config.sharpness, views, last - first, imageInfo.width, imageInfo.height,
+                                                              commonResources.outputWidth, commonResources.outputHeight, commonResources.isSrgbAliased))
+                        {
+                            ID3D11ShaderResourceView* const srv = swapchainResources.appTextureArraySrv.Get();
+                            ID3D11UnorderedAccessView* const uav = swapchainResources.upscaledTextureArrayUav.Get();
+                            commonResources.NISScaler->dispatch(first, &srv, &uav);
                         }
                         StopTimer(commonResources.scalerTimer);
 
@@ -1084,19 +2013,67 @@ float4 psMain(in float4 position : SV_POSITION, in float2 texcoord : TEXCOORD0)
                     }
                     else if (scalingMode == ScalingMode::Bilinear)
                     {
+                        // The periphery scaler upscales the region rendered by the application (which changes with dynamic
+                        // resolution), and resolves the multisampled swapchains at the same time.
                         StartTimer(commonResources.scalerTimer);
-                        commonResources.bilinearScaler->dispatch(&srv, &uav);
+                        scalerSamples++;
+                        BilinearView views[BilinearRenderer::MaxViews];
+                        for (uint32_t j = first; j < last; j++)
+                        {
+                            const ScaledView& scaledView = scaledViews[j];
+                            views[j - first] = BilinearView{ scaledView.slice, scaledView.inputViewport, scaledView.slice, scaledView.outputViewport, {} };
+                        }
+                        if (commonResources.peripheryScaler->update(views, last - first, imageInfo.width, imageInfo.height, commonResources.isSrgbAliased))
+                        {
+                            ID3D11ShaderResourceView* const srv = swapchainResources.appTextureArraySrv.Get();
+                            ID3D11UnorderedAccessView* const uav = swapchainResources.upscaledTextureArrayUav.Get();
+                            commonResources.peripheryScaler->dispatch(&srv, &uav);
+                        }
                         StopTimer(commonResources.scalerTimer);
 
                         // Unbind the UAV to avoid D3D debug layer warning.
                         ID3D11UnorderedAccessView* const uavs = { nullptr };
-                        deviceResources.context()->CSSetUnorderedAccessViews(1, 1, &uavs, nullptr);
+                        deviceResources.context()->CSSetUnorderedAccessViews(0, 1, &uavs, nullptr);
+                    }
+                }
+
+                for (uint32_t j = 0; j < proj->viewCount; j++)
+                {
+                    const ScaledView& scaledView = scaledViews[j];
+                    if (!scaledView.resources)
+                    {
+                        continue;
                     }
 
+                    const ScalerResources& commonResources = *scaledView.resources;
+                    const XrSwapchainCreateInfo& imageInfo = commonResources.swapchainInfo;
+                    const SwapchainImageResources& swapchainResources = *scaledView.imageResources;
+                    const bool indirectMode = IsIndirectlySupportedColorFormat((DXGI_FORMAT)imageInfo.format);
+                    const bool needColorConversion = commonResources.needColorConversion;
+
                     // Perform color conversion if needed. We also reuse this (basic) shader to perform unfiltered upscale for comparison.
                     if (needColorConversion || scalingMode == ScalingMode::Flat)
                     {
                         StartTimer(scalingMode == ScalingMode::Flat ? commonResources.scalerTimer : commonResources.colorConversionTimer);
+                        (scalingMode == ScalingMode::Flat ? scalerSamples : colorConversionSamples)++;
+
+                        // Flat upscaling reads the region submitted by the application, color conversion reads the region
+                        // written by the scaler.
+                        const bool isFlat = scalingMode == ScalingMode::Flat;
+                        const NISViewport& sourceViewport = isFlat ? scaledView.inputViewport : scaledView.outputViewport;
+                        const float sourceWidth = (float)(isFlat ? imageInfo.width : commonResources.outputWidth);
+                        const float sourceHeight = (float)(isFlat ? imageInfo.height : commonResources.outputHeight);
+                        const bool isFlatMultisampled = isFlat && imageInfo.sampleCount > 1;
+                        ColorConversionConstants constants{
+                            { sourceViewport.x / sourceWidth, sourceViewport.y / sourceHeight, sourceViewport.width / sourceWidth, sourceViewport.height / sourceHeight },
+                            scaledView.slice,
+                            isFlatMultisampled ? imageInfo.sampleCount : 0
+                        };
+                        if (isFlatMultisampled)
+                        {
+                            memcpy(constants.sampleWeights, commonResources.sampleWeights, sizeof(constants.sampleWeights));
+                        }
+                        deviceResources.updateConstBuffer(&constants, sizeof(constants), colorConversionConstantBuffer.Get());
 
                         ComPtr<ID3D11DeviceContext> executionContext;
                         if (!config.fastContextSwitch)
@@ -1111,16 +2088,27 @@ float4 psMain(in float4 position : SV_POSITION, in float2 texcoord : TEXCOORD0)
                         }
 
                         // Draw a quad to invoke our shader.
-                        ID3D11RenderTargetView* const rtvs[] = { swapchainResources.runtimeTextureRtv[view.subImage.imageArrayIndex].Get() };
+                        ID3D11RenderTargetView* const rtvs[] = { swapchainResources.runtimeTextureRtv[scaledView.slice].Get() };
                         executionContext->OMSetRenderTargets(1, rtvs, nullptr);
                         executionContext->OMSetBlendState(nullptr, nullptr, 0xffffffff);
                         executionContext->OMSetDepthStencilState(nullptr, 0);
                         executionContext->VSSetShader(colorConversionVertexShader.Get(), nullptr, 0);
-                        executionContext->PSSetShader(colorConversionPixelShader.Get(), nullptr, 0);
-                        ID3D11ShaderResourceView* const srvs[] = {
-                            scalingMode == ScalingMode::Flat ? swapchainResources.appTextureSrv[view.subImage.imageArrayIndex].Get() : commonResources.intermediateTextureSrv[view.subImage.imageArrayIndex].Get()
-                        };
-                        executionContext->PSSetShaderResources(0, 1, srvs);
+                        // The samples of a multisampled swapchain are resolved while they are read.
+                        executionContext->PSSetShader(isFlatMultisampled ? colorConversionPixelShaderMS.Get() : colorConversionPixelShader.Get(), nullptr, 0);
+                        if (isFlatMultisampled)
+                        {
+                            ID3D11ShaderResourceView* const srvs[] = { swapchainResources.appTextureArraySrv.Get() };
+                            executionContext->PSSetShaderResources(1, 1, srvs);
+                        }
+                        else
+                        {
+                            ID3D11ShaderResourceView* const srvs[] = {
+                                isFlat ? swapchainResources.appTextureSrv[scaledView.slice].Get() : commonResources.intermediateTextureSrv[scaledView.slice].Get()
+                            };
+                            executionContext->PSSetShaderResources(0, 1, srvs);
+                        }
+                        executionContext->VSSetConstantBuffers(0, 1, colorConversionConstantBuffer.GetAddressOf());
+                        executionContext->PSSetConstantBuffers(0, 1, colorConversionConstantBuffer.GetAddressOf());
                         ID3D11SamplerState* const ss[] = { colorConversionSampler.Get() };
                         executionContext->PSSetSamplers(0, 1, ss);
                         executionContext->IASetIndexBuffer(nullptr, DXGI_FORMAT_UNKNOWN, 0);
@@ -1128,10 +2116,11 @@ float4 psMain(in float4 position : SV_POSITION, in float2 texcoord : TEXCOORD0)
                         executionContext->IASetInputLayout(nullptr);
                         executionContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
 
-                        // TODO: Need to handle imageRect properly.
-                        CD3D11_VIEWPORT viewport(0.f, 0.f, (float)actualDisplayWidth, (float)actualDisplayHeight);
+                        // Only process the region written by the scaler, or the region submitted by the application.
+                        const NISViewport& outputViewport = scaledView.outputViewport;
+                        CD3D11_VIEWPORT viewport((float)outputViewport.x, (float)outputViewport.y, (float)outputViewport.width, (float)outputViewport.height);
                         executionContext->RSSetViewports(1, &viewport);
-                        executionContext->RSSetState(imageInfo.sampleCount > 1 ? colorConversionRasterizerMSAA.Get() : colorConversionRasterizer.Get());
+                        executionContext->RSSetState(colorConversionRasterizer.Get());
 
                         executionContext->Draw(3, 0);
 
@@ -1150,68 +2139,119 @@ float4 psMain(in float4 position : SV_POSITION, in float2 texcoord : TEXCOORD0)
                         StopTimer(scalingMode == ScalingMode::Flat ? commonResources.scalerTimer : commonResources.colorConversionTimer);
                     }
 
-                    // Forward the real texture size to OpenXR.
-                    // TODO: This is non-compliant AND dangerous. We cannot bypass the constness here and should make a copy instead.
-                    ((XrCompositionLayerProjectionView*)&view)->subImage.imageRect.extent.width = actualDisplayWidth;
-                    ((XrCompositionLayerProjectionView*)&view)->subImage.imageRect.extent.height = actualDisplayHeight;
+                    // Forward the region written by the scaler to OpenXR.
+                    chainViews[j].subImage.imageRect.offset.x = (int32_t)scaledView.outputViewport.x;
+                    chainViews[j].subImage.imageRect.offset.y = (int32_t)scaledView.outputViewport.y;
+                    chainViews[j].subImage.imageRect.extent.width = (int32_t)scaledView.outputViewport.width;
+                    chainViews[j].subImage.imageRect.extent.height = (int32_t)scaledView.outputViewport.height;
 
                     // Take a screenshot if requested.
                     if (takeScreenshot)
                     {
-                        std::stringstream parameters;
-                        if (scalingMode == ScalingMode::NIS)
-                        {
-                            parameters << "NIS_" << std::fixed << std::setprecision(3) << config.scaleFactor << "_" << config.sharpness;
-                        }
-                        else
-                        {
-                            parameters << "upscaled_" << std::fixed << std::setprecision(3) << config.scaleFactor;
-                        }
-                        const std::time_t now = std::time(nullptr);
-                        char datetime[1024];
-                        std::strftime(datetime, sizeof(datetime), "%Y%m%d_%H%M%S_", std::localtime(&now));
-                        const std::string screenshotFilename = config.name + "_" + datetime + parameters.str() + ".dds";
-                        std::string screenshotPath = (std::filesystem::path(getenv("LOCALAPPDATA")) / screenshotFilename).string();
-                        const HRESULT hr = D3DX11SaveTextureToFileA(deviceResources.context(), swapchainResources.runtimeTexture, D3DX11_IFF_DDS, screenshotPath.c_str());
-                        if (SUCCEEDED(hr))
-                        {
-                            Log("Screenshot saved to %s\n", screenshotPath.c_str());
-                        }
-                        else
-                        {
-                            Log("Failed to take screenshot: %d\n", hr);
-                        }
+                        const DXGI_FORMAT runtimeFormat = indirectMode && isIntermediateFormatCompatible ? (DXGI_FORMAT)config.intermediateFormat : (DXGI_FORMAT)imageInfo.format;
+                        CaptureScreenshot(swapchainResources.runtimeTexture, scaledView.slice, runtimeFormat);
                         takeScreenshot = false;
                     }
 
-                    // Perform upscaling for the depth layer if needed.
-                    const XrBaseInStructure* entry = reinterpret_cast<const XrBaseInStructure*>(view.next);
-                    while (entry)
+                    // Record the frame if a burst capture is in progress.
+                    if (captureFramesRemaining)
                     {
-                        if (entry->type == XR_TYPE_COMPOSITION_LAYER_DEPTH_INFO_KHR)
+                        const DXGI_FORMAT runtimeFormat = indirectMode && isIntermediateFormatCompatible ? (DXGI_FORMAT)config.intermediateFormat : (DXGI_FORMAT)imageInfo.format;
+                        CaptureFrame(CaptureStage::Output, swapchainResources.runtimeTexture, scaledView.slice, runtimeFormat, j, frameEndInfo->displayTime);
+                        if (config.captureInput)
                         {
-                            const XrCompositionLayerDepthInfoKHR* depth = reinterpret_cast<const XrCompositionLayerDepthInfoKHR*>(entry);
-
-                            // TODO: Support depth.
-                            break;
+                            CaptureFrame(CaptureStage::Input, swapchainResources.appTexture.Get(), scaledView.slice, (DXGI_FORMAT)imageInfo.format, j, frameEndInfo->displayTime);
                         }
+                    }
+                }
+
+                // Upscale the depth submitted with the views, and forward the full-size depth textures to OpenXR. The depth
+                // information is replaced wherever it appears in the chain of a view, unless a structure unknown to the layer
+                // comes before it (see FrameSubmission::copyDepthInfo()).
+                for (uint32_t j = 0; j < proj->viewCount; j++)
+                {
+                    const XrCompositionLayerDepthInfoKHR* const depth = FindDepthInfo(proj->views[j].next);
+                    const ScalerResources* const depthResources = depth ? scalerResources.find(depth->subImage.swapchain) : nullptr;
+                    if (!depthResources || !depthResources->depthScaler)
+                    {
+                        continue;
+                    }
 
-                        entry = entry->next;
+                    XrCompositionLayerDepthInfoKHR* const chainDepth = submission.copyDepthInfo(chainViews[j]);
+                    if (!chainDepth)
+                    {
+                        static bool isLogged = false;
+                        if (!isLogged)
+                        {
+                            Log("The depth of view %u follows an unknown structure and cannot be upscaled\n", j);
+                            isLogged = true;
+                        }
+                        continue;
                     }
+                    chainDepth->subImage.imageRect = UpscaleDepth(*depthResources, depth->subImage);
                 }
             }
         }
 
         lastFrameScalingMode = scalingMode;
+        lastFrameScalerSamples = scalerSamples;
+        lastFrameColorConversionSamples = colorConversionSamples;
+
+        if (captureFramesRemaining)
+        {
+            captureFramesRemaining--;
+            captureFrameIndex++;
+        }
+
+        if (telemetry.isOpen())
+        {
+            TelemetryRecord record{};
+            record.frameIndex = frameIndex;
+            record.cpuTime = (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - frameStart).count();
+            record.scalerTime = (uint32_t)stats.lastScalerTime;
+            record.colorConversionTime = (uint32_t)stats.lastColorConversionTime;
+            record.appGpuTime = (uint32_t)stats.lastAppGpuTime;
+            record.scalingMode = scalingMode;
+            record.sharpness = config.sharpness;
+            record.renderScale = config.dynamicResolution ? renderScale : config.scaleFactor;
+            record.renderWidth = renderWidth;
+            record.renderHeight = renderHeight;
+            record.displayWidth = actualDisplayWidth;
+            record.displayHeight = actualDisplayHeight;
+            telemetry.publish(record);
+        }
+        frameIndex++;
 
         // Call the chain to perform the actual submission.
-        const XrResult result = next_xrEndFrame(session, frameEndInfo);
+        const XrResult result = next_xrEndFrame(session, submission.get());
 
         DebugLog("<-- NISScaler_xrEndFrame %d\n", result);
 
         return result;
     }
 
+    // We override this OpenXR API in order to stop our threads: the loader may unload the layer once the instance is
+    // destroyed.
+    XrResult NISScaler_xrDestroyInstance(
+        const XrInstance instance)
+    {
+        DebugLog("--> NISScaler_xrDestroyInstance\n");
+
+        // Call the chain to perform the actual operation.
+        const XrResult result = next_xrDestroyInstance(instance);
+
+        DebugLog("<-- NISScaler_xrDestroyInstance %d\n", result);
+
+        if (result == XR_SUCCESS)
+        {
+            configWatcher.stop();
+            StopLogging();
+            isLogging = false;
+        }
+
+        return result;
+    }
+
     // Entry point for OpenXR calls.
     XrResult NISScaler_xrGetInstanceProcAddr(
         const XrInstance instance,
@@ -1222,7 +2262,7 @@ float4 psMain(in float4 position : SV_POSITION, in float2 texcoord : TEXCOORD0)
 
         // Call the chain to resolve the next function pointer.
         const XrResult result = next_xrGetInstanceProcAddr(instance, name, function);
-        if (config.loaded && result == XR_SUCCESS)
+        if (result == XR_SUCCESS)
         {
             const std::string apiName(name);
 
@@ -1233,14 +2273,22 @@ float4 psMain(in float4 position : SV_POSITION, in float2 texcoord : TEXCOORD0)
                 *function = reinterpret_cast<PFN_xrVoidFunction>(NISScaler_##xrCall);   \
             }
 
-            INTERCEPT_CALL(xrEnumerateViewConfigurationViews);
-            INTERCEPT_CALL(xrCreateSwapchain);
-            INTERCEPT_CALL(xrDestroySwapchain);
-            INTERCEPT_CALL(xrEnumerateSwapchainImages);
-            INTERCEPT_CALL(xrCreateSession);
-            INTERCEPT_CALL(xrDestroySession);
-            INTERCEPT_CALL(xrAcquireSwapchainImage);
-            INTERCEPT_CALL(xrEndFrame);
+            // Our threads are stopped with the instance, even when the layer is not enabled for the application.
+            INTERCEPT_CALL(xrDestroyInstance);
+
+            if (config.loaded || isProfileMatchPending)
+            {
+                INTERCEPT_CALL(xrGetSystem);
+                INTERCEPT_CALL(xrEnumerateViewConfigurationViews);
+                INTERCEPT_CALL(xrCreateSwapchain);
+                INTERCEPT_CALL(xrDestroySwapchain);
+                INTERCEPT_CALL(xrEnumerateSwapchainImages);
+                INTERCEPT_CALL(xrCreateSession);
+                INTERCEPT_CALL(xrDestroySession);
+                INTERCEPT_CALL(xrAcquireSwapchainImage);
+                INTERCEPT_CALL(xrBeginFrame);
+                INTERCEPT_CALL(xrEndFrame);
+            }
 
 #undef INTERCEPT_CALL
 
@@ -1299,9 +2347,38 @@ float4 psMain(in float4 position : SV_POSITION, in float2 texcoord : TEXCOORD0)
 
             next_xrGetInstanceProcAddr(*instance, "xrEnumerateSwapchainFormats", reinterpret_cast<PFN_xrVoidFunction*>(&next_xrEnumerateSwapchainFormats));
 
-            // Identify the application and load our configuration.
-            LoadConfiguration(instanceCreateInfo->applicationInfo.applicationName);
-            config.Dump();
+            // The adapter can only be queried when the application enabled D3D11 support.
+            isD3D11Enabled = false;
+            for (uint32_t i = 0; i < instanceCreateInfo->enabledExtensionCount; i++)
+            {
+                isD3D11Enabled = isD3D11Enabled || std::string(instanceCreateInfo->enabledExtensionNames[i]) == XR_KHR_D3D11_ENABLE_EXTENSION_NAME;
+            }
+
+            // Identify the application and load our configuration. The profile database, when present, takes precedence
+            // over the registry. The profiles are matched once the application picks its system: querying the system
+            // from here would make calls that the application did not make yet.
+            applicationName = instanceCreateInfo->applicationInfo.applicationName;
+            appliedRevision = 0;
+            config.Reset();
+            profileDatabasePath = (std::filesystem::path(getenv("LOCALAPPDATA")) / std::filesystem::path(LayerName + ".profiles")).string();
+            if (std::filesystem::exists(profileDatabasePath))
+            {
+                Log("Using profile database \"%s\"\n", profileDatabasePath.c_str());
+                isProfileMatchPending = true;
+            }
+            else
+            {
+                auto configSource = std::make_unique<RegistryConfigSource>(RegPrefix);
+                LoadConfiguration(*configSource, applicationName);
+                config.Dump();
+
+                // Watch for changes made from the configuration tool.
+                if (config.loaded)
+                {
+                    configWatcher.start(std::move(configSource), config);
+                    appliedRevision = configWatcher.latest()->revision;
+                }
+            }
         }
 
         DebugLog("<-- NISScaler_xrCreateApiLayerInstance %d\n", result);
@@ -1341,11 +2418,20 @@ extern "C" {
         }
 
         // Start logging to file.
-        if (!logStream.is_open())
+        if (!isLogging)
         {
             std::string logFile = (std::filesystem::path(getenv("LOCALAPPDATA")) / std::filesystem::path(LayerName + ".log")).string();
-            logStream.open(logFile, std::ios_base::ate);
+            StartLogging(logFile);
             Log("dllHome is \"%s\"\n", dllHome.c_str());
+            isLogging = true;
+        }
+
+        if (!shaderCache)
+        {
+            shaderCache = std::make_unique<ShaderCache>((std::filesystem::path(getenv("LOCALAPPDATA")) / std::filesystem::path(LayerName + ".shaders")).string());
+
+            // A missing database means that no GPU was tuned yet.
+            tuningDatabase.load((std::filesystem::path(getenv("LOCALAPPDATA")) / std::filesystem::path(LayerName + ".tuning")).string());
         }
 
         DebugLog("--> NISScaler_xrNegotiateLoaderApiLayerInterface\n");
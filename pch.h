@@ -8,7 +8,7 @@
 #define PCH_H
 
 // Standard library.
-#include <cstdarg>
+#include <chrono>
 #include <ctime>
 #include <filesystem>
 #include <iomanip>